@@ -216,6 +216,29 @@ reference.
     warn "$key not found\n" unless $x; # WRONG; message never printed
     warn "$key not found\n" unless @$x; # Correct
 
+C<multi_get> also accepts a reference to an array of keys, in which case
+all keys are looked up in a single batched call and it returns a reference
+to an array containing the first value of each key, or B<undef> for a key
+which is undefined or not found.  This prints B<gato undef conejo>.
+
+    $x = $catref->multi_get([ 'cat', 'foo', 'rabbit' ]);
+    print join(' ', map { defined $_ ? $_ : 'undef' } @$x);
+
+The C<iter_next> method iterates over all records in database order,
+setting the caller-supplied scalars to the key and (optionally) value
+of the next record.  The scalars and their buffers are reused, so no
+new scalars are allocated per record as for C<each>.  (Compressed values
+of a database made with B<mcdbctl make -Z> are decompressed into the
+value scalar buffer.)  C<iter_next>
+returns false after the last record and the next call starts again at
+the first record.  C<iter_reset> restarts iteration.  This iteration is
+independent of C<each>, C<keys> and C<values> on the tied hash.
+
+    my ($k, $v);
+    while ($catref->iter_next($k, $v)) {
+            print "$k:$v ";
+    }
+
 Any extra references to C<MCDB_File> object (like C<$catref> in the
 examples above) must be released with C<undef> or must have gone out of
 scope before calling C<untie> on the hash.  This ensures that the object's
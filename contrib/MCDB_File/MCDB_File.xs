@@ -24,6 +24,7 @@ struct mcdbxs_read {
     struct mcdb m;
     struct mcdb_iter iter;
     bool values;            /* flag for values() processing */
+    struct mcdb_iter scan;  /* iter_next() (independent of tied hash iter) */
 };
 
 static SV *
@@ -36,6 +37,54 @@ mcdbxs_svcp (const unsigned char * const restrict p, const STRLEN len)
     return sv;
 }
 
+/* compressed data (MCDB_FMT_VALZ) is decompressed into new SV */
+static SV *
+mcdbxs_svzcp (const struct mcdb * const restrict m,
+              const struct mcdb_iter * const restrict iter)
+{
+    const STRLEN len = m ? mcdb_datalen(m) : mcdb_iter_datalen(iter);
+    SV * const restrict sv = newSV(len); /*(allocates len+1 for '\0')*/
+    if ((m ? mcdb_readdata(m, SvPVX(sv))
+           : mcdb_iter_readdata(iter, SvPVX(sv))) == NULL) {
+        const int errnum = errno;
+        SvREFCNT_dec(sv);
+        croak("MCDB_File: %s", Strerror(errnum));
+    }
+    SvPOK_on(sv);
+    SvCUR_set(sv, len);
+    (SvPVX(sv))[len] = '\0';
+    return sv;
+}
+
+#define mcdbxs_svdata(m) \
+  (mcdb_datazlen(m) == 0                            \
+   ? mcdbxs_svcp(mcdb_dataptr(m), mcdb_datalen(m))  \
+   : mcdbxs_svzcp((m), NULL))
+
+#define mcdbxs_sviterdata(iter) \
+  (mcdb_iter_datazlen(iter) == 0                              \
+   ? mcdbxs_svcp(mcdb_iter_dataptr(iter), mcdb_iter_datalen(iter)) \
+   : mcdbxs_svzcp(NULL, (iter)))
+
+/* set sv to data of iter, reusing sv buffer (decompress if MCDB_FMT_VALZ) */
+static void
+mcdbxs_sv_setiterdata (SV * const restrict sv,
+                       const struct mcdb_iter * const restrict iter)
+{
+    const STRLEN len = mcdb_iter_datalen(iter);
+    char *p;
+    if (mcdb_iter_datazlen(iter) == 0) {
+        sv_setpvn(sv, (char *)mcdb_iter_dataptr(iter), len);
+        return;
+    }
+    sv_setpvn(sv, "", 0);
+    p = SvGROW(sv, len+1);
+    if (mcdb_iter_readdata(iter, p) == NULL)
+        croak("MCDB_File::iter_next: %s", Strerror(errno));
+    SvCUR_set(sv, len);
+    p[len] = '\0';
+}
+
 static bool
 mcdbxs_is_iterkey (struct mcdb_iter * const restrict iter,
                    const char * const restrict kp, const STRLEN klen)
@@ -58,6 +107,45 @@ mcdbxs_nextkey (struct mcdbxs_read * const restrict this)
       : (SV *)(iter->ptr = NULL);
 }
 
+/* batched lookup (mcdb_find_batch()) of keys in array, in windows of keys;
+ * push first value of each key (or undef if key undef or not found) onto ret */
+#define MCDBXS_BATCH 64
+static void
+mcdbxs_multi_get_av (struct mcdbxs_read * const restrict this,
+                     AV * const restrict keys, AV * const restrict ret)
+{
+    struct mcdb ms[MCDBXS_BATCH];
+    const char *kp[MCDBXS_BATCH];
+    size_t klen[MCDBXS_BATCH];
+    bool kundef[MCDBXS_BATCH];
+    const I32 n = av_len(keys) + 1;
+    I32 i, j, w;
+    SV **svp;
+    STRLEN len;
+    if (n > 0)
+        av_extend(ret, n-1);
+    for (j = 0; j < n; j += w) {
+        w = (n - j < MCDBXS_BATCH) ? n - j : MCDBXS_BATCH;
+        for (i = 0; i < w; ++i) {
+            ms[i].map = this->m.map;
+            svp = av_fetch(keys, j+i, 0);
+            if ((kundef[i] = (svp == NULL || !SvOK(*svp)))) {
+                kp[i]   = "";
+                klen[i] = 0;
+            }
+            else {
+                kp[i]   = SvPV(*svp, len);
+                klen[i] = len;
+            }
+        }
+        (void) mcdb_find_batch(ms, (size_t)w, kp, klen);
+        for (i = 0; i < w; ++i)
+            av_push(ret, ms[i].loop != 0 && !kundef[i]
+                         ? mcdbxs_svdata(ms+i)
+                         : newSV(0));
+    }
+}
+
 static void *
 mcdbxs_malloc (size_t sz)
 {
@@ -96,6 +184,7 @@ mcdbxs_TIEHASH(CLASS, filename)
         RETVAL->iter.ptr  = NULL;
         RETVAL->iter.eod  = NULL;
         RETVAL->values    = false;
+        mcdb_iter_init(&RETVAL->scan, &RETVAL->m);
     }
     else {
         Safefree(RETVAL);
@@ -139,7 +228,7 @@ mcdbxs_find(this, k)
   CODE:
     kp = SvPV(k, klen);
     if (mcdb_find(&this->m, kp, klen))
-        RETVAL = mcdbxs_svcp(mcdb_dataptr(&this->m), mcdb_datalen(&this->m));
+        RETVAL = mcdbxs_svdata(&this->m);
     else
         XSRETURN_UNDEF;
   OUTPUT:
@@ -157,18 +246,17 @@ mcdbxs_FETCH(this, k)
   CODE:
     kp = SvPV(k, klen);
     if (mcdbxs_is_iterkey(&this->iter, kp, klen)) {
-        RETVAL = mcdbxs_svcp(mcdb_iter_dataptr(&this->iter),
-                             mcdb_iter_datalen(&this->iter));
+        RETVAL = mcdbxs_sviterdata(&this->iter);
         if (this->values && !mcdb_iter(&this->iter)) {
             this->values = false; this->iter.ptr = this->iter.eod = NULL;
         }
     }
     else if (mcdb_find(&this->m, kp, klen)) {
-        RETVAL = mcdbxs_svcp(mcdb_dataptr(&this->m), mcdb_datalen(&this->m));
+        RETVAL = mcdbxs_svdata(&this->m);
         /* messiness required to detect Perl calling FETCH for values()
          * after having obtained all FIRSTKEY/NEXTKEY; needed to support
          * (duplicated) keys with multiple values, permitted in mcdb */
-        if (this->iter.eod && MCDB_HEADER_SZ == mcdb_datapos(&this->m)-klen-8) {
+        if (this->iter.eod && MCDB_HEADER_SZ == this->m.rpos-klen-8) {
             this->values = true;
             mcdb_iter_init(&this->iter, &this->m);
             if (!mcdb_iter(&this->iter) || !mcdb_iter(&this->iter)) {
@@ -215,6 +303,8 @@ mcdbxs_DESTROY(sv)
         Safefree(this);
     }
 
+# /*(multi_get(\@keys) returns first value of each key in a single batched
+#  * lookup; multi_get($key) returns all values of (repeated) key)*/
 AV *
 mcdbxs_multi_get(this, k)
     struct mcdbxs_read * this;
@@ -225,16 +315,45 @@ mcdbxs_multi_get(this, k)
   INIT:
     if (!SvOK(k)) XSRETURN_UNDEF;
   CODE:
-    kp = SvPV(k, klen);
     RETVAL = newAV();   /* might be redundant (see .c generated from .xs) */
     sv_2mortal((SV *)RETVAL);
-    if (mcdb_findstart(&this->m, kp, klen))
-        while (mcdb_findnext(&this->m, kp, klen))
-            av_push(RETVAL,
-                    mcdbxs_svcp(mcdb_dataptr(&this->m),mcdb_datalen(&this->m)));
+    if (SvROK(k) && SvTYPE(SvRV(k)) == SVt_PVAV)
+        mcdbxs_multi_get_av(this, (AV *)SvRV(k), RETVAL);
+    else {
+        kp = SvPV(k, klen);
+        if (mcdb_findstart(&this->m, kp, klen))
+            while (mcdb_findnext(&this->m, kp, klen))
+                av_push(RETVAL, mcdbxs_svdata(&this->m));
+    }
+  OUTPUT:
+    RETVAL
+
+# /*(iter_next($k, $v) sets caller-supplied scalars to next key and value,
+#  * reusing scalar buffers (no new SV per record); returns false (and resets
+#  * iterator) after last record; independent of tied hash each()/keys())*/
+int
+mcdbxs_iter_next(this, k, ...)
+    struct mcdbxs_read * this;
+    SV * k;
+  CODE:
+    RETVAL = mcdb_iter(&this->scan);
+    if (RETVAL) {
+        sv_setpvn(k, (char *)mcdb_iter_keyptr(&this->scan),
+                             mcdb_iter_keylen(&this->scan));
+        if (items >= 3)
+            mcdbxs_sv_setiterdata(ST(2), &this->scan);
+    }
+    else
+        mcdb_iter_init(&this->scan, &this->m);
   OUTPUT:
     RETVAL
 
+void
+mcdbxs_iter_reset(this)
+    struct mcdbxs_read * this;
+  CODE:
+    mcdb_iter_init(&this->scan, &this->m);
+
 
 MODULE = MCDB_File	PACKAGE = MCDB_File::Make	PREFIX = mcdbxs_make_
 
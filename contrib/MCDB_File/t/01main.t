@@ -1,7 +1,7 @@
 use strict;
 use warnings;
 
-use Test::More tests => 120;
+use Test::More tests => 136;
 use MCDB_File;
 
 my $good_file_db = 'good.mcdb';
@@ -128,6 +128,32 @@ while (my ($k, $v) = each %h) {
     ok($v->[0] eq 'conejo') if $k eq 'rabbit';
 }
 
+# Check batched multi_get of array of keys
+$v = $t->multi_get([ 'cat', 'foo', undef, 'rabbit', 'dog' ]);
+is(@$v, 5, "multi_get of array returned 5 entries");
+is($v->[0], 'gato');
+ok(! defined $v->[1], "multi_get of array: missing key undef");
+ok(! defined $v->[2], "multi_get of array: undef key undef");
+is($v->[3], 'conejo');
+is($v->[4], 'perro');
+$v = $t->multi_get([ ('dog') x 100 ]);
+is(@$v, 100, "multi_get of array larger than batch");
+is((grep { $_ eq 'perro' } @$v), 100);
+
+# Check iter_next reuses caller scalars
+my ($ik, $iv, @ik, @iv);
+while ($t->iter_next($ik, $iv)) {
+    push @ik, $ik;
+    push @iv, $iv;
+}
+is("@ik", "dog cat cat dog rabbit", "iter_next keys");
+is("@iv", "perro gato chat chien conejo", "iter_next values");
+ok($t->iter_next($ik), "iter_next restarts after end") and is($ik, 'dog');
+ok($t->iter_next($ik), "iter_next key only") and is($ik, 'cat');
+$t->iter_reset;
+ok($t->iter_next($ik), "iter_reset") and is($ik, 'dog');
+$t->iter_reset;
+
 # Test undefined keys.
 {
 
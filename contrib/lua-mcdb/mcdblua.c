@@ -44,6 +44,32 @@ static GCObject *mcdblua_gcobj;
 
 #define MCDBLUA "mcdb"
 
+/* compressed data (MCDB_FMT_VALZ) is decompressed into scratch userdata
+ * (collected by gc if lua_error() longjmps) and pushed as string */
+static void
+mcdblua_pushzdata(lua_State * const restrict L,
+                  const struct mcdb * const restrict m,
+                  const struct mcdb_iter * const restrict iter)
+{
+    const uint32_t dlen = m ? mcdb_datalen(m) : mcdb_iter_datalen(iter);
+    void * const restrict buf = lua_newuserdata(L, dlen != 0 ? dlen : 1);
+    if ((m ? mcdb_readdata(m, buf) : mcdb_iter_readdata(iter, buf)) == NULL)
+        luaL_error(L, "mcdb data: %s", strerror(errno));
+    lua_pushlstring(L, (char *)buf, dlen);
+    lua_remove(L, -2);
+}
+
+#define mcdblua_pushdata(L, m) \
+  (mcdb_datazlen(m) == 0                                                 \
+   ? (void)lua_pushlstring((L), (char *)mcdb_dataptr(m), mcdb_datalen(m)) \
+   : mcdblua_pushzdata((L), (m), NULL))
+
+#define mcdblua_pushiterdata(L, iter) \
+  (mcdb_iter_datazlen(iter) == 0                                  \
+   ? (void)lua_pushlstring((L), (char *)mcdb_iter_dataptr(iter),  \
+                                mcdb_iter_datalen(iter))          \
+   : mcdblua_pushzdata((L), NULL, (iter)))
+
 static inline void *
 mcdblua_struct(lua_State * const restrict L)
 {
@@ -90,7 +116,7 @@ mcdblua_get(lua_State * const restrict L)
     struct mcdb * const restrict m = mcdblua_struct(L);
     const char * const restrict k = luaL_checklstring(L, 2, &klen);
     mcdb_find(m, k, klen)
-      ? lua_pushlstring(L, (char *)mcdb_dataptr(m), mcdb_datalen(m))
+      ? mcdblua_pushdata(L, m)
       : lua_pushnil(L);
     return 1;
 }
@@ -102,7 +128,7 @@ mcdblua_find(lua_State * const restrict L)
     struct mcdb * const restrict m = mcdblua_struct(L);
     const char * const restrict k = luaL_checklstring(L, 2, &klen);
     return mcdb_find(m, k, klen)
-      ? (lua_pushlstring(L, (char *)mcdb_dataptr(m), mcdb_datalen(m)), 1)
+      ? (mcdblua_pushdata(L, m), 1)
       : 0;
 }
 
@@ -112,7 +138,7 @@ mcdblua_findnext(lua_State * const restrict L)
     struct mcdb * const restrict m = mcdblua_struct(L);
     return m->loop != 0
       ? mcdb_findnext(m, (const char *)mcdb_keyptr(m), mcdb_keylen(m))
-          ? (lua_pushlstring(L, (char *)mcdb_dataptr(m), mcdb_datalen(m)), 1)
+          ? (mcdblua_pushdata(L, m), 1)
           : 0
       : luaL_error(L, "findnext() called without first calling find()");
 }
@@ -126,9 +152,9 @@ mcdblua_findall(lua_State * const restrict L)
     int n = 0;
     if (mcdb_findstart(m, k, klen)) {
         while (mcdb_findnext(m, k, klen)) {
-            if (++n > LUA_MINSTACK - 2)
-                lua_checkstack(L, 1);
-            lua_pushlstring(L, (char *)mcdb_dataptr(m), mcdb_datalen(m));
+            if (++n > LUA_MINSTACK - 3)
+                lua_checkstack(L, 2);
+            mcdblua_pushdata(L, m);
         }
     }
     return n;
@@ -147,10 +173,78 @@ mcdblua_getseq(lua_State * const restrict L)
             ;
 
     return rc
-      ? (lua_pushlstring(L, (char *)mcdb_dataptr(m), mcdb_datalen(m)), 1)
+      ? (mcdblua_pushdata(L, m), 1)
       : 0;
 }
 
+#define MCDBLUA_BATCH 64
+
+static int
+mcdblua_multi_get(lua_State * const restrict L)
+{
+    /* batched lookup (mcdb_find_batch()) of array of keys; returns array of
+     * first value of each key (nil if not found).  Optional table argument
+     * is reused (and returned) as result array instead of creating table */
+    struct mcdb * const restrict m = mcdblua_struct(L);
+    struct mcdb ms[MCDBLUA_BATCH];
+    const char *kp[MCDBLUA_BATCH];
+    size_t klen[MCDBLUA_BATCH];
+    bool knil[MCDBLUA_BATCH];
+    int n, i, j, w;
+    luaL_checktype(L, 2, LUA_TTABLE);
+    n = (int)lua_objlen(L, 2);
+    if (lua_istable(L, 3)) {
+        lua_settop(L, 3);
+        for (i = (int)lua_objlen(L, 3); i > n; --i) {
+            lua_pushnil(L);
+            lua_rawseti(L, 3, i);
+        }
+    }
+    else {
+        lua_settop(L, 2);
+        lua_createtable(L, n, 0);
+    }
+    if (!lua_checkstack(L, MCDBLUA_BATCH + 2))
+        return luaL_error(L, "multi_get() stack overflow");
+    for (j = 0; j < n; j += w) {
+        w = (n - j < MCDBLUA_BATCH) ? n - j : MCDBLUA_BATCH;
+        for (i = 0; i < w; ++i) {
+            /* key strings remain on stack (valid) until lua_settop() below */
+            lua_rawgeti(L, 2, j+i+1);
+            ms[i].map = m->map;
+            if ((knil[i] = lua_isnil(L, -1))) {
+                kp[i]   = "";
+                klen[i] = 0;
+            }
+            else
+                kp[i]   = luaL_checklstring(L, -1, &klen[i]);
+        }
+        (void) mcdb_find_batch(ms, (size_t)w, kp, klen);
+        for (i = 0; i < w; ++i) {
+            ms[i].loop != 0 && !knil[i]
+              ? mcdblua_pushdata(L, ms+i)
+              : lua_pushnil(L);
+            lua_rawseti(L, 3, j+i+1);
+        }
+        lua_settop(L, 3);
+    }
+    return 1;
+}
+
+static int
+mcdblua_read(lua_State * const restrict L)
+{
+    /* read len bytes at offset in mmap (see iteroffsets()) */
+    struct mcdb * const restrict m = mcdblua_struct(L);
+    const lua_Number off = luaL_checknumber(L, 2);
+    const lua_Number len = luaL_checknumber(L, 3);
+    if (m->map == NULL || off < 0 || len < 0
+        || off + len > (lua_Number)m->map->size)
+        return luaL_error(L, "read() offset or length out of range");
+    lua_pushlstring(L, (char *)m->map->ptr + (uintptr_t)off, (size_t)len);
+    return 1;
+}
+
 static int
 mcdblua_iterkeys_closure(lua_State * const restrict L)
 {
@@ -181,8 +275,7 @@ mcdblua_itervalues_closure(lua_State * const restrict L)
     struct mcdb_iter * const restrict iter =
       lua_touserdata(L, lua_upvalueindex(1));
     if (mcdb_iter(iter)) {
-        lua_pushlstring(L, (char *)mcdb_iter_dataptr(iter),
-                                   mcdb_iter_datalen(iter));
+        mcdblua_pushiterdata(L, iter);
         return 1;
     }
     return 0;
@@ -207,8 +300,7 @@ mcdblua_iteritems_closure(lua_State * const restrict L)
     if (mcdb_iter(iter)) {
         lua_pushlstring(L, (char *)mcdb_iter_keyptr(iter),
                                    mcdb_iter_keylen(iter));
-        lua_pushlstring(L, (char *)mcdb_iter_dataptr(iter),
-                                   mcdb_iter_datalen(iter));
+        mcdblua_pushiterdata(L, iter);
         return 2;
     }
     return 0;
@@ -225,6 +317,38 @@ mcdblua_iteritems(lua_State * const restrict L)
     return 1;
 }
 
+static int
+mcdblua_iteroffsets_closure(lua_State * const restrict L)
+{
+    /* return (key offset, key len, data offset, data len) of record in mmap
+     * instead of creating key and value strings for each record
+     * (compressed data (MCDB_FMT_VALZ) is not in mmap as value; error) */
+    struct mcdb_iter * const restrict iter =
+      lua_touserdata(L, lua_upvalueindex(1));
+    if (mcdb_iter(iter)) {
+        if (mcdb_iter_datazlen(iter) != 0)
+            return luaL_error(L, "iteroffsets() of compressed data");
+        lua_pushnumber(L, (lua_Number)
+                          (mcdb_iter_keyptr(iter) - iter->map->ptr));
+        lua_pushnumber(L, (lua_Number)mcdb_iter_keylen(iter));
+        lua_pushnumber(L, (lua_Number)mcdb_iter_datapos(iter));
+        lua_pushnumber(L, (lua_Number)mcdb_iter_datalen(iter));
+        return 4;
+    }
+    return 0;
+}
+
+static int
+mcdblua_iteroffsets(lua_State * const restrict L)
+{
+    struct mcdb * const restrict m = mcdblua_struct(L);
+    struct mcdb_iter * const restrict iter =
+      lua_newuserdata(L, sizeof(struct mcdb_iter));
+    mcdb_iter_init(iter, m);
+    lua_pushcclosure(L, mcdblua_iteroffsets_closure, 1);
+    return 1;
+}
+
 static int
 mcdblua_keys(lua_State * const restrict L)
 {
@@ -253,8 +377,7 @@ mcdblua_values(lua_State * const restrict L)
     lua_createtable(L, mcdb_numrecs(m), 0);
     mcdb_iter_init(&iter, m);
     while (mcdb_iter(&iter)) {
-        lua_pushlstring(L, (char *)mcdb_iter_dataptr(&iter),
-                                   mcdb_iter_datalen(&iter));
+        mcdblua_pushiterdata(L, &iter);
         lua_rawseti(L, -2, ++n);
     }
     return 1;
@@ -274,8 +397,7 @@ mcdblua_items(lua_State * const restrict L)
     while (mcdb_iter(&iter)) {
         lua_pushlstring(L, (char *)mcdb_iter_keyptr(&iter),
                                    mcdb_iter_keylen(&iter));
-        lua_pushlstring(L, (char *)mcdb_iter_dataptr(&iter),
-                                   mcdb_iter_datalen(&iter));
+        mcdblua_pushiterdata(L, &iter);
         lua_rawset(L, -3);
     }
     return 1;
@@ -363,10 +485,13 @@ static const struct luaL_Reg mcdblua_methods[] = {
   { "findnext",   mcdblua_findnext },
   { "findall",    mcdblua_findall },
   { "getseq",     mcdblua_getseq },
+  { "multi_get",  mcdblua_multi_get },
+  { "read",       mcdblua_read },
   { "iter",       mcdblua_iterkeys },
   { "iterkeys",   mcdblua_iterkeys },
   { "itervalues", mcdblua_itervalues },
   { "iteritems",  mcdblua_iteritems },
+  { "iteroffsets",mcdblua_iteroffsets },
   { "pairs",      mcdblua_iteritems },
   { "keys",       mcdblua_keys },
   { "values",     mcdblua_values },
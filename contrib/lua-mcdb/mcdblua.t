@@ -87,6 +87,49 @@ EOF
 
 
 
+function lua_mcdb_multi_get {
+  typeset fn="$1"
+  [ -n "$fn" ] || exit 111;
+  shift
+
+  lua - "$@" <<EOF
+    local mcdb = require("mcdb")
+    local m, errstr = mcdb.init("$fn")
+    if m == nil then
+        io.stderr:write('lua_mcdb_multi_get: mcdb.init: ' .. errstr .. '\n')
+        os.exit(111)
+    end
+
+    -- batched lookup of all keys; nil for keys not found
+    local vals = m:multi_get(arg)
+    for i = 1, #arg do io.write(vals[i] or '(nil)', ' ') end
+    io.write('\n')
+EOF
+}
+
+
+function lua_mcdb_dump_offsets {
+  typeset fn="$1"
+  [ -n "$fn" ] || exit 111;
+
+  lua - <<EOF
+    local mcdb = require("mcdb")
+    local m, errstr = mcdb.init("$fn")
+    if m == nil then
+        io.stderr:write('lua_mcdb_dump_offsets: mcdb.init: ' .. errstr .. '\n')
+        os.exit(111)
+    end
+
+    -- iterate offsets into mcdb (no strings created) and read() as needed
+    for koff,klen,doff,dlen in m:iteroffsets() do
+        io.write(string.format('+%d,%d:',klen,dlen),
+                 m:read(koff,klen), '->', m:read(doff,dlen), '\n')
+    end
+    io.write('\n')
+EOF
+}
+
+
 err=0
 
 # create an mcdb
@@ -145,6 +188,16 @@ rc=$?; [ $rc -eq 0 ] && [ "$rv" = '3' ] || rc=101
 [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc: lua_mcdb_dump 12.mcdb"
 err=$(($err+$rc))
 
+rv="`lua_mcdb_multi_get services.mcdb echo/tcp xxx @9/udp`"
+rc=$?; [ $rc -eq 0 ] && [ "$rv" = '7 (nil) discard ' ] || rc=101
+[ $rc -eq 0 ] || echo 1>&2 "FAIL $rc: lua_mcdb_multi_get services.mcdb"
+err=$(($err+$rc))
+
+rv="`lua_mcdb_dump_offsets 12.mcdb`"
+rc=$?; [ $rc -eq 0 ] && [ "$rv" = "`lua_mcdb_dump 12.mcdb`" ] || rc=101
+[ $rc -eq 0 ] || echo 1>&2 "FAIL $rc: lua_mcdb_dump_offsets 12.mcdb"
+err=$(($err+$rc))
+
 
 /bin/rm -f 12.mcdb services.mcdb
 exit $err
@@ -1,6 +1,11 @@
 #! /usr/bin/env python
 
 from distutils.core import setup, Extension
+import os
+
+# libmcdb.a requires zlib if mcdb built with MCDB_ZLIB (if zlib.h is found)
+# (-lz after libmcdb.a in link args)
+zlib = ["-lz"] if os.path.exists("/usr/include/zlib.h") else []
 
 classifiers = [
     'Development Status :: 3 - Alpha',
@@ -34,8 +39,8 @@ mcdb is based on D. J. Bernstein's constant database package
                                    ["src/mcdbpy.c"],
                                    # compile,link with local, static libmcdb.a
                                    include_dirs=["../../.."],
-                                   extra_link_args=["../../libmcdb.a",
-                                     "-Wl,--version-script,src/pythonext.map"],
+                                   extra_link_args=["../../libmcdb.a"] + zlib
+                                   + ["-Wl,--version-script,src/pythonext.map"],
                                    # compile,link with system libmcdb.so
                                    #libraries=['mcdb']
                                  )
@@ -36,13 +36,13 @@
 /*
  * FUTURE:
  *
- * - mcdb_mmap_create() and mcdb_make_start() currently pass
- *   PyMem_Malloc and PyMem_Free for use allocating memory.  If mcdb causes
- *   performance problems in other Python threads, might simply pass malloc
- *   and free, instead, and then Py_BEGIN_ALLOW_THREADS/Py_END_ALLOW_THREADS
- *   around calls to mcdb_mmap_create() and mcdb_make_finish().  The latter
- *   (mcdb_make_finish()) is likely to take time on very large mcdb creation.
- *   (If we pass malloc and free, then set PyErr_NoMemory() if errno == ENOMEM)
+ * - mcdb_mmap_create() currently passes PyMem_Malloc and PyMem_Free for use
+ *   allocating memory.  If mcdb causes performance problems in other Python
+ *   threads, might simply pass malloc and free, instead, and then
+ *   Py_BEGIN_ALLOW_THREADS/Py_END_ALLOW_THREADS around mcdb_mmap_create().
+ *   (mcdb_makefn_start() and mcdb_make_start() are passed malloc and free so
+ *    that mcdb_make_add() (in mk.add_many(), mk.add_from_iter()) and
+ *    mcdb_make_finish() run with the GIL released)
  *
  * - mcdb is constant, immutable data and so there exists the possibility
  *   of returning read-only PyObject objects that directly reference the mmap
@@ -70,6 +70,7 @@
  *   Since the desire is that the caller need not do anything special to get
  *   the data stringified, python-mcdb continues to copy keys, data from mcdb.
  *   Maybe one day it will be worthwhile to write a custom Py_buffer class.
+ *   (m.get_view() and m.get_many(keys, True) return memoryview on request)
  */
 
 #include <Python.h>
@@ -169,10 +170,66 @@ struct mcdbpy {
 
 staticforward PyTypeObject mcdbpy_Type;
 
+/* compressed data (MCDB_FMT_VALZ) is decompressed into new bytes object */
+static PyObject *
+mcdbpy_read_zdata(const struct mcdb * const restrict m,
+                  const struct mcdb_iter * const restrict iter)
+{
+    const uint32_t dlen = m ? mcdb_datalen(m) : mcdb_iter_datalen(iter);
+    PyObject * const data = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)dlen);
+    if (data != NULL
+        && (m ? mcdb_readdata(m, PyBytes_AS_STRING(data))
+              : mcdb_iter_readdata(iter, PyBytes_AS_STRING(data))) == NULL) {
+        Py_DECREF(data);
+        return PyErr_SetFromErrno(PyExc_IOError);
+    }
+    return data;
+}
+
 static inline PyObject *
 mcdbpy_read_data(const struct mcdb * const restrict m)
 {
-    return mcdbpy_PyObject_From_mcdb(mcdb_dataptr(m), mcdb_datalen(m));
+    return mcdb_datazlen(m) == 0
+      ? mcdbpy_PyObject_From_mcdb(mcdb_dataptr(m), mcdb_datalen(m))
+      : mcdbpy_read_zdata(m, NULL);
+}
+
+static inline PyObject *
+mcdbpy_iter_data(const struct mcdb_iter * const restrict iter)
+{
+    return mcdb_iter_datazlen(iter) == 0
+      ? mcdbpy_PyObject_From_mcdb(mcdb_iter_dataptr(iter),
+                                  mcdb_iter_datalen(iter))
+      : mcdbpy_read_zdata(NULL, iter);
+}
+
+/* read-only buffer interface to entire mcdb mmap, e.g. memoryview(m)
+ * (mmap is not refreshed by python-mcdb, so remains valid while m exists) */
+static int
+mcdbpy_getbuffer(struct mcdbpy * const self, Py_buffer * const view,
+                 const int flags)
+{
+    return PyBuffer_FillInfo(view, (PyObject *)self, self->m.map->ptr,
+                             (Py_ssize_t)self->m.map->size, 1, flags);
+}
+
+/* read-only memoryview of data in mmap (no copy); view holds reference to
+ * self (the mcdb object), which keeps mmap (self->m.map) from being destroyed
+ * while the view exists (memoryview requires self provide buffer interface)
+ * (compressed data (MCDB_FMT_VALZ) is not in mmap as value: ValueError) */
+static PyObject *
+mcdbpy_view_data(struct mcdbpy * const self, const struct mcdb * const m)
+{
+    Py_buffer pyb;
+    if (mcdb_datazlen(m) != 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "compressed data; memoryview not supported");
+        return NULL;
+    }
+    return PyBuffer_FillInfo(&pyb, (PyObject *)self, (void *)mcdb_dataptr(m),
+                             (Py_ssize_t)mcdb_datalen(m), 1, PyBUF_FULL_RO)==0
+      ? PyMemoryView_FromBuffer(&pyb)
+      : NULL;
 }
 
 static Py_ssize_t
@@ -237,6 +294,69 @@ mcdbpy_findall(struct mcdbpy * const self, PyObject * const args)
     return list;
 }
 
+/* batched lookup of sequence of keys (mcdb_find_batch()) with GIL released.
+ * Keys are parsed and struct mcdb array allocated before releasing GIL, and
+ * result list (data or memoryview, or None if key not found) is created after
+ * reacquiring GIL.  Returned data is first value of multi-valued keys. */
+static PyObject *
+mcdbpy_get_many(struct mcdbpy * const self, PyObject * const args)
+{
+    PyObject *keys, *seq, *list = NULL, *data;
+    struct mcdb *ms;
+    const char **kptrs;
+    size_t *klens;
+    Py_ssize_t n, i;
+    int view = false;
+    uint32_t klen;
+    if (!PyArg_ParseTuple(args, "O|i:get_many", &keys, &view))
+        return NULL;
+    seq = PySequence_Fast(keys, "get_many(): expected sequence of keys");
+    if (seq == NULL)
+        return NULL;
+    n = PySequence_Fast_GET_SIZE(seq);
+    ms = PyMem_Malloc((size_t)n * (sizeof(struct mcdb)+sizeof(char *)
+                                   +sizeof(size_t)));
+    if (ms == NULL) {
+        Py_DECREF(seq);
+        return PyErr_NoMemory();
+    }
+    kptrs = (const char **)(ms + n);
+    klens = (size_t *)(kptrs + n);
+    for (i = 0; i < n; ++i) {
+        if (!mcdbpy_PyObject_to_buf(PySequence_Fast_GET_ITEM(seq, i),
+                                    kptrs+i, &klen))
+            break;
+        klens[i] = (size_t)klen;
+        ms[i].map = self->m.map;
+    }
+
+    if (i == n) {
+        /* (keys remain referenced by seq while GIL is released) */
+        Py_BEGIN_ALLOW_THREADS
+        (void) mcdb_find_batch(ms, (size_t)n, kptrs, klens);
+        Py_END_ALLOW_THREADS
+        if ((list = PyList_New(n)) != NULL) {
+            for (i = 0; i < n; ++i) {
+                data = ms[i].loop == 0
+                  ? mcdbpy_Py_None()
+                  : view && mcdb_datazlen(ms+i) == 0
+                      ? mcdbpy_view_data(self, ms+i)
+                      : mcdbpy_read_data(ms+i); /*(decompress if VALZ)*/
+                if (data == NULL) {
+                    Py_DECREF(list);
+                    list = NULL;
+                    break;
+                }
+                PyList_SET_ITEM(list, i, data); /*steal ref; no Py_DECREF()*/
+            }
+        }
+    }
+
+    PyMem_Free(ms);
+    Py_DECREF(seq);
+    return list;
+}
+
 static PyObject *
 mcdbpy_getseq(struct mcdbpy * const self, PyObject * const args)
 {
@@ -265,6 +385,18 @@ mcdbpy_dict_get(struct mcdbpy * const self, PyObject * const args)
       : NULL;
 }
 
+static PyObject *
+mcdbpy_get_view(struct mcdbpy * const self, PyObject * const args)
+{
+    const char *key; uint32_t klen;
+    PyObject *defaultpy = Py_None;
+    return PyArg_ParseTuple(args, "s#|O:get_view", &key, &klen, &defaultpy)
+      ? mcdb_find(&self->m, key, klen)
+          ? mcdbpy_view_data(self, &self->m)
+          : (Py_INCREF(defaultpy), defaultpy)
+      : NULL;
+}
+
 /* mcdb[key]
  * (PyObject_GetItem() specifies set KeyError, return NULL if key not found) */
 static PyObject *
@@ -335,15 +467,13 @@ mcdbpy_dict_iternext(struct mcdbpy * const self)
                                              mcdb_iter_keylen(iter));
         }
         else if (self->itertype == MCDBPY_ITERVALUES) {
-            return mcdbpy_PyObject_From_mcdb(mcdb_iter_dataptr(iter),
-                                             mcdb_iter_datalen(iter));
+            return mcdbpy_iter_data(iter);
         }
         else { /* if (self->itertype == MCDBPY_ITERITEMS) */
             PyObject * restrict tuple, * restrict key, * restrict data;
             key  = mcdbpy_PyObject_From_mcdb(mcdb_iter_keyptr(iter),
                                              mcdb_iter_keylen(iter));
-            data = mcdbpy_PyObject_From_mcdb(mcdb_iter_dataptr(iter),
-                                             mcdb_iter_datalen(iter));
+            data = mcdbpy_iter_data(iter);
             tuple= PyTuple_New(2);
             if (key && data && tuple) {
                 PyTuple_SET_ITEM(tuple,0,key);
@@ -392,8 +522,7 @@ mcdbpy_dict_values(struct mcdbpy * const self)
     if (!r) return NULL;
     mcdb_iter_init(&iter, &self->m);
     while (mcdb_iter(&iter)
-           && (value = mcdbpy_PyObject_From_mcdb(mcdb_iter_dataptr(&iter),
-                                                 mcdb_iter_datalen(&iter))))
+           && (value = mcdbpy_iter_data(&iter)))
         PyList_SET_ITEM(r, i++, value); /*steal reference; no Py_DECREF(value)*/
 
     if (value)
@@ -418,8 +547,7 @@ mcdbpy_dict_items(struct mcdbpy * const self)
     while (mcdb_iter(&iter)
            && (key  = mcdbpy_PyObject_From_mcdb(mcdb_iter_keyptr(&iter),
                                                 mcdb_iter_keylen(&iter)))
-           && (data = mcdbpy_PyObject_From_mcdb(mcdb_iter_dataptr(&iter),
-                                                mcdb_iter_datalen(&iter)))
+           && (data = mcdbpy_iter_data(&iter))
            && (tuple=PyTuple_New(2))) { /*(?maybe preallocate tuple list?)*/
         PyTuple_SET_ITEM(tuple,0,key);  /*steal reference; no Py_DECREF(key)*/
         PyTuple_SET_ITEM(tuple,1,data); /*steal reference; no Py_DECREF(data)*/
@@ -540,24 +668,169 @@ struct mcdbpy_make {
     PyObject_HEAD
     struct mcdb_make m;
     PyObject *fname;
+    bool busy;  /* struct mcdb_make in use by thread which released GIL */
 };
 
 staticforward PyTypeObject mcdbpy_make_Type;
 
+static PyObject *
+mcdbpy_make_err(void)
+{
+    return errno == ENOMEM
+      ? PyErr_NoMemory()
+      : PyErr_SetFromErrno(PyExc_IOError);
+}
+
+/* struct mcdb_make is not thread-safe; mk methods raise RuntimeError if
+ * called while another thread is adding records or finishing without GIL */
+static PyObject *
+mcdbpy_make_busy_err(void)
+{
+    PyErr_SetString(PyExc_RuntimeError,
+                    "mcdb make is in use by another thread");
+    return NULL;
+}
+
 static PyObject *
 mcdbpy_make_add(struct mcdbpy_make * const self, PyObject * const args)
 {
     const char *key, *data; uint32_t klen, dlen;
+    if (self->busy)
+        return mcdbpy_make_busy_err();
     return PyTuple_GET_SIZE(args) == 2
         && mcdbpy_PyObject_to_buf(PyTuple_GET_ITEM(args, 0), &key,  &klen)
         && mcdbpy_PyObject_to_buf(PyTuple_GET_ITEM(args, 1), &data, &dlen)
       ? mcdb_make_add(&self->m, key, klen, data, dlen) == 0
           ? mcdbpy_Py_None()
-          : PyErr_SetFromErrno(PyExc_IOError)
+          : mcdbpy_make_err()
       : (PyArg_ParseTuple(args,"s#s#:add",&key,&klen,&data,&dlen), NULL);
         /*re-process to set error strings*/
 }
 
+/* records are added in chunks: key and data of chunk of pairs are parsed and
+ * referenced while holding GIL, and then added with GIL released */
+#define MCDBPY_MAKE_CHUNK 1024
+
+struct mcdbpy_make_rec {
+    const char *key;
+    const char *data;
+    uint32_t klen;
+    uint32_t dlen;
+};
+
+static bool
+mcdbpy_make_add_chunk(struct mcdbpy_make * const restrict self,
+                      const struct mcdbpy_make_rec * const restrict r,
+                      const size_t n)
+{
+    struct mcdb_make * const restrict m = &self->m;
+    size_t i = 0;
+    self->busy = true;
+    Py_BEGIN_ALLOW_THREADS
+    while (i < n
+           && mcdb_make_add(m, r[i].key, r[i].klen, r[i].data, r[i].dlen) == 0)
+        ++i;
+    Py_END_ALLOW_THREADS
+    self->busy = false;
+    return i == n;
+}
+
+/* mk.add_many(seq) (sequence of pairs) or mk.add_from_iter(iterable) */
+static PyObject *
+mcdbpy_make_add_pairs(struct mcdbpy_make * const self, PyObject * const args,
+                      const bool fromiter)
+{
+    struct mcdbpy_make_rec r[MCDBPY_MAKE_CHUNK];
+    PyObject *refs[MCDBPY_MAKE_CHUNK<<1];  /*(key, data objects of chunk)*/
+    PyObject *item, *seq;
+    Py_ssize_t i = 0, len = 0;
+    size_t n = 0, x;
+    bool rc = true;
+    if (self->busy)
+        return mcdbpy_make_busy_err();
+    seq = fromiter
+      ? PyObject_GetIter(args)
+      : PySequence_Fast(args, "add_many(): expected sequence of pairs");
+    if (seq == NULL)
+        return NULL;
+    if (!fromiter)
+        len = PySequence_Fast_GET_SIZE(seq);
+
+    do {
+        if (fromiter)
+            item = PyIter_Next(seq);
+        else if (i < len) {
+            item = PySequence_Fast_GET_ITEM(seq, i++);
+            Py_INCREF(item);
+        }
+        else
+            item = NULL;
+        if (item != NULL) {
+            PyObject * const pair =
+              PySequence_Fast(item, "expected (key, data) pair");
+            Py_DECREF(item);
+            if (pair == NULL || PySequence_Fast_GET_SIZE(pair) != 2) {
+                if (pair != NULL) {
+                    PyErr_SetString(PyExc_TypeError,
+                                    "expected (key, data) pair");
+                    Py_DECREF(pair);
+                }
+                rc = false;
+            }
+            else {
+                refs[(n<<1)]   = PySequence_Fast_GET_ITEM(pair, 0);
+                refs[(n<<1)+1] = PySequence_Fast_GET_ITEM(pair, 1);
+                rc = mcdbpy_PyObject_to_buf(refs[(n<<1)],
+                                            &r[n].key,  &r[n].klen)
+                  && mcdbpy_PyObject_to_buf(refs[(n<<1)+1],
+                                            &r[n].data, &r[n].dlen);
+                if (rc) {
+                    Py_INCREF(refs[(n<<1)]);
+                    Py_INCREF(refs[(n<<1)+1]);
+                    ++n;
+                }
+                Py_DECREF(pair);
+            }
+        }
+        else if (PyErr_Occurred())
+            rc = false;
+
+        /* (on error, pairs preceding error are added, as if by mk.add()) */
+        if (n == MCDBPY_MAKE_CHUNK || (item == NULL && n != 0) || !rc) {
+            /* (iteration runs Python code with GIL; recheck busy) */
+            if (n != 0 && self->busy) {
+                if (rc)
+                    mcdbpy_make_busy_err();
+                rc = false;
+            }
+            else if (n != 0 && !mcdbpy_make_add_chunk(self, r, n)) {
+                if (rc)
+                    mcdbpy_make_err();
+                rc = false;
+            }
+            for (x = 0; x < (n<<1); ++x)
+                Py_DECREF(refs[x]);
+            n = 0;
+        }
+    } while (item != NULL && rc);
+
+    Py_DECREF(seq);
+    return rc ? mcdbpy_Py_None() : NULL;
+}
+
+static PyObject *
+mcdbpy_make_add_many(struct mcdbpy_make * const self, PyObject * const args)
+{
+    return mcdbpy_make_add_pairs(self, args, false);
+}
+
+static PyObject *
+mcdbpy_make_add_from_iter(struct mcdbpy_make * const self,
+                          PyObject * const args)
+{
+    return mcdbpy_make_add_pairs(self, args, true);
+}
+
 static PyObject *
 mcdbpy_make_finish(struct mcdbpy_make * const self, PyObject * const args)
 {
@@ -566,12 +839,16 @@ mcdbpy_make_finish(struct mcdbpy_make * const self, PyObject * const args)
     int rc;
     if (!PyArg_ParseTuple(args, "|i:finish", &do_fsync)) /*exception on error*/
         return mcdbpy_Py_None();
-    rc = mcdb_make_finish(m); /*(calls PyMem_Malloc(), PyMem_Free())*/
+    if (self->busy)
+        return mcdbpy_make_busy_err();
+    self->busy = true;
     Py_BEGIN_ALLOW_THREADS
+    rc = mcdb_make_finish(m); /*(uses m->nthreads threads, if set)*/
     if (rc == 0)
         rc = mcdb_makefn_finish(m, do_fsync != 0);
     Py_END_ALLOW_THREADS
-    return rc == 0 ? mcdbpy_Py_None() : PyErr_SetFromErrno(PyExc_IOError);
+    self->busy = false;
+    return rc == 0 ? mcdbpy_Py_None() : mcdbpy_make_err();
 }
 
 static PyObject *
@@ -583,6 +860,8 @@ mcdbpy_make_repr (struct mcdbpy_make * const restrict self)
 static PyObject *
 mcdbpy_make_cancel(struct mcdbpy_make * const restrict self)
 {
+    if (self->busy)
+        return mcdbpy_make_busy_err();
     mcdb_make_destroy(&self->m);
     mcdb_makefn_cleanup(&self->m);
     Py_XDECREF(self->fname);
@@ -605,6 +884,10 @@ mcdbpy_make_init(struct mcdbpy_make * const restrict self,
 {
     PyObject *fname;
     int st_mode = ~0;
+    if (self->busy) {
+        mcdbpy_make_busy_err();
+        return -1;
+    }
     if (PyArg_ParseTuple(args, "O|i:__init__", &fname, &st_mode)) {
         if (!PyString_Check(fname)) {
             PyErr_SetString(PyExc_TypeError,
@@ -613,15 +896,16 @@ mcdbpy_make_init(struct mcdbpy_make * const restrict self,
         }
         self->fname = fname;
         Py_INCREF(self->fname);
+        /* (malloc and free (not PyMem_Malloc and PyMem_Free) since
+         *  mcdb_make_add() and mcdb_make_finish() may run without GIL) */
         if (mcdb_makefn_start(&self->m, PyString_AS_STRING(self->fname),
-                              PyMem_Malloc, PyMem_Free) == 0
-            && mcdb_make_start(&self->m, self->m.fd,
-                               PyMem_Malloc, PyMem_Free) == 0) {
+                              malloc, free) == 0
+            && mcdb_make_start(&self->m, self->m.fd, malloc, free) == 0) {
             if (st_mode != ~0)
                 self->m.st_mode = (mode_t)st_mode; /* optional mcdb perm mode */
             return 0;
         }
-        PyErr_SetFromErrno(PyExc_IOError);
+        mcdbpy_make_err();
     }
     return -1;
 }
@@ -634,7 +918,12 @@ mcdbpy_make_new(PyTypeObject * const type,
       (struct mcdbpy_make *)type->tp_alloc(type, 0);
     if (self != NULL) {
         self->fname    = NULL;
-        self->m.head[0]= NULL;
+        self->busy     = false;
+        self->m.hpmap  = NULL;
+        self->m.kmap   = NULL;
+        self->m.valtab = NULL;
+        self->m.zstrm  = NULL;
+        self->m.zbuf   = NULL;
         self->m.fd     = -1;
     }
     return (PyObject *)self;
@@ -698,6 +987,7 @@ static const char mcdbpy_object_doc[] =
   "\n"
   "  Additional methods:\n"
   "    m.find(key), m.findnext(), m.findall(key) m.getseq(key[,sequence])\n"
+  "    m.get_view(key[,default]), m.get_many(keys[,view])\n"
   "\n"
   "  __members__:\n"
   "    m.name - mcdb filename\n"
@@ -711,15 +1001,19 @@ static const char mcdbpy_make_object_doc[] =
   "\n"
   "  mcdb make methods:\n"
   "    mk.add(key, data)\n"
+  "    mk.add_many(seq), mk.add_from_iter(iterable)\n"
   "    mk.finish()\n"
   "\n"
   "  A temporary file is used during creation.\n"
   "  Call mk.add() to add a record.\n"
+  "  Call mk.add_many() or mk.add_from_iter() to add many (key, data) pairs,\n"
+  "  added in chunks with the GIL released.\n"
   "  Call mk.finish() to atomically install the completed mcdb.\n"
   "\n"
   "  __members__:\n"
   "    mk.name    - mcdb filename\n"
-  "    mk.fd      - fd underlying mcdb (-1 after finish())\n";
+  "    mk.fd      - fd underlying mcdb (-1 after finish())\n"
+  "    mk.nthreads - threads filling hash tables in finish()\n";
 
 
 
@@ -756,6 +1050,20 @@ static PyMethodDef mcdbpy_methods[] = {
    "If k does not exist, return default arg, if provided, or else None"
    "d = m.get(k) is similar to d = m[k], d = m.find(k), d = m.getseq(k,0)"
   },
+  {"get_view",     (PyCFunction)mcdbpy_get_view,        METH_VARARGS,
+   "v = m.get_view(k,[default]) returns read-only memoryview of data of key k\n"
+   "If k does not exist, return default arg, if provided, or else None\n"
+   "Data is not copied; v references the mcdb mmap (and keeps m open).\n"
+   "Use v.tobytes() if a copy of the data is needed.\n"
+   "Raises ValueError if data is compressed (database made with -Z)."
+  },
+  {"get_many",     (PyCFunction)mcdbpy_get_many,        METH_VARARGS,
+   "l = m.get_many(keys[,view]) returns list of data of each key in keys,\n"
+   "or None for each key that does not exist.  Lookups are batched and run\n"
+   "with the GIL released.  If view is true, list contains read-only\n"
+   "memoryview (as from m.get_view()) instead of copy of data, except for\n"
+   "compressed data, which is decompressed into a copy."
+  },
   {"getseq",       (PyCFunction)mcdbpy_getseq,          METH_VARARGS,
    "d = m.getseq(k[,i]) returns data of key k, else None if k does not exist\n"
    "  (optional i (default 0) specifies sequence num for multi-valued keys)\n"
@@ -828,9 +1136,23 @@ static PyMethodDef mcdbpy_make_methods[] = {
    "mk.add(key, data) writes (key,data) tuple into mcdb being created.\n"
    "Returns None."
   },
+  {"add_many",     (PyCFunction)mcdbpy_make_add_many,   METH_O,
+   "mk.add_many(seq) writes each (key,data) pair in seq into mcdb being\n"
+   "created.  Pairs are added in chunks with the GIL released; other mk\n"
+   "methods called from other threads meanwhile raise RuntimeError.\n"
+   "Returns None."
+  },
+  {"add_from_iter",(PyCFunction)mcdbpy_make_add_from_iter, METH_O,
+   "mk.add_from_iter(iterable) writes each (key,data) pair from iterable,\n"
+   "e.g. generator, into mcdb being created.  Pairs are consumed and added\n"
+   "in chunks with the GIL released.\n"
+   "Returns None."
+  },
   {"finish",       (PyCFunction)mcdbpy_make_finish,     METH_VARARGS,
    "mk.finish() generates and writes the mcdb hash tables,\n"
    "flushes all data to disk, and atomically installs mcdb.\n"
+   "The GIL is released during finish(); other mk methods called from\n"
+   "other threads meanwhile raise RuntimeError.\n"
    "Returns None."
   },
   {"cancel",       (PyCFunction)mcdbpy_make_cancel,     METH_NOARGS,
@@ -861,11 +1183,23 @@ static PyMemberDef mcdbpy_make_members[] = {
   {"fd",   T_INT,       offsetof(struct mcdbpy_make, m.fd),  READONLY,
    "file descriptor"
   },
+  {"nthreads", T_UINT,  offsetof(struct mcdbpy_make, m.nthreads), 0,
+   "threads filling hash tables in finish() (set before first add)"
+  },
   { NULL }
 };
 
 
 
+static PyBufferProcs mcdbpy_as_buffer = {
+  (readbufferproc)0,                /* bf_getreadbuffer  (old buffer API) */
+  (writebufferproc)0,               /* bf_getwritebuffer (old buffer API) */
+  (segcountproc)0,                  /* bf_getsegcount    (old buffer API) */
+  (charbufferproc)0,                /* bf_getcharbuffer  (old buffer API) */
+  (getbufferproc)mcdbpy_getbuffer,  /* PyObject_GetBuffer() */
+  (releasebufferproc)0              /* PyBuffer_Release() (nothing to do) */
+};
+
 static PyMappingMethods mcdbpy_as_mapping = {
   (lenfunc)mcdbpy_numrecs,          /* PyObject_Size(), PyMapping_Length() */
   (binaryfunc)mcdbpy_dict_getitem,  /* PyObject_GetItem() */
@@ -900,8 +1234,9 @@ statichere PyTypeObject mcdbpy_Type = {
     0,                                          /*tp_str*/
     0,                                          /*tp_getattro*/
     0,                                          /*tp_setattro*/
-    0,                                          /*tp_as_buffer*/
-    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_HAVE_ITER|Py_TPFLAGS_HAVE_CLASS, /*tp_flags*/
+    &mcdbpy_as_buffer,                          /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT|Py_TPFLAGS_HAVE_ITER|Py_TPFLAGS_HAVE_CLASS
+      |Py_TPFLAGS_HAVE_NEWBUFFER,               /*tp_flags*/
     mcdbpy_object_doc,                          /*tp_doc*/
     0,                                          /*tp_traverse*/
     0,                                          /*tp_clear*/
@@ -6,6 +6,9 @@ $LDFLAGS  += ' ../../libmcdb.a'
 $LDFLAGS  += ' -Wl,--version-script,rubyext.map'
 
 have_library('mcdb')
+# libmcdb.a requires zlib if mcdb built with MCDB_ZLIB (if zlib.h is found)
+have_library('z', 'inflate') if File.exist?('/usr/include/zlib.h')
+have_func('rb_thread_call_without_gvl', 'ruby/thread.h')
 $CPPFLAGS += ' -std=c99'
 if RUBY_VERSION =~ /\A1\.8/ then
   $CPPFLAGS += " -DRUBY_1_8_x"
@@ -38,6 +38,10 @@
 #define RSTRING_PTR(x) RSTRING(x)->ptr
 #endif
 
+#ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL   /*(see ruby-mcdb/extconf.rb)*/
+#include <ruby/thread.h>
+#endif
+
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -54,6 +58,39 @@ static ID mcdbrb_id_each;
 /* option: use rb_tainted_str_new() instead of rb_str_new() for mcdb strings? */
 #define mcdbrb_str_new(p,len) rb_tainted_str_new((const char *)(p), (len))
 
+/* compressed data (MCDB_FMT_VALZ) is decompressed into new string */
+static VALUE
+mcdbrb_str_zdata (const struct mcdb * const restrict m,
+                  const struct mcdb_iter * const restrict iter)
+{
+    const uint32_t dlen = m ? mcdb_datalen(m) : mcdb_iter_datalen(iter);
+    const VALUE str = mcdbrb_str_new(NULL, dlen);
+    if ((m ? mcdb_readdata(m, RSTRING_PTR(str))
+           : mcdb_iter_readdata(iter, RSTRING_PTR(str))) == NULL)
+        rb_sys_fail("mcdb data");
+    return str;
+}
+
+#define mcdbrb_str_data(m) \
+  (mcdb_datazlen(m) == 0                                \
+   ? mcdbrb_str_new(mcdb_dataptr(m), mcdb_datalen(m))   \
+   : mcdbrb_str_zdata((m), NULL))
+
+#define mcdbrb_str_iterdata(iter) \
+  (mcdb_iter_datazlen(iter) == 0                                      \
+   ? mcdbrb_str_new(mcdb_iter_dataptr(iter), mcdb_iter_datalen(iter)) \
+   : mcdbrb_str_zdata(NULL, (iter)))
+
+static bool
+mcdbrb_iter_data_eq (const struct mcdb_iter * const restrict iter,
+                     const char * const restrict p, const uint32_t len)
+{
+    return len == mcdb_iter_datalen(iter)
+        && 0 == memcmp(mcdb_iter_datazlen(iter) == 0
+                         ? (const char *)mcdb_iter_dataptr(iter)
+                         : RSTRING_PTR(mcdbrb_str_zdata(NULL, iter)), p, len);
+}
+
 /* efficiency for common case; short-cut argument processing in common case
  * (throws exception if wrong type (unlikely) or if mcdb is closed)
  * (struct mcdb, mcdb_make both have 'map' struct element that can be tested)
@@ -113,7 +150,7 @@ mcdbrb_get (const int argc, VALUE * const restrict argv, const VALUE obj)
     key  = RSTRING_PTR(argv[0]);
     klen = (uint32_t)RSTRING_LEN(argv[0]);
     if (mcdb_find(m, key, klen))
-        return mcdbrb_str_new(mcdb_dataptr(m), mcdb_datalen(m));
+        return mcdbrb_str_data(m);
     else if (rb_block_given_p())
         return rb_yield(argv[0]);/*key not found; call provided block with key*/
     else if (argc == 1)
@@ -137,7 +174,7 @@ mcdbrb_findkey (const VALUE obj, VALUE v_key)
     key  = RSTRING_PTR(v_key);
     klen = (uint32_t)RSTRING_LEN(v_key);
     return mcdb_find(m, key, klen)
-      ? mcdbrb_str_new(mcdb_dataptr(m), mcdb_datalen(m))
+      ? mcdbrb_str_data(m)
       : Qnil;
 }
 
@@ -148,7 +185,7 @@ mcdbrb_findnext (const VALUE obj)
     mcdbrb_check_open(m);
     return m->loop != 0
       ? mcdb_findnext(m, (const char *)mcdb_keyptr(m), mcdb_keylen(m))
-          ? mcdbrb_str_new(mcdb_dataptr(m), mcdb_datalen(m))
+          ? mcdbrb_str_data(m)
           : Qnil
       : (rb_raise(rb_eArgError,
                   "findnext() called without first calling findkey()"), Qnil);
@@ -165,7 +202,7 @@ mcdbrb_findall (const VALUE obj, VALUE v_key)
     klen = (uint32_t)RSTRING_LEN(v_key);
     if (mcdb_findstart(m, key, klen)) {
         while (mcdb_findnext(m, key, klen))
-            rb_ary_push(ary, mcdbrb_str_new(mcdb_dataptr(m), mcdb_datalen(m)));
+            rb_ary_push(ary, mcdbrb_str_data(m));
     }
     return ary;
 }
@@ -190,7 +227,7 @@ mcdbrb_getseq (const int argc, VALUE * const restrict argv, const VALUE obj)
             ;
     }
     return r
-      ? mcdbrb_str_new(mcdb_dataptr(m), mcdb_datalen(m))
+      ? mcdbrb_str_data(m)
       : Qnil;
 }
 
@@ -261,8 +298,7 @@ mcdbrb_each_pair (const VALUE obj)
     while (mcdb_iter(&iter)) {
         rb_yield(rb_assoc_new(mcdbrb_str_new(mcdb_iter_keyptr(&iter),
                                              mcdb_iter_keylen(&iter)),
-                              mcdbrb_str_new(mcdb_iter_dataptr(&iter),
-                                             mcdb_iter_datalen(&iter))));
+                              mcdbrb_str_iterdata(&iter)));
         mcdbrb_check_open(m); /* m must not be 'restrict' ptr */
     }
     return Qnil;
@@ -293,8 +329,7 @@ mcdbrb_each_value (const VALUE obj)
     RETURN_ENUMERATOR(obj, 0, 0);
     mcdbrb_check_open(m);     /* m must not be 'restrict' ptr */
     while (mcdb_iter(&iter)) {
-        rb_yield(mcdbrb_str_new(mcdb_iter_dataptr(&iter),
-                                mcdb_iter_datalen(&iter)));
+        rb_yield(mcdbrb_str_iterdata(&iter));
         mcdbrb_check_open(m); /* m must not be 'restrict' ptr */
     }
     return Qnil;
@@ -315,7 +350,7 @@ mcdbrb_each (const int argc, VALUE * const argv, const VALUE obj)
         mcdbrb_check_open(m);         /* m must not be 'restrict' ptr */
         if (mcdb_findstart(m, key, klen)) {
             while (mcdb_findnext(m, key, klen)) {
-                rb_yield(mcdbrb_str_new(mcdb_dataptr(m), mcdb_datalen(m)));
+                rb_yield(mcdbrb_str_data(m));
                 mcdbrb_check_open(m); /* m must not be 'restrict' ptr */
             }
         }
@@ -343,8 +378,7 @@ mcdbrb_values_at (const int argc, VALUE * const restrict argv, const VALUE obj)
         klen = (uint32_t)RSTRING_LEN(v);
         if (mcdb_findstart(m, key, klen)) {
             while (mcdb_findnext(m, key, klen))
-                rb_ary_push(ary, mcdbrb_str_new(mcdb_dataptr(m),
-                                                mcdb_datalen(m)));
+                rb_ary_push(ary, mcdbrb_str_data(m));
         }
     }
     return ary;
@@ -363,8 +397,7 @@ mcdbrb_select_i (const VALUE obj, const bool match)
     while (mcdb_iter(&iter)) {
         assoc = rb_assoc_new(mcdbrb_str_new(mcdb_iter_keyptr(&iter),
                                             mcdb_iter_keylen(&iter)),
-                             mcdbrb_str_new(mcdb_iter_dataptr(&iter),
-                                            mcdb_iter_datalen(&iter)));
+                             mcdbrb_str_iterdata(&iter));
         v = rb_yield(assoc);
         if (RTEST(v) == match)
             rb_ary_push(ary, assoc);
@@ -396,8 +429,7 @@ mcdbrb_to_a (const VALUE obj)
         rb_ary_push(ary,
                     rb_assoc_new(mcdbrb_str_new(mcdb_iter_keyptr(&iter),
                                                 mcdb_iter_keylen(&iter)),
-                                 mcdbrb_str_new(mcdb_iter_dataptr(&iter),
-                                                mcdb_iter_datalen(&iter))));
+                                 mcdbrb_str_iterdata(&iter)));
     return ary;
 }
 
@@ -412,8 +444,7 @@ mcdbrb_to_hash (const VALUE obj)
     while (mcdb_iter(&iter))
         rb_hash_aset(hash, mcdbrb_str_new(mcdb_iter_keyptr(&iter),
                                           mcdb_iter_keylen(&iter)),
-                           mcdbrb_str_new(mcdb_iter_dataptr(&iter),
-                                          mcdb_iter_datalen(&iter)));
+                           mcdbrb_str_iterdata(&iter));
     return hash;
 }
 
@@ -426,8 +457,7 @@ mcdbrb_invert (const VALUE obj)
     mcdb_iter_init(&iter, m);
     /* Note: ignores multi-key values; last key seen wins for any given value */
     while (mcdb_iter(&iter))
-        rb_hash_aset(hash, mcdbrb_str_new(mcdb_iter_dataptr(&iter),
-                                          mcdb_iter_datalen(&iter)),
+        rb_hash_aset(hash, mcdbrb_str_iterdata(&iter),
                            mcdbrb_str_new(mcdb_iter_keyptr(&iter),
                                           mcdb_iter_keylen(&iter)));
     return hash;
@@ -444,8 +474,7 @@ mcdbrb_index (const VALUE obj, VALUE v_data)
     dlen = (uint32_t)RSTRING_LEN(v_data);
     mcdb_iter_init(&iter, m);
     while (mcdb_iter(&iter)) {
-        if (mcdb_iter_datalen(&iter) == dlen
-            && memcmp(mcdb_iter_dataptr(&iter), data, dlen) == 0)
+        if (mcdbrb_iter_data_eq(&iter, data, dlen))
             return mcdbrb_str_new(mcdb_iter_keyptr(&iter),
                                   mcdb_iter_keylen(&iter));
     }
@@ -473,8 +502,7 @@ mcdbrb_values (const VALUE obj)
     struct mcdb_iter iter;
     mcdb_iter_init(&iter, m);
     while (mcdb_iter(&iter))
-        rb_ary_push(ary, mcdbrb_str_new(mcdb_iter_dataptr(&iter),
-                                        mcdb_iter_datalen(&iter)));
+        rb_ary_push(ary, mcdbrb_str_iterdata(&iter));
     return ary;
 }
 
@@ -490,8 +518,7 @@ mcdbrb_has_value (const VALUE obj, VALUE value)
     vlen = (uint32_t)RSTRING_LEN(value);
     mcdb_iter_init(&iter, m);
     while (mcdb_iter(&iter))
-        if (vlen == mcdb_iter_datalen(&iter)
-            && memcmp(mcdb_iter_dataptr(&iter), vptr, vlen) == 0)
+        if (mcdbrb_iter_data_eq(&iter, vptr, vlen))
             return Qtrue;
     return Qfalse;
 }
@@ -547,11 +574,30 @@ mcdbrb_open (const VALUE klass, VALUE fname)
  * class MCDBmake 
  */
 
+/* struct mcdb_make is not thread-safe; methods raise RuntimeError if called
+ * while another thread is adding records or finishing with GVL released */
+struct mcdbrb_make {
+    struct mcdb_make mk;  /*(first member; see mcdbrb_Data_Cast_Struct())*/
+    bool busy;            /* mk in use by thread which released GVL */
+};
+
+#define mcdbrb_make_check_idle(mkrb) \
+  if (__builtin_expect( ((mkrb)->busy), 0)) \
+      rb_raise(rb_eRuntimeError, "MCDBmake in use by another thread");
+
+static struct mcdbrb_make *
+mcdbrb_make_idle (const VALUE obj)
+{
+    struct mcdbrb_make * const restrict mkrb = (struct mcdbrb_make *)
+      mcdbrb_Data_Cast_Struct(obj, struct mcdb_make);
+    mcdbrb_make_check_idle(mkrb);
+    return mkrb;
+}
+
 static VALUE
 mcdbrb_make_add (const VALUE obj, VALUE key, VALUE data)
 {
-    struct mcdb_make * const restrict mk =
-      mcdbrb_Data_Cast_Struct(obj, struct mcdb_make);
+    struct mcdb_make * const restrict mk = &mcdbrb_make_idle(obj)->mk;
     mcdbrb_convert_T_STRING(key);
     mcdbrb_convert_T_STRING(data);
     return mcdb_make_add(mk, RSTRING_PTR(key),  RSTRING_LEN(key),
@@ -560,23 +606,223 @@ mcdbrb_make_add (const VALUE obj, VALUE key, VALUE data)
       : (rb_sys_fail(0), Qnil);
 }
 
+/* records are added in chunks: key and data of pairs are copied (with GVL)
+ * into staging buffer, and chunk is then added to mcdb with GVL released
+ * (records larger than staging buffer are added directly, with GVL) */
+#define MCDBRB_MAKE_CHUNKSZ (1u << 20)
+
+struct mcdbrb_make_chunk {
+    struct mcdbrb_make *mkrb;
+    char *buf;
+    size_t len;
+    int rc;
+    int errnum;
+    VALUE pairs;
+};
+
+static void *
+mcdbrb_make_add_chunk_nogvl (void * const arg)
+{
+    struct mcdbrb_make_chunk * const restrict c = arg;
+    const char * restrict p = c->buf;
+    const char * const e = c->buf + c->len;
+    uint32_t kd[2];   /*(klen, dlen)*/
+    while (p < e) {
+        memcpy(kd, p, sizeof(kd));
+        p += sizeof(kd);
+        if (mcdb_make_add(&c->mkrb->mk, p, kd[0], p+kd[0], kd[1]) != 0) {
+            c->rc = -1;
+            c->errnum = errno;
+            break;
+        }
+        p += kd[0] + kd[1];
+    }
+    c->len = 0;
+    return NULL;
+}
+
+static void
+mcdbrb_make_add_chunk (struct mcdbrb_make_chunk * const restrict c)
+{
+    /* (pairs enumeration runs Ruby code with GVL; recheck busy) */
+    mcdbrb_make_check_idle(c->mkrb);
+  #ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+    c->mkrb->busy = true;
+    rb_thread_call_without_gvl(mcdbrb_make_add_chunk_nogvl, c, NULL, NULL);
+    c->mkrb->busy = false;
+  #else
+    mcdbrb_make_add_chunk_nogvl(c);
+  #endif
+    if (c->rc != 0) {
+        errno = c->errnum;
+        rb_sys_fail(0);
+    }
+}
+
+static void
+mcdbrb_make_add_pair (struct mcdbrb_make_chunk * const restrict c,
+                      VALUE key, VALUE data)
+{
+    size_t klen, dlen;
+    uint32_t kd[2];   /*(klen, dlen)*/
+    mcdbrb_convert_T_STRING(key);
+    mcdbrb_convert_T_STRING(data);
+    klen = (size_t)RSTRING_LEN(key);
+    dlen = (size_t)RSTRING_LEN(data);
+    if (c->len + sizeof(kd) + klen + dlen > MCDBRB_MAKE_CHUNKSZ) {
+        if (c->len != 0)
+            mcdbrb_make_add_chunk(c);
+        if (sizeof(kd) + klen + dlen > MCDBRB_MAKE_CHUNKSZ) {
+            mcdbrb_make_check_idle(c->mkrb);
+            if (mcdb_make_add(&c->mkrb->mk, RSTRING_PTR(key),  klen,
+                                     RSTRING_PTR(data), dlen) != 0)
+                rb_sys_fail(0);
+            return;
+        }
+    }
+    kd[0] = (uint32_t)klen;
+    kd[1] = (uint32_t)dlen;
+    memcpy(c->buf+c->len, kd, sizeof(kd));
+    memcpy(c->buf+(c->len += sizeof(kd)), RSTRING_PTR(key), klen);
+    memcpy(c->buf+(c->len += klen), RSTRING_PTR(data), dlen);
+    c->len += dlen;
+}
+
+static void
+mcdbrb_make_add_ary (struct mcdbrb_make_chunk * const restrict c,
+                     const VALUE pair)
+{
+    Check_Type(pair, T_ARRAY);
+    if (RARRAY_LEN(pair) != 2)
+        rb_raise(rb_eArgError, "expected [key, data] pair");
+    mcdbrb_make_add_pair(c, rb_ary_entry(pair, 0), rb_ary_entry(pair, 1));
+}
+
+static VALUE
+mcdbrb_make_add_i (const VALUE y, const VALUE v_chunk,
+                   const int argc, const VALUE * const restrict argv)
+{
+    struct mcdbrb_make_chunk * const restrict c =
+      (struct mcdbrb_make_chunk *)v_chunk;
+  #ifdef RUBY_1_8_x   /*(see ruby-mcdb/extconf.rb)*/
+    mcdbrb_make_add_ary(c, y);
+  #else
+    if (argc == 2)
+        mcdbrb_make_add_pair(c, argv[0], argv[1]);
+    else
+        mcdbrb_make_add_ary(c, y);
+  #endif
+    return Qnil;
+}
+
+static VALUE
+mcdbrb_make_add_ary_each (const VALUE v_chunk)
+{
+    struct mcdbrb_make_chunk * const restrict c =
+      (struct mcdbrb_make_chunk *)v_chunk;
+    for (long i = 0; i < RARRAY_LEN(c->pairs); ++i)
+        mcdbrb_make_add_ary(c, rb_ary_entry(c->pairs, i));
+    return Qnil;
+}
+
+static VALUE
+mcdbrb_make_add_iter_each (const VALUE v_chunk)
+{
+    struct mcdbrb_make_chunk * const restrict c =
+      (struct mcdbrb_make_chunk *)v_chunk;
+    return rb_block_call(c->pairs, mcdbrb_id_each, 0, 0,
+                         mcdbrb_make_add_i, v_chunk);
+}
+
+/* obj.add_many(ary) (array of pairs) or obj.add_from_iter(enum) */
+static VALUE
+mcdbrb_make_add_pairs (const VALUE obj, const VALUE pairs,
+                       VALUE (* const each)(VALUE))
+{
+    struct mcdbrb_make_chunk c;
+    volatile VALUE stage = rb_str_buf_new(MCDBRB_MAKE_CHUNKSZ);
+    int state = 0;
+    c.mkrb   = mcdbrb_make_idle(obj);
+    c.buf    = RSTRING_PTR(stage); /*(not embedded; buf does not move in GC)*/
+    c.len    = 0;
+    c.rc     = 0;
+    c.errnum = 0;
+    c.pairs  = pairs;
+    rb_protect(each, (VALUE)&c, &state);
+    /* (on error, pairs preceding error are added, as if by obj.add()) */
+    if (c.len != 0 && c.rc == 0 && !c.mkrb->busy) {
+        if (state == 0)
+            mcdbrb_make_add_chunk(&c);
+        else
+            (void)mcdbrb_make_add_chunk_nogvl(&c);
+    }
+    if (state != 0)
+        rb_jump_tag(state);
+    return Qnil;
+}
+
+static VALUE
+mcdbrb_make_add_many (const VALUE obj, VALUE ary)
+{
+    Check_Type(ary, T_ARRAY);
+    return mcdbrb_make_add_pairs(obj, ary, mcdbrb_make_add_ary_each);
+}
+
+static VALUE
+mcdbrb_make_add_from_iter (const VALUE obj, const VALUE enumerable)
+{
+    return mcdbrb_make_add_pairs(obj, enumerable, mcdbrb_make_add_iter_each);
+}
+
+static VALUE
+mcdbrb_make_set_nthreads (const VALUE obj, const VALUE n)
+{
+    struct mcdb_make * const restrict mk = &mcdbrb_make_idle(obj)->mk;
+    mk->nthreads = NUM2UINT(n);
+    return n;
+}
+
+struct mcdbrb_make_fin {
+    struct mcdb_make *mk;
+    bool do_fsync;
+    int rc;
+    int errnum;
+};
+
+static void *
+mcdbrb_make_finish_nogvl (void * const arg)
+{
+    struct mcdbrb_make_fin * const restrict f = arg;
+    f->rc = (0 == mcdb_make_finish(f->mk)
+             && 0 == mcdb_makefn_finish(f->mk, f->do_fsync)) ? 0 : -1;
+    f->errnum = errno;
+    return NULL;
+}
+
 static VALUE
 mcdbrb_make_finish (const int argc, const VALUE * const restrict argv,
                     const VALUE obj)
 {
-    struct mcdb_make * const restrict mk =
-      mcdbrb_Data_Cast_Struct(obj, struct mcdb_make);
+    struct mcdbrb_make_fin f;
+    struct mcdbrb_make * const restrict mkrb = mcdbrb_make_idle(obj);
     VALUE v_fsync;
-    bool do_fsync = true;
+    f.mk = &mkrb->mk;
     if (argc == 0)
-        do_fsync = true;
+        f.do_fsync = true;
     else if (argc == 1)
-        do_fsync = RTEST(argv[0]);
+        f.do_fsync = RTEST(argv[0]);
     else
         rb_scan_args(argc, argv, "01", &v_fsync);
-    return (0 == mcdb_make_finish(mk) && 0 == mcdb_makefn_finish(mk, do_fsync))
+  #ifdef HAVE_RB_THREAD_CALL_WITHOUT_GVL
+    mkrb->busy = true;
+    rb_thread_call_without_gvl(mcdbrb_make_finish_nogvl, &f, NULL, NULL);
+    mkrb->busy = false;
+  #else
+    mcdbrb_make_finish_nogvl(&f);
+  #endif
+    return f.rc == 0
       ? Qnil
-      : (rb_sys_fail(0), Qnil);
+      : (errno = f.errnum, rb_sys_fail(0), Qnil);
 }
 
 static VALUE
@@ -585,6 +831,7 @@ mcdbrb_make_cancel (const VALUE obj)
     /* mcdbrb_Data_Cast_Struct(), but without exception if mcdb already closed*/
     struct mcdb_make * restrict mk;
     Check_Type(obj, T_DATA);
+    mcdbrb_make_check_idle((struct mcdbrb_make *)DATA_PTR(obj));
     mk = (struct mcdb_make *)DATA_PTR(obj);
     mcdb_make_destroy(mk);
     mcdb_makefn_cleanup(mk);
@@ -621,11 +868,14 @@ mcdbrb_make_open (const int argc, VALUE * const restrict argv,
         fnptr = RSTRING_PTR(fname);
     }
 
-    mk = xmalloc(sizeof(struct mcdb_make));
+    mk = xmalloc(sizeof(struct mcdbrb_make));
     if (mk == NULL) rb_sys_fail(0);
+    ((struct mcdbrb_make *)mk)->busy = false;
 
-    if (mcdb_makefn_start(mk, fnptr, (void *(*)(size_t))xmalloc, xfree) == 0
-        && mcdb_make_start(mk, mk->fd, (void *(*)(size_t))xmalloc, xfree) == 0){
+    /* (malloc and free (not xmalloc and xfree) since mcdb_make_add() and
+     *  mcdb_make_finish() may run without GVL) */
+    if (mcdb_makefn_start(mk, fnptr, malloc, free) == 0
+        && mcdb_make_start(mk, mk->fd, malloc, free) == 0) {
         const VALUE v = Data_Wrap_Struct(klass, 0, mcdbrb_make_dtor, mk);
         if (st_mode != ~0)
             mk->st_mode = (mode_t)st_mode;
@@ -705,6 +955,11 @@ Init_mcdb (void)
     rb_define_singleton_method(rb_cMCDBmake, "open", mcdbrb_make_open, -1);
     rb_define_method(rb_cMCDBmake, "[]=",    mcdbrb_make_add,    2);
     rb_define_method(rb_cMCDBmake, "add",    mcdbrb_make_add,    2);
+    rb_define_method(rb_cMCDBmake, "add_many", mcdbrb_make_add_many, 1);
+    rb_define_method(rb_cMCDBmake, "add_from_iter",
+                                   mcdbrb_make_add_from_iter,        1);
+    rb_define_method(rb_cMCDBmake, "nthreads=",
+                                   mcdbrb_make_set_nthreads,         1);
     rb_define_method(rb_cMCDBmake, "close",  mcdbrb_make_finish,-1);
     rb_define_method(rb_cMCDBmake, "finish", mcdbrb_make_finish,-1);
     rb_define_method(rb_cMCDBmake, "cancel", mcdbrb_make_cancel, 0);
@@ -46,6 +46,7 @@
 #include "mcdb.h"
 #include "nointr.h"
 #include "uint32.h"
+#include "plasma/plasma_atomic.h"
 #include "plasma/plasma_attr.h"
 #include "plasma/plasma_membar.h"
 #include "plasma/plasma_stdtypes.h"  /* SIZE_MAX */
@@ -54,12 +55,19 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h> /* SYS_mbind */
+#endif
 #include <errno.h>
 #include <limits.h>
 #include <string.h>
 
 #ifdef _THREAD_SAFE
 #include "plasma/plasma_spin.h" /* plasma_spin_lock_t, plasma_spin_lock_*() */
+#include <pthread.h>   /* pthread_once(), pthread_key_create() */
+#include <stdlib.h>    /* posix_memalign() */
+/* (global spinlock taken only to reopen and to release superseded maps;
+ *  mcdb_mmap_thread_registration() does not take lock to register use) */
 static plasma_spin_lock_t mcdb_global_spinlock = PLASMA_SPIN_LOCK_INITIALIZER;
 #else
 #define plasma_spin_lock_acquire(spin) (void)0
@@ -83,74 +91,323 @@ extern int madvise(caddr_t, size_t, int);
 
 /* Note: tagc of 0 ('\0') is reserved to indicate no tag */
 
-bool
-mcdb_findtagstart(struct mcdb * const restrict m,
+/* hash table elements are bigendian, or native (MCDB_FMT_INDEX_LE) (see mcdb.h)
+ * (le must be constant false if !MCDB_HOST_LE) */
+#define mcdb_idx_u32(p,le) \
+  ((le) ? *(const uint32_t *)(p) : uint32_strunpack_bigendian_aligned_macro(p))
+#define mcdb_idx_u64(p,le) \
+  ((le) ? *(const uint64_t *)(p) : uint64_strunpack_bigendian_aligned_macro(p))
+
+/* lookup counters (-DMCDB_STATS) in thread-private struct mcdb_stats
+ * (see mcdb_stats_snapshot(); compiled out entirely unless MCDB_STATS) */
+#ifdef MCDB_STATS
+#if defined(_THREAD_SAFE)
+__attribute_noinline__
+static struct mcdb_stats *
+mcdb_stats_attach(void)
+  __attribute_cold__;
+#if !(defined(__APPLE__) && defined(__MACH__) \
+      && defined(__GNUC__) && !defined(__clang))
+static __thread struct mcdb_stats *mcdb_stats_tls;
+#define mcdb_stats_self() \
+  (__builtin_expect( (mcdb_stats_tls != NULL), 1) \
+   ? mcdb_stats_tls : mcdb_stats_attach())
+#else
+/* gcc 4.2.1 on Mac OSX does not support __thread thread-local storage */
+#define mcdb_stats_self()  mcdb_stats_attach()
+#endif
+#else
+static struct mcdb_stats mcdb_stats_st;
+#define mcdb_stats_self()  (&mcdb_stats_st)
+#endif
+#define mcdb_stats_decl(st) \
+  struct mcdb_stats * const restrict st = mcdb_stats_self()
+#define mcdb_stats_inc(st,f) \
+  plasma_atomic_st_nopt(&(st)->f, (st)->f + 1)
+#define mcdb_stats_probe(st,n) \
+  do { mcdb_stats_inc((st),probes); \
+       if ((st)->maxprobe < (n)) plasma_atomic_st_nopt(&(st)->maxprobe,(n)); \
+  } while (0)
+#define mcdb_stats_lookup(rc) \
+  do { mcdb_stats_decl(st_); \
+       mcdb_stats_inc(st_,lookups); \
+       if (!(rc)) mcdb_stats_inc(st_,misses); \
+  } while (0)
+#else
+#define mcdb_stats_decl(st)    (void)0
+#define mcdb_stats_inc(st,f)   (void)0
+#define mcdb_stats_probe(st,n) (void)0
+#define mcdb_stats_lookup(rc)  (void)0
+#endif
+
+static inline uint32_t
+mcdb_findtag_hash(const struct mcdb_mmap * const restrict map,
+                  const char * const restrict key, const size_t klen,
+                  const unsigned char tagc)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+static inline uint32_t
+mcdb_findtag_hash(const struct mcdb_mmap * const restrict map,
                   const char * const restrict key, const size_t klen,
                   const unsigned char tagc)
 {
-    const unsigned char * restrict ptr;
-    uint32_t khash;
-    if (m->map->hash_fn == uint32_hash_djb) {
+    if (map->hash_fn == uint32_hash_djb) {
         const uint32_t khash_init = /*init hash value; hash tagc if tagc not 0*/
           (tagc != 0)
             ? uint32_hash_djb_uchar(UINT32_HASH_DJB_INIT, tagc)
             : UINT32_HASH_DJB_INIT;
-        khash = uint32_hash_djb(khash_init, key, klen);
+        return uint32_hash_djb(khash_init, key, klen);
+    }
+    else if (map->hash_fn == uint32_hash_fast) {
+        return (tagc != 0) /* (tagc is first byte of key in mcdb) */
+          ? uint32_hash_fast_tagged(map->hash_init, tagc, key, klen)
+          : uint32_hash_fast(map->hash_init, key, klen);
     }
     else {
         const uint32_t khash_init = /*init hash value; hash tagc if tagc not 0*/
           (tagc != 0)
-            ? m->map->hash_fn(m->map->hash_init, (const char *)&tagc, 1u)
-            : m->map->hash_init;
-        khash = m->map->hash_fn(khash_init, key, klen);
+            ? map->hash_fn(map->hash_init, (const char *)&tagc, 1u)
+            : map->hash_init;
+        return map->hash_fn(khash_init, key, klen);
     }
+}
 
-    /* (hash function should not change on refresh,
-     *  else move mcdb_thread_refresh_self() before khash calculation)*/
-    (void) mcdb_thread_refresh_self(m);
-    /* (ignore rc; continue with previous map in case of failure) */
+static inline const unsigned char *
+mcdb_bloom_blkptr(const struct mcdb_mmap * const restrict map,
+                  const uint32_t khash)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+static inline const unsigned char *
+mcdb_bloom_blkptr(const struct mcdb_mmap * const restrict map,
+                  const uint32_t khash)
+{
+    const uint64_t x = mcdb_bloom_mix(khash);
+    return map->bloom + mcdb_bloom_blk(x, map->bloom_nblk) * MCDB_BLOOM_BLKSZ;
+}
+
+static inline bool
+mcdb_bloom_check(const struct mcdb_mmap * const restrict map,
+                 const uint32_t khash)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+static inline bool
+mcdb_bloom_check(const struct mcdb_mmap * const restrict map,
+                 const uint32_t khash)
+{
+    /* (all k bits for key are in a single cache line) */
+    const unsigned char * const restrict blk = mcdb_bloom_blkptr(map, khash);
+    uint64_t x = mcdb_bloom_mix(khash);
+    uint32_t j;
+    x = mcdb_bloom_bits(x);
+    for (j = map->bloom_k; j; --j, x >>= 9) {
+        if (!(blk[(x & 511) >> 3] & (1u << (x & 7))))
+            return false;
+    }
+    return true;
+}
+
+static inline void
+mcdb_findtag_mphf(struct mcdb * const restrict m, const uint32_t khash)
+  __attribute_nonnull__;
 
+static inline void
+mcdb_findtag_mphf(struct mcdb * const restrict m, const uint32_t khash)
+{
+    /* locate (and prefetch) only element in which key might be in mphf;
+     * m->dpos is used to hold element offset until mcdb_findtagnext() */
+    const struct mcdb_mmap * const restrict map = m->map;
+    const uint64_t x = mcdb_mphf_mix(khash);
+    const unsigned char * const restrict pp =
+      map->mphf + ((uintptr_t)mcdb_mphf_bkt(x, map->mphf_nb) << 1);
+    const uint32_t pilot = ((uint32_t)pp[0] << 8) | pp[1];
+    m->dpos = (uintptr_t)(map->mphf_tbl - map->ptr)
+            + ((uintptr_t)mcdb_mphf_pos(x, pilot, map->mphf_sz) << map->mphf_b);
+    m->mphf = 1;
+    __builtin_prefetch(map->ptr + m->dpos, 0, PLASMA_ATTR_MM_HINT_T1);
+}
+
+static inline bool
+mcdb_findtag_slot(struct mcdb * const restrict m, const uint32_t khash)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+static inline bool
+mcdb_findtag_slot(struct mcdb * const restrict m, const uint32_t khash)
+{
     /* (size of data in lvl1 hash table element is 16-bytes (shift 4 bits)) */
-    ptr = m->map->ptr + ((khash & MCDB_SLOT_MASK) << 4);
+    const unsigned char * restrict ptr =
+      m->map->ptr + ((khash & MCDB_SLOT_MASK) << 4);
+    if (m->map->bloom != NULL && !mcdb_bloom_check(m->map, khash)) {
+        m->hslots = 0;  /* key not present; skip hash table probes */
+        m->loop   = 0;
+        m->mphf   = 0;
+        return false;
+    }
+    m->mphf  = 0;
+    if (m->map->mphf != NULL)
+        mcdb_findtag_mphf(m, khash);
+    if (m->map->fmt & MCDB_FMT_INDEX_LE)     /*store in index byte order*/
+        m->khash = khash;
+    else
+        uint32_strpack_bigendian_aligned_macro(&m->khash, khash);
     m->hpos  = uint64_strunpack_bigendian_aligned_macro(ptr);
     m->hslots= uint32_strunpack_bigendian_aligned_macro(ptr+8);
     m->loop  = 0;
     if (__builtin_expect((!m->hslots), 0))
-        return false;
+        return (m->mphf != 0);
     /* (size of data in lvl2 hash table element is 16-bytes (shift 4 bits)) */
     m->kpos  = m->hpos
-             +(((uintptr_t)((khash>>MCDB_SLOT_BITS) % m->hslots)) << m->map->b);
+             +((m->map->fmt & MCDB_FMT_LAYOUT_MASK) != MCDB_FMT_LAYOUT_BUCKET
+               ? ((uintptr_t)((khash>>MCDB_SLOT_BITS) % m->hslots)) << m->map->b
+               : ((uintptr_t)((khash>>MCDB_SLOT_BITS) % (m->hslots>>3))) << 6);
     ptr = m->map->ptr + m->kpos;             /*prefetch for mcdb_findtagnext()*/
     __builtin_prefetch(ptr,0,PLASMA_ATTR_MM_HINT_T1);
     __builtin_prefetch(ptr+64,0,PLASMA_ATTR_MM_HINT_T1);
-    uint32_strpack_bigendian_aligned_macro(&m->khash, khash);/*store bigendian*/
     return true;
 }
 
 bool
-mcdb_findtagnext(struct mcdb * const restrict m,
-                 const char * const restrict key, const size_t klen,
-                 const unsigned char tagc)
+mcdb_findtagstart(struct mcdb * const restrict m,
+                  const char * const restrict key, const size_t klen,
+                  const unsigned char tagc)
+{
+    uint32_t khash;
+
+    /* (refresh before khash calculation; hash function may change on refresh,
+     *  since hash function is chosen per mcdb file (mcdbctl make -H)) */
+    (void) mcdb_thread_refresh_self(m);
+    /* (ignore rc; continue with previous map in case of failure) */
+    khash = mcdb_findtag_hash(m->map, key, klen, tagc);
+
+  #ifdef MCDB_STATS
+    {
+        const bool rc = mcdb_findtag_slot(m, khash);
+        mcdb_stats_lookup(rc);
+        return rc;
+    }
+  #else
+    return mcdb_findtag_slot(m, khash);
+  #endif
+}
+
+/* (inlined twice with constant le, so that native-endian index probes do not
+ *  byte swap; record headers in data section always remain bigendian) */
+static inline bool
+mcdb_findtagnext_idx(struct mcdb * const restrict m,
+                     const char * const restrict key, const size_t klen,
+                     const unsigned char tagc, const bool le)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+static inline bool
+mcdb_findtagnext_idx(struct mcdb * const restrict m,
+                     const char * const restrict key, const size_t klen,
+                     const unsigned char tagc, const bool le)
 {
     const unsigned char * ptr;
     const unsigned char * const restrict mptr = m->map->ptr;
     const uintptr_t hslots_end= m->hpos + (((uintptr_t)m->hslots) << m->map->b);
     uintptr_t vpos;
     uint32_t khash;
+    mcdb_stats_decl(st);
+
+    if (m->mphf) {
+        /* check single mphf element; key not in mphf is in hash tables */
+        m->mphf = 0;
+        mcdb_stats_probe(st, 1);
+        ptr = mptr + m->dpos;
+        vpos = (*(uint32_t *)ptr == m->khash) /*(m->khash in index byte order)*/
+          ? (m->map->mphf_b == 3)
+            ? (uintptr_t)mcdb_idx_u32(ptr+4, le)
+            : (uintptr_t)mcdb_idx_u64(ptr+8, le)
+          : 0;
+        if (vpos && (m->klen = uint32_strunpack_bigendian_macro(mptr+vpos))
+                    == klen+(tagc!=0)) {
+            ptr = mptr + vpos + 8;
+            m->dlen = uint32_strunpack_bigendian_macro(ptr-4);
+            m->dpos = vpos + 8 + m->klen;
+            if ((tagc == 0 || tagc == *ptr++) && memcmp(key,ptr,klen) == 0) {
+                m->loop   = 1;
+                m->hslots = 0; /*(khash unique; key not also in hash tables)*/
+                return true;
+            }
+        }
+        if (vpos)
+            mcdb_stats_inc(st, kmismatch);
+    }
 
-    if (m->map->b == 3) {
+    if ((m->map->fmt & MCDB_FMT_LAYOUT_MASK) == MCDB_FMT_LAYOUT_PACKED) {
+        /* (b == 3) 8-byte elements with 24-bit khash fragment, 40-bit dpos */
+        const uint32_t kh = mcdb_idx_u32(&m->khash, le);
         while (m->loop < m->hslots) {
             ptr = mptr + m->kpos;
             m->kpos += 8;
             if (__builtin_expect((m->kpos == hslots_end), 0))
                 m->kpos = m->hpos;
-            khash= *(uint32_t *)ptr; /* m->khash stored bigendian */
-            vpos = uint32_strunpack_bigendian_aligned_macro(ptr+4);
+            khash= mcdb_idx_u32(ptr, le);
+            vpos = ((uintptr_t)(khash & MCDB_SLOT_MASK) << 16 << 16)
+                 | mcdb_idx_u32(ptr+4, le);
             ptr  = mptr + vpos;
             __builtin_prefetch((char *)ptr, 0, PLASMA_ATTR_MM_HINT_T2);
             if (__builtin_expect((!vpos), 0))
                 break;
             ++m->loop;
+            mcdb_stats_probe(st, m->loop);
+            if (((khash ^ kh) & ~(uint32_t)MCDB_SLOT_MASK) == 0) {
+                ptr = mptr + vpos + 8;
+                m->klen = uint32_strunpack_bigendian_macro(ptr-8);
+                m->dlen = uint32_strunpack_bigendian_macro(ptr-4);
+                m->dpos = vpos + 8 + m->klen;
+                if (m->klen == klen+(tagc!=0)
+                    && (tagc == 0 || tagc == *ptr++) && memcmp(key,ptr,klen)==0)
+                    return true;
+                mcdb_stats_inc(st, kmismatch);
+            }
+        }
+    }
+    else if ((m->map->fmt & MCDB_FMT_LAYOUT_MASK) == MCDB_FMT_LAYOUT_BUCKET) {
+        /* compare hash fragment and klen in bucket before touching record */
+        const size_t kl = klen + (tagc != 0);
+        uint32_t tag = mcdb_bucket_frag(
+                         mcdb_idx_u32(&m->khash, le));
+        tag = (tag << 16) | (kl < MCDB_BUCKET_KLEN_MAX ? (uint32_t)kl
+                                                        : MCDB_BUCKET_KLEN_MAX);
+        if (!le)
+            uint32_strpack_bigendian_aligned_macro(&tag, tag); /*(bigendian)*/
+        while (m->loop < m->hslots) {
+            ptr = mptr + m->kpos;
+            m->kpos += 8;
+            if (__builtin_expect((m->kpos == hslots_end), 0))
+                m->kpos = m->hpos;
+            vpos = mcdb_idx_u32(ptr+4, le);
+            if (__builtin_expect((!vpos), 0))
+                break;
+            ++m->loop;
+            mcdb_stats_probe(st, m->loop);
+            if (*(uint32_t *)ptr == tag) {
+                ptr = mptr + vpos + 8;
+                m->klen = uint32_strunpack_bigendian_macro(ptr-8);
+                m->dlen = uint32_strunpack_bigendian_macro(ptr-4);
+                m->dpos = vpos + 8 + m->klen;
+                if (m->klen == kl
+                    && (tagc == 0 || tagc == *ptr++) && memcmp(key,ptr,klen)==0)
+                    return true;
+                mcdb_stats_inc(st, kmismatch);
+            }
+        }
+    }
+    else if (m->map->b == 3) {
+        while (m->loop < m->hslots) {
+            ptr = mptr + m->kpos;
+            m->kpos += 8;
+            if (__builtin_expect((m->kpos == hslots_end), 0))
+                m->kpos = m->hpos;
+            khash= *(uint32_t *)ptr; /*(m->khash in index byte order)*/
+            vpos = mcdb_idx_u32(ptr+4, le);
+            ptr  = mptr + vpos;
+            __builtin_prefetch((char *)ptr, 0, PLASMA_ATTR_MM_HINT_T2);
+            if (__builtin_expect((!vpos), 0))
+                break;
+            ++m->loop;
+            mcdb_stats_probe(st, m->loop);
             if (khash == m->khash) {
                 ptr = mptr + vpos + 8;
                 m->klen = uint32_strunpack_bigendian_macro(ptr-8);
@@ -159,6 +416,7 @@ mcdb_findtagnext(struct mcdb * const restrict m,
                 if (m->klen == klen+(tagc!=0)
                     && (tagc == 0 || tagc == *ptr++) && memcmp(key,ptr,klen)==0)
                     return true;
+                mcdb_stats_inc(st, kmismatch);
             }
         }
     }
@@ -168,25 +426,196 @@ mcdb_findtagnext(struct mcdb * const restrict m,
             m->kpos += 16;
             if (__builtin_expect((m->kpos == hslots_end), 0))
                 m->kpos = m->hpos;
-            khash   = *(uint32_t *)ptr; /* m->khash stored bigendian */
-            m->klen = uint32_strunpack_bigendian_aligned_macro(ptr+4);
-            vpos    = uint64_strunpack_bigendian_aligned_macro(ptr+8);
+            khash   = *(uint32_t *)ptr; /*(m->khash in index byte order)*/
+            m->klen = mcdb_idx_u32(ptr+4, le);
+            vpos    = mcdb_idx_u64(ptr+8, le);
             __builtin_prefetch((char *)mptr+vpos+4, 0, PLASMA_ATTR_MM_HINT_T2);
             if (__builtin_expect((!vpos), 0))
                 break;
             ++m->loop;
+            mcdb_stats_probe(st, m->loop);
             if (khash == m->khash && m->klen == klen+(tagc!=0)) {
                 m->dpos = vpos + 8 + m->klen;
                 ptr = mptr + vpos + 8;
                 m->dlen = uint32_strunpack_bigendian_macro(ptr-4);
                 if ((tagc == 0 || tagc == *ptr++) && memcmp(key,ptr,klen) == 0)
                     return true;
+                mcdb_stats_inc(st, kmismatch);
             }
         }
     }
+    mcdb_stats_inc(st, misses);
     return (m->loop = false);
 }
 
+/* resolve reference to shared data (MCDB_FMT_VALREF) (see mcdb.h)
+ * (earlier copy of data must precede record)
+ * or locate compressed data (MCDB_FMT_VALZ) (see mcdb.h) */
+__attribute_noinline__  __attribute_cold__
+static bool
+mcdb_findtagnext_valref(struct mcdb * const restrict m)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__  __attribute_cold__
+static bool
+mcdb_findtagnext_valref(struct mcdb * const restrict m)
+{
+    const unsigned char * const restrict p = m->map->ptr + m->dpos;
+    const uint64_t dpos = ((uint64_t)uint32_strunpack_bigendian_macro(p) << 32)
+                        | uint32_strunpack_bigendian_macro(p+4);
+    const uint32_t dlen = m->dlen & ~MCDB_DLEN_REF;
+    if (*p & 0x80) { /*(MCDB_ZLEN_FLAG)*/
+        const uint32_t zlen =
+          uint32_strunpack_bigendian_macro(p) & ~MCDB_ZLEN_FLAG;
+        if (!(m->map->fmt & MCDB_FMT_VALZ)
+            || zlen == 0 || zlen > m->map->size - m->dpos - 4)
+            return (m->loop = false);  /*(invalid mcdb)*/
+        m->dpos += 4;
+        m->dlen  = dlen;
+        m->zlen  = zlen;
+        return true;
+    }
+    if (dpos == MCDB_DPOS_TOMBSTONE && dlen == 0
+        && (m->map->fmt & MCDB_FMT_VALREF)) {
+        m->dpos = MCDB_DPOS_TOMBSTONE;
+        m->dlen = 0;
+        return true;
+    }
+    if (!(m->map->fmt & MCDB_FMT_VALREF)
+        || dpos < MCDB_HEADER_SZ || dpos + dlen > m->dpos - 8 - m->klen)
+        return (m->loop = false);  /*(invalid mcdb)*/
+    m->dpos = (uintptr_t)dpos;
+    m->dlen = dlen;
+    return true;
+}
+
+bool
+mcdb_findtagnext(struct mcdb * const restrict m,
+                 const char * const restrict key, const size_t klen,
+                 const unsigned char tagc)
+{
+  #if MCDB_HOST_LE
+    if (m->map->fmt & MCDB_FMT_INDEX_LE) {
+        if (!mcdb_findtagnext_idx(m, key, klen, tagc, true))
+            return false;
+    }
+    else
+  #endif
+    if (!mcdb_findtagnext_idx(m, key, klen, tagc, false))
+        return false;
+    mcdb_stats_inc(mcdb_stats_self(), hits);
+    m->rpos = m->dpos;
+    m->zlen = 0;
+    return __builtin_expect( !(m->dlen & MCDB_DLEN_REF), 1)
+        || mcdb_findtagnext_valref(m);
+}
+
+size_t
+mcdb_findtag_iov(struct mcdb * const restrict m,
+                 const char * const restrict key, const size_t klen,
+                 const unsigned char tagc,
+                 struct iovec * const restrict iov, const size_t n)
+{
+    size_t i = 0;
+    if (!mcdb_findtagstart(m, key, klen, tagc))
+        return 0;
+    while (mcdb_findtagnext(m, key, klen, tagc)) {
+        if (__builtin_expect( (m->zlen != 0), 0)) {
+            errno = ENOTSUP;
+            return SIZE_MAX;
+        }
+        if (i < n) {
+            /* (prefetch value for caller; record of next element is prefetched
+             *  while probing hash table in mcdb_findtagnext()) */
+            const unsigned char * const p = m->map->ptr + m->dpos;
+            __builtin_prefetch((char *)p, 0, PLASMA_ATTR_MM_HINT_T0);
+            if (m->dlen > 64)
+                __builtin_prefetch((char *)p+64, 0, PLASMA_ATTR_MM_HINT_T0);
+            iov[i].iov_base = (void *)(uintptr_t)p;
+            iov[i].iov_len  = m->dlen;
+        }
+        ++i;
+    }
+    return i;
+}
+
+/* batched lookup of n keys, overlapping memory latency across keys
+ * Lookups proceed in windows of MCDB_BATCH_WINDOW keys, stage by stage:
+ *   hash all keys and prefetch lvl1 hash table (header) slots (and filter),
+ *   read slots and prefetch lvl2 hash table entries,
+ *   read first entries and prefetch records,
+ *   then complete each lookup with mcdb_findtagnext()
+ * Each m[i].map must be initialized by caller (may be the same map for all).
+ * Upon return, each m[i] is in same state as after mcdb_findtagstart() and
+ * mcdb_findtagnext() on keys[i]; m[i].loop != 0 if keys[i] was found, and
+ * mcdb_findtagnext() may be called on m[i] to find repeated keys[i].
+ * Returns number of keys found. */
+#define MCDB_BATCH_WINDOW 16
+size_t
+mcdb_findtag_batch(struct mcdb * const restrict m, const size_t n,
+                   const char * const * const restrict keys,
+                   const size_t * const restrict klens,
+                   const unsigned char tagc)
+{
+    uint32_t khash[MCDB_BATCH_WINDOW];
+    const unsigned char *ptr;
+    size_t found = 0;
+    size_t i, j, w;
+    for (j = 0; j < n; j += w) {
+        w = (n - j < MCDB_BATCH_WINDOW) ? n - j : MCDB_BATCH_WINDOW;
+
+        for (i = 0; i < w; ++i) {
+            (void) mcdb_thread_refresh_self(&m[j+i]); /*(before khash)*/
+            khash[i] = mcdb_findtag_hash(m[j+i].map, keys[j+i], klens[j+i],
+                                         tagc);
+            __builtin_prefetch(m[j+i].map->ptr+((khash[i]&MCDB_SLOT_MASK)<<4),
+                               0, PLASMA_ATTR_MM_HINT_T0);
+            if (m[j+i].map->bloom != NULL)
+                __builtin_prefetch(mcdb_bloom_blkptr(m[j+i].map, khash[i]),
+                                   0, PLASMA_ATTR_MM_HINT_T0);
+        }
+
+        for (i = 0; i < w; ++i) { /*(reuse khash[] as flag: non-empty slot)*/
+            khash[i] = mcdb_findtag_slot(&m[j+i], khash[i]);
+            mcdb_stats_lookup(khash[i]);
+        }
+
+        for (i = 0; i < w; ++i) {
+            const bool le = MCDB_HOST_LE
+                         && (m[j+i].map->fmt & MCDB_FMT_INDEX_LE);
+            if (!khash[i])
+                continue;
+            if (m[j+i].mphf) {  /*(mphf element, b is mphf_b, see above)*/
+                ptr = m[j+i].map->ptr + m[j+i].dpos;
+                ptr = m[j+i].map->ptr + (m[j+i].map->mphf_b == 3
+                  ? (uintptr_t)mcdb_idx_u32(ptr+4, le)
+                  : (uintptr_t)mcdb_idx_u64(ptr+8, le));
+            }
+            else if ((m[j+i].map->fmt & MCDB_FMT_LAYOUT_MASK)
+                     == MCDB_FMT_LAYOUT_PACKED) {
+                ptr = m[j+i].map->ptr + m[j+i].kpos;
+                ptr = m[j+i].map->ptr
+                  + (((uintptr_t)(mcdb_idx_u32(ptr, le) & MCDB_SLOT_MASK)
+                      << 16 << 16)
+                     | mcdb_idx_u32(ptr+4, le));
+            }
+            else {
+                ptr = m[j+i].map->ptr + m[j+i].kpos;
+                ptr = m[j+i].map->ptr + (m[j+i].map->b == 3
+                  ? (uintptr_t)mcdb_idx_u32(ptr+4, le)
+                  : (uintptr_t)mcdb_idx_u64(ptr+8, le));
+            }
+            __builtin_prefetch((char *)ptr, 0, PLASMA_ATTR_MM_HINT_T1);
+        }
+
+        for (i = 0; i < w; ++i) {
+            if (khash[i]
+                && mcdb_findtagnext(&m[j+i], keys[j+i], klens[j+i], tagc))
+                ++found;
+        }
+    }
+    return found;
+}
+
 /* read value from mmap const db into buffer and return pointer to buffer
  * (return NULL if position (offset) or length to read will be out-of-bounds)
  * Note: caller must terminate with '\0' if desired, i.e. buf[len] = '\0';
@@ -208,6 +637,13 @@ mcdb_numrecs(struct mcdb * const restrict m)
     if (map->n == ~0) {
         const unsigned char * const restrict ptr = map->ptr;
         uint32_t u = 0;
+        if (map->fmt & (MCDB_FMT_LAYOUT_MASK | MCDB_FMT_MPHF)) {
+            /* (hslots rounded up in other layouts, or records not in hash
+             *  tables (in mphf); num records in header) */
+            map->n = uint32_strunpack_bigendian_aligned_macro(
+                       ptr+MCDB_HDRX_OFFSET(MCDB_HDRX_NUMRECS));
+            return map->n;
+        }
         for (unsigned int i = 8; i < MCDB_HEADER_SZ; i += 16)
             u += uint32_strunpack_bigendian_aligned_macro(ptr+i);
         map->n = u >> 1;  /* (hslots / 2) */
@@ -237,21 +673,141 @@ mcdb_validate_slots(struct mcdb * const restrict m)
         else
             return false;
     } while ((u += 16) < MCDB_HEADER_SZ);
-    m->map->n = numrecs >> 1;  /* (hslots / 2) */
+    m->map->n = !(m->map->fmt & (MCDB_FMT_LAYOUT_MASK | MCDB_FMT_MPHF))
+      ? numrecs >> 1  /* (hslots / 2) */
+      : uint32_strunpack_bigendian_aligned_macro(
+          ptr+MCDB_HDRX_OFFSET(MCDB_HDRX_NUMRECS));
     return (hpos_next == m->map->size);
 }
 
+/* checksum of range [off, off+len) of map; compare with checksum at csum
+ * (range was checked against map->size when section directory was read,
+ *  except for hash tables, which are checked here) */
+#define mcdb_verify_range(map,off,len,csum) \
+  (uint32_crc32c(0, (map)->ptr+(off), (len)) \
+   == uint32_strunpack_bigendian_aligned_macro(csum))
+
+bool
+mcdb_verify_index(const struct mcdb_mmap * const restrict map)
+{
+    const unsigned char * const restrict ptr = map->ptr;
+    const unsigned char * const restrict c = map->cksum;
+    uint64_t dir, hpos, hlen;
+    uintptr_t endp;
+    uint32_t i;
+    if (c == NULL) {
+        errno = ENOTSUP;
+        return false;
+    }
+    if (!mcdb_verify_range(map, 0, MCDB_HEADER_SZ, c+MCDB_CKSUM_HDRSZ))
+        goto mismatch;
+    dir = ((uint64_t)uint32_strunpack_bigendian_aligned_macro(
+             ptr+MCDB_HDRX_OFFSET(MCDB_HDRX_SECTDIR_HI)) << 32)
+        | uint32_strunpack_bigendian_aligned_macro(
+             ptr+MCDB_HDRX_OFFSET(MCDB_HDRX_SECTDIR_LO));
+    for (endp = (uintptr_t)dir;
+         uint32_strunpack_bigendian_aligned_macro(ptr+endp) != 0;
+         endp += MCDB_SECT_ENTSZ) ;  /*(terminated; see init_sections)*/
+    endp += MCDB_SECT_ENTSZ;
+    if (!mcdb_verify_range(map, dir, endp - dir, c+MCDB_CKSUM_HDRSZ+4))
+        goto mismatch;
+    for (i = 0; i < MCDB_SLOTS; ++i) {
+        hpos = uint64_strunpack_bigendian_aligned_macro(ptr+(i<<4));
+        hlen = (uint64_t)uint32_strunpack_bigendian_aligned_macro(ptr+(i<<4)+8)
+               << map->b;
+        if (hpos > map->size || hlen > map->size - hpos
+            || !mcdb_verify_range(map, hpos, hlen,
+                                  c+MCDB_CKSUM_HDRSZ+8+(i<<2)))
+            goto mismatch;
+    }
+    return true;
+
+  mismatch:
+    errno = EBADMSG;
+    return false;
+}
+
+uint32_t
+mcdb_verify_blocks(const struct mcdb_mmap * const restrict map,
+                   uint32_t first, const uint32_t n)
+{
+    const uint32_t bits = map->cksum_bits;
+    uint32_t end;
+    if (first > map->cksum_nblk)
+        first = map->cksum_nblk;
+    end = (n < map->cksum_nblk - first) ? first + n : map->cksum_nblk;
+    for (; first < end; ++first) {
+        const uintptr_t off = MCDB_HEADER_SZ + ((uintptr_t)first << bits);
+        const uintptr_t len = (map->cksum_end - off > (1u << bits))
+          ? (1u << bits)
+          : map->cksum_end - off;
+        if (!mcdb_verify_range(map, off, len, map->cksum+mcdb_cksum_blk(first)))
+            break;
+    }
+    return first;
+}
+
+/* resolve reference to shared data (MCDB_FMT_VALREF) (see mcdb.h)
+ * or locate compressed data (MCDB_FMT_VALZ) (see mcdb.h) */
+__attribute_noinline__  __attribute_cold__
+static bool
+mcdb_iter_valref(struct mcdb_iter * const restrict iter)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__  __attribute_cold__
+static bool
+mcdb_iter_valref(struct mcdb_iter * const restrict iter)
+{
+    const unsigned char * const restrict p = iter->dptr;
+    const uint64_t dpos = ((uint64_t)uint32_strunpack_bigendian_macro(p) << 32)
+                        | uint32_strunpack_bigendian_macro(p+4);
+    iter->dlen &= ~MCDB_DLEN_REF;
+    if (*p & 0x80) { /*(MCDB_ZLEN_FLAG)*/
+        const uint32_t zlen =
+          uint32_strunpack_bigendian_macro(p) & ~MCDB_ZLEN_FLAG;
+        if (!(iter->map->fmt & MCDB_FMT_VALZ)
+            || zlen == 0 || zlen > (uintptr_t)(iter->eod + 7 - p) - 4) {
+            iter->ptr = iter->eod;     /*(invalid mcdb)*/
+            return false;
+        }
+        iter->zlen = zlen;
+        iter->dptr = iter->dptr + 4;
+        iter->ptr  = iter->dptr + zlen;
+        __builtin_prefetch(iter->ptr, 0, PLASMA_ATTR_MM_HINT_T0);
+        return true;
+    }
+    iter->ptr   = iter->dptr + 8;
+    if (dpos == MCDB_DPOS_TOMBSTONE && iter->dlen == 0
+        && (iter->map->fmt & MCDB_FMT_VALREF)) {
+        iter->dptr = iter->map->ptr;
+        __builtin_prefetch(iter->ptr, 0, PLASMA_ATTR_MM_HINT_T0);
+        return true;
+    }
+    if (!(iter->map->fmt & MCDB_FMT_VALREF) || dpos < MCDB_HEADER_SZ
+        || dpos + iter->dlen > (uintptr_t)(iter->kptr - 8 - iter->map->ptr)) {
+        iter->ptr = iter->eod;     /*(invalid mcdb)*/
+        return false;
+    }
+    iter->dptr = iter->map->ptr + dpos;
+    __builtin_prefetch(iter->ptr, 0, PLASMA_ATTR_MM_HINT_T0);
+    return true;
+}
+
 bool
 mcdb_iter(struct mcdb_iter * const restrict iter)
 {
     if (iter->ptr < iter->eod) {
         iter->klen = uint32_strunpack_bigendian_macro(iter->ptr);
         iter->dlen = uint32_strunpack_bigendian_macro(iter->ptr+4);
+        iter->kptr = iter->ptr + 8;
+        iter->dptr = iter->kptr + iter->klen;
+        iter->zlen = 0;
         iter->ptr += 8 + iter->klen + iter->dlen;
         if (iter->klen != ~0) {  /* (klen == ~0 padding at end of data) */
             /* klen <= INT_MAX-8 (see mcdb_make.c), so no need to also check
              *   (iter->ptr >= iter->eod-(MCDB_PAD_MASK-7))
              * (using original iter->ptr value before update above) */
+            if (__builtin_expect( (iter->dlen & MCDB_DLEN_REF), 0))
+                return mcdb_iter_valref(iter);
             __builtin_prefetch(iter->ptr, 0, PLASMA_ATTR_MM_HINT_T0);
             return true;
         }
@@ -277,6 +833,9 @@ mcdb_iter_init(struct mcdb_iter * const restrict iter,
     __builtin_prefetch(iter->ptr,0,PLASMA_ATTR_MM_HINT_T0);
     iter->klen = 0;                     /*(non-faulting prefetch ld if 0 recs)*/
     iter->dlen = 0;
+    iter->kptr = iter->ptr;
+    iter->dptr = iter->ptr;
+    iter->zlen = 0;
     iter->map  = m->map;
     /* Note: callers that intend to iterate through entire mcdb might call
      * posix_madvise() on the mcdb as long as mcdb fits into physical memory,
@@ -286,6 +845,248 @@ mcdb_iter_init(struct mcdb_iter * const restrict iter,
      */
 }
 
+/* first record which begins at or after q (or end of data (eod) if none)
+ * (candidate is record start if key of candidate is found in hash index, and
+ *  hash index element points to candidate) */
+__attribute_noinline__
+static unsigned char *
+mcdb_iter_recstart(struct mcdb_mmap * const restrict map,
+                   unsigned char * restrict q, unsigned char * const eod)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static unsigned char *
+mcdb_iter_recstart(struct mcdb_mmap * const restrict map,
+                   unsigned char * restrict q, unsigned char * const eod)
+{
+    struct mcdb m;
+    m.map = map;
+    for (; q + 8 <= eod; ++q) {
+        const uint32_t klen = uint32_strunpack_bigendian_macro(q);
+        const uintptr_t rpos = (uintptr_t)(q - map->ptr) + 8 + klen;
+        if (klen > INT_MAX-8 || klen > (uintptr_t)(eod - q) - 8)
+            continue;
+        if (!mcdb_findtagstart(&m, (char *)q+8, klen, 0))
+            continue;
+        while (mcdb_findtagnext(&m, (char *)q+8, klen, 0)) {
+            if (m.rpos == rpos)
+                return q;
+        }
+    }
+    return eod;
+}
+
+bool
+mcdb_iter_init_range(struct mcdb_iter * const restrict iter,
+                     struct mcdb * const restrict m,
+                     const uint32_t part, const uint32_t nparts)
+{
+    struct mcdb_mmap * const restrict map = m->map;
+    unsigned char * const ptr = map->ptr;
+    unsigned char *eod;
+    uint64_t dsz;
+    if (part >= nparts)
+        return (errno = EINVAL, false);
+    mcdb_iter_init(iter, m);
+    /* end of data precedes sections (between data and hash tables) */
+    eod = iter->eod;
+    if (map->bloom != NULL && eod > map->bloom)
+        eod = (unsigned char *)(uintptr_t)map->bloom;
+    if (map->mphf != NULL && eod > map->mphf)
+        eod = (unsigned char *)(uintptr_t)map->mphf;
+    if (map->sorted != NULL && eod > map->sorted)
+        eod = (unsigned char *)(uintptr_t)map->sorted;
+    if (map->zdict != NULL && eod > map->zdict)
+        eod = (unsigned char *)(uintptr_t)map->zdict;
+    if (map->cksum != NULL && eod > map->cksum)
+        eod = (unsigned char *)(uintptr_t)map->cksum;
+    dsz = (uint64_t)(eod - iter->ptr);
+    /* (range p begins at byte offset dsz * p / nparts, without overflow) */
+    #define mcdb_iter_range_off(p) \
+      ((uintptr_t)((dsz / nparts) * (p) + (dsz % nparts) * (p) / nparts))
+    if (part != 0)
+        iter->ptr = mcdb_iter_recstart(map, iter->ptr
+                                       + mcdb_iter_range_off(part), eod);
+    if (part+1 != nparts)
+        iter->eod = mcdb_iter_recstart(map, ptr + MCDB_HEADER_SZ
+                                       + mcdb_iter_range_off(part+1), eod);
+    #undef mcdb_iter_range_off
+    if (iter->ptr == eod)       /*(no records in part)*/
+        iter->eod = eod;
+    iter->kptr = iter->ptr;
+    iter->dptr = iter->ptr;
+    return true;
+}
+
+/* sorted key index (see mcdb.h) */
+
+struct mcdb_sorted_ent {
+  uint64_t shared;
+  uint64_t len;
+  uint64_t rpos;
+  const unsigned char *suffix;
+};
+
+/* decode LEB128 varint at *pp (ending before e) (false if invalid) */
+static inline bool
+mcdb_varint(const unsigned char ** const restrict pp,
+            const unsigned char * const e, uint64_t * const restrict v)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static inline bool
+mcdb_varint(const unsigned char ** const restrict pp,
+            const unsigned char * const e, uint64_t * const restrict v)
+{
+    const unsigned char *p = *pp;
+    uint64_t x = 0;
+    unsigned int s = 0;
+    do {
+        if (p == e || s > 63)
+            return false;
+        x |= (uint64_t)(*p & 0x7F) << s;
+        s += 7;
+    } while (*p++ & 0x80);
+    *v  = x;
+    *pp = p;
+    return true;
+}
+
+/* decode index entry at *pp (ending before e) (false if invalid) */
+static inline bool
+mcdb_sorted_ent(const unsigned char ** const restrict pp,
+                const unsigned char * const e,
+                struct mcdb_sorted_ent * const restrict x)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static inline bool
+mcdb_sorted_ent(const unsigned char ** const restrict pp,
+                const unsigned char * const e,
+                struct mcdb_sorted_ent * const restrict x)
+{
+    if (!mcdb_varint(pp, e, &x->shared) || !mcdb_varint(pp, e, &x->len)
+        || !mcdb_varint(pp, e, &x->rpos) || x->len > (uintptr_t)(e - *pp))
+        return false;
+    x->suffix = *pp;
+    *pp += x->len;
+    return true;
+}
+
+/* position cursor at first index entry of block b (or at end if b >= nblk) */
+static void
+mcdb_seek_blk(struct mcdb_seek * const restrict cur, const uint32_t b)
+  __attribute_nonnull__;
+static void
+mcdb_seek_blk(struct mcdb_seek * const restrict cur, const uint32_t b)
+{
+    const struct mcdb_mmap * const restrict map = cur->iter.map;
+    const uint64_t off = (b < map->sorted_nblk)
+      ? uint64_strunpack_bigendian_aligned_macro(
+          map->sorted + MCDB_SORTED_HDRSZ + ((uintptr_t)b << 3))
+      : 0;
+    if (off < mcdb_sorted_blkoff(map->sorted_nblk) || off >= map->sorted_sz) {
+        cur->blk = map->sorted_nblk;  /*(end (or invalid block offset))*/
+        cur->n   = 0;
+        cur->p   = NULL;
+        return;
+    }
+    cur->blk = b;
+    cur->n   = (map->sorted_n - b * map->sorted_blkn < map->sorted_blkn)
+      ? map->sorted_n - b * map->sorted_blkn
+      : map->sorted_blkn;
+    cur->p   = map->sorted + off;
+}
+
+bool
+mcdb_seek(struct mcdb_seek * const restrict cur, struct mcdb * const restrict m,
+          const char * const restrict key, const size_t klen)
+{
+    const struct mcdb_mmap * const restrict map = m->map;
+    const unsigned char * const k = (const unsigned char *)key;
+    const unsigned char *e, *p;
+    struct mcdb_sorted_ent x;
+    uint32_t lo = 0, hi = map->sorted_nblk, j;
+    size_t c, n, i;
+    int cmp;
+
+    mcdb_iter_init(&cur->iter, m);
+    if (map->sorted == NULL) {
+        errno = EINVAL;
+        return false;
+    }
+    e = map->sorted + map->sorted_sz;
+
+    /* binary search for lo: num of blocks with first key < key */
+    while (lo < hi) {
+        const uint32_t mid = lo + ((hi - lo) >> 1);
+        mcdb_seek_blk(cur, mid);
+        if (cur->p == NULL || !mcdb_sorted_ent(&cur->p, e, &x) || x.shared) {
+            mcdb_seek_blk(cur, map->sorted_nblk);  /*(invalid mcdb)*/
+            return true;
+        }
+        n = (klen < x.len) ? klen : (size_t)x.len;
+        cmp = memcmp(k, x.suffix, n);
+        if (cmp > 0 || (cmp == 0 && klen > x.len))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0) {
+        mcdb_seek_blk(cur, 0);
+        return true;
+    }
+
+    /* scan block lo-1 for first entry with key >= key, tracking c, length of
+     * prefix common to key and key of preceding entry (which is < key) */
+    mcdb_seek_blk(cur, lo-1);
+    if (cur->p == NULL || !mcdb_sorted_ent(&cur->p, e, &x)) {
+        mcdb_seek_blk(cur, map->sorted_nblk);  /*(invalid mcdb)*/
+        return true;
+    }
+    n = (klen < x.len) ? klen : (size_t)x.len;
+    for (c = 0; c < n && k[c] == x.suffix[c]; ++c) ;
+    for (j = cur->n - 1; j; --j) {
+        p = cur->p;
+        if (!mcdb_sorted_ent(&cur->p, e, &x))
+            break;
+        if (x.shared > c)       /* entry[c] == preceding[c] < key[c] */
+            continue;
+        if (x.shared == c) {
+            n = (klen - c < x.len) ? klen - c : (size_t)x.len;
+            for (i = 0; i < n && k[c+i] == x.suffix[i]; ++i) ;
+            if (i < n ? k[c+i] > x.suffix[i] : c+i < klen) {
+                c += i;         /* entry < key */
+                continue;
+            }
+        }
+        /* (x.shared < c: entry[shared] > preceding[shared] == key[shared]) */
+        cur->p = p;             /* entry >= key */
+        cur->n = j;
+        return true;
+    }
+    mcdb_seek_blk(cur, lo);
+    return true;
+}
+
+bool
+mcdb_seek_next(struct mcdb_seek * const restrict cur)
+{
+    const struct mcdb_mmap * const restrict map = cur->iter.map;
+    struct mcdb_sorted_ent x;
+    if (cur->n == 0) {
+        if (cur->blk + 1 >= map->sorted_nblk)
+            return false;
+        mcdb_seek_blk(cur, cur->blk + 1);
+        if (cur->n == 0)
+            return false;
+    }
+    --cur->n;
+    if (!mcdb_sorted_ent(&cur->p, map->sorted + map->sorted_sz, &x)
+        || x.rpos < MCDB_HEADER_SZ
+        || x.rpos >= (uintptr_t)(cur->iter.eod - map->ptr)) {
+        mcdb_seek_blk(cur, map->sorted_nblk);  /*(invalid mcdb)*/
+        return false;
+    }
+    cur->iter.ptr = map->ptr + x.rpos;
+    return mcdb_iter(&cur->iter);
+}
+
 
 /* Note: __attribute_noinline__ is used to mark less frequent code paths
  * to prevent inlining of seldoms used paths, hopefully improving instruction
@@ -306,21 +1107,312 @@ mcdb_mmap_unmap(struct mcdb_mmap * const restrict map)
     map->size = 0;    /* map->size initialization required for mcdb_read() */
 }
 
+/* locate known sections from section directory (ignore unknown sections) */
 __attribute_noinline__
-bool
-mcdb_mmap_init(struct mcdb_mmap * const restrict map, int fd)
+static bool
+mcdb_mmap_init_sections(struct mcdb_mmap * const restrict map,
+                        const uint64_t dir)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static bool
+mcdb_mmap_init_sections(struct mcdb_mmap * const restrict map,
+                        const uint64_t dir)
 {
-    struct stat st;
-    void * restrict x;
+    const unsigned char *p;
+    uint64_t off;
+    uint64_t sz;
+    uint32_t param;
+    if (dir < MCDB_HEADER_SZ || dir > map->size || (dir & 7))
+        return false;
+    for (p = map->ptr + dir; ; p += MCDB_SECT_ENTSZ) {
+        if ((uintptr_t)(map->ptr + map->size - p) < MCDB_SECT_ENTSZ)
+            return false;
+        param = uint32_strunpack_bigendian_aligned_macro(p+4);
+        off   = uint64_strunpack_bigendian_aligned_macro(p+8);
+        sz    = uint64_strunpack_bigendian_aligned_macro(p+16);
+        if (off > map->size || sz > map->size - off)
+            return false;
+        switch (uint32_strunpack_bigendian_aligned_macro(p)) {
+          case 0: /* end of section directory */
+            return true;
+          case MCDB_SECT_BLOOM:
+            if (sz == 0 || (sz % MCDB_BLOOM_BLKSZ) != 0
+                || sz / MCDB_BLOOM_BLKSZ > UINT_MAX
+                || param == 0 || param > 7)
+                return false;
+            map->bloom      = map->ptr + off;
+            map->bloom_nblk = (uint32_t)(sz / MCDB_BLOOM_BLKSZ);
+            map->bloom_k    = param;
+            break;
+          case MCDB_SECT_MPHF:
+            if (sz < MCDB_MPHF_HDRSZ || (param != 3 && param != 4))
+                return false;
+            else {
+                const unsigned char * const restrict h = map->ptr + off;
+                const uint32_t nb = uint32_strunpack_bigendian_aligned_macro(h);
+                const uint32_t nt = uint32_strunpack_bigendian_aligned_macro(h+4);
+                if (nb == 0 || nt == 0
+                    || sz < mcdb_mphf_tbloff(nb) + ((uint64_t)nt << param))
+                    return false;
+                map->mphf     = h + MCDB_MPHF_HDRSZ;
+                map->mphf_tbl = h + mcdb_mphf_tbloff(nb);
+                map->mphf_nb  = nb;
+                map->mphf_sz  = nt;
+                map->mphf_b   = param;
+            }
+            break;
+          case MCDB_SECT_ZDICT:
+            if (sz == 0 || sz > MCDB_ZDICT_MAX)
+                return false;
+            map->zdict    = map->ptr + off;
+            map->zdict_sz = (uint32_t)sz;
+            break;
+          case MCDB_SECT_SORTED:
+            if (sz < MCDB_SORTED_HDRSZ || param == 0 || (off & 7))
+                return false;
+            else {
+                const unsigned char * const restrict h = map->ptr + off;
+                const uint32_t nk =
+                  uint32_strunpack_bigendian_aligned_macro(h);
+                const uint32_t nb =
+                  uint32_strunpack_bigendian_aligned_macro(h+4);
+                if (nb != nk / param + (nk % param != 0)
+                    || sz < mcdb_sorted_blkoff(nb))
+                    return false;
+                map->sorted      = h;
+                map->sorted_sz   = (uintptr_t)sz;
+                map->sorted_n    = nk;
+                map->sorted_nblk = nb;
+                map->sorted_blkn = param;
+            }
+            break;
+          case MCDB_SECT_CKSUM:
+            if (sz < MCDB_CKSUM_HDRSZ || (off & 7))
+                return false;
+            else {
+                const unsigned char * const restrict h = map->ptr + off;
+                const uint64_t end =
+                  uint64_strunpack_bigendian_aligned_macro(h+8);
+                const uint32_t nb =
+                  uint32_strunpack_bigendian_aligned_macro(h+4);
+                if (uint32_strunpack_bigendian_aligned_macro(h)
+                    != MCDB_CKSUM_CRC32C)
+                    break;  /*(ignore unknown checksum algorithm)*/
+                if (param < 9 || param > 30
+                    || end < MCDB_HEADER_SZ || end > off
+                    || nb != ((end-MCDB_HEADER_SZ+(1u<<param)-1) >> param)
+                    || sz < mcdb_cksum_blk((uint64_t)nb))
+                    return false;
+                map->cksum      = h;
+                map->cksum_end  = (uintptr_t)end;
+                map->cksum_nblk = nb;
+                map->cksum_bits = param;
+            }
+            break;
+          default: /* ignore unknown section types */
+            break;
+        }
+    }
+}
 
-    mcdb_mmap_unmap(map);
+/* check bucketized layout header slots (hslots multiple of 8, aligned tables)
+ * (reader divides by (hslots/8); must not be 0 when hslots is non-zero) */
+__attribute_noinline__
+static bool
+mcdb_mmap_init_buckets(const struct mcdb_mmap * const restrict map)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static bool
+mcdb_mmap_init_buckets(const struct mcdb_mmap * const restrict map)
+{
+    const unsigned char * const restrict ptr = map->ptr;
+    if (map->b != 3 || map->size < MCDB_HEADER_SZ)
+        return false;
+    for (unsigned int i = 0; i < MCDB_HEADER_SZ; i += 16) {
+        if ((uint32_strunpack_bigendian_aligned_macro(ptr+i+8) & 7)
+            || (uint64_strunpack_bigendian_aligned_macro(ptr+i)
+                & (MCDB_BUCKET_SZ-1)))
+            return false;
+    }
+    return true;
+}
 
-    if (fstat(fd, &st) != 0) return false;
-  #if !defined(_LP64) && !defined(__LP64__)
-    if (st.st_size > (off_t)SIZE_MAX) return (errno = EFBIG, false);
-  #endif
-    x = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
-    if (x == MAP_FAILED) return false;             /*(touch page w/ mcdb hdr)*/
+#ifdef MAP_POPULATE
+#define mcdb_mmap_populate_flag(opt_flags) \
+  (((opt_flags) & MCDB_MMAP_OPT_POPULATE) ? MAP_POPULATE : 0)
+#else
+#define mcdb_mmap_populate_flag(opt_flags) 0
+#endif
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* offset of start of hash tables and sections, following data section
+ * (lowest offset referenced from header; header is not included) */
+static uintptr_t
+mcdb_mmap_index_offset(const struct mcdb_mmap * const restrict map)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static uintptr_t
+mcdb_mmap_index_offset(const struct mcdb_mmap * const restrict map)
+{
+    const unsigned char * const restrict ptr = map->ptr;
+    uintptr_t idx = map->size;
+    if (map->size < MCDB_HEADER_SZ)
+        return 0;
+    for (unsigned int i = 0; i < MCDB_HEADER_SZ; i += 16) {
+        const uint64_t hpos = uint64_strunpack_bigendian_aligned_macro(ptr+i);
+        if (idx > hpos)
+            idx = (uintptr_t)hpos;
+    }
+    if (map->bloom != NULL && idx > (uintptr_t)(map->bloom - ptr))
+        idx = (uintptr_t)(map->bloom - ptr);
+    if (map->mphf != NULL && idx > (uintptr_t)(map->mphf - ptr))
+        idx = (uintptr_t)(map->mphf - ptr);
+    if (map->sorted != NULL && idx > (uintptr_t)(map->sorted - ptr))
+        idx = (uintptr_t)(map->sorted - ptr);
+    return (idx > MCDB_HEADER_SZ) ? idx : MCDB_HEADER_SZ;
+}
+
+/* replace [off, off+len) of mapping with private anonymous copy of file */
+__attribute_noinline__
+static bool
+mcdb_mmap_copy_range(const struct mcdb_mmap * const restrict map,
+                     const int fd, const uintptr_t off, const size_t len)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static bool
+mcdb_mmap_copy_range(const struct mcdb_mmap * const restrict map,
+                     const int fd, const uintptr_t off, const size_t len)
+{
+    unsigned char * const restrict addr = map->ptr + off;
+    size_t n = 0;
+    ssize_t r;
+    if (mmap(addr, len, PROT_READ|PROT_WRITE,
+             MAP_FIXED|MAP_PRIVATE|MAP_ANONYMOUS, -1, 0) == MAP_FAILED)
+        return false;
+  #if defined(__linux__) && defined(SYS_mbind)
+    if (map->opt_numa_node >= 0 && map->opt_numa_node < 256) {
+        /* (advisory; bind pages to node before pages are first touched)
+         * (syscall used directly to avoid libnuma dependency) */
+        unsigned long nodemask[256/(sizeof(unsigned long)*8)];
+        memset(nodemask, 0, sizeof(nodemask));
+        nodemask[map->opt_numa_node / (sizeof(unsigned long)*8)] =
+          1UL << (map->opt_numa_node % (sizeof(unsigned long)*8));
+        (void)syscall(SYS_mbind, addr, len, 2 /*MPOL_BIND*/, nodemask,
+                      (unsigned long)(sizeof(nodemask)*8+1), 0);
+    }
+  #endif
+  #ifdef MADV_HUGEPAGE
+    if (map->opt_flags & MCDB_MMAP_OPT_HUGEPAGE)
+        (void)madvise(addr, len, MADV_HUGEPAGE);
+  #endif
+    while (n < len) {
+        r = pread(fd, addr+n, len-n, (off_t)(off+n));
+        if (r > 0)
+            n += (size_t)r;
+        else if (r == 0)
+            return (errno = EIO, false); /*(file truncated)*/
+        else if (errno != EINTR)
+            return false;
+    }
+    return (mprotect(addr, len, PROT_READ) == 0);
+}
+
+/* apply mapping options (MCDB_MMAP_OPT_*) to validated mcdb mapping */
+__attribute_noinline__
+static bool
+mcdb_mmap_init_opts(struct mcdb_mmap * const restrict map, const int fd)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static bool
+mcdb_mmap_init_opts(struct mcdb_mmap * const restrict map, const int fd)
+{
+    const uint32_t flags = map->opt_flags;
+    const uintptr_t pagesz = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t idx = mcdb_mmap_index_offset(map) & ~(pagesz-1);
+    size_t hdrsz = (size_t)MCDB_HEADER_SZ;
+    hdrsz = (hdrsz + pagesz-1) & ~(pagesz-1);
+    if (hdrsz > map->size)
+        hdrsz = map->size;
+    if (idx <= hdrsz) {  /*(header and index page(s) overlap or adjacent)*/
+        idx   = 0;
+        hdrsz = 0;
+    }
+
+  #ifndef MAP_POPULATE
+    if (flags & MCDB_MMAP_OPT_POPULATE)
+        posix_madvise(map->ptr, map->size, POSIX_MADV_WILLNEED);
+  #endif
+  #ifdef MADV_HUGEPAGE  /*(file THP requires filesystem and kernel support)*/
+    if ((flags & MCDB_MMAP_OPT_HUGEPAGE) && !(flags & MCDB_MMAP_OPT_COPY_INDEX))
+        (void)madvise(map->ptr, map->size, MADV_HUGEPAGE);
+  #endif
+
+    if (flags & MCDB_MMAP_OPT_COPY_INDEX) {
+        if ((hdrsz && !mcdb_mmap_copy_range(map, fd, 0, hdrsz))
+            || !mcdb_mmap_copy_range(map, fd, idx, map->size - idx)) {
+            const int errnum = errno;
+            mcdb_mmap_unmap(map);
+            errno = errnum;
+            return false;
+        }
+    }
+
+    if (flags & MCDB_MMAP_OPT_MLOCK_INDEX) {
+        if ((hdrsz && mlock(map->ptr, hdrsz) != 0)
+            || mlock(map->ptr + idx, map->size - idx) != 0) {
+            const int errnum = errno;
+            mcdb_mmap_unmap(map);  /*(munmap() also unlocks pages)*/
+            errno = errnum;
+            return false;
+        }
+    }
+
+    /* (verify after index copy, if any, since lookups read the copy) */
+    if (flags & (MCDB_MMAP_OPT_VERIFY | MCDB_MMAP_OPT_VERIFY_DATA)) {
+        bool rc = mcdb_verify_index(map);
+        if (rc && (flags & MCDB_MMAP_OPT_VERIFY_DATA)
+            && mcdb_verify_blocks(map,0,map->cksum_nblk) != map->cksum_nblk) {
+            errno = EBADMSG;
+            rc = false;
+        }
+        if (!rc) {
+            const int errnum = errno;
+            mcdb_mmap_unmap(map);
+            errno = errnum;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* mcdb created by newer mcdb_make with format unknown to this reader */
+__attribute_noinline__  __attribute_cold__
+static bool
+mcdb_mmap_init_fmterr(struct mcdb_mmap * const restrict map)
+{
+    mcdb_mmap_unmap(map);
+    errno = EPROTONOSUPPORT;
+    return false;
+}
+
+__attribute_noinline__
+bool
+mcdb_mmap_init(struct mcdb_mmap * const restrict map, int fd)
+{
+    struct stat st;
+    void * restrict x;
+
+    mcdb_mmap_unmap(map);
+
+    if (fstat(fd, &st) != 0) return false;
+  #if !defined(_LP64) && !defined(__LP64__)
+    if (st.st_size > (off_t)SIZE_MAX) return (errno = EFBIG, false);
+  #endif
+    x = mmap(0, (size_t)st.st_size, PROT_READ,
+           MAP_SHARED|mcdb_mmap_populate_flag(map->opt_flags), fd, 0);
+    if (x == MAP_FAILED) return false;             /*(touch page w/ mcdb hdr)*/
     __builtin_prefetch((char *)x, 0, PLASMA_ATTR_MM_HINT_T0);
   #if 0 /* disable; does not appear to improve performance */
     /*(peformance hit when hitting an uncached mcdb on my 32-bit Pentium-M)*/
@@ -335,9 +1427,76 @@ mcdb_mmap_init(struct mcdb_mmap * const restrict map, int fd)
     map->mtime = st.st_mtime;
     map->next  = NULL;
     map->refcnt= 0;
-    map->hash_init = UINT32_HASH_DJB_INIT;
-    map->hash_fn   = uint32_hash_djb;
-    return true;
+    map->reopen= 0;
+    map->retired = NULL;
+    map->fmt   = (map->size >= MCDB_HEADER_SZ)
+      ? uint32_strunpack_bigendian_aligned_macro(map->ptr+MCDB_FMT_OFFSET)
+      : 0;
+    if (__builtin_expect( (map->fmt & ~MCDB_FMT_KNOWN), 0))
+        return mcdb_mmap_init_fmterr(map);
+    if (!MCDB_HOST_LE && (map->fmt & MCDB_FMT_INDEX_LE))
+        return mcdb_mmap_init_fmterr(map); /*(little-endian index; BE host)*/
+    switch (map->fmt & MCDB_FMT_HASH_MASK) {
+      case MCDB_FMT_HASH_DJB:
+        map->hash_init = UINT32_HASH_DJB_INIT;
+        map->hash_fn   = uint32_hash_djb;
+        break;
+      case MCDB_FMT_HASH_FAST:
+        map->hash_init = UINT32_HASH_FAST_INIT;
+        map->hash_fn   = uint32_hash_fast;
+        break;
+      default:
+        return mcdb_mmap_init_fmterr(map);
+    }
+    switch (map->fmt & MCDB_FMT_LAYOUT_MASK) {
+      case MCDB_FMT_LAYOUT_CLASSIC:
+        break;
+      case MCDB_FMT_LAYOUT_BUCKET:
+        if (!mcdb_mmap_init_buckets(map)) {
+            mcdb_mmap_unmap(map);
+            errno = EINVAL;
+            return false;
+        }
+        break;
+      case MCDB_FMT_LAYOUT_PACKED:
+        map->b = 3;  /* 8-byte elements, even if data > 4 GB */
+        break;
+      default:
+        return mcdb_mmap_init_fmterr(map);
+    }
+    map->bloom      = NULL;
+    map->bloom_nblk = 0;
+    map->bloom_k    = 0;
+    map->mphf       = NULL;
+    map->mphf_tbl   = NULL;
+    map->mphf_nb    = 0;
+    map->mphf_sz    = 0;
+    map->mphf_b     = 0;
+    map->zdict      = NULL;
+    map->zdict_sz   = 0;
+    map->sorted     = NULL;
+    map->sorted_sz  = 0;
+    map->sorted_n   = 0;
+    map->sorted_nblk= 0;
+    map->sorted_blkn= 0;
+    map->cksum      = NULL;
+    map->cksum_end  = 0;
+    map->cksum_nblk = 0;
+    map->cksum_bits = 0;
+    if (map->size >= MCDB_HEADER_SZ) {
+        const uint64_t dir = ((uint64_t)
+          uint32_strunpack_bigendian_aligned_macro(
+            map->ptr+MCDB_HDRX_OFFSET(MCDB_HDRX_SECTDIR_HI)) << 32)
+          | uint32_strunpack_bigendian_aligned_macro(
+            map->ptr+MCDB_HDRX_OFFSET(MCDB_HDRX_SECTDIR_LO));
+        if ((dir != 0 && !mcdb_mmap_init_sections(map, dir))
+            || ((map->fmt & MCDB_FMT_MPHF) && map->mphf == NULL)) {
+            mcdb_mmap_unmap(map);
+            errno = EINVAL;
+            return false;
+        }
+    }
+    return (map->opt_flags == 0 || mcdb_mmap_init_opts(map, fd));
 }
 
 __attribute_noinline__
@@ -367,12 +1526,349 @@ mcdb_mmap_free(struct mcdb_mmap * const restrict map)
     }
 }
 
+/* check mtime of mcdb file (stat() polling) */
+static bool
+mcdb_mmap_refresh_stat(const struct mcdb_mmap * const restrict map)
+{
+    struct stat st;
+    return (map->ptr == NULL
+            || ( (
+                  #ifdef AT_FDCWD
+                    map->dfd != -1
+                      ? fstatat(map->dfd, map->fname, &st, 0) == 0
+                      :
+                  #endif
+                        stat(map->fname, &st) == 0 )
+                && map->mtime != st.st_mtime ) );
+}
+
+/* Notification-backed refresh (optional) (mcdb_mmap_watch())
+ * A watcher thread (one per process) is notified when a file is renamed into
+ * the directory containing a watched mcdb (inotify on Linux, kqueue on *BSD
+ * and Mac OSX) and increments the generation counter of the watch.
+ * mcdb_mmap_refresh_check() of a watched map compares generation counters
+ * instead of calling stat().  Watched maps revert to stat() polling if
+ * notification becomes unavailable (e.g. in child process after fork(), or if
+ * directory is removed or renamed).  Queue overflow is treated as update. */
+
+#if defined(_THREAD_SAFE) && defined(__linux__)
+#define MCDB_WATCH_INOTIFY
+#include <sys/inotify.h>
+#elif defined(_THREAD_SAFE) \
+   && (defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) \
+       || defined(__DragonFly__) || (defined(__APPLE__) && defined(__MACH__)))
+#define MCDB_WATCH_KQUEUE
+#include <sys/event.h>
+#endif
+
+#if defined(MCDB_WATCH_INOTIFY) || defined(MCDB_WATCH_KQUEUE)
+
+#include <signal.h>  /* sigfillset(), pthread_sigmask() */
+#include <stdio.h>   /* snprintf() */
+
+#define MCDB_WATCH_POLL 0u  /* generation: notification unavailable; stat() */
+
+struct mcdb_watch {
+  uint32_t gen;               /* generation; incremented when file replaced */
+  int wd;                     /* inotify watch descriptor, or kqueue dir fd */
+  struct mcdb_watch *next;    /* list of watches (under mcdb_watch_mutex) */
+ #ifdef MCDB_WATCH_KQUEUE
+  ino_t ino;                  /* inode of file at last notification */
+  time_t mtime;               /* mtime of file at last notification */
+ #endif
+  char name[];                /* basename of watched file */
+};
+
+static struct mcdb_watch *mcdb_watch_list;
+static pthread_mutex_t mcdb_watch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t mcdb_watch_once = PTHREAD_ONCE_INIT;
+static int mcdb_watch_fd = -1;   /* inotify or kqueue fd (-1 if unavailable) */
+
+static void
+mcdb_watch_gen_incr(struct mcdb_watch * const restrict w)
+{
+    uint32_t gen = w->gen;
+    if (gen == MCDB_WATCH_POLL)
+        return;
+    if (++gen == MCDB_WATCH_POLL)
+        ++gen;
+    plasma_atomic_store_explicit(&w->gen, gen, memory_order_release);
+}
+
+static void
+mcdb_watch_gen_poll(struct mcdb_watch * const restrict w)
+{
+    plasma_atomic_store_explicit(&w->gen,MCDB_WATCH_POLL,memory_order_release);
+}
+
+static void
+mcdb_watch_atfork_prepare(void)
+{
+    pthread_mutex_lock(&mcdb_watch_mutex);
+}
+
+static void
+mcdb_watch_atfork_parent(void)
+{
+    pthread_mutex_unlock(&mcdb_watch_mutex);
+}
+
+static void
+mcdb_watch_atfork_child(void)
+{
+    /* watcher thread does not exist in child; revert to stat() polling */
+    for (struct mcdb_watch *w = mcdb_watch_list; w != NULL; w = w->next)
+        mcdb_watch_gen_poll(w);
+    if (mcdb_watch_fd != -1) {
+        (void) nointr_close(mcdb_watch_fd);
+        mcdb_watch_fd = -1;
+    }
+    pthread_mutex_unlock(&mcdb_watch_mutex);
+}
+
+static void *
+mcdb_watch_thread(void * const arg  __attribute_unused__)
+{
+    struct mcdb_watch *w;
+    const int fd = mcdb_watch_fd;
+  #ifdef MCDB_WATCH_INOTIFY
+    union { struct inotify_event ev; char buf[4096]; } u;
+    ssize_t n;
+    while ((n = read(fd, u.buf, sizeof(u.buf))) > 0
+           || (n == -1 && errno == EINTR)) {
+        const char *p = u.buf;
+        if (n <= 0)
+            continue;
+        pthread_mutex_lock(&mcdb_watch_mutex);
+        for (; p < u.buf + n; p += sizeof(struct inotify_event)
+                                 + ((const struct inotify_event *)p)->len) {
+            const struct inotify_event * const ev =
+              (const struct inotify_event *)p;
+            for (w = mcdb_watch_list; w != NULL; w = w->next) {
+                if (ev->mask & IN_Q_OVERFLOW)
+                    mcdb_watch_gen_incr(w); /*(events lost; check all maps)*/
+                else if (w->wd != ev->wd)
+                    continue;
+                else if (ev->mask & (IN_IGNORED|IN_DELETE_SELF|IN_MOVE_SELF))
+                    mcdb_watch_gen_poll(w);
+                else if (ev->len != 0 && 0 == strcmp(ev->name, w->name))
+                    mcdb_watch_gen_incr(w);
+            }
+        }
+        pthread_mutex_unlock(&mcdb_watch_mutex);
+    }
+  #else /* MCDB_WATCH_KQUEUE */
+    struct kevent ev[16];
+    struct stat st;
+    int n;
+    while ((n = kevent(fd, NULL, 0, ev, 16, NULL)) >= 0 || errno == EINTR) {
+        pthread_mutex_lock(&mcdb_watch_mutex);
+        for (int i = 0; i < n; ++i) {
+            /*(ev udata might refer to watch removed while waiting for mutex)*/
+            for (w = mcdb_watch_list; w != NULL; w = w->next) {
+                if ((uintptr_t)ev[i].udata != (uintptr_t)w)
+                    continue;
+                if (ev[i].fflags & (NOTE_DELETE|NOTE_RENAME))
+                    mcdb_watch_gen_poll(w);
+                else if (fstatat(w->wd, w->name, &st, 0) == 0
+                         && (st.st_ino != w->ino || st.st_mtime != w->mtime)) {
+                    w->ino   = st.st_ino;
+                    w->mtime = st.st_mtime;
+                    mcdb_watch_gen_incr(w);
+                }
+                break;
+            }
+        }
+        pthread_mutex_unlock(&mcdb_watch_mutex);
+    }
+  #endif
+    /* notification failed; revert to stat() polling */
+    pthread_mutex_lock(&mcdb_watch_mutex);
+    for (w = mcdb_watch_list; w != NULL; w = w->next)
+        mcdb_watch_gen_poll(w);
+    pthread_mutex_unlock(&mcdb_watch_mutex);
+    return NULL;
+}
+
+static void
+mcdb_watch_init(void)
+{
+    pthread_attr_t attr;
+    pthread_t thr;
+    sigset_t set, oset;
+    int rc;
+
+  #ifdef MCDB_WATCH_INOTIFY
+    if ((mcdb_watch_fd = inotify_init1(IN_CLOEXEC)) == -1)
+        return;
+  #else
+    if ((mcdb_watch_fd = kqueue()) == -1)
+        return;
+    (void) fcntl(mcdb_watch_fd, F_SETFD, FD_CLOEXEC);
+  #endif
+
+    /* (watcher thread blocks all signals; detached; runs for process life) */
+    if (pthread_attr_init(&attr) != 0) {
+        (void) nointr_close(mcdb_watch_fd);
+        mcdb_watch_fd = -1;
+        return;
+    }
+    (void) pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    (void) sigfillset(&set);
+    (void) pthread_sigmask(SIG_SETMASK, &set, &oset);
+    rc = pthread_create(&thr, &attr, mcdb_watch_thread, NULL);
+    (void) pthread_sigmask(SIG_SETMASK, &oset, NULL);
+    (void) pthread_attr_destroy(&attr);
+    if (rc != 0
+        || pthread_atfork(mcdb_watch_atfork_prepare, mcdb_watch_atfork_parent,
+                          mcdb_watch_atfork_child) != 0) {
+        (void) nointr_close(mcdb_watch_fd); /*(watcher thread read() fails)*/
+        mcdb_watch_fd = -1;
+    }
+}
+
+static void
+mcdb_mmap_unwatch(struct mcdb_mmap * const restrict map)
+{
+    struct mcdb_watch * const w = map->watch;
+    struct mcdb_watch **prev;
+    bool shared = false;
+    map->watch = NULL;
+    pthread_mutex_lock(&mcdb_watch_mutex);
+    for (prev = &mcdb_watch_list; *prev != NULL; prev = &(*prev)->next) {
+        if (*prev == w) {
+            *prev = w->next;
+            break;
+        }
+    }
+  #ifdef MCDB_WATCH_INOTIFY
+    /* (inotify returns same watch descriptor for same directory) */
+    for (const struct mcdb_watch *x = mcdb_watch_list; x; x = x->next)
+        shared |= (x->wd == w->wd);
+    if (!shared && mcdb_watch_fd != -1)
+        (void) inotify_rm_watch(mcdb_watch_fd, w->wd);
+  #else
+    (void) shared;
+    (void) nointr_close(w->wd);  /*(closing fd removes kevent)*/
+  #endif
+    pthread_mutex_unlock(&mcdb_watch_mutex);
+    free(w);
+}
+
+__attribute_noinline__
+bool
+mcdb_mmap_watch(struct mcdb_mmap * const restrict map)
+{
+    struct mcdb_watch *w;
+    const char * const fname = map->fname;
+    const char * const slash = strrchr(fname, '/');
+    const char * const base  = (slash != NULL) ? slash+1 : fname;
+    const size_t blen = strlen(base);
+    /* directory of fname (relative to map->dfd if map->dfd != -1) */
+    const char * const dname = (slash != NULL) ? fname : ".";
+    const int dlen = (slash != NULL && slash != fname) ? (int)(slash-fname) : 1;
+    char path[4096];
+    int rc;
+
+    if (map->watch != NULL)
+        return true;
+    if (pthread_once(&mcdb_watch_once, mcdb_watch_init) != 0
+        || mcdb_watch_fd == -1) {
+        errno = ENOSYS;
+        return false;
+    }
+    if (map->ptr == NULL || blen == 0) {
+        errno = EINVAL;
+        return false;
+    }
+    if ((w = malloc(sizeof(struct mcdb_watch) + blen + 1)) == NULL)
+        return false;
+    memcpy(w->name, base, blen+1);
+    w->gen = 1;
+
+  #ifdef MCDB_WATCH_INOTIFY
+    rc = (map->dfd != -1)
+      ? snprintf(path, sizeof(path), "/proc/self/fd/%d/%.*s",
+                 map->dfd, dlen, dname)
+      : snprintf(path, sizeof(path), "%.*s", dlen, dname);
+    w->wd = (rc >= 0 && (size_t)rc < sizeof(path))
+      ? inotify_add_watch(mcdb_watch_fd, path,
+                          IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR)
+      : (errno = ENAMETOOLONG, -1);
+    if (w->wd == -1) {
+        free(w);
+        return false;
+    }
+  #else
+    {
+        struct kevent ev;
+        struct stat st;
+        rc = snprintf(path, sizeof(path), "%.*s", dlen, dname);
+        w->wd = (rc >= 0 && (size_t)rc < sizeof(path))
+          ?
+           #ifdef AT_FDCWD
+            (map->dfd != -1)
+              ? nointr_openat(map->dfd, path, O_RDONLY|O_CLOEXEC, 0)
+              :
+           #endif
+                nointr_open(path, O_RDONLY|O_CLOEXEC, 0)
+          : (errno = ENAMETOOLONG, -1);
+        if (w->wd == -1) {
+            free(w);
+            return false;
+        }
+        if (O_CLOEXEC == 0)
+            (void) fcntl(w->wd, F_SETFD, FD_CLOEXEC);
+        if (fstatat(w->wd, w->name, &st, 0) == 0) {
+            w->ino   = st.st_ino;
+            w->mtime = st.st_mtime;
+        }
+        else {
+            w->ino   = 0;
+            w->mtime = 0;
+        }
+        EV_SET(&ev, w->wd, EVFILT_VNODE, EV_ADD|EV_CLEAR,
+               NOTE_WRITE|NOTE_DELETE|NOTE_RENAME, 0, w);
+        if (kevent(mcdb_watch_fd, &ev, 1, NULL, 0, NULL) == -1) {
+            (void) nointr_close(w->wd);
+            free(w);
+            return false;
+        }
+    }
+  #endif
+
+    pthread_mutex_lock(&mcdb_watch_mutex);
+    w->next = mcdb_watch_list;
+    mcdb_watch_list = w;
+    pthread_mutex_unlock(&mcdb_watch_mutex);
+
+    /* (file might have been replaced before watch was added) */
+    map->watch_gen = mcdb_mmap_refresh_stat(map) ? w->gen - 1 : w->gen;
+    plasma_atomic_store_explicit(&map->watch, w, memory_order_release);
+    return true;
+}
+
+#else  /* notification not supported; stat() polling */
+
+bool
+mcdb_mmap_watch(struct mcdb_mmap * const restrict map  __attribute_unused__)
+{
+    errno = ENOSYS;
+    return false;
+}
+
+#endif
+
 __attribute_noinline__
 void
 mcdb_mmap_destroy(struct mcdb_mmap * const restrict map)
 {
-  #ifdef AT_FDCWD
     if (map == NULL) return;
+  #if defined(MCDB_WATCH_INOTIFY) || defined(MCDB_WATCH_KQUEUE)
+    if (map->watch != NULL)
+        mcdb_mmap_unwatch(map);
+  #endif
+  #ifdef AT_FDCWD
     if (map->dfd != -1) {
         (void) nointr_close(map->dfd);
         map->dfd = -1;
@@ -389,6 +1885,12 @@ mcdb_mmap_reopen(struct mcdb_mmap * const restrict map)
     bool rc;
 
     const int oflags = O_RDONLY | O_NONBLOCK | O_CLOEXEC;
+  #if defined(MCDB_WATCH_INOTIFY) || defined(MCDB_WATCH_KQUEUE)
+    /* (load generation before open; notification after open is not lost) */
+    if (map->watch != NULL)
+        map->watch_gen =
+          plasma_atomic_load_explicit(&map->watch->gen, memory_order_acquire);
+  #endif
   #ifdef AT_FDCWD
     if (map->dfd != -1) {
         if ((fd = nointr_openat(map->dfd, map->fname, oflags, 0)) == -1)
@@ -409,17 +1911,16 @@ mcdb_mmap_reopen(struct mcdb_mmap * const restrict map)
 bool
 mcdb_mmap_refresh_check(const struct mcdb_mmap * const restrict map)
 {
-    struct stat st;
     plasma_membar_ld_datadep(); /*(thread ld order dep b/w map and map->ptr)*/
-    return (map->ptr == NULL
-            || ( (
-                  #ifdef AT_FDCWD
-                    map->dfd != -1
-                      ? fstatat(map->dfd, map->fname, &st, 0) == 0
-                      :
-                  #endif
-                        stat(map->fname, &st) == 0 )
-                && map->mtime != st.st_mtime ) );
+  #if defined(MCDB_WATCH_INOTIFY) || defined(MCDB_WATCH_KQUEUE)
+    if (map->watch != NULL) {
+        const uint32_t gen =
+          plasma_atomic_load_explicit(&map->watch->gen, memory_order_acquire);
+        if (__builtin_expect( (gen != MCDB_WATCH_POLL), 1))
+            return (map->ptr == NULL || map->watch_gen != gen);
+    }
+  #endif
+    return mcdb_mmap_refresh_stat(map);
 }
 
 /*
@@ -448,6 +1949,11 @@ mcdb_mmap_refresh_check(const struct mcdb_mmap * const restrict map)
  * (periodically) call mcdb_thread_refresh_self() to release the outdated mmap
  * before the thread gets around (some time in the future) to its next query.
  *
+ * Instead of stat() in each mcdb_mmap_refresh_check(), mcdb_mmap_watch(map)
+ * (optional) requests notification when mcdb file is renamed into place,
+ * after which mcdb_mmap_refresh_check() is a load of a generation counter.
+ * (call mcdb_mmap_watch() before sharing map with other threads)
+ *
  * Note: using map->dfd means that if a directory replaces existing directory,
  * mcdb_mmap will not notice.  Pass dname == NULL to skip using map->dfd.
  *
@@ -464,6 +1970,19 @@ mcdb_mmap_create(struct mcdb_mmap * restrict map,
                  const char * const dname  __attribute_unused__,
                  const char * const fname,
                  void * (*fn_malloc)(size_t), void (*fn_free)(void *))
+{
+    return mcdb_mmap_create_opts(map, dname, fname, fn_malloc, fn_free, NULL);
+}
+
+/* mcdb_mmap_create() with mapping options (MCDB_MMAP_OPT_*) (see mcdb.h)
+ * (options are retained in map and reapplied when mcdb is reopened) */
+__attribute_noinline__
+struct mcdb_mmap *
+mcdb_mmap_create_opts(struct mcdb_mmap * restrict map,
+                      const char * const dname  __attribute_unused__,
+                      const char * const fname,
+                      void * (*fn_malloc)(size_t), void (*fn_free)(void *),
+                      const struct mcdb_mmap_opts * const opts)
 {
     char *fbuf;
     size_t flen;
@@ -479,7 +1998,17 @@ mcdb_mmap_create(struct mcdb_mmap * restrict map,
     map->fn_free   = fn_free;
     map->allocated = allocated;
     map->dfd       = -1;
+    map->opt_numa_node = -1;
     flen           = strlen(fname);
+    if (opts != NULL) {
+        if (opts->flags & ~MCDB_MMAP_OPT_KNOWN) {
+            mcdb_mmap_destroy_h(map);
+            errno = EINVAL;
+            return NULL;
+        }
+        map->opt_flags     = opts->flags;
+        map->opt_numa_node = opts->numa_node;
+    }
 
   #if defined(AT_FDCWD)
     if (dname != NULL) {
@@ -530,75 +2059,433 @@ mcdb_mmap_create(struct mcdb_mmap * restrict map,
     }
 }
 
+/* mcdb_mmap_create_opts() of mcdb already open as fd (e.g. in-memory mcdb
+ * from mcdb_makefn_start_memfd(), or fd inherited from parent process)
+ * fd is not closed (caller may close fd once map is created).  Map has no
+ * file name, so map is not reopened (mcdb_mmap_refresh() is a no-op) */
 __attribute_noinline__
 struct mcdb_mmap *
-mcdb_mmap_thread_registration(struct mcdb_mmap ** const restrict mapptr,
-                              const int flags)
+mcdb_mmap_create_fd(struct mcdb_mmap * restrict map, const int fd,
+                    void * (*fn_malloc)(size_t), void (*fn_free)(void *),
+                    const struct mcdb_mmap_opts * const opts)
 {
-    struct mcdb_mmap *map;
-    struct mcdb_mmap *next = NULL;
-    struct mcdb_mmap *unmap = NULL;
-    const bool register_use_incr = ((flags & MCDB_REGISTER_USE_INCR) != 0);
-    #define register_use_decr (!register_use_incr)
+    const int allocated = (map != NULL);
 
-    /* use file-scoped global spinlock to protect scan of multiple mcdb_mmap's
-     * (care has been taken to avoid blocking operations while holding lock) */
+    if (map == NULL && (map = fn_malloc(sizeof(struct mcdb_mmap))) == NULL)
+        return NULL;
+    /* initialize */
+    memset(map, '\0', sizeof(struct mcdb_mmap));
+    map->fn_malloc = fn_malloc;
+    map->fn_free   = fn_free;
+    map->allocated = allocated;
+    map->dfd       = -1;
+    map->opt_numa_node = -1;
+    map->fname     = map->fnamebuf; /*(empty fname; stat("") fails ENOENT)*/
+    if (opts != NULL) {
+        if (opts->flags & ~MCDB_MMAP_OPT_KNOWN) {
+            mcdb_mmap_destroy_h(map);
+            errno = EINVAL;
+            return NULL;
+        }
+        map->opt_flags     = opts->flags;
+        map->opt_numa_node = opts->numa_node;
+    }
 
-    if (__builtin_expect( (!(flags & MCDB_REGISTER_ALREADY_LOCKED)), 1))
-        (void) plasma_spin_lock_acquire(&mcdb_global_spinlock);
-    plasma_membar_ccfence();
+    if (mcdb_mmap_init(map, fd)) {
+        ++map->refcnt;
+        return map;
+    }
+    else {
+        mcdb_mmap_destroy_h(map);
+        return NULL;
+    }
+}
+
+/* Registration of use of mcdb_mmap by threads
+ *
+ * mcdb_mmap_thread_registration() does not take a lock and does not write to
+ * memory shared with other threads when registering use of an up-to-date map.
+ * Each thread counts its registrations in a thread-private record of
+ * (map, count) slots (struct mcdb_treg).  The number of registrations of a
+ * map is the sum of map->refcnt (shared; e.g. reference held by creator of
+ * map, or registration released in a thread other than the one in which it
+ * was counted) and of the counts for map in all thread records.
+ * A registration is published in the thread record before the map pointer
+ * is re-checked and map is dereferenced (similar to hazard pointers).
+ *
+ * mcdb_mmap_reopen_threadsafe() points map->next of superseded maps at the
+ * newest map and places superseded maps on the mcdb_mmap_retired list.
+ * Registration of a superseded map moves to the newest map, so registration
+ * counts of superseded maps only decrease.  Superseded maps are released by
+ * mcdb_mmap_reclaim() once no thread holds a registration.  Global spinlock
+ * is taken only to reopen and to release superseded maps (and as fallback if
+ * thread record is unavailable or full). (thread records are never free'd;
+ * a record is reused after the thread which claimed it exits) */
+
+#ifdef _THREAD_SAFE
+
+#define MCDB_TREG_SLOTS 7
+
+struct mcdb_treg {
+  struct mcdb_mmap *map[MCDB_TREG_SLOTS]; /* maps registered in thread */
+  uint32_t cnt[MCDB_TREG_SLOTS];          /* registration counts */
+  uint32_t inuse;                         /* record claimed by a thread */
+  struct mcdb_treg *next;                 /* list of all thread records */
+#ifdef MCDB_STATS
+  struct mcdb_stats stats;                /* lookup counters of thread(s) */
+#endif
+};
+
+static struct mcdb_treg *mcdb_treg_list;
+static pthread_key_t mcdb_treg_key;
+static pthread_once_t mcdb_treg_once = PTHREAD_ONCE_INIT;
+static int mcdb_treg_key_rc = -1;
+
+#if !(defined(__APPLE__) && defined(__MACH__) \
+      && defined(__GNUC__) && !defined(__clang))
+static __thread struct mcdb_treg *mcdb_treg_tls;
+#define mcdb_treg_tls_get()   (mcdb_treg_tls)
+#define mcdb_treg_tls_set(r)  (mcdb_treg_tls = (r))
+#else
+/* gcc 4.2.1 on Mac OSX does not support __thread thread-local storage */
+#define mcdb_treg_tls_get()   \
+  (mcdb_treg_key_rc == 0    \
+   ? (struct mcdb_treg *)pthread_getspecific(mcdb_treg_key) : NULL)
+#define mcdb_treg_tls_set(r)  (void)0
+#endif
+
+static void
+mcdb_treg_detach(void * const r)
+{
+    /* thread exit; record (and counts in record) reused by another thread */
+    plasma_atomic_store_explicit(&((struct mcdb_treg *)r)->inuse, 0,
+                                 memory_order_release);
+}
+
+static void
+mcdb_treg_key_init(void)
+{
+    mcdb_treg_key_rc = pthread_key_create(&mcdb_treg_key, mcdb_treg_detach);
+}
+
+__attribute_noinline__
+static struct mcdb_treg *
+mcdb_treg_attach(void)
+  __attribute_cold__;
+__attribute_noinline__
+static struct mcdb_treg *
+mcdb_treg_attach(void)
+{
+    struct mcdb_treg *r;
+    void *p;
+
+    if (pthread_once(&mcdb_treg_once, mcdb_treg_key_init) != 0
+        || mcdb_treg_key_rc != 0)
+        return NULL;
+
+    for (r = plasma_atomic_load_explicit(&mcdb_treg_list, memory_order_acquire);
+         r != NULL; r = r->next) {
+        if (plasma_atomic_ld_nopt(&r->inuse) == 0
+            && plasma_atomic_CAS_32(&r->inuse, 0, 1))
+            break;
+    }
+    if (r == NULL) {
+        /* (separate cache lines for records of different threads) */
+        if (posix_memalign(&p, 64, (sizeof(struct mcdb_treg) + 63) & ~63) != 0)
+            return NULL;
+        r = (struct mcdb_treg *)p;
+        memset(r, '\0', sizeof(struct mcdb_treg));
+        r->inuse = 1;
+        do {
+            r->next = plasma_atomic_ld_nopt(&mcdb_treg_list);
+        } while (!plasma_atomic_CAS_ptr(&mcdb_treg_list, r->next, r));
+    }
+
+    if (pthread_setspecific(mcdb_treg_key, r) != 0) {
+        mcdb_treg_detach(r);
+        return NULL;
+    }
+    mcdb_treg_tls_set(r);
+    return r;
+}
+
+static inline struct mcdb_treg *
+mcdb_treg_self(void)
+{
+    struct mcdb_treg * const r = mcdb_treg_tls_get();
+    return __builtin_expect( (r != NULL), 1) ? r : mcdb_treg_attach();
+}
+
+static inline void
+mcdb_treg_slot_decr(struct mcdb_treg * const restrict r, const uint32_t i)
+{
+    const uint32_t c = r->cnt[i] - 1;
+    plasma_atomic_store_explicit(&r->cnt[i], c, memory_order_release);
+    if (c == 0)
+        plasma_atomic_store_explicit(&r->map[i], NULL, memory_order_release);
+}
 
-    map = *mapptr;
+/* count registration of map, then check that *mapptr still refers to map
+ * (map must not be dereferenced until registration is published and checked)*/
+static bool
+mcdb_treg_pin(struct mcdb_treg * const restrict r,
+              struct mcdb_mmap * const map,
+              struct mcdb_mmap * const * const mapptr)
+{
+    if (r != NULL) {
+        uint32_t i, e = MCDB_TREG_SLOTS;
+        for (i = 0; i < MCDB_TREG_SLOTS; ++i) {
+            const struct mcdb_mmap * const x = plasma_atomic_ld_nopt(&r->map[i]);
+            if (x == map)
+                break;
+            if (x == NULL && e == MCDB_TREG_SLOTS)
+                e = i;
+        }
+        if (i != MCDB_TREG_SLOTS)
+            plasma_atomic_st_nopt(&r->cnt[i], r->cnt[i] + 1);
+        else if ((i = e) != MCDB_TREG_SLOTS) {
+            plasma_atomic_st_nopt(&r->cnt[i], 1);
+            plasma_atomic_store_explicit(&r->map[i], map, memory_order_release);
+        }
+        if (i != MCDB_TREG_SLOTS) {
+            plasma_membar_StoreLoad();
+            if (__builtin_expect( (plasma_atomic_ld_nopt(mapptr) == map), 1))
+                return true;
+            mcdb_treg_slot_decr(r, i); /* map might since have been released */
+            return false;
+        }
+    }
 
-    if (__builtin_expect( (map == NULL), 0)
-        || (__builtin_expect( (map->ptr == NULL), 0) && register_use_incr)) {
+    /* thread record unavailable or full; count in map->refcnt under lock
+     * (mcdb_mmap_reclaim() releases maps while holding lock) */
+    {
+        bool rc;
+        (void) plasma_spin_lock_acquire(&mcdb_global_spinlock);
+        if ((rc = (plasma_atomic_ld_nopt(mapptr) == map)))
+            plasma_atomic_fetch_add_u32(&map->refcnt, 1, memory_order_relaxed);
         plasma_spin_lock_release(&mcdb_global_spinlock);
-        /* succeed if unregister; fail if register */ /*(NULL is failure)*/
-        return (struct mcdb_mmap *)(uintptr_t)(!register_use_incr);
-        /* If registering, possibly detected race condition in which another
-         * thread released final reference and mcdb was munmap()'d while current
-         * thread waited for lock.  It is now invalid to attempt to register use
-         * of a resource that has been released.  Caller can detect and reopen*/
+        return rc;
     }
+}
 
-    if (register_use_incr) {
-        if ((next = map->next) == NULL)
-            ++map->refcnt;
-        else {
-            while (next->next != NULL)
-                next = next->next;
-            ++next->refcnt;
-            *mapptr = next;
+static void
+mcdb_treg_decr(struct mcdb_treg * const restrict r,
+               struct mcdb_mmap * const map)
+{
+    if (r != NULL) {
+        for (uint32_t i = 0; i < MCDB_TREG_SLOTS; ++i) {
+            if (plasma_atomic_ld_nopt(&r->map[i]) == map) {
+                mcdb_treg_slot_decr(r, i);
+                return;
+            }
         }
     }
+    plasma_atomic_fetch_sub_u32(&map->refcnt, 1, memory_order_release);
+}
 
-    if ((register_use_decr || next != NULL) && --map->refcnt == 0) {
-        while ((next = map->next) != NULL && (next->refcnt & ~0x40000000) == 0){
-            map->next = next->next;
-            next->next = unmap;
-            (unmap = next)->fname = NULL;   /* do not free(next->fname) yet */
+/* sum of registrations of superseded map (called with lock held)
+ * (counts of superseded maps only decrease, so sum is not underestimated) */
+static int32_t
+mcdb_mmap_refs(const struct mcdb_mmap * const map)
+{
+    int32_t n = (int32_t)
+      plasma_atomic_load_explicit(&map->refcnt, memory_order_acquire);
+    const struct mcdb_treg *r =
+      plasma_atomic_load_explicit(&mcdb_treg_list, memory_order_acquire);
+    for (; r != NULL; r = r->next) {
+        for (uint32_t i = 0; i < MCDB_TREG_SLOTS; ++i) {
+            if (plasma_atomic_load_explicit(&r->map[i], memory_order_acquire)
+                == map)
+                n += (int32_t)
+                  plasma_atomic_load_explicit(&r->cnt[i], memory_order_acquire);
         }
-        if (next != NULL)
-            next->refcnt &= ~0x40000000;    /* unmark; now oldest map in chain*/
-        map->next = unmap;
-        (unmap = map)->fname = NULL;        /* do not free(map->fname) yet */
-        if (register_use_decr)
-            *mapptr = NULL;
-        /*(map will be free'd but map value still not NULL for return val)*/
     }
-    #undef register_use_decr
+    return n;
+}
+
+/* clear slots for released map (registrations released in other threads) */
+static void
+mcdb_treg_clear(struct mcdb_mmap * const map)
+{
+    struct mcdb_treg *r =
+      plasma_atomic_load_explicit(&mcdb_treg_list, memory_order_acquire);
+    for (; r != NULL; r = r->next) {
+        for (uint32_t i = 0; i < MCDB_TREG_SLOTS; ++i) {
+            if (plasma_atomic_ld_nopt(&r->map[i]) == map)
+                (void)plasma_atomic_CAS_ptr(&r->map[i], map, NULL);
+        }
+    }
+}
 
+#ifdef MCDB_STATS
+
+/* (counters of threads for which thread record is unavailable) */
+static struct mcdb_stats mcdb_stats_noreg;
+
+__attribute_noinline__
+static struct mcdb_stats *
+mcdb_stats_attach(void)
+{
+    struct mcdb_treg * const r = mcdb_treg_self();
+    struct mcdb_stats * const st = (r != NULL) ? &r->stats : &mcdb_stats_noreg;
+  #if !(defined(__APPLE__) && defined(__MACH__) \
+        && defined(__GNUC__) && !defined(__clang))
+    mcdb_stats_tls = st;
+  #endif
+    return st;
+}
+
+#endif
+
+#else  /* !_THREAD_SAFE */
+
+#define mcdb_treg_self()             NULL
+#define mcdb_treg_pin(r,map,mapptr)  ((void)(r), ++(map)->refcnt, true)
+#define mcdb_treg_decr(r,map)        ((void)(r), (void)(--(map)->refcnt))
+#define mcdb_mmap_refs(map)          ((int32_t)(map)->refcnt)
+#define mcdb_treg_clear(map)         (void)0
+
+#endif
+
+#ifdef MCDB_STATS
+static void
+mcdb_stats_sum(struct mcdb_stats * const restrict s,
+               const struct mcdb_stats * const st)
+{
+    const uint64_t maxprobe = plasma_atomic_ld_nopt(&st->maxprobe);
+    s->lookups   += plasma_atomic_ld_nopt(&st->lookups);
+    s->hits      += plasma_atomic_ld_nopt(&st->hits);
+    s->misses    += plasma_atomic_ld_nopt(&st->misses);
+    s->probes    += plasma_atomic_ld_nopt(&st->probes);
+    s->kmismatch += plasma_atomic_ld_nopt(&st->kmismatch);
+    if (s->maxprobe < maxprobe)
+        s->maxprobe = maxprobe;
+}
+#endif
+
+bool
+mcdb_stats_snapshot(struct mcdb_stats * const restrict s)
+{
+  #ifdef MCDB_STATS
+    memset(s, '\0', sizeof(struct mcdb_stats));
+   #ifdef _THREAD_SAFE
+    {
+        /* (counts of exited threads remain in thread records) */
+        const struct mcdb_treg *r =
+          plasma_atomic_load_explicit(&mcdb_treg_list, memory_order_acquire);
+        for (; r != NULL; r = r->next)
+            mcdb_stats_sum(s, &r->stats);
+        mcdb_stats_sum(s, &mcdb_stats_noreg);
+    }
+   #else
+    mcdb_stats_sum(s, &mcdb_stats_st);
+   #endif
+    return true;
+  #else
+    (void)s;
+    errno = ENOSYS;
+    return false;
+  #endif
+}
+
+/* superseded maps pending release (protected by mcdb_global_spinlock) */
+static struct mcdb_mmap *mcdb_mmap_retired;
+static uint32_t mcdb_mmap_retired_gen;
+
+/* release superseded maps no longer registered in any thread */
+__attribute_noinline__
+static void
+mcdb_mmap_reclaim(void)
+  __attribute_cold__;
+__attribute_noinline__
+static void
+mcdb_mmap_reclaim(void)
+{
+    struct mcdb_mmap **prev;
+    struct mcdb_mmap *map;
+    struct mcdb_mmap *unmap = NULL;
+
+    (void) plasma_spin_lock_acquire(&mcdb_global_spinlock);
+    plasma_membar_StoreLoad();
+    for (prev = &mcdb_mmap_retired; (map = *prev) != NULL; ) {
+        if (mcdb_mmap_refs(map) != 0) {
+            prev = &map->retired;
+            continue;
+        }
+        *prev = map->retired;
+        mcdb_treg_clear(map);
+        map->retired = unmap;
+        (unmap = map)->fname = NULL;        /* do not free(map->fname) yet */
+    }
     plasma_spin_lock_release(&mcdb_global_spinlock);
 
     /* release unused maps after releasing lock to minimize time holding lock */
-    next = unmap;
-    while (next != NULL) {
-        next = (unmap = next)->next;
-        mcdb_mmap_free(unmap);
+    while ((map = unmap) != NULL) {
+        unmap = map->retired;
+        mcdb_mmap_free(map);
     }
+}
 
-    /* return map on which incr refcnt to avoid race after unlocking */
-    return map; /*(for decr refcnt, non-NULL is success, even if map free'd)*/
+__attribute_noinline__
+struct mcdb_mmap *
+mcdb_mmap_thread_registration(struct mcdb_mmap ** const restrict mapptr,
+                              const int flags)
+{
+    struct mcdb_treg * const r = mcdb_treg_self();
+    struct mcdb_mmap *map;
+    struct mcdb_mmap *next;
+
+    if (!(flags & MCDB_REGISTER_USE_INCR)) {
+        /* (map (and map->next) remain valid until registration is released) */
+        const uint32_t gen = plasma_atomic_ld_nopt(&mcdb_mmap_retired_gen);
+        if ((map = *mapptr) == NULL)
+            return (struct mcdb_mmap *)(uintptr_t)1; /* succeed if unregister */
+        next = plasma_atomic_load_explicit(&map->next, memory_order_acquire);
+        mcdb_treg_decr(r, map);
+        plasma_membar_StoreLoad();
+        if (next != NULL) {
+            *mapptr = NULL;  /*(map might be released by reclaim, below)*/
+            mcdb_mmap_reclaim();
+        }
+        else if (gen != plasma_atomic_ld_nopt(&mcdb_mmap_retired_gen))
+            mcdb_mmap_reclaim(); /*(map superseded while releasing)*/
+        /*(map might be free'd but map value still not NULL for return val)*/
+        return map;
+    }
+
+    do {
+        map = plasma_atomic_load_explicit(mapptr, memory_order_acquire);
+        if (__builtin_expect( (map == NULL), 0))
+            return NULL;
+        if (!mcdb_treg_pin(r, map, mapptr))
+            continue;  /* *mapptr modified by another thread; retry */
+
+        next = plasma_atomic_load_explicit(&map->next, memory_order_acquire);
+        if (__builtin_expect( (next == NULL), 1)) {
+            if (__builtin_expect( (map->ptr != NULL), 1))
+                return map;
+            mcdb_treg_decr(r, map);
+            return NULL;
+            /* If registering, possibly detected race condition in which
+             * another thread released final reference and mcdb was munmap()'d.
+             * It is now invalid to attempt to register use of a resource that
+             * has been released.  Caller can detect and reopen */
+        }
+
+        /* map superseded; move registration held by *mapptr to newest map
+         * (map->next of superseded maps points at newest map (at the time)) */
+        while (!mcdb_treg_pin(r, next, (struct mcdb_mmap * const *)&map->next))
+            next = plasma_atomic_load_explicit(&map->next,memory_order_acquire);
+        if (plasma_atomic_CAS_ptr(mapptr, map, next)) {
+            mcdb_treg_decr(r, map); /*(registration above)*/
+            mcdb_treg_decr(r, map); /*(registration moved from map to next)*/
+            plasma_membar_StoreLoad();
+            mcdb_mmap_reclaim();
+            return next;
+        }
+        mcdb_treg_decr(r, next);    /* *mapptr modified by another thread */
+        mcdb_treg_decr(r, map);
+    } while (1);
 }
 
 /* theaded programs (while multiple threads are using same struct mcdb_mmap)
@@ -610,46 +2497,59 @@ mcdb_mmap_reopen_threadsafe(struct mcdb_mmap ** const restrict mapptr)
 {
     struct mcdb_mmap * const map = *mapptr;
     struct mcdb_mmap *next;
+    struct mcdb_mmap *x;
     bool rc;
 
-    /* use high bit of refcnt to guard that one thread attempts reopen
-     * (must lock since others modify refcnt while holding same spinlock) */
+    /* use map->reopen to guard that one thread attempts reopen */
     (void) plasma_spin_lock_acquire(&mcdb_global_spinlock);
-    if (map->next != NULL)
-        return NULL !=                      /* registration releases spinlock */
-          mcdb_mmap_thread_registration_h(mapptr, MCDB_REGISTER_USE_INCR
-                                                 |MCDB_REGISTER_ALREADY_LOCKED);
-    if ((rc = (map->refcnt < 0x80000000u))) /*(0!=(map->refcnt & 0x80000000u))*/
-        map->refcnt |= 0x80000000u;
+    if ((rc = (map->next == NULL && !map->reopen)))
+        map->reopen = 1;
     plasma_spin_lock_release(&mcdb_global_spinlock);
-    if (!rc)
-        return true; /*other threads return, even though mcdb not reopened yet*/
+    if (!rc)     /*other threads return, even though mcdb not reopened yet*/
+        return map->next == NULL
+          || NULL != mcdb_mmap_thread_registration_h(mapptr,
+                                                     MCDB_REGISTER_USE_INCR);
 
     if (__builtin_expect( (map->fn_malloc == NULL), 0)
-        || (next = map->fn_malloc(sizeof(struct mcdb_mmap))) == NULL)
+        || (next = map->fn_malloc(sizeof(struct mcdb_mmap))) == NULL) {
+        plasma_atomic_st_nopt(&map->reopen, 0);
         return false; /*(misconfigured mcdb_mmap or map->fn_malloc failed)*/
+    }
 
     memcpy(next, map, sizeof(struct mcdb_mmap));
     next->ptr = NULL; /*(skip munmap() in mcdb_mmap_reopen())*/
+    next->allocated = 0;  /*(fn_free(next) when next is released)*/
     if (map->fname == map->fnamebuf)
         next->fname = next->fnamebuf;
     rc = mcdb_mmap_reopen(next);
     if (__builtin_expect((!rc), 0)) {
         map->fn_free(next);
+        plasma_atomic_st_nopt(&map->reopen, 0);
         return false;
     }
-    next->hash_init = map->hash_init;
-    next->hash_fn   = map->hash_fn;
-    next->refcnt   |= 0x40000000u;    /* flag to indicate not oldest in chain */
-    plasma_membar_StoreStore();
-    map->next       = next;
+    if ((next->fmt & MCDB_FMT_HASH_MASK) == MCDB_FMT_HASH_DJB
+        && (map->fmt & MCDB_FMT_HASH_MASK) == MCDB_FMT_HASH_DJB) {
+        /* preserve custom hash_fn, if any (not named in mcdb header)
+         * (not hash_fn of map made with other hash (mcdbctl make -H)) */
+        next->hash_init = map->hash_init;
+        next->hash_fn   = map->hash_fn;
+    }
+
+    /* supersede map (and maps it superseded) with next; retire map */
     (void) plasma_spin_lock_acquire(&mcdb_global_spinlock);
-    map->refcnt    &= ~0x80000000u;         /* registration releases spinlock */
-    return NULL !=
-      mcdb_mmap_thread_registration_h(mapptr, MCDB_REGISTER_USE_INCR
-                                             |MCDB_REGISTER_ALREADY_LOCKED);
-}
+    for (x = mcdb_mmap_retired; x != NULL; x = x->retired) {
+        if (x->next == map)
+            plasma_atomic_store_explicit(&x->next, next, memory_order_release);
+    }
+    plasma_atomic_store_explicit(&map->next, next, memory_order_release);
+    map->retired = mcdb_mmap_retired;
+    mcdb_mmap_retired = map;
+    plasma_atomic_st_nopt(&mcdb_mmap_retired_gen, mcdb_mmap_retired_gen + 1);
+    plasma_spin_lock_release(&mcdb_global_spinlock);
 
+    return NULL !=        /* move registration held by *mapptr to next */
+      mcdb_mmap_thread_registration_h(mapptr, MCDB_REGISTER_USE_INCR);
+}
 
 /* alias symbols with hidden visibility for use in DSO linking static mcdb.o
  * (Reference: "How to Write Shared Libraries", by Ulrich Drepper)
@@ -663,6 +2563,10 @@ HIDDEN extern __typeof (mcdb_findtagstart)
 HIDDEN extern __typeof (mcdb_findtagnext)
                         mcdb_findtagnext_h
   __attribute_alias__ ("mcdb_findtagnext");
+HIDDEN extern __typeof (mcdb_findtag_batch)
+                        mcdb_findtag_batch_h
+  __attribute_hot__  __attribute_nothrow__
+  __attribute_alias__ ("mcdb_findtag_batch");
 HIDDEN extern __typeof (mcdb_iter)
                         mcdb_iter_h
   __attribute_alias__ ("mcdb_iter");
@@ -678,6 +2582,9 @@ HIDDEN extern __typeof (mcdb_mmap_destroy)
 HIDDEN extern __typeof (mcdb_mmap_refresh_check)
                         mcdb_mmap_refresh_check_h
   __attribute_alias__ ("mcdb_mmap_refresh_check");
+HIDDEN extern __typeof (mcdb_mmap_watch)
+                        mcdb_mmap_watch_h
+  __attribute_alias__ ("mcdb_mmap_watch");
 HIDDEN extern __typeof (mcdb_mmap_thread_registration)
                         mcdb_mmap_thread_registration_h
   __attribute_alias__ ("mcdb_mmap_thread_registration");
@@ -31,6 +31,7 @@
 PLASMA_ATTR_Pragma_once
 
 #include <sys/time.h>               /* time_t */
+#include <sys/uio.h>                /* struct iovec */
 
 #ifdef PLASMA_FEATURE_POSIX
 #include <unistd.h>                 /* _POSIX_* features */
@@ -45,12 +46,14 @@ PLASMA_ATTR_Pragma_once
 extern "C" {
 #endif
 
+struct mcdb_watch;             /* (opaque) (see mcdb_mmap_watch()) */
+
 struct mcdb_mmap {
   unsigned char *ptr;         /* mmap pointer */
   uint32_t b;                 /* hash table stride bits: (data < 4GB) ? 3 : 4 */
   uint32_t n;                 /* num records in mcdb */
   uint32_t hash_init;         /* hash init value */
-  uint32_t hash_pad;          /* (padding)*/
+  uint32_t fmt;               /* format word from mcdb header (MCDB_FMT_*) */
   uint32_t (*hash_fn)(uint32_t, const void * restrict, size_t); /* hash func */
   uintptr_t size;             /* mmap size */
   time_t mtime;               /* mmap file mtime */
@@ -61,9 +64,38 @@ struct mcdb_mmap {
   char fnamebuf[112];         /* buffer in which to store short fname */
   int allocated;              /* flag if struct allocated in mcdb_mmap_create */
   int dfd;                    /* fd open to dir in which mmap file resides */
-  uint32_t refcnt;            /* registered access reference count */
+  uint32_t refcnt;            /* registered access reference count (shared)*/
+  uint32_t reopen;            /* flag: reopen in progress (threadsafe) */
+  struct mcdb_mmap *retired;  /* list of superseded maps pending release */
+  const unsigned char *bloom; /* negative-lookup filter section (or NULL) */
+  uint32_t bloom_nblk;        /* num of MCDB_BLOOM_BLKSZ blocks in filter */
+  uint32_t bloom_k;           /* num of bits set per key in filter block */
+  const unsigned char *mphf;  /* minimal perfect hash pilots (or NULL) */
+  const unsigned char *mphf_tbl; /* minimal perfect hash table elements */
+  uint32_t mphf_nb;           /* num of pilots (buckets) in mphf */
+  uint32_t mphf_sz;           /* num of elements in mphf_tbl */
+  uint32_t mphf_b;            /* mphf_tbl element stride bits (3 or 4) */
+  uint32_t zdict_sz;          /* size of zdict */
+  const unsigned char *zdict; /* preset dictionary for compressed data */
+  const unsigned char *sorted;/* sorted key index section (or NULL) */
+  uintptr_t sorted_sz;        /* size of sorted key index section */
+  uint32_t sorted_n;          /* num of index entries in sorted key index */
+  uint32_t sorted_nblk;       /* num of blocks in sorted key index */
+  uint32_t sorted_blkn;       /* num of index entries per block */
+  const unsigned char *cksum; /* integrity checksums section (or NULL) */
+  uintptr_t cksum_end;        /* end of data blocks covered by checksums */
+  uint32_t cksum_nblk;        /* num of checksummed data blocks */
+  uint32_t cksum_bits;        /* log2 of checksummed data block size */
+  uint32_t watch_gen;         /* watch generation when mmap file opened */
+  uint32_t opt_flags;         /* mapping options (MCDB_MMAP_OPT_*) */
+  int32_t opt_numa_node;      /* NUMA node for MCDB_MMAP_OPT_COPY_INDEX */
+  struct mcdb_watch *watch;   /* file replacement notification (or NULL) */
 };
-/* aside: char fnamebuf[] sized to separate 'next' and 'refcnt' by 128 bytes
+/* (threads count registrations in thread-private records; map->refcnt is
+ *  modified only in less common cases (see mcdb_mmap_thread_registration()))
+ * (members through refcnt in same order as prior releases (inlined
+ *  mcdb_thread_refresh_self() reads map->next); add new members at end)
+ * aside: char fnamebuf[] sized to separate 'next' and 'refcnt' by 128 bytes
  * (L2 cache lines on modern hardware are 64-bytes and 128-bytes)
  * (32-bit pointers are 4-byte; 64-bit pointers are 8-byte)
  * (separate cache lines for high-frequency read-only data and modified data) */
@@ -78,9 +110,14 @@ struct mcdb {
   uint32_t dlen;   /* initialized if mcdb_findtagnext() returns true */
   uint32_t klen;   /* initialized if mcdb_findtagnext() returns true */
   uint32_t khash;  /* initialized by call to mcdb_findtagstart() */
-  uint32_t pad0;   /* padding */
+  uint32_t mphf;   /* mphf element at dpos pending; set by findtagstart() */
   void *vp;        /* user-provided extension data */
+  uintptr_t rpos;  /* record dpos (dpos, unless data shared; MCDB_FMT_VALREF)*/
+  uint32_t zlen;   /* compressed len (0 unless data compressed; MCDB_FMT_VALZ)*/
+  uint32_t pad1;   /* padding */
 };
+/* (members through vp in same order as prior releases; add new members at
+ *  end (struct mcdb is caller-allocated)) */
 
 EXPORT extern bool
 mcdb_findtagstart(struct mcdb * restrict, const char * restrict, size_t,
@@ -93,16 +130,65 @@ mcdb_findtagnext(struct mcdb * restrict, const char * restrict, size_t,
   __attribute_nonnull__  __attribute_warn_unused_result__  __attribute_hot__
   __attribute_nothrow__;
 
+EXPORT extern size_t
+mcdb_findtag_batch(struct mcdb * restrict, size_t,
+                   const char * const * restrict, const size_t * restrict,
+                   unsigned char) /* note: must be 0 or cast to (unsigned char)*/
+  __attribute_nonnull__  __attribute_hot__  __attribute_nothrow__;
+
 #define mcdb_findstart(m,key,klen) mcdb_findtagstart((m),(key),(klen),0)
 #define mcdb_findnext(m,key,klen)  mcdb_findtagnext((m),(key),(klen),0)
 #define mcdb_find(m,key,klen) \
   (__builtin_expect((mcdb_findstart((m),(key),(klen))), 1) \
                   && mcdb_findnext((m),(key),(klen)))
+#define mcdb_find_batch(m,n,keys,klens) \
+  mcdb_findtag_batch((m),(n),(keys),(klens),0)
+
+/* all values of key, as (pointer, length) into map (no copy), in order of
+ * mcdb_findtagnext(), e.g. for writev() (mcdb key with repeated values)
+ * Fills iov[] with first (up to) n values of key and returns number of values
+ * of key (0 if not found), which may be more than n; caller may call again
+ * with larger iov[] (data of each value after n is not touched).
+ * Values remain valid while map is registered (or until mcdb_mmap_refresh()).
+ * Tombstone (MCDB_DPOS_TOMBSTONE) is iov_base map->ptr, iov_len 0.
+ * Returns SIZE_MAX (errno ENOTSUP) if a value is compressed (MCDB_FMT_VALZ),
+ * which is not in map as value; (use mcdb_findtagnext(), mcdb_readdata()) */
+EXPORT extern size_t
+mcdb_findtag_iov(struct mcdb * restrict, const char * restrict, size_t,
+                 unsigned char, /* note: must be 0 or cast to (unsigned char) */
+                 struct iovec * restrict, size_t)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+#define mcdb_findall_iov(m,key,klen,iov,n) \
+  mcdb_findtag_iov((m),(key),(klen),0,(iov),(n))
+
+/* lookup counters (compiled in only if mcdb.c is built with -DMCDB_STATS)
+ * Counters are kept per thread (in thread record, without locks or atomic
+ * read-modify-write) and summed over all threads by mcdb_stats_snapshot(),
+ * which takes no lock; snapshot taken while lookups proceed is approximate.
+ * (a lookup miss is findtagstart() or findtagnext() returning false, which
+ *  includes end of iteration through repeated keys with findtagnext()) */
+struct mcdb_stats {
+  uint64_t lookups;   /* mcdb_findtagstart() (and keys of findtag_batch()) */
+  uint64_t hits;      /* mcdb_findtagnext() returning true */
+  uint64_t misses;    /* mcdb_findtagstart() or findtagnext() returning false*/
+  uint64_t probes;    /* hash table (and mphf) elements examined */
+  uint64_t kmismatch; /* elements with matching hash, but different key */
+  uint64_t maxprobe;  /* longest probe sequence (elements) of a lookup */
+};
+
+/* (returns false, errno ENOSYS, if mcdb not built with MCDB_STATS) */
+EXPORT extern bool
+mcdb_stats_snapshot(struct mcdb_stats * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
 
 EXPORT extern void *
 mcdb_read(const struct mcdb * restrict, uintptr_t, uint32_t, void * restrict)
   __attribute_nonnull__  __attribute_warn_unused_result__
   __attribute_nothrow__;
+EXPORT extern void *
+mcdb_readdata(const struct mcdb * restrict, void * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
 EXPORT extern uint32_t
 mcdb_numrecs(struct mcdb * restrict)
   __attribute_nonnull__  __attribute_warn_unused_result__
@@ -112,12 +198,30 @@ mcdb_validate_slots(struct mcdb * restrict)
   __attribute_nonnull__  __attribute_warn_unused_result__
   __attribute_nothrow__;
 
+/* verify integrity checksums (MCDB_SECT_CKSUM) (see mcdb_make cksum)
+ * mcdb_verify_index() verifies header, section directory, and hash tables;
+ * returns false with errno EBADMSG if mismatch, or ENOTSUP if no checksums.
+ * mcdb_verify_blocks() verifies data blocks [first, first+n) (of cksum_nblk)
+ * and returns first block which does not match, or min(first+n, cksum_nblk)
+ * if all match, e.g. to verify ranges of blocks in parallel or incrementally
+ * (block i is [MCDB_HEADER_SZ + (i << cksum_bits), + (1 << cksum_bits)) of
+ *  map, up to cksum_end) (cksum_nblk is 0 if no checksums) */
+EXPORT extern bool
+mcdb_verify_index(const struct mcdb_mmap * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
+EXPORT extern uint32_t
+mcdb_verify_blocks(const struct mcdb_mmap * restrict, uint32_t, uint32_t)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
+
 /* (macros valid only after mcdb_find() or mcdb_find*next() returns true) */
 #define mcdb_datapos(m)      ((m)->dpos)
 #define mcdb_datalen(m)      ((m)->dlen)
 #define mcdb_dataptr(m)      ((m)->map->ptr+(m)->dpos)
-#define mcdb_keyptr(m)       ((m)->map->ptr+(m)->dpos-(m)->klen)
+#define mcdb_keyptr(m)       ((m)->map->ptr+(m)->rpos-(m)->klen)
 #define mcdb_keylen(m)       ((m)->klen)
+#define mcdb_datazlen(m)     ((m)->zlen)
 
 struct mcdb_iter {
   unsigned char *ptr;
@@ -125,14 +229,18 @@ struct mcdb_iter {
   uint32_t klen;
   uint32_t dlen;
   struct mcdb_mmap *map;
+  unsigned char *kptr;
+  unsigned char *dptr; /* (kptr+klen, unless data shared; MCDB_FMT_VALREF) */
+  uint32_t zlen;       /* (0 unless data compressed; MCDB_FMT_VALZ) */
 };
 
 /* (macros valid only after mcdb_iter() returns true) */
-#define mcdb_iter_datapos(iter) ((iter)->ptr-(iter)->dlen-(iter)->map->ptr)
+#define mcdb_iter_datapos(iter) ((iter)->dptr-(iter)->map->ptr)
 #define mcdb_iter_datalen(iter) ((iter)->dlen)
-#define mcdb_iter_dataptr(iter) ((iter)->ptr-(iter)->dlen)
+#define mcdb_iter_dataptr(iter) ((iter)->dptr)
 #define mcdb_iter_keylen(iter)  ((iter)->klen)
-#define mcdb_iter_keyptr(iter)  ((iter)->ptr-(iter)->dlen-(iter)->klen)
+#define mcdb_iter_keyptr(iter)  ((iter)->kptr)
+#define mcdb_iter_datazlen(iter) ((iter)->zlen)
 
 EXPORT extern bool
 mcdb_iter(struct mcdb_iter * restrict)
@@ -141,12 +249,101 @@ mcdb_iter(struct mcdb_iter * restrict)
 EXPORT extern void
 mcdb_iter_init(struct mcdb_iter * restrict, struct mcdb * restrict)
   __attribute_nonnull__  __attribute_nothrow__;
+EXPORT extern void *
+mcdb_iter_readdata(const struct mcdb_iter * restrict, void * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+/* part of data section for parallel scans: data section is split into nparts
+ * byte ranges of about equal size, each adjusted forward to a record start,
+ * and iter is initialized to mcdb_iter() the records of range part.  Ranges
+ * of parts 0 .. nparts-1 are disjoint and together cover all records.
+ * (record start is found by scanning forward from byte offset of range for a
+ *  record which hash index points to; no additional section is required)
+ * (returns false (EINVAL) if part >= nparts) */
+EXPORT extern bool
+mcdb_iter_init_range(struct mcdb_iter * restrict, struct mcdb * restrict,
+                     uint32_t, uint32_t)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+/* ordered and prefix scans (requires sorted key index; MCDB_SECT_SORTED)
+ * mcdb_seek() positions cursor before first record with key >= key (klen 0
+ * for first record) and each mcdb_seek_next() returns next record in key
+ * order (bytewise; key which is prefix of another key sorts first; records
+ * of equal keys in data section order) (mcdb_iter_*() macros on &cur->iter)
+ * e.g. records with key prefix: mcdb_seek(&cur, m, prefix, plen), then
+ * mcdb_seek_next(&cur) while key of &cur.iter begins with prefix
+ * (mcdb_seek() returns false (EINVAL) if mcdb has no sorted key index) */
+struct mcdb_seek {
+  struct mcdb_iter iter;          /* record (mcdb_iter_*() macros on &iter) */
+  const unsigned char *p;         /* (private) next index entry */
+  uint32_t blk;                   /* (private) block of next index entry */
+  uint32_t n;                     /* (private) index entries left in block */
+};
+
+EXPORT extern bool
+mcdb_seek(struct mcdb_seek * restrict, struct mcdb * restrict,
+          const char * restrict, size_t)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
+EXPORT extern bool
+mcdb_seek_next(struct mcdb_seek * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
 
 __attribute_malloc__
 EXPORT extern struct mcdb_mmap *
 mcdb_mmap_create(struct mcdb_mmap * restrict,
                  const char *,const char *,void * (*)(size_t),void (*)(void *))
   __attribute_nonnull_x__((3,4,5))  __attribute_warn_unused_result__;
+
+/* mapping options for mcdb_mmap_create_opts()
+ * (options are retained in mcdb_mmap and reapplied on each reopen)
+ * MCDB_MMAP_OPT_POPULATE    prefault entire mcdb when mapped (MAP_POPULATE)
+ * MCDB_MMAP_OPT_HUGEPAGE    request transparent huge pages (advisory)
+ * MCDB_MMAP_OPT_MLOCK_INDEX mlock() header and hash tables (not data);
+ *                           fails if mlock() fails (see RLIMIT_MEMLOCK)
+ * MCDB_MMAP_OPT_COPY_INDEX  private anonymous copy of header and hash tables,
+ *                           bound to numa_node if numa_node >= 0 (Linux);
+ *                           (create one map per NUMA node for per-node copy)
+ *                           (data section remains shared page cache)
+ * MCDB_MMAP_OPT_VERIFY      verify checksums of header, section directory,
+ *                           and hash tables (mcdb_verify_index()) when
+ *                           mapped; fails (EBADMSG) if corrupt, or (ENOTSUP)
+ *                           if mcdb has no checksums (MCDB_SECT_CKSUM), e.g.
+ *                           so that mcdb_mmap_reopen_threadsafe() keeps
+ *                           current map instead of swapping in corrupt mcdb
+ *                           (data blocks may then be verified incrementally
+ *                            with mcdb_verify_blocks(), e.g. in background)
+ * MCDB_MMAP_OPT_VERIFY_DATA MCDB_MMAP_OPT_VERIFY and also verify checksums
+ *                           of all data blocks (reads entire mcdb) */
+#define MCDB_MMAP_OPT_POPULATE     0x1u
+#define MCDB_MMAP_OPT_HUGEPAGE     0x2u
+#define MCDB_MMAP_OPT_MLOCK_INDEX  0x4u
+#define MCDB_MMAP_OPT_COPY_INDEX   0x8u
+#define MCDB_MMAP_OPT_VERIFY       0x10u
+#define MCDB_MMAP_OPT_VERIFY_DATA  0x20u
+#define MCDB_MMAP_OPT_KNOWN        0x3Fu
+
+struct mcdb_mmap_opts {
+  uint32_t flags;             /* MCDB_MMAP_OPT_* */
+  int numa_node;              /* NUMA node for index copy (-1 for default) */
+};
+
+__attribute_malloc__
+EXPORT extern struct mcdb_mmap *
+mcdb_mmap_create_opts(struct mcdb_mmap * restrict,
+                      const char *,const char *,
+                      void * (*)(size_t),void (*)(void *),
+                      const struct mcdb_mmap_opts *)
+  __attribute_nonnull_x__((3,4,5))  __attribute_warn_unused_result__;
+/* mcdb_mmap_create_opts() of mcdb already open as fd (opts may be NULL)
+ * (fd is not closed; map is not reopened by mcdb_mmap_refresh()) */
+__attribute_malloc__
+EXPORT extern struct mcdb_mmap *
+mcdb_mmap_create_fd(struct mcdb_mmap * restrict, int,
+                    void * (*)(size_t),void (*)(void *),
+                    const struct mcdb_mmap_opts *)
+  __attribute_nonnull_x__((3,4))  __attribute_warn_unused_result__;
 EXPORT extern void
 mcdb_mmap_destroy(struct mcdb_mmap * restrict)
   ;
@@ -182,12 +379,18 @@ EXPORT extern bool
 mcdb_mmap_refresh_check(const struct mcdb_mmap * restrict)
   __attribute_nonnull__  __attribute_warn_unused_result__
   __attribute_nothrow__;
+/* request notification (inotify, kqueue) when mcdb file is renamed into place
+ * so that mcdb_mmap_refresh_check() need not stat() file
+ * (returns false, errno ENOSYS, if not supported; stat() is used) */
+EXPORT extern bool
+mcdb_mmap_watch(struct mcdb_mmap * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
 
 
 enum mcdb_flags {
   MCDB_REGISTER_USE_DECR = 0,
   MCDB_REGISTER_USE_INCR = 1,
-  MCDB_REGISTER_ALREADY_LOCKED = 2
+  MCDB_REGISTER_ALREADY_LOCKED = 2 /* (no longer used; ignored) */
 };
 
 EXPORT extern struct mcdb_mmap *
@@ -219,6 +422,172 @@ mcdb_mmap_reopen_threadsafe(struct mcdb_mmap ** restrict)
 #define MCDB_PAD_ALIGN 16
 #define MCDB_PAD_MASK (MCDB_PAD_ALIGN-1)
 
+/* format word: 4-byte bigendian word in 4-byte padding of header slot 0
+ * (always 0 in mcdb created by earlier versions; ignored by earlier readers)
+ * low 8 bits are hash function id; next 4 bits are hash table layout id;
+ * remaining bits reserved (must be 0) */
+#define MCDB_FMT_OFFSET    MCDB_HDRX_OFFSET(0)
+#define MCDB_FMT_HASH_MASK 0xFFu
+#define MCDB_FMT_HASH_DJB  0u     /* uint32_hash_djb()  (or custom hash_fn) */
+#define MCDB_FMT_HASH_FAST 1u     /* uint32_hash_fast() */
+#define MCDB_FMT_LAYOUT_MASK    0xF00u
+#define MCDB_FMT_LAYOUT_CLASSIC 0x000u /* open hash tables; 8 or 16 byte elts */
+#define MCDB_FMT_LAYOUT_BUCKET  0x100u /* 64-byte buckets of 8-byte elts */
+#define MCDB_FMT_LAYOUT_PACKED  0x200u /* 8-byte elts w/ 40-bit dpos */
+#define MCDB_FMT_MPHF      0x1000u/* hash tables incomplete without MPHF sect */
+#define MCDB_FMT_INDEX_LE  0x2000u/* hash table elements little-endian */
+#define MCDB_FMT_VALREF    0x4000u/* records may reference shared data */
+#define MCDB_FMT_VALZ      0x8000u/* records may hold compressed data */
+#define MCDB_FMT_KNOWN \
+  (MCDB_FMT_HASH_MASK | MCDB_FMT_LAYOUT_MASK | MCDB_FMT_MPHF \
+   | MCDB_FMT_INDEX_LE | MCDB_FMT_VALREF | MCDB_FMT_VALZ)
+
+/* MCDB_FMT_VALREF: record with dlen | MCDB_DLEN_REF shares data of an earlier
+ * record with identical data: record is klen, dlen | MCDB_DLEN_REF, key, and
+ * 8-byte bigendian dpos of earlier copy of data (dlen bytes).  mcdb_find*()
+ * and mcdb_iter() resolve the reference, so that mcdb_dataptr() and
+ * mcdb_iter_dataptr() point directly to (shared) data in map.
+ * (dlen <= INT_MAX-8 (see mcdb_make.c), so high bit is otherwise unused) */
+#define MCDB_DLEN_REF 0x80000000u
+
+/* tombstone: MCDB_FMT_VALREF record with dlen 0 | MCDB_DLEN_REF and dpos 0
+ * marks key as deleted, e.g. in delta mcdb layered over base (mcdb_layer.h)
+ * mcdb_find*() and mcdb_iter() return tombstone as record with empty data
+ * (mcdb_datalen() 0) for which mcdb_tombstone() (mcdb_iter_tombstone()) */
+#define MCDB_DPOS_TOMBSTONE 0
+#define mcdb_tombstone(m)         ((m)->dpos == MCDB_DPOS_TOMBSTONE)
+#define mcdb_iter_tombstone(iter) ((iter)->dptr == (iter)->map->ptr)
+
+/* MCDB_FMT_VALZ: record with dlen | MCDB_DLEN_REF may instead hold compressed
+ * data: record is klen, dlen | MCDB_DLEN_REF, key, 4-byte bigendian
+ * zlen | MCDB_ZLEN_FLAG, and zlen bytes of raw deflate stream (RFC 1951) of
+ * data (dlen bytes), compressed with preset dictionary in MCDB_SECT_ZDICT
+ * section (if present).  (hi bit of reference dpos, above, is always clear)
+ * mcdb_datalen() and mcdb_iter_datalen() are length of data, dataptr macros
+ * point to compressed data, and mcdb_datazlen() and mcdb_iter_datazlen() are
+ * zlen (0 if data is not compressed).  mcdb_readdata() and
+ * mcdb_iter_readdata() copy data into buffer (of at least datalen bytes),
+ * decompressing if compressed (ENOTSUP if mcdb built without MCDB_ZLIB) */
+#define MCDB_ZLEN_FLAG 0x80000000u
+
+/* MCDB_FMT_INDEX_LE: hash table elements (incl. mphf elements) are stored in
+ * little-endian (host) byte order instead of bigendian, so that probes on
+ * little-endian hosts need not byte swap.  Header, section headers, and data
+ * records remain bigendian.  Readable only on little-endian hosts.
+ * (MCDB_HOST_LE is 0 if host byte order is not known at compile time) */
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) \
+ && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define MCDB_HOST_LE 1
+#else
+#define MCDB_HOST_LE 0
+#endif
+
+/* bucketized hash table layout (MCDB_FMT_LAYOUT_BUCKET) (data < 4 GB)
+ * Hash tables are 64-byte aligned and hslots is a multiple of 8, so that
+ * each table is an array of 64-byte buckets of 8 elements.  Each element is
+ *   4-byte (16-bit hash fragment << 16 | 16-bit klen), 4-byte dpos
+ * (klen >= MCDB_BUCKET_KLEN_MAX is stored as MCDB_BUCKET_KLEN_MAX).
+ * Probing begins at first element of bucket ((khash>>8) % (hslots/8)) and
+ * proceeds linearly (wrapping), as in classic layout, until empty (dpos 0).
+ * Record header is read only if hash fragment and klen match. */
+#define MCDB_BUCKET_SZ       64
+#define MCDB_BUCKET_KLEN_MAX 0xFFFFu
+#define mcdb_bucket_frag(khash) \
+  ((uint32_t)((uint32_t)(khash) * UINT32_C(0x9E3779B1)) >> 16)
+
+/* packed hash table layout (MCDB_FMT_LAYOUT_PACKED) (data < 1 TB)
+ * Hash table elements are 8 bytes (as for classic layout with data < 4 GB),
+ * even for data > 4 GB: 8-byte bigendian ((khash >> 8) << 40 | 40-bit dpos)
+ * (low 8 bits of khash are implied by header slot, so full khash is kept)
+ * i.e. 4-byte bigendian (khash & ~0xFF | dpos >> 32), 4-byte low dpos */
+#define MCDB_PACKED_DPOS_BITS 40
+#define MCDB_PACKED_DPOS_MAX  ((UINT64_C(1) << MCDB_PACKED_DPOS_BITS) - 1)
+
+/* 4-byte bigendian padding words in header slots (hdrx[0] is format word)
+ *   hdrx[1],hdrx[2]  64-bit offset of section directory (hi,lo) (0 if none)
+ *   hdrx[3]          number of records
+ * Section directory entries are 24 bytes of bigendian values:
+ *   4-byte type, 4-byte param, 8-byte offset, 8-byte size
+ * and directory is terminated by entry with type 0.  Sections are placed after
+ * end of data and before hash tables; at least 16 bytes of end-of-data padding
+ * (all bits set) precede sections so that earlier mcdb_iter() stops at end of
+ * data.  Readers ignore unknown section types. */
+#define MCDB_HDRX_OFFSET(i) ((((uintptr_t)(i))<<4)+12)
+#define MCDB_HDRX_SECTDIR_HI 1
+#define MCDB_HDRX_SECTDIR_LO 2
+#define MCDB_HDRX_NUMRECS    3
+#define MCDB_SECT_ENTSZ      24
+#define MCDB_SECT_BLOOM      1u   /* param: bits set per key */
+#define MCDB_SECT_MPHF       2u   /* param: element stride bits (3 or 4) */
+#define MCDB_SECT_ZDICT      3u   /* param: 0 (MCDB_FMT_VALZ dictionary) */
+#define MCDB_SECT_SORTED     4u   /* param: index entries per block */
+#define MCDB_SECT_CKSUM      5u   /* param: log2 of data block size */
+#define MCDB_ZDICT_MAX   32768u   /* (deflate window size) */
+
+/* blocked bloom filter (MCDB_SECT_BLOOM)
+ * (k bits set per key in a single 64-byte block, selected by khash) */
+#define MCDB_BLOOM_BLKSZ 64
+#define mcdb_bloom_mix(khash) \
+  ((uint64_t)(khash) * UINT64_C(0x9E3779B97F4A7C15))
+#define mcdb_bloom_blk(x,nblk) \
+  ((uintptr_t)((((x) >> 32) * (uint64_t)(nblk)) >> 32))
+#define mcdb_bloom_bits(x) \
+  (((x) ^ ((x) >> 29)) * UINT64_C(0xBF58476D1CE4E5B9))
+/* (bit j of k bits:  (mcdb_bloom_bits(x) >> (9*j)) & 511; k <= 7) */
+
+/* minimal perfect hash index (MCDB_SECT_MPHF) (PTHash-style)
+ * Section contains 16-byte header of bigendian 4-byte nb, 4-byte sz (and 8
+ * bytes reserved), then nb 2-byte bigendian pilots (padded to 16 bytes), then
+ * sz hash table elements as in classic layout (8 or 16 bytes per param).
+ * Key with hash khash is found only in element
+ *   mcdb_mphf_pos(x, pilot[mcdb_mphf_bkt(x, nb)], sz), x = mcdb_mphf_mix(khash)
+ * (or in classic hash tables, which hold keys not placed in mphf, including
+ *  all keys for which khash is not unique, e.g. repeated keys)
+ * (use macros only with simple args) */
+#define MCDB_MPHF_HDRSZ 16
+#define mcdb_mphf_mix(khash) \
+  ((uint64_t)(khash) * UINT64_C(0xD6E8FEB86659FD93))
+#define mcdb_mphf_bkt(x,nb) \
+  ((uint32_t)((((x) >> 32) * (uint64_t)(nb)) >> 32))
+#define mcdb_mphf_pos(x,pilot,sz) \
+  ((uint32_t)((((((x) ^ ((uint64_t)(pilot) * UINT64_C(0x9E3779B97F4A7C15))) \
+                 * UINT64_C(0xBF58476D1CE4E5B9)) >> 32) * (uint64_t)(sz)) >> 32))
+#define mcdb_mphf_tbloff(nb) \
+  (MCDB_MPHF_HDRSZ + ((((uintptr_t)(nb) << 1) + MCDB_PAD_MASK) & ~MCDB_PAD_MASK))
+
+/* sorted key index (MCDB_SECT_SORTED) (see mcdb_seek())
+ * Section contains 16-byte header of bigendian 4-byte nkeys, 4-byte nblk (and
+ * 8 bytes reserved), then nblk 8-byte bigendian block offsets (from start of
+ * section) (padded to 16 bytes), then blocks of param (last block may hold
+ * fewer) index entries, one entry per record, in key order.  Entry is
+ *   varint shared, varint suffix len, varint rpos, suffix
+ * (LEB128 varints: 7 bits per byte, low bits first, high bit set if more)
+ * where key of entry is first shared bytes of key of preceding entry in block
+ * (shared is 0 for first entry of block) followed by suffix, and rpos is
+ * offset of record in data section.  Lookups binary search first keys of
+ * blocks, then scan block comparing only suffixes. */
+#define MCDB_SORTED_HDRSZ 16
+#define MCDB_SORTED_BLKN  16
+#define mcdb_sorted_blkoff(nblk) \
+  (MCDB_SORTED_HDRSZ + ((((uintptr_t)(nblk) << 3) + MCDB_PAD_MASK) \
+                        & ~MCDB_PAD_MASK))
+
+/* integrity checksums (MCDB_SECT_CKSUM) (see mcdb_verify_index())
+ * Section contains 16-byte header of bigendian 4-byte algorithm
+ * (MCDB_CKSUM_CRC32C), 4-byte nblk, 8-byte end, then 4-byte bigendian
+ * checksums of: header (MCDB_HEADER_SZ bytes), section directory (incl.
+ * terminating entry), hash table of each of MCDB_SLOTS header slots, and
+ * each of nblk blocks of (1 << param) bytes (last block may be shorter)
+ * covering [MCDB_HEADER_SZ, end), i.e. data and end-of-data padding and
+ * sections preceding checksum section (end is offset of checksum section)
+ * (padded to 16 bytes).  Section is last section before section directory. */
+#define MCDB_CKSUM_HDRSZ   16
+#define MCDB_CKSUM_CRC32C  1u     /* uint32_crc32c() (crc 0 for each range) */
+#define MCDB_CKSUM_BLKBITS 16     /* (64 KB blocks written by mcdb_make) */
+#define mcdb_cksum_blk(i)  (MCDB_CKSUM_HDRSZ + ((2 + MCDB_SLOTS + (i)) << 2))
+#define mcdb_cksum_sz(nblk) \
+  ((mcdb_cksum_blk((uintptr_t)(nblk)) + MCDB_PAD_MASK) & ~MCDB_PAD_MASK)
+
 
 /* alias symbols with hidden visibility for use in DSO linking static mcdb.o
  * (Reference: "How to Write Shared Libraries", by Ulrich Drepper)
@@ -230,6 +599,9 @@ HIDDEN extern __typeof (mcdb_findtagstart)
                         mcdb_findtagstart_h;
 HIDDEN extern __typeof (mcdb_findtagnext)
                         mcdb_findtagnext_h;
+HIDDEN extern __typeof (mcdb_findtag_batch)
+                        mcdb_findtag_batch_h
+  __attribute_hot__  __attribute_nothrow__;
 HIDDEN extern __typeof (mcdb_iter)
                         mcdb_iter_h;
 HIDDEN extern __typeof (mcdb_iter_init)
@@ -240,6 +612,8 @@ HIDDEN extern __typeof (mcdb_mmap_destroy)
                         mcdb_mmap_destroy_h;
 HIDDEN extern __typeof (mcdb_mmap_refresh_check)
                         mcdb_mmap_refresh_check_h;
+HIDDEN extern __typeof (mcdb_mmap_watch)
+                        mcdb_mmap_watch_h;
 HIDDEN extern __typeof (mcdb_mmap_thread_registration)
                         mcdb_mmap_thread_registration_h;
 HIDDEN extern __typeof (mcdb_mmap_reopen_threadsafe)
@@ -247,11 +621,13 @@ HIDDEN extern __typeof (mcdb_mmap_reopen_threadsafe)
 #else
 #define mcdb_findtagstart_h              mcdb_findtagstart
 #define mcdb_findtagnext_h               mcdb_findtagnext
+#define mcdb_findtag_batch_h             mcdb_findtag_batch
 #define mcdb_iter_h                      mcdb_iter
 #define mcdb_iter_init_h                 mcdb_iter_init
 #define mcdb_mmap_create_h               mcdb_mmap_create
 #define mcdb_mmap_destroy_h              mcdb_mmap_destroy
 #define mcdb_mmap_refresh_check_h        mcdb_mmap_refresh_check
+#define mcdb_mmap_watch_h                mcdb_mmap_watch
 #define mcdb_mmap_thread_registration_h  mcdb_mmap_thread_registration 
 #define mcdb_mmap_reopen_threadsafe_h    mcdb_mmap_reopen_threadsafe
 #endif
@@ -0,0 +1,741 @@
+/*
+ * mcdb_aio - asynchronous lookups over pread() or io_uring (mcdb not mmap'd)
+ *
+ * Copyright (c) 2010, Glue Logic LLC. All rights reserved. code()gluelogic.com
+ *
+ *  This file is part of mcdb.
+ *
+ *  mcdb is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mcdb is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with mcdb.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * mcdb is originally based upon the Public Domain cdb-0.75 by Dan Bernstein
+ */
+
+#ifndef _XOPEN_SOURCE /* pread() */
+#define _XOPEN_SOURCE 700
+#endif
+#ifndef _GNU_SOURCE /* enable O_CLOEXEC on GNU systems */
+#define _GNU_SOURCE 1
+#endif
+/* large file support needed for pread() of mcdb > 2 GB */
+#define PLASMA_FEATURE_ENABLE_LARGEFILE
+
+#include "mcdb_aio.h"
+#include "mcdb.h"
+#include "nointr.h"
+#include "uint32.h"
+#include "plasma/plasma_atomic.h"
+#include "plasma/plasma_stdtypes.h"  /* SIZE_MAX */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>   /* struct iovec */
+#include <fcntl.h>
+#include <unistd.h>    /* pread(), close() */
+#include <errno.h>
+#include <limits.h>    /* UINT_MAX */
+#include <string.h>    /* memcmp(), memcpy(), memset() */
+
+#ifdef MCDB_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+/* hash table elements are bigendian, or native (MCDB_FMT_INDEX_LE) (see mcdb.h)
+ * (le must be constant false if !MCDB_HOST_LE) */
+#define mcdb_aio_u32(p,le) \
+  ((le) ? *(const uint32_t *)(p) : uint32_strunpack_bigendian_aligned_macro(p))
+#define mcdb_aio_u64(p,le) \
+  ((le) ? *(const uint64_t *)(p) : uint64_strunpack_bigendian_aligned_macro(p))
+
+/* page cache is direct-mapped by page offset */
+#define mcdb_aio_cache_idx(a,pg) \
+  ((uint32_t)(((pg) / MCDB_AIO_PAGESZ) % (a)->ncache))
+
+enum {
+  MCDB_AIO_FREE = 0,          /* context free */
+  MCDB_AIO_IDX,               /* read of hash table page */
+  MCDB_AIO_REC,               /* read of record (klen, dlen, key, data) */
+  MCDB_AIO_DATA,              /* read of data */
+  MCDB_AIO_DONE               /* lookup complete (result not yet polled) */
+};
+
+/* lookup in flight */
+struct mcdb_aio_req {
+  const char *key;
+  size_t klen;
+  void *udata;
+  unsigned char *buf;         /* read buffer */
+  size_t bufsz;
+  uint64_t off;               /* offset of read */
+  size_t len;                 /* length of read */
+  ssize_t res;                /* bytes read (or -errno) */
+  uint64_t hpos;              /* hash table offset */
+  uint64_t kpos;              /* next hash table element */
+  uint64_t vpos;              /* record offset */
+  uint32_t hslots;            /* num of hash table elements */
+  uint32_t loop;              /* num of hash table elements probed */
+  uint32_t khash;             /* key hash */
+  uint32_t state;             /* MCDB_AIO_* */
+  const char *data;           /* result */
+  uint32_t dlen;              /* result */
+  int err;                    /* result */
+  unsigned char tagc;
+#ifdef MCDB_IO_URING
+  struct iovec iov;           /* (IORING_OP_READV) */
+#endif
+};
+
+
+#ifdef MCDB_IO_URING
+
+/* io_uring (single issuer; each lookup has at most one read in flight, so
+ * submission queue of depth entries does not overflow) */
+struct mcdb_aio_ring {
+  int fd;
+  uint32_t tosubmit;          /* sqes queued, not yet submitted */
+  uint32_t inflight;          /* reads submitted or queued, not completed */
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_ptr;
+  void *cq_ptr;
+  size_t sq_sz;
+  size_t cq_sz;
+  size_t sqes_sz;
+};
+
+static struct mcdb_aio_ring *
+mcdb_aio_ring_create(struct mcdb_aio * const restrict a)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static struct mcdb_aio_ring *
+mcdb_aio_ring_create(struct mcdb_aio * const restrict a)
+{
+    struct mcdb_aio_ring * const restrict r =
+      (struct mcdb_aio_ring *)a->fn_malloc(sizeof(struct mcdb_aio_ring));
+    struct io_uring_params p;
+    if (r == NULL)
+        return NULL;
+    memset(r, '\0', sizeof(*r));
+    memset(&p, '\0', sizeof(p));
+    r->fd = (int)syscall(__NR_io_uring_setup, a->depth, &p);
+    if (r->fd < 0) {
+        a->fn_free(r);
+        return NULL;
+    }
+    r->sq_sz   = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_sz   = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->sq_sz < r->cq_sz)
+            r->sq_sz = r->cq_sz;
+        r->cq_sz = 0;
+    }
+    r->sq_ptr = mmap(0, r->sq_sz, PROT_READ|PROT_WRITE, MAP_SHARED,
+                     r->fd, IORING_OFF_SQ_RING);
+    r->cq_ptr = (r->cq_sz == 0 || r->sq_ptr == MAP_FAILED)
+      ? r->sq_ptr
+      : mmap(0, r->cq_sz, PROT_READ|PROT_WRITE, MAP_SHARED,
+             r->fd, IORING_OFF_CQ_RING);
+    r->sqes = (r->cq_ptr == MAP_FAILED)
+      ? MAP_FAILED
+      : mmap(0, r->sqes_sz, PROT_READ|PROT_WRITE, MAP_SHARED,
+             r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        if (r->cq_sz != 0 && r->cq_ptr != MAP_FAILED)
+            munmap(r->cq_ptr, r->cq_sz);
+        if (r->sq_ptr != MAP_FAILED)
+            munmap(r->sq_ptr, r->sq_sz);
+        (void) nointr_close(r->fd);
+        a->fn_free(r);
+        return NULL;
+    }
+    r->sq_tail  = (unsigned *)((char *)r->sq_ptr + p.sq_off.tail);
+    r->sq_mask  = (unsigned *)((char *)r->sq_ptr + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)((char *)r->sq_ptr + p.sq_off.array);
+    r->cq_head  = (unsigned *)((char *)r->cq_ptr + p.cq_off.head);
+    r->cq_tail  = (unsigned *)((char *)r->cq_ptr + p.cq_off.tail);
+    r->cq_mask  = (unsigned *)((char *)r->cq_ptr + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)((char *)r->cq_ptr + p.cq_off.cqes);
+    return r;
+}
+
+/* submit queued sqes; wait for min_complete completions
+ * (returns false and errno upon failure) */
+static bool
+mcdb_aio_ring_enter(struct mcdb_aio_ring * const restrict r,
+                    const uint32_t min_complete)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdb_aio_ring_enter(struct mcdb_aio_ring * const restrict r,
+                    const uint32_t min_complete)
+{
+    long rc;
+    if (r->tosubmit == 0 && min_complete == 0)
+        return true;
+    rc = syscall(__NR_io_uring_enter, r->fd, r->tosubmit, min_complete,
+                 min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (rc >= 0)
+        r->tosubmit -= (uint32_t)rc;
+    else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        return false;
+    return true;
+}
+
+static void
+mcdb_aio_ring_read(struct mcdb_aio_ring * const restrict r, const int fd,
+                   struct mcdb_aio_req * const restrict q, const uint64_t id)
+  __attribute_nonnull__;
+static void
+mcdb_aio_ring_read(struct mcdb_aio_ring * const restrict r, const int fd,
+                   struct mcdb_aio_req * const restrict q, const uint64_t id)
+{
+    const unsigned tail = *r->sq_tail;
+    const unsigned idx  = tail & *r->sq_mask;
+    struct io_uring_sqe * const restrict sqe = r->sqes + idx;
+    q->iov.iov_base = q->buf;
+    q->iov.iov_len  = q->len;
+    memset(sqe, '\0', sizeof(*sqe));
+    sqe->opcode    = IORING_OP_READV;
+    sqe->fd        = fd;
+    sqe->off       = q->off;
+    sqe->addr      = (uint64_t)(uintptr_t)&q->iov;
+    sqe->len       = 1;
+    sqe->user_data = id;
+    r->sq_array[idx] = idx;
+    plasma_atomic_store_explicit(r->sq_tail, tail+1, memory_order_release);
+    ++r->tosubmit;
+    ++r->inflight;
+}
+
+static void
+mcdb_aio_ring_destroy(struct mcdb_aio_ring * const restrict r)
+  __attribute_nonnull__;
+static void
+mcdb_aio_ring_destroy(struct mcdb_aio_ring * const restrict r)
+{
+    /* wait for reads in flight (kernel writes into lookup buffers) */
+    while (r->inflight != 0 && mcdb_aio_ring_enter(r, 1)) {
+        const unsigned tail =
+          plasma_atomic_load_explicit(r->cq_tail, memory_order_acquire);
+        r->inflight -= tail - *r->cq_head;
+        plasma_atomic_store_explicit(r->cq_head, tail, memory_order_release);
+    }
+    munmap(r->sqes, r->sqes_sz);
+    if (r->cq_sz != 0)
+        munmap(r->cq_ptr, r->cq_sz);
+    munmap(r->sq_ptr, r->sq_sz);
+    (void) nointr_close(r->fd);
+}
+
+#endif /* MCDB_IO_URING */
+
+
+/* read len bytes at off (returns bytes read (short at end of file) or -errno)*/
+static ssize_t
+mcdb_aio_pread(const int fd, unsigned char * const restrict buf,
+               const size_t len, const uint64_t off)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static ssize_t
+mcdb_aio_pread(const int fd, unsigned char * const restrict buf,
+               const size_t len, const uint64_t off)
+{
+    size_t n = 0;
+    ssize_t r;
+    while (n < len) {
+        r = pread(fd, buf+n, len-n, (off_t)(off+n));
+        if (r > 0)
+            n += (size_t)r;
+        else if (r == 0)
+            break;
+        else if (errno != EINTR)
+            return -errno;
+    }
+    return (ssize_t)n;
+}
+
+static bool
+mcdb_aio_done(struct mcdb_aio_req * const restrict q, const int err,
+              const void * const data, const uint32_t dlen)
+  __attribute_nonnull_x__((1));
+static bool
+mcdb_aio_done(struct mcdb_aio_req * const restrict q, const int err,
+              const void * const data, const uint32_t dlen)
+{
+    q->state = MCDB_AIO_DONE;
+    q->err   = err;
+    q->data  = (const char *)data;
+    q->dlen  = dlen;
+    return false;  /*(no read)*/
+}
+
+/* set up read of len bytes at off into lookup buffer (grown if needed)
+ * (returns true if read is to be issued; false if lookup failed) */
+static bool
+mcdb_aio_read(struct mcdb_aio * const restrict a,
+              struct mcdb_aio_req * const restrict q, const uint32_t state,
+              const uint64_t off, uint64_t len)
+  __attribute_nonnull__;
+static bool
+mcdb_aio_read(struct mcdb_aio * const restrict a,
+              struct mcdb_aio_req * const restrict q, const uint32_t state,
+              const uint64_t off, uint64_t len)
+{
+    if (off >= a->size)
+        return mcdb_aio_done(q, EINVAL, NULL, 0);  /*(invalid mcdb)*/
+    if (len > a->size - off)
+        len = a->size - off;
+    if (len > q->bufsz) {
+        unsigned char * const buf = (len <= SIZE_MAX)
+          ? (unsigned char *)a->fn_malloc((size_t)len)
+          : NULL;
+        if (buf == NULL)
+            return mcdb_aio_done(q, ENOMEM, NULL, 0);
+        a->fn_free(q->buf);
+        q->buf   = buf;
+        q->bufsz = (size_t)len;
+    }
+    q->state = state;
+    q->off   = off;
+    q->len   = (size_t)len;
+    return true;
+}
+
+/* probe hash table elements (from cached pages, or page read into buffer)
+ * (returns true if read is to be issued) */
+static bool
+mcdb_aio_probe(struct mcdb_aio * const restrict a,
+               struct mcdb_aio_req * const restrict q,
+               const unsigned char * restrict page, uint64_t pgoff)
+  __attribute_nonnull_x__((1,2));
+static bool
+mcdb_aio_probe(struct mcdb_aio * const restrict a,
+               struct mcdb_aio_req * const restrict q,
+               const unsigned char * restrict page, uint64_t pgoff)
+{
+    const bool le = MCDB_HOST_LE && (a->fmt & MCDB_FMT_INDEX_LE);
+    const uint32_t layout = a->fmt & MCDB_FMT_LAYOUT_MASK;
+    const uint32_t esz = 1u << a->b;
+    const uint64_t hend = q->hpos + ((uint64_t)q->hslots << a->b);
+    const size_t kl = q->klen + (q->tagc != 0);
+    const uint32_t tag = (mcdb_bucket_frag(q->khash) << 16)
+      | (kl < MCDB_BUCKET_KLEN_MAX ? (uint32_t)kl : MCDB_BUCKET_KLEN_MAX);
+    const unsigned char *p;
+    uint64_t vpos;
+    uint32_t khash;
+    bool match;
+
+    while (q->loop < q->hslots) {
+        const uint64_t pg = q->kpos & ~(uint64_t)(MCDB_AIO_PAGESZ-1);
+        if (page == NULL || pg != pgoff) {
+            uint32_t i;
+            if (a->ncache == 0
+                || a->cache_tag[(i = mcdb_aio_cache_idx(a, pg))] != pg+1)
+                return mcdb_aio_read(a, q, MCDB_AIO_IDX, pg, MCDB_AIO_PAGESZ);
+            page  = a->cache + (size_t)i * MCDB_AIO_PAGESZ;
+            pgoff = pg;
+        }
+        p = page + (size_t)(q->kpos - pg);
+        q->kpos += esz;
+        if (__builtin_expect((q->kpos == hend), 0))
+            q->kpos = q->hpos;
+        khash = mcdb_aio_u32(p, le);
+        switch (layout) {
+          case MCDB_FMT_LAYOUT_PACKED:
+            vpos  = ((uint64_t)(khash & MCDB_SLOT_MASK) << 32)
+                  | mcdb_aio_u32(p+4, le);
+            match = ((khash ^ q->khash) & ~(uint32_t)MCDB_SLOT_MASK) == 0;
+            break;
+          case MCDB_FMT_LAYOUT_BUCKET:
+            vpos  = mcdb_aio_u32(p+4, le);
+            match = (khash == tag);
+            break;
+          default: /* MCDB_FMT_LAYOUT_CLASSIC */
+            if (esz == 8) {
+                vpos  = mcdb_aio_u32(p+4, le);
+                match = (khash == q->khash);
+            }
+            else {
+                vpos  = mcdb_aio_u64(p+8, le);
+                match = (khash == q->khash && mcdb_aio_u32(p+4, le) == kl);
+            }
+            break;
+        }
+        if (__builtin_expect((!vpos), 0))
+            break;
+        ++q->loop;
+        if (match) {
+            q->vpos = vpos;
+            return mcdb_aio_read(a, q, MCDB_AIO_REC, vpos,
+                                 8 + (uint64_t)kl + MCDB_AIO_DATASZ);
+        }
+    }
+    return mcdb_aio_done(q, ENOENT, NULL, 0);
+}
+
+/* process completed read (q->res) (returns true if next read is to be issued)*/
+static bool
+mcdb_aio_step(struct mcdb_aio * const restrict a,
+              struct mcdb_aio_req * const restrict q)
+  __attribute_nonnull__;
+static bool
+mcdb_aio_step(struct mcdb_aio * const restrict a,
+              struct mcdb_aio_req * const restrict q)
+{
+    const unsigned char *p = q->buf;
+    const size_t kl = q->klen + (q->tagc != 0);
+    const size_t n = (size_t)q->res;
+    uint32_t klen, dlen;
+
+    if (q->res < 0)
+        return mcdb_aio_done(q, (int)-q->res, NULL, 0);
+
+    switch (q->state) {
+      case MCDB_AIO_IDX:
+        if (n != q->len)
+            return mcdb_aio_done(q, EINVAL, NULL, 0);  /*(file truncated)*/
+        if (a->ncache != 0 && n == MCDB_AIO_PAGESZ) {
+            const uint32_t i = mcdb_aio_cache_idx(a, q->off);
+            memcpy(a->cache + (size_t)i * MCDB_AIO_PAGESZ, p, MCDB_AIO_PAGESZ);
+            a->cache_tag[i] = q->off + 1;
+        }
+        return mcdb_aio_probe(a, q, p, q->off);
+
+      case MCDB_AIO_REC:
+        if (n < 8)
+            return mcdb_aio_done(q, EINVAL, NULL, 0);
+        klen = uint32_strunpack_bigendian_macro(p);
+        dlen = uint32_strunpack_bigendian_macro(p+4);
+        if (klen != kl)
+            return mcdb_aio_probe(a, q, NULL, 0);
+        if (n < 8 + kl)
+            return mcdb_aio_done(q, EINVAL, NULL, 0);
+        if ((q->tagc != 0 && p[8] != q->tagc)
+            || 0 != memcmp(p+8+(q->tagc != 0), q->key, q->klen))
+            return mcdb_aio_probe(a, q, NULL, 0);
+        p += 8 + kl;
+        if (__builtin_expect( (dlen & MCDB_DLEN_REF), 0)) {
+            /* shared data (MCDB_FMT_VALREF) or tombstone (see mcdb.h) */
+            uint64_t dpos;
+            dlen &= ~MCDB_DLEN_REF;
+            if (!(a->fmt & MCDB_FMT_VALREF) || n < 8 + kl + 8 || (*p & 0x80))
+                return mcdb_aio_done(q, EINVAL, NULL, 0);
+            dpos = ((uint64_t)uint32_strunpack_bigendian_macro(p) << 32)
+                 | uint32_strunpack_bigendian_macro(p+4);
+            if (dpos == MCDB_DPOS_TOMBSTONE && dlen == 0)
+                return mcdb_aio_done(q, 0, NULL, 0);
+            if (dpos < MCDB_HEADER_SZ || dpos + dlen > q->vpos)
+                return mcdb_aio_done(q, EINVAL, NULL, 0);
+            return (dlen != 0)
+              ? mcdb_aio_read(a, q, MCDB_AIO_DATA, dpos, dlen)
+              : mcdb_aio_done(q, 0, q->buf, 0);
+        }
+        if (8 + kl + dlen <= n)
+            return mcdb_aio_done(q, 0, p, dlen);
+        return mcdb_aio_read(a, q, MCDB_AIO_DATA, q->vpos + 8 + kl, dlen);
+
+      case MCDB_AIO_DATA:
+        return (n == q->len)
+          ? mcdb_aio_done(q, 0, q->buf, (uint32_t)n)
+          : mcdb_aio_done(q, EINVAL, NULL, 0);  /*(file truncated)*/
+
+      default:
+        return mcdb_aio_done(q, EINVAL, NULL, 0);
+    }
+}
+
+/* issue reads of lookup until lookup completes, or read is queued (io_uring)*/
+static void
+mcdb_aio_run(struct mcdb_aio * const restrict a,
+             struct mcdb_aio_req * const restrict q, bool rd)
+  __attribute_nonnull__;
+static void
+mcdb_aio_run(struct mcdb_aio * const restrict a,
+             struct mcdb_aio_req * const restrict q, bool rd)
+{
+    while (rd) {
+      #ifdef MCDB_IO_URING
+        if (a->ring != NULL) {
+            mcdb_aio_ring_read((struct mcdb_aio_ring *)a->ring, a->fd, q,
+                               (uint64_t)(q - a->req));
+            return;
+        }
+      #endif
+        q->res = mcdb_aio_pread(a->fd, q->buf, q->len, q->off);
+        rd = mcdb_aio_step(a, q);
+    }
+    a->ready[a->nready++] = q;
+}
+
+bool
+mcdb_aio_submit(struct mcdb_aio * const restrict a,
+                const char * const key, const size_t klen,
+                const unsigned char tagc, void * const udata)
+{
+    struct mcdb_aio_req * restrict q;
+    const unsigned char * restrict slot;
+    uint32_t khash;
+    if (a->nfree == 0)
+        return (errno = EAGAIN, false);
+    q = a->freel[--a->nfree];
+    if (a->hash_fn == uint32_hash_djb)
+        khash = uint32_hash_djb((tagc != 0)
+                                ? uint32_hash_djb_uchar(a->hash_init, tagc)
+                                : a->hash_init, key, klen);
+    else
+        khash = (tagc != 0)
+          ? uint32_hash_fast_tagged(a->hash_init, tagc, key, klen)
+          : uint32_hash_fast(a->hash_init, key, klen);
+    slot = a->hdr + ((khash & MCDB_SLOT_MASK) << 4);
+    q->key    = key;
+    q->klen   = klen;
+    q->tagc   = tagc;
+    q->udata  = udata;
+    q->khash  = khash;
+    q->hpos   = uint64_strunpack_bigendian_aligned_macro(slot);
+    q->hslots = uint32_strunpack_bigendian_aligned_macro(slot+8);
+    q->loop   = 0;
+    q->kpos   = (q->hslots == 0)
+      ? q->hpos
+      : q->hpos
+        + (((a->fmt & MCDB_FMT_LAYOUT_MASK) != MCDB_FMT_LAYOUT_BUCKET)
+           ? ((uint64_t)((khash >> MCDB_SLOT_BITS) % q->hslots)) << a->b
+           : ((uint64_t)((khash >> MCDB_SLOT_BITS) % (q->hslots>>3))) << 6);
+    mcdb_aio_run(a, q, mcdb_aio_probe(a, q, NULL, 0));
+    return true;
+}
+
+int
+mcdb_aio_poll(struct mcdb_aio * const restrict a,
+              struct mcdb_aio_result * const restrict res,
+              const uint32_t n, const bool wait)
+{
+    uint32_t i;
+  #ifdef MCDB_IO_URING
+    struct mcdb_aio_ring * const restrict r = (struct mcdb_aio_ring *)a->ring;
+    if (r != NULL) {
+        uint32_t min = 0;
+        do {
+            unsigned head = *r->cq_head;
+            unsigned tail;
+            if (!mcdb_aio_ring_enter(r, min))
+                return -1;
+            tail = plasma_atomic_load_explicit(r->cq_tail,memory_order_acquire);
+            for (; head != tail; ++head) {
+                const struct io_uring_cqe * const cqe =
+                  r->cqes + (head & *r->cq_mask);
+                struct mcdb_aio_req * const restrict q =
+                  a->req + cqe->user_data;
+                q->res = cqe->res;
+                --r->inflight;
+                plasma_atomic_store_explicit(r->cq_head, head+1,
+                                             memory_order_release);
+                mcdb_aio_run(a, q, mcdb_aio_step(a, q)); /*(may queue read)*/
+            }
+            min = 1;
+        } while (wait && a->nready == 0 && r->inflight != 0);
+        if (!mcdb_aio_ring_enter(r, 0))  /*(submit reads queued above)*/
+            return -1;
+    }
+  #endif
+    (void)wait;  /*(pread() lookups complete in mcdb_aio_submit())*/
+    for (i = 0; i < n && a->nready != 0; ++i) {
+        struct mcdb_aio_req * const restrict q = a->ready[--a->nready];
+        res[i].udata = q->udata;
+        res[i].data  = q->data;
+        res[i].dlen  = q->dlen;
+        res[i].err   = q->err;
+        q->state = MCDB_AIO_FREE;
+        a->freel[a->nfree++] = q;
+    }
+    return (int)i;
+}
+
+bool
+mcdb_aio_create(struct mcdb_aio * const restrict a, const char * const fname,
+                const uint32_t depth, const uint32_t ncache,
+                void * (* const fn_malloc)(size_t),
+                void (* const fn_free)(void *))
+{
+    struct stat st;
+    uint32_t i;
+    int errsave;
+
+    memset(a, '\0', sizeof(*a));
+    a->fd        = -1;
+    a->fn_malloc = fn_malloc;
+    a->fn_free   = fn_free;
+    if (depth == 0 || depth > MCDB_AIO_DEPTH_MAX
+        || ncache > SIZE_MAX / MCDB_AIO_PAGESZ / 2) {
+        errno = EINVAL;
+        return false;
+    }
+
+    a->fd = nointr_open(fname, O_RDONLY | O_CLOEXEC, 0);
+    if (a->fd == -1 || fstat(a->fd, &st) != 0)
+        goto fail;
+    a->size = (uint64_t)st.st_size;
+    a->hdr  = (unsigned char *)fn_malloc(MCDB_HEADER_SZ);
+    if (a->hdr == NULL)
+        goto fail;
+    if (a->size < MCDB_HEADER_SZ
+        || mcdb_aio_pread(a->fd, a->hdr, MCDB_HEADER_SZ, 0) != MCDB_HEADER_SZ){
+        errno = EINVAL;
+        goto fail;
+    }
+
+    /* format (see mcdb_mmap_init()) */
+    a->fmt = uint32_strunpack_bigendian_aligned_macro(a->hdr+MCDB_FMT_OFFSET);
+    a->b   = (st.st_size < UINT_MAX || *(uint32_t *)a->hdr == 0) ? 3u : 4u;
+    errno  = EINVAL;
+    if ((a->fmt & ~MCDB_FMT_KNOWN)
+        || (!MCDB_HOST_LE && (a->fmt & MCDB_FMT_INDEX_LE)))
+        goto fail;
+    switch (a->fmt & MCDB_FMT_HASH_MASK) {
+      case MCDB_FMT_HASH_DJB:
+        a->hash_init = UINT32_HASH_DJB_INIT;
+        a->hash_fn   = uint32_hash_djb;
+        break;
+      case MCDB_FMT_HASH_FAST:
+        a->hash_init = UINT32_HASH_FAST_INIT;
+        a->hash_fn   = uint32_hash_fast;
+        break;
+      default:
+        goto fail;
+    }
+    switch (a->fmt & MCDB_FMT_LAYOUT_MASK) {
+      case MCDB_FMT_LAYOUT_CLASSIC:
+        break;
+      case MCDB_FMT_LAYOUT_BUCKET:
+      case MCDB_FMT_LAYOUT_PACKED:
+        a->b = 3;  /* 8-byte elements */
+        break;
+      default:
+        goto fail;
+    }
+    if (a->fmt & (MCDB_FMT_MPHF | MCDB_FMT_VALZ)) {
+        errno = ENOTSUP;  /*(mphf section, deflate not read by mcdb_aio)*/
+        goto fail;
+    }
+    /* hash tables within file and aligned (elements do not cross pages) */
+    for (i = 0; i < MCDB_SLOTS; ++i) {
+        const unsigned char * const slot = a->hdr + (i << 4);
+        const uint64_t hpos  = uint64_strunpack_bigendian_aligned_macro(slot);
+        const uint32_t hslots= uint32_strunpack_bigendian_aligned_macro(slot+8);
+        const uint32_t align =
+          ((a->fmt & MCDB_FMT_LAYOUT_MASK) == MCDB_FMT_LAYOUT_BUCKET)
+            ? MCDB_BUCKET_SZ
+            : 1u << a->b;
+        if (hslots != 0
+            && (hpos < MCDB_HEADER_SZ || (hpos & (align-1))
+                || hpos > a->size
+                || ((uint64_t)hslots << a->b) > a->size - hpos
+                || ((a->fmt & MCDB_FMT_LAYOUT_MASK) == MCDB_FMT_LAYOUT_BUCKET
+                    && (hslots & 7))))
+            goto fail;
+    }
+
+    /* lookup contexts and page cache */
+    a->depth  = depth;
+    a->ncache = ncache;
+    a->req    = (struct mcdb_aio_req *)
+      fn_malloc(depth * sizeof(struct mcdb_aio_req));
+    a->freel  = (struct mcdb_aio_req **)
+      fn_malloc(2 * depth * sizeof(struct mcdb_aio_req *));
+    if (a->req == NULL || a->freel == NULL)
+        goto fail;
+    memset(a->req, '\0', depth * sizeof(struct mcdb_aio_req));
+    a->ready = a->freel + depth;
+    for (i = 0; i < depth; ++i) {
+        a->req[i].buf = (unsigned char *)fn_malloc(MCDB_AIO_PAGESZ*2);
+        if (a->req[i].buf == NULL)
+            goto fail;
+        a->req[i].bufsz = MCDB_AIO_PAGESZ*2;
+        a->freel[depth-1-i] = a->req+i;
+    }
+    a->nfree = depth;
+    if (ncache != 0) {
+        a->cache = (unsigned char *)fn_malloc((size_t)ncache*MCDB_AIO_PAGESZ);
+        a->cache_tag = (uint64_t *)fn_malloc(ncache * sizeof(uint64_t));
+        if (a->cache == NULL || a->cache_tag == NULL)
+            goto fail;
+        memset(a->cache_tag, '\0', ncache * sizeof(uint64_t));
+    }
+
+  #ifdef MCDB_IO_URING
+    a->ring = mcdb_aio_ring_create(a);  /*(NULL: pread() (e.g. ENOSYS))*/
+  #endif
+    return true;
+
+  fail:
+    errsave = errno;
+    mcdb_aio_destroy(a);
+    errno = errsave;
+    return false;
+}
+
+void
+mcdb_aio_destroy(struct mcdb_aio * const restrict a)
+{
+    uint32_t i;
+  #ifdef MCDB_IO_URING
+    if (a->ring != NULL) {
+        mcdb_aio_ring_destroy((struct mcdb_aio_ring *)a->ring);
+        a->fn_free(a->ring);
+        a->ring = NULL;
+    }
+  #endif
+    if (a->req != NULL) {
+        for (i = 0; i < a->depth; ++i) {
+            if (a->req[i].buf != NULL)
+                a->fn_free(a->req[i].buf);
+        }
+        a->fn_free(a->req);
+        a->req = NULL;
+    }
+    if (a->freel != NULL) {
+        a->fn_free(a->freel);
+        a->freel = NULL;
+        a->ready = NULL;
+    }
+    if (a->cache != NULL) {
+        a->fn_free(a->cache);
+        a->cache = NULL;
+    }
+    if (a->cache_tag != NULL) {
+        a->fn_free(a->cache_tag);
+        a->cache_tag = NULL;
+    }
+    if (a->hdr != NULL) {
+        a->fn_free(a->hdr);
+        a->hdr = NULL;
+    }
+    if (a->fd != -1) {
+        (void) nointr_close(a->fd);
+        a->fd = -1;
+    }
+    a->depth  = 0;
+    a->nfree  = 0;
+    a->nready = 0;
+}
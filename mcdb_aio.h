@@ -0,0 +1,127 @@
+/*
+ * mcdb_aio - asynchronous lookups over pread() or io_uring (mcdb not mmap'd)
+ *
+ * Copyright (c) 2010, Glue Logic LLC. All rights reserved. code()gluelogic.com
+ *
+ *  This file is part of mcdb.
+ *
+ *  mcdb is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mcdb is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with mcdb.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * mcdb is originally based upon the Public Domain cdb-0.75 by Dan Bernstein
+ */
+
+#ifndef INCLUDED_MCDB_AIO_H
+#define INCLUDED_MCDB_AIO_H
+
+#include "plasma/plasma_feature.h"
+#include "plasma/plasma_attr.h"
+#include "plasma/plasma_stdtypes.h" /* bool, size_t, uint32_t, uint64_t */
+PLASMA_ATTR_Pragma_once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* asynchronous lookups for mcdb much larger than physical memory, where page
+ * fault on mmap of mcdb (mcdb_findtagnext()) would stall querying thread
+ *
+ * mcdb is read with pread(), not mmap'd.  Lookups are submitted with
+ * mcdb_aio_submit() (up to depth in flight) and completed in any order by
+ * mcdb_aio_poll().  Each lookup reads (4 KB page of) hash table elements,
+ * then record (and shared data of MCDB_FMT_VALREF record, or data which does
+ * not fit in first read of record), with reads issued through io_uring
+ * (Linux; MCDB_IO_URING) or else completed by pread() within submit.
+ * Throughput then scales with device queue depth rather than thread count.
+ *
+ * Header is read once by mcdb_aio_create().  Optional cache of ncache hash
+ * table pages (direct-mapped by page offset) avoids repeated reads of hot
+ * index pages.  Lookup finds first record of key (as mcdb_findtagstart(),
+ * mcdb_findtagnext()).  Hash table layouts classic, bucket, packed, and
+ * MCDB_FMT_VALREF are supported; mcdb_aio_create() fails (errno ENOTSUP)
+ * for MCDB_FMT_MPHF or MCDB_FMT_VALZ.  Handle is used by a single thread.
+ */
+#define MCDB_AIO_PAGESZ 4096u   /* hash table page (read, cached) */
+#define MCDB_AIO_DATASZ 1024u   /* data read with record key (more read next)*/
+#define MCDB_AIO_DEPTH_MAX 4096u
+
+struct mcdb_aio_result {
+  void *udata;                /* udata of mcdb_aio_submit() */
+  const char *data;           /* data (NULL if not found, or for tombstone) */
+  uint32_t dlen;              /* length of data */
+  int err;                    /* 0: found; ENOENT: not found; else read err */
+};
+/* (data is valid until next mcdb_aio_submit()) */
+
+struct mcdb_aio_req;          /* (private) lookup in flight */
+
+struct mcdb_aio {
+  int fd;                     /* mcdb fd (opened by mcdb_aio_create()) */
+  uint32_t fmt;               /* format word from mcdb header (MCDB_FMT_*) */
+  uint32_t b;                 /* log2 of hash table element size (3 or 4) */
+  uint32_t depth;             /* max lookups in flight */
+  uint32_t ncache;            /* num of cached hash table pages */
+  uint32_t nfree;             /* (private) free lookup contexts */
+  uint32_t nready;            /* (private) completed lookups not yet polled */
+  uint32_t hash_init;         /* hash init value */
+  uint32_t (*hash_fn)(uint32_t, const void * restrict, size_t); /* hash func */
+  uint64_t size;              /* mcdb file size */
+  unsigned char *hdr;         /* mcdb header (MCDB_HEADER_SZ) */
+  unsigned char *cache;       /* (private) ncache pages of hash tables */
+  uint64_t *cache_tag;        /* (private) cached page offset + 1 (0: none) */
+  struct mcdb_aio_req *req;   /* (private) depth lookup contexts */
+  struct mcdb_aio_req **freel;/* (private) free lookup contexts */
+  struct mcdb_aio_req **ready;/* (private) completed lookups */
+  void *ring;                 /* (private) io_uring (NULL if pread()) */
+  void * (*fn_malloc)(size_t);/* fn ptr to malloc() */
+  void (*fn_free)(void *);    /* fn ptr to free() */
+};
+
+/* open mcdb fname for depth lookups in flight, with cache of ncache pages
+ * (ncache 0 for no cache) (io_uring, if available; else pread())
+ * (returns false and errno upon failure (EINVAL if mcdb is invalid)) */
+EXPORT extern bool
+mcdb_aio_create(struct mcdb_aio * restrict, const char *, uint32_t, uint32_t,
+                void * (*)(size_t), void (*)(void *))
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+EXPORT extern void
+mcdb_aio_destroy(struct mcdb_aio * restrict)
+  __attribute_nonnull__;
+
+/* submit lookup of key (klen, tagc) (key must be valid until lookup result is
+ * returned by mcdb_aio_poll()) (udata is returned in result)
+ * (returns false (EAGAIN) if depth lookups are in flight or not yet polled) */
+EXPORT extern bool
+mcdb_aio_submit(struct mcdb_aio * restrict, const char *, size_t,
+                unsigned char, void *)
+  __attribute_nonnull_x__((1,2))  __attribute_warn_unused_result__;
+
+/* submit reads queued by mcdb_aio_submit() and return up to n results of
+ * completed lookups; if wait, block until at least one lookup completes
+ * (unless no lookups are in flight)
+ * (returns num of results; -1 and errno upon failure of io_uring) */
+EXPORT extern int
+mcdb_aio_poll(struct mcdb_aio * restrict, struct mcdb_aio_result * restrict,
+              uint32_t, bool)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+/* num of lookups submitted and not yet returned by mcdb_aio_poll() */
+#define mcdb_aio_pending(a) ((a)->depth - (a)->nfree)
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,223 @@
+/*
+ * mcdb_layer - layered mcdb: delta mcdb (with tombstones) stacked over base
+ *
+ * Copyright (c) 2010, Glue Logic LLC. All rights reserved. code()gluelogic.com
+ *
+ *  This file is part of mcdb.
+ *
+ *  mcdb is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mcdb is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with mcdb.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * mcdb is originally based upon the Public Domain cdb-0.75 by Dan Bernstein
+ */
+
+
+#include "mcdb_layer.h"
+#include "mcdb.h"
+#include "plasma/plasma_stdtypes.h"
+
+#include <errno.h>
+#include <string.h>    /* memset() */
+
+bool
+mcdb_layer_create(struct mcdb_layer * const restrict l,
+                  const char * const * const fnames, const uint32_t n,
+                  void * (* const fn_malloc)(size_t),
+                  void (* const fn_free)(void *))
+{
+    uint32_t i;
+    int errsave;
+
+    l->m         = NULL;
+    l->nlayers   = 0;
+    l->owner     = 1;
+    l->fn_malloc = fn_malloc;
+    l->fn_free   = fn_free;
+    if (n == 0) {
+        errno = EINVAL;
+        return false;
+    }
+    if ((l->m = fn_malloc(n * sizeof(struct mcdb))) == NULL)
+        return false;
+    memset(l->m, '\0', n * sizeof(struct mcdb));
+
+    for (i = 0; i < n; ++i) {
+        l->m[i].map =
+          mcdb_mmap_create_h(NULL, NULL, fnames[i], fn_malloc, fn_free);
+        if (l->m[i].map == NULL)
+            break;
+        if (i != 0 && (l->m[i].map->hash_fn != l->m[0].map->hash_fn
+                       || l->m[i].map->hash_init != l->m[0].map->hash_init)){
+            mcdb_mmap_destroy_h(l->m[i].map);
+            errno = EINVAL;  /*(layers must use same hash function)*/
+            break;
+        }
+    }
+    l->nlayers = i;
+    if (i == n)
+        return true;
+    errsave = errno;
+    mcdb_layer_destroy(l);
+    errno = errsave;
+    return false;
+}
+
+void
+mcdb_layer_destroy(struct mcdb_layer * const restrict l)
+{
+    uint32_t i;
+    if (l->m == NULL)
+        return;
+    if (!l->owner) {
+        mcdb_layer_thread_unregister(l);
+        return;
+    }
+    for (i = 0; i < l->nlayers; ++i)
+        mcdb_mmap_destroy_h(l->m[i].map);
+    l->fn_free(l->m);
+    l->m = NULL;
+    l->nlayers = 0;
+}
+
+bool
+mcdb_layer_refresh(struct mcdb_layer * const restrict l)
+{
+    bool rc = true;
+    uint32_t i;
+    for (i = 0; i < l->nlayers; ++i) {
+        if (l->owner
+            ? !mcdb_mmap_refresh_threadsafe(&l->m[i].map)
+            : !mcdb_thread_refresh_self(l->m+i))
+            rc = false;
+    }
+    return rc;
+}
+
+bool
+mcdb_layer_watch(struct mcdb_layer * const restrict l)
+{
+    bool rc = true;
+    uint32_t i;
+    for (i = 0; i < l->nlayers; ++i) {
+        if (!mcdb_mmap_watch_h(l->m[i].map))
+            rc = false;
+    }
+    return rc;
+}
+
+bool
+mcdb_layer_thread_register(struct mcdb_layer * const restrict t,
+                           const struct mcdb_layer * const restrict l)
+{
+    uint32_t i;
+    t->nlayers   = 0;
+    t->owner     = 0;
+    t->fn_malloc = l->fn_malloc;
+    t->fn_free   = l->fn_free;
+    t->m = l->fn_malloc(l->nlayers * sizeof(struct mcdb));
+    if (t->m == NULL)
+        return false;
+    memset(t->m, '\0', l->nlayers * sizeof(struct mcdb));
+    for (i = 0; i < l->nlayers; ++i) {
+        t->m[i].map = l->m[i].map;
+        if (mcdb_thread_register(t->m+i) == NULL)
+            break;
+        t->nlayers = i+1;
+    }
+    if (i == l->nlayers)
+        return true;
+    mcdb_layer_thread_unregister(t);
+    return false;
+}
+
+void
+mcdb_layer_thread_unregister(struct mcdb_layer * const restrict t)
+{
+    uint32_t i;
+    if (t->m == NULL)
+        return;
+    for (i = 0; i < t->nlayers; ++i)
+        (void)mcdb_thread_unregister(t->m+i);
+    t->fn_free(t->m);
+    t->m = NULL;
+    t->nlayers = 0;
+}
+
+bool
+mcdb_layer_findtagnext(struct mcdb * const restrict m,
+                       const char * const restrict key, const size_t klen,
+                       const unsigned char tagc)
+{
+    while (mcdb_findtagnext_h(m, key, klen, tagc)) {
+        if (!mcdb_tombstone(m))
+            return true;
+    }
+    return false;
+}
+
+struct mcdb *
+mcdb_layer_findtag(struct mcdb_layer * const restrict l,
+                   const char * const restrict key, const size_t klen,
+                   const unsigned char tagc)
+{
+    struct mcdb * restrict m = l->m;
+    struct mcdb * const e = l->m + l->nlayers;
+    for (; m != e; ++m) {
+        /* (filter, if present, is checked in mcdb_findtagstart()) */
+        if (!mcdb_findtagstart_h(m, key, klen, tagc)
+            || !mcdb_findtagnext_h(m, key, klen, tagc))
+            continue;
+        /* newest layer with key decides (key deleted if only tombstones) */
+        return (!mcdb_tombstone(m) || mcdb_layer_findtagnext(m,key,klen,tagc))
+          ? m
+          : NULL;
+    }
+    return NULL;
+}
+
+void
+mcdb_layer_iter_init(struct mcdb_layer_iter * const restrict it,
+                     struct mcdb_layer * const restrict l)
+{
+    it->l = l;
+    it->i = 0;
+    mcdb_iter_init_h(&it->iter, l->m);
+}
+
+bool
+mcdb_layer_iter(struct mcdb_layer_iter * const restrict it)
+{
+    struct mcdb * const restrict m = it->l->m;
+    uint32_t j;
+    for (;;) {
+        if (!mcdb_iter_h(&it->iter)) {
+            if (it->i + 1 >= it->l->nlayers)
+                return false;
+            mcdb_iter_init_h(&it->iter, m + ++it->i);
+            continue;
+        }
+        if (mcdb_iter_tombstone(&it->iter))
+            continue;
+        /* skip record if key is in newer layer (including tombstone) */
+        for (j = 0; j < it->i; ++j) {
+            if (mcdb_findtagstart_h(m+j, (char *)mcdb_iter_keyptr(&it->iter),
+                                    mcdb_iter_keylen(&it->iter), 0)
+                && mcdb_findtagnext_h(m+j,(char *)mcdb_iter_keyptr(&it->iter),
+                                      mcdb_iter_keylen(&it->iter), 0))
+                break;
+        }
+        if (j == it->i)
+            return true;
+    }
+}
@@ -0,0 +1,145 @@
+/*
+ * mcdb_layer - layered mcdb: delta mcdb (with tombstones) stacked over base
+ *
+ * Copyright (c) 2010, Glue Logic LLC. All rights reserved. code()gluelogic.com
+ *
+ *  This file is part of mcdb.
+ *
+ *  mcdb is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mcdb is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with mcdb.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * mcdb is originally based upon the Public Domain cdb-0.75 by Dan Bernstein
+ */
+
+#ifndef INCLUDED_MCDB_LAYER_H
+#define INCLUDED_MCDB_LAYER_H
+
+#include "plasma/plasma_feature.h"
+#include "plasma/plasma_attr.h"
+#include "plasma/plasma_stdtypes.h" /* bool, size_t, uint32_t */
+#include "mcdb.h"
+PLASMA_ATTR_Pragma_once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* layered mcdb: small delta mcdb (e.g. recent updates) stacked over large
+ * base mcdb, so that updates need not rebuild base (cf. mcdb_make_update(),
+ * "mcdbctl update", to later fold delta into base)
+ *
+ * Layers are ordered newest first (m[0] is newest).  Newest layer with any
+ * record of key decides the records of key: non-tombstone records of key in
+ * that layer (mcdb_layer_findtag(), mcdb_layer_findtagnext()).  A layer with
+ * only tombstones for key (see MCDB_DPOS_TOMBSTONE in mcdb.h) deletes key;
+ * a layer with tombstone and other records for key replaces key.  Lookup
+ * of key not in newer layer passes to next layer after probe of filter of
+ * newer layer, if present (mcdb_make bloom_bits), without touching records.
+ *
+ * mcdb_layer_iter() iterates records of merged view: records of each layer,
+ * newest layer first, except tombstones and records of keys in newer layers.
+ *
+ * Each layer mcdb is refreshed independently (mcdb_layer_refresh()), e.g.
+ * after delta is rebuilt and renamed into place.  All layers must use same
+ * hash function (hash id of mcdb header), as key hash of each layer is
+ * computed separately (lookup in each layer probes only that layer).
+ */
+
+struct mcdb_layer {
+  struct mcdb *m;             /* nlayers handles; m[0] is newest layer */
+  uint32_t nlayers;           /* num of layers */
+  uint32_t owner;             /* (private) maps created (not registered) */
+  void * (*fn_malloc)(size_t);/* fn ptr to malloc() */
+  void (*fn_free)(void *);    /* fn ptr to free() */
+};
+
+struct mcdb_layer_iter {
+  struct mcdb_iter iter;      /* record (mcdb_iter_*() macros on &iter) */
+  struct mcdb_layer *l;       /* (private) layered mcdb */
+  uint32_t i;                 /* layer of record */
+};
+
+
+/* open nlayers mcdb fnames (newest first) (maps each layer)
+ * (returns false and errno upon failure) */
+EXPORT extern bool
+mcdb_layer_create(struct mcdb_layer * restrict, const char * const *,
+                  uint32_t, void * (*)(size_t), void (*)(void *))
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+EXPORT extern void
+mcdb_layer_destroy(struct mcdb_layer * restrict)
+  __attribute_nonnull__;
+
+/* refresh each layer mcdb which has been updated (see mcdb_mmap_refresh())
+ * (thread-safe; call with layers from mcdb_layer_create(), e.g. in
+ *  maintenance thread, while querying threads use layers from
+ *  mcdb_layer_thread_register())
+ * (returns false if any layer fails to refresh; other layers are refreshed) */
+EXPORT extern bool
+mcdb_layer_refresh(struct mcdb_layer * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+/* request notification when layer mcdb are renamed into place
+ * (see mcdb_mmap_watch()) (call before sharing layers with other threads) */
+EXPORT extern bool
+mcdb_layer_watch(struct mcdb_layer * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+/* querying thread registers its own set of handles t to maps of layers
+ * (as mcdb_thread_register() registers a struct mcdb to its map) */
+EXPORT extern bool
+mcdb_layer_thread_register(struct mcdb_layer * restrict,
+                           const struct mcdb_layer * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+EXPORT extern void
+mcdb_layer_thread_unregister(struct mcdb_layer * restrict)
+  __attribute_nonnull__;
+
+
+/* find first (non-tombstone) record of key in newest layer with key; returns
+ * handle of layer (for data and mcdb_layer_findtagnext()), or NULL if not
+ * found (or deleted) */
+EXPORT extern struct mcdb *
+mcdb_layer_findtag(struct mcdb_layer * restrict, const char * restrict,
+                   size_t, unsigned char)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
+/* find next (non-tombstone) record of key in layer handle m (from above) */
+EXPORT extern bool
+mcdb_layer_findtagnext(struct mcdb * restrict, const char * restrict,
+                       size_t, unsigned char)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
+#define mcdb_layer_find(l,key,klen) mcdb_layer_findtag((l),(key),(klen),0)
+#define mcdb_layer_findnext(m,key,klen) \
+  mcdb_layer_findtagnext((m),(key),(klen),0)
+
+/* iterate records of merged view (see above)
+ * (each record in lower layer is looked up in newer layers; layers must not
+ *  be refreshed, e.g. mcdb_layer_refresh() or mcdb_layer_findtag() on l,
+ *  during iteration) */
+EXPORT extern void
+mcdb_layer_iter_init(struct mcdb_layer_iter * restrict,
+                     struct mcdb_layer * restrict)
+  __attribute_nonnull__  __attribute_nothrow__;
+EXPORT extern bool
+mcdb_layer_iter(struct mcdb_layer_iter * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
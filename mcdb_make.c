@@ -28,6 +28,12 @@
 #ifndef _XOPEN_SOURCE /* posix_fallocate() requires _XOPEN_SOURCE 600 */
 #define _XOPEN_SOURCE 600
 #endif
+/* _GNU_SOURCE needed for mremap() MREMAP_MAYMOVE on Linux */
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
 /* gcc -std=c99 hides MAP_ANONYMOUS
  * _BSD_SOURCE or _SVID_SOURCE needed for mmap MAP_ANONYMOUS on Linux */
 #ifndef _BSD_SOURCE
@@ -47,6 +53,10 @@
 #include "uint32.h"
 #include "plasma/plasma_stdtypes.h"
 #include "plasma/plasma_sysconf.h"
+#ifdef _THREAD_SAFE
+#include "plasma/plasma_atomic.h"
+#include <pthread.h>   /* pthread_create(), pthread_join() */
+#endif
 
 #include <sys/stat.h>
 #include <sys/mman.h>
@@ -54,7 +64,11 @@
 #include <errno.h>
 #include <fcntl.h>   /* posix_fallocate() */
 #include <string.h>  /* memcpy() */
+#include <stdlib.h>  /* qsort() */
 #include <limits.h>  /* UINT_MAX, INT_MAX */
+#ifdef MCDB_ZLIB
+#include <zlib.h>    /* deflate() (compress; MCDB_FMT_VALZ) */
+#endif
 
 #ifdef _AIX
 #ifndef MAP_ANONYMOUS
@@ -79,15 +93,110 @@ extern int madvise(caddr_t, size_t, int);
 #define POSIX_MADV_DONTNEED    4
 #endif
 
-#define MCDB_HPLIST 250
+/* hash list: per-slot chains of fixed-size chunks, bump-allocated from one
+ * growable arena (anonymous mmap, or mmap of m->spill_fd scratch file).
+ * Chunks are referenced by arena offset, since arena may move when grown
+ * (offset 0 is reserved and terminates chain).  Entries are compact
+ * (struct mcdb_hpc) while data section is < 4 GB, and are struct mcdb_hp
+ * after data section crosses 4 GB, or if m->fd == -1 (no data to read back).
+ * Compact entries omit klen, which is needed only for bucket layout and for
+ * 16-byte hash table elements, and which is then read from data (m->kmap) */
+#define MCDB_HPCHUNK_SZ 4096u
+
+struct mcdb_hpchunk {
+  uint64_t next;   /* arena offset of next (older) chunk in slot (0 at end) */
+  uint64_t pbase;  /* added to compact entry p (nonzero if writer rebased) */
+  uint32_t num;    /* num entries in chunk */
+  uint32_t wide;   /* entries are struct mcdb_hp; else struct mcdb_hpc */
+};
+
+struct mcdb_hpc { uint32_t p; uint32_t h; };  /* (p == 0 if placed in mphf) */
+
+#define MCDB_HPCHUNK_N(wide) \
+  ((MCDB_HPCHUNK_SZ - sizeof(struct mcdb_hpchunk)) \
+   / ((wide) ? sizeof(struct mcdb_hp) : sizeof(struct mcdb_hpc)))
+
+#define mcdb_hpchunk(m, off) \
+  ((struct mcdb_hpchunk *)(void *)((m)->hpmap + (off)))
+
+/* get entry j of chunk c (klen read from kmap for compact entry, if kmap) */
+static inline void
+mcdb_hpchunk_get(const struct mcdb_hpchunk * const restrict c,
+                 const uint32_t j, const unsigned char * const restrict kmap,
+                 struct mcdb_hp * const restrict hp)
+  __attribute_nonnull_x__((1,4));
+static inline void
+mcdb_hpchunk_get(const struct mcdb_hpchunk * const restrict c,
+                 const uint32_t j, const unsigned char * const restrict kmap,
+                 struct mcdb_hp * const restrict hp)
+{
+    if (c->wide)
+        *hp = ((const struct mcdb_hp *)(c+1))[j];
+    else {
+        const struct mcdb_hpc * const restrict e =
+          ((const struct mcdb_hpc *)(c+1)) + j;
+        hp->h = e->h;
+        hp->p = e->p ? (uintptr_t)(c->pbase + e->p) : 0;
+        hp->l = (kmap != NULL && hp->p)
+          ? uint32_strunpack_bigendian_macro(kmap + hp->p)
+          : 0;
+    }
+}
+
+/* mark entry j of chunk c as placed in mphf (omit from hash tables) */
+static inline void
+mcdb_hpchunk_mark(struct mcdb_hpchunk * const restrict c, const uint32_t j)
+  __attribute_nonnull__;
+static inline void
+mcdb_hpchunk_mark(struct mcdb_hpchunk * const restrict c, const uint32_t j)
+{
+    if (c->wide)
+        ((struct mcdb_hp *)(c+1))[j].p = 0;
+    else
+        ((struct mcdb_hpc *)(c+1))[j].p = 0;
+}
 
-struct mcdb_hplist {
-  uint32_t num;  /* index into struct mcdb_hp hp[MCDB_HPLIST] */
-  struct mcdb_hplist *next;
-  struct mcdb_hplist *pend;
-  struct mcdb_hp hp[MCDB_HPLIST];
+struct mcdb_hpiter {
+  const struct mcdb_make *m;
+  const unsigned char *kmap;
+  struct mcdb_hpchunk *c;
+  uint32_t j;
 };
 
+static inline void
+mcdb_hpiter_init(struct mcdb_hpiter * const restrict it,
+                 const struct mcdb_make * const restrict m, const uint32_t slot,
+                 const unsigned char * const restrict kmap)
+  __attribute_nonnull_x__((1,2));
+static inline void
+mcdb_hpiter_init(struct mcdb_hpiter * const restrict it,
+                 const struct mcdb_make * const restrict m, const uint32_t slot,
+                 const unsigned char * const restrict kmap)
+{
+    it->m    = m;
+    it->kmap = kmap;
+    it->c    = m->head[slot] ? mcdb_hpchunk(m, m->head[slot]) : NULL;
+    it->j    = 0;
+}
+
+static inline bool
+mcdb_hpiter_next(struct mcdb_hpiter * const restrict it,
+                 struct mcdb_hp * const restrict hp)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static inline bool
+mcdb_hpiter_next(struct mcdb_hpiter * const restrict it,
+                 struct mcdb_hp * const restrict hp)
+{
+    while (it->c != NULL && it->j == it->c->num) {
+        it->c = it->c->next ? mcdb_hpchunk(it->m, it->c->next) : NULL;
+        it->j = 0;
+    }
+    if (it->c == NULL)
+        return false;
+    mcdb_hpchunk_get(it->c, it->j++, it->kmap, hp);
+    return true;
+}
+
 /* routine marked to indicate unlikely branch;
  * __attribute_cold__ can be used instead of __builtin_expect() */
 __attribute_noinline__  __attribute_cold__
@@ -99,45 +208,139 @@ mcdb_make_err(struct mcdb_make * const restrict m, int errnum)
     return -1;
 }
 
+static int
+mcdb_make_preallocate(int, off_t, off_t)
+  __attribute_warn_unused_result__;
+
+/* grow hash list arena to at least sz bytes (doubling)
+ * (spill mode: arena is mmap of scratch file, so that hash list memory is
+ *  backed by file (and may be paged out), not by anonymous memory) */
+__attribute_noinline__
+static bool
+mcdb_hparena_grow(struct mcdb_make * const restrict m, const size_t need)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static bool
+mcdb_hparena_grow(struct mcdb_make * const restrict m, const size_t need)
+{
+    size_t sz = m->hpsz ? m->hpsz : (MCDB_SLOTS+1) * MCDB_HPCHUNK_SZ;
+    uint64_t cnt = 0;
+    char *x;
+    for (uint32_t i = 0; i < MCDB_SLOTS; ++i)
+        cnt += m->count[i];
+    /* detect if we have already passed 2 gibibyte records
+     * (not exact, but ok; will abort in mcdb_make_finish() if > INT_MAX) */
+    if (cnt >= INT_MAX) { errno = ENOMEM; return false; }
+    while (sz < need) {
+        if (sz > (SIZE_MAX >> 1)) { errno = ENOMEM; return false; }
+        sz <<= 1;
+    }
+    sz = (sz + ~m->pgalign) & m->pgalign;
+    if (m->spill_fd != -1) {
+      #if !defined(_LP64) && !defined(__LP64__)
+        if (sz > (size_t)LONG_MAX) { errno = EFBIG; return false; }
+      #endif
+        if ((errno = mcdb_make_preallocate(m->spill_fd, (off_t)m->hpsz,
+                                           (off_t)(sz - m->hpsz))) != 0)
+            return false;
+        x = (char *)mmap(0, sz, PROT_READ|PROT_WRITE, MAP_SHARED,
+                         m->spill_fd, 0);
+        if (x == MAP_FAILED)
+            return false;
+        if (m->hpmap != NULL)
+            munmap(m->hpmap, m->hpsz);
+    }
+    else {
+      #ifdef MREMAP_MAYMOVE
+        x = (m->hpmap != NULL)
+          ? (char *)mremap(m->hpmap, m->hpsz, sz, MREMAP_MAYMOVE)
+          : (char *)mmap(0, sz, PROT_READ|PROT_WRITE,
+                         MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (x == MAP_FAILED)
+            return false;
+      #else
+        x = (char *)mmap(0, sz, PROT_READ|PROT_WRITE,
+                         MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (x == MAP_FAILED)
+            return false;
+        if (m->hpmap != NULL) {
+            memcpy(x, m->hpmap, m->hppos);
+            munmap(m->hpmap, m->hpsz);
+        }
+      #endif
+    }
+    m->hpmap = x;
+    m->hpsz  = sz;
+    return true;
+}
+
+/* allocate new head chunk for slot */
+static bool
+mcdb_hpchunk_alloc(struct mcdb_make * const restrict m, const uint32_t slot)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdb_hpchunk_alloc(struct mcdb_make * const restrict m, const uint32_t slot)
+{
+    const size_t off = m->hppos;
+    struct mcdb_hpchunk * restrict c;
+    if (m->hpsz < off + MCDB_HPCHUNK_SZ
+        && !mcdb_hparena_grow(m, off + MCDB_HPCHUNK_SZ))
+        return false;
+    c = mcdb_hpchunk(m, off);
+    c->next  = m->head[slot];
+    c->pbase = 0;
+    c->num   = 0;
+    c->wide  = m->hpwide;
+    m->head[slot] = off;
+    m->hppos = off + MCDB_HPCHUNK_SZ;
+    m->hpcompact |= !m->hpwide;
+    return true;
+}
+
 __attribute_noinline__
 static bool
 mcdb_hplist_alloc(struct mcdb_make * const restrict m)
   __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
 static bool
 mcdb_hplist_alloc(struct mcdb_make * const restrict m)
 {
-    uint32_t i = m->hp.h & MCDB_SLOT_MASK;
-    struct mcdb_hplist * const head = m->head[i];
-    struct mcdb_hplist * const pend = head->pend;
-    if (pend != NULL) {
-        pend->next = head;
-        m->head[i] = pend;
+    if (m->hpmap == NULL) { /* (first add) chunk for each slot */
+      #if !defined(_LP64) && !defined(__LP64__)
+        /* (bucket layout needs klen; avoid mmap of data (m->kmap) in 32-bit) */
+        if (m->layout == MCDB_FMT_LAYOUT_BUCKET)
+            m->hpwide = 1;
+      #endif
+        if (m->cluster || m->dup) /*(record offsets are rewritten;
+                                   *  see mcdb_make_cluster)*/
+            m->hpwide = 1;
+        m->hppos = MCDB_HPCHUNK_SZ;  /*(offset 0 reserved)*/
+        for (uint32_t i = 0; i < MCDB_SLOTS; ++i) {
+            if (!mcdb_hpchunk_alloc(m, i))
+                return false;
+        }
         return true;
     }
-    else {
-        uint32_t cnt;
-        const uint32_t * const count = m->count;
-        struct mcdb_hplist * const restrict hplist = (struct mcdb_hplist *)
-          m->fn_malloc(sizeof(struct mcdb_hplist) * MCDB_SLOTS);
-        if (!hplist) return false;
-        for (cnt = 0, i = 0; i < MCDB_SLOTS; ++i) {
-            hplist[i].num  = 0;
-            hplist[i].pend = NULL;
-            if (m->head[i]->num != MCDB_HPLIST) {
-                if (NULL != m->head[i]->pend)
-                    hplist[i].pend = m->head[i]->pend;
-                m->head[i]->pend = hplist+i;
-            }
-            else {
-                hplist[i].next = m->head[i];
-                m->head[i] = hplist+i;
-            }
-            cnt += count[i];
-        }
-        /* detect if we have already passed 2 gibibyte records
-         * (not exact, but ok; will abort in mcdb_make_finish() if > INT_MAX) */
-        return (cnt < INT_MAX) ? true : (errno = ENOMEM, false);
+    return mcdb_hpchunk_alloc(m, m->hp.h & MCDB_SLOT_MASK);
+}
+
+/* data section crosses 4 GB; switch to struct mcdb_hp entries for all slots */
+__attribute_noinline__  __attribute_cold__
+static bool
+mcdb_hplist_widen(struct mcdb_make * const restrict m)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__  __attribute_cold__
+static bool
+mcdb_hplist_widen(struct mcdb_make * const restrict m)
+{
+    m->hpwide = 1;
+    if (m->hpmap == NULL)
+        return mcdb_hplist_alloc(m);
+    for (uint32_t i = 0; i < MCDB_SLOTS; ++i) {
+        if (!mcdb_hpchunk_alloc(m, i))
+            return false;
     }
+    return true;
 }
 
 #if !defined(__GLIBC__)
@@ -212,6 +415,32 @@ mcdb_make_fallocate(const int fd, off_t offset, off_t len)
 }
 #endif
 
+/* allocate file space [offset, offset+len) (returns 0 or errno value) */
+static int
+mcdb_make_preallocate(const int fd, const off_t offset, const off_t len)
+  __attribute_warn_unused_result__;
+static int
+mcdb_make_preallocate(const int fd, const off_t offset, const off_t len)
+{
+  #if defined(__GLIBC__)/* glibc emulates if not natively supported by fs */
+    return posix_fallocate(fd, offset, len);
+  #elif defined(__SunOS_5_11)/*not sure about Solaris 11; not tested by me*/
+    /* disabled for defined(_AIX) since mcdb_make_fallocate() is faster
+     * and because posix_fallocate() in 32-bit can result in SIGSEGV.
+     * Observed on AIX TL6 SP3: posix_fallocate() fails on initial resize
+     * and mcdb_make_fallocate() succeeds, but then posix_fallocate()
+     * returns 0 on second call to extend file, but later access invalid.
+     * Prior issues others had with posix_fallocate() on AIX:
+     * http://thr3ads.net/dovecot/2009/07/1089409-AIX-and-posix_fallocate
+     * https://www-304.ibm.com/support/docview.wss?uid=isg1IZ46957 */
+    /*defined(_AIX)*//*AIX errno=ENOTSUP if not natively supported by fs*/
+    const int rc = posix_fallocate(fd, offset, len);
+    return (rc == 0 || rc == ENOSPC) ? rc : mcdb_make_fallocate(fd,offset,len);
+  #else /*emulate posix_fallocate() on earlier __sun, on __hpux and others*/
+    return mcdb_make_fallocate(fd, offset, len);
+  #endif
+}
+
 static bool  inline
 mcdb_mmap_commit(struct mcdb_make * const restrict m,
                  char header[MCDB_HEADER_SZ])
@@ -246,6 +475,150 @@ mcdb_mmap_commit(struct mcdb_make * const restrict m,
      * OS crashes, then the updated mcdb can be corrupted. */
 }
 
+/* write-based output of data section (m->io != MCDB_MAKE_IO_MMAP)
+ * Records are buffered in a large page-aligned buffer (m->map, m->io_buf set)
+ * which is written to m->fd with pwrite() when full, instead of mmap windows
+ * which are re-mmap'd (and file preallocated) as data section grows.
+ * Buffer starts at page-aligned offset (m->offset); partial page at end of
+ * buffer is moved to start of buffer and is written again with next buffer.
+ * (MCDB_MAKE_IO_DIRECT: fd is set O_DIRECT, if supported, while buffering)
+ * mcdb_make_finish() flushes buffer and reverts to mmap for sections, index*/
+#define MCDB_MAKE_WBUF_SZ (1u<<24)  /* 16MB */
+
+/* write [m->offset, end) from buffer (end page-aligned, or m->pos) */
+static bool
+mcdb_wbuf_write(struct mcdb_make * const restrict m, const size_t end)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdb_wbuf_write(struct mcdb_make * const restrict m, const size_t end)
+{
+    /* (O_DIRECT: length rounded to page; buffer is page multiple; data past
+     *  m->pos written to file is overwritten, or truncated in mcdb_mmap_commit)*/
+    const size_t len = (m->io == MCDB_MAKE_IO_DIRECT)
+      ? (end - m->offset + ~m->pgalign) & m->pgalign
+      : end - m->offset;
+    size_t off = 0;
+    ssize_t w;
+    while (off < len) {
+        w = pwrite(m->fd, m->map + off, len - off, (off_t)(m->offset + off));
+        if (w <= 0) {
+            if (w == -1 && errno == EINTR)
+                continue;
+            if (w == 0)
+                errno = EIO;
+            return false;
+        }
+        off += (size_t)w;
+    }
+    if (m->fsz < m->offset + len)
+        m->fsz = m->osz = m->offset + len; /*(file extended; see upsize below)*/
+    return true;
+}
+
+/* flush (data up to m->pos) and munmap mmap (or write buffer) */
+static bool
+mcdb_mmap_unmap(struct mcdb_make * const restrict m)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdb_mmap_unmap(struct mcdb_make * const restrict m)
+{
+    if (m->io_buf) {
+        if (!mcdb_wbuf_write(m, m->pos) || 0 != munmap(m->map, m->msz))
+            return false;
+        m->map = MAP_FAILED;
+        m->io_buf = 0;
+    }
+    else if (m->map != MAP_FAILED) {
+        if ((  -1 == m->fd     /*(m->fd==-1 during some large mcdb size tests)*/
+             || 0 == m->pos - m->offset   /*(avoid 0-sized msync; portability)*/
+             || 0 == msync(m->map, m->pos - m->offset, MS_ASYNC))
+            &&  0 == munmap(m->map, m->msz))
+            m->map = MAP_FAILED;
+        else
+            return false;
+    }
+    return true;
+}
+
+/* write full pages of buffer and reuse (or grow) buffer for [pos, sz) */
+__attribute_noinline__
+static bool
+mcdb_wbuf_upsize(struct mcdb_make * const restrict m, const size_t sz)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static bool
+mcdb_wbuf_upsize(struct mcdb_make * const restrict m, const size_t sz)
+{
+    const size_t offset = m->pos & m->pgalign;
+    const size_t tail = m->pos - offset;  /* partial page at end of data */
+    size_t bsz = MCDB_MAKE_WBUF_SZ;
+    char *buf;
+
+    if (sz - offset > bsz) {
+        if (sz - offset > SIZE_MAX - ~m->pgalign) { errno=ENOMEM; return false; }
+        bsz = (sz - offset + ~m->pgalign) & m->pgalign;
+    }
+
+    if (m->io_buf) {
+        if (!mcdb_wbuf_write(m, offset))
+            return false;
+        if (bsz <= m->msz) {
+            memmove(m->map, m->map + (offset - m->offset), tail);
+            m->offset = offset;
+            return true;
+        }
+    }
+
+    buf = (char *)mmap(0, bsz, PROT_READ|PROT_WRITE,
+                       MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED)
+        return false;
+    if (m->io_buf) {  /* grow buffer */
+        memcpy(buf, m->map + (offset - m->offset), tail);
+        munmap(m->map, m->msz);
+    }
+    else {            /* switch from mmap window to write buffer */
+        if (m->map != MAP_FAILED && m->offset <= offset
+            && offset + tail <= m->offset + m->msz)
+            memcpy(buf, m->map + (offset - m->offset), tail);
+        else if (tail != 0) { /*(O_DIRECT, e.g. after mcdb_make_update() copy)*/
+            const size_t rlen = (m->io == MCDB_MAKE_IO_DIRECT)
+              ? (tail + ~m->pgalign) & m->pgalign
+              : tail;
+            ssize_t r;
+            do { r = pread(m->fd, buf, rlen, (off_t)offset);
+            } while (r == -1 && errno == EINTR);
+            if (r < (ssize_t)tail) {
+                munmap(buf, bsz);
+                if (r != -1) errno = EIO;
+                return false;
+            }
+        }
+        if (!mcdb_mmap_unmap(m)) {
+            munmap(buf, bsz);
+            return false;
+        }
+      #ifdef O_DIRECT
+        if (m->io == MCDB_MAKE_IO_DIRECT) { /*(continue buffered if EINVAL)*/
+            const int fl = fcntl(m->fd, F_GETFL);
+            if (fl != -1 && !(fl & O_DIRECT))
+                (void)fcntl(m->fd, F_SETFL, fl | O_DIRECT);
+        }
+      #endif
+    }
+    m->map    = buf;
+    m->msz    = bsz;
+    m->offset = offset;
+    m->io_buf = 1;
+    return true;
+}
+
+/* write out buffer and revert to mmap windows (m->io = MCDB_MAKE_IO_MMAP) */
+__attribute_noinline__
+static bool
+mcdb_wbuf_finish(struct mcdb_make * const restrict m)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
 __attribute_noinline__
 static bool
 mcdb_mmap_upsize(struct mcdb_make * const restrict m, const size_t sz,
@@ -267,6 +640,9 @@ mcdb_mmap_upsize(struct mcdb_make * const restrict m, const size_t sz,
     if (sz > (UINT_MAX & m->pgalign)) { errno = EOVERFLOW; return false; }
   #endif
 
+    if (m->io != MCDB_MAKE_IO_MMAP && m->fd != -1)
+        return mcdb_wbuf_upsize(m, sz);
+
     msz = (MCDB_MMAP_SZ > sz - offset)
       ? MCDB_MMAP_SZ
       : (sz - offset + ~m->pgalign) & m->pgalign;
@@ -281,43 +657,16 @@ mcdb_mmap_upsize(struct mcdb_make * const restrict m, const size_t sz,
         m->fsz = (m->offset != 0)
           ? ((offset + msz + (MCDB_BLOCK_SZ-1)) & ~(size_t)(MCDB_BLOCK_SZ-1))
           : ((offset + msz + (MCDB_MMAP_SZ-1))  & ~(size_t)(MCDB_MMAP_SZ-1));
-      #if defined(__GLIBC__)/* glibc emulates if not natively supported by fs */
-        if ((errno = posix_fallocate(m->fd, (off_t)m->osz,
-                                     (off_t)(m->fsz-m->osz))) == 0)
-      #elif defined(__SunOS_5_11)/*not sure about Solaris 11; not tested by me*/
-        /* disabled for defined(_AIX) since mcdb_make_fallocate() is faster
-         * and because posix_fallocate() in 32-bit can result in SIGSEGV.
-         * Observed on AIX TL6 SP3: posix_fallocate() fails on initial resize
-         * and mcdb_make_fallocate() succeeds, but then posix_fallocate()
-         * returns 0 on second call to extend file, but later access invalid.
-         * Prior issues others had with posix_fallocate() on AIX:
-         * http://thr3ads.net/dovecot/2009/07/1089409-AIX-and-posix_fallocate
-         * https://www-304.ibm.com/support/docview.wss?uid=isg1IZ46957 */
-        /*defined(_AIX)*//*AIX errno=ENOTSUP if not natively supported by fs*/
-        if ((errno = posix_fallocate(m->fd, (off_t)m->osz,
-                                     (off_t)(m->fsz-m->osz))) == 0
-            || (errno != ENOSPC
-                && (errno = mcdb_make_fallocate(m->fd, (off_t)m->osz,
-                                                (off_t)(m->fsz-m->osz))) == 0))
-      #else /*emulate posix_fallocate() on earlier __sun, on __hpux and others*/
-        if ((errno = mcdb_make_fallocate(m->fd, (off_t)m->osz,
-                                         (off_t)(m->fsz-m->osz))) == 0)
-      #endif
+        if ((errno = mcdb_make_preallocate(m->fd, (off_t)m->osz,
+                                           (off_t)(m->fsz-m->osz))) == 0)
             m->osz = m->fsz;
         else
             return false;
     }
 
     /* flush and munmap prior mmap */
-    if (m->map != MAP_FAILED) {
-        if ((  -1 == m->fd     /*(m->fd==-1 during some large mcdb size tests)*/
-             || 0 == m->pos - m->offset   /*(avoid 0-sized msync; portability)*/
-             || 0 == msync(m->map, m->pos - m->offset, MS_ASYNC))
-            &&  0 == munmap(m->map, m->msz))
-            m->map = MAP_FAILED;
-        else
-            return false;
-    }
+    if (!mcdb_mmap_unmap(m))
+        return false;
 
     /* (compilation with large file support enables off_t max > 2 GB in cast) */
     m->map = (m->fd != -1) /* (m->fd == -1 during some large mcdb size tests) */
@@ -331,133 +680,1899 @@ mcdb_mmap_upsize(struct mcdb_make * const restrict m, const size_t sz,
     return true;
 }
 
-int
-mcdb_make_addbegin(struct mcdb_make * const restrict m,
-                   const size_t keylen, const size_t datalen)
+__attribute_noinline__
+static bool
+mcdb_wbuf_finish(struct mcdb_make * const restrict m)
 {
-    /* validate/allocate space for next key/data pair */
-    char *p;
-    const size_t pos = m->pos;
-    const size_t len = 8 + keylen + datalen;/* arbitrary ~2 GB limit for lens */
-    if (m->map == MAP_FAILED && m->fd != -1)  return mcdb_make_err(NULL,EPERM);
-    if (m->hp.l== ~0 && !mcdb_hplist_alloc(m))return mcdb_make_err(NULL,errno);
-    m->hp.p = pos;
-    m->hp.h = m->hash_init;
-    if (keylen>INT_MAX-8 || datalen>INT_MAX-8)return mcdb_make_err(NULL,EINVAL);
-    m->hp.l = (uint32_t)keylen;
-  #if !defined(_LP64) && !defined(__LP64__)  /* (no 4 GB limit in 64-bit) */
-    if (pos > UINT_MAX-len)                   return mcdb_make_err(NULL,ENOMEM);
+    if (!m->io_buf) {
+        m->io = MCDB_MAKE_IO_MMAP;
+        return true;
+    }
+    if (!mcdb_mmap_unmap(m))
+        return false;
+    m->io = MCDB_MAKE_IO_MMAP;
+  #ifdef O_DIRECT
+    {   /*(header is written with write() in mcdb_mmap_commit())*/
+        const int fl = fcntl(m->fd, F_GETFL);
+        if (fl != -1 && (fl & O_DIRECT))
+            (void)fcntl(m->fd, F_SETFL, fl & ~O_DIRECT);
+    }
   #endif
-    if (m->offset+m->msz < pos+len && !mcdb_mmap_upsize(m, pos+len, true))
-                                              return mcdb_make_err(NULL,errno);
-    p = m->map + pos - m->offset;
-    uint32_strpack_bigendian_macro(p,keylen);
-    uint32_strpack_bigendian_macro(p+4,datalen);
-    m->pos += 8;
-    return 0;
+    return mcdb_mmap_upsize(m, m->pos, true);
 }
 
-void  inline
-mcdb_make_addbuf_data(struct mcdb_make * const restrict m,
-                      const char * const restrict buf, const size_t len)
-{
-    /* len validated in mcdb_make_addbegin(); passing any other len is wrong,
-     * unless the len is shorter from partial contents of buf. */
-    memcpy(m->map + m->pos - m->offset, buf, len);
-    m->pos += len;
-}
+/* hash table elements are bigendian, or host byte order if m->index_native
+ * (MCDB_FMT_INDEX_LE) (see mcdb.h) (le must be false if !MCDB_HOST_LE) */
+#define mcdb_idx_pack32(le,s,u) \
+  ((le) ? (void)(*(uint32_t *)(s) = (u)) \
+        : (void)uint32_strpack_bigendian_aligned_macro((s),(u)))
+#define mcdb_idx_pack64(le,s,u) \
+  ((le) ? (void)(*(uint64_t *)(s) = (u)) \
+        : (void)uint64_strpack_bigendian_aligned_macro((s),(u)))
 
-void  inline
-mcdb_make_addbuf_key(struct mcdb_make * const restrict m,
-                     const char * const restrict buf, const size_t len)
+/* fill sz bytes with c (space need not already be mapped) */
+static bool
+mcdb_make_fill(struct mcdb_make * const restrict m, const size_t sz,
+               const int c)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdb_make_fill(struct mcdb_make * const restrict m, const size_t sz,
+               const int c)
 {
-    /* len validated in mcdb_make_addbegin(); passing any other len is wrong,
-     * unless the len is shorter from partial contents of buf. */
-    m->hp.h = (m->hash_fn == uint32_hash_djb)
-      ? uint32_hash_djb(m->hp.h, buf, len)
-      : m->hash_fn(m->hp.h, buf, len);
-    mcdb_make_addbuf_data(m, buf, len);
+  #if !defined(_LP64) && !defined(__LP64__)
+    if (sz > UINT_MAX - m->pos) { errno = ENOMEM; return false; }
+  #endif
+    if (m->offset+m->msz < m->pos+sz && !mcdb_mmap_upsize(m, m->pos+sz, false))
+        return false;
+    memset(m->map + m->pos - m->offset, c, sz);
+    m->pos += sz;
+    return true;
 }
 
-void  inline
-mcdb_make_addend(struct mcdb_make * const restrict m)
-{
-    /* copy hp data structure into list for hp slot mask */
-    const uint32_t slot_idx = m->hp.h & MCDB_SLOT_MASK;
-    const uint32_t i = m->head[slot_idx]->num++;
-    m->head[slot_idx]->hp[i] = m->hp;
-    ++m->count[slot_idx];
-    if (i == MCDB_HPLIST-1)
-        m->hp.l = ~0; /* set flag for mcdb_make_start() to allocate lists */
-}
+/* minimal perfect hash index (see mcdb.h) (PTHash-style, 16-bit pilots)
+ * Keys with unique khash are placed into the mphf, bucket by bucket, largest
+ * buckets first, searching for a pilot which places all keys in the bucket
+ * into free elements.  Placed keys are marked (hp->p = 0) and removed from
+ * count[] so that they are omitted from hash tables.  Keys with duplicated
+ * khash (incl. repeated keys), and keys in the (rare) bucket for which no
+ * pilot is found, remain in the hash tables. */
 
-void  inline
-mcdb_make_addrevert(struct mcdb_make * const restrict m)
-{   /* e.g. discard in-progress incremental addbuf, or immediately prior add */
-    m->pos = m->hp.p;  /* addrevert can be used up until next add or addbegin */
-}
+struct mcdb_mphf_key {
+  uint32_t h;
+  uint32_t bkt;
+  struct mcdb_hpchunk *c;  /* hash list chunk and entry index of key */
+  uint32_t j;
+};
 
-int
-mcdb_make_add(struct mcdb_make * const restrict m,
-              const char * const restrict key, const size_t keylen,
-              const char * const restrict data, const size_t datalen)
+static int
+mcdb_mphf_key_cmp(const void * const a, const void * const b)
 {
-    if (mcdb_make_addbegin(m, keylen, datalen) == 0) {
-        mcdb_make_addbuf_key(m, key, keylen);
-        mcdb_make_addbuf_data(m, data, datalen);
-        mcdb_make_addend(m);
-        return 0;
-    }
-    return -1;
+    const uint32_t x = ((const struct mcdb_mphf_key *)a)->h;
+    const uint32_t y = ((const struct mcdb_mphf_key *)b)->h;
+    return (x > y) - (x < y);
 }
 
-/* Note: it is recommended that fd be the fd returned from a call to mkstemp()
- * and that the temporary file be renamed (by the caller) upon success */
-int
-mcdb_make_start(struct mcdb_make * const restrict m, const int fd,
-                void * (*fn_malloc)(size_t), void (*fn_free)(void *))
+static void
+mcdb_make_mphf_search(struct mcdb_make * const restrict m,
+                      const struct mcdb_mphf_key * const restrict k,
+                      const uint32_t nb, const uint32_t nt, const uint32_t b,
+                      const uint32_t * const restrict bstart,
+                      const uint32_t * const restrict order,
+                      uint32_t * const restrict pos,
+                      uint64_t * const restrict taken,
+                      const uint32_t maxb, unsigned char * const restrict p)
+  __attribute_nonnull__;
+static void
+mcdb_make_mphf_search(struct mcdb_make * const restrict m,
+                      const struct mcdb_mphf_key * const restrict k,
+                      const uint32_t nb, const uint32_t nt, const uint32_t b,
+                      const uint32_t * const restrict bstart,
+                      const uint32_t * const restrict order,
+                      uint32_t * const restrict pos,
+                      uint64_t * const restrict taken,
+                      const uint32_t maxb, unsigned char * const restrict p)
 {
-    m->map       = MAP_FAILED;
-    m->pos       = MCDB_HEADER_SZ;
-    m->offset    = 0;
-    m->hash_init = UINT32_HASH_DJB_INIT;
-    m->hash_fn   = uint32_hash_djb;
-    m->fsz       = 0;
-    m->osz       = 0;
-    m->msz       = 0;
-    m->hp.p      = MCDB_HEADER_SZ;
-    m->hp.h      = 0;
-    m->hp.l      = 0;
-    m->fd        = fd;
-    m->fn_malloc = fn_malloc;
-    m->fn_free   = fn_free;
-    m->pgalign   = ~( ((size_t)plasma_sysconf_pagesize()) - 1u );
-    m->head[0]   = (struct mcdb_hplist *)
-                   fn_malloc(sizeof(struct mcdb_hplist) * MCDB_SLOTS);
-    memset(m->count, 0, MCDB_SLOTS * sizeof(uint32_t));
-    /* do not modify m->fname, m->fntmp, m->st_mode; may already have been set*/
-    /* (defer mcdb_mmap_upsize() if fd==-1 to allow caller to set custom map) */
-    if (m->head[0] != NULL
-        && (fd == -1 || mcdb_mmap_upsize(m, MCDB_MMAP_SZ, true))) {
-        for (uint32_t u = 0; u < MCDB_SLOTS; ++u) {
-            m->head[u] = m->head[0]+u;
-            m->head[u]->num  = 0;
-            m->head[u]->next = NULL;
-            m->head[u]->pend = NULL;
+    const bool le = MCDB_HOST_LE && m->index_native;
+    const unsigned char * const kmap = (b == 4) ? m->kmap : NULL; /*(klen)*/
+    unsigned char * const restrict pilots = p + MCDB_MPHF_HDRSZ;
+    unsigned char * const restrict tbl = p + mcdb_mphf_tbloff(nb);
+    uint32_t sz, bk, pilot, j, t;
+    for (sz = maxb; sz; --sz) {
+        for (bk = 0; bk < nb; ++bk) {
+            const uint32_t * const restrict ko = order + bstart[bk];
+            if (bstart[bk+1] - bstart[bk] != sz)
+                continue;
+            for (pilot = 0; pilot <= 0xFFFFu; ++pilot) {
+                for (j = 0; j < sz; ++j) {
+                    const uint64_t x = mcdb_mphf_mix(k[ko[j]].h);
+                    const uint32_t q = mcdb_mphf_pos(x, pilot, nt);
+                    if (taken[q >> 6] & (UINT64_C(1) << (q & 63)))
+                        break;
+                    for (t = 0; t < j && pos[t] != q; ++t) ;
+                    if (t != j)
+                        break;
+                    pos[j] = q;
+                }
+                if (j == sz)
+                    break;
+            }
+            if (pilot > 0xFFFFu)
+                continue;  /* keys in bucket remain in hash tables */
+            pilots[bk << 1]     = (unsigned char)(pilot >> 8);
+            pilots[(bk << 1)+1] = (unsigned char)pilot;
+            for (j = 0; j < sz; ++j) {
+                struct mcdb_hp e;
+                const struct mcdb_hp * const restrict hp = &e;
+                unsigned char * const restrict q = tbl+((uintptr_t)pos[j] << b);
+                taken[pos[j] >> 6] |= (UINT64_C(1) << (pos[j] & 63));
+                mcdb_hpchunk_get(k[ko[j]].c, k[ko[j]].j, kmap, &e);
+                mcdb_idx_pack32(le,q, hp->h);  /*khash*/
+                if (b == 3)
+                    mcdb_idx_pack32(le,q+4,(uint32_t)hp->p);
+                else {
+                    mcdb_idx_pack32(le,q+4, hp->l);/*klen*/
+                    mcdb_idx_pack64(le,q+8,(uint64_t)hp->p);
+                }
+                --m->count[hp->h & MCDB_SLOT_MASK];
+                /*(mark key placed in mphf; omit from hash tables)*/
+                mcdb_hpchunk_mark(k[ko[j]].c, k[ko[j]].j);
+            }
         }
-        return 0;
-    }
-    else {
-        mcdb_make_destroy(m);
-        return -1;
     }
 }
 
-int
-mcdb_make_finish(struct mcdb_make * const restrict m)
+__attribute_noinline__
+static bool
+mcdb_make_mphf(struct mcdb_make * const restrict m, const uint32_t nrec,
+               uint64_t * const restrict off, uint64_t * const restrict sz,
+               uint32_t * const restrict param)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static bool
+mcdb_make_mphf(struct mcdb_make * const restrict m, const uint32_t nrec,
+               uint64_t * const restrict off, uint64_t * const restrict sz,
+               uint32_t * const restrict param)
 {
-    /* Current code below effectively limits mcdb to approx 2 billion entries.
-     * (256 million when compiled 32-bit, in order to keep hash table in memory,
+    const uint32_t b = (m->pos < UINT_MAX) ? 3u : 4u; /*(all dpos < m->pos)*/
+    struct mcdb_mphf_key * restrict k;
+    uint64_t *taken;
+    uint32_t *bstart;
+    uint32_t n = 0, nb, nt, maxb = 0, i, j;
+    uint64_t asz;
+    bool rc;
+
+    *sz = 0;
+    if (nrec == 0)
+        return true;
+    if ((uint64_t)nrec * sizeof(*k) > SIZE_MAX)
+        return (errno = ENOMEM, false);
+    k = (struct mcdb_mphf_key *)m->fn_malloc((size_t)nrec * sizeof(*k));
+    if (k == NULL)
+        return false;
+    for (i = 0; i < MCDB_SLOTS; ++i) {
+        struct mcdb_hpchunk *c;
+        for (size_t x = m->head[i]; x; x = c->next) {
+            c = mcdb_hpchunk(m, x);
+            for (j = 0; j < c->num; ++j) {
+                struct mcdb_hp hp;
+                mcdb_hpchunk_get(c, j, NULL, &hp);
+                if (!hp.p) continue;  /*(duplicate key dropped)*/
+                k[n].h = hp.h;
+                k[n].c = c;
+                k[n].j = j;
+                ++n;
+            }
+        }
+    }
+
+    /* keep only keys with unique khash */
+    qsort(k, n, sizeof(*k), mcdb_mphf_key_cmp);
+    for (i = 0, j = 0; i < n; ) {
+        const uint32_t e = i;
+        while (++i < n && k[i].h == k[e].h) ;
+        if (i == e + 1)
+            k[j++] = k[e];
+    }
+    n = j;
+    if (n == 0) {
+        m->fn_free(k);
+        return true;
+    }
+
+    /* ~5 keys per bucket (16-bit pilot: ~3.2 bits per key); ~97% load */
+    nb = n / 5 + 1;
+    nt = n + (n >> 5) + 1;
+
+    /* (taken bitmap, bucket start offsets (nb+2), key order, pilot search) */
+    asz = (((uint64_t)nt + 63) >> 6) * 8
+        + ((uint64_t)nb + 2 + n + n) * sizeof(uint32_t);
+    if (asz > SIZE_MAX
+        || (taken = (uint64_t *)m->fn_malloc((size_t)asz)) == NULL) {
+        m->fn_free(k);
+        if (asz > SIZE_MAX) errno = ENOMEM;
+        return false;
+    }
+    memset(taken, 0, (size_t)asz);
+    bstart = (uint32_t *)(taken + ((nt + 63) >> 6));
+
+    /* counting sort keys by bucket: keys of bucket bk are
+     * order[bstart[bk]] ... order[bstart[bk+1]-1] */
+    for (i = 0; i < n; ++i) {
+        k[i].bkt = mcdb_mphf_bkt(mcdb_mphf_mix(k[i].h), nb);
+        ++bstart[k[i].bkt+2];
+    }
+    for (i = 2; i < nb+2; ++i)
+        bstart[i] += bstart[i-1];
+    for (i = 0; i < n; ++i)
+        bstart[nb+2+(bstart[k[i].bkt+1]++)] = i;
+    for (i = 0; i < nb; ++i) {
+        if (maxb < bstart[i+1] - bstart[i])
+            maxb = bstart[i+1] - bstart[i];
+    }
+
+    *sz = mcdb_mphf_tbloff(nb) + ((uint64_t)nt << b);
+    rc = ((uint64_t)*sz <= SIZE_MAX || (errno = ENOMEM, false))
+      && mcdb_make_fill(m, (size_t)*sz, 0);
+    if (rc) {
+        unsigned char * const restrict p =
+          (unsigned char *)m->map + (m->pos - (size_t)*sz) - m->offset;
+        *off   = m->pos - *sz;
+        *param = b;
+        uint32_strpack_bigendian_aligned_macro(p,   nb);
+        uint32_strpack_bigendian_aligned_macro(p+4, nt);
+        mcdb_make_mphf_search(m, k, nb, nt, b, bstart, bstart+nb+2,
+                              bstart+nb+2+n, taken, maxb, p);
+    }
+
+    m->fn_free(taken);
+    m->fn_free(k);
+    return rc;
+}
+
+/* size of record in data section
+ * (see MCDB_FMT_VALREF and MCDB_FMT_VALZ in mcdb.h) */
+static inline size_t
+mcdb_make_reclen(const unsigned char * const restrict q)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static inline size_t
+mcdb_make_reclen(const unsigned char * const restrict q)
+{
+    const size_t klen = uint32_strunpack_bigendian_macro(q);
+    const uint32_t dlen = uint32_strunpack_bigendian_macro(q+4);
+    if (!(dlen & MCDB_DLEN_REF))
+        return 8 + klen + dlen;
+    return (q[8+klen] & 0x80) /*(MCDB_ZLEN_FLAG)*/
+      ? 8 + klen + 4 + (uint32_strunpack_bigendian_macro(q+8+klen)
+                        & ~MCDB_ZLEN_FLAG)
+      : 8 + klen + 8;
+}
+
+/* sorted key index (m->sorted) (see MCDB_SECT_SORTED in mcdb.h)
+ * Index entry for each record is sorted in memory (16 bytes per record:
+ * leading 8 key bytes and key ptr into read-only map of data section, so that
+ * most comparisons do not touch keys in map), then entries are written, with
+ * keys prefix-compressed within blocks of MCDB_SORTED_BLKN entries. */
+
+struct mcdb_sorted_key {
+  uint64_t pfx;            /* leading 8 bytes of key (bigendian; 0-padded) */
+  const unsigned char *kp; /* key (in read-only map of data section) */
+};
+
+static int
+mcdb_sorted_key_cmp(const void * const a, const void * const b)
+  __attribute_nonnull__;
+static int
+mcdb_sorted_key_cmp(const void * const a, const void * const b)
+{
+    const struct mcdb_sorted_key * const x = (const struct mcdb_sorted_key *)a;
+    const struct mcdb_sorted_key * const y = (const struct mcdb_sorted_key *)b;
+    if (x->pfx != y->pfx)
+        return x->pfx < y->pfx ? -1 : 1;
+    else {
+        const uint32_t xl = uint32_strunpack_bigendian_macro(x->kp-8);
+        const uint32_t yl = uint32_strunpack_bigendian_macro(y->kp-8);
+        const int cmp = memcmp(x->kp, y->kp, xl < yl ? xl : yl);
+        return (cmp != 0)
+          ? cmp
+          : (xl != yl)
+            ? (xl < yl ? -1 : 1)
+            : (x->kp < y->kp ? -1 : x->kp > y->kp); /*(data section order)*/
+    }
+}
+
+/* LEB128 varint (see MCDB_SECT_SORTED in mcdb.h) */
+static inline size_t
+mcdb_make_varint(char * const restrict p, uint64_t v)
+  __attribute_nonnull__;
+static inline size_t
+mcdb_make_varint(char * const restrict p, uint64_t v)
+{
+    size_t n = 0;
+    for (; v >= 0x80; v >>= 7)
+        p[n++] = (char)((v & 0x7F) | 0x80);
+    p[n++] = (char)v;
+    return n;
+}
+
+static inline size_t
+mcdb_make_varint_len(uint64_t v)
+  __attribute_warn_unused_result__;
+static inline size_t
+mcdb_make_varint_len(uint64_t v)
+{
+    size_t n = 1;
+    for (; v >= 0x80; v >>= 7)
+        ++n;
+    return n;
+}
+
+/* (dend is end of data (before end-of-data padding)) */
+__attribute_noinline__
+static bool
+mcdb_make_sorted(struct mcdb_make * const restrict m, const uint32_t nrec,
+                 const size_t dend, uint64_t * const restrict off,
+                 uint64_t * const restrict sz)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static bool
+mcdb_make_sorted(struct mcdb_make * const restrict m, const uint32_t nrec,
+                 const size_t dend, uint64_t * const restrict off,
+                 uint64_t * const restrict sz)
+{
+    const uint32_t nblk = nrec / MCDB_SORTED_BLKN
+                        + (nrec % MCDB_SORTED_BLKN != 0);
+    struct mcdb_sorted_key * restrict k;
+    const unsigned char *src;
+    const unsigned char *q;
+    size_t tot, pos, shared;
+    uint32_t i, n, klen, plen = 0;
+    char *p;
+
+    if (m->fd == -1 || dend <= MCDB_HEADER_SZ)
+        return (errno = EINVAL, false);
+  #if !defined(_LP64) && !defined(__LP64__)
+    if ((uint64_t)nrec * sizeof(*k) > SIZE_MAX)
+        return (errno = ENOMEM, false);
+  #endif
+    k = (struct mcdb_sorted_key *)
+      m->fn_malloc((size_t)(nrec ? nrec : 1) * sizeof(*k));
+    if (k == NULL)
+        return false;
+    src = (const unsigned char *)
+      mmap(0, dend, PROT_READ, MAP_SHARED, m->fd, 0);
+    if (src == MAP_FAILED) {
+        m->fn_free(k);
+        return false;
+    }
+
+    /* index entry for each record in data section */
+    for (n = 0, q = src + MCDB_HEADER_SZ; q + 8 <= src + dend; ++n) {
+        uint64_t pfx = 0;
+        klen = uint32_strunpack_bigendian_macro(q);
+        if (klen == ~0u) /*(end-of-data padding)*/
+            break;
+        if (n == nrec)
+            break;
+        for (i = 0; i < 8; ++i)
+            pfx = (pfx << 8) | (i < klen ? q[8+i] : 0);
+        k[n].pfx = pfx;
+        k[n].kp  = q + 8;
+        q += mcdb_make_reclen(q);
+    }
+    if (n != nrec || (q + 8 <= src + dend
+                      && uint32_strunpack_bigendian_macro(q) != ~0u)) {
+        munmap((void *)(uintptr_t)src, dend);
+        m->fn_free(k);
+        return (errno = EINVAL, false); /*(data section must hold nrec recs)*/
+    }
+    qsort(k, nrec, sizeof(*k), mcdb_sorted_key_cmp);
+
+    /* size of section (header, block offsets, entries) */
+    tot = mcdb_sorted_blkoff(nblk);
+    for (i = 0; i < nrec; ++i) {
+        klen = uint32_strunpack_bigendian_macro(k[i].kp-8);
+        shared = 0;
+        if (i % MCDB_SORTED_BLKN)
+            while (shared < klen && shared < plen
+                   && k[i].kp[shared] == k[i-1].kp[shared])
+                ++shared;
+        tot += mcdb_make_varint_len(shared)
+             + mcdb_make_varint_len(klen - shared)
+             + mcdb_make_varint_len((uint64_t)(k[i].kp - 8 - src))
+             + (klen - shared);
+        plen = klen;
+    }
+    tot = (tot + MCDB_PAD_MASK) & ~(size_t)MCDB_PAD_MASK;
+
+    /* write section */
+    if (!mcdb_make_fill(m, tot, 0)) {
+        munmap((void *)(uintptr_t)src, dend);
+        m->fn_free(k);
+        return false;
+    }
+    *sz  = tot;
+    *off = m->pos - tot;
+    p = m->map + *off - m->offset;
+    uint32_strpack_bigendian_aligned_macro(p,   nrec);
+    uint32_strpack_bigendian_aligned_macro(p+4, nblk);
+    pos = mcdb_sorted_blkoff(nblk);
+    for (i = 0; i < nrec; ++i) {
+        klen = uint32_strunpack_bigendian_macro(k[i].kp-8);
+        shared = 0;
+        if (i % MCDB_SORTED_BLKN)
+            while (shared < klen && shared < plen
+                   && k[i].kp[shared] == k[i-1].kp[shared])
+                ++shared;
+        else
+            uint64_strpack_bigendian_aligned_macro(
+              p + MCDB_SORTED_HDRSZ + ((size_t)(i / MCDB_SORTED_BLKN) << 3),
+              (uint64_t)pos);
+        pos += mcdb_make_varint(p+pos, shared);
+        pos += mcdb_make_varint(p+pos, klen - shared);
+        pos += mcdb_make_varint(p+pos, (uint64_t)(k[i].kp - 8 - src));
+        memcpy(p+pos, k[i].kp+shared, klen - shared);
+        pos += klen - shared;
+        plen = klen;
+    }
+
+    munmap((void *)(uintptr_t)src, dend);
+    m->fn_free(k);
+    return true;
+}
+
+/* write sections and section directory between end of data and hash tables
+ * (see mcdb.h for description; section data is bigendian)
+ * (m->pos is end of data, aligned to MCDB_PAD_ALIGN)
+ * (checksums section is reserved here and filled in by mcdb_make_cksum()) */
+__attribute_noinline__
+static bool
+mcdb_make_sections(struct mcdb_make * const restrict m, const uint32_t nrec,
+                   uint64_t * const restrict sectdir,
+                   uint64_t * const restrict cksum,
+                   uint32_t * const restrict fmt)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static bool
+mcdb_make_sections(struct mcdb_make * const restrict m, const uint32_t nrec,
+                   uint64_t * const restrict sectdir,
+                   uint64_t * const restrict cksum,
+                   uint32_t * const restrict fmt)
+{
+    enum { MCDB_SECT_MAX = 8 };
+    uint32_t type[MCDB_SECT_MAX];
+    uint32_t param[MCDB_SECT_MAX];
+    uint64_t off[MCDB_SECT_MAX];
+    uint64_t sz[MCDB_SECT_MAX];
+    uint32_t n = 0;
+    uint32_t i;
+    char *p;
+    const size_t dend = m->pos;
+
+    /* end-of-data padding (uint32_t ~0 stops mcdb_iter() at end of data) */
+    if (!mcdb_make_fill(m, MCDB_PAD_ALIGN, ~0))
+        return false;
+
+    if (m->bloom_bits) {
+        /* blocked bloom filter; k bits per key, all within one 64-byte block */
+        uint32_t k = (m->bloom_bits * 11) >> 4;   /*(approx bits * ln 2)*/
+        uint64_t nblk = ((uint64_t)nrec * m->bloom_bits + 511) >> 9;
+        if (k == 0) k = 1;
+        if (k > 7)  k = 7;
+        if (nblk == 0) nblk = 1;
+        if (nblk > UINT_MAX) { errno = EINVAL; return false; }
+        if (!mcdb_make_fill(m, (MCDB_BLOOM_BLKSZ - (m->pos & (MCDB_BLOOM_BLKSZ-1)))
+                                 & (MCDB_BLOOM_BLKSZ-1), ~0)
+            || !mcdb_make_fill(m, (size_t)nblk * MCDB_BLOOM_BLKSZ, 0))
+            return false;
+        type[n]  = MCDB_SECT_BLOOM;
+        param[n] = k;
+        sz[n]    = nblk * MCDB_BLOOM_BLKSZ;
+        off[n]   = m->pos - sz[n];
+        p = m->map + off[n] - m->offset;
+        for (i = 0; i < MCDB_SLOTS; ++i) {
+            struct mcdb_hpiter it;
+            struct mcdb_hp hp;
+            mcdb_hpiter_init(&it, m, i, NULL);
+            while (mcdb_hpiter_next(&it, &hp)) {
+                uint64_t h = mcdb_bloom_mix(hp.h);
+                unsigned char * const restrict blk = (unsigned char *)
+                  p + mcdb_bloom_blk(h, nblk) * MCDB_BLOOM_BLKSZ;
+                h = mcdb_bloom_bits(h);
+                for (uint32_t j = k; j; --j, h >>= 9)
+                    blk[(h & 511) >> 3] |= (unsigned char)(1u << (h & 7));
+            }
+        }
+        ++n;
+    }
+
+    if (m->sorted) {
+        /* sorted key index (section offset aligned to MCDB_PAD_ALIGN) */
+        if (!mcdb_make_sorted(m, nrec, dend, off+n, sz+n))
+            return false;
+        type[n]  = MCDB_SECT_SORTED;
+        param[n] = MCDB_SORTED_BLKN;
+        ++n;
+    }
+
+    if (m->mphf) {
+        /* minimal perfect hash index (after filter, which covers all keys) */
+        if (!mcdb_make_mphf(m, nrec, off+n, sz+n, param+n))
+            return false;
+        if (sz[n]) {
+            type[n] = MCDB_SECT_MPHF;
+            *fmt |= MCDB_FMT_MPHF;
+            ++n;
+        }
+    }
+
+    if (m->valz && m->zdictlen) {
+        /* preset dictionary for compressed data (padded to MCDB_PAD_ALIGN) */
+        if (!mcdb_make_fill(m, m->zdictlen, 0))
+            return false;
+        type[n]  = MCDB_SECT_ZDICT;
+        param[n] = 0;
+        sz[n]    = m->zdictlen;
+        off[n]   = m->pos - sz[n];
+        memcpy(m->map + off[n] - m->offset, m->zdict, m->zdictlen);
+        ++n;
+        if (!mcdb_make_fill(m, (MCDB_PAD_ALIGN - (m->pos & MCDB_PAD_MASK))
+                               & MCDB_PAD_MASK, 0))
+            return false;
+    }
+
+    if (m->cksum) {
+        /* integrity checksums (last section; blocks cover preceding bytes) */
+        const uint64_t end = m->pos;
+        const uint64_t nblk =
+          (end - MCDB_HEADER_SZ + (1u << MCDB_CKSUM_BLKBITS) - 1)
+          >> MCDB_CKSUM_BLKBITS;
+        if (nblk > UINT_MAX) { errno = EINVAL; return false; }
+        if (!mcdb_make_fill(m, mcdb_cksum_sz(nblk), 0))
+            return false;
+        type[n]  = MCDB_SECT_CKSUM;
+        param[n] = MCDB_CKSUM_BLKBITS;
+        sz[n]    = mcdb_cksum_sz(nblk);
+        off[n]   = end;
+        p = m->map + off[n] - m->offset;
+        uint32_strpack_bigendian_aligned_macro(p,   MCDB_CKSUM_CRC32C);
+        uint32_strpack_bigendian_aligned_macro(p+4, (uint32_t)nblk);
+        uint64_strpack_bigendian_aligned_macro(p+8, end);
+        *cksum = end;
+        ++n;
+    }
+
+    /* section directory (terminated by entry with type 0) */
+    if (!mcdb_make_fill(m, (size_t)(n+1) * MCDB_SECT_ENTSZ, 0))
+        return false;
+    *sectdir = m->pos - (size_t)(n+1) * MCDB_SECT_ENTSZ;
+    p = m->map + *sectdir - m->offset;
+    for (i = 0; i < n; ++i, p += MCDB_SECT_ENTSZ) {
+        uint32_strpack_bigendian_aligned_macro(p,    type[i]);
+        uint32_strpack_bigendian_aligned_macro(p+4,  param[i]);
+        uint64_strpack_bigendian_aligned_macro(p+8,  off[i]);
+        uint64_strpack_bigendian_aligned_macro(p+16, sz[i]);
+    }
+
+    /* padding to align hash tables to MCDB_PAD_ALIGN bytes (16) */
+    return mcdb_make_fill(m, (MCDB_PAD_ALIGN - (m->pos & MCDB_PAD_MASK))
+                             & MCDB_PAD_MASK, 0);
+}
+
+/* number of hash table elements in slot table with count keys */
+#define mcdb_make_slot_len(count, layout) \
+  ((layout) == MCDB_FMT_LAYOUT_BUCKET \
+   ? (((count) << 1) + 7) & ~7u    /* multiple of 8 elts; 64-byte buckets */ \
+   : ((count) << 1))
+
+/* generate hash table for slot, writing directly to mmap
+ * (slot tables are disjoint; may be called concurrently for distinct slots)
+ * (kmap is needed (for klen) only for bucket layout and b == 4 tables) */
+static void
+mcdb_make_slot_fill(const struct mcdb_make * const restrict m,
+                    const uint32_t slot, char * const p,
+                    const uint32_t len, const uint32_t b,
+                    const uint32_t layout, const bool le,
+                    const unsigned char * const kmap)
+  __attribute_nonnull_x__((1,3));
+static void
+mcdb_make_slot_fill(const struct mcdb_make * const restrict m,
+                    const uint32_t slot, char * const p,
+                    const uint32_t len, const uint32_t b,
+                    const uint32_t layout, const bool le,
+                    const unsigned char * const kmap)
+{
+    struct mcdb_hpiter it;
+    struct mcdb_hp e;
+    const struct mcdb_hp * const restrict hp = &e;
+    char * restrict q;
+    uint32_t u;
+    memset(p, 0, (size_t)len << b);
+    mcdb_hpiter_init(&it, m, slot, kmap);
+    if (layout == MCDB_FMT_LAYOUT_BUCKET) { /* (b == 3) */
+        /* layout in memory: 64-byte buckets of 8 elements of
+         * 4-byte (hash fragment << 16 | klen), 4-byte dpos */
+        const uint32_t nb = len >> 3;
+        while (mcdb_hpiter_next(&it, &e)) {
+            if (!hp->p) continue;  /*(placed in mphf)*/
+            q = p+4;  /*(4 is offset of dpos)*/
+            u = ((hp->h >> MCDB_SLOT_BITS) % nb) << 3;
+            /* find empty entry in open hash table (dpos == 0) */
+            while (*(uint32_t *)(q+((uintptr_t)u<<3)))
+                if (++u == len)
+                    u = 0;
+            q += (u<<3);
+            mcdb_idx_pack32(le,q-4,
+              (mcdb_bucket_frag(hp->h) << 16)
+              | (hp->l < MCDB_BUCKET_KLEN_MAX
+                 ? hp->l
+                 : MCDB_BUCKET_KLEN_MAX));                /*frag,klen*/
+            mcdb_idx_pack32(le,q,(uint32_t)hp->p);                 /*dpos*/
+        }
+    }
+    else if (layout == MCDB_FMT_LAYOUT_PACKED) { /* (b == 3) */
+        /* layout in memory: 8-byte ((khash >> 8) << 40 | 40-bit dpos),
+         * i.e. 4-byte (khash & ~0xFF | dpos >> 32), 4-byte low dpos */
+        while (mcdb_hpiter_next(&it, &e)) {
+            if (!hp->p) continue;  /*(placed in mphf)*/
+            u = (hp->h >> MCDB_SLOT_BITS) % len;
+            /* find empty entry in open hash table (element == 0) */
+            while (*(uint64_t *)(p+((uintptr_t)u<<3)))
+                if (++u == len)
+                    u = 0;
+            q = p + (u<<3);
+            mcdb_idx_pack32(le,q,
+              (hp->h & ~(uint32_t)MCDB_SLOT_MASK)
+              | (uint32_t)((uint64_t)hp->p >> 32));         /*khash,dpos*/
+            mcdb_idx_pack32(le,q+4,(uint32_t)hp->p);
+        }
+    }
+    else if (b == 3) { /* data section ends < 4 GB; use 32-bit dpos offset */
+        /* layout in memory: 4-byte khash, 4-byte dpos */
+        while (mcdb_hpiter_next(&it, &e)) {
+            if (!hp->p) continue;  /*(placed in mphf)*/
+            q = p+4;  /*(4 is offset of dpos)*/
+            u = (hp->h >> MCDB_SLOT_BITS) % len;
+            /* find empty entry in open hash table (dpos == 0) */
+            while (*(uint32_t *)(q+((uintptr_t)u<<3)))
+                if (++u == len)
+                    u = 0;
+            q += (u<<3);
+            mcdb_idx_pack32(le,q-4,hp->h); /*khash*/
+            mcdb_idx_pack32(le,q,(uint32_t)hp->p);                 /*dpos*/
+        }
+    }
+    else {/*b==4*//* data section crosses 4 GB; need 64-bit dpos offset */
+        /* layout in memory: 4-byte khash, 4-byte klen, 8-byte dpos */
+        while (mcdb_hpiter_next(&it, &e)) {
+            if (!hp->p) continue;  /*(placed in mphf)*/
+            q = p+8;  /*(8 is offset of dpos)*/
+            u = (hp->h >> MCDB_SLOT_BITS) % len;
+            /* find empty entry in open hash table (dpos == 0) */
+            while (*(uintptr_t *)(q+((uintptr_t)u<<4)))
+                if (++u == len)
+                    u = 0;
+            q += (u<<4);
+            mcdb_idx_pack32(le,q-8,hp->h); /*khash*/
+            mcdb_idx_pack32(le,q-4,hp->l); /*klen*/
+            mcdb_idx_pack64(le,q,(uint64_t)hp->p);                 /*dpos*/
+        }
+    }
+}
+
+#ifdef _THREAD_SAFE
+
+struct mcdb_make_fill_ctx {
+  const struct mcdb_make *m;
+  const char *header;
+  uint32_t b;
+  uint32_t layout;
+  bool le;
+  uint32_t next;              /* next slot to fill (shared among threads) */
+  const unsigned char *kmap;
+};
+
+static void *
+mcdb_make_fill_thread(void * const arg)
+  __attribute_nonnull__;
+static void *
+mcdb_make_fill_thread(void * const arg)
+{
+    struct mcdb_make_fill_ctx * const restrict ctx =
+      (struct mcdb_make_fill_ctx *)arg;
+    const struct mcdb_make * const restrict m = ctx->m;
+    uint32_t i;
+    while ((i = plasma_atomic_fetch_add_u32(&ctx->next, 1,
+                                            memory_order_relaxed))
+           < MCDB_SLOTS) {
+        const char * const h = ctx->header + (i << 4);
+        mcdb_make_slot_fill(m, i, m->map - m->offset
+                              + uint64_strunpack_bigendian_aligned_macro(h),
+                            uint32_strunpack_bigendian_aligned_macro(h+8),
+                            ctx->b, ctx->layout, ctx->le, ctx->kmap);
+    }
+    return NULL;
+}
+
+/* fill slot hash tables using m->nthreads threads (incl. calling thread)
+ * (hash tables for all slots must already be mapped; header hpos, hslots set)
+ * (each slot is filled by a single thread in hash list order, so output is
+ *  identical to serial fill) */
+__attribute_noinline__
+static void
+mcdb_make_fill_parallel(const struct mcdb_make * const restrict m,
+                        const char * const restrict header, const uint32_t b,
+                        const uint32_t layout, const bool le,
+                        const unsigned char * const kmap)
+  __attribute_nonnull_x__((1,2));
+__attribute_noinline__
+static void
+mcdb_make_fill_parallel(const struct mcdb_make * const restrict m,
+                        const char * const restrict header, const uint32_t b,
+                        const uint32_t layout, const bool le,
+                        const unsigned char * const kmap)
+{
+    pthread_t tid[MCDB_SLOTS];
+    struct mcdb_make_fill_ctx ctx = { m, header, b, layout, le, 0, kmap };
+    const uint32_t nthreads =
+      (m->nthreads < MCDB_SLOTS) ? m->nthreads : MCDB_SLOTS;
+    uint32_t n;
+    /* (continue with fewer threads if thread creation fails) */
+    for (n = 0; n < nthreads-1; ++n) {
+        if (pthread_create(tid+n, NULL, mcdb_make_fill_thread, &ctx) != 0)
+            break;
+    }
+    (void)mcdb_make_fill_thread(&ctx);
+    while (n)
+        pthread_join(tid[--n], NULL);
+}
+
+#endif /* _THREAD_SAFE */
+
+/* shared data (m->valshare) (see MCDB_FMT_VALREF in mcdb.h)
+ * Open hash table of earlier (distinct) copies of data, by hash of data.
+ * Entries are tombstoned (dlen = 0) if record is reverted (addrevert). */
+
+struct mcdb_valent {
+  uint64_t dpos;  /* offset of data in file (0 if empty) */
+  uint32_t h;     /* hash of data */
+  uint32_t dlen;
+};
+
+#define MCDB_VALSHARE_MIN 9 /* (reference to shared data is 8 bytes) */
+
+static bool
+mcdb_valtab_grow(struct mcdb_make * const restrict m)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdb_valtab_grow(struct mcdb_make * const restrict m)
+{
+    const struct mcdb_valent * const restrict o =
+      (const struct mcdb_valent *)m->valtab;
+    const size_t osz = m->valtabsz;
+    const size_t sz = osz ? osz << 1 : 4096;
+    struct mcdb_valent * restrict t;
+    size_t i, j, n = 0;
+    if (sz > SIZE_MAX / sizeof(*t) || sz <= osz)
+        return false;
+    t = (struct mcdb_valent *)m->fn_malloc(sz * sizeof(*t));
+    if (t == NULL)
+        return false;
+    memset(t, 0, sz * sizeof(*t));
+    for (i = 0; i < osz; ++i) {
+        if (!o[i].dlen) /*(empty or tombstone)*/
+            continue;
+        for (j = o[i].h & (sz-1); t[j].dpos; j = (j+1) & (sz-1)) ;
+        t[j] = o[i];
+        ++n;
+    }
+    if (o != NULL)
+        m->fn_free((void *)(uintptr_t)o);
+    m->valtab   = t;
+    m->valtabsz = sz;
+    m->valtabn  = n;
+    m->valtablast = 0;
+    return true;
+}
+
+/* compare len bytes of data at file offset dpos (< record at p) with p
+ * (data which precedes mmap window (or write buffer) is read from m->fd) */
+static bool
+mcdb_make_datacmp(const struct mcdb_make * const restrict m, size_t dpos,
+                  const char * restrict p, size_t len)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdb_make_datacmp(const struct mcdb_make * const restrict m, size_t dpos,
+                  const char * restrict p, size_t len)
+{
+    char buf[4096];
+    ssize_t rd;
+    while (dpos < m->offset && len) {
+        size_t n = m->offset - dpos;
+        if (n > len)         n = len;
+        if (n > sizeof(buf)) n = sizeof(buf);
+        if (m->fd == -1)
+            return false;
+        rd = pread(m->fd, buf, n, (off_t)dpos);
+        if (rd <= 0) {
+            if (rd == -1 && errno == EINTR)
+                continue;
+            return false;
+        }
+        if (0 != memcmp(buf, p, (size_t)rd))
+            return false;
+        dpos += (size_t)rd;
+        p    += rd;
+        len  -= (size_t)rd;
+    }
+    return (len == 0 || 0 == memcmp(m->map + dpos - m->offset, p, len));
+}
+
+/* share data of record at rpos (ending at m->pos, in mmap window) if identical
+ * to data of an earlier record; else add data to m->valtab.  Reference
+ * written is (dpos - adj) (adj is nonzero if gathering records elsewhere in
+ * file, e.g. mcdb_make_cluster()).  (data not shared if ENOMEM) */
+__attribute_noinline__
+static void
+mcdb_make_valshare(struct mcdb_make * const restrict m, const size_t rpos,
+                   const size_t adj)
+  __attribute_nonnull__;
+__attribute_noinline__
+static void
+mcdb_make_valshare(struct mcdb_make * const restrict m, const size_t rpos,
+                   const size_t adj)
+{
+    char * const r = m->map + rpos - m->offset;
+    const uint32_t klen = uint32_strunpack_bigendian_macro(r);
+    const uint32_t dlen = uint32_strunpack_bigendian_macro(r+4);
+    char * const d = r + 8 + klen;
+    struct mcdb_valent * restrict t;
+    size_t i, mask;
+    uint32_t h;
+    m->valtablast = 0;
+    if (dlen < MCDB_VALSHARE_MIN || (dlen & MCDB_DLEN_REF)) /*(or compressed)*/
+        return;
+    if (m->valtabn >= (m->valtabsz >> 1) && !mcdb_valtab_grow(m))
+        return;
+    h = uint32_hash_fast(UINT32_HASH_FAST_INIT, d, dlen);
+    t = (struct mcdb_valent *)m->valtab;
+    mask = m->valtabsz - 1;
+    for (i = h & mask; t[i].dpos; i = (i+1) & mask) {
+        if (t[i].h == h && t[i].dlen == dlen
+            && mcdb_make_datacmp(m, (size_t)t[i].dpos, d, dlen)) {
+            const uint64_t dpos = t[i].dpos - adj;
+            uint32_strpack_bigendian_macro(r+4, dlen | MCDB_DLEN_REF);
+            uint32_strpack_bigendian_macro(d,   (uint32_t)(dpos >> 32));
+            uint32_strpack_bigendian_macro(d+4, (uint32_t)dpos);
+            m->pos = rpos + 8 + klen + 8;
+            m->valref = 1;
+            return;
+        }
+    }
+    t[i].dpos = rpos + 8 + klen;
+    t[i].h    = h;
+    t[i].dlen = dlen;
+    ++m->valtabn;
+    m->valtablast = i + 1;
+}
+
+/* tombstone m->valtab entry for data of reverted record */
+__attribute_noinline__
+static void
+mcdb_make_valrevert(struct mcdb_make * const restrict m)
+  __attribute_nonnull__;
+__attribute_noinline__
+static void
+mcdb_make_valrevert(struct mcdb_make * const restrict m)
+{
+    struct mcdb_valent * const restrict t = (struct mcdb_valent *)m->valtab;
+    if (m->valtablast && t[m->valtablast-1].dpos >= m->hp.p)
+        t[m->valtablast-1].dlen = 0;
+    m->valtablast = 0;
+}
+
+/* compressed data (m->compress) (see MCDB_FMT_VALZ in mcdb.h)
+ * Compress data of record at rpos (ending at m->pos, in mmap window) in place
+ * if compressed data (plus 4-byte zlen) is smaller.  Deflate stream (and
+ * preset dictionary) is reset for each record, so that each record is
+ * decompressed independently.  (data not compressed if ENOMEM) */
+#ifdef MCDB_ZLIB
+__attribute_noinline__
+static void
+mcdb_make_zdata(struct mcdb_make * const restrict m, const size_t rpos)
+  __attribute_nonnull__;
+__attribute_noinline__
+static void
+mcdb_make_zdata(struct mcdb_make * const restrict m, const size_t rpos)
+{
+    char * const r = m->map + rpos - m->offset;
+    const uint32_t klen = uint32_strunpack_bigendian_macro(r);
+    const uint32_t dlen = uint32_strunpack_bigendian_macro(r+4);
+    char * const d = r + 8 + klen;
+    z_stream * restrict z = (z_stream *)m->zstrm;
+    uint32_t zlen;
+    if (dlen < MCDB_COMPRESS_MIN || m->compress > 9
+        || m->zdictlen > MCDB_ZDICT_MAX) /*(invalid; finish fails EINVAL)*/
+        return;
+    if (z == NULL) {
+        z = (z_stream *)m->fn_malloc(sizeof(z_stream));
+        if (z == NULL)
+            return;
+        memset(z, 0, sizeof(z_stream));
+        if (deflateInit2(z, (int)m->compress, Z_DEFLATED, -MAX_WBITS, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK) { /*(raw deflate)*/
+            m->fn_free(z);
+            return;
+        }
+        m->zstrm = z;
+    }
+    else if (deflateReset(z) != Z_OK)
+        return;
+    if (m->zdictlen
+        && deflateSetDictionary(z, (const Bytef *)m->zdict,
+                                (uInt)m->zdictlen) != Z_OK)
+        return;
+    if (m->zbufsz < dlen) {
+        size_t sz = m->zbufsz ? m->zbufsz : 4096;
+        while (sz < dlen)
+            sz <<= 1;
+        if (m->zbuf != NULL)
+            m->fn_free(m->zbuf);
+        m->zbufsz = 0;
+        if ((m->zbuf = (char *)m->fn_malloc(sz)) == NULL)
+            return;
+        m->zbufsz = sz;
+    }
+    z->next_in   = (Bytef *)d;
+    z->avail_in  = dlen;
+    z->next_out  = (Bytef *)m->zbuf;
+    z->avail_out = dlen - 5;  /*(zlen + 4 < dlen)*/
+    if (deflate(z, Z_FINISH) != Z_STREAM_END) /*(else not smaller)*/
+        return;
+    zlen = dlen - 5 - z->avail_out;
+    uint32_strpack_bigendian_macro(r+4, dlen | MCDB_DLEN_REF);
+    uint32_strpack_bigendian_macro(d, zlen | MCDB_ZLEN_FLAG);
+    memcpy(d+4, m->zbuf, zlen);
+    m->pos = rpos + 8 + klen + 4 + zlen;
+    m->valz = 1;
+}
+#else
+#define mcdb_make_zdata(m,rpos) (void)0  /*(mcdb_make_finish() fails ENOTSUP)*/
+#endif
+
+/* tombstone (see MCDB_DPOS_TOMBSTONE in mcdb.h)
+ * Rewrite record at rpos (in mmap window) as tombstone: dlen 0|MCDB_DLEN_REF
+ * and 8-byte dpos 0 (space for which is reserved by mcdb_make_addbegin()) */
+__attribute_noinline__
+static void
+mcdb_make_tombstone(struct mcdb_make * const restrict m, const size_t rpos)
+  __attribute_nonnull__;
+__attribute_noinline__
+static void
+mcdb_make_tombstone(struct mcdb_make * const restrict m, const size_t rpos)
+{
+    char * const r = m->map + rpos - m->offset;
+    const uint32_t klen = uint32_strunpack_bigendian_macro(r);
+    uint32_strpack_bigendian_macro(r+4, 0 | MCDB_DLEN_REF);
+    memset(r + 8 + klen, 0, 8);  /*(MCDB_DPOS_TOMBSTONE)*/
+    m->pos = rpos + 8 + klen + 8;
+    m->valref = 1;
+    m->valtablast = 0;
+}
+
+/* true if data of record at rpos (in mmap window) is m->tombstone */
+__attribute_noinline__
+static bool
+mcdb_make_tombstone_data(const struct mcdb_make * const restrict m,
+                         const size_t rpos)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static bool
+mcdb_make_tombstone_data(const struct mcdb_make * const restrict m,
+                         const size_t rpos)
+{
+    const char * const r = m->map + rpos - m->offset;
+    const uint32_t klen = uint32_strunpack_bigendian_macro(r);
+    return uint32_strunpack_bigendian_macro(r+4) == m->tombstonelen
+        && 0 == memcmp(r + 8 + klen, m->tombstone, m->tombstonelen);
+}
+
+int
+mcdb_make_addbegin(struct mcdb_make * const restrict m,
+                   const size_t keylen, const size_t datalen)
+{
+    /* validate/allocate space for next key/data pair */
+    char *p;
+    const size_t pos = m->pos;
+    const size_t len = 8 + keylen + datalen;/* arbitrary ~2 GB limit for lens */
+    const size_t rsv = (m->tombstone != NULL) ? 8 : 0; /*(tombstone dpos)*/
+    if (m->map == MAP_FAILED && m->fd != -1)  return mcdb_make_err(NULL,EPERM);
+    if (__builtin_expect( (pos > UINT_MAX && !m->hpwide), 0)) {
+        if (!mcdb_hplist_widen(m))            return mcdb_make_err(NULL,errno);
+    }
+    else if (m->hp.l == ~0 && !mcdb_hplist_alloc(m))
+                                              return mcdb_make_err(NULL,errno);
+    m->hp.p = pos;
+    m->hp.h = m->hash_init;
+    if (keylen>INT_MAX-8 || datalen>INT_MAX-8)return mcdb_make_err(NULL,EINVAL);
+    m->hp.l = (uint32_t)keylen;
+  #if !defined(_LP64) && !defined(__LP64__)  /* (no 4 GB limit in 64-bit) */
+    if (pos > UINT_MAX-len-rsv)               return mcdb_make_err(NULL,ENOMEM);
+  #endif
+    if (m->offset+m->msz < pos+len+rsv
+        && !mcdb_mmap_upsize(m, pos+len+rsv, true))
+                                              return mcdb_make_err(NULL,errno);
+    p = m->map + pos - m->offset;
+    uint32_strpack_bigendian_macro(p,keylen);
+    uint32_strpack_bigendian_macro(p+4,datalen);
+    m->pos += 8;
+    return 0;
+}
+
+void  inline
+mcdb_make_addbuf_data(struct mcdb_make * const restrict m,
+                      const char * const restrict buf, const size_t len)
+{
+    /* len validated in mcdb_make_addbegin(); passing any other len is wrong,
+     * unless the len is shorter from partial contents of buf. */
+    memcpy(m->map + m->pos - m->offset, buf, len);
+    m->pos += len;
+}
+
+void  inline
+mcdb_make_addbuf_key(struct mcdb_make * const restrict m,
+                     const char * const restrict buf, const size_t len)
+{
+    /* len validated in mcdb_make_addbegin(); passing any other len is wrong,
+     * unless the len is shorter from partial contents of buf. */
+    if (m->hash_fn == uint32_hash_djb)
+        m->hp.h = uint32_hash_djb(m->hp.h, buf, len);
+    else if (m->hash_fn != uint32_hash_fast)/*(fast hash deferred to addend)*/
+        m->hp.h = m->hash_fn(m->hp.h, buf, len);
+    mcdb_make_addbuf_data(m, buf, len);
+}
+
+/* copy hp data structure into list for hp slot mask */
+static inline void
+mcdb_make_hpadd(struct mcdb_make * const restrict m)
+  __attribute_nonnull__;
+static inline void
+mcdb_make_hpadd(struct mcdb_make * const restrict m)
+{
+    uint32_t slot_idx;
+    uint32_t i;
+    struct mcdb_hpchunk * restrict c;
+    slot_idx = m->hp.h & MCDB_SLOT_MASK;
+    c = mcdb_hpchunk(m, m->head[slot_idx]);
+    i = c->num++;
+    if (c->wide)
+        ((struct mcdb_hp *)(c+1))[i] = m->hp;
+    else {
+        struct mcdb_hpc * const restrict e = ((struct mcdb_hpc *)(c+1)) + i;
+        e->p = (uint32_t)m->hp.p;
+        e->h = m->hp.h;
+    }
+    ++m->count[slot_idx];
+    if (i == MCDB_HPCHUNK_N(c->wide)-1)
+        m->hp.l = ~0; /* set flag for mcdb_make_addbegin() to allocate chunk */
+}
+
+void  inline
+mcdb_make_addend(struct mcdb_make * const restrict m)
+{
+    if (m->hash_fn == uint32_hash_fast) /* hash full key (contiguous in map) */
+        m->hp.h = uint32_hash_fast(m->hash_init,
+                                   m->map + m->hp.p + 8 - m->offset, m->hp.l);
+    if (__builtin_expect( (m->tombstone != NULL), 0)
+        && mcdb_make_tombstone_data(m, m->hp.p))
+        mcdb_make_tombstone(m, m->hp.p); /*(not compressed or shared)*/
+    else {
+        if (__builtin_expect( (m->compress != 0), 0))
+            mcdb_make_zdata(m, m->hp.p);
+        if (__builtin_expect( (m->valshare != 0), 0))
+            mcdb_make_valshare(m, m->hp.p, 0);
+    }
+    mcdb_make_hpadd(m);
+}
+
+void  inline
+mcdb_make_addrevert(struct mcdb_make * const restrict m)
+{   /* e.g. discard in-progress incremental addbuf, or immediately prior add */
+    m->pos = m->hp.p;  /* addrevert can be used up until next add or addbegin */
+    if (__builtin_expect( (m->valtablast != 0), 0))
+        mcdb_make_valrevert(m);
+}
+
+int
+mcdb_make_add(struct mcdb_make * const restrict m,
+              const char * const restrict key, const size_t keylen,
+              const char * const restrict data, const size_t datalen)
+{
+    if (mcdb_make_addbegin(m, keylen, datalen) == 0) {
+        mcdb_make_addbuf_key(m, key, keylen);
+        mcdb_make_addbuf_data(m, data, datalen);
+        mcdb_make_addend(m);
+        return 0;
+    }
+    return -1;
+}
+
+int
+mcdb_make_add_tombstone(struct mcdb_make * const restrict m,
+                        const char * const restrict key, const size_t keylen)
+{
+    if (mcdb_make_addbegin(m, keylen, 8) == 0) {
+        mcdb_make_addbuf_key(m, key, keylen);
+        if (m->hash_fn == uint32_hash_fast)
+            m->hp.h = uint32_hash_fast(m->hash_init,
+                                       m->map + m->hp.p + 8 - m->offset,
+                                       m->hp.l);
+        mcdb_make_tombstone(m, m->hp.p);
+        mcdb_make_hpadd(m);
+        return 0;
+    }
+    return -1;
+}
+
+/* incremental rebuild from existing mcdb plus keyed delta (see mcdb_make.h)
+ * Runs of records kept from old mcdb are appended as a block, with hash list
+ * entries added from keys in old mcdb mmap (only the index is rebuilt).
+ * Large runs are copied with copy_file_range() on Linux, so that the kernel
+ * may copy in-kernel or share extents (reflink) on filesystems supporting it,
+ * else are copied from old mcdb mmap. */
+
+#define MCDB_UPDATE_COPY_MIN 65536  /* min run size to copy_file_range() */
+
+/* true if records of key in old mcdb are replaced or deleted by delta */
+static bool
+mcdb_make_update_drop(struct mcdb * const restrict delta,
+                      const char * const restrict key, const size_t klen)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdb_make_update_drop(struct mcdb * const restrict delta,
+                      const char * const restrict key, const size_t klen)
+{
+    if (mcdb_find(delta, key, klen)) {
+        do {
+            if (mcdb_datalen(delta) != 0
+                && (*mcdb_dataptr(delta) == '=' || *mcdb_dataptr(delta) == '-'))
+                return true;
+        } while (mcdb_findnext(delta, key, klen));
+    }
+    return false;
+}
+
+/* open old mcdb file for copy_file_range() (-1 if not same file as mmap) */
+static int
+mcdb_make_update_srcfd(const struct mcdb_mmap * const restrict map)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdb_make_update_srcfd(const struct mcdb_mmap * const restrict map)
+{
+  #if defined(__linux__) && defined(__GLIBC__) \
+   && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+    struct stat st;
+    const int fd = (map->dfd != -1)
+      ? nointr_openat(map->dfd, map->fname, O_RDONLY|O_CLOEXEC, 0)
+      : nointr_open(map->fname, O_RDONLY|O_CLOEXEC, 0);
+    if (fd != -1
+        && (fstat(fd, &st) != 0
+            || (uintptr_t)st.st_size != map->size || st.st_mtime != map->mtime)){
+        (void) nointr_close(fd);  /*(file replaced since mmap; do not use)*/
+        return -1;
+    }
+    return fd;
+  #else
+    (void)map;
+    return -1;
+  #endif
+}
+
+/* append run of len bytes of records at src (in old mcdb mmap at soff) */
+__attribute_noinline__
+static bool
+mcdb_make_update_run(struct mcdb_make * const restrict m,
+                     const unsigned char * const restrict src,
+                     const size_t len, const int sfd, const off_t soff)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static bool
+mcdb_make_update_run(struct mcdb_make * const restrict m,
+                     const unsigned char * const restrict src,
+                     const size_t len, const int sfd, const off_t soff)
+{
+    const size_t pos = m->pos;
+    size_t off = 0;
+
+  #if !defined(_LP64) && !defined(__LP64__)  /* (no 4 GB limit in 64-bit) */
+    if (pos > UINT_MAX-len)                  return (errno = ENOMEM, false);
+  #endif
+
+    /* add hash list entries for records in run (hash keys in old mcdb) */
+    for (const unsigned char *q = src; q < src+len; ) {
+        const uint32_t klen = uint32_strunpack_bigendian_macro(q);
+        if (__builtin_expect( (pos+(size_t)(q-src) > UINT_MAX && !m->hpwide), 0)){
+            if (!mcdb_hplist_widen(m))
+                return false;
+        }
+        else if (m->hp.l == ~0 && !mcdb_hplist_alloc(m))
+            return false;
+        m->hp.p = pos + (size_t)(q - src);
+        m->hp.h = m->hash_fn(m->hash_init, q+8, klen);
+        m->hp.l = klen;
+        mcdb_make_hpadd(m);
+        q += mcdb_make_reclen(q);
+    }
+
+  #if defined(__linux__) && defined(__GLIBC__) \
+   && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+    /* copy run in kernel (m mmap is flushed and unmapped; remapped below) */
+    if (sfd != -1 && m->fd != -1 && len >= MCDB_UPDATE_COPY_MIN) {
+        off_t sp = soff;
+        off_t dp = (off_t)pos;
+        ssize_t r;
+        if (!mcdb_mmap_unmap(m))
+            return false;
+        while (off < len) {
+            r = copy_file_range(sfd, &sp, m->fd, &dp, len - off, 0);
+            if (r <= 0) {
+                if (r == -1 && errno == EINTR)
+                    continue;
+                if (r == 0)
+                    errno = EIO;
+                break; /*(copy remainder from mmap, e.g. EXDEV or ENOSYS)*/
+            }
+            off += (size_t)r;
+        }
+        m->pos = pos + off;
+        if (m->fsz < m->pos)
+            m->fsz = m->osz = m->pos; /*(do not preallocate over copied data)*/
+        if (!mcdb_mmap_upsize(m, m->pos + (len - off), true))
+            return false;
+    }
+  #else
+    (void)sfd;
+    (void)soff;
+  #endif
+
+    /* copy (remainder of) run from old mcdb mmap */
+    while (off < len) {
+        const size_t n = (len - off < MCDB_MMAP_SZ) ? len - off : MCDB_MMAP_SZ;
+        if (m->offset+m->msz < m->pos+n && !mcdb_mmap_upsize(m, m->pos+n, true))
+            return false;
+        memcpy(m->map + m->pos - m->offset, src + off, n);
+        off    += n;
+        m->pos += n;
+    }
+    return true;
+}
+
+int
+mcdb_make_update(struct mcdb_make * const restrict m,
+                 struct mcdb * const restrict old,
+                 struct mcdb * const restrict delta)
+{
+    struct mcdb_iter iter;
+    const unsigned char *run = NULL;
+    const unsigned char *q;
+    char *zbuf = NULL;
+    size_t zbufsz = 0;
+    /*(compressed data (MCDB_FMT_VALZ) kept as-is if same preset dictionary)*/
+    const bool zkeep = m->compress != 0
+      && m->zdictlen == old->map->zdict_sz
+      && (m->zdictlen == 0
+          || 0 == memcmp(m->zdict, old->map->zdict, m->zdictlen));
+    int sfd;
+    int rc = 0;
+
+    if (old->map->hash_fn != m->hash_fn || old->map->hash_init != m->hash_init
+        || (delta->map->fmt & MCDB_FMT_VALZ)) /*(delta op char not compressed)*/
+        return mcdb_make_err(NULL, EINVAL);
+    sfd = (m->fd != -1) ? mcdb_make_update_srcfd(old->map) : -1;
+
+    /* copy runs of records of old mcdb not replaced or deleted by delta */
+    mcdb_iter_init(&iter, old);
+    for (q = iter.ptr; rc == 0; q = iter.ptr) {
+        const bool more = mcdb_iter(&iter);
+        const bool keep = more
+          && !mcdb_make_update_drop(delta, (char *)mcdb_iter_keyptr(&iter),
+                                    mcdb_iter_keylen(&iter));
+        /*(reference to shared data (MCDB_FMT_VALREF) not valid in new mcdb)*/
+        /*(tombstone does not reference data; kept as-is)*/
+        const bool z = keep && mcdb_iter_datazlen(&iter) != 0;
+        const bool t = keep && mcdb_iter_tombstone(&iter);
+        const bool shared = keep && !(z && zkeep) && !t
+          && mcdb_iter_dataptr(&iter)
+             != mcdb_iter_keyptr(&iter) + mcdb_iter_keylen(&iter);
+        if (keep && !shared) {
+            if (run == NULL)
+                run = q;
+            m->valz |= z;
+            m->valref |= t;
+            continue;
+        }
+        if (run != NULL
+            && !mcdb_make_update_run(m, run, (size_t)(q - run), sfd,
+                                     (off_t)(run - old->map->ptr)))
+            rc = -1;
+        run = NULL;
+        if (shared && rc == 0) {
+            const char *data = (char *)mcdb_iter_dataptr(&iter);
+            if (z) { /*(decompress data; data recompressed if m->compress)*/
+                if (zbufsz < mcdb_iter_datalen(&iter)) {
+                    if (zbuf != NULL)
+                        m->fn_free(zbuf);
+                    zbufsz = mcdb_iter_datalen(&iter);
+                    if ((zbuf = (char *)m->fn_malloc(zbufsz)) == NULL)
+                        zbufsz = 0;
+                }
+                data = (zbuf != NULL) ? mcdb_iter_readdata(&iter, zbuf) : NULL;
+            }
+            if (data == NULL
+                || mcdb_make_add(m, (char *)mcdb_iter_keyptr(&iter),
+                                 mcdb_iter_keylen(&iter),
+                                 data, mcdb_iter_datalen(&iter)) != 0)
+                rc = -1;
+        }
+        if (!more)
+            break;
+    }
+    if (zbuf != NULL)
+        m->fn_free(zbuf);
+    if (sfd != -1)
+        (void) nointr_close(sfd);
+    if (rc != 0)
+        return -1;
+
+    /* add records of delta ('+' add, '=' replace) (data without op char) */
+    mcdb_iter_init(&iter, delta);
+    while (mcdb_iter(&iter)) {
+        const char * const data = (char *)mcdb_iter_dataptr(&iter);
+        const size_t dlen = mcdb_iter_datalen(&iter);
+        if (dlen == 0 || (*data != '+' && *data != '=' && *data != '-'))
+            return mcdb_make_err(NULL, EINVAL);
+        if (*data != '-'
+            && mcdb_make_add(m, (char *)mcdb_iter_keyptr(&iter),
+                             mcdb_iter_keylen(&iter), data+1, dlen-1) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* Note: it is recommended that fd be the fd returned from a call to mkstemp()
+ * and that the temporary file be renamed (by the caller) upon success */
+int
+mcdb_make_start(struct mcdb_make * const restrict m, const int fd,
+                void * (*fn_malloc)(size_t), void (*fn_free)(void *))
+{
+    m->map       = MAP_FAILED;
+    m->pos       = MCDB_HEADER_SZ;
+    m->offset    = 0;
+    m->hash_init = UINT32_HASH_DJB_INIT;
+    m->hash_fn   = uint32_hash_djb;
+    m->fsz       = 0;
+    m->osz       = 0;
+    m->msz       = 0;
+    m->hp.p      = MCDB_HEADER_SZ;
+    m->hp.h      = 0;
+    m->hp.l      = ~0; /*(allocate hash list in first mcdb_make_addbegin())*/
+    m->fd        = fd;
+    m->fn_malloc = fn_malloc;
+    m->fn_free   = fn_free;
+    m->pgalign   = ~( ((size_t)plasma_sysconf_pagesize()) - 1u );
+    m->bloom_bits= 0;
+    m->layout    = MCDB_FMT_LAYOUT_CLASSIC;
+    m->mphf      = 0;
+    m->sorted    = 0;
+    m->cksum     = 0;
+    m->index_native = 0;
+    m->nthreads  = 0;
+    m->writer    = NULL;
+    m->wown      = 0;
+    m->scratch   = NULL;
+    m->spill_fd  = -1;
+    m->io        = MCDB_MAKE_IO_MMAP;
+    m->io_buf    = 0;
+    m->cluster   = 0;
+    m->dup       = MCDB_MAKE_DUP_ALL;
+    m->valshare  = 0;
+    m->valref    = 0;
+    m->valtab    = NULL;
+    m->valtabsz  = 0;
+    m->valtabn   = 0;
+    m->valtablast= 0;
+    m->compress  = 0;
+    m->valz      = 0;
+    m->zdict     = NULL;
+    m->zdictlen  = 0;
+    m->zstrm     = NULL;
+    m->zbuf      = NULL;
+    m->zbufsz    = 0;
+    m->tombstone = NULL;
+    m->tombstonelen = 0;
+    m->cluster_weight = NULL;
+    m->cluster_arg = NULL;
+    m->hpwide    = (fd == -1); /*(custom map; klen can not be read from fd)*/
+    m->hpcompact = 0;
+    m->hpmap     = NULL;
+    m->hpsz      = 0;
+    m->hppos     = 0;
+    m->kmap      = NULL;
+    m->kmsz      = 0;
+    memset(m->count, 0, MCDB_SLOTS * sizeof(uint32_t));
+    memset(m->head,  0, MCDB_SLOTS * sizeof(size_t));
+    /* do not modify m->fname, m->fntmp, m->st_mode; may already have been set*/
+    /* (defer mcdb_mmap_upsize() if fd==-1 to allow caller to set custom map) */
+    if (fd == -1 || mcdb_mmap_upsize(m, MCDB_MMAP_SZ, true))
+        return 0;
+    else {
+        mcdb_make_destroy(m);
+        return -1;
+    }
+}
+
+/* multi-writer build: each writer handle is used by (at most) one thread,
+ * appending records to a private data segment in its own (temporary) file
+ * and to its own hash list.  Segments are concatenated, in order writers were
+ * started, following records added directly to m, by mcdb_make_finish().
+ * fd must be open O_RDWR to a file not otherwise in use (e.g. from mkstemp()
+ * followed by unlink()); fd is not closed (caller should cleanup fd)
+ * (m->hash_fn and m->hash_init must be set before mcdb_make_writer_start())
+ * (mcdb_make_writer_start() must not be called concurrently for same m)
+ * (writer struct must remain valid until m is finished or destroyed) */
+int
+mcdb_make_writer_start(struct mcdb_make * const restrict w,
+                       struct mcdb_make * const restrict m, const int fd)
+{
+    struct mcdb_make **wp = &m->writer;
+    if (fd == -1)                              return mcdb_make_err(NULL,EINVAL);
+    if (mcdb_make_start(w, fd, m->fn_malloc, m->fn_free) != 0) return -1;
+    w->hash_init = m->hash_init;
+    w->hash_fn   = m->hash_fn;
+    w->hpwide    = (m->fd == -1); /*(klen read from m->fd if compact entries)*/
+    w->cluster   = m->cluster;    /*(hash list entries rewritten by m)*/
+    w->dup       = m->dup;
+    w->io        = m->io;
+    w->compress  = m->compress;   /*(writers compress data in parallel)*/
+    w->zdict     = m->zdict;
+    w->zdictlen  = m->zdictlen;
+    w->tombstone = m->tombstone;
+    w->tombstonelen = m->tombstonelen;
+    while (*wp != NULL)
+        wp = &(*wp)->writer;
+    *wp = w;
+    return 0;
+}
+
+/* destroy writer w of m (and free w and close its fd if w->wown) */
+__attribute_noinline__
+static int
+mcdb_make_writer_release(struct mcdb_make * const restrict m,
+                         struct mcdb_make * const restrict w)
+  __attribute_nonnull__;
+__attribute_noinline__
+static int
+mcdb_make_writer_release(struct mcdb_make * const restrict m,
+                         struct mcdb_make * const restrict w)
+{
+    const int fd = w->fd;
+    int rc = mcdb_make_destroy(w);
+    if (w->wown) {
+        (void) nointr_close(fd);
+        m->fn_free(w);
+    }
+    return rc;
+}
+
+/* append writer data segment to m and rebase writer hash list onto m
+ * (writer hash list chunks are copied into m arena) */
+__attribute_noinline__
+static bool
+mcdb_make_writer_merge(struct mcdb_make * const restrict m,
+                       struct mcdb_make * const restrict w)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static bool
+mcdb_make_writer_merge(struct mcdb_make * const restrict m,
+                       struct mcdb_make * const restrict w)
+{
+    const size_t delta = m->pos - MCDB_HEADER_SZ;
+    size_t off = MCDB_HEADER_SZ;
+    uint64_t u = 0, v = 0;
+    uint32_t i;
+
+    if (w->map == MAP_FAILED
+        || w->hash_fn != m->hash_fn || w->hash_init != m->hash_init)
+        return (errno = EINVAL, false);
+    if (!mcdb_wbuf_finish(w))  /*(writer data segment is read from w->fd)*/
+        return false;
+    for (i = 0; i < MCDB_SLOTS; ++i) {
+        u += m->count[i];
+        v += w->count[i];
+    }
+    if (u + v > INT_MAX)
+        return (errno = ENOMEM, false);
+  #if !defined(_LP64) && !defined(__LP64__)  /* (no 4 GB limit in 64-bit) */
+    if (w->pos - MCDB_HEADER_SZ > UINT_MAX - m->pos)
+        return (errno = ENOMEM, false);
+  #endif
+
+    /* copy data segment (read from writer fd; mmap is MAP_SHARED on fd) */
+    while (off < w->pos) {
+        const size_t len = (w->pos - off < MCDB_MMAP_SZ)
+          ? w->pos - off
+          : MCDB_MMAP_SZ;
+        ssize_t r;
+        if (m->offset+m->msz < m->pos+len
+            && !mcdb_mmap_upsize(m, m->pos+len, true))
+            return false;
+        r = pread(w->fd, m->map + m->pos - m->offset, len, (off_t)off);
+        if (r <= 0) {
+            if (r == -1 && errno == EINTR)
+                continue;
+            if (r == 0)
+                errno = EIO;
+            return false;
+        }
+        off    += (size_t)r;
+        m->pos += (size_t)r;
+    }
+
+    /* copy writer hash list chunks into m arena, rebase arena offsets and
+     * record offsets, and prepend writer hash list to m hash list */
+    if (w->hpmap != NULL) {
+        const size_t wsz = w->hppos - MCDB_HPCHUNK_SZ;
+        size_t aoff, x;
+        struct mcdb_hpchunk *c;
+        if (m->hpmap == NULL)
+            m->hppos = MCDB_HPCHUNK_SZ;  /*(offset 0 reserved)*/
+        if (m->hpsz < m->hppos + wsz && !mcdb_hparena_grow(m, m->hppos + wsz))
+            return false;
+        aoff = m->hppos - MCDB_HPCHUNK_SZ;
+        memcpy(m->hpmap + m->hppos, w->hpmap + MCDB_HPCHUNK_SZ, wsz);
+        for (x = m->hppos, m->hppos += wsz; x < m->hppos; x+=MCDB_HPCHUNK_SZ){
+            c = mcdb_hpchunk(m, x);
+            if (c->next)
+                c->next += aoff;
+            if (!c->wide)
+                c->pbase += delta;
+            else {
+                struct mcdb_hp * const restrict hp = (struct mcdb_hp *)(c+1);
+                for (uint32_t j = 0; j < c->num; ++j)
+                    hp[j].p += delta;
+            }
+        }
+        for (i = 0; i < MCDB_SLOTS; ++i) {
+            for (x = w->head[i] + aoff; (c = mcdb_hpchunk(m, x))->next; )
+                x = c->next;
+            c->next = m->head[i];
+            m->head[i] = w->head[i] + aoff;
+        }
+        m->hpcompact |= w->hpcompact;
+    }
+    m->valz |= w->valz;
+    m->valref |= w->valref;  /*(tombstones; writers do not share data)*/
+    for (i = 0; i < MCDB_SLOTS; ++i)
+        m->count[i] += w->count[i];
+    return true;
+}
+
+/* slot-clustered data layout (m->cluster)
+ * Rewrite data section with records ordered by hash slot, so that records
+ * in same slot share pages, and, if m->cluster_weight, ordered first by
+ * descending caller-supplied weight, so that hot records share pages.
+ * Insertion order is otherwise preserved (incl. order of repeated keys).
+ * Records are gathered in new order after end of data and are then copied
+ * back over data section; hash list record offsets are updated to match.
+ * (hash list entries are struct mcdb_hp if m->cluster; see mcdb_hplist_alloc)
+ * (file temporarily grows to twice size of data section) */
+
+/* rewrite data section: records in hash slot order (m->cluster), weightier
+ * keys first (m->cluster_weight), and/or omitting records with duplicated
+ * keys (m->dup).  Records are gathered in new order after end of data and
+ * are then copied over data section; hash list entries (all struct mcdb_hp)
+ * are updated with new record offsets (and dropped entries marked p = 0) */
+
+struct mcdb_cluster_rec {
+  uint64_t k;              /* sort key ((~weight << 32) | slot) */
+  uint64_t p;              /* record offset (sort by insertion order) */
+  struct mcdb_hp *hp;      /* hash list entry */
+  const unsigned char *kp; /* key (m->dup) */
+};
+
+static int
+mcdb_cluster_rec_cmp(const void * const a, const void * const b)
+  __attribute_nonnull__;
+static int
+mcdb_cluster_rec_cmp(const void * const a, const void * const b)
+{
+    const struct mcdb_cluster_rec * const x = (const struct mcdb_cluster_rec*)a;
+    const struct mcdb_cluster_rec * const y = (const struct mcdb_cluster_rec*)b;
+    return (x->k != y->k)
+      ? (x->k < y->k ? -1 : 1)
+      : (x->p < y->p ? -1 : x->p > y->p);
+}
+
+static int
+mcdb_cluster_rec_keycmp_key(const struct mcdb_cluster_rec * const restrict x,
+                            const struct mcdb_cluster_rec * const restrict y)
+  __attribute_nonnull__;
+static int
+mcdb_cluster_rec_keycmp_key(const struct mcdb_cluster_rec * const restrict x,
+                            const struct mcdb_cluster_rec * const restrict y)
+{
+    if (x->hp->h != y->hp->h)
+        return x->hp->h < y->hp->h ? -1 : 1;
+    if (x->hp->l != y->hp->l)
+        return x->hp->l < y->hp->l ? -1 : 1;
+    return memcmp(x->kp, y->kp, x->hp->l);
+}
+
+/* (group records with same key, in insertion order) */
+static int
+mcdb_cluster_rec_keycmp(const void * const a, const void * const b)
+  __attribute_nonnull__;
+static int
+mcdb_cluster_rec_keycmp(const void * const a, const void * const b)
+{
+    const struct mcdb_cluster_rec * const x = (const struct mcdb_cluster_rec*)a;
+    const struct mcdb_cluster_rec * const y = (const struct mcdb_cluster_rec*)b;
+    const int rc = mcdb_cluster_rec_keycmp_key(x, y);
+    return rc ? rc : (x->p < y->p ? -1 : x->p > y->p);
+}
+
+/* apply m->dup policy to records r (sorted by key); returns num kept records
+ * (kept records are moved to front of r; sort key k of kept records is record
+ *  offset of first record for key, unless clustering; returns n+1 on error) */
+static size_t
+mcdb_make_dedup(struct mcdb_make * const restrict m,
+                struct mcdb_cluster_rec * const restrict r, const size_t n)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static size_t
+mcdb_make_dedup(struct mcdb_make * const restrict m,
+                struct mcdb_cluster_rec * const restrict r, const size_t n)
+{
+    size_t i, e, j, u = 0;
+    qsort(r, n, sizeof(*r), mcdb_cluster_rec_keycmp);
+    for (i = 0; i < n; ++u) {
+        e = i;
+        while (++i < n && 0 == mcdb_cluster_rec_keycmp_key(r+e, r+i)) ;
+        if (i - e == 1) {
+            r[u] = r[e];
+            continue;
+        }
+        if (m->dup == MCDB_MAKE_DUP_REJECT)
+            return (errno = EEXIST, n+1);
+        j = (m->dup == MCDB_MAKE_DUP_LAST) ? i-1 : e;
+        for (size_t x = e; x < i; ++x) {
+            if (x != j) {
+                --m->count[r[x].hp->h & MCDB_SLOT_MASK];
+                r[x].hp->p = 0;  /*(omit from hash tables)*/
+            }
+        }
+        if (!m->cluster)
+            r[j].k = r[e].p; /*(place where first record for key was added)*/
+        r[u] = r[j];
+    }
+    return u;
+}
+
+__attribute_noinline__
+static bool
+mcdb_make_cluster(struct mcdb_make * const restrict m, const uint32_t nrec)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static bool
+mcdb_make_cluster(struct mcdb_make * const restrict m, const uint32_t nrec)
+{
+    const size_t dend = m->pos;
+    size_t dsz  = dend - MCDB_HEADER_SZ;
+    struct mcdb_cluster_rec * restrict r;
+    const unsigned char *src;
+    size_t n = 0, off, tot = 0;
+    uint32_t i;
+
+    if (nrec == 0)
+        return true;
+    if (m->fd == -1 || m->map == MAP_FAILED)
+        return (errno = EINVAL, false);
+  #if !defined(_LP64) && !defined(__LP64__)
+    if ((uint64_t)nrec * sizeof(*r) > SIZE_MAX) { errno = ENOMEM; return false; }
+  #endif
+    r = (struct mcdb_cluster_rec *)m->fn_malloc((size_t)nrec * sizeof(*r));
+    if (r == NULL)
+        return false;
+    src = (const unsigned char *)
+      mmap(0, dend, PROT_READ, MAP_SHARED, m->fd, 0);
+    if (src == MAP_FAILED) {
+        m->fn_free(r);
+        return false;
+    }
+
+    for (i = 0; i < MCDB_SLOTS; ++i) {
+        struct mcdb_hpchunk *c;
+        for (size_t x = m->head[i]; x; x = c->next) {
+            c = mcdb_hpchunk(m, x);
+            if (!c->wide || n + c->num > nrec) {
+                munmap((void *)(uintptr_t)src, dend);
+                m->fn_free(r);
+                return (errno = EINVAL, false);
+            }
+            for (uint32_t j = 0; j < c->num; ++j, ++n) {
+                struct mcdb_hp * const hp = ((struct mcdb_hp *)(c+1)) + j;
+                const uint32_t w = (m->cluster && m->cluster_weight != NULL)
+                  ? m->cluster_weight(m->cluster_arg,
+                                      (const char *)src + hp->p + 8, hp->l)
+                  : 0;
+                r[n].k  = m->cluster
+                  ? ((uint64_t)(UINT32_MAX - w) << 32) | i
+                  : hp->p;
+                r[n].p  = hp->p;
+                r[n].hp = hp;
+                r[n].kp = src + hp->p + 8;
+                tot += mcdb_make_reclen(src + hp->p);
+            }
+        }
+    }
+    if (tot != dsz) { /*(data section must contain only records)*/
+        munmap((void *)(uintptr_t)src, dend);
+        m->fn_free(r);
+        return (errno = EINVAL, false);
+    }
+    if (m->dup) {
+        const size_t u = mcdb_make_dedup(m, r, n);
+        if (u > n || (u == n && !m->cluster)) { /*(error, or no dup to drop)*/
+            munmap((void *)(uintptr_t)src, dend);
+            m->fn_free(r);
+            return (u == n);
+        }
+        n = u;
+    }
+    qsort(r, n, sizeof(*r), mcdb_cluster_rec_cmp);
+
+    /* (shared data is shared anew among records in new order) */
+    if (m->valtab != NULL)
+        memset(m->valtab, 0, m->valtabsz * sizeof(struct mcdb_valent));
+    m->valtabn = 0;
+    m->valref  = 0;
+
+    /* gather records in new order after end of data */
+    for (off = 0; off < n; ++off) {
+        const unsigned char * const restrict q = src + r[off].p;
+        const size_t klen = uint32_strunpack_bigendian_macro(q);
+        uint32_t dlen = uint32_strunpack_bigendian_macro(q+4);
+        const unsigned char *d = q + 8 + klen;
+        const size_t pos = m->pos;
+        size_t n = dlen;
+        if (dlen & MCDB_DLEN_REF) {
+            if (*d & 0x80) /*(MCDB_ZLEN_FLAG)*//*(copy compressed data as-is)*/
+                n = 4 + (size_t)(uint32_strunpack_bigendian_macro(d)
+                                 & ~MCDB_ZLEN_FLAG);
+            else {
+                const uint64_t dpos =
+                  ((uint64_t)uint32_strunpack_bigendian_macro(d) << 32)
+                  | uint32_strunpack_bigendian_macro(d+4);
+                if (dlen == MCDB_DLEN_REF && dpos == MCDB_DPOS_TOMBSTONE) {
+                    n = 8;  /*(copy tombstone as-is)*/
+                    m->valref = 1;
+                }
+                else {      /*(copy shared data)*/
+                    n = dlen &= ~MCDB_DLEN_REF;
+                    d = src + dpos;
+                }
+            }
+        }
+        if (m->offset+m->msz < pos+8+klen+n
+            && !mcdb_mmap_upsize(m, pos+8+klen+n, true))
+            break;
+        memcpy(m->map + pos - m->offset, q, 8 + klen);
+        uint32_strpack_bigendian_macro(m->map + pos - m->offset + 4, dlen);
+        memcpy(m->map + pos + 8 + klen - m->offset, d, n);
+        r[off].hp->p = MCDB_HEADER_SZ + (pos - dend);
+        m->pos += 8 + klen + n;
+        if (m->valshare)
+            mcdb_make_valshare(m, pos, dend - MCDB_HEADER_SZ);
+    }
+    munmap((void *)(uintptr_t)src, dend);
+    m->fn_free(r);
+    if (off != n)
+        return false;
+    dsz = m->pos - dend; /*(smaller than before if records dropped)*/
+
+    /* flush and munmap mmap, and copy gathered records over data section */
+    if (!mcdb_mmap_unmap(m))
+        return false;
+    m->pos = MCDB_HEADER_SZ;
+    for (off = 0; off < dsz; ) {
+        const size_t len = (dsz - off < MCDB_MMAP_SZ)
+          ? dsz - off
+          : MCDB_MMAP_SZ;
+        ssize_t rd;
+        if ((m->map == MAP_FAILED || m->offset+m->msz < m->pos+len)
+            && !mcdb_mmap_upsize(m, m->pos+len, true))
+            return false;
+        rd = pread(m->fd, m->map + m->pos - m->offset, len,
+                   (off_t)(dend + off));
+        if (rd <= 0) {
+            if (rd == -1 && errno == EINTR)
+                continue;
+            if (rd == 0)
+                errno = EIO;
+            return false;
+        }
+        off    += (size_t)rd;
+        m->pos += (size_t)rd;
+    }
+    return (m->map != MAP_FAILED || mcdb_mmap_upsize(m, m->pos, true));
+}
+
+/* fill in checksums section (at offset coff) reserved by mcdb_make_sections()
+ * (after hash tables are written, before header is written from header[]) */
+__attribute_noinline__
+static bool
+mcdb_make_cksum(struct mcdb_make * const restrict m,
+                const char header[MCDB_HEADER_SZ], const uint32_t b,
+                const uint64_t coff)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static bool
+mcdb_make_cksum(struct mcdb_make * const restrict m,
+                const char header[MCDB_HEADER_SZ], const uint32_t b,
+                const uint64_t coff)
+{
+    char *x, *c;
+    uint64_t end, pos;
+    uint32_t nblk, i, crc;
+    uintptr_t dir, endp;
+    /* (map all of mcdb, unless already mapped, e.g. custom map if fd == -1) */
+    if (m->offset == 0 && m->msz >= m->pos)
+        x = m->map;
+    else if (m->fd == -1) {
+        errno = EINVAL;
+        return false;
+    }
+    else {
+        x = (char *)mmap(0, m->pos, PROT_READ|PROT_WRITE, MAP_SHARED, m->fd, 0);
+        if (x == MAP_FAILED)
+            return false;
+        posix_madvise(x, m->pos, POSIX_MADV_SEQUENTIAL);
+    }
+    c    = x + coff;
+    nblk = uint32_strunpack_bigendian_aligned_macro(c+4);
+    end  = uint64_strunpack_bigendian_aligned_macro(c+8);
+    crc  = uint32_crc32c(0, header, MCDB_HEADER_SZ);
+    uint32_strpack_bigendian_aligned_macro(c+MCDB_CKSUM_HDRSZ, crc);
+    dir = (uintptr_t)
+          (((uint64_t)uint32_strunpack_bigendian_aligned_macro(
+             header+MCDB_HDRX_OFFSET(MCDB_HDRX_SECTDIR_HI)) << 32)
+           | uint32_strunpack_bigendian_aligned_macro(
+             header+MCDB_HDRX_OFFSET(MCDB_HDRX_SECTDIR_LO)));
+    for (endp = dir; uint32_strunpack_bigendian_aligned_macro(x+endp) != 0; )
+        endp += MCDB_SECT_ENTSZ;
+    endp += MCDB_SECT_ENTSZ;  /*(incl. terminating entry)*/
+    crc  = uint32_crc32c(0, x+dir, endp - dir);
+    uint32_strpack_bigendian_aligned_macro(c+MCDB_CKSUM_HDRSZ+4, crc);
+    for (i = 0; i < MCDB_SLOTS; ++i) {
+        pos = uint64_strunpack_bigendian_aligned_macro(header+(i<<4));
+        crc = uint32_crc32c(0, x+pos, (size_t)
+                uint32_strunpack_bigendian_aligned_macro(header+(i<<4)+8) << b);
+        uint32_strpack_bigendian_aligned_macro(c+MCDB_CKSUM_HDRSZ+8+(i<<2),crc);
+    }
+    for (i = 0, pos = MCDB_HEADER_SZ; i < nblk; ++i) {
+        const size_t len = (end - pos > (1u << MCDB_CKSUM_BLKBITS))
+          ? (1u << MCDB_CKSUM_BLKBITS)
+          : (size_t)(end - pos);
+        crc = uint32_crc32c(0, x+pos, len);
+        uint32_strpack_bigendian_aligned_macro(c+mcdb_cksum_blk(i), crc);
+        pos += len;
+    }
+    return (x == m->map || munmap(x, m->pos) == 0);
+}
+
+int
+mcdb_make_finish(struct mcdb_make * const restrict m)
+{
+    /* Current code below effectively limits mcdb to approx 2 billion entries.
+     * (256 million when compiled 32-bit, in order to keep hash table in memory,
      *  and in practice, size of data fitting in 4 GB will impose lower limit)
      * Use of 32-bit hash is the basis for continuing to use 32-bit structures.
      * Even a mostly uniform distribution of hash keys will likely show
@@ -467,22 +2582,60 @@ mcdb_make_finish(struct mcdb_make * const restrict m)
     uintptr_t d;
     uint32_t len;
     uint32_t b;
+    uint32_t nrec;
+    uint32_t layout = m->layout;
+    const bool le = MCDB_HOST_LE && m->index_native;
+    uint32_t fmt = le ? MCDB_FMT_INDEX_LE : 0;
+    uint64_t sectdir = 0;
+    uint64_t cksum = 0;
     char *p;
+    const unsigned char *kmap;
     const uint32_t * const restrict count = m->count;
     char header[MCDB_HEADER_SZ];
     if (m->map == MAP_FAILED)                  return mcdb_make_err(m,EPERM);
+    if (!mcdb_wbuf_finish(m))                  return mcdb_make_err(m,errno);
+    for (struct mcdb_make *w; (w = m->writer) != NULL; ) {
+        if (!mcdb_make_writer_merge(m, w))     return mcdb_make_err(m,errno);
+        m->writer = w->writer;
+        w->writer = NULL;
+        mcdb_make_writer_release(m, w);
+    }
+    if (layout != MCDB_FMT_LAYOUT_CLASSIC
+        && layout != MCDB_FMT_LAYOUT_BUCKET
+        && layout != MCDB_FMT_LAYOUT_PACKED)   return mcdb_make_err(m,EINVAL);
+  #ifndef MCDB_ZLIB
+    if (m->compress)                           return mcdb_make_err(m,ENOTSUP);
+  #endif
+    if (m->compress > 9 || m->zdictlen > MCDB_ZDICT_MAX
+        || (m->zdictlen && m->zdict == NULL))  return mcdb_make_err(m,EINVAL);
 
-    for (u = 0, i = 0; i < MCDB_SLOTS; ++i)
-        u += count[i];  /* no overflow; limited in mcdb_hplist_alloc */
+    for (u = 0, i = 0; i < MCDB_SLOTS; ++i) {
+        if (count[i] > INT_MAX - u)            return mcdb_make_err(m,ENOMEM);
+        u += count[i];
+    }
+    nrec = u;
 
     /* check for integer overflow and that sufficient space allocated in file */
-    if (u > INT_MAX)                           return mcdb_make_err(m,ENOMEM);
+    if (layout == MCDB_FMT_LAYOUT_BUCKET && u > INT_MAX-8)
+                                               return mcdb_make_err(m,ENOMEM);
   #if !defined(_LP64) && !defined(__LP64__)
     if (u > (UINT_MAX>>4))                     return mcdb_make_err(m,ENOMEM);
     u <<= 4;  /* 8 byte hash entries in 32-bit; x 2 for space in table */
+    if (layout == MCDB_FMT_LAYOUT_BUCKET) { /*(bucket rounding and alignment)*/
+        if (u > UINT_MAX-(MCDB_SLOTS*MCDB_BUCKET_SZ + MCDB_BUCKET_SZ))
+                                               return mcdb_make_err(m,ENOMEM);
+        u += MCDB_SLOTS*MCDB_BUCKET_SZ + MCDB_BUCKET_SZ;
+    }
     if (m->pos > ((size_t)UINT_MAX-u))         return mcdb_make_err(m,ENOMEM);
   #endif
 
+    if ((m->cluster || m->dup) && !mcdb_make_cluster(m, nrec))
+                                               return mcdb_make_err(m,errno);
+    if (m->dup) { /*(records with duplicated keys dropped)*/
+        for (nrec = 0, i = 0; i < MCDB_SLOTS; ++i)
+            nrec += count[i];
+    }
+
     /* add "hole" for alignment; incompatible with djb cdbdump */
     /* padding to align hash tables to MCDB_PAD_ALIGN bytes (16) */
     d = (MCDB_PAD_ALIGN - (m->pos & MCDB_PAD_MASK)) & MCDB_PAD_MASK;
@@ -498,9 +2651,69 @@ mcdb_make_finish(struct mcdb_make * const restrict m)
      * (madvise is supposed to be advice, not promise; Solaris crash is bug) */
     posix_madvise(m->map, m->msz, POSIX_MADV_NORMAL);
 
+  #if defined(_LP64) || defined(__LP64__)
+    /* read-only map of data for klen of compact hash list entries
+     * (needed only for bucket layout and 16-byte hash table elements) */
+    if (m->hpcompact && m->fd != -1) {
+        void * const x = mmap(0, m->pos, PROT_READ, MAP_SHARED, m->fd, 0);
+        if (x == MAP_FAILED)                   return mcdb_make_err(m,errno);
+        m->kmap = (const unsigned char *)x;
+        m->kmsz = m->pos;
+    }
+  #endif
+
+    /* optional sections (e.g. filter) between end of data and hash tables */
+    if ((m->bloom_bits || m->mphf || m->sorted || m->cksum
+         || (m->valz && m->zdictlen))
+        && !mcdb_make_sections(m, nrec, &sectdir, &cksum, &fmt))
+                                               return mcdb_make_err(m,errno);
+
+    /* bucketized layout: align hash tables to 64-byte buckets (pad with ~0);
+     * fall back to packed layout if data section crosses 4 GB; packed layout
+     * falls back to classic layout if data section crosses 1 TB */
+    if (layout == MCDB_FMT_LAYOUT_BUCKET
+        && !mcdb_make_fill(m, (MCDB_BUCKET_SZ - (m->pos & (MCDB_BUCKET_SZ-1)))
+                              & (MCDB_BUCKET_SZ-1), ~0))
+                                               return mcdb_make_err(m,errno);
+
     b = (m->pos < UINT_MAX) ? 3u : 4u;
-    for (i = 0; i < MCDB_SLOTS; ++i) {
-        len = count[i] << 1;
+    if (b == 4 && layout == MCDB_FMT_LAYOUT_BUCKET)
+        layout = MCDB_FMT_LAYOUT_PACKED;
+    if (layout == MCDB_FMT_LAYOUT_PACKED) {
+        if ((uint64_t)m->pos <= MCDB_PACKED_DPOS_MAX)
+            b = 3;
+        else
+            layout = MCDB_FMT_LAYOUT_CLASSIC;
+    }
+    else if (b == 4)
+        layout = MCDB_FMT_LAYOUT_CLASSIC;
+    /* constant header (16 bytes per header slot, so multiply by 16)
+     * (hash table position is prefix sum of table sizes) */
+    for (d = m->pos, i = 0; i < MCDB_SLOTS; ++i) {
+        len = mcdb_make_slot_len(count[i], layout);
+        p = header + (i << 4);  /* (i << 4) == (i * 16) */
+        uint64_strpack_bigendian_aligned_macro(p,(uint64_t)d); /* hpos */
+        uint32_strpack_bigendian_aligned_macro(p+8,len);       /* hslots */
+        *(uint32_t *)(p+12) = 0;     /*(fill hole with 0; see hdrx below)*/
+        d += ((uintptr_t)len << b);
+    }
+
+    /* (klen needed only for bucket layout and 16-byte hash table elements) */
+    kmap = (layout == MCDB_FMT_LAYOUT_BUCKET || b == 4) ? m->kmap : NULL;
+
+    i = 0;
+  #ifdef _THREAD_SAFE
+    /* parallel fill requires mmap of all hash tables at once
+     * (fall back to serial fill, remapping per slot, if mmap fails) */
+    if (m->nthreads > 1
+        && (m->offset+m->msz >= d || mcdb_mmap_upsize(m, d, false))) {
+        mcdb_make_fill_parallel(m, header, b, layout, le, kmap);
+        m->pos = d;
+        i = MCDB_SLOTS;
+    }
+  #endif
+    for (; i < MCDB_SLOTS; ++i) {
+        len = mcdb_make_slot_len(count[i], layout);
         d   = m->pos;
 
         /* mmap sufficient space into which to write hash table for this slot */
@@ -508,57 +2721,26 @@ mcdb_make_finish(struct mcdb_make * const restrict m)
             && !mcdb_mmap_upsize(m, d+((uintptr_t)len << b), false))
             break;
 
-        /* constant header (16 bytes per header slot, so multiply by 16) */
-        p = header + (i << 4);  /* (i << 4) == (i * 16) */
-        uint64_strpack_bigendian_aligned_macro(p,(uint64_t)d); /* hpos */
-        uint32_strpack_bigendian_aligned_macro(p+8,len);       /* hslots */
-        *(uint32_t *)(p+12) = 0;     /*(fill hole with 0 only for consistency)*/
-
-        /* generate hash table for slot, writing directly to mmap */
-        p = m->map + m->pos - m->offset;
+        mcdb_make_slot_fill(m, i, m->map + d - m->offset,
+                            len, b, layout, le, kmap);
         m->pos += ((uintptr_t)len << b);
-        memset(p, 0, (size_t)len << b);
-        if (b == 3) { /* data section ends < 4 GB; use 32-bit dpos offset */
-            /* (could be made into a subroutine taking (len, p, m->head[i]) */
-            /* layout in memory: 4-byte khash, 4-byte dpos */
-            for (const struct mcdb_hplist *x = m->head[i]; x; x = x->next) {
-                const struct mcdb_hp * restrict hp = x->hp;
-                char * restrict q;
-                for (uint32_t w = x->num; w; --w, ++hp) {
-                    q = p+4;  /*(4 is offset of dpos)*/
-                    u = (hp->h >> MCDB_SLOT_BITS) % len;
-                    /* find empty entry in open hash table (dpos == 0) */
-                    while (*(uint32_t *)(q+((uintptr_t)u<<3)))
-                        if (++u == len)
-                            u = 0;
-                    q += (u<<3);
-                    uint32_strpack_bigendian_aligned_macro(q-4,hp->h); /*khash*/
-                    uint32_strpack_bigendian_aligned_macro(q,(uint32_t)hp->p);
-                }                                                      /*dpos*/
-            }
-        }
-        else {/*b==4*//* data section crosses 4 GB; need 64-bit dpos offset */
-            /* (could be made into a subroutine taking (len, p, m->head[i]) */
-            /* layout in memory: 4-byte khash, 4-byte klen, 8-byte dpos */
-            for (const struct mcdb_hplist *x = m->head[i]; x; x = x->next) {
-                const struct mcdb_hp * restrict hp = x->hp;
-                char * restrict q;
-                for (uint32_t w = x->num; w; --w, ++hp) {
-                    q = p+8;  /*(8 is offset of dpos)*/
-                    u = (hp->h >> MCDB_SLOT_BITS) % len;
-                    /* find empty entry in open hash table (dpos == 0) */
-                    while (*(uintptr_t *)(q+((uintptr_t)u<<4)))
-                        if (++u == len)
-                            u = 0;
-                    q += (u<<4);
-                    uint32_strpack_bigendian_aligned_macro(q-8,hp->h); /*khash*/
-                    uint32_strpack_bigendian_aligned_macro(q-4,hp->l); /*klen*/
-                    uint64_strpack_bigendian_aligned_macro(q,(uint64_t)hp->p);
-                }                                                      /*dpos*/
-            }
-        }
     }
 
+    /* header padding words (hdrx) (see mcdb.h) */
+    uint32_strpack_bigendian_aligned_macro(header+MCDB_FMT_OFFSET,
+      ((m->hash_fn == uint32_hash_fast) ? MCDB_FMT_HASH_FAST : MCDB_FMT_HASH_DJB)
+      | layout | fmt | (m->valref ? MCDB_FMT_VALREF : 0)
+      | (m->valz ? MCDB_FMT_VALZ : 0));
+    uint32_strpack_bigendian_aligned_macro(
+      header+MCDB_HDRX_OFFSET(MCDB_HDRX_SECTDIR_HI), (uint32_t)(sectdir >> 32));
+    uint32_strpack_bigendian_aligned_macro(
+      header+MCDB_HDRX_OFFSET(MCDB_HDRX_SECTDIR_LO), (uint32_t)sectdir);
+    uint32_strpack_bigendian_aligned_macro(
+      header+MCDB_HDRX_OFFSET(MCDB_HDRX_NUMRECS), nrec);
+
+    if (cksum && i == MCDB_SLOTS && !mcdb_make_cksum(m, header, b, cksum))
+                                               return mcdb_make_err(m,errno);
+
     u = (uint32_t)(i == MCDB_SLOTS && mcdb_mmap_commit(m, header));
     return (u ? 0 : -1) | mcdb_make_destroy(m);
 }
@@ -586,20 +2768,34 @@ mcdb_make_destroy(struct mcdb_make * const restrict m)
             rc |= nointr_ftruncate(m->fd, (off_t)m->pos);
       #endif
     }
-    if (m->head[0] != NULL) {
-        struct mcdb_hplist *n;
-        struct mcdb_hplist *node;
-        node = m->head[0]->pend;
-        while ((n = node)) {
-            node = node->pend;
-            m->fn_free(n);
-        }
-        node = m->head[0];
-        while ((n = node)) {
-            node = node->next;
-            m->fn_free(n);
-        }
-        m->head[0] = NULL;
+    if (m->hpmap != NULL) {
+        munmap(m->hpmap, m->hpsz);
+        m->hpmap = NULL;
+    }
+    if (m->kmap != NULL) {
+        munmap((void *)(uintptr_t)m->kmap, m->kmsz);
+        m->kmap = NULL;
+    }
+    if (m->valtab != NULL) {
+        m->fn_free(m->valtab);
+        m->valtab = NULL;
+    }
+    if (m->zstrm != NULL) {
+      #ifdef MCDB_ZLIB
+        deflateEnd((z_stream *)m->zstrm);
+      #endif
+        m->fn_free(m->zstrm);
+        m->zstrm = NULL;
+    }
+    if (m->zbuf != NULL) {
+        m->fn_free(m->zbuf);
+        m->zbuf = NULL;
+    }
+    while (m->writer != NULL) { /* writers not merged (e.g. upon error) */
+        struct mcdb_make * const w = m->writer;
+        m->writer = w->writer;
+        w->writer = NULL;
+        rc |= mcdb_make_writer_release(m, w);
     }
     return rc;
 }
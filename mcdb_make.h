@@ -36,7 +36,6 @@ extern "C" {
 #endif
 
 struct mcdb_hp { uintptr_t p; uint32_t h; uint32_t l; }; /*(private structure)*/
-struct mcdb_hplist;                                      /*(private structure)*/
 
 struct mcdb_make {
   size_t pos;
@@ -45,6 +44,14 @@ struct mcdb_make {
   uint32_t hash_init;         /* hash init value */
   uint32_t hash_pad;          /* (padding)*/
   uint32_t (*hash_fn)(uint32_t, const void * restrict, size_t); /* hash func */
+  /* (hash_fn and hash_init may be modified after mcdb_make_start() and before
+   *  first add, e.g. to uint32_hash_fast, UINT32_HASH_FAST_INIT; hash id is
+   *  recorded in mcdb header for uint32_hash_djb and uint32_hash_fast)
+   * (bloom_bits, layout, mphf, sorted, cksum, index_native, nthreads,
+   *  scratch, spill_fd, io,
+   *  cluster, cluster_weight, cluster_arg, dup, valshare, below, may similarly
+   *  be modified after mcdb_make_start() and before first add (and before
+   *  writers started)) */
   size_t fsz;
   size_t osz;
   size_t msz;
@@ -56,14 +63,123 @@ struct mcdb_make {
   char *fntmp; /*(compiler warning for const char * restrict passed to free())*/
   int fd;
   mode_t st_mode;
+  uint32_t bloom_bits;        /* filter bits per key (0 disables filter) */
+  uint32_t layout;            /* hash table layout (MCDB_FMT_LAYOUT_*) */
+  uint32_t mphf;              /* build minimal perfect hash index if non-zero */
+  uint32_t sorted;            /* build sorted key index if non-zero */
+  uint32_t cksum;             /* embed integrity checksums if non-zero */
+  uint32_t index_native;      /* hash table elements in host byte order */
+  uint32_t nthreads;          /* threads parsing input, filling hash tables */
+  struct mcdb_make *writer;   /* writers started on this mcdb_make (list) */
+  uint32_t wown;              /* (private) writer and its fd owned by m */
+  const char *scratch;        /* name prefix of scratch files (or NULL) */
+  int spill_fd;               /* scratch file for hash list (-1: in memory) */
+  uint32_t io;                /* data section output (MCDB_MAKE_IO_*) */
+  uint32_t io_buf;            /* (private) m->map is write buffer */
+  uint32_t cluster;           /* rewrite data section in hash slot order */
+  uint32_t (*cluster_weight)(void *, const char *, size_t);/*(opt) key weight*/
+  void *cluster_arg;          /* arg passed to cluster_weight() */
+  uint32_t dup;               /* duplicate key policy (MCDB_MAKE_DUP_*) */
+  uint32_t valshare;          /* records with identical data share one copy */
+  uint32_t valref;            /* (private) records reference shared data */
+  void *valtab;               /* (private) table of data copies (valshare) */
+  size_t valtabsz;            /* (private) valtab size (power of 2) */
+  size_t valtabn;             /* (private) valtab entries in use */
+  size_t valtablast;          /* (private) valtab entry of last add (+1) */
+  uint32_t compress;          /* deflate level (1-9) of data (0: none) */
+  uint32_t valz;              /* (private) records hold compressed data */
+  const char *zdict;          /* preset dictionary (compress) (or NULL) */
+  size_t zdictlen;            /* zdict len (<= MCDB_ZDICT_MAX) */
+  void *zstrm;                /* (private) deflate stream (compress) */
+  char *zbuf;                 /* (private) compressed data buffer */
+  size_t zbufsz;              /* (private) size of zbuf */
+  const char *tombstone;      /* data which marks record as tombstone (opt) */
+  size_t tombstonelen;        /* tombstone len */
+  uint32_t hpwide;            /* (private) hash list entries are mcdb_hp */
+  uint32_t hpcompact;         /* (private) compact hash list entries exist */
+  char *hpmap;                /* (private) hash list arena */
+  size_t hpsz;                /* (private) hash list arena size */
+  size_t hppos;               /* (private) hash list arena in use */
+  const unsigned char *kmap;  /* (private) read-only map of data (for klen) */
+  size_t kmsz;                /* (private) size of kmap */
   uint32_t count[MCDB_SLOTS];
-  struct mcdb_hplist *head[MCDB_SLOTS];
+  size_t head[MCDB_SLOTS];    /* (private) arena offset of hash list chunk */
 };
 
 
+/* data section output (struct mcdb_make io)
+ * MCDB_MAKE_IO_MMAP:   write into mmap of fd (windows re-mmap'd as file grows)
+ * MCDB_MAKE_IO_WRITE:  buffer in large user buffer; pwrite() to fd when full
+ * MCDB_MAKE_IO_DIRECT: MCDB_MAKE_IO_WRITE with fd O_DIRECT (if supported)
+ * (sections and hash tables are written into mmap in mcdb_make_finish()) */
+#define MCDB_MAKE_IO_MMAP   0u
+#define MCDB_MAKE_IO_WRITE  1u
+#define MCDB_MAKE_IO_DIRECT 2u
+
+/* duplicate key policy (struct mcdb_make dup), applied in mcdb_make_finish()
+ * MCDB_MAKE_DUP_ALL:    keep all records (mcdb_findnext() returns each)
+ * MCDB_MAKE_DUP_FIRST:  keep first record added for each key
+ * MCDB_MAKE_DUP_LAST:   keep last record added for each key (placed in data
+ *                       section where first record for key was added)
+ * MCDB_MAKE_DUP_REJECT: mcdb_make_finish() fails (EEXIST) if any key repeats
+ * Dropped records are compacted out of data section (so that mcdb_iter()
+ * sees only kept records), without a second build (cf. "mcdbctl uniq").
+ * "first" and "last" are by order in data section (records added to m, then
+ * writers in order started) (requires m->fd != -1) */
+#define MCDB_MAKE_DUP_ALL    0u
+#define MCDB_MAKE_DUP_FIRST  1u
+#define MCDB_MAKE_DUP_LAST   2u
+#define MCDB_MAKE_DUP_REJECT 3u
+
+/* shared data (struct mcdb_make valshare) (see MCDB_FMT_VALREF in mcdb.h)
+ * Data of each record added is content-hashed; a record with data identical
+ * to that of an earlier record (and longer than 8 bytes) is written as a
+ * reference to the earlier copy.  Readers receive pointers directly into map
+ * (mcdb_dataptr(), mcdb_iter_dataptr()), and records with shared data remain
+ * distinct records (and keys), e.g. for mcdb_iter() and duplicate policy.
+ * (records added to writers (mcdb_make_writer_start()) do not share data,
+ *  unless data section is rewritten (cluster, dup) in mcdb_make_finish()) */
+
+/* parallel parse (struct mcdb_make nthreads, scratch) (see mcdb_makefmt.h)
+ * mcdb_makefmt_fileintomcdb() parses mmap'd input in nthreads chunks, each
+ * into a writer (mcdb_make_writer_start()) appending to a scratch file
+ * created (and unlinked) at scratch + ".XXXXXX", e.g. scratch = fname of mcdb.
+ * Data section is identical to that of serial parse (as for writers, hash
+ * tables may differ in placement of entries with colliding hash values).
+ * (serial parse if scratch is NULL, or valshare, or input is small) */
+
+/* compressed data (struct mcdb_make compress) (see MCDB_FMT_VALZ in mcdb.h)
+ * Data of each record added (of at least MCDB_COMPRESS_MIN bytes) is
+ * compressed (raw deflate, at level compress) with preset dictionary zdict
+ * (e.g. sample of typical data), and is stored compressed if smaller.  zdict
+ * is stored in mcdb for use by readers (and must remain valid until mcdb is
+ * finished).  Records with compressed data are not shared (valshare).
+ * (requires mcdb built with zlib (MCDB_ZLIB); else mcdb_make_finish() fails
+ *  ENOTSUP) */
+#define MCDB_COMPRESS_MIN 32
+
+/* integrity checksums (struct mcdb_make cksum) (see MCDB_SECT_CKSUM in mcdb.h)
+ * mcdb_make_finish() embeds CRC32C of header, section directory, hash table
+ * of each slot, and each 64 KB block of data (and sections preceding
+ * checksums), computed after hash tables are written, so that readers can
+ * detect corruption, e.g. from bad copies (see mcdb_verify_index(),
+ * MCDB_MMAP_OPT_VERIFY) (requires m->fd != -1, or single custom map) */
+
+/* tombstones (struct mcdb_make tombstone) (see MCDB_DPOS_TOMBSTONE in mcdb.h)
+ * Record added with data identical to tombstone (tombstonelen bytes) is
+ * written as tombstone for key, e.g. to delete key of base mcdb in delta
+ * mcdb layered over base (see mcdb_layer.h).  mcdb_make_add_tombstone() adds
+ * tombstone for key regardless of tombstone setting.  Tombstones are not
+ * compressed (compress) or shared (valshare), and are kept as records by
+ * duplicate key policy (dup). */
+
 /*
  * Note: mcdb *_make_* routines are not thread-safe
  * (no need for thread-safety; mcdb is typically created from a single stream)
+ * (mcdb_make_finish() fills slot hash tables in parallel if nthreads > 1;
+ *  output is identical to that of serial fill)
+ * (for multiple producer threads, each thread adds records to its own writer
+ *  handle from mcdb_make_writer_start(); see mcdb_make.c)
  */
 
 
@@ -77,11 +193,32 @@ mcdb_make_add(struct mcdb_make * restrict,
               const char * restrict, size_t)
   __attribute_nonnull__  __attribute_warn_unused_result__;
 EXPORT extern int
+mcdb_make_add_tombstone(struct mcdb_make * restrict,
+                        const char * restrict, size_t)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+EXPORT extern int
 mcdb_make_finish(struct mcdb_make * restrict)
   __attribute_nonnull__  __attribute_warn_unused_result__;
 EXPORT extern int
 mcdb_make_destroy(struct mcdb_make * restrict)
   __attribute_nonnull__;
+EXPORT extern int
+mcdb_make_writer_start(struct mcdb_make * restrict, struct mcdb_make * restrict,
+                       int)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+/* incremental rebuild: add records of old mcdb, except records of keys which
+ * are replaced or deleted in delta mcdb, and then add records of delta.
+ * Data of each delta record begins with op char: '+' add record (in addition
+ * to records of key in old mcdb), '=' replace (all records of key in old
+ * mcdb are dropped, and record added), '-' delete (all records of key in old
+ * mcdb are dropped; remainder of data is ignored).  The remainder of data
+ * for '+' and '=' is the data added.  m->hash_fn and m->hash_init must match
+ * old mcdb; caller may add additional records before mcdb_make_finish(). */
+EXPORT extern int
+mcdb_make_update(struct mcdb_make * restrict,
+                 struct mcdb * restrict, struct mcdb * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
 
 /* support for adding entries from input stream, instead of fully in memory */
 EXPORT extern int
@@ -37,8 +37,10 @@
 #include "mcdb_error.h"
 #include "nointr.h"
 #include "plasma/plasma_stdtypes.h"  /* SIZE_MAX */
+#include "plasma/plasma_sysconf.h"
 
 #include <errno.h>
+#include <limits.h>    /* INT_MAX */
 #include <sys/mman.h>  /* mmap(), munmap() */
 #include <sys/stat.h>  /* fstat() */
 #include <fcntl.h>     /* open() */
@@ -46,6 +48,14 @@
 #include <string.h>    /* memcpy(), memmove(), memchr() */
 #include <unistd.h>    /* read() */
 
+#ifdef _THREAD_SAFE
+#include <pthread.h>   /* pthread_create(), pthread_join() */
+#endif
+
+#ifdef MCDB_ZLIB
+#include <zlib.h>      /* inflate() (compressed input) */
+#endif
+
 /*(posix_madvise, defines not provided in Solaris 10, even w/ __EXTENSIONS__)*/
 #if (defined(__sun) || defined(__hpux)) && !defined(POSIX_MADV_NORMAL)
 extern int madvise(caddr_t, size_t, int);
@@ -73,6 +83,8 @@ struct mcdb_input {
   size_t datasz;
   size_t bufsz;
   int fd;
+  size_t lim;  /* stop at first record at or after lim (parallel parse) */
+  struct mcdb_zinput *z;  /* compressed input (or NULL) */
 };
 
 /* Note: __attribute_noinline__ is used to mark less frequent code paths
@@ -80,6 +92,299 @@ struct mcdb_input {
  * cache hits.
  */
 
+#ifdef MCDB_ZLIB
+
+/* compressed input (gzip) (see mcdb_makefmt_zmagic())
+ * Input fd is inflated in blocks by a second thread (if _THREAD_SAFE), ahead
+ * of parse and add, and blocks are copied into struct mcdb_input buffer as it
+ * is refilled (records parsed must be contiguous with unparsed remainder of
+ * buffer, so blocks are not parsed in place).  If not _THREAD_SAFE, or if
+ * second thread can not be created, input is inflated directly into buffer.
+ * Concatenated gzip members (e.g. from pigz or cat a.gz b.gz) are inflated in
+ * sequence. */
+
+#define MCDB_ZINPUT_INSZ  (128u << 10)  /* compressed input read() size */
+#define MCDB_ZINPUT_BLKSZ (256u << 10)  /* inflated block size (thread) */
+#define MCDB_ZINPUT_NBLK  4
+
+struct mcdb_zinput {
+  z_stream zs;
+  unsigned char *in;
+  size_t insz;
+  int fd;
+  int err;     /* errno if read() or inflate() failed (0 at end of input) */
+  int rderr;   /* errno returned by mcdb_zinput_read() (error to report) */
+  bool eof;    /* end of input or error (no more to inflate) */
+ #ifdef _THREAD_SAFE
+  bool threaded;
+  bool stop;   /* (consumer ends before end of input, e.g. on parse error) */
+  bool done;   /* (eof published by thread) */
+  pthread_t tid;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond_full;
+  pthread_cond_t cond_free;
+  size_t nfull;
+  size_t pi;   /* (next block to fill; thread) */
+  size_t ci;   /* (next block to consume) */
+  size_t co;   /* (offset consumed in block ci) */
+  size_t blen[MCDB_ZINPUT_NBLK];
+  char *blk[MCDB_ZINPUT_NBLK];
+ #endif
+};
+
+/* inflate up to len bytes into dst (fewer only at end of input or on error)*/
+static size_t
+mcdb_zinput_inflate (struct mcdb_zinput * const restrict z,
+                     char * const restrict dst, size_t len)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static size_t
+mcdb_zinput_inflate (struct mcdb_zinput * const restrict z,
+                     char * const restrict dst, size_t len)
+{
+    z_stream * const zs = &z->zs;
+    ssize_t r;
+    int rc;
+    if (len > INT_MAX)
+        len = INT_MAX;
+    zs->next_out  = (Bytef *)dst;
+    zs->avail_out = (uInt)len;
+    while (zs->avail_out != 0 && !z->eof) {
+        if (zs->avail_in == 0) {
+            retry_eintr_do_while(
+              (r = read(z->fd, z->in, MCDB_ZINPUT_INSZ)), (r == -1));
+            if (r <= 0) {
+                z->err = (r == 0) ? EIO : errno;  /*(EIO: truncated input)*/
+                z->eof = true;
+                break;
+            }
+            zs->next_in  = z->in;
+            zs->avail_in = (uInt)r;
+        }
+        rc = inflate(zs, Z_NO_FLUSH);
+        if (rc == Z_STREAM_END) {
+            /* end of gzip member; end of input or next member follows */
+            if (zs->avail_in == 0) {
+                retry_eintr_do_while(
+                  (r = read(z->fd, z->in, MCDB_ZINPUT_INSZ)), (r == -1));
+                if (r <= 0) {
+                    z->err = (r == 0) ? 0 : errno;
+                    z->eof = true;
+                    break;
+                }
+                zs->next_in  = z->in;
+                zs->avail_in = (uInt)r;
+            }
+            rc = inflateReset(zs);
+        }
+        if (rc != Z_OK && rc != Z_BUF_ERROR) {
+            z->err = (rc == Z_MEM_ERROR) ? ENOMEM : EIO; /*(EIO: invalid data)*/
+            z->eof = true;
+        }
+    }
+    return len - zs->avail_out;
+}
+
+#ifdef _THREAD_SAFE
+
+static void *
+mcdb_zinput_thread (void * const arg)
+  __attribute_nonnull__;
+static void *
+mcdb_zinput_thread (void * const arg)
+{
+    struct mcdb_zinput * const restrict z = (struct mcdb_zinput *)arg;
+    size_t i, n;
+    bool stop;
+    do {
+        pthread_mutex_lock(&z->mutex);
+        while (z->nfull == MCDB_ZINPUT_NBLK && !z->stop)
+            pthread_cond_wait(&z->cond_free, &z->mutex);
+        stop = z->stop;
+        pthread_mutex_unlock(&z->mutex);
+        if (stop)
+            break;
+        i = z->pi;
+        n = mcdb_zinput_inflate(z, z->blk[i], MCDB_ZINPUT_BLKSZ);
+        pthread_mutex_lock(&z->mutex);
+        if (n != 0) {
+            z->blen[i] = n;
+            z->pi = (i + 1) % MCDB_ZINPUT_NBLK;
+            ++z->nfull;
+        }
+        z->done = z->eof;
+        pthread_cond_signal(&z->cond_full);
+        pthread_mutex_unlock(&z->mutex);
+    } while (!z->eof);
+    return NULL;
+}
+
+/* copy from next block inflated by thread (waits for block if none ready) */
+static ssize_t
+mcdb_zinput_read_blk (struct mcdb_zinput * const restrict z,
+                      char * const restrict dst, size_t len)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static ssize_t
+mcdb_zinput_read_blk (struct mcdb_zinput * const restrict z,
+                      char * const restrict dst, size_t len)
+{
+    size_t n;
+    pthread_mutex_lock(&z->mutex);
+    while (z->nfull == 0 && !z->done)
+        pthread_cond_wait(&z->cond_full, &z->mutex);
+    n = z->nfull;
+    pthread_mutex_unlock(&z->mutex);
+    if (n == 0)
+        return z->err == 0 ? 0 : (errno = z->err, (ssize_t)-1);
+    if (len > z->blen[z->ci] - z->co)
+        len = z->blen[z->ci] - z->co;
+    memcpy(dst, z->blk[z->ci] + z->co, len);
+    if ((z->co += len) == z->blen[z->ci]) {
+        z->co = 0;
+        z->ci = (z->ci + 1) % MCDB_ZINPUT_NBLK;
+        pthread_mutex_lock(&z->mutex);
+        --z->nfull;
+        pthread_cond_signal(&z->cond_free);
+        pthread_mutex_unlock(&z->mutex);
+    }
+    return (ssize_t)len;
+}
+
+#endif /* _THREAD_SAFE */
+
+/* read() replacement for compressed input: inflated data into dst */
+static ssize_t
+mcdb_zinput_read (struct mcdb_zinput * const restrict z,
+                  char * const restrict dst, const size_t len)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static ssize_t
+mcdb_zinput_read (struct mcdb_zinput * const restrict z,
+                  char * const restrict dst, const size_t len)
+{
+    ssize_t r;
+  #ifdef _THREAD_SAFE
+    if (z->threaded)
+        r = mcdb_zinput_read_blk(z, dst, len);
+    else
+  #endif
+    {
+        const size_t n =
+          (!z->eof && len != 0) ? mcdb_zinput_inflate(z, dst, len) : 0;
+        r = (n != 0 || z->err == 0) ? (ssize_t)n : (errno = z->err, -1);
+    }
+    if (r == -1)
+        z->rderr = errno;
+    return r;
+}
+
+/* begin inflating compressed input fd (pre: prelen bytes already read) */
+__attribute_noinline__
+static struct mcdb_zinput *
+mcdb_zinput_start (struct mcdb_make * const restrict m, const int fd,
+                   const char * const restrict pre, const size_t prelen)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static struct mcdb_zinput *
+mcdb_zinput_start (struct mcdb_make * const restrict m, const int fd,
+                   const char * const restrict pre, const size_t prelen)
+{
+    struct mcdb_zinput * const restrict z =
+      m->fn_malloc(sizeof(struct mcdb_zinput));
+    if (z == NULL)
+        return NULL;
+    memset(z, 0, sizeof(struct mcdb_zinput));
+    z->fd   = fd;
+    z->insz = (prelen > MCDB_ZINPUT_INSZ) ? prelen : MCDB_ZINPUT_INSZ;
+    if ((z->in = m->fn_malloc(z->insz)) == NULL) {
+        m->fn_free(z);
+        return NULL;
+    }
+    memcpy(z->in, pre, prelen);
+    z->zs.next_in  = z->in;
+    z->zs.avail_in = (uInt)prelen;
+    if (inflateInit2(&z->zs, 16 + MAX_WBITS) != Z_OK) { /*(gzip)*/
+        m->fn_free(z->in);
+        m->fn_free(z);
+        return (errno = ENOMEM, NULL);
+    }
+  #ifdef _THREAD_SAFE
+    z->blk[0] = m->fn_malloc(MCDB_ZINPUT_NBLK * MCDB_ZINPUT_BLKSZ);
+    if (z->blk[0] != NULL) {
+        size_t i;
+        for (i = 1; i < MCDB_ZINPUT_NBLK; ++i)
+            z->blk[i] = z->blk[0] + i * MCDB_ZINPUT_BLKSZ;
+        if (0 == pthread_mutex_init(&z->mutex, NULL)) {
+            if (0 == pthread_cond_init(&z->cond_full, NULL)) {
+                if (0 == pthread_cond_init(&z->cond_free, NULL)) {
+                    z->threaded = (0 == pthread_create(&z->tid, NULL,
+                                                       mcdb_zinput_thread, z));
+                    if (!z->threaded)
+                        pthread_cond_destroy(&z->cond_free);
+                }
+                if (!z->threaded)
+                    pthread_cond_destroy(&z->cond_full);
+            }
+            if (!z->threaded)
+                pthread_mutex_destroy(&z->mutex);
+        }
+        if (!z->threaded) {  /*(inflate in this thread)*/
+            m->fn_free(z->blk[0]);
+            z->blk[0] = NULL;
+        }
+    }
+  #endif
+    return z;
+}
+
+__attribute_noinline__
+static void
+mcdb_zinput_end (struct mcdb_make * const restrict m,
+                 struct mcdb_zinput * const restrict z)
+  __attribute_nonnull__;
+__attribute_noinline__
+static void
+mcdb_zinput_end (struct mcdb_make * const restrict m,
+                 struct mcdb_zinput * const restrict z)
+{
+    const int errsave = errno;
+  #ifdef _THREAD_SAFE
+    if (z->threaded) {
+        pthread_mutex_lock(&z->mutex);
+        z->stop = true;
+        pthread_cond_signal(&z->cond_free);
+        pthread_mutex_unlock(&z->mutex);
+        pthread_join(z->tid, NULL);
+        pthread_cond_destroy(&z->cond_free);
+        pthread_cond_destroy(&z->cond_full);
+        pthread_mutex_destroy(&z->mutex);
+        m->fn_free(z->blk[0]);
+    }
+  #endif
+    inflateEnd(&z->zs);
+    m->fn_free(z->in);
+    m->fn_free(z);
+    errno = errsave;
+}
+
+#endif /* MCDB_ZLIB */
+
+/* read() more input at dst (from fd, or inflated data if compressed input) */
+static ssize_t
+mcdb_bufread_src (struct mcdb_input * const restrict b,
+                  char * const restrict dst, const size_t len)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static ssize_t
+mcdb_bufread_src (struct mcdb_input * const restrict b,
+                  char * const restrict dst, const size_t len)
+{
+    ssize_t r;
+  #ifdef MCDB_ZLIB
+    if (b->z != NULL)
+        return mcdb_zinput_read(b->z, dst, len);
+  #endif
+    retry_eintr_do_while((r = read(b->fd, dst, len)), (r == -1));
+    return r;
+}
+
 __attribute_noinline__
 static ssize_t
 mcdb_bufread_fd (struct mcdb_input * const restrict b)
@@ -94,8 +399,7 @@ mcdb_bufread_fd (struct mcdb_input * const restrict b)
             memmove(b->buf, b->buf + b->pos, b->datasz);
         b->pos = 0;
     }
-    retry_eintr_do_while(
-      (r = read(b->fd, b->buf + b->datasz, b->bufsz - b->datasz)), (r == -1));
+    r = mcdb_bufread_src(b, b->buf + b->datasz, b->bufsz - b->datasz);
     if (r > 0) b->datasz += r;
     return r;
 }
@@ -228,13 +532,662 @@ mcdb_bufread_rec (struct mcdb_make * const restrict m,
 }
 
 
+/* scan decimal number of 1..7 digits at s (caller ensures 8 bytes readable)
+ * (caller falls back to mcdb_bufread_number() for longer numbers)
+ * returns pointer to char following digits, or NULL if no digits or too long */
+static inline const char *
+mcdb_scan_number (const char * restrict s, uint32_t * const restrict rv)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static inline const char *
+mcdb_scan_number (const char * restrict s, uint32_t * const restrict rv)
+{
+    const char * const e = s + 7;
+    uint32_t num = (uint32_t)(*s - '0');
+    uint32_t n;
+    if (num > 9u)
+        return NULL;
+    while ((n = (uint32_t)(*++s - '0')) <= 9u && s != e)
+        num = num * 10 + n;
+    *rv = num;
+    return (n > 9u) ? s : NULL;
+}
+
+/* parse and add run of records entirely contained in buffer (frequent path)
+ * Scans "+nnnn,mmmm:" and then checks "->" and "\n" at positions given by
+ * lengths, without per-record bounds checks on each char or calls through
+ * mcdb_bufread_preamble().  Stops at first record not entirely buffered or
+ * not matching fast path, e.g. end of input, numbers longer than 7 digits,
+ * or format error, leaving b->pos at beginning of that record for
+ * mcdb_bufread_preamble() and mcdb_bufread_rec() to handle (and to report
+ * any error).  Returns false if mcdb_make_add_h() fails. */
+static bool
+mcdb_bufread_recs (struct mcdb_make * const restrict m,
+                   struct mcdb_input * const restrict b)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdb_bufread_recs (struct mcdb_make * const restrict m,
+                   struct mcdb_input * const restrict b)
+{
+    const char * const buf = b->buf;
+    const char * const end = buf + b->datasz;
+    const char * const lim = (b->lim < b->datasz) ? buf + b->lim : end;
+    const char *p = buf + b->pos;
+    const char *q;
+    uint32_t klen, dlen;
+    /*(24 bytes: "+nnnnnnn,mmmmmmm:" max 17 chars with 7-digit nums, + 7)*/
+    while (p < lim && end - p >= 24 && *p == '+') {
+        if ((q = mcdb_scan_number(p+1, &klen)) == NULL || *q != ','
+            || (q = mcdb_scan_number(q+1, &dlen)) == NULL || *q != ':')
+            break;
+        ++q;
+        if ((size_t)(end - q) < (size_t)klen + dlen + 3
+            || q[klen] != '-' || q[klen+1] != '>' || q[klen+2+dlen] != '\n')
+            break;
+        if (__builtin_expect( (mcdb_make_add_h(m, q, klen, q+klen+2, dlen)
+                               != 0), 0)) {
+            b->pos = (size_t)(p - buf);
+            return false;
+        }
+        p = q + klen + dlen + 3;
+    }
+    b->pos = (size_t)(p - buf);
+    return true;
+}
+
+
+/* parse records from b and add to m until end of input (blank line)
+ * (or until first record at or after b->lim; returns 1 (true) if stopped) */
+static int
+mcdb_bufread_input (struct mcdb_make * const restrict m,
+                    struct mcdb_input * const restrict b)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdb_bufread_input (struct mcdb_make * const restrict m,
+                    struct mcdb_input * const restrict b)
+{
+    size_t klen;
+    size_t dlen;
+    int rv;
+
+    for (;;) {
+
+        /* optimized frequent path: run of records buffered and available */
+        if (!mcdb_bufread_recs(m, b))  return MCDB_ERROR_WRITE;
+
+        if (b->pos >= b->lim)          return true;
+
+        if ((rv = mcdb_bufread_preamble(b,&klen,&dlen)) <= 0)
+            return rv;
+
+        /* entire data line buffered and available */
+        /* (klen and dlen checked < INT_MAX-8; no integer overflow possible) */
+        if (klen + dlen + 3 <= b->datasz - b->pos) {
+            const char * const p = b->buf + b->pos;
+            if (p[klen] == '-' && p[klen+1] == '>' && p[klen+2+dlen] == '\n') {
+                if (mcdb_make_add_h(m, p, klen, p+klen+2, dlen) == 0)
+                    b->pos += klen + dlen + 3;
+                else   return MCDB_ERROR_WRITE;
+            } else     return MCDB_ERROR_READFORMAT;
+        }
+        else { /* entire data line is not buffered; handle in parts */
+            if (mcdb_make_addbegin_h(m, klen, dlen) == 0) {
+                if (mcdb_bufread_rec(m, klen, dlen, b))
+                    mcdb_make_addend_h(m);
+                else   return MCDB_ERROR_READFORMAT;
+            } else     return MCDB_ERROR_WRITE;
+        }
+
+    }
+}
+
+
+/* line formats (struct mcdb_makefmt_input; see mcdb_makefmt.h)
+ * Key and data are added directly from input buffer; data not contiguous in
+ * line (key field removed) is added in two parts with mcdb_make_addbuf_data().
+ * Only a key of NDJSON string containing escapes is copied (unescaped). */
+
+struct mcdb_keybuf {
+  char *buf;
+  size_t sz;
+};
+
+static inline const char *
+mcdb_json_ws (const char *p, const char * const e)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static inline const char *
+mcdb_json_ws (const char *p, const char * const e)
+{
+    while (p != e && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+    return p;
+}
+
+/* end of JSON string beginning at p ('"') (returns pointer following closing
+ * '"', or NULL if not terminated); *esc set true if string contains escapes */
+static const char *
+mcdb_json_strend (const char *p, const char * const e, bool * const esc)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static const char *
+mcdb_json_strend (const char *p, const char * const e, bool * const esc)
+{
+    while (++p != e) {
+        if (*p == '"')
+            return p+1;
+        if (*p == '\\') {
+            *esc = true;
+            if (++p == e)
+                break;
+        }
+    }
+    return NULL;
+}
+
+/* end of JSON value beginning at p (nesting and strings tracked, else value
+ * is not validated) (returns NULL if object or array not terminated) */
+static const char *
+mcdb_json_valend (const char *p, const char * const e)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static const char *
+mcdb_json_valend (const char *p, const char * const e)
+{
+    size_t depth = 0;
+    bool esc;
+    while (p != e) {
+        switch (*p) {
+          case '"':
+            if ((p = mcdb_json_strend(p, e, &esc)) == NULL)
+                return NULL;
+            if (depth == 0)
+                return p;
+            continue;
+          case '{': case '[':
+            ++depth;
+            break;
+          case '}': case ']':
+            if (depth == 0)
+                return p;     /*(end of scalar)*/
+            if (--depth == 0)
+                return p+1;
+            break;
+          case ',': case ' ': case '\t': case '\r':
+            if (depth == 0)
+                return p;     /*(end of scalar)*/
+            break;
+          default:
+            break;
+        }
+        ++p;
+    }
+    return (depth == 0) ? p : NULL;
+}
+
+static bool
+mcdb_json_hex4 (const char * const restrict s, const char * const e,
+                uint32_t * const restrict rv)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdb_json_hex4 (const char * const restrict s, const char * const e,
+                uint32_t * const restrict rv)
+{
+    uint32_t c = 0;
+    int i;
+    if (e - s < 4)
+        return false;
+    for (i = 0; i < 4; ++i) {
+        const uint32_t x = (uint32_t)(unsigned char)s[i];
+        if (x - '0' <= 9u)
+            c = (c << 4) | (x - '0');
+        else if ((x | 0x20) - 'a' <= 5u)
+            c = (c << 4) | ((x | 0x20) - 'a' + 10);
+        else
+            return false;
+    }
+    *rv = c;
+    return true;
+}
+
+/* unescape JSON string contents [s,e) into kb (UTF-8) (never longer than
+ * escaped string) (returns length, or -1 if invalid escape or malloc fails) */
+__attribute_noinline__
+static ssize_t
+mcdb_json_unescape (const char *s, const char * const e,
+                    struct mcdb_keybuf * const restrict kb,
+                    struct mcdb_make * const restrict m)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static ssize_t
+mcdb_json_unescape (const char *s, const char * const e,
+                    struct mcdb_keybuf * const restrict kb,
+                    struct mcdb_make * const restrict m)
+{
+    char *d;
+    uint32_t c, c2;
+    if (kb->sz < (size_t)(e - s)) {
+        if (kb->buf != NULL)
+            m->fn_free(kb->buf);
+        kb->sz = 0;
+        if ((kb->buf = m->fn_malloc((size_t)(e - s))) == NULL)
+            return (errno = ENOMEM, -1);
+        kb->sz = (size_t)(e - s);
+    }
+    for (d = kb->buf; s != e; ) {
+        if (*s != '\\') {
+            *d++ = *s++;
+            continue;
+        }
+        if (++s == e)
+            return -1;
+        switch (*s++) {
+          case '"':  *d++ = '"';  break;
+          case '\\': *d++ = '\\'; break;
+          case '/':  *d++ = '/';  break;
+          case 'b':  *d++ = '\b'; break;
+          case 'f':  *d++ = '\f'; break;
+          case 'n':  *d++ = '\n'; break;
+          case 'r':  *d++ = '\r'; break;
+          case 't':  *d++ = '\t'; break;
+          case 'u':
+            if (!mcdb_json_hex4(s, e, &c))
+                return -1;
+            s += 4;
+            if (c - 0xD800u < 0x400u) { /*(surrogate pair)*/
+                if (e - s < 6 || s[0] != '\\' || s[1] != 'u'
+                    || !mcdb_json_hex4(s+2, e, &c2) || c2 - 0xDC00u >= 0x400u)
+                    return -1;
+                s += 6;
+                c = 0x10000u + ((c - 0xD800u) << 10) + (c2 - 0xDC00u);
+            }
+            else if (c - 0xDC00u < 0x400u)
+                return -1;
+            if (c < 0x80u)
+                *d++ = (char)c;
+            else if (c < 0x800u) {
+                *d++ = (char)(0xC0u | (c >> 6));
+                *d++ = (char)(0x80u | (c & 0x3Fu));
+            }
+            else if (c < 0x10000u) {
+                *d++ = (char)(0xE0u | (c >> 12));
+                *d++ = (char)(0x80u | ((c >> 6) & 0x3Fu));
+                *d++ = (char)(0x80u | (c & 0x3Fu));
+            }
+            else {
+                *d++ = (char)(0xF0u | (c >> 18));
+                *d++ = (char)(0x80u | ((c >> 12) & 0x3Fu));
+                *d++ = (char)(0x80u | ((c >> 6) & 0x3Fu));
+                *d++ = (char)(0x80u | (c & 0x3Fu));
+            }
+            break;
+          default:
+            return -1;
+        }
+    }
+    return (ssize_t)(d - kb->buf);
+}
+
+/* key of NDJSON line [p,e): value of top-level member in->keyname
+ * (string value without quotes (unescaped into kb if escaped), or scalar) */
+static int
+mcdb_json_key (const char *p, const char * const e,
+               const struct mcdb_makefmt_input * const in,
+               struct mcdb_keybuf * const restrict kb,
+               struct mcdb_make * const restrict m,
+               const char ** const restrict k, size_t * const restrict klen)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdb_json_key (const char *p, const char * const e,
+               const struct mcdb_makefmt_input * const in,
+               struct mcdb_keybuf * const restrict kb,
+               struct mcdb_make * const restrict m,
+               const char ** const restrict k, size_t * const restrict klen)
+{
+    const char *n, *v;
+    size_t nlen;
+    bool esc;
+    p = mcdb_json_ws(p, e);
+    if (p == e || *p != '{')
+        return MCDB_ERROR_READFORMAT;
+    p = mcdb_json_ws(p+1, e);
+    while (p != e && *p == '"') {
+        n = p + 1;
+        esc = false;
+        if ((p = mcdb_json_strend(p, e, &esc)) == NULL)
+            break;
+        nlen = (size_t)(p - 1 - n);
+        p = mcdb_json_ws(p, e);
+        if (p == e || *p != ':')
+            break;
+        v = mcdb_json_ws(p+1, e);
+        esc = false;
+        if (v == e
+            || (p = (*v == '"')
+                    ? mcdb_json_strend(v, e, &esc)
+                    : mcdb_json_valend(v, e)) == NULL
+            || p == v)
+            break;
+        if (nlen == in->keynamelen && 0 == memcmp(n, in->keyname, nlen)) {
+            if (*v == '{' || *v == '[')
+                break;  /*(key must be string or scalar)*/
+            if (*v != '"') {
+                *k = v;
+                *klen = (size_t)(p - v);
+            }
+            else if (!esc) {
+                *k = v + 1;
+                *klen = (size_t)(p - 1 - (v + 1));
+            }
+            else {
+                const ssize_t len = mcdb_json_unescape(v+1, p-1, kb, m);
+                if (len == -1)
+                    return (kb->buf == NULL && errno == ENOMEM)
+                      ? MCDB_ERROR_MALLOC
+                      : MCDB_ERROR_READFORMAT;
+                *k = kb->buf;
+                *klen = (size_t)len;
+            }
+            return true;
+        }
+        p = mcdb_json_ws(p, e);
+        if (p == e || *p != ',')
+            break;
+        p = mcdb_json_ws(p+1, e);
+    }
+    return MCDB_ERROR_READFORMAT;  /*(invalid or key member not found)*/
+}
+
+/* (separate routine for less frequent code path: line not entirely buffered)
+ * (returns > 0 if more data read; 0 at end of input (or mmap); -1 on error) */
+__attribute_noinline__
+static ssize_t
+mcdb_bufread_line_fill (struct mcdb_input * const restrict b)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static ssize_t
+mcdb_bufread_line_fill (struct mcdb_input * const restrict b)
+{
+    ssize_t r;
+    if (b->fd == -1) return 0;  /* we use fd == -1 as flag for mmap */
+    if (b->pos != 0) {
+        if ((b->datasz -= b->pos))
+            memmove(b->buf, b->buf + b->pos, b->datasz);
+        b->pos = 0;
+    }
+    r = mcdb_bufread_src(b, b->buf + b->datasz, b->bufsz - b->datasz);
+    if (r > 0) b->datasz += r;
+    return r;
+}
+
+/* parse lines from b in format in and add to m until end of input
+ * (or until first line at or after b->lim; returns 1 (true) if stopped) */
+static int
+mcdb_bufread_lines (struct mcdb_make * const restrict m,
+                    struct mcdb_input * const restrict b,
+                    const struct mcdb_makefmt_input * const in)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdb_bufread_lines (struct mcdb_make * const restrict m,
+                    struct mcdb_input * const restrict b,
+                    const struct mcdb_makefmt_input * const in)
+{
+    struct mcdb_keybuf kb = { NULL, 0 };
+    const char *line, *e, *k = NULL, *d1 = NULL, *d2 = NULL;
+    size_t len, klen = 0, d1len = 0, d2len = 0;
+    int rv = EXIT_SUCCESS;
+
+    while (b->pos < b->lim) {
+        line = b->buf + b->pos;
+        len = b->datasz - b->pos;
+        if ((e = memchr(line, '\n', len)) != NULL)
+            b->pos += (size_t)(e - line) + 1;
+        else if (b->fd != -1) {
+            ssize_t r;
+            if (b->pos == 0 && b->datasz == b->bufsz) {
+                rv = MCDB_ERROR_READFORMAT;  /*(line does not fit in buf)*/
+                break;
+            }
+            if ((r = mcdb_bufread_line_fill(b)) > 0)
+                continue;
+            if (r == -1) {
+                rv = MCDB_ERROR_READ;
+                break;
+            }
+            if (b->pos == b->datasz)
+                break;                       /*(end of input)*/
+            line = b->buf + b->pos;          /*(last line without '\n')*/
+            e = b->buf + b->datasz;
+            b->pos = b->datasz;
+        }
+        else if (len != 0) {
+            e = line + len;                  /*(last line without '\n')*/
+            b->pos = b->datasz;
+        }
+        else
+            break;                           /*(end of input)*/
+
+        if (e != line && e[-1] == '\r')
+            --e;
+        if (e == line)
+            continue;                        /*(skip empty line)*/
+        len = (size_t)(e - line);
+
+        switch (in->fmt) {
+          case MCDB_MAKEFMT_DELIM: {
+            const char *f = line, *fe;
+            uint32_t col = in->keycol;
+            while (--col && (fe = memchr(f, in->delim, (size_t)(e-f))) != NULL)
+                f = fe + 1;
+            if (col != 0) {
+                rv = MCDB_ERROR_READFORMAT;  /*(fewer than keycol fields)*/
+                break;
+            }
+            if ((fe = memchr(f, in->delim, (size_t)(e - f))) == NULL)
+                fe = e;
+            k = f;
+            klen = (size_t)(fe - f);
+            if (f == line) {
+                d1 = (fe != e) ? fe + 1 : e;
+                d1len = (size_t)(e - d1);
+                d2 = e;
+                d2len = 0;
+            }
+            else {
+                d1 = line;
+                d1len = (size_t)(f - 1 - line);
+                d2 = fe;
+                d2len = (size_t)(e - fe);
+            }
+            break;
+          }
+          case MCDB_MAKEFMT_NDJSON:
+            rv = mcdb_json_key(line, e, in, &kb, m, &k, &klen);
+            d1 = line;
+            d1len = len;
+            d2 = e;
+            d2len = 0;
+            break;
+          default: /* MCDB_MAKEFMT_FIXED */
+            if (len <= in->keyoff) {
+                rv = MCDB_ERROR_READFORMAT;  /*(line ends before key)*/
+                break;
+            }
+            k = line + in->keyoff;
+            klen = (len - in->keyoff < in->keylen)
+              ? len - in->keyoff
+              : in->keylen;
+            d1 = line;
+            d1len = in->keyoff;
+            d2 = k + klen;
+            d2len = (size_t)(e - d2);
+            while (klen != 0 && k[klen-1] == ' ')
+                --klen;
+            break;
+        }
+        if (rv < 0)
+            break;
+        rv = EXIT_SUCCESS;
+
+        if (d2len == 0
+            ? mcdb_make_add_h(m, k, klen, d1, d1len) != 0
+            : mcdb_make_addbegin_h(m, klen, d1len + d2len) != 0) {
+            rv = MCDB_ERROR_WRITE;
+            break;
+        }
+        if (d2len != 0) {
+            mcdb_make_addbuf_key_h(m, k, klen);
+            mcdb_make_addbuf_data_h(m, d1, d1len);
+            mcdb_make_addbuf_data_h(m, d2, d2len);
+            mcdb_make_addend_h(m);
+        }
+    }
+
+    if (kb.buf != NULL)
+        m->fn_free(kb.buf);
+    return (rv == EXIT_SUCCESS && b->pos >= b->lim) ? true : rv;
+}
+
+/* parse input from b in format in (cdbmake format if in is NULL) */
+static int
+mcdb_bufread_fmt (struct mcdb_make * const restrict m,
+                  struct mcdb_input * const restrict b,
+                  const struct mcdb_makefmt_input * const in)
+  __attribute_nonnull_x__((1,2))  __attribute_warn_unused_result__;
+static int
+mcdb_bufread_fmt (struct mcdb_make * const restrict m,
+                  struct mcdb_input * const restrict b,
+                  const struct mcdb_makefmt_input * const in)
+{
+    return (in == NULL || in->fmt == MCDB_MAKEFMT_CDB)
+      ? mcdb_bufread_input(m, b)
+      : mcdb_bufread_lines(m, b, in);
+}
+
+
 /* Above are private data struct, static routines used by mcdb_makefmt_fdintofd
  *   struct mcdb_input
+ *   mcdb_bufread_input()
+ *   mcdb_bufread_recs()
  *   mcdb_bufread_preamble()
  *   mcdb_bufread_rec()
- */ 
+ *   mcdb_bufread_lines()  (line formats; struct mcdb_makefmt_input)
+ */
 
 
+/* Note: caller must call mcdb_make_start() prior to calling
+ * mcdb_makefmt_fdintomcdb(), and then mcdb_make_finish() upon success, or else
+ * mcdb_make_destroy() upon error.  Between mcdb_make_start() and
+ * mcdb_makefmt_fdintomcdb(), caller may modify mcdb_make settings,
+ * e.g. hash_fn and hash_init */
+__attribute_noinline__
+int
+mcdb_makefmt_fdintomcdb (struct mcdb_make * const restrict m,
+                         const int inputfd,
+                         char * const restrict buf,
+                         const size_t bufsz)
+{
+    return mcdb_makefmt_fdintomcdb_fmt(m, inputfd, buf, bufsz, NULL);
+}
+
+static bool
+mcdb_makefmt_input_valid (const struct mcdb_makefmt_input * const in)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdb_makefmt_input_valid (const struct mcdb_makefmt_input * const in)
+{
+    switch (in->fmt) {
+      case MCDB_MAKEFMT_CDB:
+        return true;
+      case MCDB_MAKEFMT_DELIM:
+        return (in->keycol != 0 && in->delim != '\n');
+      case MCDB_MAKEFMT_NDJSON:
+        return (in->keyname != NULL);
+      case MCDB_MAKEFMT_FIXED:
+        return (in->keylen != 0);
+      default:
+        return false;
+    }
+}
+
+/* compressed input format by magic bytes at beginning of input
+ * (1: gzip; 2: zstd (not supported); 0: not compressed) */
+static int
+mcdb_makefmt_zmagic (const unsigned char * const restrict p, const size_t n)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdb_makefmt_zmagic (const unsigned char * const restrict p, const size_t n)
+{
+    if (n >= 2 && p[0] == 0x1f && p[1] == 0x8b)
+        return 1;
+    if (n >= 4 && p[0] == 0x28 && p[1] == 0xb5 && p[2] == 0x2f && p[3] == 0xfd)
+        return 2;
+    return 0;
+}
+
+/* parse input in format in (see mcdb_makefmt.h) (cdbmake format if in NULL)
+ * (input fd beginning with gzip magic bytes is inflated as it is parsed)
+ * (see notes above mcdb_makefmt_fdintomcdb() for caller responsibilities) */
+__attribute_noinline__
+int
+mcdb_makefmt_fdintomcdb_fmt (struct mcdb_make * const restrict m,
+                             const int inputfd,
+                             char * const restrict buf,
+                             const size_t bufsz,
+                             const struct mcdb_makefmt_input * const in)
+{
+    struct mcdb_input b = { buf, 0, 0, bufsz, inputfd, SIZE_MAX, NULL };
+    int rv;
+
+    if (in != NULL && !mcdb_makefmt_input_valid(in)) {
+        errno = EINVAL;
+        return MCDB_ERROR_USAGE;
+    }
+
+    if (b.fd == -1)  /* we use fd == -1 as flag for mmap */
+        b.datasz = b.bufsz;
+    else {
+        /* read beginning of input to check for compressed input */
+        ssize_t r = 0;
+        while (b.datasz < 4 && b.datasz < b.bufsz) {
+            retry_eintr_do_while(
+              (r = read(b.fd, b.buf + b.datasz, b.bufsz - b.datasz)),
+              (r == -1));
+            if (r <= 0)
+                break;
+            b.datasz += (size_t)r;
+        }
+        if (r == -1)
+            return MCDB_ERROR_READ;
+        switch (mcdb_makefmt_zmagic((unsigned char *)b.buf, b.datasz)) {
+          case 0:
+            break;
+          case 1:
+          #ifdef MCDB_ZLIB
+            if ((b.z = mcdb_zinput_start(m, b.fd, b.buf, b.datasz)) == NULL)
+                return MCDB_ERROR_MALLOC;
+            b.datasz = 0;
+            break;
+          #endif
+          default:
+            errno = ENOTSUP;
+            return MCDB_ERROR_READ;
+        }
+    }
+
+    errno = 0;
+
+    rv = mcdb_bufread_fmt(m, &b, in);
+  #ifdef MCDB_ZLIB
+    if (b.z != NULL) {
+        /*(truncated or invalid compressed input ending within record)*/
+        const int rderr = b.z->rderr;
+        mcdb_zinput_end(m, b.z);
+        if (rv == MCDB_ERROR_READFORMAT && rderr != 0) {
+            errno = rderr;
+            rv = MCDB_ERROR_READ;
+        }
+    }
+  #endif
+    return rv;
+}
+
 __attribute_noinline__
 int
 mcdb_makefmt_fdintofd (const int inputfd,
@@ -244,41 +1197,13 @@ mcdb_makefmt_fdintofd (const int inputfd,
                        void * (* const fn_malloc)(size_t),
                        void (* const fn_free)(void *))
 {
-    struct mcdb_input b = { buf, 0, 0, bufsz, inputfd };
     struct mcdb_make m;
-    size_t klen;
-    size_t dlen;
     int rv;
 
-    errno = 0;
-
     if (mcdb_make_start(&m, outputfd, fn_malloc, fn_free) == -1)
         return MCDB_ERROR_WRITE;
 
-    if (b.fd == -1)  /* we use fd == -1 as flag for mmap */
-        b.datasz = b.bufsz;
-
-    while ((rv = mcdb_bufread_preamble(&b,&klen,&dlen)) > 0) {
-
-        /* optimized frequent path: entire data line buffered and available */
-        /* (klen and dlen checked < INT_MAX-8; no integer overflow possible) */
-        if (klen + dlen + 3 <= b.datasz - b.pos) {
-            const char * const p = b.buf + b.pos;
-            if (p[klen] == '-' && p[klen+1] == '>' && p[klen+2+dlen] == '\n') {
-                if (mcdb_make_add_h(&m, p, klen, p+klen+2, dlen) == 0)
-                    b.pos += klen + dlen + 3;
-                else { rv = MCDB_ERROR_WRITE;      break; }
-            } else {   rv = MCDB_ERROR_READFORMAT; break; }
-        }
-        else { /* entire data line is not buffered; handle in parts */
-            if (mcdb_make_addbegin_h(&m, klen, dlen) == 0) {
-                if (mcdb_bufread_rec(&m, klen, dlen, &b))
-                    mcdb_make_addend_h(&m);
-                else { rv = MCDB_ERROR_READFORMAT; break; }
-            } else {   rv = MCDB_ERROR_WRITE;      break; }
-        }
-
-    }
+    rv = mcdb_makefmt_fdintomcdb(&m, inputfd, buf, bufsz);
 
     if (rv == EXIT_SUCCESS)
         return (mcdb_make_finish(&m) == 0) ? EXIT_SUCCESS : MCDB_ERROR_WRITE;
@@ -321,22 +1246,275 @@ mcdb_makefmt_fdintofile (const int inputfd,
     return rv;
 }
 
+#ifdef _THREAD_SAFE
+
+/* parallel parse of mmap'd input (m->nthreads, m->scratch)
+ * Input is split into chunks (of at least MCDB_MAKEFMT_CHUNK_MIN bytes), each
+ * beginning at a plausible record boundary ("\n+") following the nominal
+ * chunk offset, and each chunk is parsed by a thread into its own writer
+ * (mcdb_make_writer_start()).  Thread parsing chunk i stops at first record
+ * at or after beginning of chunk i+1, which must be exactly the beginning of
+ * chunk i+1; since first chunk begins at beginning of input, all chunks are
+ * then validated to begin at record boundaries.  If not (e.g. data
+ * resembling a record boundary), or if any chunk has a format error, or if
+ * end of input (blank line) is found before last chunk, writers are
+ * discarded and input is parsed serially (reporting any error as would
+ * serial parse).  Writers are merged (in order) by mcdb_make_finish(). */
+
+#define MCDB_MAKEFMT_CHUNK_MIN (1u << 20)
+
+struct mcdb_makefmt_chunk {
+  struct mcdb_input b;
+  const struct mcdb_makefmt_input *in;
+  struct mcdb_make *w;
+  pthread_t tid;
+  int started;
+  int rv;
+};
+
+static void *
+mcdb_makefmt_chunk_thread (void * const arg)
+  __attribute_nonnull__;
+static void *
+mcdb_makefmt_chunk_thread (void * const arg)
+{
+    struct mcdb_makefmt_chunk * const restrict c =
+      (struct mcdb_makefmt_chunk *)arg;
+    errno = 0;
+    c->rv = mcdb_bufread_fmt(c->w, &c->b, c->in);
+    return NULL;
+}
+
+/* offset of first plausible record boundary at or after off (0 < off)
+ * (record "+nnnn,mmmm:xxxx->yyyy\n" following '\n') (returns sz if none)
+ * (line formats: beginning of line at or after off is a record boundary) */
+static size_t
+mcdb_makefmt_resync (const char * const restrict x, const size_t sz,
+                     size_t off, const bool lines)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static size_t
+mcdb_makefmt_resync (const char * const restrict x, const size_t sz,
+                     size_t off, const bool lines)
+{
+    const char *p;
+    size_t klen, dlen;
+    if (lines)
+        return (off < sz && (p = memchr(x+off-1, '\n', sz-off)) != NULL)
+          ? (size_t)(p - x) + 1
+          : sz;
+    while (off < sz && (p = memchr(x+off-1, '\n', sz-off)) != NULL) {
+        struct mcdb_input b = { (char *)(uintptr_t)p, 2, sz-(size_t)(p-x),
+                                sz-(size_t)(p-x), -1, SIZE_MAX };
+        off = (size_t)(p - x) + 1;
+        if (x[off] == '+'
+            && mcdb_bufread_number(&b, &klen)
+            && b.pos != b.datasz && b.buf[b.pos++] == ','
+            && mcdb_bufread_number(&b, &dlen)
+            && b.pos != b.datasz && b.buf[b.pos++] == ':'
+            && klen + dlen + 3 <= b.datasz - b.pos
+            && b.buf[b.pos+klen] == '-' && b.buf[b.pos+klen+1] == '>'
+            && b.buf[b.pos+klen+2+dlen] == '\n')
+            return off;
+        ++off;
+    }
+    return sz;
+}
+
+/* open (and unlink) scratch file for writer: pfx + ".XXXXXX" */
+static int
+mcdb_makefmt_scratch_fd (struct mcdb_make * const restrict m)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdb_makefmt_scratch_fd (struct mcdb_make * const restrict m)
+{
+    const size_t len = strlen(m->scratch);
+    char * const restrict fntmp = m->fn_malloc(len + 8);
+    int fd = -1;
+    if (fntmp != NULL) {
+        memcpy(fntmp, m->scratch, len);
+        memcpy(fntmp+len, ".XXXXXX", 8);
+        if ((fd = mkstemp(fntmp)) != -1)
+            unlink(fntmp);
+        m->fn_free(fntmp);
+    }
+    return fd;
+}
+
+/* discard writers of m (started by mcdb_makefmt_mapintomcdb_mt()) */
+__attribute_noinline__
+static void
+mcdb_makefmt_writers_discard (struct mcdb_make * const restrict m)
+  __attribute_nonnull__;
+__attribute_noinline__
+static void
+mcdb_makefmt_writers_discard (struct mcdb_make * const restrict m)
+{
+    while (m->writer != NULL) {
+        struct mcdb_make * const w = m->writer;
+        const int fd = w->fd;
+        m->writer = w->writer;
+        w->writer = NULL;
+        mcdb_make_destroy(w);
+        (void) nointr_close(fd);
+        m->fn_free(w);
+    }
+}
+
+/* parse mmap'd input x of sz bytes in parallel into writers of m
+ * (returns false if input is to be parsed serially; else result in *rv) */
+__attribute_noinline__
+static bool
+mcdb_makefmt_mapintomcdb_mt (struct mcdb_make * const restrict m,
+                             char * const restrict x, const size_t sz,
+                             const struct mcdb_makefmt_input * const in,
+                             int * const restrict rv)
+  __attribute_nonnull_x__((1,2,5))  __attribute_warn_unused_result__;
+__attribute_noinline__
+static bool
+mcdb_makefmt_mapintomcdb_mt (struct mcdb_make * const restrict m,
+                             char * const restrict x, const size_t sz,
+                             const struct mcdb_makefmt_input * const in,
+                             int * const restrict rv)
+{
+    struct mcdb_makefmt_chunk *c;
+    size_t n = (m->nthreads < MCDB_SLOTS) ? m->nthreads : MCDB_SLOTS;
+    size_t i, k, s, e;
+    bool ok = true;
+    const bool lines = (in != NULL && in->fmt != MCDB_MAKEFMT_CDB);
+
+    if (n > sz / MCDB_MAKEFMT_CHUNK_MIN)
+        n = sz / MCDB_MAKEFMT_CHUNK_MIN;
+    /*(writers do not share data (valshare); parse serially for same output)*/
+    if (n < 2 || m->scratch == NULL || m->writer != NULL || m->fd == -1
+        || m->valshare)
+        return false;
+    c = m->fn_malloc(n * sizeof(struct mcdb_makefmt_chunk));
+    if (c == NULL)
+        return false;
+
+    /* chunk boundaries (chunk that does not end before sz parses to end) */
+    for (k = 0, s = 0; k < n && s < sz; ++k, s = e) {
+        e = (k+1 < n)
+          ? mcdb_makefmt_resync(x, sz, (sz/n*(k+1) > s) ? sz/n*(k+1) : s+1,
+                                lines)
+          : sz;
+        c[k].b.buf    = x + s;
+        c[k].b.pos    = 0;
+        c[k].b.datasz = sz - s;
+        c[k].b.bufsz  = sz - s;
+        c[k].b.fd     = -1;
+        c[k].b.lim    = (e < sz) ? e - s : SIZE_MAX;
+        c[k].in       = in;
+        c[k].w        = NULL;
+    }
+    if (k < 2) {
+        m->fn_free(c);
+        return false;
+    }
+
+    /* start writers, in order of chunks */
+    for (i = 0; i < k && ok; ++i) {
+        struct mcdb_make * const w = m->fn_malloc(sizeof(struct mcdb_make));
+        const int fd = (w != NULL) ? mcdb_makefmt_scratch_fd(m) : -1;
+        if (fd != -1 && mcdb_make_writer_start(w, m, fd) == 0) {
+            w->wown = 1; /*(w and fd released by m)*/
+            c[i].w = w;
+        }
+        else {
+            if (fd != -1)
+                (void) nointr_close(fd);
+            if (w != NULL)
+                m->fn_free(w);
+            ok = false;
+        }
+    }
+
+    if (ok) {
+        for (i = 1; i < k; ++i)
+            c[i].started =
+              (0 == pthread_create(&c[i].tid, NULL,
+                                   mcdb_makefmt_chunk_thread, c+i));
+        mcdb_makefmt_chunk_thread(c);
+        for (i = 1; i < k; ++i) {
+            if (c[i].started)
+                pthread_join(c[i].tid, NULL);
+            else  /*(parse chunk in this thread if thread not created)*/
+                mcdb_makefmt_chunk_thread(c+i);
+        }
+    }
+
+    /* validate chunks */
+    *rv = EXIT_SUCCESS;
+    for (i = 0; i < k && ok; ++i) {
+        if (c[i].rv == MCDB_ERROR_WRITE)
+            *rv = MCDB_ERROR_WRITE;
+        else if ((i+1 < k)
+                 ? (c[i].rv != true || c[i].b.pos != c[i].b.lim)
+                 : (c[i].rv != EXIT_SUCCESS))
+            ok = false;
+    }
+    m->fn_free(c);
+    if (*rv == MCDB_ERROR_WRITE)
+        return true;
+    if (!ok)
+        mcdb_makefmt_writers_discard(m);
+    return ok;
+}
+
+#endif /* _THREAD_SAFE */
+
+/* (buffer size for compressed input file) */
+#define MCDB_MAKEFMT_ZBUFSZ (1u << 20)
+
+/* mmap input file and call mcdb_makefmt_fdintomcdb()
+ * (parse in parallel if m->nthreads > 1 and m->scratch (see mcdb_make.h))
+ * (see notes above mcdb_makefmt_fdintomcdb() for caller responsibilities) */
 __attribute_noinline__
 int
-mcdb_makefmt_fileintofile (const char * const restrict infile,
-                           const char * const restrict fname,
-                           void * (* const fn_malloc)(size_t),
-                           void (* const fn_free)(void *))
+mcdb_makefmt_fileintomcdb (struct mcdb_make * const restrict m,
+                           const char * const restrict infile)
+{
+    return mcdb_makefmt_fileintomcdb_fmt(m, infile, NULL);
+}
+
+/* mmap input file and call mcdb_makefmt_fdintomcdb_fmt()
+ * (compressed input file is read() into buffer and inflated; not mmap'd) */
+__attribute_noinline__
+int
+mcdb_makefmt_fileintomcdb_fmt (struct mcdb_make * const restrict m,
+                               const char * const restrict infile,
+                               const struct mcdb_makefmt_input * const in)
 {
     void * restrict x = MAP_FAILED;
     int rv = MCDB_ERROR_READ;
     int fd;
     struct stat st;
     int errsave = 0;
+    unsigned char magic[4];
+    ssize_t n;
+
+    if (in != NULL && !mcdb_makefmt_input_valid(in)) {
+        errno = EINVAL;
+        return MCDB_ERROR_USAGE;
+    }
 
     if ((fd = nointr_open(infile,O_RDONLY,0)) == -1)
         return MCDB_ERROR_READ;
 
+    if ((n = pread(fd, magic, sizeof(magic), 0)) > 0
+        && mcdb_makefmt_zmagic(magic, (size_t)n) != 0) {
+        char * const restrict buf = m->fn_malloc(MCDB_MAKEFMT_ZBUFSZ);
+        rv = (buf != NULL)
+          ? mcdb_makefmt_fdintomcdb_fmt(m, fd, buf, MCDB_MAKEFMT_ZBUFSZ, in)
+          : MCDB_ERROR_MALLOC;
+        errsave = errno;
+        if (buf != NULL)
+            m->fn_free(buf);
+        (void) nointr_close(fd);
+        errno = errsave;
+        return rv;
+    }
+
     if (fstat(fd, &st) == -1
         || (!S_ISREG(st.st_mode) ? (errno = EINVAL) : 0)
        #if !defined(_LP64) && !defined(__LP64__)
@@ -351,8 +1529,10 @@ mcdb_makefmt_fileintofile (const char * const restrict infile,
         posix_madvise(x, (size_t)st.st_size,
                       POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
         /* pass entire map and size as params; fd -1 elides read()/remaps */
-        rv = mcdb_makefmt_fdintofile(-1, x, (size_t)st.st_size,
-                                     fname, fn_malloc, fn_free);
+      #ifdef _THREAD_SAFE
+        if (!mcdb_makefmt_mapintomcdb_mt(m, x, (size_t)st.st_size, in, &rv))
+      #endif
+        rv = mcdb_makefmt_fdintomcdb_fmt(m, -1, x, (size_t)st.st_size, in);
     }
 
     if (x != MAP_FAILED)
@@ -362,3 +1542,33 @@ mcdb_makefmt_fileintofile (const char * const restrict infile,
 
     return rv;
 }
+
+__attribute_noinline__
+int
+mcdb_makefmt_fileintofile (const char * const restrict infile,
+                           const char * const restrict fname,
+                           void * (* const fn_malloc)(size_t),
+                           void (* const fn_free)(void *))
+{
+    struct mcdb_make m;
+    int rv;
+    if (mcdb_makefn_start(&m, fname, fn_malloc, fn_free) != 0)
+        return (errno == ENOMEM ? MCDB_ERROR_MALLOC : MCDB_ERROR_WRITE);
+    if (mcdb_make_start(&m, m.fd, fn_malloc, fn_free) == 0) {
+        /* parse (and fill hash tables) using threads, one per online cpu */
+        const long ncpu = plasma_sysconf_nprocessors_onln();
+        m.nthreads = (ncpu > 1) ? (uint32_t)ncpu : 0;
+        m.scratch  = fname;
+        rv = mcdb_makefmt_fileintomcdb(&m, infile);
+        if (rv == EXIT_SUCCESS)
+            rv = (mcdb_make_finish(&m) == 0 && mcdb_makefn_finish(&m,true) == 0)
+              ? EXIT_SUCCESS
+              : MCDB_ERROR_WRITE;
+        else
+            mcdb_make_destroy(&m);
+    }
+    else
+        rv = MCDB_ERROR_WRITE;
+    mcdb_makefn_cleanup(&m);
+    return rv;
+}
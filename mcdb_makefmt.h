@@ -27,7 +27,7 @@
 
 #include "plasma/plasma_feature.h"
 #include "plasma/plasma_attr.h"
-#include "plasma/plasma_stdtypes.h"  /* size_t */
+#include "plasma/plasma_stdtypes.h"  /* size_t, uint32_t */
 PLASMA_ATTR_Pragma_once
 
 #ifdef __cplusplus
@@ -37,13 +37,64 @@ extern "C" {
 /* Note: ensure output file is open() O_RDWR if calling mcdb_makefmt_fdintofd()
  * or else mmap() may fail.
  * Note: caller of mcdb_makefmt_fdintofd() should choose whether or not to then
- * call fsync() or fdatasync().  See notes in mcdb_make.c:mcdb_mmap_commit() */
+ * call fsync() or fdatasync().  See notes in mcdb_make.c:mcdb_mmap_commit()
+ * Note: input fd (or input file) beginning with gzip magic bytes is inflated
+ * as it is read (requires zlib; else fails with ENOTSUP, as does zstd input) */
 
 EXPORT extern int
 mcdb_makefmt_fdintofd (int, char * restrict, size_t,
                        int, void * (*)(size_t), void (*)(void *))
   __attribute_nonnull__  __attribute_warn_unused_result__;
 
+struct mcdb_make;  /* (see mcdb_make.h) */
+
+EXPORT extern int
+mcdb_makefmt_fdintomcdb (struct mcdb_make * restrict,
+                         int, char * restrict, size_t)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+EXPORT extern int
+mcdb_makefmt_fileintomcdb (struct mcdb_make * restrict, const char * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+/* input formats other than cdbmake format (struct mcdb_makefmt_input)
+ * Records are one per line ("\n"; trailing "\r" ignored; empty lines skipped;
+ * last line need not end in "\n").  Key and data are added to mcdb directly
+ * from input buffer, so each line must fit in buf passed to
+ * mcdb_makefmt_fdintomcdb_fmt() (else MCDB_ERROR_READFORMAT).
+ * MCDB_MAKEFMT_CDB:    "+klen,dlen:key->data\n" (cdbmake; as if input NULL)
+ * MCDB_MAKEFMT_DELIM:  fields separated by delim; key is field keycol (1-based)
+ *                      data is line without key field (and one delim)
+ * MCDB_MAKEFMT_NDJSON: JSON object per line; key is value of top-level member
+ *                      keyname (string, unescaped, or else number, true, ...);
+ *                      data is line
+ * MCDB_MAKEFMT_FIXED:  key is keylen bytes at keyoff (trailing spaces trimmed;
+ *                      line may end within key); data is line without key */
+#define MCDB_MAKEFMT_CDB    0u
+#define MCDB_MAKEFMT_DELIM  1u
+#define MCDB_MAKEFMT_NDJSON 2u
+#define MCDB_MAKEFMT_FIXED  3u
+
+struct mcdb_makefmt_input {
+  uint32_t fmt;               /* MCDB_MAKEFMT_* */
+  uint32_t keycol;            /* DELIM: key field number (1-based) */
+  int delim;                  /* DELIM: field separator char, e.g. '\t' */
+  const char *keyname;        /* NDJSON: member name (not escaped) */
+  size_t keynamelen;          /* NDJSON: strlen(keyname) */
+  size_t keyoff;              /* FIXED: offset of key in line */
+  size_t keylen;              /* FIXED: width of key field */
+};
+
+EXPORT extern int
+mcdb_makefmt_fdintomcdb_fmt (struct mcdb_make * restrict,
+                             int, char * restrict, size_t,
+                             const struct mcdb_makefmt_input * restrict)
+  __attribute_nonnull_x__((1,3))  __attribute_warn_unused_result__;
+EXPORT extern int
+mcdb_makefmt_fileintomcdb_fmt (struct mcdb_make * restrict,
+                               const char * restrict,
+                               const struct mcdb_makefmt_input * restrict)
+  __attribute_nonnull_x__((1,2))  __attribute_warn_unused_result__;
+
 EXPORT extern int
 mcdb_makefmt_fdintofile (const int, char * restrict, size_t,
                          const char * restrict,
@@ -28,6 +28,12 @@
 #ifndef _XOPEN_SOURCE /* >= 500 on Linux for mkstemp(), fchmod(), fdatasync() */
 #define _XOPEN_SOURCE 700
 #endif
+/* _GNU_SOURCE needed for memfd_create() and F_ADD_SEALS on Linux */
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
 /* large file support needed for stat(),fstat() input file > 2 GB */
 #define PLASMA_FEATURE_ENABLE_LARGEFILE
 #ifdef _AIX
@@ -41,6 +47,8 @@
 #include "plasma/plasma_stdtypes.h"
 
 #include <errno.h>
+#include <fcntl.h>     /* fcntl() F_ADD_SEALS O_* */
+#include <sys/mman.h>  /* memfd_create() shm_open() shm_unlink() */
 #include <sys/stat.h>  /* fchmod() umask() */
 #include <stdlib.h>    /* mkstemp() EXIT_SUCCESS */
 #include <string.h>    /* memcpy() strlen() */
@@ -63,7 +71,12 @@ mcdb_makefn_start (struct mcdb_make * const restrict m,
     const size_t len = strlen(fname);
     char * restrict fntmp;
 
-    m->head[0] = NULL;
+    m->hpmap   = NULL;
+    m->kmap    = NULL;
+    m->valtab  = NULL;
+    m->zstrm   = NULL;
+    m->zbuf    = NULL;
+    m->writer  = NULL;
     m->fntmp   = NULL;
     m->fd      = -1;
 
@@ -126,12 +139,84 @@ mcdb_makefn_finish (struct mcdb_make * const restrict m, const bool datasync)
      * so mcdb_makefn_cleanup() must not be called here */
 }
 
+#ifndef MFD_ALLOW_SEALING
+/* anonymous shared memory object (shm_open() of unique name, then unlinked) */
+static int
+mcdb_makefn_shm (void)
+{
+    char name[48];
+    unsigned int n = 0;
+    int fd;
+    do {
+        snprintf(name, sizeof(name), "/mcdb.%lu.%lx.%u",
+                 (unsigned long)getpid(), (unsigned long)(uintptr_t)&n, n);
+        fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, S_IRUSR|S_IWUSR);
+    } while (fd == -1 && errno == EEXIST && ++n < 100);
+    if (fd != -1)
+        (void)shm_unlink(name);
+    return fd;
+}
+#endif
+
+/* in-memory mcdb: fd is anonymous memory-backed file (memfd_create() on
+ * Linux) to be passed to mcdb_make_start(m, m->fd, ...) (name is label) */
+int
+mcdb_makefn_start_memfd (struct mcdb_make * const restrict m,
+                         const char * const restrict name,
+                         void * (* const fn_malloc)(size_t),
+                         void (* const fn_free)(void *))
+{
+    m->hpmap   = NULL;
+    m->kmap    = NULL;
+    m->valtab  = NULL;
+    m->zstrm   = NULL;
+    m->zbuf    = NULL;
+    m->writer  = NULL;
+    m->fntmp   = NULL;
+    m->fname   = name;
+    m->st_mode = S_IRUSR;
+    m->fn_malloc = fn_malloc;
+    m->fn_free   = fn_free;
+  #ifdef MFD_ALLOW_SEALING
+    m->fd      = memfd_create(name, MFD_CLOEXEC|MFD_ALLOW_SEALING);
+  #else
+    m->fd      = mcdb_makefn_shm();
+    if (m->fd != -1 && O_CLOEXEC == 0)
+        (void) fcntl(m->fd, F_SETFD, FD_CLOEXEC);
+  #endif
+    return (m->fd != -1) ? EXIT_SUCCESS : -1;
+}
+
+/* mcdb_mmap of in-memory mcdb after mcdb_make_finish() (same pages as m->fd)
+ * m->fd is sealed read-only (if supported) and remains open, e.g. to pass to
+ * child processes (mcdb_mmap_create_fd()), until mcdb_makefn_cleanup()
+ * (map remains valid after m->fd is closed) */
+struct mcdb_mmap *
+mcdb_makefn_mmap (struct mcdb_make * const restrict m,
+                  struct mcdb_mmap * const restrict map)
+{
+    if (m->fd < 0) {
+        errno = EBADF;
+        return NULL;
+    }
+  #ifdef F_ADD_SEALS
+    /* (F_SEAL_WRITE fails EBUSY if writable shared mmap remains, e.g. if
+     *  mcdb_make_finish() was not called) */
+    if (fcntl(m->fd, F_ADD_SEALS,
+              F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_WRITE|F_SEAL_SEAL) != 0
+        && errno != EINVAL)  /*(EINVAL if fd does not support sealing)*/
+        return NULL;
+  #endif
+    return mcdb_mmap_create_fd(map, m->fd, m->fn_malloc, m->fn_free, NULL);
+}
+
 int
 mcdb_makefn_cleanup (struct mcdb_make * const restrict m)
 {
     const int errsave = errno;
     if (m->fd != -1) {                       /* (fd == -1 if mkstemp() fails) */
-        unlink(m->fntmp);
+        if (m->fntmp != NULL)                /* (NULL if in-memory mcdb) */
+            unlink(m->fntmp);
         if (m->fd >= 0)
             (void) nointr_close(m->fd);
         m->fd = -1;
@@ -49,6 +49,25 @@ EXPORT extern int
 mcdb_makefn_cleanup (struct mcdb_make * restrict)
   __attribute_nonnull__;
 
+/* in-memory mcdb (no filesystem round trip)
+ *   mcdb_makefn_start_memfd(&m, "label", malloc, free)
+ *   mcdb_make_start(&m, m.fd, malloc, free)
+ *   mcdb_make_add(&m, ...) ...
+ *   mcdb_make_finish(&m)
+ *   map = mcdb_makefn_mmap(&m, NULL)   (instead of mcdb_makefn_finish())
+ *   mcdb_makefn_cleanup(&m)            (closes m.fd; map remains valid)
+ * m.fd is memfd_create() on Linux (else unlinked shm_open()), and is sealed
+ * read-only by mcdb_makefn_mmap() (Linux), so that map shares pages of m.fd
+ * (m.fd may be passed to child processes for mcdb_mmap_create_fd()) */
+EXPORT extern int
+mcdb_makefn_start_memfd (struct mcdb_make * restrict, const char * restrict,
+                         void * (*)(size_t), void (*)(void *))
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+EXPORT extern struct mcdb_mmap *
+mcdb_makefn_mmap (struct mcdb_make * restrict, struct mcdb_mmap * restrict)
+  __attribute_nonnull_x__((1))  __attribute_warn_unused_result__;
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,466 @@
+/*
+ * mcdb_shard - shard sets: manifest plus N mcdb, lookups routed by key hash
+ *
+ * Copyright (c) 2010, Glue Logic LLC. All rights reserved. code()gluelogic.com
+ *
+ *  This file is part of mcdb.
+ *
+ *  mcdb is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mcdb is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with mcdb.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * mcdb is originally based upon the Public Domain cdb-0.75 by Dan Bernstein
+ */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#ifndef _XOPEN_SOURCE /* >= 500 for fdatasync() */
+#define _XOPEN_SOURCE 600
+#endif
+/* large file support needed for fstat() of manifest on large file systems */
+#define PLASMA_FEATURE_ENABLE_LARGEFILE
+
+#include "mcdb_shard.h"
+#include "mcdb.h"
+#include "mcdb_make.h"
+#include "mcdb_makefn.h"
+#include "nointr.h"
+#include "uint32.h"
+#include "plasma/plasma_stdtypes.h"
+#ifdef _THREAD_SAFE
+#include "plasma/plasma_atomic.h"
+#include <pthread.h>   /* pthread_create(), pthread_join() */
+#endif
+
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>     /* open(), O_RDONLY */
+#include <stdio.h>     /* snprintf() */
+#include <stdlib.h>    /* strtoul() */
+#include <string.h>    /* memcpy() strlen() strrchr() */
+#include <unistd.h>    /* read() fdatasync() */
+
+#if defined(__APPLE__) && defined(__MACH__)
+#include <sys/syscall.h>
+int syscall(int, ...); /* or omit -ansi compile flag, define _DARWIN_C_SOURCE */
+#define fdatasync(fd) syscall(SYS_fdatasync, (fd))
+#endif
+
+#define MCDB_SHARD_MANIFEST_MAX (1u << 24)  /* 16 MB */
+
+uint32_t
+mcdb_shard_hash(const char * const restrict key, const size_t klen,
+                const unsigned char tagc)
+{
+    return (tagc != 0)
+      ? uint32_hash_fast_tagged(MCDB_SHARD_HASH_INIT, tagc, key, klen)
+      : uint32_hash_fast(MCDB_SHARD_HASH_INIT, key, klen);
+}
+
+
+/* shard mcdb fname: <manifest>.<i>-of-<nshards> (see mcdb_shard.h) */
+static char *
+mcdb_shard_fname(const struct mcdb_shard_make * const restrict sm,
+                 char * const restrict buf, const size_t bufsz,
+                 const uint32_t i)
+  __attribute_nonnull__;
+static char *
+mcdb_shard_fname(const struct mcdb_shard_make * const restrict sm,
+                 char * const restrict buf, const size_t bufsz,
+                 const uint32_t i)
+{
+    (void)snprintf(buf, bufsz, "%s.%u-of-%u", sm->fname, i, sm->nshards);
+    return buf;
+}
+
+int
+mcdb_shard_make_start(struct mcdb_shard_make * const restrict sm,
+                      const char * const fname, const uint32_t nshards,
+                      void * (* const fn_malloc)(size_t),
+                      void (* const fn_free)(void *))
+{
+    const size_t bufsz = strlen(fname) + sizeof(".4294967295-of-4294967295");
+    char *buf;
+    uint32_t i;
+
+    sm->m         = NULL;
+    sm->nshards   = 0;
+    sm->nthreads  = 0;
+    sm->fname     = fname;
+    sm->fn_malloc = fn_malloc;
+    sm->fn_free   = fn_free;
+    if (nshards == 0 || nshards > MCDB_SHARD_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((buf = fn_malloc(bufsz)) == NULL)
+        return -1;
+    sm->m = fn_malloc(nshards * sizeof(struct mcdb_make));
+    if (sm->m == NULL) {
+        fn_free(buf);
+        return -1;
+    }
+
+    sm->nshards = nshards; /*(for mcdb_shard_fname())*/
+    for (i = 0; i < nshards; ++i) {
+        struct mcdb_make * const restrict m = sm->m+i;
+        if (mcdb_makefn_start(m, mcdb_shard_fname(sm, buf, bufsz, i),
+                              fn_malloc, fn_free) != 0
+            || mcdb_make_start(m, m->fd, fn_malloc, fn_free) != 0) {
+            /* (m[i] released with shards started in mcdb_shard_make_destroy())
+             * (mcdb_makefn_start() initializes fields needed for release) */
+            sm->nshards = i+1;
+            fn_free(buf);
+            return -1;
+        }
+    }
+    fn_free(buf);
+    return EXIT_SUCCESS;
+}
+
+int
+mcdb_shard_make_add(struct mcdb_shard_make * const restrict sm,
+                    const char * const restrict key, const size_t klen,
+                    const char * const restrict data, const size_t dlen)
+{
+    const uint32_t h = mcdb_shard_hash(key, klen, 0);
+    return mcdb_make_add_h(sm->m + mcdb_shard_route(h, sm->nshards),
+                           key, klen, data, dlen);
+}
+
+struct mcdb_shard_make_ctx {
+  struct mcdb_shard_make *sm;
+  uint32_t next;              /* next shard to finish */
+  int err;                    /* errno of (any one) shard which failed */
+};
+
+/* finish shards (into temporary files), taking next shard until none remain */
+static void *
+mcdb_shard_make_finish_thread(void * const arg)
+  __attribute_nonnull__;
+static void *
+mcdb_shard_make_finish_thread(void * const arg)
+{
+    struct mcdb_shard_make_ctx * const ctx = arg;
+    struct mcdb_shard_make * const restrict sm = ctx->sm;
+    uint32_t i;
+    while ((i =
+          #ifdef _THREAD_SAFE
+            plasma_atomic_fetch_add_u32(&ctx->next, 1, memory_order_relaxed)
+          #else
+            ctx->next++
+          #endif
+           ) < sm->nshards) {
+        struct mcdb_make * const restrict m = sm->m+i;
+        if (mcdb_make_finish(m) != 0 || fdatasync(m->fd) != 0) {
+          #ifdef _THREAD_SAFE
+            plasma_atomic_st_nopt(&ctx->err, errno);
+          #else
+            ctx->err = errno;
+          #endif
+        }
+    }
+    return NULL;
+}
+
+int
+mcdb_shard_make_finish(struct mcdb_shard_make * const restrict sm)
+{
+    struct mcdb_shard_make_ctx ctx = { sm, 0, 0 };
+    struct mcdb_make mf;
+    const char * const base = strrchr(sm->fname, '/');
+    const size_t blen = strlen(base != NULL ? base+1 : sm->fname);
+    const size_t bufsz = blen + sizeof(".4294967295-of-4294967295");
+    char *buf;
+    char hdr[64];
+    uint32_t i;
+    int rc;
+
+    /* shards are finished in parallel */
+  #ifdef _THREAD_SAFE
+    pthread_t tid[64];
+    uint32_t n = (sm->nthreads < sm->nshards) ? sm->nthreads : sm->nshards;
+    if (n > sizeof(tid)/sizeof(*tid))
+        n = sizeof(tid)/sizeof(*tid);
+    for (i = 0; i+1 < n; ++i) {
+        if (pthread_create(tid+i, NULL, mcdb_shard_make_finish_thread,&ctx)!=0)
+            break;  /* (continue with fewer threads if thread creation fails) */
+    }
+    (void)mcdb_shard_make_finish_thread(&ctx);
+    while (i)
+        pthread_join(tid[--i], NULL);
+  #else
+    (void)mcdb_shard_make_finish_thread(&ctx);
+  #endif
+    if (ctx.err != 0) {
+        errno = ctx.err;
+        return -1;
+    }
+
+    /* rename shards into place, then write manifest */
+    for (i = 0; i < sm->nshards; ++i) {
+        if (mcdb_makefn_finish(sm->m+i, false) != 0)
+            return -1;
+    }
+    if ((buf = sm->fn_malloc(bufsz)) == NULL)
+        return -1;
+    if (mcdb_makefn_start(&mf, sm->fname, sm->fn_malloc, sm->fn_free) != 0) {
+        sm->fn_free(buf);
+        return -1;
+    }
+    rc = snprintf(hdr, sizeof(hdr), MCDB_SHARD_MAGIC " %u %u\n",
+                  MCDB_SHARD_VERSION, sm->nshards);
+    rc = (nointr_write(mf.fd, hdr, (size_t)rc) != -1) ? 0 : -1;
+    for (i = 0; i < sm->nshards && rc == 0; ++i) {
+        const int len = snprintf(buf, bufsz, "%s.%u-of-%u\n",
+                                 base != NULL ? base+1 : sm->fname,
+                                 i, sm->nshards);
+        if (nointr_write(mf.fd, buf, (size_t)len) == -1)
+            rc = -1;
+    }
+    sm->fn_free(buf);
+    if (rc == 0)
+        rc = mcdb_makefn_finish(&mf, true);
+    mcdb_makefn_cleanup(&mf);
+    return rc;
+}
+
+void
+mcdb_shard_make_destroy(struct mcdb_shard_make * const restrict sm)
+{
+    uint32_t i;
+    if (sm->m == NULL)
+        return;
+    for (i = 0; i < sm->nshards; ++i) {
+        (void)mcdb_make_destroy(sm->m+i);
+        (void)mcdb_makefn_cleanup(sm->m+i);
+    }
+    sm->fn_free(sm->m);
+    sm->m = NULL;
+    sm->nshards = 0;
+}
+
+
+/* read manifest fname (NUL-terminated) (returns NULL upon failure) */
+static char *
+mcdb_shard_manifest(const char * const restrict fname,
+                    void * (* const fn_malloc)(size_t),
+                    void (* const fn_free)(void *))
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static char *
+mcdb_shard_manifest(const char * const restrict fname,
+                    void * (* const fn_malloc)(size_t),
+                    void (* const fn_free)(void *))
+{
+    struct stat st;
+    char *buf = NULL;
+    size_t len = 0;
+    ssize_t rd;
+    const int fd = nointr_open(fname, O_RDONLY, 0);
+    if (fd == -1)
+        return NULL;
+    if (fstat(fd, &st) == 0) {
+        if (!S_ISREG(st.st_mode)
+            || st.st_size >= (off_t)MCDB_SHARD_MANIFEST_MAX)
+            errno = EINVAL;
+        else if ((buf = fn_malloc((size_t)st.st_size + 1)) != NULL) {
+            while (len < (size_t)st.st_size
+                   && ((rd = read(fd, buf+len, (size_t)st.st_size - len)) > 0
+                       || (rd == -1 && errno == EINTR)))
+                len += (rd > 0) ? (size_t)rd : 0;
+            if (len == (size_t)st.st_size)
+                buf[len] = '\0';
+            else {
+                fn_free(buf);
+                buf = NULL;
+                if (rd == 0)
+                    errno = EINVAL;  /*(file truncated while reading)*/
+            }
+        }
+    }
+    (void) nointr_close(fd);
+    return buf;
+}
+
+bool
+mcdb_shard_create(struct mcdb_shard * const restrict sh,
+                  const char * const fname,
+                  void * (* const fn_malloc)(size_t),
+                  void (* const fn_free)(void *))
+{
+    const char * const base = strrchr(fname, '/');
+    const size_t dlen = (base != NULL) ? (size_t)(base - fname) + 1 : 0;
+    char * const manifest = mcdb_shard_manifest(fname, fn_malloc, fn_free);
+    char *p, *e, *path;
+    unsigned long version, n;
+    uint32_t i;
+    int errsave;
+
+    sh->m         = NULL;
+    sh->nshards   = 0;
+    sh->owner     = 1;
+    sh->fn_malloc = fn_malloc;
+    sh->fn_free   = fn_free;
+    if (manifest == NULL)
+        return false;
+
+    /* "mcdb-shard <version> <nshards>\n", then nshards lines of basenames */
+    p = manifest;
+    if (0 != memcmp(p, MCDB_SHARD_MAGIC " ", sizeof(MCDB_SHARD_MAGIC)))
+        p = NULL;
+    else {
+        p += sizeof(MCDB_SHARD_MAGIC);
+        version = strtoul(p, &e, 10);
+        p = (e != p && *e == ' ' && version == MCDB_SHARD_VERSION) ? e+1 : NULL;
+    }
+    if (p != NULL) {
+        n = strtoul(p, &e, 10);
+        p = (e != p && *e == '\n' && n-1 < MCDB_SHARD_MAX) ? e+1 : NULL;
+    }
+    if (p == NULL) {
+        fn_free(manifest);
+        errno = EINVAL;
+        return false;
+    }
+    if ((path = fn_malloc(dlen + strlen(p) + 1)) == NULL) {
+        fn_free(manifest);
+        return false;
+    }
+    if ((sh->m = fn_malloc(n * sizeof(struct mcdb))) == NULL) {
+        fn_free(path);
+        fn_free(manifest);
+        return false;
+    }
+    memcpy(path, fname, dlen);
+    memset(sh->m, '\0', n * sizeof(struct mcdb));
+
+    for (i = 0; i < n; ++i, p = e+1) {
+        if ((e = strchr(p, '\n')) == NULL || e == p
+            || memchr(p, '/', (size_t)(e - p)) != NULL) {
+            errno = EINVAL;
+            break;
+        }
+        memcpy(path+dlen, p, (size_t)(e - p));
+        path[dlen + (size_t)(e - p)] = '\0';
+        sh->m[i].map = mcdb_mmap_create_h(NULL, NULL, path, fn_malloc, fn_free);
+        if (sh->m[i].map == NULL)
+            break;
+    }
+    sh->nshards = i;
+    if (i == n && *p != '\0') {
+        errno = EINVAL;  /*(more shards listed than nshards)*/
+        i = 0;
+    }
+    errsave = errno;
+    fn_free(path);
+    fn_free(manifest);
+    if (i == n)
+        return true;
+    mcdb_shard_destroy(sh);
+    errno = errsave;
+    return false;
+}
+
+void
+mcdb_shard_destroy(struct mcdb_shard * const restrict sh)
+{
+    uint32_t i;
+    if (sh->m == NULL)
+        return;
+    if (!sh->owner) {
+        mcdb_shard_thread_unregister(sh);
+        return;
+    }
+    for (i = 0; i < sh->nshards; ++i)
+        mcdb_mmap_destroy_h(sh->m[i].map);
+    sh->fn_free(sh->m);
+    sh->m = NULL;
+    sh->nshards = 0;
+}
+
+bool
+mcdb_shard_refresh(struct mcdb_shard * const restrict sh)
+{
+    bool rc = true;
+    uint32_t i;
+    for (i = 0; i < sh->nshards; ++i) {
+        if (sh->owner
+            ? !mcdb_mmap_refresh_threadsafe(&sh->m[i].map)
+            : !mcdb_thread_refresh_self(sh->m+i))
+            rc = false;
+    }
+    return rc;
+}
+
+bool
+mcdb_shard_watch(struct mcdb_shard * const restrict sh)
+{
+    bool rc = true;
+    uint32_t i;
+    for (i = 0; i < sh->nshards; ++i) {
+        if (!mcdb_mmap_watch_h(sh->m[i].map))
+            rc = false;
+    }
+    return rc;
+}
+
+bool
+mcdb_shard_thread_register(struct mcdb_shard * const restrict t,
+                           const struct mcdb_shard * const restrict sh)
+{
+    uint32_t i;
+    t->nshards   = 0;
+    t->owner     = 0;
+    t->fn_malloc = sh->fn_malloc;
+    t->fn_free   = sh->fn_free;
+    t->m = sh->fn_malloc(sh->nshards * sizeof(struct mcdb));
+    if (t->m == NULL)
+        return false;
+    memset(t->m, '\0', sh->nshards * sizeof(struct mcdb));
+    for (i = 0; i < sh->nshards; ++i) {
+        t->m[i].map = sh->m[i].map;
+        if (mcdb_thread_register(t->m+i) == NULL)
+            break;
+        t->nshards = i+1;
+    }
+    if (i == sh->nshards)
+        return true;
+    mcdb_shard_thread_unregister(t);
+    return false;
+}
+
+void
+mcdb_shard_thread_unregister(struct mcdb_shard * const restrict t)
+{
+    uint32_t i;
+    if (t->m == NULL)
+        return;
+    for (i = 0; i < t->nshards; ++i)
+        (void)mcdb_thread_unregister(t->m+i);
+    t->fn_free(t->m);
+    t->m = NULL;
+    t->nshards = 0;
+}
+
+struct mcdb *
+mcdb_shard_findtag(struct mcdb_shard * const restrict sh,
+                   const char * const restrict key, const size_t klen,
+                   const unsigned char tagc)
+{
+    struct mcdb * const restrict m = mcdb_shard_mcdb(sh, key, klen, tagc);
+    return mcdb_findtagstart_h(m, key, klen, tagc)
+        && mcdb_findtagnext_h(m, key, klen, tagc)
+      ? m
+      : NULL;
+}
@@ -0,0 +1,170 @@
+/*
+ * mcdb_shard - shard sets: manifest plus N mcdb, lookups routed by key hash
+ *
+ * Copyright (c) 2010, Glue Logic LLC. All rights reserved. code()gluelogic.com
+ *
+ *  This file is part of mcdb.
+ *
+ *  mcdb is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mcdb is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with mcdb.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * mcdb is originally based upon the Public Domain cdb-0.75 by Dan Bernstein
+ */
+
+#ifndef INCLUDED_MCDB_SHARD_H
+#define INCLUDED_MCDB_SHARD_H
+
+#include "plasma/plasma_feature.h"
+#include "plasma/plasma_attr.h"
+#include "plasma/plasma_stdtypes.h" /* bool, size_t, uint32_t */
+#include "mcdb.h"
+#include "mcdb_make.h"
+PLASMA_ATTR_Pragma_once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* shard set: manifest file naming nshards mcdb files (shards) which together
+ * hold the records of a set (e.g. more records or data than fit one mcdb)
+ *
+ * Each key is in shard mcdb_shard_route(mcdb_shard_hash(), nshards), from
+ * a hash (uint32_hash_fast() with MCDB_SHARD_HASH_INIT) independent of hash
+ * used within shard (so that keys in each shard remain uniformly distributed
+ * across slots and hash table elements).  Tagged keys hash as key prefixed
+ * by tag char (see uint32_hash_fast()), as in shard mcdb.
+ *
+ * Manifest (text) is MCDB_SHARD_MAGIC, version, and nshards, each followed
+ * by single space or newline, then basename of each shard mcdb on its own
+ * line.  Shards reside in directory of manifest.  Shards created by
+ * mcdb_shard_make_finish() are named <manifest>.<i>-of-<nshards>, so that
+ * rebuild with different nshards does not replace shards in use by readers
+ * of previous manifest.  (shards are renamed into place before manifest)
+ *
+ * Readers read manifest once (mcdb_shard_create()); each shard mcdb is then
+ * refreshed independently (mcdb_shard_refresh()), e.g. after a shard is
+ * rebuilt and renamed into place.  Replacing manifest (e.g. different
+ * nshards) requires new mcdb_shard_create().
+ */
+#define MCDB_SHARD_MAGIC     "mcdb-shard"
+#define MCDB_SHARD_VERSION   1u
+#define MCDB_SHARD_MAX       65536u
+#define MCDB_SHARD_HASH_INIT UINT32_C(0x5BD1E995)
+#define mcdb_shard_route(h,nshards) \
+  ((uint32_t)(((uint64_t)(h) * (uint64_t)(nshards)) >> 32))
+
+struct mcdb_shard {
+  struct mcdb *m;             /* nshards handles; m[i].map is map of shard i */
+  uint32_t nshards;           /* num of shards in set */
+  uint32_t owner;             /* (private) maps created (not registered) */
+  void * (*fn_malloc)(size_t);/* fn ptr to malloc() */
+  void (*fn_free)(void *);    /* fn ptr to free() */
+};
+
+struct mcdb_shard_make {
+  struct mcdb_make *m;        /* nshards mcdb_make; one per shard */
+  /* (m[i] settings (e.g. hash_fn, layout, bloom_bits, nthreads) may be
+   *  modified after mcdb_shard_make_start() and before first add, as for
+   *  mcdb_make_start()) */
+  uint32_t nshards;           /* num of shards in set */
+  uint32_t nthreads;          /* shards finished in parallel by nthreads */
+  const char *fname;          /* manifest */
+  void * (*fn_malloc)(size_t);/* fn ptr to malloc() */
+  void (*fn_free)(void *);    /* fn ptr to free() */
+};
+
+
+__attribute_pure__
+EXPORT extern uint32_t
+mcdb_shard_hash(const char * restrict, size_t, unsigned char)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
+
+
+/* build shard set: mcdb_shard_make_start(), mcdb_shard_make_add() (repeat),
+ * mcdb_shard_make_finish(), mcdb_shard_make_destroy() (always)
+ * (manifest fname is written last, after all shards are in place)
+ * (returns 0 on success; -1 and errno upon failure) */
+EXPORT extern int
+mcdb_shard_make_start(struct mcdb_shard_make * restrict, const char *,
+                      uint32_t, void * (*)(size_t), void (*)(void *))
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+EXPORT extern int
+mcdb_shard_make_add(struct mcdb_shard_make * restrict,
+                    const char * restrict, size_t,
+                    const char * restrict, size_t)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+EXPORT extern int
+mcdb_shard_make_finish(struct mcdb_shard_make * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+EXPORT extern void
+mcdb_shard_make_destroy(struct mcdb_shard_make * restrict)
+  __attribute_nonnull__;
+
+
+/* open shard set (manifest fname) (maps each shard)
+ * (returns false and errno upon failure (EINVAL if manifest is invalid)) */
+EXPORT extern bool
+mcdb_shard_create(struct mcdb_shard * restrict, const char *,
+                  void * (*)(size_t), void (*)(void *))
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+EXPORT extern void
+mcdb_shard_destroy(struct mcdb_shard * restrict)
+  __attribute_nonnull__;
+
+/* refresh each shard mcdb which has been updated (see mcdb_mmap_refresh())
+ * (thread-safe; call with set from mcdb_shard_create(), e.g. in maintenance
+ *  thread, while querying threads use sets from mcdb_shard_thread_register())
+ * (returns false if any shard fails to refresh; other shards are refreshed) */
+EXPORT extern bool
+mcdb_shard_refresh(struct mcdb_shard * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+/* request notification when shard mcdb are renamed into place
+ * (see mcdb_mmap_watch()) (call before sharing set with other threads) */
+EXPORT extern bool
+mcdb_shard_watch(struct mcdb_shard * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+/* querying thread registers its own set of handles t to maps of set
+ * (as mcdb_thread_register() registers a struct mcdb to its map) */
+EXPORT extern bool
+mcdb_shard_thread_register(struct mcdb_shard * restrict,
+                           const struct mcdb_shard * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+EXPORT extern void
+mcdb_shard_thread_unregister(struct mcdb_shard * restrict)
+  __attribute_nonnull__;
+
+
+/* struct mcdb handle of shard for key (with which to mcdb_findtagstart(),
+ * mcdb_findtagnext(), mcdb_dataptr(), etc.) */
+#define mcdb_shard_mcdb(sh,key,klen,tagc) \
+  ((sh)->m + mcdb_shard_route(mcdb_shard_hash((key),(klen),(tagc)), \
+                              (sh)->nshards))
+
+/* find first record of key in set; returns handle of shard (for data and
+ * mcdb_findtagnext()), or NULL if not found */
+EXPORT extern struct mcdb *
+mcdb_shard_findtag(struct mcdb_shard * restrict, const char * restrict,
+                   size_t, unsigned char)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
+#define mcdb_shard_find(sh,key,klen) mcdb_shard_findtag((sh),(key),(klen),0)
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
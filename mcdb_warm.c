@@ -0,0 +1,399 @@
+/*
+ * mcdb_warm - access profiles (page bitmaps) and page cache warmup of mcdb
+ *
+ * Copyright (c) 2010, Glue Logic LLC. All rights reserved. code()gluelogic.com
+ *
+ *  This file is part of mcdb.
+ *
+ *  mcdb is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mcdb is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with mcdb.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * mcdb is originally based upon the Public Domain cdb-0.75 by Dan Bernstein
+ */
+
+#ifndef _XOPEN_SOURCE /* POSIX_MADV_WILLNEED */
+#define _XOPEN_SOURCE 700
+#endif
+#ifndef _GNU_SOURCE /* mincore() on GNU systems */
+#define _GNU_SOURCE 1
+#endif
+/* large file support needed for fstat() of profile of mcdb > 2 GB */
+#define PLASMA_FEATURE_ENABLE_LARGEFILE
+
+#include "mcdb_warm.h"
+#include "mcdb.h"
+#include "mcdb_make.h"
+#include "mcdb_makefn.h"
+#include "nointr.h"
+#include "uint32.h"
+#include "plasma/plasma_stdtypes.h"
+#include "plasma/plasma_sysconf.h"
+#ifdef _THREAD_SAFE
+#include "plasma/plasma_atomic.h"
+#include <pthread.h>   /* pthread_create(), pthread_join() */
+#endif
+
+#include <sys/mman.h>  /* posix_madvise(), mincore() */
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>     /* open(), O_RDONLY */
+#include <string.h>    /* memcmp() memcpy() memset() */
+#include <unistd.h>    /* read() */
+
+/*(posix_madvise, defines not provided in Solaris 10, even w/ __EXTENSIONS__)*/
+#if (defined(__sun) || defined(__hpux)) && !defined(POSIX_MADV_NORMAL)
+extern int madvise(caddr_t, size_t, int);
+#define posix_madvise(addr,len,advice)  madvise((caddr_t)(addr),(len),(advice))
+#define POSIX_MADV_RANDOM      1
+#define POSIX_MADV_WILLNEED    3
+#endif
+
+#define MCDB_WARM_CHUNK 512u     /* pages prefetched per unit of work (2 MB) */
+#define MCDB_WARM_SAMPLE 65536u  /* system pages per mincore() */
+
+#define mcdb_warm_bitmapsz(npages) ((size_t)(((npages) + 7) >> 3))
+
+bool
+mcdb_warm_init(struct mcdb_warm * const restrict w, const uint64_t size,
+               void * (* const fn_malloc)(size_t),
+               void (* const fn_free)(void *))
+{
+    const uint64_t npages = (size + MCDB_WARM_PAGESZ-1) >> MCDB_WARM_PGSHIFT;
+    w->bits = NULL;
+    w->size = size;
+    w->npages = npages;
+    w->fn_malloc = fn_malloc;
+    w->fn_free = fn_free;
+    if ((npages + 7) >> 3 > SIZE_MAX - MCDB_WARM_HDRSZ)
+        return (errno = ENOMEM, false);
+    if ((w->bits = fn_malloc(mcdb_warm_bitmapsz(npages) + 1)) == NULL)
+        return false;
+    memset(w->bits, '\0', mcdb_warm_bitmapsz(npages) + 1);
+    return true;
+}
+
+void
+mcdb_warm_destroy(struct mcdb_warm * const restrict w)
+{
+    if (w->bits != NULL) {
+        w->fn_free(w->bits);
+        w->bits = NULL;
+    }
+    w->size = 0;
+    w->npages = 0;
+}
+
+bool
+mcdb_warm_read(struct mcdb_warm * const restrict w, const char * const fname,
+               void * (* const fn_malloc)(size_t),
+               void (* const fn_free)(void *))
+{
+    unsigned char hdr[MCDB_WARM_HDRSZ];
+    struct stat st;
+    size_t len = 0, sz;
+    ssize_t rd = 0;
+    bool rc = false;
+    const int fd = nointr_open(fname, O_RDONLY, 0);
+    w->bits = NULL;
+    w->size = 0;
+    w->npages = 0;
+    w->fn_malloc = fn_malloc;
+    w->fn_free = fn_free;
+    if (fd == -1)
+        return false;
+    while (len < sizeof(hdr)
+           && ((rd = read(fd, hdr+len, sizeof(hdr) - len)) > 0
+               || (rd == -1 && errno == EINTR)))
+        len += (rd > 0) ? (size_t)rd : 0;
+    if (len == sizeof(hdr) && fstat(fd, &st) == 0
+        && 0 == memcmp(hdr, MCDB_WARM_MAGIC, 8)
+        && uint32_strunpack_bigendian_macro(hdr+8)  == MCDB_WARM_VERSION
+        && uint32_strunpack_bigendian_macro(hdr+12) == MCDB_WARM_PGSHIFT) {
+        const uint64_t size =
+            ((uint64_t)uint32_strunpack_bigendian_macro(hdr+16) << 32)
+          | uint32_strunpack_bigendian_macro(hdr+20);
+        const uint64_t npages =
+          (size + MCDB_WARM_PAGESZ-1) >> MCDB_WARM_PGSHIFT;
+        if (size < MCDB_HEADER_SZ
+            || (uint64_t)st.st_size - sizeof(hdr) != mcdb_warm_bitmapsz(npages))
+            errno = EINVAL;
+        else if (mcdb_warm_init(w, size, fn_malloc, fn_free)) {
+            sz = mcdb_warm_bitmapsz(w->npages);
+            for (len = 0; len < sz
+                 && ((rd = read(fd, w->bits+len, sz - len)) > 0
+                     || (rd == -1 && errno == EINTR)); )
+                len += (rd > 0) ? (size_t)rd : 0;
+            if (len == sz)
+                rc = true;
+            else {
+                mcdb_warm_destroy(w);
+                if (rd == 0)
+                    errno = EINVAL;  /*(file truncated while reading)*/
+            }
+        }
+    }
+    else if (rd != -1)
+        errno = EINVAL;
+    (void) nointr_close(fd);
+    return rc;
+}
+
+int
+mcdb_warm_write(const struct mcdb_warm * const restrict w,
+                const char * const fname)
+{
+    struct mcdb_make mf;
+    char hdr[MCDB_WARM_HDRSZ];
+    int rc;
+    memcpy(hdr, MCDB_WARM_MAGIC, 8);
+    uint32_strpack_bigendian_macro(hdr+8,  MCDB_WARM_VERSION);
+    uint32_strpack_bigendian_macro(hdr+12, MCDB_WARM_PGSHIFT);
+    uint32_strpack_bigendian_macro(hdr+16, (uint32_t)(w->size >> 32));
+    uint32_strpack_bigendian_macro(hdr+20, (uint32_t)w->size);
+    if (mcdb_makefn_start(&mf, fname, w->fn_malloc, w->fn_free) != 0)
+        return -1;
+    rc = (nointr_write(mf.fd, hdr, sizeof(hdr)) != -1
+          && nointr_write(mf.fd, (char *)w->bits,
+                          mcdb_warm_bitmapsz(w->npages)) != -1)
+      ? mcdb_makefn_finish(&mf, true)
+      : -1;
+    mcdb_makefn_cleanup(&mf);
+    return rc;
+}
+
+void
+mcdb_warm_mark(struct mcdb_warm * const restrict w,
+               const uint64_t off, const uint64_t len)
+{
+    uint64_t pg, last;
+    if (len == 0 || off >= w->size)
+        return;
+    last = ((len < w->size - off) ? off + len - 1 : w->size - 1)
+         >> MCDB_WARM_PGSHIFT;
+    for (pg = off >> MCDB_WARM_PGSHIFT; pg <= last; ++pg)
+        w->bits[pg >> 3] |= (unsigned char)(1u << (pg & 7));
+}
+
+/* (as mcdb_findtag_hash() in mcdb.c) */
+static uint32_t
+mcdb_warm_hash(const struct mcdb_mmap * const restrict map,
+               const char * const restrict key, const size_t klen,
+               const unsigned char tagc)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static uint32_t
+mcdb_warm_hash(const struct mcdb_mmap * const restrict map,
+               const char * const restrict key, const size_t klen,
+               const unsigned char tagc)
+{
+    if (map->hash_fn == uint32_hash_djb) {
+        const uint32_t khash_init = (tagc != 0)
+          ? uint32_hash_djb_uchar(UINT32_HASH_DJB_INIT, tagc)
+          : UINT32_HASH_DJB_INIT;
+        return uint32_hash_djb(khash_init, key, klen);
+    }
+    else if (map->hash_fn == uint32_hash_fast) {
+        return (tagc != 0)
+          ? uint32_hash_fast_tagged(map->hash_init, tagc, key, klen)
+          : uint32_hash_fast(map->hash_init, key, klen);
+    }
+    else {
+        const uint32_t khash_init = (tagc != 0)
+          ? map->hash_fn(map->hash_init, (const char *)&tagc, 1u)
+          : map->hash_init;
+        return map->hash_fn(khash_init, key, klen);
+    }
+}
+
+bool
+mcdb_warm_findtag(struct mcdb_warm * const restrict w,
+                  struct mcdb * const restrict m,
+                  const char * const restrict key, const size_t klen,
+                  const unsigned char tagc)
+{
+    const struct mcdb_mmap * const restrict map = m->map;
+    const uint32_t khash = mcdb_warm_hash(map, key, klen, tagc);
+    uintptr_t kpos;
+    bool rc;
+
+    mcdb_warm_mark(w, 0, MCDB_HEADER_SZ);  /* header slots */
+    if (map->bloom != NULL) {
+        const uint64_t x = mcdb_bloom_mix(khash);
+        mcdb_warm_mark(w, (uint64_t)(map->bloom - map->ptr)
+                          + mcdb_bloom_blk(x, map->bloom_nblk)
+                            * MCDB_BLOOM_BLKSZ, MCDB_BLOOM_BLKSZ);
+    }
+
+    if (!mcdb_findtagstart(m, key, klen, tagc))
+        return false;
+    if (m->mphf) {  /* pilot and element (m->dpos) (see mcdb_findtag_mphf())*/
+        const uint64_t x = mcdb_mphf_mix(khash);
+        mcdb_warm_mark(w, (uint64_t)(map->mphf - map->ptr)
+                          + ((uint64_t)mcdb_mphf_bkt(x, map->mphf_nb) << 1), 2);
+        mcdb_warm_mark(w, m->dpos, 1u << map->mphf_b);
+    }
+    kpos = m->kpos;
+    rc = mcdb_findtagnext(m, key, klen, tagc);
+
+    /* hash table elements probed, from kpos to m->kpos (wraps at end)
+     * (m->hslots is 0 if found in mphf; tables not probed) */
+    if (m->hslots != 0) {
+        if (m->kpos > kpos)
+            mcdb_warm_mark(w, kpos, m->kpos - kpos);
+        else {
+            mcdb_warm_mark(w, kpos, m->hpos + ((uint64_t)m->hslots << map->b)
+                                    - kpos);
+            mcdb_warm_mark(w, m->hpos, m->kpos - m->hpos);
+        }
+    }
+
+    if (rc) {  /* record; data and shared data ref or compressed data len */
+        mcdb_warm_mark(w, m->rpos - 8 - m->klen, 8 + (uint64_t)m->klen);
+        if (m->rpos != m->dpos)
+            mcdb_warm_mark(w, m->rpos, 8);
+        mcdb_warm_mark(w, m->dpos, m->zlen != 0 ? m->zlen : m->dlen);
+        if (m->zlen != 0 && map->zdict != NULL)  /*(inflate with dictionary)*/
+            mcdb_warm_mark(w, (uint64_t)(map->zdict - map->ptr), map->zdict_sz);
+    }
+    return rc;
+}
+
+bool
+mcdb_warm_sample(struct mcdb_warm * const restrict w,
+                 const struct mcdb_mmap * const restrict map)
+{
+    const size_t pgsz = plasma_sysconf_pagesize();
+    const uintptr_t size = (w->size < map->size) ? (uintptr_t)w->size
+                                                 : map->size;
+    unsigned char *vec = w->fn_malloc(MCDB_WARM_SAMPLE);
+    uintptr_t off;
+    size_t i, n;
+    if (vec == NULL)
+        return false;
+    for (off = 0; off < size; off += n * pgsz) {
+        const uintptr_t len = (size - off < MCDB_WARM_SAMPLE * pgsz)
+          ? size - off
+          : MCDB_WARM_SAMPLE * pgsz;
+        n = (len + pgsz - 1) / pgsz;
+        if (mincore(map->ptr + off, len, (void *)vec) != 0) {
+            w->fn_free(vec);
+            return false;
+        }
+        for (i = 0; i < n; ++i) {
+            if (vec[i] & 1)
+                mcdb_warm_mark(w, off + i * pgsz, pgsz);
+        }
+    }
+    w->fn_free(vec);
+    return true;
+}
+
+uint64_t
+mcdb_warm_count(const struct mcdb_warm * const restrict w)
+{
+    const size_t sz = mcdb_warm_bitmapsz(w->npages);
+    uint64_t n = 0;
+    size_t i;
+    for (i = 0; i < sz; ++i)
+        n += (uint64_t)__builtin_popcount(w->bits[i]);
+    return n;
+}
+
+struct mcdb_warm_ctx {
+  const struct mcdb_warm *w;
+  const unsigned char *ptr;   /* map->ptr */
+  uintptr_t pgmask;           /* system page size - 1 */
+  uint64_t nchunks;           /* num of MCDB_WARM_CHUNK page chunks */
+  uint64_t next;              /* next chunk to prefetch */
+};
+
+/* prefetch chunks of pages, taking next chunk until none remain
+ * (WILLNEED on each run of hot pages in chunk, so that reads are queued,
+ *  then read each hot page, so that pages are resident upon return) */
+static void *
+mcdb_warm_prefault_thread(void * const arg)
+  __attribute_nonnull__;
+static void *
+mcdb_warm_prefault_thread(void * const arg)
+{
+    struct mcdb_warm_ctx * const ctx = arg;
+    const struct mcdb_warm * const restrict w = ctx->w;
+    uint64_t c, pg, s, e;
+    while ((c =
+          #ifdef _THREAD_SAFE
+            plasma_atomic_fetch_add_u64(&ctx->next, 1, memory_order_relaxed)
+          #else
+            ctx->next++
+          #endif
+           ) < ctx->nchunks) {
+        const uint64_t end = ((c+1) * MCDB_WARM_CHUNK < w->npages)
+          ? (c+1) * MCDB_WARM_CHUNK
+          : w->npages;
+        for (pg = c * MCDB_WARM_CHUNK; pg < end; pg = e) {
+            for (s = pg; s < end && !mcdb_warm_test(w, s); ++s) ;
+            for (e = s; e < end &&  mcdb_warm_test(w, e); ++e) ;
+            if (s != e) {
+                const uintptr_t off =
+                  (uintptr_t)(s << MCDB_WARM_PGSHIFT) & ~ctx->pgmask;
+                const uintptr_t len = (e << MCDB_WARM_PGSHIFT < w->size)
+                  ? (uintptr_t)(e << MCDB_WARM_PGSHIFT) - off
+                  : (uintptr_t)w->size - off;
+                posix_madvise((void *)(uintptr_t)(ctx->ptr + off), len,
+                              POSIX_MADV_WILLNEED);
+            }
+        }
+        for (pg = c * MCDB_WARM_CHUNK; pg < end; ++pg) {
+            if (mcdb_warm_test(w, pg))
+                (void)*(volatile const unsigned char *)
+                  (ctx->ptr + (uintptr_t)(pg << MCDB_WARM_PGSHIFT));
+        }
+    }
+    return NULL;
+}
+
+bool
+mcdb_warm_prefault(const struct mcdb_warm * const restrict w,
+                   const struct mcdb_mmap * const restrict map,
+                   const uint32_t nthreads)
+{
+    struct mcdb_warm_ctx ctx;
+    if (w->size != (uint64_t)map->size)
+        return (errno = EINVAL, false);  /*(profile of different mcdb)*/
+    ctx.w = w;
+    ctx.ptr = map->ptr;
+    ctx.pgmask = (uintptr_t)plasma_sysconf_pagesize() - 1;
+    ctx.nchunks = (w->npages + MCDB_WARM_CHUNK-1) / MCDB_WARM_CHUNK;
+    ctx.next = 0;
+    /* (no read-around on faults of hot pages; read only runs of hot pages) */
+    posix_madvise((void *)(uintptr_t)map->ptr, map->size, POSIX_MADV_RANDOM);
+  #ifdef _THREAD_SAFE
+    {
+        pthread_t tid[64];
+        uint32_t i, n = (nthreads < ctx.nchunks) ? nthreads
+                                                 : (uint32_t)ctx.nchunks;
+        if (n > sizeof(tid)/sizeof(*tid))
+            n = sizeof(tid)/sizeof(*tid);
+        for (i = 0; i+1 < n; ++i) {
+            if (pthread_create(tid+i, NULL, mcdb_warm_prefault_thread,&ctx)!=0)
+                break; /* (continue with fewer threads if creation fails) */
+        }
+        (void)mcdb_warm_prefault_thread(&ctx);
+        while (i)
+            pthread_join(tid[--i], NULL);
+    }
+  #else
+    (void)nthreads;
+    (void)mcdb_warm_prefault_thread(&ctx);
+  #endif
+    return true;
+}
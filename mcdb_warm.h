@@ -0,0 +1,136 @@
+/*
+ * mcdb_warm - access profiles (page bitmaps) and page cache warmup of mcdb
+ *
+ * Copyright (c) 2010, Glue Logic LLC. All rights reserved. code()gluelogic.com
+ *
+ *  This file is part of mcdb.
+ *
+ *  mcdb is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mcdb is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with mcdb.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * mcdb is originally based upon the Public Domain cdb-0.75 by Dan Bernstein
+ */
+
+#ifndef INCLUDED_MCDB_WARM_H
+#define INCLUDED_MCDB_WARM_H
+
+#include "plasma/plasma_feature.h"
+#include "plasma/plasma_attr.h"
+#include "plasma/plasma_stdtypes.h" /* bool, size_t, uint32_t, uint64_t */
+#include "mcdb.h"
+PLASMA_ATTR_Pragma_once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* access profile: bitmap of MCDB_WARM_PAGESZ pages of an mcdb touched by
+ * lookups (the hot set), with which to warm page cache after new mcdb is
+ * renamed into place, rather than mcdb_mmap_prefault() of entire mcdb
+ *
+ * Profile is recorded offline from a key log, by lookups on the new mcdb
+ * with mcdb_warm_findtag() (marks pages of header slot, filter block and
+ * mphf element, hash table elements probed, record and data of first record)
+ * or sampled in a running process, by mcdb_warm_findtag() on some lookups,
+ * or by mcdb_warm_sample() (pages of map resident in page cache (mincore())).
+ * Profile applies to mcdb of same size (i.e. mcdb from which recorded).
+ *
+ * Profile file (conventionally <fname.mcdb>.warm, next to mcdb) is
+ * MCDB_WARM_MAGIC, 4-byte bigendian version and page shift, 8-byte bigendian
+ * mcdb size, then bitmap (bit (i & 7) of byte (i >> 3) set if page i is hot).
+ * mcdb_warm_write() writes temporary file and renames into place.
+ *
+ * mcdb_warm_prefault() prefetches hot pages (POSIX_MADV_WILLNEED on runs of
+ * hot pages, then reads each hot page), divided among nthreads threads so
+ * that page cache misses are serviced in parallel.
+ *
+ * (struct mcdb_warm is not thread-safe; use one per recording thread) */
+#define MCDB_WARM_MAGIC    "mcdbwarm"
+#define MCDB_WARM_VERSION  1u
+#define MCDB_WARM_PGSHIFT  12u
+#define MCDB_WARM_PAGESZ   (1u << MCDB_WARM_PGSHIFT)  /* 4 KB */
+#define MCDB_WARM_HDRSZ    24u
+
+struct mcdb_warm {
+  unsigned char *bits;        /* bitmap of hot pages */
+  uint64_t size;              /* size of mcdb covered by bitmap */
+  uint64_t npages;            /* num of pages in bitmap */
+  void * (*fn_malloc)(size_t);/* fn ptr to malloc() */
+  void (*fn_free)(void *);    /* fn ptr to free() */
+};
+
+#define mcdb_warm_test(w,pg) \
+  (((w)->bits[(pg) >> 3] >> ((pg) & 7)) & 1)
+
+
+/* init empty profile of mcdb of size (e.g. map->size)
+ * (returns false and errno upon failure) */
+EXPORT extern bool
+mcdb_warm_init(struct mcdb_warm * restrict, uint64_t,
+               void * (*)(size_t), void (*)(void *))
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+EXPORT extern void
+mcdb_warm_destroy(struct mcdb_warm * restrict)
+  __attribute_nonnull__;
+
+/* read profile fname (returns false and errno upon failure
+ * (EINVAL if profile is invalid)) */
+EXPORT extern bool
+mcdb_warm_read(struct mcdb_warm * restrict, const char *,
+               void * (*)(size_t), void (*)(void *))
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+/* write profile fname (returns 0 on success; -1 and errno upon failure) */
+EXPORT extern int
+mcdb_warm_write(const struct mcdb_warm * restrict, const char *)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+/* mark pages [off, off+len) hot */
+EXPORT extern void
+mcdb_warm_mark(struct mcdb_warm * restrict, uint64_t, uint64_t)
+  __attribute_nonnull__  __attribute_nothrow__;
+
+/* find first record of key (as mcdb_findtagstart(), mcdb_findtagnext()),
+ * marking pages touched by lookup (whether or not key is found) */
+EXPORT extern bool
+mcdb_warm_findtag(struct mcdb_warm * restrict, struct mcdb * restrict,
+                  const char * restrict, size_t, unsigned char)
+  __attribute_nonnull__;
+#define mcdb_warm_find(w,m,key,klen) mcdb_warm_findtag((w),(m),(key),(klen),0)
+
+/* mark pages of map resident in page cache (mincore())
+ * (returns false and errno upon failure) */
+EXPORT extern bool
+mcdb_warm_sample(struct mcdb_warm * restrict,
+                 const struct mcdb_mmap * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+/* num of hot pages in profile */
+__attribute_pure__
+EXPORT extern uint64_t
+mcdb_warm_count(const struct mcdb_warm * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+/* prefetch hot pages of map, with nthreads threads
+ * (returns false, errno EINVAL, if profile is not of mcdb of map size) */
+EXPORT extern bool
+mcdb_warm_prefault(const struct mcdb_warm * restrict,
+                   const struct mcdb_mmap * restrict, uint32_t)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,174 @@
+/*
+ * mcdb_zdata - read compressed data of mcdb records (MCDB_FMT_VALZ)
+ *
+ * Copyright (c) 2010, Glue Logic LLC. All rights reserved. code()gluelogic.com
+ *
+ *  This file is part of mcdb.
+ *
+ *  mcdb is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mcdb is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with mcdb.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * mcdb is originally based upon the Public Domain cdb-0.75 by Dan Bernstein
+ */
+
+/* Decompression is kept apart from mcdb.c so that mcdb.o (incl. its use in
+ * libnss_mcdb.so.2) does not depend on zlib.  Built with -DMCDB_ZLIB (see
+ * Makefile); otherwise, reading compressed data fails with ENOTSUP. */
+
+#include "mcdb.h"
+#include "plasma/plasma_attr.h"
+
+#include <errno.h>
+#include <stdlib.h>  /* malloc(), free() */
+#include <string.h>  /* memcpy() */
+
+#ifdef MCDB_ZLIB
+
+#include <zlib.h>
+
+#ifdef _THREAD_SAFE
+#include <pthread.h>
+#endif
+
+/* inflate stream is reused by thread (inflateReset() and preset dictionary
+ * per record, instead of inflateInit2() (and allocation of window) per record)
+ * (no thread-specific storage if !_THREAD_SAFE; stream per call) */
+
+static void
+mcdb_zstrm_free(void * const z)
+{
+    inflateEnd((z_stream *)z);
+    free(z);
+}
+
+#ifdef _THREAD_SAFE
+
+static pthread_key_t mcdb_zstrm_key;
+static pthread_once_t mcdb_zstrm_once = PTHREAD_ONCE_INIT;
+static int mcdb_zstrm_key_rc = -1;
+
+static void
+mcdb_zstrm_key_init(void)
+{
+    mcdb_zstrm_key_rc = pthread_key_create(&mcdb_zstrm_key, mcdb_zstrm_free);
+}
+
+#endif /* _THREAD_SAFE */
+
+static z_stream *
+mcdb_zstrm_get(void)
+  __attribute_warn_unused_result__;
+static z_stream *
+mcdb_zstrm_get(void)
+{
+    z_stream *z;
+  #ifdef _THREAD_SAFE
+    pthread_once(&mcdb_zstrm_once, mcdb_zstrm_key_init);
+    if (mcdb_zstrm_key_rc == 0
+        && (z = (z_stream *)pthread_getspecific(mcdb_zstrm_key)) != NULL)
+        return (inflateReset(z) == Z_OK) ? z : NULL;
+  #endif
+    z = (z_stream *)malloc(sizeof(z_stream));
+    if (z == NULL)
+        return NULL;
+    memset(z, 0, sizeof(z_stream));
+    if (inflateInit2(z, -MAX_WBITS) != Z_OK) { /*(raw deflate)*/
+        free(z);
+        return (errno = ENOMEM, NULL);
+    }
+  #ifdef _THREAD_SAFE
+    if (mcdb_zstrm_key_rc == 0)
+        (void)pthread_setspecific(mcdb_zstrm_key, z); /*(else released)*/
+  #endif
+    return z;
+}
+
+static void
+mcdb_zstrm_release(z_stream * const z)
+  __attribute_nonnull__;
+static void
+mcdb_zstrm_release(z_stream * const z)
+{
+  #ifdef _THREAD_SAFE
+    if (mcdb_zstrm_key_rc == 0 && pthread_getspecific(mcdb_zstrm_key) == z)
+        return;
+  #endif
+    mcdb_zstrm_free(z);
+}
+
+#endif /* MCDB_ZLIB */
+
+/* decompress zlen bytes at src into dlen bytes at buf (see MCDB_FMT_VALZ) */
+__attribute_noinline__
+static void *
+mcdb_zdata_inflate(const struct mcdb_mmap * const restrict map,
+                   const unsigned char * const restrict src,
+                   const uint32_t zlen, void * const restrict buf,
+                   const uint32_t dlen)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__
+static void *
+mcdb_zdata_inflate(const struct mcdb_mmap * const restrict map,
+                   const unsigned char * const restrict src,
+                   const uint32_t zlen, void * const restrict buf,
+                   const uint32_t dlen)
+{
+  #ifdef MCDB_ZLIB
+    z_stream * const restrict z = mcdb_zstrm_get();
+    int rc;
+    if (z == NULL)
+        return NULL;
+    z->next_in   = (Bytef *)(uintptr_t)src;
+    z->avail_in  = zlen;
+    z->next_out  = (Bytef *)buf;
+    z->avail_out = dlen;
+    rc = (map->zdict == NULL
+          || inflateSetDictionary(z, map->zdict, map->zdict_sz) == Z_OK)
+      ? inflate(z, Z_FINISH)
+      : Z_DATA_ERROR;
+    if (rc == Z_STREAM_END && (z->avail_out | z->avail_in) != 0)
+        rc = Z_DATA_ERROR;
+    mcdb_zstrm_release(z);
+    if (rc == Z_STREAM_END)
+        return buf;
+    errno = (rc == Z_MEM_ERROR) ? ENOMEM : EINVAL; /*(EINVAL: invalid mcdb)*/
+    return NULL;
+  #else
+    (void)map; (void)src; (void)zlen; (void)buf; (void)dlen;
+    errno = ENOTSUP;
+    return NULL;
+  #endif
+}
+
+/* copy data of record found (mcdb_find*()) into buf (mcdb_datalen() bytes)
+ * (decompress if compressed) */
+void *
+mcdb_readdata(const struct mcdb * const restrict m, void * const restrict buf)
+{
+    return (m->zlen == 0)
+      ? memcpy(buf, mcdb_dataptr(m), mcdb_datalen(m))
+      : mcdb_zdata_inflate(m->map, mcdb_dataptr(m), m->zlen, buf, m->dlen);
+}
+
+/* copy data of record at iter (mcdb_iter()) into buf (datalen bytes)
+ * (decompress if compressed) */
+void *
+mcdb_iter_readdata(const struct mcdb_iter * const restrict iter,
+                   void * const restrict buf)
+{
+    return (iter->zlen == 0)
+      ? memcpy(buf, mcdb_iter_dataptr(iter), mcdb_iter_datalen(iter))
+      : mcdb_zdata_inflate(iter->map, mcdb_iter_dataptr(iter), iter->zlen,
+                           buf, iter->dlen);
+}
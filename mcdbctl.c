@@ -1,5 +1,5 @@
 /*
- * mcdbctl - mcdb command line tool: make, get, dump, stats
+ * mcdbctl - mcdb command line tool: make, get, dump, stats, analyze, verify
  *
  * Copyright (c) 2010, Glue Logic LLC. All rights reserved. code()gluelogic.com
  *
@@ -32,9 +32,15 @@
 #define PLASMA_FEATURE_ENABLE_LARGEFILE
 
 #include "mcdb.h"
+#include "mcdb_make.h"
 #include "mcdb_makefmt.h"
 #include "mcdb_makefn.h"
+#include "mcdb_shard.h"
+#include "mcdb_layer.h"
+#include "mcdb_aio.h"
+#include "mcdb_warm.h"
 #include "mcdb_error.h"
+#include "mcdbctl_serve.h"
 #include "nointr.h"
 #include "uint32.h"
 #include "plasma/plasma_stdtypes.h"
@@ -42,6 +48,7 @@
 
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <errno.h>   /* errno, ENOMEM */
 #include <fcntl.h>   /* open(), O_RDONLY */
 #include <stdio.h>   /* printf(), IOV_MAX */
 #include <stdlib.h>  /* malloc(), free(), EXIT_SUCCESS */
@@ -50,6 +57,10 @@
 #include <sys/uio.h> /* writev() */
 #include <limits.h>  /* SSIZE_MAX */
 
+#ifdef _THREAD_SAFE
+#include <pthread.h> /* pthread_create(), pthread_join() */
+#endif
+
 /*(posix_madvise, defines not provided in Solaris 10, even w/ __EXTENSIONS__)*/
 #if (defined(__sun) || defined(__hpux)) && !defined(POSIX_MADV_NORMAL)
 extern int madvise(caddr_t, size_t, int);
@@ -116,17 +127,77 @@ writev_loop(const int fd, struct iovec * restrict iov, int iovcnt, ssize_t sz)
     return (iovcnt == 0);
 }
 
-/* read and dump data section of mcdb */
-static int
-mcdbctl_dump(struct mcdb * const restrict m)
+/* buffer for decompressed data (MCDB_FMT_VALZ) (reused for each record) */
+static char *mcdbctl_zbuf;
+static size_t mcdbctl_zbufsz;
+
+static char *
+mcdbctl_zbuf_get(const size_t len)
+  __attribute_warn_unused_result__;
+static char *
+mcdbctl_zbuf_get(const size_t len)
+{
+    if (mcdbctl_zbufsz < len) {
+        free(mcdbctl_zbuf);
+        mcdbctl_zbufsz = 0;
+        if ((mcdbctl_zbuf = malloc(len)) == NULL)
+            return NULL;
+        mcdbctl_zbufsz = len;
+    }
+    return mcdbctl_zbuf;
+}
+
+/* data of record found (decompressed into zbuf if compressed) (or NULL) */
+static void *
+mcdbctl_data(struct mcdb * const restrict m, int * const restrict rv)
   __attribute_nonnull__  __attribute_warn_unused_result__;
+static void *
+mcdbctl_data(struct mcdb * const restrict m, int * const restrict rv)
+{
+    char *zbuf;
+    void *data;
+    if (!mcdb_datazlen(m))
+        return mcdb_dataptr(m);
+    if ((zbuf = mcdbctl_zbuf_get(mcdb_datalen(m))) == NULL)
+        return (*rv = MCDB_ERROR_MALLOC, NULL);
+    if ((data = mcdb_readdata(m, zbuf)) == NULL)
+        *rv = MCDB_ERROR_READFORMAT;
+    return data;
+}
+
+/* next record (in key order) with key prefix pfx */
+static bool
+mcdbctl_dump_seek(struct mcdb_seek * const restrict cur,
+                  const char * const restrict pfx, const size_t pfxlen)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_dump_seek(struct mcdb_seek * const restrict cur,
+                  const char * const restrict pfx, const size_t pfxlen)
+{
+    return mcdb_seek_next(cur)
+        && mcdb_iter_keylen(&cur->iter) >= pfxlen
+        && 0 == memcmp(mcdb_iter_keyptr(&cur->iter), pfx, pfxlen);
+}
+
+/* read and dump data section of mcdb (part of nparts; see mcdb_iter_init_range)
+ * (or merged view of layers l (see mcdb_layer.h), if l is not NULL)
+ * (or records with key prefix pfx, in key order, if pfx is not NULL) */
 static int
-mcdbctl_dump(struct mcdb * const restrict m)
+mcdbctl_dump(struct mcdb * const restrict m, struct mcdb_layer * const l,
+             const char * const pfx, const uint32_t part, const uint32_t nparts)
+  __attribute_nonnull_x__((1))  __attribute_warn_unused_result__;
+static int
+mcdbctl_dump(struct mcdb * const restrict m, struct mcdb_layer * const l,
+             const char * const pfx, const uint32_t part, const uint32_t nparts)
 {
-    struct mcdb_iter iter;
+    struct mcdb_layer_iter liter;
+    struct mcdb_seek cur;
+    struct mcdb_iter * const iter = (pfx == NULL) ? &liter.iter : &cur.iter;
+    const size_t pfxlen = (pfx == NULL) ? 0 : strlen(pfx);
     uint32_t klen;
     uint32_t dlen;
-    unsigned char *mark = mcdb_madv_initmark(m->map->ptr, m->map->size, 0);
+    unsigned char *mark = (unsigned char *)~(uintptr_t)0;
+      /*(mark only if dumped in data section order)*/
     int    iovcnt = 0;
     size_t iovlen = 0;
     size_t buflen = 0;             /* _XOPEN_IOV_MAX minimum is 16 */
@@ -135,13 +206,25 @@ mcdbctl_dump(struct mcdb * const restrict m)
     char buf[(MCDB_IOVNUM * 3)];   /* each db entry might use (2) * 10 chars */
       /* oversized buffer since all num strings must add up to less than max */
 
-    mcdb_iter_init(&iter, m);
-    posix_madvise(iter.map, (size_t)(iter.eod - (unsigned char *)iter.map),
-                  POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
-    while (mcdb_iter(&iter)) {
+    if (pfx != NULL) {
+        if (!mcdb_seek(&cur, m, pfx, pfxlen))
+            return MCDB_ERROR_READ;  /*(EINVAL: no sorted key index)*/
+    }
+    else if (l != NULL)
+        mcdb_layer_iter_init(&liter, l);
+    else {
+        if (!mcdb_iter_init_range(iter, m, part, nparts))
+            return MCDB_ERROR_USAGE;
+        mark = mcdb_madv_initmark(m->map->ptr, m->map->size,
+                                  part ? (size_t)(iter->ptr - m->map->ptr) : 0);
+        posix_madvise(iter->map,(size_t)(iter->eod-(unsigned char *)iter->map),
+                      POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
+    }
+    while (pfx != NULL ? mcdbctl_dump_seek(&cur, pfx, pfxlen)
+           : l == NULL ? mcdb_iter(iter) : mcdb_layer_iter(&liter)) {
 
-        klen = mcdb_iter_keylen(&iter);
-        dlen = mcdb_iter_datalen(&iter);
+        klen = mcdb_iter_keylen(iter);
+        dlen = mcdb_iter_datalen(iter);
 
         /* avoid printf("%.*s\n",...) due to mcdb arbitrary binary data */
         /* klen, dlen each limited to (2GB - 8); space for extra tokens exists*/
@@ -151,7 +234,7 @@ mcdbctl_dump(struct mcdb * const restrict m)
             iovcnt = 0;
             iovlen = 0;
             buflen = 0;
-            mcdb_madv_dontneed(iter.ptr, mark); /*hint to release memory pages*/
+            mcdb_madv_dontneed(iter->ptr, mark);/*hint to release memory pages*/
         }
 
         iov[iovcnt].iov_base = "+";
@@ -174,7 +257,7 @@ mcdbctl_dump(struct mcdb * const restrict m)
         iov[iovcnt].iov_len  = 1;
         ++iovcnt;
 
-        iov[iovcnt].iov_base = mcdb_iter_keyptr(&iter);
+        iov[iovcnt].iov_base = mcdb_iter_keyptr(iter);
         iov[iovcnt].iov_len  = klen;
         ++iovcnt;
 
@@ -190,10 +273,23 @@ mcdbctl_dump(struct mcdb * const restrict m)
             iovcnt = 0;
             iovlen = 0;
             buflen = 0;
-            mcdb_madv_dontneed(iter.ptr, mark); /*hint to release memory pages*/
+            mcdb_madv_dontneed(iter->ptr, mark);/*hint to release memory pages*/
         }
 
-        iov[iovcnt].iov_base = mcdb_iter_dataptr(&iter);
+        iov[iovcnt].iov_base = mcdb_iter_dataptr(iter);
+        if (mcdb_iter_datazlen(iter)) {
+            /* decompress data (flush iovecs, since zbuf reused per record) */
+            char *zbuf;
+            if (!writev_loop(STDOUT_FILENO, iov, iovcnt, (ssize_t)iovlen))
+                return MCDB_ERROR_WRITE;
+            iovcnt = 0;
+            iovlen = 0;
+            buflen = 0;
+            if ((zbuf = mcdbctl_zbuf_get(dlen)) == NULL)
+                return MCDB_ERROR_MALLOC;
+            if ((iov[iovcnt].iov_base = mcdb_iter_readdata(iter, zbuf))==NULL)
+                return MCDB_ERROR_READFORMAT;
+        }
         iov[iovcnt].iov_len  = dlen;
         ++iovcnt;
 
@@ -212,6 +308,328 @@ mcdbctl_dump(struct mcdb * const restrict m)
       : MCDB_ERROR_WRITE;
 }
 
+/* dump in segments: records are cut (in order) into segments of about
+ * MCDBCTL_DUMP_SEGSZ bytes of output, formatted by threads into per-thread
+ * buffers, and segments are written to stdout in order.  Keys and data of at
+ * least MCDBCTL_DUMP_COPYMAX bytes, and raw records not compressed or shared,
+ * are written from the map (iovecs) rather than copied into buffer.
+ * raw format: records of 4-byte bigendian klen, 4-byte bigendian dlen, key,
+ * data (record format of mcdb data section), without end marker */
+
+#define MCDBCTL_DUMP_SEGSZ   (4u << 20)
+#define MCDBCTL_DUMP_COPYMAX 4096u
+
+struct mcdbctl_dump {
+  struct mcdb_iter iter;  /* (next record not yet cut into segment) */
+  unsigned char *mark;
+  size_t nseg;            /* (segments cut) */
+  size_t turn;            /* (segment to be written next) */
+  int rv;
+  bool raw;
+ #ifdef _THREAD_SAFE
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+ #endif
+};
+
+struct mcdbctl_dump_buf {
+  char *buf;
+  size_t bufsz;
+  struct iovec *iov;
+  size_t iovsz;
+  size_t iovcnt;
+};
+
+/* cut next segment from d->iter (returns bytes to be copied into buffer) */
+static size_t
+mcdbctl_dump_cut(struct mcdbctl_dump * const restrict d)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static size_t
+mcdbctl_dump_cut(struct mcdbctl_dump * const restrict d)
+{
+    struct mcdb_iter * const restrict iter = &d->iter;
+    size_t out = 0;
+    size_t need = 0;
+    while (out < MCDBCTL_DUMP_SEGSZ && mcdb_iter(iter)) {
+        const uint32_t klen = mcdb_iter_keylen(iter);
+        const uint32_t dlen = mcdb_iter_datalen(iter);
+        out += (size_t)klen + dlen + 8;
+        if (d->raw && mcdb_iter_datazlen(iter) == 0
+            && mcdb_iter_dataptr(iter) == mcdb_iter_keyptr(iter) + klen)
+            continue;  /*(record written from map)*/
+        need += 8+20; /*(raw 8-byte header; +20 for text "+klen,dlen:->\n")*/
+        if (klen < MCDBCTL_DUMP_COPYMAX)
+            need += klen;
+        if (dlen < MCDBCTL_DUMP_COPYMAX || mcdb_iter_datazlen(iter))
+            need += dlen;
+    }
+    return need;
+}
+
+/* add len bytes at p to iovecs (appended to previous iovec if contiguous) */
+static void
+mcdbctl_dump_iov(struct mcdbctl_dump_buf * const restrict b,
+                 const void * const restrict p, const size_t len)
+  __attribute_nonnull__;
+static void
+mcdbctl_dump_iov(struct mcdbctl_dump_buf * const restrict b,
+                 const void * const restrict p, const size_t len)
+{
+    struct iovec * const restrict iov = b->iov + b->iovcnt;
+    if (b->iovcnt != 0 && (char *)iov[-1].iov_base + iov[-1].iov_len == p
+        && iov[-1].iov_len <= SSIZE_MAX - len)
+        iov[-1].iov_len += len;
+    else {
+        iov->iov_base = (void *)(uintptr_t)p;
+        iov->iov_len  = len;
+        ++b->iovcnt;
+    }
+}
+
+/* format records of segment (start (iterator) through end) into b */
+static int
+mcdbctl_dump_fmt(struct mcdbctl_dump_buf * const restrict b,
+                 const struct mcdb_iter * const restrict start,
+                 const unsigned char * const end, const size_t need,
+                 const bool raw)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdbctl_dump_fmt(struct mcdbctl_dump_buf * const restrict b,
+                 const struct mcdb_iter * const restrict start,
+                 const unsigned char * const end, const size_t need,
+                 const bool raw)
+{
+    struct mcdb_iter iter = *start;
+    char *p;
+    uint32_t klen;
+    uint32_t dlen;
+    if (b->bufsz < need) {
+        free(b->buf);
+        b->bufsz = 0;
+        if ((b->buf = malloc(need)) == NULL)
+            return MCDB_ERROR_MALLOC;
+        b->bufsz = need;
+    }
+    p = b->buf;
+    b->iovcnt = 0;
+    while (iter.ptr < end && mcdb_iter(&iter)) {
+        if (b->iovsz - b->iovcnt < 8) {  /* each record uses <= 8 iovecs */
+            struct iovec * const iov =
+              realloc(b->iov, (b->iovsz + 1024) * sizeof(struct iovec));
+            if (iov == NULL)
+                return MCDB_ERROR_MALLOC;
+            b->iov = iov;
+            b->iovsz += 1024;
+        }
+        klen = mcdb_iter_keylen(&iter);
+        dlen = mcdb_iter_datalen(&iter);
+        if (raw) {
+            if (mcdb_iter_datazlen(&iter) == 0
+                && mcdb_iter_dataptr(&iter) == mcdb_iter_keyptr(&iter) + klen){
+                mcdbctl_dump_iov(b, mcdb_iter_keyptr(&iter) - 8,
+                                 (size_t)klen + dlen + 8);
+                continue;
+            }
+            uint32_strpack_bigendian_macro(p, klen);
+            uint32_strpack_bigendian_macro(p+4, dlen);
+            mcdbctl_dump_iov(b, p, 8);
+            p += 8;
+        }
+        else {
+            char * const s = p;
+            *p++ = '+';
+            p += uint32_to_ascii_base10(klen, p);
+            *p++ = ',';
+            p += uint32_to_ascii_base10(dlen, p);
+            *p++ = ':';
+            mcdbctl_dump_iov(b, s, (size_t)(p - s));
+        }
+        if (klen < MCDBCTL_DUMP_COPYMAX) {
+            memcpy(p, mcdb_iter_keyptr(&iter), klen);
+            mcdbctl_dump_iov(b, p, klen);
+            p += klen;
+        }
+        else
+            mcdbctl_dump_iov(b, mcdb_iter_keyptr(&iter), klen);
+        if (!raw) {
+            p[0] = '-';
+            p[1] = '>';
+            mcdbctl_dump_iov(b, p, 2);
+            p += 2;
+        }
+        if (mcdb_iter_datazlen(&iter)) {
+            if (mcdb_iter_readdata(&iter, p) == NULL)
+                return MCDB_ERROR_READFORMAT;
+            mcdbctl_dump_iov(b, p, dlen);
+            p += dlen;
+        }
+        else if (dlen < MCDBCTL_DUMP_COPYMAX) {
+            memcpy(p, mcdb_iter_dataptr(&iter), dlen);
+            mcdbctl_dump_iov(b, p, dlen);
+            p += dlen;
+        }
+        else
+            mcdbctl_dump_iov(b, mcdb_iter_dataptr(&iter), dlen);
+        if (!raw) {
+            *p = '\n';
+            mcdbctl_dump_iov(b, p, 1);
+            ++p;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/* write iovecs of segment (writev() at most IOV_MAX at a time) */
+static bool
+mcdbctl_dump_write(struct mcdbctl_dump_buf * const restrict b)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_dump_write(struct mcdbctl_dump_buf * const restrict b)
+{
+    struct iovec *iov = b->iov;
+    size_t n = b->iovcnt;
+    while (n != 0) {
+        int iovcnt = 0;
+        size_t sz = 0;
+        while ((size_t)iovcnt < n && iovcnt < IOV_MAX
+               && iov[iovcnt].iov_len <= SSIZE_MAX - sz)
+            sz += iov[iovcnt++].iov_len;
+        if (!writev_loop(STDOUT_FILENO, iov, iovcnt, (ssize_t)sz))
+            return false;
+        iov += iovcnt;
+        n -= (size_t)iovcnt;
+    }
+    return true;
+}
+
+static void *
+mcdbctl_dump_thread(void * const arg)
+  __attribute_nonnull__;
+static void *
+mcdbctl_dump_thread(void * const arg)
+{
+    struct mcdbctl_dump * const restrict d = (struct mcdbctl_dump *)arg;
+    struct mcdbctl_dump_buf b = { NULL, 0, NULL, 0, 0 };
+    struct mcdb_iter start;
+    const unsigned char *end;
+    unsigned char *mark;
+    size_t seg, need;
+    int rv;
+    for (;;) {
+      #ifdef _THREAD_SAFE
+        pthread_mutex_lock(&d->mutex);
+      #endif
+        if (d->rv != EXIT_SUCCESS || d->iter.ptr >= d->iter.eod) {
+          #ifdef _THREAD_SAFE
+            pthread_mutex_unlock(&d->mutex);
+          #endif
+            break;
+        }
+        seg   = d->nseg++;
+        start = d->iter;
+        need  = mcdbctl_dump_cut(d);
+        end   = d->iter.ptr;
+      #ifdef _THREAD_SAFE
+        pthread_mutex_unlock(&d->mutex);
+      #endif
+
+        rv = mcdbctl_dump_fmt(&b, &start, end, need, d->raw);
+
+      #ifdef _THREAD_SAFE
+        pthread_mutex_lock(&d->mutex);
+        while (d->turn != seg && d->rv == EXIT_SUCCESS)
+            pthread_cond_wait(&d->cond, &d->mutex);
+      #endif
+        if (d->rv != EXIT_SUCCESS)
+            rv = d->rv;
+        mark = d->mark;
+      #ifdef _THREAD_SAFE
+        pthread_mutex_unlock(&d->mutex);
+      #endif
+
+        /* write segment in turn (segments written in order) */
+        if (rv == EXIT_SUCCESS) {
+            if (mcdbctl_dump_write(&b))
+                mcdb_madv_dontneed((unsigned char *)(uintptr_t)end, mark);
+            else
+                rv = MCDB_ERROR_WRITE;
+        }
+
+      #ifdef _THREAD_SAFE
+        pthread_mutex_lock(&d->mutex);
+      #endif
+        if (d->rv == EXIT_SUCCESS) {
+            d->rv = rv;
+            d->mark = mark;
+            ++d->turn;
+        }
+      #ifdef _THREAD_SAFE
+        pthread_cond_broadcast(&d->cond);
+        pthread_mutex_unlock(&d->mutex);
+      #endif
+        if (rv != EXIT_SUCCESS)
+            break;
+    }
+    free(b.iov);
+    free(b.buf);
+    return NULL;
+}
+
+/* read and dump data section of mcdb in segments, using nthreads threads
+ * (raw format if raw, else cdbmake format (as mcdbctl_dump()))
+ * (part of nparts (see mcdb_iter_init_range())) */
+static int
+mcdbctl_dump_mt(struct mcdb * const restrict m, const uint32_t nthreads,
+                const bool raw, const uint32_t part, const uint32_t nparts)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdbctl_dump_mt(struct mcdb * const restrict m, const uint32_t nthreads,
+                const bool raw, const uint32_t part, const uint32_t nparts)
+{
+    struct mcdbctl_dump d;
+  #ifdef _THREAD_SAFE
+    pthread_t tid[MCDB_SLOTS];
+    uint32_t i, n = 0;
+  #endif
+    if (!mcdb_iter_init_range(&d.iter, m, part, nparts))
+        return MCDB_ERROR_USAGE;
+    d.mark = mcdb_madv_initmark(m->map->ptr, m->map->size,
+                                part ? (size_t)(d.iter.ptr - m->map->ptr) : 0);
+    d.nseg = 0;
+    d.turn = 0;
+    d.rv   = EXIT_SUCCESS;
+    d.raw  = raw;
+    posix_madvise(d.iter.map,(size_t)(d.iter.eod-(unsigned char *)d.iter.map),
+                  POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
+  #ifdef _THREAD_SAFE
+    if (0 != pthread_mutex_init(&d.mutex, NULL))
+        return MCDB_ERROR_MALLOC;
+    if (0 != pthread_cond_init(&d.cond, NULL)) {
+        pthread_mutex_destroy(&d.mutex);
+        return MCDB_ERROR_MALLOC;
+    }
+    for (i = 1; i < nthreads; ++i) {
+        if (0 == pthread_create(&tid[n], NULL, mcdbctl_dump_thread, &d))
+            ++n;
+    }
+  #else
+    (void)nthreads;
+  #endif
+    mcdbctl_dump_thread(&d);
+  #ifdef _THREAD_SAFE
+    for (i = 0; i < n; ++i)
+        pthread_join(tid[i], NULL);
+    pthread_cond_destroy(&d.cond);
+    pthread_mutex_destroy(&d.mutex);
+  #endif
+    if (d.rv != EXIT_SUCCESS)
+        return d.rv;
+    /* append blank line ("\n") to indicate end of data (cdbmake format) */
+    return (raw || write(STDOUT_FILENO, "\n", 1) == 1)
+      ? EXIT_SUCCESS
+      : MCDB_ERROR_WRITE;
+}
+
 /* Note: mcdbctl_stats() is equivalent test to pass/fail of djb cdbtest */
 static int
 mcdbctl_stats(struct mcdb * const restrict m)
@@ -256,6 +674,387 @@ mcdbctl_stats(struct mcdb * const restrict m)
     return EXIT_SUCCESS;
 }
 
+/* layout analysis (mcdbctl analyze): sizes of header, data, sections and
+ * hash tables; dead space (padding and empty hash table elements); per-slot
+ * load factor; probes and cache lines (64 bytes) touched by lookup of each
+ * record (hit) and expected for lookup of key not in mcdb (miss; uniform
+ * random start in each hash table, weighted equally across header slots;
+ * reduced by filter false positive rate estimated from filter bit density);
+ * log2 histograms of key and value sizes */
+
+struct mcdbctl_sizes {
+  uint64_t sum;
+  uint32_t min;
+  uint32_t max;
+  unsigned long n[33];       /* [0] len 0; [i] len in [2^(i-1), 2^i - 1] */
+};
+
+static void
+mcdbctl_sizes_add(struct mcdbctl_sizes * const restrict s, const uint32_t len)
+  __attribute_nonnull__;
+static void
+mcdbctl_sizes_add(struct mcdbctl_sizes * const restrict s, const uint32_t len)
+{
+    s->sum += len;
+    if (s->min > len) s->min = len;
+    if (s->max < len) s->max = len;
+    ++s->n[len ? 32 - __builtin_clz(len) : 0];
+}
+
+static void
+mcdbctl_sizes_print(const char * const restrict name,
+                    const struct mcdbctl_sizes * const restrict s,
+                    const unsigned long nrec)
+  __attribute_nonnull__;
+static void
+mcdbctl_sizes_print(const char * const restrict name,
+                    const struct mcdbctl_sizes * const restrict s,
+                    const unsigned long nrec)
+{
+    printf("%s min %u avg %.1f max %u\n", name, nrec ? s->min : 0,
+           nrec ? (double)s->sum / nrec : 0.0, s->max);
+    for (uint32_t i = 0; i < 33; ++i) {
+        if (s->n[i])
+            printf("%s %u-%u %lu\n", name, i ? 1u << (i-1) : 0,
+                   i ? (uint32_t)((UINT64_C(1) << i) - 1) : 0, s->n[i]);
+    }
+}
+
+/* num of cache lines spanned by [pos, pos+len) */
+#define mcdbctl_lines(pos,len) \
+  ((len) ? (((pos)+(len)-1) >> 6) - ((pos) >> 6) + 1 : 0)
+
+/* hash table element is empty (dpos 0; byte order independent) */
+static bool
+mcdbctl_elt_empty(const unsigned char * const restrict p, const uint32_t fmt,
+                  const uint32_t b)
+  __attribute_nonnull__  __attribute_pure__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_elt_empty(const unsigned char * const restrict p, const uint32_t fmt,
+                  const uint32_t b)
+{
+    if (b == 4)
+        return (p[8]|p[9]|p[10]|p[11]|p[12]|p[13]|p[14]|p[15]) == 0;
+    if ((p[4]|p[5]|p[6]|p[7]) != 0)
+        return false;
+    return (fmt & MCDB_FMT_LAYOUT_MASK) != MCDB_FMT_LAYOUT_PACKED
+        || ((fmt & MCDB_FMT_INDEX_LE) ? p[0] : p[3]) == 0; /*(dpos hi bits)*/
+}
+
+/* cache lines of elements [kpos, kpos + n<<b) of hash table (wraps) */
+static uint64_t
+mcdbctl_elt_lines(const uintptr_t hpos, const uintptr_t hend,
+                  const uintptr_t kpos, const uint64_t n, const uint32_t b)
+  __attribute_const__  __attribute_warn_unused_result__;
+static uint64_t
+mcdbctl_elt_lines(const uintptr_t hpos, const uintptr_t hend,
+                  const uintptr_t kpos, const uint64_t n, const uint32_t b)
+{
+    const uint64_t len = n << b;
+    return (kpos + len <= hend)
+      ? mcdbctl_lines(kpos, len)
+      : mcdbctl_lines(kpos, hend - kpos)
+        + mcdbctl_lines(hpos, len - (hend - kpos));
+}
+
+static int
+mcdbctl_analyze(struct mcdb * const restrict m)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdbctl_analyze(struct mcdb * const restrict m)
+{
+    const struct mcdb_mmap * const restrict map = m->map;
+    const unsigned char * const restrict ptr = map->ptr;
+    const uint32_t fmt = map->fmt;
+    const uint32_t layout = fmt & MCDB_FMT_LAYOUT_MASK;
+    const uint32_t b = map->b;
+    const uint32_t stride = (layout == MCDB_FMT_LAYOUT_BUCKET) ? 8 : 1;
+    struct mcdb_iter iter;
+    struct mcdbctl_sizes ks, ds;
+    unsigned long numd[11] = { 0,0,0,0,0,0,0,0,0,0,0 };
+    unsigned long nrec = 0, nref = 0, ntomb = 0, nmphf = 0, slots_empty = 0;
+    uint64_t dend = MCDB_HEADER_SZ;
+    uint64_t kbytes = 0, rbytes = 0, sbytes = 0, tbytes = 0, ebytes = 0;
+    uint64_t probes = 0, hlines_idx = 0, hlines_rec = 0, maxprobe = 0;
+    uint64_t nelt = 0, nfull = 0, smin = ~(uint64_t)0, smax = 0;
+    double miss_probes = 0.0, miss_lines = 0.0;
+    double lmin = 1.0, lmax = 0.0, lsum = 0.0, fpr = 1.0;
+    uint32_t i, nslots = 0;
+    unsigned char *mark = mcdb_madv_initmark(m->map->ptr, m->map->size,
+                                             MCDB_HEADER_SZ);
+    posix_madvise(m->map->ptr, m->map->size,
+                  POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
+    if (!mcdb_validate_slots(m))
+        return MCDB_ERROR_READFORMAT;
+
+    /* hash tables: per-slot load and expected cost of miss */
+    for (i = 0; i < MCDB_SLOTS; ++i) {
+        const unsigned char * const restrict h = ptr + (i << 4);
+        const uintptr_t hpos = uint64_strunpack_bigendian_aligned_macro(h);
+        const uint32_t hslots = uint32_strunpack_bigendian_aligned_macro(h+8);
+        const uintptr_t hend = hpos + ((uintptr_t)hslots << b);
+        uint64_t full = 0, run = 0, mp = 0, ml = 0;
+        uint32_t j, e;
+        if (hslots == 0) {
+            ++slots_empty;
+            smin = 0;
+            continue;
+        }
+        tbytes += (uint64_t)hslots << b;
+        for (e = 0; e < hslots; ++e) {
+            if (mcdbctl_elt_empty(ptr + hpos + ((uintptr_t)e << b), fmt, b))
+                break;
+        }
+        if (e == hslots) {  /* (full table; miss probes every element) */
+            full = hslots;
+            mp = (uint64_t)hslots * (hslots / stride);
+            ml = mcdbctl_lines(hpos, (uint64_t)hslots << b) * (hslots/stride);
+        }
+        else {
+            /* walk back from empty element e; run is num of non-empty
+             * elements which miss starting at j probes before empty elt */
+            j = e;
+            do {
+                j = (j ? j : hslots) - 1;
+                if (mcdbctl_elt_empty(ptr + hpos + ((uintptr_t)j << b), fmt,b))
+                    run = 0;
+                else {
+                    ++run;
+                    ++full;
+                }
+                if (j % stride == 0) {
+                    mp += run;
+                    ml += mcdbctl_elt_lines(hpos, hend,
+                                            hpos + ((uintptr_t)j << b),
+                                            run + 1, b);
+                }
+            } while (j != e);
+        }
+        ++nslots;
+        nelt  += hslots;
+        nfull += full;
+        ebytes += (uint64_t)(hslots - full) << b;
+        if (smin > full) smin = full;
+        if (smax < full) smax = full;
+        lsum += (double)full / hslots;
+        if (lmin > (double)full / hslots) lmin = (double)full / hslots;
+        if (lmax < (double)full / hslots) lmax = (double)full / hslots;
+        miss_probes += (double)mp / (hslots / stride) / MCDB_SLOTS;
+        miss_lines  += (double)ml / (hslots / stride) / MCDB_SLOTS;
+    }
+    if (nslots == 0)
+        lmin = 0.0;
+
+    /* optional sections */
+    if (map->bloom) {
+        const uint64_t sz = (uint64_t)map->bloom_nblk * MCDB_BLOOM_BLKSZ;
+        uint64_t nbits = 0;
+        for (uint64_t n = 0; n < sz; ++n)
+            nbits += (uint32_t)__builtin_popcount(map->bloom[n]);
+        for (i = 0; i < map->bloom_k; ++i)
+            fpr *= (double)nbits / (double)(sz << 3);
+        sbytes += sz;
+    }
+    if (map->mphf)
+        sbytes += (uint64_t)(map->mphf_tbl - map->mphf)
+               +  ((uint64_t)map->mphf_sz << map->mphf_b);
+    sbytes += map->zdict_sz + map->sorted_sz;
+    if (map->cksum)
+        sbytes += mcdb_cksum_sz(map->cksum_nblk);
+
+    /* records: sizes; probes and cache lines of lookup of each record */
+    memset(&ks, '\0', sizeof(ks));
+    memset(&ds, '\0', sizeof(ds));
+    ks.min = ds.min = ~0u;
+    mcdb_iter_init(&iter, m);
+    while (mcdb_iter(&iter)) {
+        char * const k = (char *)mcdb_iter_keyptr(&iter);
+        const uint32_t klen = mcdb_iter_keylen(&iter);
+        const uintptr_t rec = (uintptr_t)(k - 8 - (char *)ptr);
+        const uintptr_t rpos = rec + 8 + klen;
+        uintptr_t kpos = 0;
+        bool rc;
+        if ((rc = mcdb_findstart(m, k, klen))) {
+            kpos = m->kpos;
+            do { rc = mcdb_findnext(m, k, klen);
+            } while (rc && m->rpos != rpos);
+        }
+        if (!rc) return MCDB_ERROR_READFORMAT;
+        ++numd[ ((m->loop < 11) ? m->loop - 1 : 10) ];
+        ++nrec;
+        if (maxprobe < m->loop) maxprobe = m->loop;
+        hlines_idx += 1 + (map->bloom != NULL) + (map->mphf != NULL) * 2;
+        if (map->mphf != NULL && m->hslots == 0) {
+            ++nmphf;
+            ++probes;
+        }
+        else {
+            const uintptr_t hend = m->hpos + ((uintptr_t)m->hslots << b);
+            uint64_t n = ((m->kpos >= kpos ? 0 : hend - m->hpos)
+                          + m->kpos - kpos) >> b;
+            hlines_idx += mcdbctl_elt_lines(m->hpos, hend, kpos,
+                                            n ? n : m->hslots, b);
+            probes += m->loop;
+        }
+        if (m->zlen)           /* compressed data follows zlen in record */
+            hlines_rec += mcdbctl_lines(rec, m->dpos + m->zlen - rec);
+        else if (m->dpos != rpos) {             /* reference to shared data */
+            hlines_rec += mcdbctl_lines(rec, rpos + 8 - rec)
+                        + mcdbctl_lines(m->dpos, m->dlen);
+            if (m->dpos == MCDB_DPOS_TOMBSTONE)
+                ++ntomb;
+            else
+                ++nref;
+        }
+        else
+            hlines_rec += mcdbctl_lines(rec, m->dpos + m->dlen - rec);
+        mcdbctl_sizes_add(&ks, klen);
+        mcdbctl_sizes_add(&ds, m->dlen);
+        kbytes += klen;
+        rbytes += (uint64_t)(iter.ptr - (unsigned char *)ptr) - rec;
+        dend = (uint64_t)(iter.ptr - (unsigned char *)ptr);
+        mcdb_madv_dontneed(iter.ptr, mark);  /* hint to release memory pages */
+    }
+
+    printf("records %lu\n", nrec);
+    printf("size %llu\n", (unsigned long long)map->size);
+    printf("layout %s\n", layout == MCDB_FMT_LAYOUT_BUCKET ? "bucket"
+                        : layout == MCDB_FMT_LAYOUT_PACKED ? "packed"
+                        : "classic");
+    printf("element %u\n", 1u << b);
+    printf("index %s\n", (fmt & MCDB_FMT_INDEX_LE) ? "native" : "big");
+    printf("hash %s\n", (fmt & MCDB_FMT_HASH_MASK) == MCDB_FMT_HASH_FAST
+                        ? "fast" : "djb");
+    printf("sections%s%s%s%s%s%s\n", map->bloom  ? " bloom"  : "",
+           map->mphf   ? " mphf"   : "", map->sorted ? " sorted" : "",
+           map->zdict  ? " zdict"  : "", map->cksum  ? " cksum"  : "",
+           sbytes ? "" : " none");
+    printf("bytes header %u\n", MCDB_HEADER_SZ);
+    printf("bytes data %llu\n", (unsigned long long)(dend - MCDB_HEADER_SZ));
+    printf("bytes keys %llu\n", (unsigned long long)kbytes);
+    printf("bytes values %llu\n",
+           (unsigned long long)(rbytes - kbytes - (uint64_t)nrec * 8));
+    printf("bytes sections %llu\n", (unsigned long long)sbytes);
+    printf("bytes index %llu\n", (unsigned long long)tbytes);
+    printf("bytes dead %llu\n", (unsigned long long)
+           (map->size - MCDB_HEADER_SZ - rbytes - sbytes - tbytes + ebytes));
+    printf("bytes dead pad %llu\n", (unsigned long long)
+           (map->size - MCDB_HEADER_SZ - rbytes - sbytes - tbytes));
+    printf("bytes dead empty %llu\n", (unsigned long long)ebytes);
+    printf("refs shared %lu\n", nref);
+    printf("refs tombstone %lu\n", ntomb);
+    printf("slots empty %lu\n", slots_empty);
+    printf("slot records min %llu avg %.1f max %llu\n",
+           (unsigned long long)(smin == ~(uint64_t)0 ? 0 : smin),
+           (double)nfull / MCDB_SLOTS, (unsigned long long)smax);
+    printf("slot load min %.3f avg %.3f max %.3f\n", lmin,
+           nslots ? lsum / nslots : 0.0, lmax);
+    printf("load %.3f\n", nelt ? (double)nfull / nelt : 0.0);
+    printf("hit mphf %lu\n", nmphf);
+    printf("hit probes avg %.3f max %llu\n",
+           nrec ? (double)probes / nrec : 0.0, (unsigned long long)maxprobe);
+    for (i = 0; i < 10; ++i)
+        printf("hit d%u %lu\n", i, numd[i]);
+    printf("hit >9 %lu\n", numd[10]);
+    printf("hit lines avg %.3f index %.3f record %.3f\n",
+           nrec ? (double)(hlines_idx + hlines_rec) / nrec : 0.0,
+           nrec ? (double)hlines_idx / nrec : 0.0,
+           nrec ? (double)hlines_rec / nrec : 0.0);
+    if (map->bloom)
+        printf("miss filter fpr %.4f\n", fpr);
+    printf("miss probes avg %.3f\n",
+           fpr * ((map->mphf != NULL) + miss_probes));
+    printf("miss lines avg %.3f\n", 1.0 + (map->bloom != NULL)
+           + fpr * ((map->mphf != NULL) * 2 + miss_lines));
+    mcdbctl_sizes_print("klen", &ks, nrec);
+    mcdbctl_sizes_print("dlen", &ds, nrec);
+    return EXIT_SUCCESS;
+}
+
+/* integrity check (mcdbctl verify): checksums (MCDB_SECT_CKSUM) of header,
+ * section directory, and hash tables, and of data blocks in nthreads ranges;
+ * prints each mismatch (blocks in each range in order) */
+struct mcdbctl_verify {
+  const struct mcdb_mmap *map;
+  uint32_t first;
+  uint32_t end;
+  uint32_t nbad;
+};
+
+static void *
+mcdbctl_verify_thread(void * const arg)
+  __attribute_nonnull__;
+static void *
+mcdbctl_verify_thread(void * const arg)
+{
+    struct mcdbctl_verify * const restrict v = (struct mcdbctl_verify *)arg;
+    const struct mcdb_mmap * const restrict map = v->map;
+    uint32_t i = v->first;
+    while ((i = mcdb_verify_blocks(map, i, v->end - i)) < v->end) {
+        const uint64_t off = MCDB_HEADER_SZ + ((uint64_t)i << map->cksum_bits);
+        printf("bad block %u offset %llu\n", i, (unsigned long long)off);
+        ++v->nbad;
+        ++i;
+    }
+    return NULL;
+}
+
+static int
+mcdbctl_verify(struct mcdb * const restrict m, uint32_t nthreads)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdbctl_verify(struct mcdb * const restrict m, uint32_t nthreads)
+{
+    struct mcdbctl_verify v[MCDB_SLOTS];
+    const struct mcdb_mmap * const restrict map = m->map;
+    const uint32_t nblk = map->cksum_nblk;
+    uint32_t nbad = 0, i;
+  #ifdef _THREAD_SAFE
+    pthread_t tid[MCDB_SLOTS];
+    uint32_t n = 0;
+  #else
+    nthreads = 1;
+  #endif
+    if (map->cksum == NULL) {
+        fprintf(stderr, "mcdbctl: verify: no checksums (make -Y crc32c)\n");
+        return EXIT_FAILURE;  /*(nothing to verify; not error reading mcdb)*/
+    }
+    if (!mcdb_verify_index(map)) {
+        printf("bad index\n");
+        ++nbad;
+    }
+    else if (!mcdb_validate_slots(m))
+        return MCDB_ERROR_READFORMAT;
+    if (nthreads == 0)
+        nthreads = 1;
+    if (nthreads > nblk)
+        nthreads = nblk ? nblk : 1;
+    posix_madvise(map->ptr, map->cksum_end,
+                  POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
+    for (i = 0; i < nthreads; ++i) {
+        v[i].map   = map;
+        v[i].first = (uint32_t)((uint64_t)nblk * i / nthreads);
+        v[i].end   = (uint32_t)((uint64_t)nblk * (i+1) / nthreads);
+        v[i].nbad  = 0;
+    }
+  #ifdef _THREAD_SAFE
+    for (i = 1; i < nthreads; ++i) {
+        if (0 == pthread_create(&tid[n], NULL, mcdbctl_verify_thread, v+i))
+            ++n;
+        else
+            mcdbctl_verify_thread(v+i);
+    }
+  #endif
+    mcdbctl_verify_thread(v);
+  #ifdef _THREAD_SAFE
+    for (i = 0; i < n; ++i)
+        pthread_join(tid[i], NULL);
+  #endif
+    for (i = 0; i < nthreads; ++i)
+        nbad += v[i].nbad;
+    return (nbad == 0) ? EXIT_SUCCESS : MCDB_ERROR_READFORMAT;
+}
+
 static int
 mcdbctl_getseq(struct mcdb * const restrict m,
                const char * const restrict key, unsigned long seq)
@@ -271,8 +1070,10 @@ mcdbctl_getseq(struct mcdb * const restrict m,
         while ((rc = mcdb_findnext(m, key, klen)) && seq--)
             ;
         if (rc) {
+            int rv = EXIT_SUCCESS;
             /* avoid printf("%.*s\n",...) due to mcdb arbitrary binary data */
-            iov[0].iov_base = mcdb_dataptr(m);
+            if ((iov[0].iov_base = mcdbctl_data(m, &rv)) == NULL)
+                return rv;
             iov[0].iov_len  = mcdb_datalen(m);
             iov[1].iov_base = "\n";
             iov[1].iov_len  = 1;
@@ -293,11 +1094,32 @@ mcdbctl_getall(struct mcdb * const restrict m,
                const char * const restrict key)
 {
     const size_t klen = strlen(key);
-    struct iovec iov[2];
+    enum { MCDBCTL_IOVNUM = IOV_MAX/2 }; /* each value uses 2 iovecs */
+    struct iovec v[MCDBCTL_IOVNUM];
+    struct iovec iov[MCDBCTL_IOVNUM*2];
+    /* values referenced in map and written with single writev() (no copy);
+     * fall back to one value at a time if compressed or too many values */
+    const size_t n = mcdb_findall_iov(m, key, klen, v, MCDBCTL_IOVNUM);
+    if (n == 0)
+        return EXIT_FAILURE;
+    if (n <= MCDBCTL_IOVNUM) {
+        size_t i, sz = n;
+        for (i = 0; i < n; ++i) {
+            iov[(i<<1)]   = v[i];
+            iov[(i<<1)+1].iov_base = "\n";
+            iov[(i<<1)+1].iov_len  = 1;
+            sz += v[i].iov_len;
+        }
+        return writev_loop(STDOUT_FILENO, iov, (int)(n<<1), (ssize_t)sz)
+          ? EXIT_SUCCESS
+          : MCDB_ERROR_WRITE;
+    }
     if (mcdb_find(m, key, klen)) {
+        int rv = EXIT_SUCCESS;
         do {
             /* avoid printf("%.*s\n",...) due to mcdb arbitrary binary data */
-            iov[0].iov_base = mcdb_dataptr(m);
+            if ((iov[0].iov_base = mcdbctl_data(m, &rv)) == NULL)
+                return rv;
             iov[0].iov_len  = mcdb_datalen(m);
             iov[1].iov_base = "\n";
             iov[1].iov_len  = 1;
@@ -309,6 +1131,379 @@ mcdbctl_getall(struct mcdb * const restrict m,
     return EXIT_FAILURE;
 }
 
+/* batch queries: keys read from stdin (newline-terminated; or if raw,
+ * 4-byte bigendian klen and key), values written to stdout as by
+ * mcdbctl_getseq() or mcdbctl_getall() for each key in turn, so that output
+ * can be matched to keys: empty line is in place of value not found (seq)
+ * or follows values of each key ("all") (if raw, each value is 4-byte
+ * bigendian dlen and data, and 0xFFFFFFFF is in place of empty line)
+ * (an empty value, or value containing newline, is ambiguous unless raw).
+ * Lookups are batched (mcdb_find_batch()), or if aio, submitted to mcdb_aio
+ * (mcdb read, not mmap'd; first record of each key); output is buffered in
+ * iovecs (flushed before each read() of more keys, and after each aio batch).
+ * Returns EXIT_FAILURE if any key not found, after all keys are queried. */
+
+#define MCDBCTL_GETBATCH_KEYS 256
+#define MCDBCTL_GETBATCH_AIO_CACHE 256  /* hash table pages cached by aio */
+
+struct mcdbctl_getbatch_out {
+  int iovcnt;
+  size_t iovlen;
+  size_t lenpos;
+  struct iovec iov[IOV_MAX];
+  char lens[IOV_MAX * 2];  /* (raw 4-byte lens; each uses 2 iovecs or more)*/
+};
+
+static bool
+mcdbctl_getbatch_flush(struct mcdbctl_getbatch_out * const restrict o)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_getbatch_flush(struct mcdbctl_getbatch_out * const restrict o)
+{
+    const bool rc = (o->iovcnt == 0
+                     || writev_loop(STDOUT_FILENO, o->iov, o->iovcnt,
+                                    (ssize_t)o->iovlen));
+    o->iovcnt = 0;
+    o->iovlen = 0;
+    o->lenpos = 0;
+    return rc;
+}
+
+/* append value (or end marker if data is NULL: empty line, or if raw,
+ * 0xFFFFFFFF) to output */
+static bool
+mcdbctl_getbatch_value(struct mcdbctl_getbatch_out * const restrict o,
+                       const void * const restrict data, const uint32_t dlen,
+                       const bool raw)
+  __attribute_nonnull_x__((1))  __attribute_warn_unused_result__;
+static bool
+mcdbctl_getbatch_value(struct mcdbctl_getbatch_out * const restrict o,
+                       const void * const restrict data, const uint32_t dlen,
+                       const bool raw)
+{
+    struct iovec *iov;
+    if ((o->iovcnt + 2 > IOV_MAX || o->lenpos + 4 > sizeof(o->lens)
+         || o->iovlen + dlen + 4 > SSIZE_MAX)
+        && !mcdbctl_getbatch_flush(o))
+        return false;
+    iov = o->iov + o->iovcnt;
+    if (raw) {
+        iov->iov_base = o->lens + o->lenpos;
+        iov->iov_len  = 4;
+        if (data != NULL)
+            uint32_strpack_bigendian_macro(o->lens + o->lenpos, dlen);
+        else
+            memset(o->lens + o->lenpos, 0xFF, 4);
+        o->lenpos += 4;
+        ++iov;
+    }
+    if (data != NULL) {
+        iov->iov_base = (void *)(uintptr_t)data;
+        iov->iov_len  = dlen;
+        ++iov;
+    }
+    if (!raw) {
+        iov->iov_base = "\n";
+        iov->iov_len  = 1;
+        ++iov;
+    }
+    o->iovlen += (raw ? 4 : 1) + (data != NULL ? dlen : 0);
+    o->iovcnt = (int)(iov - o->iov);
+    return true;
+}
+
+static int
+mcdbctl_getbatch_run(struct mcdbctl_getbatch_out * const restrict o,
+                     struct mcdb * const restrict ms, const size_t n,
+                     const char ** const restrict keys,
+                     const size_t * const restrict klens,
+                     const unsigned long seq, const bool all, const bool raw,
+                     bool * const restrict notfound)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdbctl_getbatch_run(struct mcdbctl_getbatch_out * const restrict o,
+                     struct mcdb * const restrict ms, const size_t n,
+                     const char ** const restrict keys,
+                     const size_t * const restrict klens,
+                     const unsigned long seq, const bool all, const bool raw,
+                     bool * const restrict notfound)
+{
+    size_t i;
+    (void) mcdb_find_batch(ms, n, keys, klens);
+    for (i = 0; i < n; ++i) {
+        struct mcdb * const restrict m = ms + i;
+        unsigned long s = seq;
+        bool rc = (m->loop != 0);
+        if (!all) {
+            while (rc && s--)
+                rc = mcdb_findnext(m, keys[i], klens[i]);
+        }
+        if (!rc) {
+            *notfound = true;
+            if (!mcdbctl_getbatch_value(o, NULL, 0, raw))
+                return MCDB_ERROR_WRITE;
+            continue;
+        }
+        do {
+            int rv = EXIT_SUCCESS;
+            const bool z = (mcdb_datazlen(m) != 0);
+            const void * const data = mcdbctl_data(m, &rv);
+            if (data == NULL)
+                return rv;
+            if (!mcdbctl_getbatch_value(o, data, mcdb_datalen(m), raw)
+                || (z && !mcdbctl_getbatch_flush(o))) /*(zbuf reused)*/
+                return MCDB_ERROR_WRITE;
+        } while (all && mcdb_findnext(m, keys[i], klens[i]));
+        if (all && !mcdbctl_getbatch_value(o, NULL, 0, raw))
+            return MCDB_ERROR_WRITE;
+    }
+    return EXIT_SUCCESS;
+}
+
+static int
+mcdbctl_getbatch_aio(struct mcdbctl_getbatch_out * const restrict o,
+                     struct mcdb_aio * const restrict a, const size_t n,
+                     const char ** const restrict keys,
+                     const size_t * const restrict klens, const bool raw,
+                     bool * const restrict notfound)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdbctl_getbatch_aio(struct mcdbctl_getbatch_out * const restrict o,
+                     struct mcdb_aio * const restrict a, const size_t n,
+                     const char ** const restrict keys,
+                     const size_t * const restrict klens, const bool raw,
+                     bool * const restrict notfound)
+{
+    /* submit batch, then poll until all complete (any order); results are
+     * written in order of keys (data valid until next mcdb_aio_submit()) */
+    static struct mcdb_aio_result res[MCDBCTL_GETBATCH_KEYS];
+    struct mcdb_aio_result done[MCDBCTL_GETBATCH_KEYS];
+    size_t i, ndone = 0;
+    for (i = 0; i < n; ++i) {
+        if (!mcdb_aio_submit(a, keys[i], klens[i], 0, (void *)(uintptr_t)i))
+            return MCDB_ERROR_READ;
+    }
+    while (ndone < n) {
+        const int r = mcdb_aio_poll(a, done, (uint32_t)(n - ndone), true);
+        if (r <= 0) {
+            if (r == 0)
+                errno = EIO; /*(lookups in flight lost; not expected)*/
+            return MCDB_ERROR_READ;
+        }
+        for (i = 0; i < (size_t)r; ++i)
+            res[(uintptr_t)done[i].udata] = done[i];
+        ndone += (size_t)r;
+    }
+    for (i = 0; i < n; ++i) {
+        if (res[i].err == ENOENT) {
+            *notfound = true;
+            if (!mcdbctl_getbatch_value(o, NULL, 0, raw))
+                return MCDB_ERROR_WRITE;
+        }
+        else if (res[i].err != 0)
+            return (errno = res[i].err, MCDB_ERROR_READ);
+        else if (!mcdbctl_getbatch_value(o, res[i].data != NULL
+                                              ? res[i].data
+                                              : "", /*(tombstone)*/
+                                         res[i].dlen, raw))
+            return MCDB_ERROR_WRITE;
+    }
+    return mcdbctl_getbatch_flush(o) ? EXIT_SUCCESS : MCDB_ERROR_WRITE;
+}
+
+/* (m is NULL if a is not NULL) */
+static int
+mcdbctl_getbatch(struct mcdb * const restrict m, struct mcdb_aio * const a,
+                 const unsigned long seq, const bool all, const bool raw)
+  __attribute_warn_unused_result__;
+static int
+mcdbctl_getbatch(struct mcdb * const restrict m, struct mcdb_aio * const a,
+                 const unsigned long seq, const bool all, const bool raw)
+{
+    static struct mcdb ms[MCDBCTL_GETBATCH_KEYS];
+    static struct mcdbctl_getbatch_out o;
+    const char *keys[MCDBCTL_GETBATCH_KEYS];
+    size_t klens[MCDBCTL_GETBATCH_KEYS];
+    size_t bufsz = 65536;
+    size_t pos = 0, datasz = 0, n = 0, i;
+    char *buf = malloc(bufsz);
+    bool eof = false;
+    bool notfound = false;
+    int rv = EXIT_SUCCESS;
+    if (buf == NULL)
+        return MCDB_ERROR_MALLOC;
+    memset(ms, '\0', sizeof(ms));
+    for (i = 0; m != NULL && i < MCDBCTL_GETBATCH_KEYS; ++i)
+        ms[i].map = m->map;
+
+    for (;;) {
+        /* next key (entirely buffered) */
+        const char * const p = buf + pos;
+        const size_t avail = datasz - pos;
+        const char *e;
+        if (!raw) {
+            if ((e = memchr(p, '\n', avail)) != NULL || (eof && avail != 0)) {
+                keys[n]  = p;
+                klens[n] = (e != NULL) ? (size_t)(e - p) : avail;
+                pos += klens[n] + (e != NULL);
+                if (++n < MCDBCTL_GETBATCH_KEYS)
+                    continue;
+            }
+        }
+        else if (avail >= 4) {
+            const uint32_t klen = uint32_strunpack_bigendian_macro(p);
+            if (klen > INT_MAX - 8) {
+                rv = MCDB_ERROR_READFORMAT;
+                break;
+            }
+            if (avail - 4 >= klen) {
+                keys[n]  = p + 4;
+                klens[n] = klen;
+                pos += 4 + (size_t)klen;
+                if (++n < MCDBCTL_GETBATCH_KEYS)
+                    continue;
+            }
+        }
+
+        /* lookup batch (full, or before reading more keys) */
+        if (n != 0) {
+            rv = (a == NULL)
+              ? mcdbctl_getbatch_run(&o, ms, n, keys, klens, seq, all, raw,
+                                     &notfound)
+              : mcdbctl_getbatch_aio(&o, a, n, keys, klens, raw, &notfound);
+            n = 0;
+            if (rv != EXIT_SUCCESS)
+                break;
+            continue;
+        }
+
+        if (eof) {
+            if (pos != datasz)
+                rv = MCDB_ERROR_READFORMAT;  /*(raw: truncated key)*/
+            break;
+        }
+
+        /* read more keys (flush output first; reader might be waiting) */
+        if (!mcdbctl_getbatch_flush(&o)) {
+            rv = MCDB_ERROR_WRITE;
+            break;
+        }
+        if (pos != 0) {
+            if ((datasz -= pos))
+                memmove(buf, buf + pos, datasz);
+            pos = 0;
+        }
+        if (datasz == bufsz) {  /*(key longer than buf)*/
+            char * const nbuf = realloc(buf, bufsz << 1);
+            if (nbuf == NULL) {
+                rv = MCDB_ERROR_MALLOC;
+                break;
+            }
+            buf = nbuf;
+            bufsz <<= 1;
+        }
+        {
+            ssize_t r;
+            retry_eintr_do_while(
+              (r = read(STDIN_FILENO, buf + datasz, bufsz - datasz)),
+              (r == -1));
+            if (r > 0)
+                datasz += (size_t)r;
+            else if (r == 0)
+                eof = true;
+            else {
+                rv = MCDB_ERROR_READ;
+                break;
+            }
+        }
+    }
+
+    free(buf);
+    if (!mcdbctl_getbatch_flush(&o) && rv == EXIT_SUCCESS)
+        rv = MCDB_ERROR_WRITE;
+    return (rv == EXIT_SUCCESS && notfound) ? EXIT_FAILURE : rv;
+}
+
+/* get <key> in shard set (manifest fname) (see mcdb_shard.h) */
+static int
+mcdbctl_shard_get(const char * const restrict fname,
+                  const char * const restrict key, const unsigned long seq,
+                  const bool all)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdbctl_shard_get(const char * const restrict fname,
+                  const char * const restrict key, const unsigned long seq,
+                  const bool all)
+{
+    struct mcdb_shard sh;
+    struct mcdb *m;
+    int rv;
+    if (!mcdb_shard_create(&sh, fname, malloc, free))
+        return (errno == EINVAL) ? MCDB_ERROR_READFORMAT : MCDB_ERROR_READ;
+    m = mcdb_shard_mcdb(&sh, key, strlen(key), 0);
+    rv = all ? mcdbctl_getall(m, key) : mcdbctl_getseq(m, key, seq);
+    mcdb_shard_destroy(&sh);
+    return rv;
+}
+
+/* get <key> or dump of merged view of layers (see mcdb_layer.h):
+ * each -L <delta.mcdb> (newest first) in argv[2..fn-1], over argv[fn] */
+static int
+mcdbctl_layer(char ** const restrict argv, const int fn, const bool dump,
+              const unsigned long seq, const bool all)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdbctl_layer(char ** const restrict argv, const int fn, const bool dump,
+              const unsigned long seq, const bool all)
+{
+    struct mcdb_layer l;
+    const uint32_t n = (uint32_t)(fn - 2) / 2 + 1;
+    const char ** const fnames = malloc(n * sizeof(char *));
+    uint32_t i;
+    int rv = EXIT_FAILURE;
+    if (fnames == NULL)
+        return MCDB_ERROR_MALLOC;
+    for (i = 0; i < n-1; ++i)
+        fnames[i] = argv[3 + 2*i];
+    fnames[i] = argv[fn];
+    if (!mcdb_layer_create(&l, fnames, n, malloc, free)) {
+        rv = (errno == EINVAL) ? MCDB_ERROR_READFORMAT : MCDB_ERROR_READ;
+        free(fnames);
+        return rv;
+    }
+    free(fnames);
+    if (dump)
+        rv = mcdbctl_dump(l.m, &l, NULL, 0, 1);
+    else {
+        const char * const key = argv[fn+1];
+        const size_t klen = strlen(key);
+        unsigned long s = seq;
+        struct mcdb * const m = mcdb_layer_find(&l, key, klen);
+        bool rc = (m != NULL);
+        while (rc && !all && s--)
+            rc = mcdb_layer_findnext(m, key, klen);
+        if (rc) {
+            struct iovec iov[2];
+            do {
+                /* avoid printf("%.*s\n",...) due to mcdb binary data */
+                rv = EXIT_SUCCESS;
+                if ((iov[0].iov_base = mcdbctl_data(m, &rv)) == NULL)
+                    break;
+                iov[0].iov_len  = mcdb_datalen(m);
+                iov[1].iov_base = "\n";
+                iov[1].iov_len  = 1;
+                if (!writev_loop(STDOUT_FILENO, iov, 2,
+                                 (ssize_t)(iov[0].iov_len+1))) {
+                    rv = MCDB_ERROR_WRITE;
+                    break;
+                }
+            } while (all && mcdb_layer_findnext(m, key, klen));
+        }
+    }
+    mcdb_layer_destroy(&l);
+    return rv;
+}
+
 static int
 mcdbctl_query(const int argc, char ** restrict argv)
   __attribute_nonnull__  __attribute_warn_unused_result__;
@@ -320,36 +1515,170 @@ mcdbctl_query(const int argc, char ** restrict argv)
     int rv;
     int fd;
     unsigned long seq = 0;
+    uint32_t nthreads = 0;
+    bool raw = false;
+    bool aio = false;
+    const char *pfx = NULL;
+    uint32_t part = 0;
+    uint32_t nparts = 1;
+    int fn = 2;  /*(argv index of fname)*/
     enum { MCDBCTL_BAD_QUERY_TYPE, MCDBCTL_GET, MCDBCTL_GETALL,
-           MCDBCTL_DUMP, MCDBCTL_STATS }
+           MCDBCTL_DUMP, MCDBCTL_STATS, MCDBCTL_ANALYZE, MCDBCTL_VERIFY }
       query_type = MCDBCTL_BAD_QUERY_TYPE;
 
+    /* option -L <delta.mcdb> (repeatable; newest first) (get, dump):
+     * layers over <fname.mcdb> (see mcdb_layer.h) */
+    if (argc > 3
+        && (0 == strcmp(argv[1], "get") || 0 == strcmp(argv[1], "dump"))) {
+        while (fn+2 < argc && 0 == strcmp(argv[fn], "-L"))
+            fn += 2;
+    }
+
     /* validate args  (query type string == argv[1]) */
     if (argc > 3 && 0 == strcmp(argv[1], "get")) {
-        if (argc == 5) {
+        /* options -F line|raw, -O mmap|aio
+         * (only with key "-": batch of keys on stdin) */
+        while (fn+3 < argc && 0 != strcmp(argv[2], "-L")
+               && (0 == strcmp(argv[fn], "-F") || 0 == strcmp(argv[fn], "-O"))){
+            if (0 == strcmp(argv[fn], "-F")) {
+                if (0 == strcmp(argv[fn+1], "raw"))
+                    raw = true;
+                else if (0 != strcmp(argv[fn+1], "line"))
+                    return MCDB_ERROR_USAGE;
+            }
+            else if (0 == strcmp(argv[fn+1], "aio"))
+                aio = true;
+            else if (0 != strcmp(argv[fn+1], "mmap"))
+                return MCDB_ERROR_USAGE;
+            fn += 2;
+        }
+        if (fn != 2 && 0 != strcmp(argv[2], "-L")
+            && 0 != strcmp(argv[fn+1], "-"))
+            return MCDB_ERROR_USAGE;
+        if (argc == fn+3) {
             char *endptr;
-            seq = strtoul(argv[4], &endptr, 10);
-            if (seq != ULONG_MAX && argv[4] != endptr && *endptr == '\0')
+            seq = strtoul(argv[fn+2], &endptr, 10);
+            if (seq != ULONG_MAX && argv[fn+2] != endptr && *endptr == '\0')
                 query_type = MCDBCTL_GET;
-            else if (0 == strcmp(argv[4], "all"))
+            else if (0 == strcmp(argv[fn+2], "all"))
                 query_type = MCDBCTL_GETALL;
         }
-        else if (argc == 4)
+        else if (argc == fn+2)
             query_type = MCDBCTL_GET;
     }
+    else if (argc >= 3 && 0 == strcmp(argv[1], "dump")) {
+        /* options precede <fname.mcdb> */
+        for (query_type = MCDBCTL_DUMP; fn+1 < argc; fn += 2) {
+            if (0 == strcmp(argv[fn], "-j")) {
+                char *endptr;
+                const unsigned long n = strtoul(argv[fn+1], &endptr, 10);
+                if (n != 0 && n <= MCDB_SLOTS && argv[fn+1] != endptr
+                    && *endptr == '\0')
+                    nthreads = (uint32_t)n;
+                else
+                    query_type = MCDBCTL_BAD_QUERY_TYPE;
+            }
+            else if (0 == strcmp(argv[fn], "-F")) {
+                if (0 == strcmp(argv[fn+1], "cdb"))
+                    raw = false;
+                else if (0 == strcmp(argv[fn+1], "raw"))
+                    raw = true;
+                else
+                    query_type = MCDBCTL_BAD_QUERY_TYPE;
+            }
+            else if (0 == strcmp(argv[fn], "-P"))
+                pfx = argv[fn+1];  /*(key prefix; requires sorted key index)*/
+            else if (0 == strcmp(argv[fn], "-R")) {
+                /* <part>/<nparts>: part of data section (parallel scans) */
+                char *endptr;
+                const unsigned long i = strtoul(argv[fn+1], &endptr, 10);
+                const char * const s = endptr + 1;
+                const unsigned long n = (argv[fn+1] != endptr && *endptr=='/')
+                  ? strtoul(s, &endptr, 10)
+                  : 0;
+                if (i < n && n <= UINT32_MAX && s != endptr && *endptr == '\0'){
+                    part   = (uint32_t)i;
+                    nparts = (uint32_t)n;
+                }
+                else
+                    query_type = MCDBCTL_BAD_QUERY_TYPE;
+            }
+            else
+                query_type = MCDBCTL_BAD_QUERY_TYPE;
+        }
+        if (fn+1 != argc
+            || (pfx != NULL && (nthreads != 0 || raw || nparts != 1)))
+            query_type = MCDBCTL_BAD_QUERY_TYPE;
+    }
+    else if (argc >= 3 && 0 == strcmp(argv[1], "verify")) {
+        /* options precede <fname.mcdb> */
+        for (query_type = MCDBCTL_VERIFY; fn+1 < argc; fn += 2) {
+            char *endptr;
+            const unsigned long n = strtoul(argv[fn+1], &endptr, 10);
+            if (0 == strcmp(argv[fn], "-j") && n != 0 && n <= MCDB_SLOTS
+                && argv[fn+1] != endptr && *endptr == '\0')
+                nthreads = (uint32_t)n;
+            else
+                query_type = MCDBCTL_BAD_QUERY_TYPE;
+        }
+        if (fn+1 != argc)
+            query_type = MCDBCTL_BAD_QUERY_TYPE;
+    }
     else if (argc == 3) {
-        if (0 == strcmp(argv[1], "dump"))
-            query_type = MCDBCTL_DUMP;
-        else if (0 == strcmp(argv[1], "stats"))
+        if (0 == strcmp(argv[1], "stats"))
             query_type = MCDBCTL_STATS;
+        else if (0 == strcmp(argv[1], "analyze"))
+            query_type = MCDBCTL_ANALYZE;
     }
 
     if (query_type == MCDBCTL_BAD_QUERY_TYPE)
         return MCDB_ERROR_USAGE;
 
+    if (fn != 2 && 0 == strcmp(argv[2], "-L")) {
+        /* layered get (not batch) or dump (cdb format; not segmented) */
+        if (query_type == MCDBCTL_DUMP
+            ? (nthreads != 0 || raw || pfx != NULL || nparts != 1)
+            : 0 == strcmp(argv[fn+1], "-"))
+            return MCDB_ERROR_USAGE;
+        rv = mcdbctl_layer(argv, fn, query_type == MCDBCTL_DUMP, seq,
+                           query_type == MCDBCTL_GETALL);
+        if (rv == EXIT_FAILURE)
+            exit(100); /* not found: exit nonzero without errmsg */
+        return rv;
+    }
+
+    if (aio) {  /* batch get (first record of each key) by mcdb_aio */
+        struct mcdb_aio a;
+        if (query_type != MCDBCTL_GET || seq != 0)
+            return MCDB_ERROR_USAGE;
+        if (!mcdb_aio_create(&a, argv[fn], MCDBCTL_GETBATCH_KEYS,
+                             MCDBCTL_GETBATCH_AIO_CACHE, malloc, free))
+            return MCDB_ERROR_READ;
+        rv = mcdbctl_getbatch(NULL, &a, 0, false, raw);
+        mcdb_aio_destroy(&a);
+        if (rv == EXIT_FAILURE)
+            exit(100); /* not found: exit nonzero without errmsg */
+        return rv;
+    }
+
     /* open mcdb */
-    fd = nointr_open(argv[2], O_RDONLY, 0);  /* fname = argv[2] */
+    fd = nointr_open(argv[fn], O_RDONLY, 0);  /* fname = argv[fn] */
     if (fd == -1) return MCDB_ERROR_READ;
+    {   /* shard set manifest: get <key> from shard of key */
+        char magic[sizeof(MCDB_SHARD_MAGIC)];
+        if (pread(fd, magic, sizeof(magic), 0) == (ssize_t)sizeof(magic)
+            && 0 == memcmp(magic, MCDB_SHARD_MAGIC " ", sizeof(magic))) {
+            (void) nointr_close(fd);
+            if ((query_type != MCDBCTL_GET && query_type != MCDBCTL_GETALL)
+                || 0 == strcmp(argv[fn+1], "-"))
+                return MCDB_ERROR_USAGE;
+            rv = mcdbctl_shard_get(argv[fn], argv[fn+1], seq,
+                                   query_type == MCDBCTL_GETALL);
+            if (rv == EXIT_FAILURE)
+                exit(100); /* not found: exit nonzero without errmsg */
+            return rv;
+        }
+    }
     memset(&map, '\0', sizeof(map));  /*(init fn_free, fname)*/
     rv = mcdb_mmap_init(&map, fd);
     (void) nointr_close(fd);
@@ -359,22 +1688,36 @@ mcdbctl_query(const int argc, char ** restrict argv)
 
     /* run query */
     switch (query_type) {
-      case MCDBCTL_GET:
-        rv = mcdbctl_getseq(&m, argv[3], seq);  /* key = argv[3] */
+      case MCDBCTL_GET:     /* key = argv[fn+1] ("-": keys on stdin) */
+        rv = (0 != strcmp(argv[fn+1], "-"))
+          ? mcdbctl_getseq(&m, argv[fn+1], seq)
+          : mcdbctl_getbatch(&m, NULL, seq, false, raw);
         if (rv == EXIT_FAILURE)
             exit(100); /* not found: exit nonzero without errmsg */
         break;
-      case MCDBCTL_GETALL:
-        rv = mcdbctl_getall(&m, argv[3]);       /* key = argv[3] */
+      case MCDBCTL_GETALL:  /* key = argv[fn+1] ("-": keys on stdin) */
+        rv = (0 != strcmp(argv[fn+1], "-"))
+          ? mcdbctl_getall(&m, argv[fn+1])
+          : mcdbctl_getbatch(&m, NULL, 0, true, raw);
         if (rv == EXIT_FAILURE)
             exit(100); /* not found: exit nonzero without errmsg */
         break;
       case MCDBCTL_DUMP:
-        rv = mcdbctl_dump(&m);
+        rv = (nthreads == 0 && !raw)
+          ? mcdbctl_dump(&m, NULL, pfx, part, nparts)
+          : mcdbctl_dump_mt(&m, nthreads, raw, part, nparts);
         break;
       case MCDBCTL_STATS:
         rv = mcdbctl_stats(&m);
         break;
+      case MCDBCTL_ANALYZE:
+        rv = mcdbctl_analyze(&m);
+        break;
+      case MCDBCTL_VERIFY:
+        rv = mcdbctl_verify(&m, nthreads);
+        if (rv == EXIT_FAILURE)
+            exit(102); /* no checksums: exit nonzero after errmsg */
+        break;
       default: /* should not happen */
         rv = MCDB_ERROR_USAGE;
         break;
@@ -384,23 +1727,358 @@ mcdbctl_query(const int argc, char ** restrict argv)
     return rv;
 }
 
+/* key weight for slot-clustered data layout: decimal data of key in weights
+ * mcdb (0 if key not present) (saturates at UINT32_MAX) */
+static uint32_t
+mcdbctl_make_weight(void * const arg, const char * const key, const size_t klen)
+  __attribute_nonnull__;
+static uint32_t
+mcdbctl_make_weight(void * const arg, const char * const key, const size_t klen)
+{
+    struct mcdb * const restrict w = (struct mcdb *)arg;
+    uint64_t n = 0;
+    if (mcdb_find(w, key, klen)) {
+        const unsigned char * const restrict p = mcdb_dataptr(w);
+        for (uint32_t i = 0, len = mcdb_datalen(w); i < len; ++i) {
+            if (p[i] < '0' || p[i] > '9')
+                break;
+            if ((n = n * 10 + (p[i] - '0')) > UINT32_MAX)
+                return UINT32_MAX;
+        }
+    }
+    return (uint32_t)n;
+}
+
 static int
-mcdbctl_make(const int argc __attribute_unused__, char ** const restrict argv)
+mcdbctl_make(const int argc, char ** const restrict argv)
   __attribute_nonnull__  __attribute_warn_unused_result__;
 static int
-mcdbctl_make(const int argc __attribute_unused__, char ** const restrict argv)
+mcdbctl_make(const int argc, char ** const restrict argv)
 {
-    /* assert(argc == 4); */                   /* must be checked by caller */
     /* assert(0 == strcmp(argv[1], "make")); *//* must be checked by caller */
     enum { BUFSZ = 65536 }; /* 64 KB buffer size */
+    struct mcdb_make m;
     char * restrict buf = NULL;
-    char * const fname = argv[2];
-    char * const input = argv[3];
-    const int rv = (input[0] == '-' && input[1] == '\0')
-      ? ((buf = malloc(BUFSZ)) != NULL)
-        ? mcdb_makefmt_fdintofile(STDIN_FILENO, buf, BUFSZ, fname, malloc, free)
-        : MCDB_ERROR_MALLOC
-      : mcdb_makefmt_fileintofile(input, fname, malloc, free);
+    char *fname;
+    char *input;
+    uint32_t (*hash_fn)(uint32_t, const void * restrict, size_t) =
+      uint32_hash_djb;
+    uint32_t hash_init = UINT32_HASH_DJB_INIT;
+    uint32_t bloom_bits = 0;
+    uint32_t layout = MCDB_FMT_LAYOUT_CLASSIC;
+    uint32_t mphf = 0;
+    uint32_t sorted = 0;
+    uint32_t cksum = 0;
+    uint32_t index_native = 0;
+    uint32_t nthreads = 0;
+    const char *spilldir = NULL;
+    int spill_fd = -1;
+    uint32_t cluster = 0;
+    uint32_t io = MCDB_MAKE_IO_MMAP;
+    uint32_t dup = MCDB_MAKE_DUP_ALL;
+    uint32_t valshare = 0;
+    uint32_t compress = 0;
+    const char *zdictfile = NULL;
+    static char zdict[MCDB_ZDICT_MAX];
+    size_t zdictlen = 0;
+    const char *weights = NULL;
+    const char *tombstone = NULL;
+    struct mcdb_makefmt_input in = { MCDB_MAKEFMT_CDB, 1, '\t', NULL, 0, 0, 0 };
+    const char *keysel = NULL;
+    struct mcdb w;
+    int rv;
+    int i;
+
+    /* options precede <fname.mcdb> <datafile|-> */
+    for (i = 2; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i += 2) {
+        if (i+1 == argc)
+            return MCDB_ERROR_USAGE;
+        if (0 == strcmp(argv[i], "-H")) {
+            if (0 == strcmp(argv[i+1], "djb")) {
+                hash_fn   = uint32_hash_djb;
+                hash_init = UINT32_HASH_DJB_INIT;
+            }
+            else if (0 == strcmp(argv[i+1], "fast")) {
+                hash_fn   = uint32_hash_fast;
+                hash_init = UINT32_HASH_FAST_INIT;
+            }
+            else
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strcmp(argv[i], "-I")) {
+            if (0 == strcmp(argv[i+1], "classic"))
+                layout = MCDB_FMT_LAYOUT_CLASSIC;
+            else if (0 == strcmp(argv[i+1], "bucket"))
+                layout = MCDB_FMT_LAYOUT_BUCKET;
+            else if (0 == strcmp(argv[i+1], "packed"))
+                layout = MCDB_FMT_LAYOUT_PACKED;
+            else if (0 == strcmp(argv[i+1], "mphf"))
+                mphf = 1;  /*(minimal perfect hash; overflow in classic)*/
+            else
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strcmp(argv[i], "-X")) {
+            if (0 == strcmp(argv[i+1], "none"))
+                sorted = 0;
+            else if (0 == strcmp(argv[i+1], "sorted"))
+                sorted = 1;  /*(sorted key index; for dump -P <prefix>)*/
+            else
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strcmp(argv[i], "-Y")) {
+            if (0 == strcmp(argv[i+1], "none"))
+                cksum = 0;
+            else if (0 == strcmp(argv[i+1], "crc32c"))
+                cksum = 1;  /*(integrity checksums; for verify)*/
+            else
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strcmp(argv[i], "-E")) {
+            if (0 == strcmp(argv[i+1], "big"))
+                index_native = 0;
+            else if (0 == strcmp(argv[i+1], "native"))
+                index_native = 1;
+            else
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strcmp(argv[i], "-j")) {
+            char *endptr;
+            const unsigned long n = strtoul(argv[i+1], &endptr, 10);
+            if (n <= MCDB_SLOTS && argv[i+1] != endptr && *endptr == '\0')
+                nthreads = (uint32_t)n;
+            else
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strcmp(argv[i], "-S"))
+            spilldir = argv[i+1];
+        else if (0 == strcmp(argv[i], "-C")) {
+            if (0 == strcmp(argv[i+1], "none"))
+                cluster = 0;
+            else if (0 == strcmp(argv[i+1], "slot"))
+                cluster = 1;
+            else
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strcmp(argv[i], "-O")) {
+            if (0 == strcmp(argv[i+1], "mmap"))
+                io = MCDB_MAKE_IO_MMAP;
+            else if (0 == strcmp(argv[i+1], "write"))
+                io = MCDB_MAKE_IO_WRITE;
+            else if (0 == strcmp(argv[i+1], "direct"))
+                io = MCDB_MAKE_IO_DIRECT;
+            else
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strcmp(argv[i], "-U")) {
+            if (0 == strcmp(argv[i+1], "all"))
+                dup = MCDB_MAKE_DUP_ALL;
+            else if (0 == strcmp(argv[i+1], "first"))
+                dup = MCDB_MAKE_DUP_FIRST;
+            else if (0 == strcmp(argv[i+1], "last"))
+                dup = MCDB_MAKE_DUP_LAST;
+            else if (0 == strcmp(argv[i+1], "reject"))
+                dup = MCDB_MAKE_DUP_REJECT;
+            else
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strcmp(argv[i], "-V")) {
+            if (0 == strcmp(argv[i+1], "none"))
+                valshare = 0;
+            else if (0 == strcmp(argv[i+1], "share"))
+                valshare = 1;
+            else
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strcmp(argv[i], "-Z")) {
+            char *endptr;
+            const unsigned long n = strtoul(argv[i+1], &endptr, 10);
+            if (n <= 9 && argv[i+1] != endptr && *endptr == '\0')
+                compress = (uint32_t)n;  /*(deflate level; 0: none)*/
+            else
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strcmp(argv[i], "-D"))
+            zdictfile = argv[i+1];
+        else if (0 == strcmp(argv[i], "-W")) {
+            weights = argv[i+1];
+            cluster = 1;
+        }
+        else if (0 == strcmp(argv[i], "-F")) {
+            if (0 == strcmp(argv[i+1], "cdb"))
+                in.fmt = MCDB_MAKEFMT_CDB;
+            else if (0 == strcmp(argv[i+1], "tsv"))
+                in.fmt = MCDB_MAKEFMT_DELIM;
+            else if (0 == strcmp(argv[i+1], "ndjson"))
+                in.fmt = MCDB_MAKEFMT_NDJSON;
+            else if (0 == strcmp(argv[i+1], "fixed"))
+                in.fmt = MCDB_MAKEFMT_FIXED;
+            else
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strcmp(argv[i], "-K"))
+            keysel = argv[i+1];
+        else if (0 == strcmp(argv[i], "-T"))
+            tombstone = argv[i+1];  /*(records with data tombstone)*/
+        else if (0 == strcmp(argv[i], "-d")) {
+            if (argv[i+1][0] != '\0' && argv[i+1][1] == '\0'
+                && argv[i+1][0] != '\n')
+                in.delim = (unsigned char)argv[i+1][0];
+            else
+                return MCDB_ERROR_USAGE;
+        }
+        else if (0 == strcmp(argv[i], "-B")) {
+            char *endptr;
+            const unsigned long n = strtoul(argv[i+1], &endptr, 10);
+            if (n <= 64 && argv[i+1] != endptr && *endptr == '\0')
+                bloom_bits = (uint32_t)n;
+            else
+                return MCDB_ERROR_USAGE;
+        }
+        else
+            return MCDB_ERROR_USAGE;
+    }
+    if (argc - i != 2)
+        return MCDB_ERROR_USAGE;
+    fname = argv[i];
+    input = argv[i+1];
+
+    /* key selector: tsv field number (default 1), ndjson member name,
+     * fixed "offset,width" */
+    if (keysel != NULL || in.fmt == MCDB_MAKEFMT_NDJSON
+                       || in.fmt == MCDB_MAKEFMT_FIXED) {
+        char *endptr;
+        unsigned long n;
+        if (keysel == NULL)
+            return MCDB_ERROR_USAGE;
+        switch (in.fmt) {
+          case MCDB_MAKEFMT_DELIM:
+            n = strtoul(keysel, &endptr, 10);
+            if (n == 0 || n > UINT32_MAX || keysel == endptr || *endptr != '\0')
+                return MCDB_ERROR_USAGE;
+            in.keycol = (uint32_t)n;
+            break;
+          case MCDB_MAKEFMT_NDJSON:
+            in.keyname = keysel;
+            in.keynamelen = strlen(keysel);
+            break;
+          case MCDB_MAKEFMT_FIXED:
+            in.keyoff = strtoul(keysel, &endptr, 10);
+            if (keysel == endptr || *endptr != ',')
+                return MCDB_ERROR_USAGE;
+            keysel = endptr + 1;
+            in.keylen = strtoul(keysel, &endptr, 10);
+            if (in.keylen == 0 || keysel == endptr || *endptr != '\0')
+                return MCDB_ERROR_USAGE;
+            break;
+          default:
+            return MCDB_ERROR_USAGE;  /*(-K not valid with cdb format)*/
+        }
+    }
+
+    if (zdictfile != NULL) {
+        /* preset dictionary (deflate uses at most last MCDB_ZDICT_MAX bytes) */
+        struct stat st;
+        ssize_t rd;
+        off_t off;
+        const int fd = nointr_open(zdictfile, O_RDONLY, 0);
+        if (fd == -1)
+            return MCDB_ERROR_READ;
+        if (fstat(fd, &st) != 0) {
+            (void) nointr_close(fd);
+            return MCDB_ERROR_READ;
+        }
+        off = (st.st_size > (off_t)MCDB_ZDICT_MAX)
+          ? st.st_size - (off_t)MCDB_ZDICT_MAX
+          : 0;
+        while (zdictlen < (size_t)(st.st_size - off)
+               && (rd = pread(fd, zdict + zdictlen,
+                              (size_t)(st.st_size - off) - zdictlen,
+                              off + (off_t)zdictlen)) > 0)
+            zdictlen += (size_t)rd;
+        (void) nointr_close(fd);
+        if (zdictlen != (size_t)(st.st_size - off))
+            return MCDB_ERROR_READ;
+    }
+
+    w.map = NULL;
+    if (weights != NULL
+        && (w.map = mcdb_mmap_create(NULL,NULL,weights,malloc,free)) == NULL)
+        return MCDB_ERROR_READ;
+    if (spilldir != NULL) {
+        /* spill hash list to unlinked scratch file in spilldir */
+        const size_t len = strlen(spilldir);
+        char * const fntmp = malloc(len + sizeof("/.mcdbctl.XXXXXX"));
+        if (fntmp == NULL)
+            return MCDB_ERROR_MALLOC;
+        memcpy(fntmp, spilldir, len);
+        memcpy(fntmp+len, "/.mcdbctl.XXXXXX", sizeof("/.mcdbctl.XXXXXX"));
+        if ((spill_fd = mkstemp(fntmp)) != -1)
+            unlink(fntmp);
+        free(fntmp);
+        if (spill_fd == -1) {
+            if (w.map != NULL)
+                mcdb_mmap_destroy(w.map);
+            return MCDB_ERROR_WRITE;
+        }
+    }
+    if (input[0] == '-' && input[1] == '\0' && (buf = malloc(BUFSZ)) == NULL) {
+        if (spill_fd != -1)
+            nointr_close(spill_fd);
+        if (w.map != NULL)
+            mcdb_mmap_destroy(w.map);
+        return MCDB_ERROR_MALLOC;
+    }
+    if (mcdb_makefn_start(&m, fname, malloc, free) != 0) {
+        rv = (errno == ENOMEM ? MCDB_ERROR_MALLOC : MCDB_ERROR_WRITE);
+        if (spill_fd != -1)
+            nointr_close(spill_fd);
+        if (w.map != NULL)
+            mcdb_mmap_destroy(w.map);
+        free(buf);
+        return rv;
+    }
+    if (mcdb_make_start(&m, m.fd, malloc, free) == 0) {
+        m.hash_fn   = hash_fn;
+        m.hash_init = hash_init;
+        m.bloom_bits= bloom_bits;
+        m.layout    = layout;
+        m.mphf      = mphf;
+        m.sorted    = sorted;
+        m.cksum     = cksum;
+        m.index_native = index_native;
+        m.nthreads  = nthreads;
+        m.scratch   = fname;  /*(parallel parse of input file if nthreads)*/
+        m.spill_fd  = spill_fd;
+        m.cluster   = cluster;
+        m.io        = io;
+        m.dup       = dup;
+        m.valshare  = valshare;
+        m.compress  = compress;
+        m.zdict     = zdictlen ? zdict : NULL;
+        m.zdictlen  = zdictlen;
+        m.tombstone = tombstone;
+        m.tombstonelen = (tombstone != NULL) ? strlen(tombstone) : 0;
+        if (w.map != NULL) {
+            m.cluster_weight = mcdbctl_make_weight;
+            m.cluster_arg    = &w;
+        }
+        rv = (buf != NULL)
+          ? mcdb_makefmt_fdintomcdb_fmt(&m, STDIN_FILENO, buf, BUFSZ, &in)
+          : mcdb_makefmt_fileintomcdb_fmt(&m, input, &in);
+        if (rv == EXIT_SUCCESS)
+            rv = (mcdb_make_finish(&m) == 0 && mcdb_makefn_finish(&m,true) == 0)
+              ? EXIT_SUCCESS
+              : MCDB_ERROR_WRITE;
+        else
+            mcdb_make_destroy(&m);
+    }
+    else
+        rv = MCDB_ERROR_WRITE;
+    mcdb_makefn_cleanup(&m);
+    if (spill_fd != -1)
+        nointr_close(spill_fd);
+    if (w.map != NULL)
+        mcdb_mmap_destroy(w.map);
     free(buf);
     return rv;
 }
@@ -436,6 +2114,37 @@ mcdbctl_has_unique_keys(struct mcdb * const restrict m)
     return true;  /*keys are unique in mcdb*/
 }
 
+/* preserve hash, layout, index, filter, sorted index, checksums, shared data,
+ * compression settings of input mcdb (compression at deflate default level,
+ * with same dictionary) */
+static void
+mcdbctl_make_settings(struct mcdb_make * const restrict mk,
+                      struct mcdb * const restrict m)
+  __attribute_nonnull__;
+static void
+mcdbctl_make_settings(struct mcdb_make * const restrict mk,
+                      struct mcdb * const restrict m)
+{
+    mk->hash_fn   = m->map->hash_fn;     /* preserve hash of input mcdb */
+    mk->hash_init = m->map->hash_init;
+    mk->layout    = m->map->fmt & MCDB_FMT_LAYOUT_MASK;  /*preserve layout*/
+    mk->mphf      = (m->map->fmt & MCDB_FMT_MPHF) != 0;
+    mk->sorted    = m->map->sorted != NULL;   /* preserve sorted key index */
+    mk->cksum     = m->map->cksum  != NULL;   /* preserve checksums */
+    mk->index_native = (m->map->fmt & MCDB_FMT_INDEX_LE) != 0;
+    mk->valshare  = (m->map->fmt & MCDB_FMT_VALREF) != 0;
+    if (m->map->fmt & MCDB_FMT_VALZ) {
+        mk->compress = 6;
+        mk->zdict    = (const char *)m->map->zdict;
+        mk->zdictlen = m->map->zdict_sz;
+    }
+    if (m->map->bloom != NULL) {         /* preserve filter (approx bits) */
+        const uint32_t n = mcdb_numrecs(m);
+        const uint64_t bits = ((uint64_t)m->map->bloom_nblk << 9) / (n?n:1);
+        mk->bloom_bits = bits > 64 ? 64 : bits ? (uint32_t)bits : 1;
+    }
+}
+
 static int
 mcdbctl_make_unique_keys(struct mcdb * const restrict m, const bool first)
   __attribute_nonnull__  __attribute_warn_unused_result__;
@@ -455,24 +2164,30 @@ mcdbctl_make_unique_keys(struct mcdb * const restrict m, const bool first)
         return MCDB_ERROR_READFORMAT;
     if (mcdb_makefn_start(&mk, m->map->fname, malloc, free) == 0
         && mcdb_make_start(&mk, mk.fd, malloc, free) == 0) {
+        mcdbctl_make_settings(&mk, m);
         mcdb_iter_init(&iter, m);
         while (mcdb_iter(&iter) && rv == EXIT_SUCCESS) {
             /* Technically, passing m (which contains m->map->ptr) and an
              * alias into the map (k) as key is in violation of C99 restrict
              * pointers, but is inconsequential since it is all read-only */
-            data = (char *)mcdb_iter_dataptr(&iter);
-            dlen = mcdb_iter_datalen(&iter);
             k = (char *)mcdb_iter_keyptr(&iter);
             if (mcdb_find(m, k, mcdb_iter_keylen(&iter))) {
-                if (data == (char *)mcdb_dataptr(m)) { /*first value for key*/
+                if (k == (char *)mcdb_keyptr(m)) { /*(first value for key)*/
+                    struct mcdb r = *m;
                     if (!first) {  /*!first: find last (final) value for key*/
-                        while (mcdb_findnext(m, k, mcdb_iter_keylen(&iter))) {
-                            data = (char *)mcdb_dataptr(m);
-                            dlen = mcdb_datalen(m);
-                        }
+                        while (mcdb_findnext(m, k, mcdb_iter_keylen(&iter)))
+                            r = *m;
+                    }
+                    if (mcdb_tombstone(&r))  /*(keep tombstone)*/
+                        rv = mcdb_make_add_tombstone(&mk, k,
+                                                     mcdb_iter_keylen(&iter));
+                    else if ((data = mcdbctl_data(&r, &rv)) == NULL)
+                        break;
+                    else {
+                        dlen = mcdb_datalen(&r);
+                        rv = mcdb_make_add_h(&mk, k, mcdb_iter_keylen(&iter),
+                                             data, dlen);
                     }
-                    rv = mcdb_make_add_h(&mk, k, mcdb_iter_keylen(&iter),
-                                         data, dlen);
                     if (__builtin_expect( (rv != 0), 0)) {
                         rv = MCDB_ERROR_WRITE;
                         break;
@@ -532,19 +2247,354 @@ mcdbctl_uniq(const int argc, char ** const restrict argv)
     return rv;
 }
 
+static int
+mcdbctl_update(const int argc, char ** const restrict argv)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdbctl_update(const int argc, char ** const restrict argv)
+{
+    /* assert(argc == 5); */                   /* must be checked by caller */
+    /* assert(0 == strcmp(argv[1], "update")); *//*must be checked by caller*/
+    struct mcdb m;
+    struct mcdb d;
+    struct mcdb_make mk;
+    int rv = EXIT_SUCCESS;
+
+    m.map = mcdb_mmap_create(NULL,NULL,argv[3],malloc,free); /*fname=argv[3]*/
+    if (m.map == NULL)
+        return MCDB_ERROR_READ;
+    d.map = mcdb_mmap_create(NULL,NULL,argv[4],malloc,free); /*fname=argv[4]*/
+    if (d.map == NULL) {
+        mcdb_mmap_destroy(m.map);
+        return MCDB_ERROR_READ;
+    }
+
+    if (mcdb_validate_slots(&m)) {
+        if (mcdb_makefn_start(&mk, argv[2], malloc, free) == 0
+            && mcdb_make_start(&mk, mk.fd, malloc, free) == 0) {
+            mcdbctl_make_settings(&mk, &m);
+            if (mcdb_make_update(&mk, &m, &d) != 0)
+                rv = (errno == EINVAL) ? MCDB_ERROR_READFORMAT
+                                       : MCDB_ERROR_WRITE;
+            else if (mcdb_make_finish(&mk)!=0 || mcdb_makefn_finish(&mk,true)!=0)
+                rv = MCDB_ERROR_WRITE;
+        }
+        else
+            rv = MCDB_ERROR_WRITE;
+        mcdb_make_destroy(&mk);
+        mcdb_makefn_cleanup(&mk);
+    }
+    else
+        rv = MCDB_ERROR_READFORMAT;
+
+    mcdb_mmap_destroy(d.map);
+    mcdb_mmap_destroy(m.map);
+    return rv;
+}
+
+static int
+mcdbctl_shard(const int argc, char ** const restrict argv)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdbctl_shard(const int argc, char ** const restrict argv)
+{
+    /* assert(0 == strcmp(argv[1], "shard")); *//* must be checked by caller */
+    struct mcdb m;
+    struct mcdb_iter iter;
+    struct mcdb_shard_make sm;
+    unsigned long n;
+    uint32_t nthreads = 0;
+    char *endptr;
+    unsigned char *mark;
+    int rv = EXIT_SUCCESS;
+    int i = 2;
+    if (argc == 7 && 0 == strcmp(argv[2], "-j")) {
+        n = strtoul(argv[3], &endptr, 10);
+        if (n == 0 || n > 64 || argv[3] == endptr || *endptr != '\0')
+            return MCDB_ERROR_USAGE;
+        nthreads = (uint32_t)n;
+        i = 4;
+    }
+    if (argc - i != 3)
+        return MCDB_ERROR_USAGE;
+    n = strtoul(argv[i+1], &endptr, 10);
+    if (n == 0 || n > MCDB_SHARD_MAX || argv[i+1] == endptr || *endptr != '\0')
+        return MCDB_ERROR_USAGE;
+
+    m.map = mcdb_mmap_create(NULL,NULL,argv[i+2],malloc,free);/*mcdb=argv[i+2]*/
+    if (m.map == NULL)
+        return MCDB_ERROR_READ;
+    if (!mcdb_validate_slots(&m)) {
+        mcdb_mmap_destroy(m.map);
+        return MCDB_ERROR_READFORMAT;
+    }
+
+    if (mcdb_shard_make_start(&sm, argv[i], (uint32_t)n, malloc, free) == 0) {
+        /* shards preserve settings of input mcdb; records in order of input */
+        for (uint32_t j = 0; j < sm.nshards; ++j)
+            mcdbctl_make_settings(sm.m+j, &m);
+        sm.nthreads = nthreads;
+        mark = mcdb_madv_initmark(m.map->ptr, m.map->size, MCDB_HEADER_SZ);
+        posix_madvise(m.map->ptr, m.map->size,
+                      POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
+        mcdb_iter_init(&iter, &m);
+        while (mcdb_iter(&iter)) {
+            const uint32_t dlen = mcdb_iter_datalen(&iter);
+            char *data = (char *)mcdb_iter_dataptr(&iter);
+            if (mcdb_iter_datazlen(&iter)) {
+                if ((data = mcdbctl_zbuf_get(dlen)) == NULL) {
+                    rv = MCDB_ERROR_MALLOC;
+                    break;
+                }
+                if (mcdb_iter_readdata(&iter, data) == NULL) {
+                    rv = MCDB_ERROR_READFORMAT;
+                    break;
+                }
+            }
+            if (mcdb_shard_make_add(&sm, (char *)mcdb_iter_keyptr(&iter),
+                                    mcdb_iter_keylen(&iter),
+                                    data, dlen) != 0) {
+                rv = MCDB_ERROR_WRITE;
+                break;
+            }
+            mcdb_madv_dontneed(iter.ptr, mark); /*hint to release memory pages*/
+        }
+        if (rv == EXIT_SUCCESS && mcdb_shard_make_finish(&sm) != 0)
+            rv = MCDB_ERROR_WRITE;
+    }
+    else
+        rv = (errno == ENOMEM) ? MCDB_ERROR_MALLOC : MCDB_ERROR_WRITE;
+
+    mcdb_shard_make_destroy(&sm);
+    mcdb_mmap_destroy(m.map);
+    return rv;
+}
+
+/* record access profile from lookups of keys in key log (newline-terminated)
+ * (fd of key log) (see mcdb_warm.h) */
+static int
+mcdbctl_warm_keylog(struct mcdb_warm * const restrict w,
+                    struct mcdb * const restrict m, const int fd)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdbctl_warm_keylog(struct mcdb_warm * const restrict w,
+                    struct mcdb * const restrict m, const int fd)
+{
+    size_t bufsz = 65536;
+    size_t pos = 0, datasz = 0;
+    char *buf = malloc(bufsz);
+    bool eof = false;
+    int rv = EXIT_SUCCESS;
+    if (buf == NULL)
+        return MCDB_ERROR_MALLOC;
+    for (;;) {
+        const char * const p = buf + pos;
+        const size_t avail = datasz - pos;
+        const char * const e = memchr(p, '\n', avail);
+        if (e != NULL || (eof && avail != 0)) {
+            const size_t klen = (e != NULL) ? (size_t)(e - p) : avail;
+            mcdb_warm_find(w, m, p, klen);
+            pos += klen + (e != NULL);
+            continue;
+        }
+        if (eof)
+            break;
+        if (pos != 0) {
+            if ((datasz -= pos))
+                memmove(buf, buf + pos, datasz);
+            pos = 0;
+        }
+        if (datasz == bufsz) {  /*(key longer than buf)*/
+            char * const nbuf = realloc(buf, bufsz << 1);
+            if (nbuf == NULL) {
+                rv = MCDB_ERROR_MALLOC;
+                break;
+            }
+            buf = nbuf;
+            bufsz <<= 1;
+        }
+        {
+            ssize_t r;
+            retry_eintr_do_while((r = read(fd, buf+datasz, bufsz-datasz)),
+                                 (r == -1));
+            if (r > 0)
+                datasz += (size_t)r;
+            else if (r == 0)
+                eof = true;
+            else {
+                rv = MCDB_ERROR_READ;
+                break;
+            }
+        }
+    }
+    free(buf);
+    return rv;
+}
+
+/* warm [-j threads] [-W profile] <mcdb>: prefetch hot pages of profile
+ * warm -k <keylog|-> [-W profile] <mcdb>: record profile from key log
+ * warm -m [-W profile] <mcdb>: record profile of pages resident in page cache
+ * (profile is <mcdb>.warm unless -W) (see mcdb_warm.h) */
+static int
+mcdbctl_warm(const int argc, char ** const restrict argv)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static int
+mcdbctl_warm(const int argc, char ** const restrict argv)
+{
+    /* assert(0 == strcmp(argv[1], "warm")); */ /* must be checked by caller */
+    struct mcdb m;
+    struct mcdb_warm w;
+    const char *keylog = NULL;
+    const char *profile = NULL;
+    char *fname = NULL;
+    bool resident = false;
+    uint32_t nthreads = 1;
+    int rv = EXIT_SUCCESS;
+    int i;
+    for (i = 2; i+1 < argc; i += 2) {
+        if (0 == strcmp(argv[i], "-j")) {
+            char *endptr;
+            const unsigned long n = strtoul(argv[i+1], &endptr, 10);
+            if (n == 0 || n > 64 || argv[i+1] == endptr || *endptr != '\0')
+                return MCDB_ERROR_USAGE;
+            nthreads = (uint32_t)n;
+        }
+        else if (0 == strcmp(argv[i], "-k"))
+            keylog = argv[i+1];
+        else if (0 == strcmp(argv[i], "-W"))
+            profile = argv[i+1];
+        else if (0 == strcmp(argv[i], "-m")) {
+            resident = true;
+            --i;  /*(no option arg)*/
+        }
+        else
+            return MCDB_ERROR_USAGE;
+    }
+    if (i+1 != argc || (keylog != NULL && resident))
+        return MCDB_ERROR_USAGE;
+    if (profile == NULL) {
+        const size_t len = strlen(argv[i]);
+        if ((fname = malloc(len + sizeof(".warm"))) == NULL)
+            return MCDB_ERROR_MALLOC;
+        memcpy(fname, argv[i], len);
+        memcpy(fname+len, ".warm", sizeof(".warm"));
+        profile = fname;
+    }
+
+    m.map = mcdb_mmap_create(NULL,NULL,argv[i],malloc,free); /*fname=argv[i]*/
+    if (m.map == NULL) {
+        free(fname);
+        return MCDB_ERROR_READ;
+    }
+
+    if (keylog != NULL || resident) {  /* record profile */
+        if (!mcdb_warm_init(&w, m.map->size, malloc, free))
+            rv = MCDB_ERROR_MALLOC;
+        else if (resident)
+            rv = mcdb_warm_sample(&w, m.map) ? EXIT_SUCCESS : MCDB_ERROR_READ;
+        else if (0 == strcmp(keylog, "-"))
+            rv = mcdbctl_warm_keylog(&w, &m, STDIN_FILENO);
+        else {
+            const int fd = nointr_open(keylog, O_RDONLY, 0);
+            if (fd != -1) {
+                rv = mcdbctl_warm_keylog(&w, &m, fd);
+                (void) nointr_close(fd);
+            }
+            else
+                rv = MCDB_ERROR_READ;
+        }
+        if (rv == EXIT_SUCCESS && mcdb_warm_write(&w, profile) != 0)
+            rv = MCDB_ERROR_WRITE;
+    }
+    else if (!mcdb_warm_read(&w, profile, malloc, free))
+        rv = (errno == EINVAL) ? MCDB_ERROR_READFORMAT : MCDB_ERROR_READ;
+    else if (!mcdb_warm_prefault(&w, m.map, nthreads))
+        rv = MCDB_ERROR_READFORMAT;  /*(profile of different mcdb)*/
+
+    mcdb_warm_destroy(&w);
+    mcdb_mmap_destroy(m.map);
+    free(fname);
+    return rv;
+}
+
 static const char * const restrict mcdb_usage =
-   "mcdbctl make  <fname.mcdb> <datafile|->\n"
+   "mcdbctl make  [-H djb|fast] [-I classic|bucket|packed|mphf] [-B bits]\n"
+   "                       [-X none|sorted] [-Y none|crc32c]\n"
+   "                       [-E big|native] [-j threads] [-S spilldir]\n"
+   "                       [-C none|slot] [-W weights.mcdb] [-O mmap|write|direct]\n"
+   "                       [-U all|first|last|reject] [-V none|share]\n"
+   "                       [-Z level] [-D dictfile]\n"
+   "                       [-F cdb|tsv|ndjson|fixed] [-K key] [-d delim]\n"
+   "                       [-T tombstone] <fname.mcdb> <datafile|->\n"
    "         mcdbctl uniq  <fname.mcdb> [\"first\"|\"last\"]\n"
-   "         mcdbctl dump  <fname.mcdb>\n"
+   "         mcdbctl update <fname.mcdb> <old.mcdb> <delta.mcdb>\n"
+   "         mcdbctl shard [-j threads] <manifest> <nshards> <fname.mcdb>\n"
+   "         mcdbctl dump  [-j threads] [-F cdb|raw] [-R part/nparts]\n"
+   "                       <fname.mcdb>\n"
+   "         mcdbctl dump  -L <delta.mcdb> [-L ...] <fname.mcdb>\n"
+   "         mcdbctl dump  -P <prefix> <fname.mcdb>\n"
    "         mcdbctl stats <fname.mcdb>\n"
-   "         mcdbctl get   <fname.mcdb> <key> [seq|\"all\"]\n";
+   "         mcdbctl analyze <fname.mcdb>\n"
+   "         mcdbctl verify [-j threads] <fname.mcdb>\n"
+   "         mcdbctl warm  [-j threads] [-W profile] <fname.mcdb>\n"
+   "         mcdbctl warm  [-k <keylog|->|-m] [-W profile] <fname.mcdb>\n"
+   "         mcdbctl get   [-L <delta.mcdb> ...] <fname.mcdb> <key>\n"
+   "                       [seq|\"all\"]\n"
+   "         mcdbctl get   [-F line|raw] [-O mmap|aio] <fname.mcdb> -\n"
+   "                       [seq|\"all\"]\n"
+   "         mcdbctl serve [-p port] [-u port] [-b addr] [-j threads]\n"
+   "                       [-P memcache|raw] <fname.mcdb> [<fname.mcdb>...]\n";
 
 /*
- * mcdbctl get   <mcdb> <key> [seq|"all"]
- * mcdbctl dump  <mcdb>
+ * mcdbctl get   [-L <delta-mcdb> ...] <mcdb> <key> [seq|"all"]
+ * mcdbctl get   [-F line|raw] [-O mmap|aio] <mcdb> - [seq|"all"]
+ *                       (keys on stdin)
+ * mcdbctl serve [-p port] [-u port] [-b addr] [-j threads]
+ *                       [-P memcache|raw] <mcdb> [<mcdb> ...]
+ * mcdbctl dump  [-j threads] [-F cdb|raw] [-R part/nparts] <mcdb>
+ * mcdbctl dump  -L <delta-mcdb> [-L ...] <mcdb>
+ * mcdbctl dump  -P <prefix> <mcdb>
  * mcdbctl stats <mcdb>
- * mcdbctl make  <mcdb> <input-file>
+ * mcdbctl analyze <mcdb>
+ * mcdbctl verify [-j threads] <mcdb>
+ * mcdbctl warm  [-j threads] [-W profile] <mcdb>
+ * mcdbctl warm  [-k <keylog|->|-m] [-W profile] <mcdb>
+ * mcdbctl make  [-H djb|fast] [-I classic|bucket|packed|mphf] [-B bits]
+ *                       [-X none|sorted] [-Y none|crc32c]
+ *                       [-E big|native] [-j threads] [-S spilldir]
+ *                       [-C none|slot] [-W weights.mcdb] [-O mmap|write|direct]
+ *                       [-U all|first|last|reject] [-V none|share]
+ *                       [-Z level] [-D dictfile]
+ *                       [-F cdb|tsv|ndjson|fixed] [-K key] [-d delim]
+ *                       [-T tombstone] <mcdb> <input-file>
  * mcdbctl uniq  <mcdb> ["first"|"last"]
+ * mcdbctl update <mcdb> <old-mcdb> <delta-mcdb>
+ * mcdbctl shard [-j threads] <manifest> <nshards> <mcdb>
+ *
+ * mcdbctl get of <key> in shard set: pass manifest in place of <mcdb>
+ * mcdbctl get, dump -L: delta mcdb layered over <mcdb> (see mcdb_layer.h);
+ *   "make -T" data is written as tombstone, which deletes key of <mcdb>
+ * mcdbctl get -O aio: mcdb read (pread() or io_uring), not mmap'd; first
+ *   record of each key (seq 0) (see mcdb_aio.h)
+ * mcdbctl dump -R: records of part (0 .. nparts-1) of data section, e.g. to
+ *   scan mcdb in nparts parallel processes (see mcdb_iter_init_range())
+ * mcdbctl dump -P: records with key <prefix>, in key order, from sorted key
+ *   index written by "make -X sorted"
+ *
+ * mcdbctl analyze: layout report (sizes of data, sections, index; dead space;
+ *   per-slot load; probes and cache lines per hit and miss; key and value
+ *   size histograms) for choosing layout (make -I, -B) or splitting mcdb
+ *
+ * mcdbctl verify: check integrity checksums written by "make -Y crc32c"
+ *   (header, section directory, hash tables, and data blocks, in parallel
+ *   with -j); prints each mismatch and exits nonzero if any (see mcdb.h);
+ *   mcdb made without "-Y crc32c" has no checksums: prints errmsg
+ *   "no checksums (make -Y crc32c)" and exits 102
+ *
+ * mcdbctl warm: prefetch pages of access profile (default <mcdb>.warm);
+ *   with -k, record profile of pages touched by lookups of keys in key log;
+ *   with -m, record profile of pages resident in page cache
+ *   (see mcdb_warm.h)
  *
  * mcdbctl tools require mcdb filename be specified on the command line.
  * djb cdb tools take cdb on stdin, since able to mmap stdin backed by file.
@@ -553,10 +2603,18 @@ int
 main(int argc, char ** const restrict argv)
 {
     int rv;
-    if (argc == 4 && 0 == strcmp(argv[1], "make"))
+    if (argc >= 4 && 0 == strcmp(argv[1], "make"))
         rv = mcdbctl_make(argc, argv);
     else if ((argc == 3 || argc == 4) && 0 == strcmp(argv[1], "uniq"))
         rv = mcdbctl_uniq(argc, argv);
+    else if (argc == 5 && 0 == strcmp(argv[1], "update"))
+        rv = mcdbctl_update(argc, argv);
+    else if (argc >= 5 && 0 == strcmp(argv[1], "shard"))
+        rv = mcdbctl_shard(argc, argv);
+    else if (argc >= 3 && 0 == strcmp(argv[1], "serve"))
+        rv = mcdbctl_serve(argc, argv);
+    else if (argc >= 3 && 0 == strcmp(argv[1], "warm"))
+        rv = mcdbctl_warm(argc, argv);
     else
         rv = mcdbctl_query(argc, argv);
 
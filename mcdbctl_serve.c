@@ -0,0 +1,1194 @@
+/*
+ * mcdbctl_serve - mcdbctl serve: network lookup server for mcdb files
+ *
+ * Copyright (c) 2010, Glue Logic LLC. All rights reserved. code()gluelogic.com
+ *
+ *  This file is part of mcdb.
+ *
+ *  mcdb is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mcdb is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with mcdb.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * mcdb is originally based upon the Public Domain cdb-0.75 by Dan Bernstein
+ */
+
+/*
+ * mcdbctl serve [-p port] [-u port] [-b addr] [-j threads] [-P memcache|raw]
+ *               <fname.mcdb> [<fname.mcdb> ...]
+ *
+ * Read-only key lookups over TCP (-p port, default 11211; 0 disables) and
+ * UDP (-u port, default disabled), bound to addr (-b, default all).
+ * Each key is looked up in the mcdb files in the order given (first found).
+ *
+ * -P memcache (default): memcached text protocol
+ *   get|gets <key>*     -> VALUE <key> 0 <bytes>[ 0]\r\n<data>\r\n ... END\r\n
+ *   version             -> VERSION mcdb\r\n
+ *   quit                -> (connection closed)
+ *   storage commands    -> SERVER_ERROR read-only\r\n
+ *   UDP datagrams carry memcached 8-byte frame header (request id, sequence,
+ *   count); response is split into datagrams of up to 1400 bytes of payload
+ * -P raw (TCP only): request is 4-byte bigendian klen and key; response is
+ *   4-byte bigendian dlen and data, or 0xFFFFFFFF if not found
+ *   (same as mcdbctl get -F raw <fname.mcdb> -)
+ *
+ * Worker threads (-j) each run an event loop (epoll on Linux, else poll())
+ * over connections each worker accepts.  Requests pipelined on a connection
+ * are parsed together and keys looked up in batches (mcdb_find_batch()).
+ * Responses are sent with writev() straight from mmap; response remainder is
+ * copied only if socket buffer is full (and then no more requests are read
+ * from connection until response is sent).  Main thread (also worker 0)
+ * checks each mcdb once per second and hot-swaps updated mcdb (renamed into
+ * place) with mcdb_mmap_refresh_threadsafe(); workers move to the new mmap
+ * with mcdb_thread_refresh_self() and superseded mmap is then released.
+ * Server runs in foreground until killed.
+ */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#ifndef _XOPEN_SOURCE /* IOV_MAX */
+#define _XOPEN_SOURCE 600
+#endif
+
+#include "mcdbctl_serve.h"
+#include "mcdb.h"
+#include "mcdb_error.h"
+#include "nointr.h"
+#include "uint32.h"
+#include "plasma/plasma_stdtypes.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>  /* socket(), bind(), listen(), accept(), sendmsg() */
+#include <sys/uio.h>     /* writev() */
+#include <netinet/in.h>  /* IPPROTO_TCP, IPPROTO_IPV6, IPV6_V6ONLY */
+#include <netinet/tcp.h> /* TCP_NODELAY */
+#include <netdb.h>       /* getaddrinfo() */
+#include <errno.h>
+#include <fcntl.h>       /* fcntl() */
+#include <limits.h>      /* IOV_MAX */
+#include <signal.h>      /* sigaction() */
+#include <stdio.h>       /* fprintf() */
+#include <stdlib.h>      /* malloc(), calloc(), realloc(), free(), exit() */
+#include <string.h>      /* memcpy(), memchr(), memcmp(), strerror_r() */
+#include <time.h>        /* time() */
+#include <unistd.h>      /* read(), write() */
+
+#ifdef __linux__
+#define MCDBCTL_SERVE_EPOLL
+#include <sys/epoll.h>   /* epoll_create(), epoll_ctl(), epoll_wait() */
+#else
+#include <poll.h>        /* poll() */
+#endif
+
+#ifdef _THREAD_SAFE
+#include <pthread.h>     /* pthread_create() */
+#endif
+
+#define MCDBCTL_SERVE_BATCH   256         /* keys per batched lookup */
+#define MCDBCTL_SERVE_IBUFSZ  16384       /* initial input buffer of conn */
+#define MCDBCTL_SERVE_REQMAX  (1u << 20)  /* max request line or raw klen */
+#define MCDBCTL_SERVE_UDPSZ   65536       /* max UDP datagram received */
+#define MCDBCTL_SERVE_UDPMAX  1400        /* response payload per datagram */
+#define MCDBCTL_SERVE_NLISTEN 8           /* max listening sockets */
+#define MCDBCTL_SERVE_NIOV    (5*MCDBCTL_SERVE_BATCH + 16)
+#define MCDBCTL_SERVE_NEVENTS 64          /* events (and accept()s) per loop */
+
+enum {
+  MCDBCTL_SERVE_CONN,         /* TCP connection */
+  MCDBCTL_SERVE_UDP,          /* UDP request and response */
+  MCDBCTL_SERVE_LISTEN_TCP,
+  MCDBCTL_SERVE_LISTEN_UDP
+};
+
+/* key flags (memcache protocol) */
+#define MCDBCTL_SERVE_KEY_END 0x1u   /* "END\r\n" follows (last key of get) */
+#define MCDBCTL_SERVE_KEY_CAS 0x2u   /* gets: cas unique in VALUE line */
+
+struct mcdbctl_serve_conn {
+  int fd;
+  int kind;                   /* MCDBCTL_SERVE_* */
+  bool closing;               /* close once pending output is sent */
+  bool wantout;               /* waiting for socket to become writable */
+  size_t ipos;                /* input (requests) ibuf[ipos,ilen) */
+  size_t ilen;
+  size_t isz;
+  char *ibuf;
+  size_t opos;                /* pending output obuf[opos,olen) */
+  size_t olen;
+  size_t osz;
+  char *obuf;
+};
+
+struct mcdbctl_serve {
+  struct mcdb_mmap **maps;    /* shared maps (refreshed by main thread) */
+  uint32_t ndb;
+  uint32_t nlisten;
+  bool raw;
+  struct mcdbctl_serve_conn listen[MCDBCTL_SERVE_NLISTEN];
+};
+
+struct mcdbctl_serve_worker {
+  struct mcdbctl_serve *srv;
+  struct mcdb *ms;            /* ndb x BATCH lookups (each registered) */
+  struct mcdb *hit[MCDBCTL_SERVE_BATCH];
+  const char *keys[MCDBCTL_SERVE_BATCH];
+  size_t klens[MCDBCTL_SERVE_BATCH];
+  uint32_t kflags[MCDBCTL_SERVE_BATCH];
+  size_t nkeys;
+  char *sbuf;                 /* scratch: response headers, inflated data */
+  size_t ssz;
+  int iovcnt;
+  size_t iovlen;
+  struct iovec iov[MCDBCTL_SERVE_NIOV];
+  struct mcdbctl_serve_conn udp;
+  time_t tick;
+  bool main;                  /* refreshes shared maps */
+  bool paused;                /* accept() paused (e.g. EMFILE) */
+#ifdef MCDBCTL_SERVE_EPOLL
+  int epfd;
+#else
+  struct mcdbctl_serve_conn **conns;  /* listeners, then connections */
+  struct pollfd *pfd;
+  size_t nconns;
+  size_t connsz;
+#endif
+};
+
+__attribute_noinline__
+static void
+mcdbctl_serve_fatal(const char * const restrict what)
+  __attribute_nonnull__  __attribute_cold__;
+__attribute_noinline__
+static void
+mcdbctl_serve_fatal(const char * const restrict what)
+{
+    char errstr[128];
+    if (strerror_r(errno, errstr, sizeof(errstr)) != 0) errstr[0] = '\0';
+    fprintf(stderr, "mcdbctl: serve: %s: %s\n", what, errstr);
+    exit(111);
+}
+
+static struct mcdbctl_serve_conn *
+mcdbctl_serve_conn_new(const int fd)
+  __attribute_malloc__  __attribute_warn_unused_result__;
+static struct mcdbctl_serve_conn *
+mcdbctl_serve_conn_new(const int fd)
+{
+    struct mcdbctl_serve_conn * const c =
+      malloc(sizeof(struct mcdbctl_serve_conn));
+    if (c == NULL)
+        return NULL;
+    memset(c, '\0', sizeof(struct mcdbctl_serve_conn));
+    if ((c->ibuf = malloc(MCDBCTL_SERVE_IBUFSZ)) == NULL) {
+        free(c);
+        return NULL;
+    }
+    c->isz  = MCDBCTL_SERVE_IBUFSZ;
+    c->fd   = fd;
+    c->kind = MCDBCTL_SERVE_CONN;
+    return c;
+}
+
+static void
+mcdbctl_serve_conn_free(struct mcdbctl_serve_conn * const restrict c)
+  __attribute_nonnull__;
+static void
+mcdbctl_serve_conn_free(struct mcdbctl_serve_conn * const restrict c)
+{
+    free(c->ibuf);
+    free(c->obuf);
+    free(c);
+}
+
+/* (TCP conn has output pending; stop reading requests until sent) */
+#define mcdbctl_serve_pending(c) \
+  ((c)->kind == MCDBCTL_SERVE_CONN && (c)->opos != (c)->olen)
+
+/* copy unsent iovecs into pending output of conn */
+static bool
+mcdbctl_serve_conn_copy(struct mcdbctl_serve_conn * const restrict c,
+                        const struct iovec * restrict iov, int iovcnt,
+                        const size_t len)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_serve_conn_copy(struct mcdbctl_serve_conn * const restrict c,
+                        const struct iovec * restrict iov, int iovcnt,
+                        const size_t len)
+{
+    char *p;
+    if (c->opos != 0) {
+        if ((c->olen -= c->opos))
+            memmove(c->obuf, c->obuf + c->opos, c->olen);
+        c->opos = 0;
+    }
+    if (c->osz - c->olen < len) {
+        size_t sz = c->osz ? c->osz : 4096;
+        while (sz - c->olen < len) {
+            if ((sz << 1) < sz)
+                return (errno = ENOMEM, false);
+            sz <<= 1;
+        }
+        if ((p = realloc(c->obuf, sz)) == NULL)
+            return false;
+        c->obuf = p;
+        c->osz  = sz;
+    }
+    for (p = c->obuf + c->olen; iovcnt--; ++iov) {
+        memcpy(p, iov->iov_base, iov->iov_len);
+        p += iov->iov_len;
+    }
+    c->olen += len;
+    return true;
+}
+
+/* send response iovecs (writev() straight from mmap) and copy remainder into
+ * pending output of conn if socket buffer full (UDP: copy for datagrams)
+ * (called before iovecs are invalidated by lookups or reuse of scratch) */
+static bool
+mcdbctl_serve_send(struct mcdbctl_serve_worker * const restrict w,
+                   struct mcdbctl_serve_conn * const restrict c)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_serve_send(struct mcdbctl_serve_worker * const restrict w,
+                   struct mcdbctl_serve_conn * const restrict c)
+{
+    struct iovec *iov = w->iov;
+    int iovcnt = w->iovcnt;
+    size_t len = w->iovlen;
+    ssize_t n;
+    w->iovcnt = 0;
+    w->iovlen = 0;
+    if (c->kind == MCDBCTL_SERVE_CONN && c->opos == c->olen) {
+        while (iovcnt) {
+            n = writev(c->fd, iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX);
+            if (n == -1) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                return false;
+            }
+            len -= (size_t)n;
+            while (n != 0) { /*(iovecs are not zero-length)*/
+                if ((size_t)n >= iov->iov_len) {
+                    n -= (ssize_t)iov->iov_len;
+                    --iovcnt;
+                    ++iov;
+                }
+                else {
+                    iov->iov_len -= (size_t)n;
+                    iov->iov_base = ((char *)(iov->iov_base)) + n;
+                    break; /* n = 0; */
+                }
+            }
+        }
+    }
+    return iovcnt == 0 || mcdbctl_serve_conn_copy(c, iov, iovcnt, len);
+}
+
+static bool
+mcdbctl_serve_iov(struct mcdbctl_serve_worker * const restrict w,
+                  struct mcdbctl_serve_conn * const restrict c,
+                  const void * const restrict base, const size_t len)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_serve_iov(struct mcdbctl_serve_worker * const restrict w,
+                  struct mcdbctl_serve_conn * const restrict c,
+                  const void * const restrict base, const size_t len)
+{
+    if (len == 0)
+        return true;
+    if (w->iovcnt == MCDBCTL_SERVE_NIOV && !mcdbctl_serve_send(w, c))
+        return false;
+    w->iov[w->iovcnt].iov_base = (void *)(uintptr_t)base;
+    w->iov[w->iovcnt].iov_len  = len;
+    ++w->iovcnt;
+    w->iovlen += len;
+    return true;
+}
+
+static size_t
+mcdbctl_serve_u32dec(char * const restrict s, uint32_t u)
+  __attribute_nonnull__;
+static size_t
+mcdbctl_serve_u32dec(char * const restrict s, uint32_t u)
+{
+    char buf[10];
+    size_t n = 0, i;
+    do { buf[n++] = (char)('0' + u % 10); } while ((u /= 10));
+    for (i = 0; i < n; ++i)
+        s[i] = buf[n-1-i];
+    return n;
+}
+
+/* look up keys in batch (in each mcdb, in order, until found)
+ * and append responses to iovecs */
+static bool
+mcdbctl_serve_batch(struct mcdbctl_serve_worker * const restrict w,
+                    struct mcdbctl_serve_conn * const restrict c)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_serve_batch(struct mcdbctl_serve_worker * const restrict w,
+                    struct mcdbctl_serve_conn * const restrict c)
+{
+    const char *mkeys[MCDBCTL_SERVE_BATCH];
+    size_t mklens[MCDBCTL_SERVE_BATCH];
+    size_t idx[MCDBCTL_SERVE_BATCH];
+    const struct mcdbctl_serve * const srv = w->srv;
+    const size_t n = w->nkeys;
+    size_t i, k, sz;
+    uint32_t d;
+    char *s;
+
+    if (n == 0)
+        return true;
+    w->nkeys = 0;
+
+    /* send prior responses before lookups (which might move registrations to
+     * newer mmap and release superseded mmap) and before scratch is reused */
+    if (w->iovcnt && !mcdbctl_serve_send(w, c))
+        return false;
+
+    (void) mcdb_find_batch(w->ms, n, w->keys, w->klens);
+    for (i = 0; i < n; ++i)
+        w->hit[i] = (w->ms[i].loop != 0) ? &w->ms[i] : NULL;
+    for (d = 1; d < srv->ndb; ++d) {
+        struct mcdb * const md = w->ms + (size_t)d * MCDBCTL_SERVE_BATCH;
+        for (i = 0, k = 0; i < n; ++i) {
+            if (w->hit[i] == NULL) {
+                idx[k]    = i;
+                mkeys[k]  = w->keys[i];
+                mklens[k] = w->klens[i];
+                ++k;
+            }
+        }
+        if (k == 0)
+            break;
+        (void) mcdb_find_batch(md, k, mkeys, mklens);
+        for (i = 0; i < k; ++i) {
+            if (md[i].loop != 0)
+                w->hit[idx[i]] = &md[i];
+        }
+    }
+
+    /* scratch for response headers ("<sp>0<sp><bytes><sp>0\r\n" or raw dlen)
+     * and for inflated data (MCDB_FMT_VALZ) */
+    for (i = 0, sz = 0; i < n; ++i) {
+        sz += 24;
+        if (w->hit[i] != NULL && mcdb_datazlen(w->hit[i]))
+            sz += mcdb_datalen(w->hit[i]);
+    }
+    if (w->ssz < sz) {
+        free(w->sbuf);
+        w->ssz = 0;
+        if ((w->sbuf = malloc(sz)) == NULL)
+            return false;
+        w->ssz = sz;
+    }
+
+    for (i = 0, s = w->sbuf; i < n; ++i) {
+        struct mcdb * const m = w->hit[i];
+        const void *data = NULL;
+        uint32_t dlen = 0;
+        if (m != NULL) {
+            dlen = mcdb_datalen(m);
+            if (!mcdb_datazlen(m))
+                data = mcdb_dataptr(m);
+            else if ((data = mcdb_readdata(m, s)) != NULL)
+                s += dlen;   /*(else respond as if not found)*/
+        }
+        if (srv->raw) {
+            if (data != NULL)
+                uint32_strpack_bigendian_macro(s, dlen);
+            else
+                memset(s, 0xFF, 4);
+            if (!mcdbctl_serve_iov(w, c, s, 4)
+                || (data != NULL && !mcdbctl_serve_iov(w, c, data, dlen)))
+                return false;
+            s += 4;
+            continue;
+        }
+        if (data != NULL) {
+            char * const h = s;
+            *s++ = ' ';
+            *s++ = '0';
+            *s++ = ' ';
+            s += mcdbctl_serve_u32dec(s, dlen);
+            if (w->kflags[i] & MCDBCTL_SERVE_KEY_CAS) {
+                *s++ = ' ';
+                *s++ = '0';
+            }
+            *s++ = '\r';
+            *s++ = '\n';
+            if (!mcdbctl_serve_iov(w, c, "VALUE ", 6)
+                || !mcdbctl_serve_iov(w, c, w->keys[i], w->klens[i])
+                || !mcdbctl_serve_iov(w, c, h, (size_t)(s - h))
+                || !mcdbctl_serve_iov(w, c, data, dlen)
+                || !mcdbctl_serve_iov(w, c, "\r\n", 2))
+                return false;
+        }
+        if ((w->kflags[i] & MCDBCTL_SERVE_KEY_END)
+            && !mcdbctl_serve_iov(w, c, "END\r\n", 5))
+            return false;
+    }
+    return true;
+}
+
+/* add key to batch (key points into conn input, which is not moved until
+ * responses are sent) */
+static bool
+mcdbctl_serve_key(struct mcdbctl_serve_worker * const restrict w,
+                  struct mcdbctl_serve_conn * const restrict c,
+                  const char * const restrict key, const size_t klen,
+                  const uint32_t flags)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_serve_key(struct mcdbctl_serve_worker * const restrict w,
+                  struct mcdbctl_serve_conn * const restrict c,
+                  const char * const restrict key, const size_t klen,
+                  const uint32_t flags)
+{
+    w->keys[w->nkeys]   = key;
+    w->klens[w->nkeys]  = klen;
+    w->kflags[w->nkeys] = flags;
+    return ++w->nkeys < MCDBCTL_SERVE_BATCH || mcdbctl_serve_batch(w, c);
+}
+
+/* reply with string (after responses to prior requests) */
+static bool
+mcdbctl_serve_reply(struct mcdbctl_serve_worker * const restrict w,
+                    struct mcdbctl_serve_conn * const restrict c,
+                    const char * const restrict str, const size_t len)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_serve_reply(struct mcdbctl_serve_worker * const restrict w,
+                    struct mcdbctl_serve_conn * const restrict c,
+                    const char * const restrict str, const size_t len)
+{
+    return mcdbctl_serve_batch(w, c) && mcdbctl_serve_iov(w, c, str, len);
+}
+
+#define mcdbctl_serve_reply_str(w, c, str) \
+  mcdbctl_serve_reply((w), (c), (str), sizeof(str)-1)
+
+#define mcdbctl_serve_cmd(t, tlen, str) \
+  ((tlen) == sizeof(str)-1 && 0 == memcmp((t), (str), sizeof(str)-1))
+
+/* parse memcache text protocol requests (complete lines) in conn input */
+static bool
+mcdbctl_serve_memcache(struct mcdbctl_serve_worker * const restrict w,
+                       struct mcdbctl_serve_conn * const restrict c)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_serve_memcache(struct mcdbctl_serve_worker * const restrict w,
+                       struct mcdbctl_serve_conn * const restrict c)
+{
+    while (!c->closing && !mcdbctl_serve_pending(c)) {
+        const char * const b = c->ibuf + c->ipos;
+        const char *e = memchr(b, '\n', c->ilen - c->ipos);
+        const char *p, *t;
+        size_t tlen;
+        if (e == NULL) {
+            if (c->ilen - c->ipos > MCDBCTL_SERVE_REQMAX
+                && c->kind == MCDBCTL_SERVE_CONN) {
+                c->closing = true;
+                return
+                  mcdbctl_serve_reply_str(w,c,"CLIENT_ERROR line too long\r\n");
+            }
+            break;
+        }
+        c->ipos += (size_t)(e - b) + 1;
+        if (e != b && e[-1] == '\r')
+            --e;
+
+        for (p = b; p != e && *p == ' '; ++p) ;
+        for (t = p; p != e && *p != ' '; ++p) ;
+        tlen = (size_t)(p - t);
+
+        if (mcdbctl_serve_cmd(t, tlen, "get")
+            || mcdbctl_serve_cmd(t, tlen, "gets")) {
+            const uint32_t cas = (tlen == 4) ? MCDBCTL_SERVE_KEY_CAS : 0;
+            while (p != e && *p == ' ') ++p;
+            if (p == e && !mcdbctl_serve_reply_str(w, c, "ERROR\r\n"))
+                return false;
+            while (p != e) {
+                const char * const k = p;
+                size_t klen;
+                uint32_t flags;
+                while (p != e && *p != ' ') ++p;
+                klen = (size_t)(p - k);
+                while (p != e && *p == ' ') ++p;
+                flags = (p == e) ? cas | MCDBCTL_SERVE_KEY_END : cas;
+                if (!mcdbctl_serve_key(w, c, k, klen, flags))
+                    return false;
+            }
+        }
+        else if (mcdbctl_serve_cmd(t, tlen, "version")) {
+            if (!mcdbctl_serve_reply_str(w, c, "VERSION mcdb\r\n"))
+                return false;
+        }
+        else if (mcdbctl_serve_cmd(t, tlen, "quit"))
+            c->closing = true;
+        else if (mcdbctl_serve_cmd(t, tlen, "set")
+                 || mcdbctl_serve_cmd(t, tlen, "add")
+                 || mcdbctl_serve_cmd(t, tlen, "replace")
+                 || mcdbctl_serve_cmd(t, tlen, "append")
+                 || mcdbctl_serve_cmd(t, tlen, "prepend")
+                 || mcdbctl_serve_cmd(t, tlen, "cas")) {
+            c->closing = true; /*(data block follows; not parsed)*/
+            return mcdbctl_serve_reply_str(w, c, "SERVER_ERROR read-only\r\n");
+        }
+        else if (mcdbctl_serve_cmd(t, tlen, "delete")
+                 || mcdbctl_serve_cmd(t, tlen, "incr")
+                 || mcdbctl_serve_cmd(t, tlen, "decr")
+                 || mcdbctl_serve_cmd(t, tlen, "touch")
+                 || mcdbctl_serve_cmd(t, tlen, "flush_all")) {
+            if (!mcdbctl_serve_reply_str(w, c, "SERVER_ERROR read-only\r\n"))
+                return false;
+        }
+        else if (!mcdbctl_serve_reply_str(w, c, "ERROR\r\n"))
+            return false;
+    }
+    return true;
+}
+
+/* parse raw protocol requests (4-byte bigendian klen, key) in conn input */
+static bool
+mcdbctl_serve_rawreq(struct mcdbctl_serve_worker * const restrict w,
+                     struct mcdbctl_serve_conn * const restrict c)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_serve_rawreq(struct mcdbctl_serve_worker * const restrict w,
+                     struct mcdbctl_serve_conn * const restrict c)
+{
+    while (c->ilen - c->ipos >= 4 && !mcdbctl_serve_pending(c)) {
+        const char * const b = c->ibuf + c->ipos;
+        const uint32_t klen = uint32_strunpack_bigendian_macro(b);
+        if (klen > MCDBCTL_SERVE_REQMAX) {
+            c->closing = true;  /*(invalid request; close after responses)*/
+            break;
+        }
+        if (c->ilen - c->ipos - 4 < klen)
+            break;
+        c->ipos += 4 + (size_t)klen;
+        if (!mcdbctl_serve_key(w, c, b+4, klen, 0))
+            return false;
+    }
+    return true;
+}
+
+/* process requests in conn input and send responses */
+static bool
+mcdbctl_serve_process(struct mcdbctl_serve_worker * const restrict w,
+                      struct mcdbctl_serve_conn * const restrict c)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_serve_process(struct mcdbctl_serve_worker * const restrict w,
+                      struct mcdbctl_serve_conn * const restrict c)
+{
+    const bool rc =
+         (w->srv->raw ? mcdbctl_serve_rawreq(w,c) : mcdbctl_serve_memcache(w,c))
+      && mcdbctl_serve_batch(w, c)
+      && (w->iovcnt == 0 || mcdbctl_serve_send(w, c));
+    w->nkeys  = 0;  /*(if error)*/
+    w->iovcnt = 0;
+    w->iovlen = 0;
+    return rc;
+}
+
+/* read requests from conn (returns false if conn is to be closed) */
+static bool
+mcdbctl_serve_read(struct mcdbctl_serve_worker * const restrict w,
+                   struct mcdbctl_serve_conn * const restrict c)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_serve_read(struct mcdbctl_serve_worker * const restrict w,
+                   struct mcdbctl_serve_conn * const restrict c)
+{
+    ssize_t r;
+    if (c->ipos != 0) {  /*(responses to consumed requests have been sent)*/
+        if ((c->ilen -= c->ipos))
+            memmove(c->ibuf, c->ibuf + c->ipos, c->ilen);
+        c->ipos = 0;
+    }
+    if (c->ilen == c->isz) {
+        char *p;
+        if (c->isz > MCDBCTL_SERVE_REQMAX
+            || (p = realloc(c->ibuf, c->isz << 1)) == NULL)
+            return false;
+        c->ibuf = p;
+        c->isz <<= 1;
+    }
+    retry_eintr_do_while((r = read(c->fd, c->ibuf+c->ilen, c->isz-c->ilen)),
+                         (r == -1));
+    if (r <= 0)
+        return (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK));
+    c->ilen += (size_t)r;
+    return mcdbctl_serve_process(w, c);
+}
+
+/* send pending output of conn, then process buffered requests, if any
+ * (returns false if conn is to be closed) */
+static bool
+mcdbctl_serve_write(struct mcdbctl_serve_worker * const restrict w,
+                    struct mcdbctl_serve_conn * const restrict c)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_serve_write(struct mcdbctl_serve_worker * const restrict w,
+                    struct mcdbctl_serve_conn * const restrict c)
+{
+    ssize_t n;
+    while (c->opos != c->olen) {
+        n = write(c->fd, c->obuf + c->opos, c->olen - c->opos);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+        c->opos += (size_t)n;
+    }
+    c->opos = c->olen = 0;
+    if (c->osz > MCDBCTL_SERVE_REQMAX) {  /*(release large buffer)*/
+        free(c->obuf);
+        c->obuf = NULL;
+        c->osz  = 0;
+    }
+    return c->closing || c->ipos == c->ilen || mcdbctl_serve_process(w, c);
+}
+
+/* receive UDP requests (memcache protocol) and send responses */
+static void
+mcdbctl_serve_udp(struct mcdbctl_serve_worker * const restrict w,
+                  const int fd)
+  __attribute_nonnull__;
+static void
+mcdbctl_serve_udp(struct mcdbctl_serve_worker * const restrict w,
+                  const int fd)
+{
+    struct mcdbctl_serve_conn * const u = &w->udp;
+    struct sockaddr_storage sa;
+    socklen_t salen;
+    struct msghdr msg;
+    struct iovec iov[2];
+    unsigned char hdr[8];
+    size_t off, ndgram;
+    ssize_t r;
+    int i;
+    for (i = 0; i < MCDBCTL_SERVE_NEVENTS; ++i) {
+        salen = sizeof(sa);
+        r = recvfrom(fd, u->ibuf, u->isz, 0, (struct sockaddr *)&sa, &salen);
+        if (r == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (r < 8)   /*(memcached UDP frame header)*/
+            continue;
+        u->ipos = 8;
+        u->ilen = (size_t)r;
+        u->opos = u->olen = 0;
+        u->closing = false;
+        if (!mcdbctl_serve_process(w, u) || u->olen == 0)
+            continue;
+
+        /* response datagrams: request id, sequence num, num datagrams, 0 */
+        ndgram = (u->olen + MCDBCTL_SERVE_UDPMAX - 1) / MCDBCTL_SERVE_UDPMAX;
+        if (ndgram > 0xFFFF)
+            continue;
+        memcpy(hdr, u->ibuf, 2);
+        hdr[4] = (unsigned char)(ndgram >> 8);
+        hdr[5] = (unsigned char)ndgram;
+        hdr[6] = hdr[7] = 0;
+        memset(&msg, '\0', sizeof(msg));
+        msg.msg_name    = (void *)&sa;
+        msg.msg_namelen = salen;
+        msg.msg_iov     = iov;
+        msg.msg_iovlen  = 2;
+        for (off = 0; off < u->olen; off += MCDBCTL_SERVE_UDPMAX) {
+            const size_t seq = off / MCDBCTL_SERVE_UDPMAX;
+            hdr[2] = (unsigned char)(seq >> 8);
+            hdr[3] = (unsigned char)seq;
+            iov[0].iov_base = hdr;
+            iov[0].iov_len  = 8;
+            iov[1].iov_base = u->obuf + off;
+            iov[1].iov_len  = (u->olen - off < MCDBCTL_SERVE_UDPMAX)
+              ? u->olen - off
+              : MCDBCTL_SERVE_UDPMAX;
+            retry_eintr_do_while((r = sendmsg(fd, &msg, 0)), (r == -1));
+            if (r == -1)
+                break;  /*(drop response)*/
+        }
+    }
+}
+
+
+/* event set of worker (epoll on Linux, else poll()) */
+
+#ifdef MCDBCTL_SERVE_EPOLL
+
+static bool
+mcdbctl_serve_ev_add(struct mcdbctl_serve_worker * const restrict w,
+                     struct mcdbctl_serve_conn * const restrict c)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_serve_ev_add(struct mcdbctl_serve_worker * const restrict w,
+                     struct mcdbctl_serve_conn * const restrict c)
+{
+    struct epoll_event ev;
+    memset(&ev, '\0', sizeof(ev));
+    ev.events = EPOLLIN;
+  #ifdef EPOLLEXCLUSIVE  /*(listening sockets are shared by workers)*/
+    if (c->kind != MCDBCTL_SERVE_CONN)
+        ev.events |= EPOLLEXCLUSIVE;
+  #endif
+    ev.data.ptr = c;
+    return 0 == epoll_ctl(w->epfd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+static void
+mcdbctl_serve_ev_want(struct mcdbctl_serve_worker * const restrict w,
+                      struct mcdbctl_serve_conn * const restrict c,
+                      const bool out)
+  __attribute_nonnull__;
+static void
+mcdbctl_serve_ev_want(struct mcdbctl_serve_worker * const restrict w,
+                      struct mcdbctl_serve_conn * const restrict c,
+                      const bool out)
+{
+    struct epoll_event ev;
+    if (c->wantout == out)
+        return;
+    c->wantout = out;
+    memset(&ev, '\0', sizeof(ev));
+    ev.events = out ? EPOLLOUT : EPOLLIN;
+    ev.data.ptr = c;
+    (void)epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+static void
+mcdbctl_serve_ev_close(struct mcdbctl_serve_worker * const restrict w,
+                       struct mcdbctl_serve_conn * const restrict c)
+  __attribute_nonnull__;
+static void
+mcdbctl_serve_ev_close(struct mcdbctl_serve_worker * const restrict w,
+                       struct mcdbctl_serve_conn * const restrict c)
+{
+    (void)w;
+    (void)nointr_close(c->fd);  /*(removes fd from epoll set)*/
+    mcdbctl_serve_conn_free(c);
+}
+
+static void
+mcdbctl_serve_ev_pause(struct mcdbctl_serve_worker * const restrict w,
+                       const bool pause)
+  __attribute_nonnull__;
+static void
+mcdbctl_serve_ev_pause(struct mcdbctl_serve_worker * const restrict w,
+                       const bool pause)
+{
+    uint32_t i;
+    struct epoll_event ev;
+    w->paused = pause;
+    memset(&ev, '\0', sizeof(ev));
+    for (i = 0; i < w->srv->nlisten; ++i) {
+        struct mcdbctl_serve_conn * const l = &w->srv->listen[i];
+        if (l->kind != MCDBCTL_SERVE_LISTEN_TCP)
+            continue;
+        if (pause)
+            (void)epoll_ctl(w->epfd, EPOLL_CTL_DEL, l->fd, &ev);
+        else if (!mcdbctl_serve_ev_add(w, l))
+            w->paused = true;  /*(retry after a second)*/
+    }
+}
+
+#else  /* !MCDBCTL_SERVE_EPOLL */
+
+static bool
+mcdbctl_serve_ev_add(struct mcdbctl_serve_worker * const restrict w,
+                     struct mcdbctl_serve_conn * const restrict c)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+static bool
+mcdbctl_serve_ev_add(struct mcdbctl_serve_worker * const restrict w,
+                     struct mcdbctl_serve_conn * const restrict c)
+{
+    if (w->nconns == w->connsz) {
+        const size_t sz = w->connsz ? w->connsz << 1 : 64;
+        struct mcdbctl_serve_conn ** const conns =
+          realloc(w->conns, sz * sizeof(struct mcdbctl_serve_conn *));
+        struct pollfd *pfd;
+        if (conns == NULL)
+            return false;
+        w->conns = conns;
+        if ((pfd = realloc(w->pfd, sz * sizeof(struct pollfd))) == NULL)
+            return false;
+        w->pfd = pfd;
+        w->connsz = sz;
+    }
+    w->conns[w->nconns++] = c;
+    return true;
+}
+
+#define mcdbctl_serve_ev_want(w, c, out)  ((c)->wantout = (out))
+
+static void
+mcdbctl_serve_ev_close(struct mcdbctl_serve_worker * const restrict w,
+                       struct mcdbctl_serve_conn * const restrict c)
+  __attribute_nonnull__;
+static void
+mcdbctl_serve_ev_close(struct mcdbctl_serve_worker * const restrict w,
+                       struct mcdbctl_serve_conn * const restrict c)
+{
+    (void)w;
+    (void)nointr_close(c->fd);
+    c->fd = -1;  /*(removed from w->conns and free'd after poll() loop)*/
+}
+
+#define mcdbctl_serve_ev_pause(w, pause)  ((w)->paused = (pause))
+
+#endif /* !MCDBCTL_SERVE_EPOLL */
+
+
+/* accept connections (nonblocking listening socket shared by workers) */
+static void
+mcdbctl_serve_accept(struct mcdbctl_serve_worker * const restrict w,
+                     const int lfd)
+  __attribute_nonnull__;
+static void
+mcdbctl_serve_accept(struct mcdbctl_serve_worker * const restrict w,
+                     const int lfd)
+{
+    struct mcdbctl_serve_conn *c;
+    int fd, i;
+    const int on = 1;
+    for (i = 0; i < MCDBCTL_SERVE_NEVENTS; ++i) {
+        if ((fd = accept(lfd, NULL, NULL)) == -1) {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO)
+                continue;
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS
+                || errno == ENOMEM)
+                mcdbctl_serve_ev_pause(w, true); /*(resume after a second)*/
+            break;
+        }
+        if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) == -1
+            || fcntl(fd, F_SETFD, FD_CLOEXEC) == -1
+            || (c = mcdbctl_serve_conn_new(fd)) == NULL) {
+            (void)nointr_close(fd);
+            continue;
+        }
+        if (!mcdbctl_serve_ev_add(w, c)) {
+            (void)nointr_close(fd);
+            mcdbctl_serve_conn_free(c);
+            continue;
+        }
+        (void)setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+}
+
+static void
+mcdbctl_serve_event(struct mcdbctl_serve_worker * const restrict w,
+                    struct mcdbctl_serve_conn * const restrict c,
+                    const bool in, const bool out, const bool err)
+  __attribute_nonnull__;
+static void
+mcdbctl_serve_event(struct mcdbctl_serve_worker * const restrict w,
+                    struct mcdbctl_serve_conn * const restrict c,
+                    const bool in, const bool out, const bool err)
+{
+    bool rc = true;
+    switch (c->kind) {
+      case MCDBCTL_SERVE_LISTEN_TCP: mcdbctl_serve_accept(w, c->fd); return;
+      case MCDBCTL_SERVE_LISTEN_UDP: mcdbctl_serve_udp(w, c->fd);    return;
+      default: break;
+    }
+    if (c->wantout) {
+        if (out || err)
+            rc = mcdbctl_serve_write(w, c);
+    }
+    else if (in || err)
+        rc = mcdbctl_serve_read(w, c);
+    if (!rc || (c->closing && c->opos == c->olen))
+        mcdbctl_serve_ev_close(w, c);
+    else
+        mcdbctl_serve_ev_want(w, c, c->opos != c->olen);
+}
+
+/* once per second: main thread checks for updated mcdb (hot swap) and
+ * workers move registrations off superseded mmap (so that it is released) */
+static void
+mcdbctl_serve_tick(struct mcdbctl_serve_worker * const restrict w)
+  __attribute_nonnull__;
+static void
+mcdbctl_serve_tick(struct mcdbctl_serve_worker * const restrict w)
+{
+    const time_t now = time(NULL);
+    size_t i, n;
+    uint32_t d;
+    if (now == w->tick)
+        return;
+    w->tick = now;
+    if (w->main) {
+        for (d = 0; d < w->srv->ndb; ++d)
+            (void)mcdb_mmap_refresh_threadsafe(&w->srv->maps[d]);
+    }
+    for (i = 0, n = (size_t)w->srv->ndb * MCDBCTL_SERVE_BATCH; i < n; ++i)
+        (void)mcdb_thread_refresh_self(&w->ms[i]);
+    if (w->paused)
+        mcdbctl_serve_ev_pause(w, false);
+}
+
+/* worker init (in worker thread; mcdb registrations are counted per thread)
+ * (each struct mcdb used in batched lookups holds its own registration) */
+static void
+mcdbctl_serve_worker_init(struct mcdbctl_serve_worker * const restrict w)
+  __attribute_nonnull__;
+static void
+mcdbctl_serve_worker_init(struct mcdbctl_serve_worker * const restrict w)
+{
+    struct mcdbctl_serve * const srv = w->srv;
+    const size_t n = (size_t)srv->ndb * MCDBCTL_SERVE_BATCH;
+    size_t i;
+    if ((w->ms = calloc(n, sizeof(struct mcdb))) == NULL
+        || (w->udp.ibuf = malloc(MCDBCTL_SERVE_UDPSZ)) == NULL)
+        mcdbctl_serve_fatal("malloc");
+    w->udp.fd   = -1;
+    w->udp.kind = MCDBCTL_SERVE_UDP;
+    w->udp.isz  = MCDBCTL_SERVE_UDPSZ;
+    for (i = 0; i < n; ++i) {
+        w->ms[i].map = mcdb_mmap_thread_registration(
+                         &srv->maps[i / MCDBCTL_SERVE_BATCH],
+                         MCDB_REGISTER_USE_INCR);
+        if (w->ms[i].map == NULL)
+            mcdbctl_serve_fatal("mcdb registration");
+    }
+  #ifdef MCDBCTL_SERVE_EPOLL
+    if ((w->epfd = epoll_create(MCDBCTL_SERVE_NEVENTS)) == -1)
+        mcdbctl_serve_fatal("epoll_create");
+    (void)fcntl(w->epfd, F_SETFD, FD_CLOEXEC);
+  #endif
+    for (i = 0; i < srv->nlisten; ++i) {
+        if (!mcdbctl_serve_ev_add(w, &srv->listen[i]))
+            mcdbctl_serve_fatal("listen");
+    }
+}
+
+/* worker event loop (does not return) */
+static void *
+mcdbctl_serve_worker(void * const arg)
+  __attribute_nonnull__;
+static void *
+mcdbctl_serve_worker(void * const arg)
+{
+    struct mcdbctl_serve_worker * const restrict w =
+      (struct mcdbctl_serve_worker *)arg;
+  #ifdef MCDBCTL_SERVE_EPOLL
+    struct epoll_event ev[MCDBCTL_SERVE_NEVENTS];
+    int i, n;
+  #else
+    size_t i, j, n;
+  #endif
+    mcdbctl_serve_worker_init(w);
+    for (;;) {
+      #ifdef MCDBCTL_SERVE_EPOLL
+        n = epoll_wait(w->epfd, ev, MCDBCTL_SERVE_NEVENTS, 1000);
+        if (n == -1) {
+            if (errno != EINTR)
+                mcdbctl_serve_fatal("epoll_wait");
+            n = 0;
+        }
+        for (i = 0; i < n; ++i)
+            mcdbctl_serve_event(w,
+                                (struct mcdbctl_serve_conn *)ev[i].data.ptr,
+                                (ev[i].events & EPOLLIN) != 0,
+                                (ev[i].events & EPOLLOUT) != 0,
+                                (ev[i].events & (EPOLLERR|EPOLLHUP)) != 0);
+      #else
+        n = w->nconns;
+        for (i = 0; i < n; ++i) {
+            const struct mcdbctl_serve_conn * const c = w->conns[i];
+            w->pfd[i].fd = (w->paused && c->kind == MCDBCTL_SERVE_LISTEN_TCP)
+              ? -1
+              : c->fd;
+            w->pfd[i].events  = c->wantout ? POLLOUT : POLLIN;
+            w->pfd[i].revents = 0;
+        }
+        if (poll(w->pfd, (nfds_t)n, 1000) == -1) {
+            if (errno != EINTR)
+                mcdbctl_serve_fatal("poll");
+            n = 0;
+        }
+        for (i = 0; i < n; ++i) { /*(w->conns, w->pfd realloc'd by accept)*/
+            const short ev = w->pfd[i].revents;
+            if (ev != 0)
+                mcdbctl_serve_event(w, w->conns[i],
+                                    (ev & POLLIN) != 0,
+                                    (ev & POLLOUT) != 0,
+                                    (ev & (POLLERR|POLLHUP|POLLNVAL)) != 0);
+        }
+        for (i = 0, j = 0, n = w->nconns; i < n; ++i) {
+            if (w->conns[i]->fd != -1)
+                w->conns[j++] = w->conns[i];
+            else
+                mcdbctl_serve_conn_free(w->conns[i]);
+        }
+        w->nconns = j;
+      #endif
+        mcdbctl_serve_tick(w);
+    }
+    return NULL;
+}
+
+/* create listening sockets for addr and port (all addresses resolved) */
+static void
+mcdbctl_serve_listen(struct mcdbctl_serve * const restrict srv,
+                     const char * const restrict addr,
+                     const char * const restrict port, const bool udp)
+  __attribute_nonnull_x__((1,3));
+static void
+mcdbctl_serve_listen(struct mcdbctl_serve * const restrict srv,
+                     const char * const restrict addr,
+                     const char * const restrict port, const bool udp)
+{
+    struct addrinfo hints, *res, *ai;
+    const uint32_t nlisten = srv->nlisten;
+    const int on = 1;
+    int fd, rc, errnum = 0;
+    memset(&hints, '\0', sizeof(hints));
+    hints.ai_flags    = AI_PASSIVE;
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = udp ? SOCK_DGRAM : SOCK_STREAM;
+    if ((rc = getaddrinfo(addr, port, &hints, &res)) != 0) {
+        fprintf(stderr, "mcdbctl: serve: %s port %s: %s\n",
+                addr != NULL ? addr : "*", port, gai_strerror(rc));
+        exit(111);
+    }
+    for (ai = res; ai != NULL && srv->nlisten < MCDBCTL_SERVE_NLISTEN;
+         ai = ai->ai_next) {
+        if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol))
+            == -1) {
+            errnum = errno;  /*(e.g. EAFNOSUPPORT if no IPv6)*/
+            continue;
+        }
+        if (!udp)
+            (void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+      #ifdef IPV6_V6ONLY  /*(separate sockets bound for IPv4 and IPv6)*/
+        if (ai->ai_family == AF_INET6)
+            (void)setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+      #endif
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == -1
+            || (!udp && listen(fd, 1024) == -1)
+            || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) == -1
+            || fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+            errnum = errno;
+            (void)nointr_close(fd);
+            continue;
+        }
+        srv->listen[srv->nlisten].fd   = fd;
+        srv->listen[srv->nlisten].kind = udp
+          ? MCDBCTL_SERVE_LISTEN_UDP
+          : MCDBCTL_SERVE_LISTEN_TCP;
+        ++srv->nlisten;
+    }
+    freeaddrinfo(res);
+    if (srv->nlisten == nlisten) {
+        errno = errnum;
+        mcdbctl_serve_fatal(udp ? "bind udp" : "bind tcp");
+    }
+}
+
+int
+mcdbctl_serve(const int argc, char ** restrict argv)
+{
+    static struct mcdbctl_serve srv;
+    struct mcdbctl_serve_worker *workers;
+    struct sigaction sa;
+    const char *addr  = NULL;
+    const char *tport = "11211";
+    const char *uport = NULL;
+    unsigned long nthreads = 1;
+    uint32_t d;
+    int i;
+
+    /* options precede <fname.mcdb> [<fname.mcdb> ...] */
+    for (i = 2; i+1 < argc && argv[i][0] == '-' && argv[i][1] != '\0'
+                && argv[i][2] == '\0'; i += 2) {
+        char *endptr;
+        switch (argv[i][1]) {
+          case 'p': tport = argv[i+1]; break;
+          case 'u': uport = argv[i+1]; break;
+          case 'b': addr  = argv[i+1]; break;
+          case 'j': nthreads = strtoul(argv[i+1], &endptr, 10);
+                    if (nthreads == 0 || nthreads > 1024
+                        || argv[i+1] == endptr || *endptr != '\0')
+                        return MCDB_ERROR_USAGE;
+                    break;
+          case 'P': if (0 == strcmp(argv[i+1], "raw"))
+                        srv.raw = true;
+                    else if (0 == strcmp(argv[i+1], "memcache"))
+                        srv.raw = false;
+                    else
+                        return MCDB_ERROR_USAGE;
+                    break;
+          default:  return MCDB_ERROR_USAGE;
+        }
+    }
+    if (tport != NULL && 0 == strcmp(tport, "0"))
+        tport = NULL;
+    if (uport != NULL && 0 == strcmp(uport, "0"))
+        uport = NULL;
+    if (i == argc || (tport == NULL && uport == NULL)
+        || (uport != NULL && srv.raw))   /*(raw protocol is TCP only)*/
+        return MCDB_ERROR_USAGE;
+  #ifndef _THREAD_SAFE
+    nthreads = 1;
+  #endif
+
+    /* map mcdb files (shared by workers) */
+    srv.ndb = (uint32_t)(argc - i);
+    if ((srv.maps = calloc(srv.ndb, sizeof(struct mcdb_mmap *))) == NULL)
+        return MCDB_ERROR_MALLOC;
+    for (d = 0; d < srv.ndb; ++d) {
+        srv.maps[d] = mcdb_mmap_create(NULL, NULL, argv[i+(int)d],malloc,free);
+        if (srv.maps[d] == NULL)
+            return MCDB_ERROR_READ;
+        if (!mcdb_mmap_watch(srv.maps[d])) {
+            /*(notification not available; stat() mcdb once per second)*/
+        }
+    }
+
+    if (tport != NULL)
+        mcdbctl_serve_listen(&srv, addr, tport, false);
+    if (uport != NULL)
+        mcdbctl_serve_listen(&srv, addr, uport, true);
+
+    memset(&sa, '\0', sizeof(sa));
+    sa.sa_handler = SIG_IGN;  /*(EPIPE from writev() to closed conn instead)*/
+    (void)sigemptyset(&sa.sa_mask);
+    (void)sigaction(SIGPIPE, &sa, NULL);
+
+    if ((workers = calloc(nthreads, sizeof(struct mcdbctl_serve_worker)))
+        == NULL)
+        return MCDB_ERROR_MALLOC;
+    for (i = 0; (unsigned long)i < nthreads; ++i)
+        workers[i].srv = &srv;
+    workers[0].main = true;
+  #ifdef _THREAD_SAFE
+    for (i = 1; (unsigned long)i < nthreads; ++i) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, mcdbctl_serve_worker, workers+i) != 0)
+            mcdbctl_serve_fatal("pthread_create");
+        (void)pthread_detach(tid);
+    }
+  #endif
+    (void)mcdbctl_serve_worker(workers);  /*(main thread is worker 0)*/
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,48 @@
+/*
+ * mcdbctl_serve - mcdbctl serve: network lookup server for mcdb files
+ *
+ * Copyright (c) 2010, Glue Logic LLC. All rights reserved. code()gluelogic.com
+ *
+ *  This file is part of mcdb.
+ *
+ *  mcdb is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mcdb is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with mcdb.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * mcdb is originally based upon the Public Domain cdb-0.75 by Dan Bernstein
+ */
+
+#ifndef INCLUDED_MCDBCTL_SERVE_H
+#define INCLUDED_MCDBCTL_SERVE_H
+
+#include "plasma/plasma_feature.h"
+#include "plasma/plasma_attr.h"
+PLASMA_ATTR_Pragma_once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* mcdbctl serve [-p port] [-u port] [-b addr] [-j threads] [-P memcache|raw]
+ *               <fname.mcdb> [<fname.mcdb> ...]
+ * (argv[1] is "serve") (returns MCDB_ERROR_* upon failure to start server;
+ *  server runs until killed) */
+extern int
+mcdbctl_serve(int, char ** restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
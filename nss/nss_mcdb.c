@@ -24,11 +24,15 @@
 #endif
 
 #include "nss_mcdb.h"
+#include "../uint32.h"
+#include "../plasma/plasma_atomic.h"
 #include "../plasma/plasma_membar.h"
 #include "../plasma/plasma_stdtypes.h"
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -108,6 +112,119 @@ static __thread struct mcdb _nss_mcdb_st[_nss_num_dbs];
 static struct mcdb _nss_mcdb_st[_nss_num_dbs];
 #endif
 
+/* optional lookup statistics (see struct nss_mcdb_stats in nss_mcdb.h) */
+struct nss_mcdb_stats_tls {
+  uint32_t calls;
+  uint32_t hits;
+  uint32_t notfound;
+  uint32_t tryagain;
+  uint32_t lat[NSS_MCDB_STATS_NLAT];
+};
+
+static struct nss_mcdb_stats *_nss_mcdb_stats;
+
+#if !(defined(__APPLE__) && defined(__MACH__) \
+      && defined(__GNUC__) && !defined(__clang))
+static __thread struct nss_mcdb_stats_tls _nss_mcdb_stats_tls[_nss_num_dbs];
+#else
+static struct nss_mcdb_stats_tls _nss_mcdb_stats_tls[_nss_num_dbs];
+#endif
+
+/* map shared statistics, if enabled (called with _nss_mcdb_global_mutex) */
+__attribute_noinline__
+static void
+_nss_mcdb_stats_attach(void)
+  __attribute_cold__;
+__attribute_noinline__
+static void
+_nss_mcdb_stats_attach(void)
+{
+    struct nss_mcdb_stats *stats;
+    struct stat st;
+    const int errsave = errno;
+    const int fd = open(NSS_MCDB_STATSPATH, O_RDWR|O_NONBLOCK|O_CLOEXEC, 0);
+    if (fd == -1)
+        return; /* (not enabled, or not permitted) */
+    stats = (fstat(fd, &st) == 0
+             && S_ISREG(st.st_mode)
+             && !(st.st_mode & (S_IWGRP|S_IWOTH))
+             && (st.st_uid == 0 || st.st_uid == geteuid())
+             && st.st_size == (off_t)sizeof(struct nss_mcdb_stats))
+      ? mmap(NULL, sizeof(struct nss_mcdb_stats), PROT_READ|PROT_WRITE,
+             MAP_SHARED, fd, 0)
+      : MAP_FAILED;
+    (void)close(fd);
+    if (stats != MAP_FAILED) {
+        if (stats->magic   == NSS_MCDB_STATS_MAGIC
+            && stats->version == NSS_MCDB_STATS_VERSION
+            && stats->ndb     == NSS_DBTYPE_SENTINEL
+            && stats->nlat    == NSS_MCDB_STATS_NLAT) {
+            plasma_membar_StoreStore();
+            _nss_mcdb_stats = stats;
+        }
+        else
+            munmap(stats, sizeof(struct nss_mcdb_stats));
+    }
+    errno = errsave;
+}
+
+/* add thread counts to shared counts */
+__attribute_noinline__
+static void
+_nss_mcdb_stats_flush(struct nss_mcdb_stats_db * restrict,
+                      struct nss_mcdb_stats_tls * restrict)
+  __attribute_nonnull__;
+__attribute_noinline__
+static void
+_nss_mcdb_stats_flush(struct nss_mcdb_stats_db * const restrict sdb,
+                      struct nss_mcdb_stats_tls * const restrict tls)
+{
+    #define _nss_mcdb_stats_add(x) \
+      if (tls->x) plasma_atomic_fetch_add_u64(&sdb->x, tls->x, \
+                                              memory_order_relaxed)
+    _nss_mcdb_stats_add(calls);
+    _nss_mcdb_stats_add(hits);
+    _nss_mcdb_stats_add(notfound);
+    _nss_mcdb_stats_add(tryagain);
+    for (int i = 0; i < NSS_MCDB_STATS_NLAT; ++i) {
+        _nss_mcdb_stats_add(lat[i]);
+    }
+    #undef  _nss_mcdb_stats_add
+    memset(tls, 0, sizeof(struct nss_mcdb_stats_tls));
+}
+
+/* count lookup in thread counts (begin is time lookup began) */
+static void
+_nss_mcdb_stats_count(struct nss_mcdb_stats * restrict,
+                      enum nss_dbtype, nss_status_t,
+                      const struct timespec * restrict)
+  __attribute_nonnull__;
+static void
+_nss_mcdb_stats_count(struct nss_mcdb_stats * const restrict stats,
+                      const enum nss_dbtype dbtype, const nss_status_t status,
+                      const struct timespec * const restrict begin)
+{
+    struct nss_mcdb_stats_tls * const restrict tls =
+      &_nss_mcdb_stats_tls[dbtype];
+    struct timespec end;
+    uint64_t ns;
+    int i = 0;
+    (void)clock_gettime(CLOCK_MONOTONIC, &end);
+    ns = (uint64_t)(end.tv_sec - begin->tv_sec) * 1000000000u
+       + (uint64_t)end.tv_nsec - (uint64_t)begin->tv_nsec;
+    for (ns >>= 8; ns != 0 && i < NSS_MCDB_STATS_NLAT-1; ns >>= 1)
+        ++i;
+    ++tls->lat[i];
+    if (status == NSS_STATUS_SUCCESS)
+        ++tls->hits;
+    else if (status == NSS_STATUS_NOTFOUND)
+        ++tls->notfound;
+    else if (status == NSS_STATUS_TRYAGAIN)
+        ++tls->tryagain;
+    if (++tls->calls == NSS_MCDB_STATS_FLUSH)
+        _nss_mcdb_stats_flush(&stats->db[dbtype], tls);
+}
+
 #ifdef _FORTIFY_SOURCE
 static void _nss_mcdb_atexit(void)
 {
@@ -152,10 +269,16 @@ _nss_mcdb_db_openshared(const enum nss_dbtype dbtype)
      * use static storage for initial struct mcdb_mmap for each dbtype
      * to avoid malloc allocation in short-lived programs, and to maintain
      * a reference to maps to keep them available. */
+    if (_nss_mcdb_stats == NULL)
+        _nss_mcdb_stats_attach();
+
     if ((rc = (NULL != mcdb_mmap_create_h(map, NULL, _nss_dbnames[dbtype],
                                           malloc, free)))) {
         plasma_membar_StoreStore();
         _nss_mcdb_mmap[dbtype] = map;
+        if (_nss_mcdb_stats != NULL)
+            plasma_atomic_fetch_add_u64(&_nss_mcdb_stats->db[dbtype].opens, 1,
+                                        memory_order_relaxed);
     }
 
     pthread_mutex_unlock(&_nss_mcdb_global_mutex);
@@ -171,6 +294,24 @@ _nss_mcdb_db_openshared(const enum nss_dbtype dbtype)
  * (FreeBSD provides setpassent() and setgroupent() API with stayopen flag) */
 static bool _nss_mcdb_stayopen = true;
 
+/* reopen mcdb after database was remade */
+__attribute_noinline__
+static bool
+_nss_mcdb_db_reopen(const enum nss_dbtype dbtype)
+  __attribute_cold__;
+__attribute_noinline__
+static bool
+_nss_mcdb_db_reopen(const enum nss_dbtype dbtype)
+{
+    struct nss_mcdb_stats * const stats = _nss_mcdb_stats;
+    if (stats != NULL) {
+        plasma_membar_ld_datadep();
+        plasma_atomic_fetch_add_u64(&stats->db[dbtype].reopens, 1,
+                                    memory_order_relaxed);
+    }
+    return mcdb_mmap_reopen_threadsafe_h(&_nss_mcdb_mmap[dbtype]);
+}
+
 /* release shared mcdb_mmap */
 #define _nss_mcdb_db_relshared(map) \
   mcdb_mmap_thread_registration_h(&(map), MCDB_REGISTER_USE_DECR)
@@ -203,8 +344,7 @@ _nss_mcdb_db_getshared(const enum nss_dbtype dbtype)
             /*(void)mcdb_mmap_refresh_threadsafe(&_nss_mcdb_mmap[dbtype]);*/
             (void)(__builtin_expect(
                !mcdb_mmap_refresh_check_h(_nss_mcdb_mmap[dbtype]), true)
-               ||  __builtin_expect(
-               mcdb_mmap_reopen_threadsafe_h(&_nss_mcdb_mmap[dbtype]), true));
+               ||  __builtin_expect(_nss_mcdb_db_reopen(dbtype), true));
             break;
         }
     }
@@ -213,7 +353,41 @@ _nss_mcdb_db_getshared(const enum nss_dbtype dbtype)
 
     return mcdb_mmap_thread_registration_h(&_nss_mcdb_mmap[dbtype],
                                            MCDB_REGISTER_USE_INCR);
-    /* (fails only if obtaining mutex fails, i.e. EAGAIN; should not happen) */
+    /* (fails only if map has been released; should not happen)
+     * (lock-free and without shared writes unless map has been superseded) */
+}
+
+/* position get*ent() session at range of '=' records in tag directory
+ * (hpos and kpos of session are next record and end of range (0 if no end))
+ * (mcdb made by older nss_mcdbctl has no tag directory; walk entire db) */
+static void
+nss_mcdb_setent_range(struct mcdb * const restrict m)
+  __attribute_nonnull__;
+static void
+nss_mcdb_setent_range(struct mcdb * const restrict m)
+{
+    uint64_t begin = MCDB_HEADER_SZ, end = 0;
+    if (mcdb_findtagstart_h(m, "", 0, (unsigned char)NSS_TD_TAGC)
+        && mcdb_findtagnext_h(m, "", 0, (unsigned char)NSS_TD_TAGC)
+        && m->zlen == 0) {
+        const unsigned char * restrict p = mcdb_dataptr(m);
+        uint32_t n = mcdb_datalen(m) / NSS_TD_ENTSZ;
+        for (; n; --n, p += NSS_TD_ENTSZ) {
+            if (uint32_strunpack_bigendian_macro(p+NSS_TD_TAG) != '=')
+                continue;
+            #define nss_mcdb_td_unpack64(s)                           \
+              (((uint64_t)uint32_strunpack_bigendian_macro(s) << 32)  \
+               | uint32_strunpack_bigendian_macro((s)+4))
+            begin = nss_mcdb_td_unpack64(p+NSS_TD_BEGIN);
+            end   = nss_mcdb_td_unpack64(p+NSS_TD_END);
+            #undef  nss_mcdb_td_unpack64
+            if (begin < MCDB_HEADER_SZ || end < begin || end > m->map->size)
+                begin = MCDB_HEADER_SZ, end = 0;  /*(invalid; ignore)*/
+            break;
+        }
+    }
+    m->hpos = (uintptr_t)(m->map->ptr + begin);
+    m->kpos = (end != 0) ? (uintptr_t)(m->map->ptr + end) : 0;
 }
 
 __attribute_noinline__ /*(skip _nss_mcdb_setent inline)*/
@@ -223,7 +397,7 @@ nss_mcdb_setent(const enum nss_dbtype dbtype,
 {
     struct mcdb * const restrict m = &_nss_mcdb_st[dbtype];
     if (m->map != NULL || (m->map = _nss_mcdb_db_getshared(dbtype)) != NULL) {
-        m->hpos = (uintptr_t)(m->map->ptr + MCDB_HEADER_SZ);
+        nss_mcdb_setent_range(m);
         return NSS_STATUS_SUCCESS;
     }
     return NSS_STATUS_UNAVAIL;
@@ -234,10 +408,15 @@ nss_mcdb_endent(const enum nss_dbtype dbtype)
 {
     struct mcdb * const restrict m = &_nss_mcdb_st[dbtype];
     struct mcdb_mmap *map = m->map;
+    struct nss_mcdb_stats * const stats = _nss_mcdb_stats;
     m->map = NULL;  /* set thread-local ptr NULL */
+    if (stats != NULL && _nss_mcdb_stats_tls[dbtype].calls != 0) {
+        plasma_membar_ld_datadep();
+        _nss_mcdb_stats_flush(&stats->db[dbtype], &_nss_mcdb_stats_tls[dbtype]);
+    }
     return (map == NULL || _nss_mcdb_db_relshared(map))
       ? NSS_STATUS_SUCCESS
-      : NSS_STATUS_UNAVAIL; /* (fails if obtaining mutex fails, i.e. EAGAIN) */
+      : NSS_STATUS_UNAVAIL; /* (should not happen) */
 }
 
 /* mcdb get*ent() walks db returning successive keys with '=' tag char */
@@ -247,24 +426,44 @@ nss_mcdb_getent(const enum nss_dbtype dbtype,
 {
     struct mcdb_iter iter;
     struct mcdb * const m = &_nss_mcdb_st[dbtype];
+    struct nss_mcdb_stats * const stats = _nss_mcdb_stats;
+    struct timespec begin;
+    nss_status_t status;
+    if (__builtin_expect(stats != NULL, false))
+        (void)clock_gettime(CLOCK_MONOTONIC, &begin);
     if (__builtin_expect(m->map == NULL, false)
         && nss_mcdb_setent(dbtype,0) != NSS_STATUS_SUCCESS) {
         *v->errnop = errno;
+        if (stats != NULL) {
+            plasma_membar_ld_datadep();
+            _nss_mcdb_stats_count(stats, dbtype, NSS_STATUS_UNAVAIL, &begin);
+        }
         return NSS_STATUS_UNAVAIL;
     }
     mcdb_iter_init_h(&iter, m);
     iter.ptr = (unsigned char *)m->hpos;
+    if (m->kpos != 0 && iter.eod > (unsigned char *)m->kpos)
+        iter.eod = (unsigned char *)m->kpos; /*(end of '=' records)*/
     while (mcdb_iter_h(&iter)) {
         if (mcdb_iter_keyptr(&iter)[0] == (unsigned char)'=') {
             m->hpos = (uintptr_t)iter.ptr;
             /* valid data for mcdb_datapos() mcdb_datalen() mcdb_dataptr() */
             m->dpos = (uintptr_t)mcdb_iter_datapos(&iter);
             m->dlen = mcdb_iter_datalen(&iter);
-            return v->decode(m, v);
+            status = v->decode(m, v);
+            if (__builtin_expect(stats != NULL, false)) {
+                plasma_membar_ld_datadep();
+                _nss_mcdb_stats_count(stats, dbtype, status, &begin);
+            }
+            return status;
         }
     }
     m->hpos = (uintptr_t)iter.ptr;
     *v->errnop = errno = ENOENT;
+    if (__builtin_expect(stats != NULL, false)) {
+        plasma_membar_ld_datadep();
+        _nss_mcdb_stats_count(stats, dbtype, NSS_STATUS_NOTFOUND, &begin);
+    }
     return NSS_STATUS_NOTFOUND;
 }
 
@@ -316,10 +515,18 @@ nss_mcdb_get_generic(const enum nss_dbtype dbtype,
 {
     struct mcdb m;
     nss_status_t status;
+    struct nss_mcdb_stats * const stats = _nss_mcdb_stats;
+    struct timespec begin;
+    if (__builtin_expect(stats != NULL, false))
+        (void)clock_gettime(CLOCK_MONOTONIC, &begin);
 
     m.map = _nss_mcdb_db_getshared(dbtype);
     if (__builtin_expect(m.map == NULL, false)) {
         *v->errnop = errno;
+        if (stats != NULL) {
+            plasma_membar_ld_datadep();
+            _nss_mcdb_stats_count(stats, dbtype, NSS_STATUS_UNAVAIL, &begin);
+        }
         return NSS_STATUS_UNAVAIL;
     }
 
@@ -335,6 +542,10 @@ nss_mcdb_get_generic(const enum nss_dbtype dbtype,
     if (_nss_mcdb_st[dbtype].map == NULL)
         _nss_mcdb_db_relshared(m.map);
 
+    if (__builtin_expect(stats != NULL, false)) {
+        plasma_membar_ld_datadep();
+        _nss_mcdb_stats_count(stats, dbtype, status, &begin);
+    }
     return status;
 }
 
@@ -359,3 +570,13 @@ nss_mcdb_refresh_check(const enum nss_dbtype dbtype)
         && _nss_mcdb_mmap[dbtype] != NULL
         && mcdb_mmap_refresh_check_h(_nss_mcdb_mmap[dbtype]);
 }
+
+/* request notification when db is replaced, so that lookups need not stat()
+ * (e.g. for long-running, threaded programs) (db is opened if not yet open) */
+bool
+nss_mcdb_refresh_watch(const enum nss_dbtype dbtype)
+{
+    return (0 <= (int)dbtype && dbtype < NSS_DBTYPE_SENTINEL)
+        && (_nss_mcdb_mmap[dbtype] != NULL || _nss_mcdb_db_openshared(dbtype))
+        && mcdb_mmap_watch_h(_nss_mcdb_mmap[dbtype]);
+}
@@ -101,6 +101,55 @@ enum nss_dbtype {
  * of accessing the mcdb when end*ent() is called, or else crashes are likely
  * if the mcdb is updated. */
 
+/* tag directory record (tag '#', empty key) written last by nss_mcdbctl:
+ * records of each tag are contiguous in data section, and for each tag, entry
+ * of NSS_TD_ENTSZ bytes holds bigendian tag, and begin and end offsets of its
+ * records (high, low 32 bits each) (get*ent() reads only range of '=' tag) */
+enum {
+  NSS_TD_TAG     =  0,
+  NSS_TD_BEGIN   =  4,
+  NSS_TD_END     = 12,
+  NSS_TD_ENTSZ   = 20
+};
+#define NSS_TD_TAGC '#'
+
+/* optional lookup statistics per database, shared by processes on host
+ * Collected by processes which can open NSS_MCDB_STATSPATH read-write when
+ * first opening a database.  File is created and read by nss_mcdbctl stats.
+ * (File must not be writable by group or other; truncation of file would
+ *  fault processes that have it mapped.  Otherwise, it is not used.)
+ * Counts are accumulated per thread, and are added to shared counts every
+ * NSS_MCDB_STATS_FLUSH lookups and at end*ent() (without locks), so shared
+ * counts lag, and counts not yet added when thread exits are lost.
+ * Latency buckets are powers of 2: lat[0] < 256ns, lat[i] < (256ns << i),
+ * and last bucket is everything greater */
+#ifndef NSS_MCDB_STATSPATH
+#define NSS_MCDB_STATSPATH "/dev/shm/nss_mcdb.stats"
+#endif
+#define NSS_MCDB_STATS_MAGIC   0x6d636462u  /* "mcdb" */
+#define NSS_MCDB_STATS_VERSION 1u
+enum { NSS_MCDB_STATS_NLAT = 12, NSS_MCDB_STATS_FLUSH = 64 };
+
+struct nss_mcdb_stats_db {
+  uint64_t calls;
+  uint64_t hits;
+  uint64_t notfound;
+  uint64_t tryagain;        /* NSS_STATUS_TRYAGAIN (e.g. ERANGE retries) */
+  uint64_t opens;
+  uint64_t reopens;         /* mcdb refreshed after database was remade */
+  uint64_t lat[NSS_MCDB_STATS_NLAT];
+  uint64_t pad[6];          /* (pad to multiple of 64-byte cache line) */
+};
+
+struct nss_mcdb_stats {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t ndb;             /* NSS_DBTYPE_SENTINEL */
+  uint32_t nlat;            /* NSS_MCDB_STATS_NLAT */
+  uint64_t pad[6];
+  struct nss_mcdb_stats_db db[NSS_DBTYPE_SENTINEL];
+};
+
 struct nss_mcdb_vinfo {
   /* fail with errno = ERANGE if insufficient buf space supplied */
   nss_status_t (* const decode)(struct mcdb * restrict,
@@ -155,5 +204,8 @@ nss_mcdb_buf_decode(struct mcdb * restrict,
 bool
 nss_mcdb_refresh_check(enum nss_dbtype);
 
+bool
+nss_mcdb_refresh_watch(enum nss_dbtype);
+
 
 #endif
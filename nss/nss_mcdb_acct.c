@@ -31,7 +31,8 @@
 
 #include <pwd.h>
 #include <grp.h>
-#include <stdlib.h>     /* realloc */
+#include <stdlib.h>     /* malloc() realloc() free() */
+#include <limits.h>     /* INT_MAX */
 #include <arpa/inet.h>  /* ntohl(), ntohs() */
 #include <unistd.h>     /* sysconf(), _SC_NGROUPS_MAX */
 
@@ -59,6 +60,11 @@ nss_mcdb_acct_grouplist_decode(struct mcdb * restrict,
                                const struct nss_mcdb_vinfo * restrict)
   __attribute_nonnull__  __attribute_warn_unused_result__;
 
+static nss_status_t
+nss_mcdb_acct_gidlist_decode(struct mcdb * restrict,
+                             const struct nss_mcdb_vinfo * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
 
 void _nss_mcdb_setpwent(void) { nss_mcdb_setent(NSS_DBTYPE_PASSWD,0); }
 void _nss_mcdb_endpwent(void) { nss_mcdb_endent(NSS_DBTYPE_PASSWD);   }
@@ -170,20 +176,32 @@ nss_mcdb_getgrouplist(const char * const restrict user, gid_t group,
                       int * const restrict ngroups)
 {
     int errnum;
-    const struct nss_mcdb_vinfo v = { .decode  = nss_mcdb_acct_grouplist_decode,
+    const struct nss_mcdb_vinfo v = { .decode  = nss_mcdb_acct_gidlist_decode,
                                       .vstruct = &group,
                                       .buf     = (char * restrict)groups,
                                       .bufsz   = *(unsigned int *)ngroups,
                                       .errnop  = &errnum,
                                       .key     = user,
                                       .klen    = strlen(user),
-                                      .tagc    = (unsigned char)'~' };
+                                      .tagc    = (unsigned char)'^' };
     /* overload 'group' to pass values in and out of decode routine.
-     * nss_mcdb_acct_grouplist_decode() needs to know group gid that will be
+     * nss_mcdb_acct_gidlist_decode() needs to know group gid that will be
      * added to grouplist so that gid can be removed if duplicated in grouplist.
      * The value in 'group' after the call is the number of groups that would
      * be in the list, regardless of whether or not there is enough space. */
-    const nss_status_t status = nss_mcdb_get_generic(NSS_DBTYPE_GROUP, &v);
+    nss_status_t status = nss_mcdb_get_generic(NSS_DBTYPE_GROUP, &v);
+    if (status == NSS_STATUS_NOTFOUND) { /*(mcdb made by older nss_mcdbctl)*/
+        const struct nss_mcdb_vinfo vl = { .decode  =
+                                             nss_mcdb_acct_grouplist_decode,
+                                           .vstruct = v.vstruct,
+                                           .buf     = v.buf,
+                                           .bufsz   = v.bufsz,
+                                           .errnop  = v.errnop,
+                                           .key     = v.key,
+                                           .klen    = v.klen,
+                                           .tagc    = (unsigned char)'~' };
+        status = nss_mcdb_get_generic(NSS_DBTYPE_GROUP, &vl);
+    }
     *ngroups = (status == NSS_STATUS_SUCCESS || status == NSS_STATUS_TRYAGAIN)
              ? (int)group  /* overloaded; value returned is num of groups */
              : 0; /*(indicates error; valid value always >= 1 in *ngroups)*/
@@ -197,8 +215,6 @@ nss_mcdb_getgrouplist(const char * const restrict user, gid_t group,
 #include <assert.h>
 #endif
 
-static long sc_ngroups_max_cached = -1L;
-
 nss_status_t
 _nss_mcdb_initgroups_dyn(const char * const restrict user,
                          const gid_t group,
@@ -208,40 +224,69 @@ _nss_mcdb_initgroups_dyn(const char * const restrict user,
                          const long int limit,
                          int * const restrict errnop)
 {
-    /* arbitrary limit: NSS_MCDB_NGROUPS_MAX in nss_mcdb_acct.h */
-    const long sc_ngroups_max = (sc_ngroups_max_cached != -1L)
-      ? sc_ngroups_max_cached
-      : (sc_ngroups_max_cached = sysconf(_SC_NGROUPS_MAX));
-    int sz = (0 < sc_ngroups_max && sc_ngroups_max < NSS_MCDB_NGROUPS_MAX)
-           ? (int)(sc_ngroups_max+1)
-           : NSS_MCDB_NGROUPS_MAX+1;
-    gid_t gidlist[sz];
+    /* decode directly into *groupsp if list is empty or contains only gid
+     * (growing *groupsp to number of groups, up to limit), else decode into
+     * gidlist on stack (or allocated if more than NSS_MCDB_NGROUPS_MAX groups)
+     * and merge into *groupsp, removing dups */
+    gid_t gidstack[NSS_MCDB_NGROUPS_MAX+1];
+    gid_t * restrict gidlist;
+    bool direct = (*start == 0 || (*start == 1 && (*groupsp)[0] == group));
+    int sz;
+    if (direct) {
+        gidlist = *groupsp;
+        sz = (*size < INT_MAX) ? (int)*size : INT_MAX;
+    }
+    else {
+        gidlist = gidstack;
+        sz = NSS_MCDB_NGROUPS_MAX+1;
+    }
     if (nss_mcdb_getgrouplist(user, group, gidlist, &sz) == -1) {
         /*(sz == 0 indicates error; valid value always >= 1 in *ngroups)
          *(no differentiation between NOTFOUND and UNAVAIL here; use UNAVAIL)
-         *(if db unavailable due to ENOENT, do not mistakenly return NOTFOUND)
-         *(TRYAGAIN should not happen (matched limit in nss_mcdb_acct_make.c))*/
-        *errnop = errno;
-        return (sz != 0 ? NSS_STATUS_TRYAGAIN : NSS_STATUS_UNAVAIL);
+         *(if db unavailable due to ENOENT, do not mistakenly return NOTFOUND)*/
+        if (sz == 0 || errno != ERANGE) {
+            *errnop = errno;
+            return (sz != 0 ? NSS_STATUS_TRYAGAIN : NSS_STATUS_UNAVAIL);
+        }
+        /* insufficient space for sz groups; allocate and retry */
+        if (direct && (limit <= 0 || sz <= limit)) {
+            gidlist = realloc(*groupsp, (size_t)sz * sizeof(gid_t));
+            if (gidlist != NULL) {
+                *groupsp = gidlist;
+                *size = sz;
+            }
+        }
+        else {
+            direct = false;
+            gidlist = malloc((size_t)sz * sizeof(gid_t));
+        }
+        if (gidlist == NULL) {
+            *errnop = errno = ENOMEM;
+            return NSS_STATUS_TRYAGAIN;
+        }
+        if (nss_mcdb_getgrouplist(user, group, gidlist, &sz) == -1) {
+            *errnop = errno;
+            if (!direct)
+                free(gidlist);
+            return (sz != 0 ? NSS_STATUS_TRYAGAIN : NSS_STATUS_UNAVAIL);
+        }
     }
 
     /* nss_mcdb_getgrouplist() success above means sz >=1 */
 
   #ifdef __GLIBC__
-    /* nss_mcdb_acct_grouplist_decode() puts gid passed in list first.
+    /* nss_mcdb_acct_gidlist_decode() puts gid passed in list first.
      * If -1, remove from list due to how __GLIBC__ nscd caches initgroups */
     if (group == (gid_t)-1) {
-        /*(nss_mcdb_acct_grouplist_decode() puts passed group as first entry) */
+        /*(nss_mcdb_acct_gidlist_decode() puts passed group as first entry) */
         assert(gidlist[0] == (gid_t)-1);
         assert((gid_t)-1 != 65535);  /* by convention 'nobody' */
         gidlist[0] = gidlist[--sz];
     }
   #endif
 
-    /* shortcut if enough space and list is empty or contains only gid */
-    if (*size >= sz && ((*start==1 && (*groupsp)[0]==group) || *start==0)) {
+    if (direct) {
         *start = sz;
-        memcpy(*groupsp, gidlist, sz * sizeof(gid_t));
         return NSS_STATUS_SUCCESS;
     }
     else { /* fill *groupsp, removing dups */
@@ -257,7 +302,7 @@ _nss_mcdb_initgroups_dyn(const char * const restrict user,
                 continue;  /* skip duplicate gid */
             if (__builtin_expect( *start == *size, 0)) {
                 if (*size == limit)
-                    return NSS_STATUS_SUCCESS;
+                    break;
                 /* realloc groups, as needed, to limit (no limit if limit <= 0)
                  * reallocate only when adding unique gids require, rather than
                  * preallocating and possibly hitting the limit due to dups */
@@ -266,12 +311,14 @@ _nss_mcdb_initgroups_dyn(const char * const restrict user,
                   : (int)(*size << 1);
                 groups = realloc(groups, sz * sizeof(gid_t));
                 if (groups == NULL) /*(realloc failed. oh well. truncate here)*/
-                    return NSS_STATUS_SUCCESS;
+                    break;
                 *groupsp = groups;
                 *size = sz;
             }
             groups[(*start)++] = gidlist[j];  /* add new gid to list */
         }
+        if (gidlist != gidstack)
+            free(gidlist);
         return NSS_STATUS_SUCCESS;
     }
 }
@@ -332,22 +379,32 @@ nss_mcdb_acct_group_decode(struct mcdb * const restrict m,
     gr->gr_gid    = (gid_t) ntohl( hdr.u[NSS_GR_GID>>2] );
     gr_mem_num    = (size_t)ntohs( hdr.h[NSS_GR_MEM_NUM>>1] );
     gr->gr_mem    = /* align to 8-byte boundary for 64-bit */
-      (char **)(((uintptr_t)(buf+ntohs(hdr.h[NSS_GR_MEM>>1])+0x7u)) & ~0x7u);
+      (char **)(((uintptr_t)(buf+ntohs(hdr.h[NSS_GR_MEM>>1])+0x7u))
+                & ~(uintptr_t)0x7u);
     /* fill buf, (char **) gr_mem (allow 8-byte ptrs), and terminate strings.
-     * scan for '\0' instead of precalculating array because names should
-     * be short and adding an extra 4 chars per name to store size takes
-     * more space and might take just as long to parse as scan for '\0'
+     * relocate gr_mem string offsets stored after strings, if present.
+     * (older mcdb lack offsets; scan for '\0' to locate gr_mem strings)
      * (assume data consistent, gr_mem_num correct) */
     if (((char *)gr->gr_mem)-buf+((gr_mem_num+1)<<3) <= v->bufsz) {
         char ** const restrict gr_mem = gr->gr_mem;
-        memcpy(buf, dptr+NSS_GR_HDRSZ, (size_t)mcdb_datalen(m)-NSS_GR_HDRSZ);
+        const size_t slen = (size_t)ntohs( hdr.h[NSS_GR_MEM>>1] );
+        memcpy(buf, dptr+NSS_GR_HDRSZ, slen);
+        gr_mem[gr_mem_num] = NULL;         /* terminate (char **) gr_mem array*/
+        if (mcdb_datalen(m) == NSS_GR_HDRSZ + slen + (gr_mem_num<<1)) {
+            const char * const restrict offs = dptr + NSS_GR_HDRSZ + slen;
+            uint16_t o;
+            for (size_t i = 0; i < gr_mem_num; ++i) {
+                memcpy(&o, offs+(i<<1), sizeof(uint16_t));
+                gr_mem[i] = buf + ntohs(o);
+            }
+            return NSS_STATUS_SUCCESS;
+        }
         gr_mem[0] = (buf += ntohs(hdr.h[NSS_GR_MEM_STR>>1])); /*gr_mem strings*/
         for (size_t i=1; i<gr_mem_num; ++i) {/*(i=1; assigned first str above)*/
             while (*++buf != '\0')
                 ;
             gr_mem[i] = ++buf;
         }
-        gr_mem[gr_mem_num] = NULL;         /* terminate (char **) gr_mem array*/
         return NSS_STATUS_SUCCESS;
     }
     else {
@@ -394,3 +451,104 @@ nss_mcdb_acct_grouplist_decode(struct mcdb * const restrict m,
     *(gid_t *)v->vstruct = (gid_t)x;
     return NSS_STATUS_SUCCESS;
 }
+
+/* grouplist record of gids in byte order of other host (cold) */
+__attribute_noinline__  __attribute_cold__
+static nss_status_t
+nss_mcdb_acct_gidlist_decode_swap(const unsigned char * restrict dptr,
+                                  uint32_t n,
+                                  const struct nss_mcdb_vinfo * restrict v)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+__attribute_noinline__  __attribute_cold__
+static nss_status_t
+nss_mcdb_acct_gidlist_decode_swap(const unsigned char * restrict dptr,
+                                  uint32_t n,
+                                  const struct nss_mcdb_vinfo *
+                                    const restrict v)
+{
+    gid_t * const gidlist = (gid_t *)v->buf;
+    const gid_t gid = *(gid_t *)v->vstruct;
+    uint32_t g, i, x = 1;
+    for (i = 0; i < n; ++i) {
+        memcpy(&g, dptr+(i<<2), sizeof(uint32_t));
+        x += ((gid_t)__builtin_bswap32(g) != gid);
+    }
+    if (__builtin_expect( x > v->bufsz, 0)) { /* not enough space */
+        *(gid_t *)v->vstruct = (gid_t)x;
+        *v->errnop = errno = ERANGE;
+        return NSS_STATUS_TRYAGAIN;
+    }
+    gidlist[0] = gid;
+    for (i = 0, x = 1; i < n; ++i) {
+        memcpy(&g, dptr+(i<<2), sizeof(uint32_t));
+        if ((gid_t)(g = __builtin_bswap32(g)) != gid)
+            gidlist[x++] = (gid_t)g;
+    }
+    *(gid_t *)v->vstruct = (gid_t)x;
+    return NSS_STATUS_SUCCESS;
+}
+
+static nss_status_t
+nss_mcdb_acct_gidlist_decode(struct mcdb * const restrict m,
+                             const struct nss_mcdb_vinfo * const restrict v)
+{
+    /* sorted array of unique gids (see NSS_GV_* in nss_mcdb_acct.h)
+     * gid passed is placed first; if also in array, it is skipped, located by
+     * binary search.  gids before and after it are each copied with memcpy */
+    const unsigned char * restrict dptr = mcdb_dataptr(m);
+    gid_t * const gidlist = (gid_t *)v->buf;
+    const gid_t gid = *(gid_t *)v->vstruct;
+    uint32_t hdr[NSS_GV_HDRSZ>>2];
+    uint32_t n, lo, hi, mid, g, x, dup;
+    if (__builtin_expect( mcdb_datalen(m) < NSS_GV_HDRSZ, 0)) {
+        *v->errnop = errno = EINVAL;
+        return NSS_STATUS_UNAVAIL;
+    }
+    memcpy(hdr, dptr, NSS_GV_HDRSZ);
+    dptr += NSS_GV_HDRSZ;
+    n = hdr[NSS_GV_NGROUPS>>2];
+    if (__builtin_expect( hdr[NSS_GV_BOM>>2] != NSS_GV_BOM_MARK, 0)) {
+        n = __builtin_bswap32(n);
+        if (hdr[NSS_GV_BOM>>2] != __builtin_bswap32(NSS_GV_BOM_MARK)
+            || mcdb_datalen(m) - NSS_GV_HDRSZ < ((size_t)n << 2)) {
+            *v->errnop = errno = EINVAL;
+            return NSS_STATUS_UNAVAIL;
+        }
+        return nss_mcdb_acct_gidlist_decode_swap(dptr, n, v);
+    }
+    if (__builtin_expect(mcdb_datalen(m) - NSS_GV_HDRSZ < ((size_t)n<<2),0)){
+        *v->errnop = errno = EINVAL;
+        return NSS_STATUS_UNAVAIL;
+    }
+    for (lo = 0, hi = n; lo < hi; ) {
+        mid = lo + ((hi - lo) >> 1);
+        memcpy(&g, dptr+(mid<<2), sizeof(uint32_t));
+        if ((gid_t)g < gid)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < n)
+        memcpy(&g, dptr+(lo<<2), sizeof(uint32_t));
+    dup = (lo < n && (gid_t)g == gid);
+    x = 1 + n - dup;
+    if (__builtin_expect( x > v->bufsz, 0)) { /* not enough space */
+        *(gid_t *)v->vstruct = (gid_t)x;
+        *v->errnop = errno = ERANGE;
+        return NSS_STATUS_TRYAGAIN;
+    }
+    gidlist[0] = gid;
+    if (sizeof(gid_t) == sizeof(uint32_t)) {
+        memcpy(gidlist+1, dptr, (size_t)lo << 2);
+        memcpy(gidlist+1+lo, dptr+((lo+dup)<<2), (size_t)(n-lo-dup) << 2);
+    }
+    else {
+        for (hi = 0, x = 1; hi < n; ++hi) {
+            memcpy(&g, dptr+(hi<<2), sizeof(uint32_t));
+            if ((gid_t)g != gid)
+                gidlist[x++] = (gid_t)g;
+        }
+    }
+    *(gid_t *)v->vstruct = (gid_t)x;
+    return NSS_STATUS_SUCCESS;
+}
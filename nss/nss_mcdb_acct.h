@@ -62,11 +62,29 @@ enum {
   NSS_GR_HDRSZ   = 12   /*(must be multiple of 4)*/
 };
 
+/* group record: header, strings (NSS_GR_MEM is length of strings), followed by
+ * NSS_GR_MEM_NUM uint16_t offsets (network byte order) of gr_mem strings,
+ * relative to start of strings, so that decode is memcpy() of strings plus
+ * relocation of offsets into (char **) gr_mem.  (offsets are independent of
+ * pointer size, so same mcdb serves 32-bit and 64-bit processes)
+ * (offsets were added later; older records end at strings and are scanned) */
+
 enum {
   NSS_GL_NGROUPS =  0,
   NSS_GL_HDRSZ   =  4   /*(must be multiple of 4)*/
 };
 
+/* grouplist record (tag '^') is sorted array of unique gids in host byte order
+ * (copied into gid_t array as is) preceded by header in host byte order
+ * (byte order mark permits reading mcdb made on host of other byte order)
+ * (grouplist record (tag '~') of bigendian gids is read from older mcdb) */
+enum {
+  NSS_GV_NGROUPS =  0,
+  NSS_GV_BOM     =  4,
+  NSS_GV_HDRSZ   =  8   /*(must be multiple of 4)*/
+};
+#define NSS_GV_BOM_MARK 0x01020304u
+
 /* ngroups_max reasonable value used in sizing some data structures
  * (256) 4-byte or 4-char entries fills 1 KB and must fit in, e.g. struct group
  * On Linux _SC_GETPW_R_SIZE_MAX and _SC_GETGR_R_SIZE_MAX are 1 KB
@@ -32,7 +32,7 @@
 #include <errno.h>
 #include <limits.h>
 #include <string.h>
-#include <stdlib.h>     /* malloc() calloc() free() strtol() strtoul() */
+#include <stdlib.h>     /* malloc() calloc() realloc() free() qsort() strtol()*/
 #include <arpa/inet.h>  /* htonl(), htons() */
 #include <unistd.h>     /* sysconf(), _SC_NGROUPS_MAX _SC_GETGR_R_SIZE_MAX */
 
@@ -56,6 +56,8 @@ PLASMA_ATTR_Pragma_no_side_effect(strlen)
 /*
  * initgroups() and getgrouplist() support
  * (keep hash map of group memberships per member)
+ * (hash map is resized to keep chains short with many members; gidlist of
+ *  each member is grown by doubling, then sorted and made unique in flush)
  */
 
 struct nss_mcdb_acct_make_groupmem {
@@ -65,20 +67,28 @@ struct nss_mcdb_acct_make_groupmem {
   uint32_t hash;
   uint32_t ngids;
   uint32_t gidlist_sz;
-  gid_t gidlist[];  /* C99 VLA */
+  gid_t * restrict gidlist;
 };
 
-enum { nss_mcdb_acct_make_groupmem_hashmap_sz = 2048 }; /* must be power of 2 */
+enum { nss_mcdb_acct_make_groupmem_hashmap_init = 2048 };/*must be power of 2*/
 
 static struct nss_mcdb_acct_make_groupmem ** restrict
   nss_mcdb_acct_make_groupmem_hashmap = NULL;
 
+static size_t nss_mcdb_acct_make_groupmem_hashmap_sz = 0;
+static size_t nss_mcdb_acct_make_groupmem_count = 0;
+
 static struct nss_mcdb_acct_make_groupmem *
   nss_mcdb_acct_make_groupmem_pool = NULL;
 
 static char *
   nss_mcdb_acct_make_groupmem_strpool = NULL;
 
+static size_t nss_mcdb_acct_make_groupmem_pool_sz     = 0;
+static size_t nss_mcdb_acct_make_groupmem_pool_idx    = 0;
+static size_t nss_mcdb_acct_make_groupmem_strpool_sz  = 0;
+static size_t nss_mcdb_acct_make_groupmem_strpool_idx = 0;
+
 
 __attribute_noinline__
 static bool
@@ -111,27 +121,22 @@ nss_mcdb_acct_make_groupmem_pool_alloc(const size_t sz,
 }
 
 static struct nss_mcdb_acct_make_groupmem *
-nss_mcdb_acct_make_groupmem_alloc(const size_t sz)
+nss_mcdb_acct_make_groupmem_alloc(void)
 {
-    static size_t pool_sz  = 0;
-    static size_t pool_idx = 0;
-
-    /* caller should request aligned size; no need to realign here */
-  #if defined(_LP64) || defined(__LP64__)
-    /* assert(0 == (sz & 7)); */
-  #else
-    /* assert(0 == (sz & 3)); */
-  #endif
+    /* (sizeof struct is multiple of pointer size; no need to realign here) */
+    const size_t sz = sizeof(struct nss_mcdb_acct_make_groupmem);
+    size_t * const restrict pool_sz  = &nss_mcdb_acct_make_groupmem_pool_sz;
+    size_t * const restrict pool_idx = &nss_mcdb_acct_make_groupmem_pool_idx;
 
-    if ((sz <= pool_sz && pool_idx <= pool_sz - sz)
+    if ((sz <= *pool_sz && *pool_idx <= *pool_sz - sz)
         || nss_mcdb_acct_make_groupmem_pool_alloc(
-             sz, &pool_sz, &pool_idx,
+             sz, pool_sz, pool_idx,
              &nss_mcdb_acct_make_groupmem_pool)) {
 
         struct nss_mcdb_acct_make_groupmem * const restrict groupmem =
           (struct nss_mcdb_acct_make_groupmem *)
-          (((char *)nss_mcdb_acct_make_groupmem_pool) + pool_idx);
-        pool_idx += sz;
+          (((char *)nss_mcdb_acct_make_groupmem_pool) + *pool_idx);
+        *pool_idx += sz;
         return groupmem;
     }
 
@@ -141,17 +146,19 @@ nss_mcdb_acct_make_groupmem_alloc(const size_t sz)
 static char *
 nss_mcdb_acct_make_groupmem_stralloc(const size_t sz)
 {
-    static size_t strpool_sz  = 0;
-    static size_t strpool_idx = 0;
+    size_t * const restrict strpool_sz  =
+      &nss_mcdb_acct_make_groupmem_strpool_sz;
+    size_t * const restrict strpool_idx =
+      &nss_mcdb_acct_make_groupmem_strpool_idx;
 
-    if ((sz <= strpool_sz && strpool_idx <= strpool_sz - sz)
+    if ((sz <= *strpool_sz && *strpool_idx <= *strpool_sz - sz)
         || (nss_mcdb_acct_make_groupmem_pool_alloc(
-              sz, &strpool_sz, &strpool_idx,
+              sz, strpool_sz, strpool_idx,
               &nss_mcdb_acct_make_groupmem_strpool))) {
 
         char * const restrict str =
-          nss_mcdb_acct_make_groupmem_strpool + strpool_idx;
-        strpool_idx += sz;
+          nss_mcdb_acct_make_groupmem_strpool + *strpool_idx;
+        *strpool_idx += sz;
         return str;
     }
 
@@ -164,21 +171,67 @@ nss_mcdb_acct_make_grouplist_free(const bool rc)
 {
     uintptr_t * restrict mem;
     uintptr_t *next;
+    struct nss_mcdb_acct_make_groupmem * restrict groupmem;
 
+    for (size_t i = 0; i < nss_mcdb_acct_make_groupmem_hashmap_sz; ++i) {
+        for (groupmem = nss_mcdb_acct_make_groupmem_hashmap[i];
+             groupmem;
+             groupmem = groupmem->next)
+            free(groupmem->gidlist);
+    }
     free(nss_mcdb_acct_make_groupmem_hashmap);
     nss_mcdb_acct_make_groupmem_hashmap = NULL;
+    nss_mcdb_acct_make_groupmem_hashmap_sz = 0;
+    nss_mcdb_acct_make_groupmem_count = 0;
 
     next = (uintptr_t *)nss_mcdb_acct_make_groupmem_pool;
     nss_mcdb_acct_make_groupmem_pool = NULL;
+    nss_mcdb_acct_make_groupmem_pool_sz  = 0;
+    nss_mcdb_acct_make_groupmem_pool_idx = 0;
     while ((mem = next)) { next = (uintptr_t *)*mem; free(mem); }
 
     next = (uintptr_t *)nss_mcdb_acct_make_groupmem_strpool;
     nss_mcdb_acct_make_groupmem_strpool = NULL;
+    nss_mcdb_acct_make_groupmem_strpool_sz  = 0;
+    nss_mcdb_acct_make_groupmem_strpool_idx = 0;
     while ((mem = next)) { next = (uintptr_t *)*mem; free(mem); }
 
     return rc;
 }
 
+/* double size of hash map, moving members into new buckets */
+__attribute_noinline__
+static bool
+nss_mcdb_acct_make_groupmem_hashmap_grow(void)
+{
+    struct nss_mcdb_acct_make_groupmem * restrict groupmem;
+    struct nss_mcdb_acct_make_groupmem * restrict next;
+    const size_t osz = nss_mcdb_acct_make_groupmem_hashmap_sz;
+    const size_t nsz = (osz != 0)
+      ? osz << 1
+      : nss_mcdb_acct_make_groupmem_hashmap_init;
+    struct nss_mcdb_acct_make_groupmem ** const restrict hashmap =
+      (struct nss_mcdb_acct_make_groupmem **)
+      calloc(nsz, sizeof(struct nss_mcdb_acct_make_groupmem *));
+    if (__builtin_expect( hashmap == NULL, 0))
+        return false;
+
+    for (size_t i = 0; i < osz; ++i) {
+        for (groupmem = nss_mcdb_acct_make_groupmem_hashmap[i];
+             groupmem;
+             groupmem = next) {
+            next = groupmem->next;
+            groupmem->next = hashmap[groupmem->hash & (nsz-1)];
+            hashmap[groupmem->hash & (nsz-1)] = groupmem;
+        }
+    }
+
+    free(nss_mcdb_acct_make_groupmem_hashmap);
+    nss_mcdb_acct_make_groupmem_hashmap = hashmap;
+    nss_mcdb_acct_make_groupmem_hashmap_sz = nsz;
+    return true;
+}
+
 /* copy data and insert into simple hash map */
 static bool
 nss_mcdb_acct_make_grouplist_add(const char * const restrict name,
@@ -189,12 +242,10 @@ nss_mcdb_acct_make_grouplist_add(const char * const restrict name,
     const size_t namelen = strlen(name);
     const uint32_t hash = uint32_hash_djb(UINT32_HASH_DJB_INIT, name, namelen);
 
-    if (__builtin_expect( nss_mcdb_acct_make_groupmem_hashmap == NULL, 0)) {
-        nss_mcdb_acct_make_groupmem_hashmap =
-          (struct nss_mcdb_acct_make_groupmem **)
-          calloc(nss_mcdb_acct_make_groupmem_hashmap_sz,
-                 sizeof(struct nss_mcdb_acct_make_groupmem_hashmap *));
-        if (__builtin_expect( nss_mcdb_acct_make_groupmem_hashmap == NULL, 0))
+    /* (grow hash map when members outnumber buckets) */
+    if (__builtin_expect( nss_mcdb_acct_make_groupmem_count
+                          >= nss_mcdb_acct_make_groupmem_hashmap_sz, 0)) {
+        if (!nss_mcdb_acct_make_groupmem_hashmap_grow())
             return nss_mcdb_acct_make_grouplist_free(false);
     }
 
@@ -209,15 +260,15 @@ nss_mcdb_acct_make_grouplist_add(const char * const restrict name,
     }
 
     if (groupmem == NULL) {
-        /* allocate gidlist in multiples of 4 
-         * (for array align of 4-bytes in 32-bit and 8-bytes in 64-bit) */
-        groupmem = nss_mcdb_acct_make_groupmem_alloc(
-          sizeof(struct nss_mcdb_acct_make_groupmem) + (sizeof(gid_t) * 4));
+        groupmem = nss_mcdb_acct_make_groupmem_alloc();
         if (__builtin_expect( groupmem == NULL, 0))
             return nss_mcdb_acct_make_grouplist_free(false);
         groupmem->name = nss_mcdb_acct_make_groupmem_stralloc(namelen+1);
         if (__builtin_expect( groupmem->name == NULL, 0))
             return nss_mcdb_acct_make_grouplist_free(false);
+        groupmem->gidlist = (gid_t *)malloc(sizeof(gid_t) * 4);
+        if (__builtin_expect( groupmem->gidlist == NULL, 0))
+            return nss_mcdb_acct_make_grouplist_free(false);
         memcpy(groupmem->name, name, namelen+1);
         groupmem->namelen    = (uint32_t)namelen;
         groupmem->hash       = hash;
@@ -225,18 +276,16 @@ nss_mcdb_acct_make_grouplist_add(const char * const restrict name,
         groupmem->gidlist_sz = 4;   /* initial gidlist allocation above */
         groupmem->next       = *hashmap_bucket;
         *hashmap_bucket      = groupmem;
+        ++nss_mcdb_acct_make_groupmem_count;
     }
     else if (groupmem->ngids == groupmem->gidlist_sz) {
-        /* allocate gidlist in multiples of 4 
-         * (for array align of 4-bytes in 32-bit and 8-bytes in 64-bit) */
-        const size_t groupmem_sz = sizeof(struct nss_mcdb_acct_make_groupmem)
-                                 + sizeof(gid_t) * groupmem->gidlist_sz;
-        struct nss_mcdb_acct_make_groupmem * const restrict groupmem_new =
-          nss_mcdb_acct_make_groupmem_alloc(groupmem_sz + (sizeof(gid_t) * 32));
-        if (__builtin_expect( groupmem_new == NULL, 0))
+        /* (limit checked in nss_mcdb_acct_make_group_flush()) */
+        gid_t * const restrict gidlist = (gid_t *)
+          realloc(groupmem->gidlist, sizeof(gid_t) * groupmem->gidlist_sz * 2);
+        if (__builtin_expect( gidlist == NULL, 0))
             return nss_mcdb_acct_make_grouplist_free(false);
-        groupmem = memcpy(groupmem_new, groupmem, groupmem_sz);
-        groupmem->gidlist_sz += 32; /* incremental gidlist allocation above */
+        groupmem->gidlist = gidlist;
+        groupmem->gidlist_sz <<= 1;
     }
 
     groupmem->gidlist[groupmem->ngids++] = gid;
@@ -244,64 +293,86 @@ nss_mcdb_acct_make_grouplist_add(const char * const restrict name,
     return true;
 }
 
-static size_t
-nss_mcdb_acct_make_grouplist_datastr(char * restrict buf, const size_t bufsz,
-                                     const struct nss_mcdb_acct_make_groupmem *
-                                       const restrict groupmem)
+static int
+nss_mcdb_acct_make_gid_cmp(const void * const a, const void * const b)
 {
-    /* nss_mcdb_acct_make_group_flush() validates sane number of gids (ngids) */
-    const gid_t * const gidlist = groupmem->gidlist;
-    const uint32_t ngids = groupmem->ngids; /*4-char encoding per gid (below)*/
-    const size_t sz = NSS_GL_HDRSZ + ((size_t)ngids << 2);
-    union { uint32_t u[NSS_GL_HDRSZ>>2]; uint16_t h[NSS_GL_HDRSZ>>1]; } hdr;
-    union { uint32_t u; char c[4]; } g;
-    hdr.u[NSS_GL_NGROUPS>>2] = htonl(ngids);
-    if (sz <= bufsz) {
-	memcpy(buf, hdr.u, NSS_GL_HDRSZ);
-	buf += NSS_GL_HDRSZ;
-	for (uint32_t i = 0; i < ngids; ++i, buf+=4) {
-	    g.u = htonl((uint32_t)gidlist[i]);
-	    buf[0] = g.c[0]; buf[1] = g.c[1]; buf[2] = g.c[2]; buf[3] = g.c[3];
-	}
-	return sz;
+    const gid_t x = *(const gid_t *)a;
+    const gid_t y = *(const gid_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* write grouplist record of groupmem (see NSS_GV_* in nss_mcdb_acct.h)
+ * (gidlist is sorted and made unique in place; duplicates are harmless, but
+ *  more than ngids_max unique gids is an error)
+ * (gidlist is written directly into mcdb instead of copying into w->data) */
+static bool
+nss_mcdb_acct_make_grouplist_write(struct nss_mcdb_make_winfo *
+                                     const restrict w,
+                                   struct nss_mcdb_acct_make_groupmem *
+                                     const restrict groupmem,
+                                   const uint32_t ngids_max)
+{
+    gid_t * const restrict gidlist = groupmem->gidlist;
+    uint32_t n = groupmem->ngids;
+    uint32_t hdr[NSS_GV_HDRSZ>>2];
+    struct mcdb_make * const restrict m = w->wbuf.m;
+
+    if (n > 1) {
+        uint32_t i, j;
+        qsort(gidlist, n, sizeof(gid_t), nss_mcdb_acct_make_gid_cmp);
+        for (i = 1, j = 1; i < n; ++i) {
+            if (gidlist[i] != gidlist[j-1])
+                gidlist[j++] = gidlist[i];
+        }
+        n = j;
     }
+    if (__builtin_expect( n > ngids_max, 0))
+        return false;
+    hdr[NSS_GV_NGROUPS>>2] = n;
+    hdr[NSS_GV_BOM>>2]     = NSS_GV_BOM_MARK;
+
+    if (mcdb_make_addbegin_h(m, groupmem->namelen+1,
+                             NSS_GV_HDRSZ + ((size_t)n << 2)) != 0)
+        return false;
+    mcdb_make_addbuf_key_h(m, &w->tagc, 1);
+    mcdb_make_addbuf_key_h(m, groupmem->name, groupmem->namelen);
+    mcdb_make_addbuf_data_h(m, (char *)hdr, NSS_GV_HDRSZ);
+    if (sizeof(gid_t) == sizeof(uint32_t))
+        mcdb_make_addbuf_data_h(m, (char *)gidlist, (size_t)n << 2);
     else {
-	errno = ERANGE;
-	return 0;
+        for (uint32_t i = 0; i < n; ++i) {
+            const uint32_t g = (uint32_t)gidlist[i];
+            mcdb_make_addbuf_data_h(m, (const char *)&g, sizeof(uint32_t));
+        }
     }
+    mcdb_make_addend_h(m);
+    return true;
 }
 
 bool
 nss_mcdb_acct_make_group_flush(struct nss_mcdb_make_winfo * const restrict w)
 {
-    const struct nss_mcdb_acct_make_groupmem * restrict groupmem;
-    int i = 0;
-    /* arbitrary limit: NSS_MCDB_NGROUPS_MAX in nss_mcdb_acct.h */
+    struct nss_mcdb_acct_make_groupmem * restrict groupmem;
+    size_t i = 0;
+    /* limit: supplemental groups permitted by system (_SC_NGROUPS_MAX), else
+     * NSS_MCDB_NGROUPS_MAX in nss_mcdb_acct.h */
     /*(permit max ngids supplemental groups to validate input)*/
     const long sc_ngroups_max = sysconf(_SC_NGROUPS_MAX);
-    const unsigned int ngids =
-      (0 < sc_ngroups_max && sc_ngroups_max < NSS_MCDB_NGROUPS_MAX)
-        ? (unsigned int)sc_ngroups_max
-        : NSS_MCDB_NGROUPS_MAX;
+    const unsigned int ngids = (0 < sc_ngroups_max && sc_ngroups_max < INT_MAX)
+      ? (unsigned int)sc_ngroups_max
+      : NSS_MCDB_NGROUPS_MAX;
 
-    w->tagc = '~';
+    w->tagc = '^';
 
-    do {
+    for (; i < nss_mcdb_acct_make_groupmem_hashmap_sz; ++i) {
         for (groupmem = nss_mcdb_acct_make_groupmem_hashmap[i];
              groupmem;
              groupmem = groupmem->next) {
-            if (__builtin_expect( groupmem->ngids > ngids, 0))
-                return nss_mcdb_acct_make_grouplist_free(false);
-            w->klen = groupmem->namelen;
-            w->key  = groupmem->name;
-            w->dlen =
-              nss_mcdb_acct_make_grouplist_datastr(w->data,w->datasz,groupmem);
-            if (__builtin_expect( w->dlen == 0, 0))
-                return nss_mcdb_acct_make_grouplist_free(false);
-            if (__builtin_expect( !nss_mcdb_make_mcdbctl_write(w), 0))
+            if (__builtin_expect(
+                  !nss_mcdb_acct_make_grouplist_write(w, groupmem, ngids), 0))
                 return nss_mcdb_acct_make_grouplist_free(false);
         }
-    } while (++i < nss_mcdb_acct_make_groupmem_hashmap_sz);
+    }
 
     return nss_mcdb_acct_make_grouplist_free(true);
 }
@@ -419,18 +490,28 @@ nss_mcdb_acct_make_group_datastr(char * restrict buf, const size_t bufsz,
 	} /* check for gr_mem[gr_mem_num] == NULL for sufficient buf space */
 	if (   __builtin_expect(gr_mem_num <= USHRT_MAX, 1)
 	    && __builtin_expect(gr_mem[gr_mem_num] == NULL,  1)
-	    && __builtin_expect((gr_mem_num<<3)+8u+7u <= bufsz-dlen, 1)) {
-	    /* verify space in string for 8-aligned char ** gr_mem array + NULL
+	    && __builtin_expect((gr_mem_num<<1)+(gr_mem_num<<3)+8u+7u
+				  <= bufsz-dlen, 1)) {
+	    /* verify space in string for gr_mem offsets, and verify space for
+	     * 8-aligned char ** gr_mem array + NULL
 	     * (not strictly necessary, but best to catch excessively long
 	     *  entries at mcdb create time rather than in query at runtime) */
 
 	    /* store string offsets into aligned header, then copy into buf */
 	    /* copy strings into buffer, including string terminating '\0' */
+	    /* append offset of each gr_mem string (relative to gr_name) so that
+	     * decode need not scan strings (NSS_GR_MEM is end of strings) */
+	    size_t offset = gr_mem_str_offset;
 	    hdr.h[NSS_GR_MEM>>1]     = htons((uint16_t) (dlen-NSS_GR_HDRSZ));
 	    hdr.h[NSS_GR_PASSWD>>1]  = htons((uint16_t) gr_passwd_offset);
 	    hdr.h[NSS_GR_MEM_STR>>1] = htons((uint16_t) gr_mem_str_offset);
 	    hdr.h[NSS_GR_MEM_NUM>>1] = htons((uint16_t) gr_mem_num);
 	    hdr.u[NSS_GR_GID>>2]     = htonl((uint32_t) gr->gr_gid);
+	    for (size_t i = 0; i < gr_mem_num; ++i, dlen += 2) {
+		const uint16_t o = htons((uint16_t) offset);
+		memcpy(buf+dlen, &o, 2);
+		offset += 1 + strlen(gr_mem[i]);
+	    }
 	    memcpy(buf,                  hdr.u,         NSS_GR_HDRSZ);
 	    memcpy((buf+=NSS_GR_HDRSZ),  gr->gr_name,   gr_name_len);
 	    memcpy(buf+gr_passwd_offset, gr->gr_passwd, gr_passwd_len);
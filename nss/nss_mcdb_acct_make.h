@@ -55,6 +55,8 @@ nss_mcdb_acct_make_group_datastr(char * restrict, const size_t,
  * used in sizing some data structures.  /etc/group with many members may exceed
  * the limit imposed here, but should be plenty for average standalone systems.
  * Recompile with #define value in header set to a large size, if needed.
+ * (The grouplist of each member (initgroups(), getgrouplist()) is limited by
+ *  sysconf(_SC_NGROUPS_MAX) rather than by NSS_MCDB_NGROUPS_MAX)
  *
  * nss_mcdb_acct*.[ch] code expects 1:1 mapping between uid/user and gid/group.
  * Validate file-based databases (e.g. /etc/passwd and /etc/group) after the
@@ -90,7 +92,8 @@ nss_mcdb_acct_make_group_datastr(char * restrict, const size_t,
  * /etc/group.  If this is done, take care to ensure that nothing other than the
  * preprocessor modifies /etc/group, and that the resultant /etc/group not have
  * undesirable duplication, excessively long lines, or excessive number of group
- * members (that exceeds NSS_MCDB_NGROUPS_MAX).
+ * members (that exceeds NSS_MCDB_NGROUPS_MAX), or users that are members of
+ * more groups than sysconf(_SC_NGROUPS_MAX).
  *
  * Aside: user membership of many groups while using NFSv2,NFSv3 is not portable
  * past 16 groups on modern unix systems.  This is due to a limitation in the
@@ -29,12 +29,17 @@
 #define PLASMA_FEATURE_ENABLE_LARGEFILE
 
 #include "nss_mcdb_make.h"
+#include "nss_mcdb.h"      /* NSS_TD_* */
 #include "../nointr.h"
+#include "../uint32.h"
+#include "../plasma/plasma_atomic.h"
 #include "../plasma/plasma_stdtypes.h" /* SIZE_MAX */
 
 #include <sys/stat.h>
 #include <sys/mman.h> /* mmap() munmap() */
 #include <fcntl.h>    /* open() */
+#include <stdio.h>    /* fdopen() fread() fwrite() fclose() */
+#include <stdlib.h>   /* mkstemp() malloc() free() */
 #include <string.h>   /* memcpy() strcmp() strncmp() strrchr() */
 #include <unistd.h>   /* fstat() close() */
 #include <errno.h>
@@ -52,8 +57,11 @@ nss_mcdb_nsswitch(const char * restrict svc,
                   char * const restrict data,
                   const size_t datasz)
 {
-    static void * restrict nsswitch = MAP_FAILED;
-    if (nsswitch == MAP_FAILED) {/*mmap /etc/nsswitch.conf and keep mmap open*/
+    static void *nsswitch = MAP_FAILED;
+    /* (databases might be made concurrently in separate threads;
+     *  first mmap to be published is kept and others are unmapped) */
+    void *ns = plasma_atomic_load_explicit(&nsswitch, memory_order_acquire);
+    if (ns == MAP_FAILED) {  /*mmap /etc/nsswitch.conf and keep mmap open*/
         struct stat st;
         const int fd =
           nointr_open(NSSWITCH_CONF_PATH, O_RDONLY|O_NONBLOCK|O_CLOEXEC, 0);
@@ -64,8 +72,14 @@ nss_mcdb_nsswitch(const char * restrict svc,
                     errno = EFBIG; /* nsswitch.conf >= 4 GB; highly unlikely */
                 else
               #endif
-                    nsswitch = mmap(NULL, (size_t)st.st_size,
-                                    PROT_READ, MAP_SHARED, fd, 0);
+                    ns = mmap(NULL, (size_t)st.st_size,
+                              PROT_READ, MAP_SHARED, fd, 0);
+                if (ns != MAP_FAILED
+                    && !plasma_atomic_CAS_ptr(&nsswitch, MAP_FAILED, ns)) {
+                    munmap(ns, (size_t)st.st_size);
+                    ns = plasma_atomic_load_explicit(&nsswitch,
+                                                     memory_order_acquire);
+                }
             }
             (void) nointr_close(fd);
         }
@@ -73,10 +87,10 @@ nss_mcdb_nsswitch(const char * restrict svc,
             return false;   /* failed to open /etc/nsswitch.conf that exists */
     }
 
-    if (nsswitch != MAP_FAILED) { /* search /etc/nsswitch.conf for svc entry */
+    if (ns != MAP_FAILED) { /* search /etc/nsswitch.conf for svc entry */
         const char * restrict p = strrchr(svc, '/');
         const size_t svclen = strlen((p != NULL) ? (svc = p+1) : svc);
-        for (p = (char *)nsswitch; *p != '\0'; ++p) {
+        for (p = (char *)ns; *p != '\0'; ++p) {
             while (*p == ' ' || *p == '\t') ++p;
             if (*p == *svc && 0 == strncmp(p, svc, svclen)) {
                 p += svclen;
@@ -124,6 +138,129 @@ nss_mcdb_nsswitch(const char * restrict svc,
     return true;
 }
 
+/* open unlinked scratch file next to mcdb temp output file (else in /tmp) */
+static FILE *
+nss_mcdb_make_scratch(const struct mcdb_make * const restrict m)
+{
+    const char * const pfx = (m->fntmp != NULL) ? m->fntmp : "/tmp/.nss_mcdb";
+    const size_t len = strlen(pfx);
+    char * const restrict fntmp = malloc(len + sizeof(".XXXXXX"));
+    FILE *fp = NULL;
+    int fd, errsave;
+    if (fntmp == NULL)
+        return NULL;
+    memcpy(fntmp, pfx, len);
+    memcpy(fntmp+len, ".XXXXXX", sizeof(".XXXXXX"));
+    if ((fd = mkstemp(fntmp)) != -1) {
+        unlink(fntmp);
+        if ((fp = fdopen(fd, "w+")) == NULL) {
+            errsave = errno;
+            (void) nointr_close(fd);
+            errno = errsave;
+        }
+    }
+    free(fntmp);
+    return fp;
+}
+
+/* close scratch files of held records */
+static void
+nss_mcdb_make_spill_close(struct nss_mcdb_make_winfo * const restrict w)
+{
+    for (unsigned int t = 0; t < 256; ++t) {
+        if (w->spill[t] != NULL) {
+            fclose(w->spill[t]);
+            w->spill[t] = NULL;
+        }
+    }
+}
+
+/* hold record of tag other than '=' until after all '=' records are written
+ * (records are appended to scratch file of tag; memory use is not O(db size))
+ * (spill record: klen and dlen (host byte order), key, data) */
+static bool
+nss_mcdb_make_spill(struct nss_mcdb_make_winfo * const restrict w)
+{
+    FILE ** const restrict fp = &w->spill[(unsigned char)w->tagc];
+    const uint32_t kd[2] = { (uint32_t)w->klen, (uint32_t)w->dlen };
+    if (*fp == NULL && (*fp = nss_mcdb_make_scratch(w->wbuf.m)) == NULL)
+        return false;
+    return fwrite(kd, sizeof(kd), 1, *fp) == 1
+        && fwrite(w->key,  1, w->klen, *fp) == w->klen
+        && fwrite(w->data, 1, w->dlen, *fp) == w->dlen;
+}
+
+/* add entry to tag directory (see NSS_TD_* in nss_mcdb.h) */
+static void
+nss_mcdb_make_tagdir_add(char * const restrict td, size_t * const restrict n,
+                         const unsigned char tagc,
+                         const uint64_t begin, const uint64_t end)
+{
+    char * const restrict p = td + (*n)++ * NSS_TD_ENTSZ;
+    uint32_strpack_bigendian_macro(p+NSS_TD_TAG,   (uint32_t)tagc);
+    uint32_strpack_bigendian_macro(p+NSS_TD_BEGIN,   (uint32_t)(begin >> 32));
+    uint32_strpack_bigendian_macro(p+NSS_TD_BEGIN+4, (uint32_t)begin);
+    uint32_strpack_bigendian_macro(p+NSS_TD_END,     (uint32_t)(end >> 32));
+    uint32_strpack_bigendian_macro(p+NSS_TD_END+4,   (uint32_t)end);
+}
+
+/* copy len bytes of held record from scratch file into mcdb record */
+static bool
+nss_mcdb_make_spill_copy(struct mcdb_make * const restrict m,
+                         FILE * const restrict fp, size_t len,
+                         void (* const addbuf)(struct mcdb_make * restrict,
+                                               const char * restrict, size_t))
+{
+    char buf[4096];
+    size_t n;
+    for (; len != 0; len -= n) {
+        n = (len < sizeof(buf)) ? len : sizeof(buf);
+        if (fread(buf, 1, n, fp) != n) {
+            if (!ferror(fp))
+                errno = EIO; /* truncated scratch file */
+            return false;
+        }
+        addbuf(m, buf, n);
+    }
+    return true;
+}
+
+/* write held records, contiguous by tag, adding each tag to tag directory
+ * (stream each tag scratch file into mcdb and then close it) */
+static bool
+nss_mcdb_make_spill_write(struct nss_mcdb_make_winfo * const restrict w,
+                          char * const restrict td, size_t * const restrict n)
+{
+    struct mcdb_make * const restrict m = w->wbuf.m;
+    uint32_t kd[2];   /*(klen, dlen)*/
+    for (unsigned int t = 0; t < 256; ++t) {
+        FILE * const restrict fp = w->spill[t];
+        const uint64_t begin = m->pos;
+        const char tagc = (char)t;
+        if (fp == NULL)
+            continue;
+        if (fflush(fp) != 0 || fseeko(fp, 0, SEEK_SET) != 0)
+            return false;
+        while (fread(kd, sizeof(kd), 1, fp) == 1) {
+            if (mcdb_make_addbegin_h(m, (size_t)kd[0]+1, kd[1]) != 0)
+                return false;
+            mcdb_make_addbuf_key_h(m, &tagc, 1);
+            if (!nss_mcdb_make_spill_copy(m, fp, kd[0],
+                                          mcdb_make_addbuf_key_h)
+                || !nss_mcdb_make_spill_copy(m, fp, kd[1],
+                                             mcdb_make_addbuf_data_h))
+                return false;
+            mcdb_make_addend_h(m);
+        }
+        if (ferror(fp))
+            return false;
+        fclose(fp);
+        w->spill[t] = NULL;
+        nss_mcdb_make_tagdir_add(td, n, (unsigned char)t, begin, m->pos);
+    }
+    return true;
+}
+
 /*
  * mechanism to create mcdb directly and mechanism to output mcdbctl make input
  * (allows for testing translation in and out)
@@ -134,6 +271,10 @@ nss_mcdb_make_mcdbctl_write(struct nss_mcdb_make_winfo * const restrict w)
     /* write data record into mcdb if struct mcdb_make * is provided */
     struct nss_mcdb_make_wbuf * const restrict wbuf = &w->wbuf;
     struct mcdb_make * const restrict m = wbuf->m;
+    /* records enumerated by get*ent() ('=') are written contiguously;
+     * records of other tags are held and written after (except nsswitch) */
+    if (w->tagc != '=' && w->tagc != '\0')
+        return nss_mcdb_make_spill(w);
     if (mcdb_make_addbegin_h(m, w->klen+1, w->dlen) == 0) {
         mcdb_make_addbuf_key_h(m, &w->tagc, 1);
         mcdb_make_addbuf_key_h(m, w->key, w->klen);
@@ -162,6 +303,10 @@ nss_mcdb_make_dbfile( struct nss_mcdb_make_winfo * const restrict w,
     off_t  fsize = 0;
     time_t mtime;
     bool rc = false;
+    uint64_t begin;
+    size_t ntd;
+    char td[NSS_TD_ENTSZ * (256+2)];  /* tag directory */
+    const char tdtag = NSS_TD_TAGC;
 
     /* make db from input.  attempt to detect if input changes during parse.
      * note: still a race condition if file was modified same second that
@@ -199,6 +344,8 @@ nss_mcdb_make_dbfile( struct nss_mcdb_make_winfo * const restrict w,
 
         /* generate mcdb make info */
         wbuf->offset = 0;
+        nss_mcdb_make_spill_close(w);
+        ntd = 0;
         if (mcdb_make_start(m, m->fd, m->fn_malloc, m->fn_free) != 0)
             break;
 
@@ -217,9 +364,29 @@ nss_mcdb_make_dbfile( struct nss_mcdb_make_winfo * const restrict w,
         if (!nss_mcdb_make_mcdbctl_write(w))
             break;
 
-        rc = parse_mmap(w,map) && (w->flush == NULL || w->flush(w));/*callback*/
+        begin = m->pos;
+        rc = parse_mmap(w,map);
+        if (!rc)
+            break;
+        nss_mcdb_make_tagdir_add(td, &ntd, '=', begin, m->pos);
+        begin = m->pos;
+        rc = (w->flush == NULL || w->flush(w));/*callback*/
+        if (!rc)
+            break;
+        /* (hosts and networks flush write 'a' and 'l' records directly with
+         *  mcdb_make_add*(); group flush records are held by tag, as above) */
+        if (begin != m->pos)
+            nss_mcdb_make_tagdir_add(td, &ntd, (unsigned char)w->tagc,
+                                     begin, m->pos);
+
+        /* write held records by tag, and then tag directory */
+        rc = nss_mcdb_make_spill_write(w, td, &ntd)
+          && mcdb_make_addbegin_h(m, 1, ntd * NSS_TD_ENTSZ) == 0;
         if (!rc)
             break;
+        mcdb_make_addbuf_key_h(m, &tdtag, 1);
+        mcdb_make_addbuf_data_h(m, td, ntd * NSS_TD_ENTSZ);
+        mcdb_make_addend_h(m);
 
         /* finish writing mcdb make output file */
         rc = (mcdb_make_finish(m) == 0);
@@ -235,6 +402,7 @@ nss_mcdb_make_dbfile( struct nss_mcdb_make_winfo * const restrict w,
     mcdb_make_destroy(m);
 
     errsave = errno;
+    nss_mcdb_make_spill_close(w);
     if (map != MAP_FAILED)
         munmap(map, (size_t)st.st_size);
     if (fd != -1) {
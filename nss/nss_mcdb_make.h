@@ -28,6 +28,8 @@
 #include "../mcdb_make.h"
 PLASMA_ATTR_Pragma_once
 
+#include <stdio.h>  /* FILE */
+
 struct nss_mcdb_make_wbuf {
   struct mcdb_make * restrict m;
   char * const restrict buf;
@@ -46,12 +48,17 @@ struct nss_mcdb_make_winfo {
   const char * restrict key;
   size_t klen;
   char tagc;
+  FILE *spill[256];  /* scratch files (by tag) of records held until after
+                      * '=' records written */
 };
 
 
 /*
  * Note: mcdb *_make_* routines are not thread-safe
  * (no need for thread-safety; mcdb is typically created from a single stream)
+ * Different databases may be made concurrently, each with its own winfo
+ * (nss_mcdbctl), but a single database must not (e.g. group keeps grouplist
+ *  state in nss_mcdb_acct_make.c)
  */
 
 
@@ -206,7 +206,8 @@ nss_mcdb_misc_aliasent_decode(struct mcdb * const restrict m,
     ae->alias_local       = (int)ntohl( hdr.u[NSS_AE_LOCAL>>2] );
     ae->alias_members_len = ae_mem_num =(size_t)ntohs(hdr.h[NSS_AE_MEM_NUM>>1]);
     ae->alias_members     = /* align to 8-byte boundary for 64-bit */
-      (char **)(((uintptr_t)(buf+ntohs(hdr.h[NSS_AE_MEM>>1])+0x7u)) & ~0x7u);
+      (char **)(((uintptr_t)(buf+ntohs(hdr.h[NSS_AE_MEM>>1])+0x7u))
+                & ~(uintptr_t)0x7u);
     /* fill buf, (char **) ae_mem (allow 8-byte ptrs), and terminate strings.
      * scan for '\0' instead of precalculating array because names should
      * be short and adding an extra 4 chars per name to store size takes
@@ -35,6 +35,8 @@
 #include "nss_mcdb_netdb.h"
 #include "nss_mcdb.h"
 
+#include "../uint32.h"
+
 #include <errno.h>
 #include <string.h>
 
@@ -119,6 +121,37 @@ nss_mcdb_netdb_servent_decode(struct mcdb * restrict,
                               const struct nss_mcdb_vinfo * restrict)
   __attribute_nonnull__  __attribute_warn_unused_result__;
 
+struct nss_mcdb_netdb_netlpm {
+  uint32_t addr;
+  uint32_t net;
+  bool indexed;
+};
+
+static nss_status_t
+nss_mcdb_netdb_netlpm_decode(struct mcdb * restrict,
+                             const struct nss_mcdb_vinfo * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+__attribute_noinline__
+static nss_status_t
+nss_mcdb_netdb_netlpm_probe(uint32_t,
+                            struct netent * restrict, char * restrict, size_t,
+                            int * restrict, int * restrict)
+  __attribute_cold__  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+#ifdef __GLIBC__
+static nss_status_t
+nss_mcdb_netdb_gaih_decode(struct mcdb * restrict,
+                           const struct nss_mcdb_vinfo * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
+__attribute_noinline__
+static nss_status_t
+nss_mcdb_netdb_gaih_hostent_decode(struct mcdb * restrict,
+                                   const struct nss_mcdb_vinfo * restrict)
+  __attribute_cold__  __attribute_nonnull__  __attribute_warn_unused_result__;
+#endif
+
 
 __attribute_noinline__
 static nss_status_t
@@ -246,6 +279,50 @@ _nss_mcdb_gethostbyaddr_r(const void * const restrict addr,
     return nss_mcdb_netdb_gethost_query((uint32_t)type, &v, h_errnop);
 }
 
+#ifdef __GLIBC__
+/* glibc getaddrinfo() queries all address families with single 'a' lookup
+ * (a gaih_addrtuple passed in *pat, if any, is used as first in chain; others
+ *  are allocated in buf.  Name is set on first tuple, as in glibc nss_files)*/
+nss_status_t
+_nss_mcdb_gethostbyname4_r(const char * const restrict name,
+                           struct gaih_addrtuple ** const restrict pat,
+                           char * const restrict buf, const size_t bufsz,
+                           int * const restrict errnop,
+                           int * const restrict h_errnop,
+                           int32_t * const restrict ttlp  __attribute_unused__)
+{
+    const struct nss_mcdb_vinfo v = { .decode  = nss_mcdb_netdb_gaih_decode,
+                                      .vstruct = pat,
+                                      .buf     = buf,
+                                      .bufsz   = bufsz,
+                                      .errnop  = errnop,
+                                      .key     = name,
+                                      .klen    = strlen(name),
+                                      .tagc    = (unsigned char)'a' };
+    nss_status_t status = nss_mcdb_get_generic(NSS_DBTYPE_HOSTS, &v);
+    if (status == NSS_STATUS_NOTFOUND) { /*(mcdb made by older nss_mcdbctl)*/
+        const struct nss_mcdb_vinfo vh = { .decode  =
+                                             nss_mcdb_netdb_gaih_hostent_decode,
+                                           .vstruct = v.vstruct,
+                                           .buf     = v.buf,
+                                           .bufsz   = v.bufsz,
+                                           .errnop  = v.errnop,
+                                           .key     = v.key,
+                                           .klen    = v.klen,
+                                           .tagc    = (unsigned char)'~' };
+        status = nss_mcdb_get_generic(NSS_DBTYPE_HOSTS, &vh);
+    }
+    if (status == NSS_STATUS_SUCCESS)
+        return NSS_STATUS_SUCCESS;
+    else if (status == NSS_STATUS_TRYAGAIN && *errnop == ERANGE) {
+        *h_errnop = NETDB_INTERNAL; /*(getaddrinfo() retries with larger buf)*/
+        return NSS_STATUS_TRYAGAIN;
+    }
+    else
+        return nss_mcdb_netdb_gethost_fill_h_errnop(status, h_errnop);
+}
+#endif
+
 
 #if 0  /* implemented, but not enabling by default; often used only with NIS+ */
 
@@ -362,6 +439,38 @@ _nss_mcdb_getnetbyaddr_r(const uint32_t net, const int type,
       : nss_mcdb_netdb_gethost_fill_h_errnop(status, h_errnop);
 }
 
+nss_status_t
+nss_mcdb_getnetbyaddr_lpm_r(const uint32_t addr, const int type,
+                            struct netent * const restrict netbuf,
+                            char * const restrict buf, const size_t bufsz,
+                            int * const restrict errnop,
+                            int * const restrict h_errnop)
+{
+    struct nss_mcdb_netdb_netlpm lpm = { addr, NSS_NL_NONE, false };
+    const struct nss_mcdb_vinfo v = { .decode  = nss_mcdb_netdb_netlpm_decode,
+                                      .vstruct = &lpm,
+                                      .buf     = buf,
+                                      .bufsz   = bufsz,
+                                      .errnop  = errnop,
+                                      .key     = "",
+                                      .klen    = 0,
+                                      .tagc    = (unsigned char)'l' };
+    nss_status_t status;
+    if (type != AF_INET)  /*(only AF_INET networks indexed; exact match)*/
+        return _nss_mcdb_getnetbyaddr_r(addr, type, netbuf,
+                                        buf, bufsz, errnop, h_errnop);
+    /* find network in index, then query network with exact match */
+    status = nss_mcdb_get_generic(NSS_DBTYPE_NETWORKS, &v);
+    if (status == NSS_STATUS_SUCCESS)
+        return _nss_mcdb_getnetbyaddr_r(lpm.net, AF_INET, netbuf,
+                                        buf, bufsz, errnop, h_errnop);
+    else if (!lpm.indexed && status == NSS_STATUS_NOTFOUND)
+        return nss_mcdb_netdb_netlpm_probe(addr, netbuf,       /*(no index)*/
+                                           buf, bufsz, errnop, h_errnop);
+    else
+        return nss_mcdb_netdb_gethost_fill_h_errnop(status, h_errnop);
+}
+
 
 nss_status_t
 _nss_mcdb_getprotoent_r(struct protoent * const restrict protobuf,
@@ -667,16 +776,29 @@ nss_mcdb_netdb_hostent_decode(struct mcdb * const restrict m,
     he_lst_num     = (size_t) ntohs( hdr.h[NSS_HE_LST_NUM>>1] );
     he->h_name     = buf;
     he->h_aliases  = /* align to 8-byte boundary for 64-bit */
-      (char **)(((uintptr_t)(buf+ntohs(hdr.h[NSS_HE_MEM>>1])+0x7u)) & ~0x7u);
+      (char **)(((uintptr_t)(buf+ntohs(hdr.h[NSS_HE_MEM>>1])+0x7u))
+                & ~(uintptr_t)0x7u);
     if (((char *)he->h_aliases)-buf+((he_mem_num+1+he_lst_num+1)<<3)<=v->bufsz){
         char ** const restrict he_mem = he->h_aliases;    /* 8-byte aligned */
         char ** const restrict he_lst = he->h_addr_list = he_mem+he_mem_num+1;
-        memcpy(buf, dptr+NSS_HE_HDRSZ, (size_t)mcdb_datalen(m)-NSS_HE_HDRSZ);
-        he_mem[0] = (buf += ntohs(hdr.h[NSS_HE_MEM_STR>>1])); /*he_mem strings*/
-        for (size_t i=1; i<he_mem_num; ++i) {/*(i=1; assigned first str above)*/
-            while (*++buf != '\0')
-                ;
-            he_mem[i] = ++buf;
+        const size_t slen = (size_t)ntohs( hdr.h[NSS_HE_MEM>>1] );
+        memcpy(buf, dptr+NSS_HE_HDRSZ, slen);
+        if (mcdb_datalen(m) == NSS_HE_HDRSZ + slen + (he_mem_num<<1)) {
+            /* relocate he_mem string offsets stored after strings and addrs */
+            const char * const restrict offs = dptr + NSS_HE_HDRSZ + slen;
+            uint16_t o;
+            for (size_t i = 0; i < he_mem_num; ++i) {
+                memcpy(&o, offs+(i<<1), sizeof(uint16_t));
+                he_mem[i] = buf + ntohs(o);
+            }
+        }
+        else { /* older mcdb lack offsets; scan for '\0' */
+            he_mem[0] = (buf += ntohs(hdr.h[NSS_HE_MEM_STR>>1]));/*he_mem strs*/
+            for (size_t i=1; i<he_mem_num; ++i) {/*(i=1; assigned first above)*/
+                while (*++buf != '\0')
+                    ;
+                he_mem[i] = ++buf;
+            }
         }
         he_mem[he_mem_num] = NULL;         /* terminate (char **) he_mem array*/
         he_lst[0] = buf = v->buf+ntohs(hdr.h[NSS_HE_LST_STR>>1]);/*he_lst str*/
@@ -693,6 +815,124 @@ nss_mcdb_netdb_hostent_decode(struct mcdb * const restrict m,
 }
 
 
+#ifdef __GLIBC__
+
+static nss_status_t
+nss_mcdb_netdb_gaih_decode(struct mcdb * const restrict m,
+                           const struct nss_mcdb_vinfo * const restrict v)
+{
+    const char * const restrict dptr = (char *)mcdb_dataptr(m);
+    const size_t dlen = (size_t)mcdb_datalen(m);
+    const size_t n = uint32_strunpack_bigendian_macro(dptr+NSS_HA_NUM);
+    const char * restrict e = dptr + NSS_HA_HDRSZ;
+    struct gaih_addrtuple ** const restrict pat =
+      (struct gaih_addrtuple **)v->vstruct;
+    struct gaih_addrtuple * restrict tup = (struct gaih_addrtuple *)
+      (((uintptr_t)v->buf + __alignof__(struct gaih_addrtuple) - 1)
+       & ~(uintptr_t)(__alignof__(struct gaih_addrtuple) - 1));
+    struct gaih_addrtuple * restrict at;
+    const size_t ntup = n - (*pat != NULL);
+    size_t canonlen;
+    char *name;
+
+    if (__builtin_expect( n == 0, 0)
+        || __builtin_expect( dlen <= NSS_HA_HDRSZ + n * NSS_HA_ENTSZ, 0)) {
+        *v->errnop = errno = ENOENT;       /*(not expected; invalid record)*/
+        return NSS_STATUS_NOTFOUND;
+    }
+    canonlen = dlen - NSS_HA_HDRSZ - n * NSS_HA_ENTSZ;
+    if ((size_t)((char *)(tup+ntup) - v->buf) + canonlen > v->bufsz) {
+        *v->errnop = errno = ERANGE;
+        return NSS_STATUS_TRYAGAIN;
+    }
+
+    /* (memcpy() addr; addr in record is not necessarily 4-byte aligned) */
+    name = memcpy(tup+ntup, e + n * NSS_HA_ENTSZ, canonlen);
+    at = (*pat != NULL) ? *pat : tup++;
+    *pat = at;
+    for (size_t i = 0; ; e += NSS_HA_ENTSZ) {
+        at->name    = (i == 0) ? name : NULL;
+        at->family  = (int)uint32_strunpack_bigendian_macro(e+NSS_HA_TYPE);
+        at->scopeid = 0;
+        memcpy(at->addr, e+NSS_HA_ADDR, sizeof(at->addr));
+        if (++i == n)
+            break;
+        at = at->next = tup++;
+    }
+    at->next = NULL;
+    return NSS_STATUS_SUCCESS;
+}
+
+/* fill gaih_addrtuple chain from each '~' hostent record of name
+ * (mcdb made by older nss_mcdbctl without 'a' records)
+ * (tuples allocated from front of buf, name copied to end of buf) */
+__attribute_noinline__
+static nss_status_t
+nss_mcdb_netdb_gaih_hostent_decode(struct mcdb * const restrict m,
+                                   const struct nss_mcdb_vinfo *
+                                     const restrict v)
+{
+    struct gaih_addrtuple ** restrict pat =
+      (struct gaih_addrtuple **)v->vstruct;
+    struct gaih_addrtuple * restrict tup = (struct gaih_addrtuple *)
+      (((uintptr_t)v->buf + __alignof__(struct gaih_addrtuple) - 1)
+       & ~(uintptr_t)(__alignof__(struct gaih_addrtuple) - 1));
+    char *name = v->buf + v->bufsz;
+    struct gaih_addrtuple * restrict at = NULL;
+
+    do {
+        const char * const restrict dptr = (char *)mcdb_dataptr(m);
+        union { uint32_t u[NSS_HE_HDRSZ>>2]; uint16_t h[NSS_HE_HDRSZ>>1]; } hdr;
+        size_t h_length;
+        memcpy(hdr.u, dptr, NSS_HE_HDRSZ);
+        h_length = ntohl( hdr.u[NSS_H_LENGTH>>2] );
+        if (h_length > sizeof(at->addr))
+            continue;
+        if (at != NULL  /*(skip name repeated as alias on same line)*/
+            && at->family == (int)ntohl( hdr.u[NSS_H_ADDRTYPE>>2] )
+            && 0 == memcmp(at->addr,
+                           dptr+NSS_HE_HDRSZ+ntohs(hdr.h[NSS_HE_LST_STR>>1]),
+                           h_length))
+            continue;
+        if (at == NULL) {
+            const size_t len = strlen(dptr+NSS_HE_HDRSZ) + 1;
+            if (sizeof(struct gaih_addrtuple) + len > v->bufsz
+                || (char *)(tup + (*pat == NULL)) > name - len) {
+                *v->errnop = errno = ERANGE;
+                return NSS_STATUS_TRYAGAIN;
+            }
+            name = memcpy(name - len, dptr+NSS_HE_HDRSZ, len);
+            at = (*pat != NULL) ? *pat : tup++;
+            at->name = name;
+        }
+        else {
+            if ((char *)(tup+1) > name) {
+                *v->errnop = errno = ERANGE;
+                return NSS_STATUS_TRYAGAIN;
+            }
+            at = tup++;
+            at->name = NULL;
+        }
+        at->family  = (int)ntohl( hdr.u[NSS_H_ADDRTYPE>>2] );
+        at->scopeid = 0;
+        memset(at->addr, 0, sizeof(at->addr));
+        memcpy(at->addr,
+               dptr+NSS_HE_HDRSZ+ntohs(hdr.h[NSS_HE_LST_STR>>1]), h_length);
+        *pat = at;
+        pat = &at->next;
+    } while (mcdb_findtagnext_h(m, v->key, v->klen, v->tagc));
+
+    if (at == NULL) {
+        *v->errnop = errno = ENOENT;
+        return NSS_STATUS_NOTFOUND;
+    }
+    at->next = NULL;
+    return NSS_STATUS_SUCCESS;
+}
+
+#endif /* __GLIBC__ */
+
+
 static nss_status_t
 nss_mcdb_netdb_netent_decode(struct mcdb * const restrict m,
                              const struct nss_mcdb_vinfo * const restrict v)
@@ -717,7 +957,8 @@ nss_mcdb_netdb_netent_decode(struct mcdb * const restrict m,
     ne_mem_num     = (size_t) ntohs( hdr.h[NSS_NE_MEM_NUM>>1] );
     ne->n_name     = buf = v->buf;
     ne->n_aliases  = /* align to 8-byte boundary for 64-bit */
-      (char **)(((uintptr_t)(buf+ntohs(hdr.h[NSS_NE_MEM>>1])+0x7u)) & ~0x7u);
+      (char **)(((uintptr_t)(buf+ntohs(hdr.h[NSS_NE_MEM>>1])+0x7u))
+                & ~(uintptr_t)0x7u);
     if (((char *)ne->n_aliases)-buf+((ne_mem_num+1)<<3) <= v->bufsz) {
         char ** const restrict ne_mem = ne->n_aliases;
         memcpy(buf, dptr+NSS_NE_HDRSZ, (size_t)mcdb_datalen(m)-NSS_NE_HDRSZ);
@@ -737,6 +978,79 @@ nss_mcdb_netdb_netent_decode(struct mcdb * const restrict m,
 }
 
 
+/* binary search index of ranges for range containing addr (NSS_NL_*)
+ * (fixed-size index by first octet limits search to ranges in octet) */
+static nss_status_t
+nss_mcdb_netdb_netlpm_decode(struct mcdb * const restrict m,
+                             const struct nss_mcdb_vinfo * const restrict v)
+{
+    struct nss_mcdb_netdb_netlpm * const restrict lpm =
+      (struct nss_mcdb_netdb_netlpm *)v->vstruct;
+    const char * const restrict dptr = (char *)mcdb_dataptr(m);
+    const char * const restrict idx  = dptr + NSS_NL_HDRSZ;
+    const char * restrict begin;
+    const uint32_t addr = lpm->addr;
+    uint32_t hdr[NSS_NL_HDRSZ>>2];
+    uint32_t lo, hi, u;
+    memcpy(hdr, dptr, NSS_NL_HDRSZ);  /*(copy for alignment)*/
+    if (__builtin_expect( hdr[NSS_NL_BOM>>2] != NSS_NL_BOM_MARK, 0)
+        || __builtin_expect( hdr[NSS_NL_NUM>>2] == 0, 0)
+        || __builtin_expect( mcdb_datalen(m) != NSS_NL_HDRSZ
+                             + ((NSS_NL_IDXSZ + (size_t)hdr[NSS_NL_NUM>>2]*2)
+                                * sizeof(uint32_t)), 0)) {
+        /*(created on host with different byte order, or invalid)*/
+        *v->errnop = errno = ENOENT;
+        return NSS_STATUS_NOTFOUND;
+    }
+    lpm->indexed = true;
+
+    /* (memcpy() uint32_t; data in mcdb is not necessarily 4-byte aligned) */
+    memcpy(&lo, idx + ((addr >> 24)    ) * sizeof(uint32_t), sizeof(uint32_t));
+    memcpy(&hi, idx + ((addr >> 24) + 1) * sizeof(uint32_t), sizeof(uint32_t));
+    begin = idx + NSS_NL_IDXSZ * sizeof(uint32_t);
+    while (lo < hi) {  /* last range in [lo,hi] beginning at or before addr */
+        const uint32_t mid = (lo + hi + 1) >> 1;
+        memcpy(&u, begin + mid * sizeof(uint32_t), sizeof(uint32_t));
+        if (u <= addr)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    memcpy(&lpm->net, begin + (hdr[NSS_NL_NUM>>2] + lo) * sizeof(uint32_t),
+           sizeof(uint32_t));
+    if (lpm->net != NSS_NL_NONE)
+        return NSS_STATUS_SUCCESS;
+    *v->errnop = errno = ENOENT;
+    return NSS_STATUS_NOTFOUND;
+}
+
+/* query networks masking addr to successively shorter octet prefixes
+ * (networks mcdb created by older nss_mcdbctl without 'l' record) */
+__attribute_noinline__
+static nss_status_t
+nss_mcdb_netdb_netlpm_probe(const uint32_t addr,
+                            struct netent * const restrict netbuf,
+                            char * const restrict buf, const size_t bufsz,
+                            int * const restrict errnop,
+                            int * const restrict h_errnop)
+{
+    nss_status_t status = NSS_STATUS_NOTFOUND;
+    uint32_t mask = ~(uint32_t)0;
+    uint32_t prev = NSS_NL_NONE;
+    for (int i = 0; i <= 4; ++i, mask <<= 8) {  /*(i == 4: mask 0; net 0)*/
+        const uint32_t net = (i < 4) ? addr & mask : 0;
+        if (net == prev) /*(skip; prefix implied by net is shorter)*/
+            continue;
+        prev = net;
+        status = _nss_mcdb_getnetbyaddr_r(net, AF_INET, netbuf,
+                                          buf, bufsz, errnop, h_errnop);
+        if (status != NSS_STATUS_NOTFOUND)
+            break;
+    }
+    return status;
+}
+
+
 static nss_status_t
 nss_mcdb_netdb_protoent_decode(struct mcdb * const restrict m,
                                const struct nss_mcdb_vinfo * const restrict v)
@@ -751,7 +1065,8 @@ nss_mcdb_netdb_protoent_decode(struct mcdb * const restrict m,
     pe_mem_num    = (size_t) ntohs( hdr.h[NSS_PE_MEM_NUM>>1] );
     pe->p_name    = buf = v->buf;
     pe->p_aliases = /* align to 8-byte boundary for 64-bit */
-      (char **)(((uintptr_t)(buf+ntohs(hdr.h[NSS_PE_MEM>>1])+0x7u)) & ~0x7u);
+      (char **)(((uintptr_t)(buf+ntohs(hdr.h[NSS_PE_MEM>>1])+0x7u))
+                & ~(uintptr_t)0x7u);
     if (((char *)pe->p_aliases)-buf+((pe_mem_num+1)<<3) <= v->bufsz) {
         char ** const restrict pe_mem = pe->p_aliases;
         memcpy(buf, dptr+NSS_PE_HDRSZ, (size_t)mcdb_datalen(m)-NSS_PE_HDRSZ);
@@ -785,7 +1100,8 @@ nss_mcdb_netdb_rpcent_decode(struct mcdb * const restrict m,
     re_mem_num    = (size_t) ntohs( hdr.h[NSS_RE_MEM_NUM>>1] );
     re->r_name    = buf = v->buf;
     re->r_aliases = /* align to 8-byte boundary for 64-bit */
-      (char **)(((uintptr_t)(buf+ntohs(hdr.h[NSS_RE_MEM>>1])+0x7u)) & ~0x7u);
+      (char **)(((uintptr_t)(buf+ntohs(hdr.h[NSS_RE_MEM>>1])+0x7u))
+                & ~(uintptr_t)0x7u);
     if (((char *)re->r_aliases)-buf+((re_mem_num+1)<<3) <= v->bufsz) {
         char ** const restrict re_mem = re->r_aliases;
         memcpy(buf, dptr+NSS_RE_HDRSZ, (size_t)mcdb_datalen(m)-NSS_RE_HDRSZ);
@@ -838,7 +1154,8 @@ nss_mcdb_netdb_servent_decode(struct mcdb * const restrict m,
     se->s_proto   = buf;
     se->s_name    = buf + ntohs(hdr.h[NSS_S_NAME>>1]);
     se->s_aliases = /* align to 8-byte boundary for 64-bit */
-      (char **)(((uintptr_t)(buf+ntohs(hdr.h[NSS_SE_MEM>>1])+0x7u)) & ~0x7u);
+      (char **)(((uintptr_t)(buf+ntohs(hdr.h[NSS_SE_MEM>>1])+0x7u))
+                & ~(uintptr_t)0x7u);
     if (((char *)se->s_aliases)-buf+((se_mem_num+1)<<3) <= v->bufsz) {
         char ** const restrict se_mem = se->s_aliases;
         memcpy(buf, dptr+NSS_SE_HDRSZ, (size_t)mcdb_datalen(m)-NSS_SE_HDRSZ);
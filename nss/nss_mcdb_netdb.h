@@ -70,6 +70,25 @@ enum {
   NSS_HE_HDRSZ   = 20   /*(must be multiple of 4; round up)*/
 };
 
+/* hostent record: header, strings, addrs (NSS_HE_MEM is length of strings and
+ * addrs), followed by NSS_HE_MEM_NUM uint16_t offsets (network byte order) of
+ * h_aliases strings, relative to start of strings, so that decode is memcpy()
+ * of strings and addrs plus relocation of offsets into (char **) h_aliases.
+ * (offsets are independent of pointer size, so same mcdb serves 32-bit and
+ *  64-bit processes) (older records end at addrs and are scanned for '\0') */
+
+/* all address families record (tag 'a') of each host name and alias, for
+ * gethostbyname4_r(): num addrs, then NSS_HA_ENTSZ per addr in order found in
+ * /etc/hosts (bigendian addr type, addr zero-padded to 16 bytes), and then
+ * h_name of first line with matching name or alias (with terminating '\0') */
+enum {
+  NSS_HA_NUM     =  0,
+  NSS_HA_HDRSZ   =  4,
+  NSS_HA_TYPE    =  0,
+  NSS_HA_ADDR    =  4,
+  NSS_HA_ENTSZ   = 20
+};
+
 enum {
   NSS_N_NET      =  0,
   NSS_N_ADDRTYPE =  4,
@@ -82,6 +101,22 @@ enum {
   NSS_NE_HDRSZ   = 16   /*(must be multiple of 4; round up)*/
 };
 
+/* longest prefix match record (tag 'l', empty key) of AF_INET networks for
+ * nss_mcdb_getnetbyaddr_lpm_r(): network prefix length is implied by trailing
+ * zero octets (e.g. 10.1.0.0 is 10.1.0.0/16), and prefixes are flattened into
+ * sorted disjoint ranges covering all addrs.  After header, all uint32_t in
+ * host byte order: NSS_NL_IDXSZ index (by first octet) of range containing
+ * octet.0.0.0 (last entry is num-1), then num range begin addrs, then num
+ * networks (or ~0 for range not in any network) */
+enum {
+  NSS_NL_NUM     =  0,
+  NSS_NL_BOM     =  4,
+  NSS_NL_HDRSZ   =  8,
+  NSS_NL_IDXSZ   = 257
+};
+#define NSS_NL_BOM_MARK 0x01020304u
+#define NSS_NL_NONE     (~(uint32_t)0)
+
 enum {
   NSS_P_PROTO    =  0,
   NSS_PE_MEM_STR =  4,
@@ -141,6 +176,17 @@ _nss_mcdb_gethostbyaddr_r(const void * restrict, socklen_t, int,
                           int * restrict, int * restrict)
   __attribute_nonnull__  __attribute_warn_unused_result__;
 
+#ifdef __GLIBC__
+struct gaih_addrtuple;
+/* (int32_t *ttlp is optional; not modified) */
+nss_status_t
+_nss_mcdb_gethostbyname4_r(const char * restrict,
+                           struct gaih_addrtuple ** restrict,
+                           char * restrict, size_t,
+                           int * restrict, int * restrict, int32_t * restrict)
+  __attribute_nonnull_x__((1,2,3,5,6))  __attribute_warn_unused_result__;
+#endif
+
 #if 0  /* implemented, but not enabling by default; often used only with NIS+ */
 
 int _nss_mcdb_setnetgrent(const char * restrict)
@@ -171,6 +217,14 @@ _nss_mcdb_getnetbyaddr_r(const uint32_t, int,
                          int * restrict, int * restrict)
   __attribute_nonnull__  __attribute_warn_unused_result__;
 
+/* (not part of libc nss interface)
+ * network containing AF_INET addr (host byte order), not only exact match */
+nss_status_t
+nss_mcdb_getnetbyaddr_lpm_r(uint32_t, int,
+                            struct netent * restrict, char * restrict, size_t,
+                            int * restrict, int * restrict)
+  __attribute_nonnull__  __attribute_warn_unused_result__;
+
 nss_status_t
 _nss_mcdb_getprotoent_r(struct protoent * restrict, char * restrict, size_t,
                         int * restrict)
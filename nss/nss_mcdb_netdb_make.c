@@ -35,11 +35,12 @@
 #include "nss_mcdb_netdb_make.h"
 #include "nss_mcdb_netdb.h"
 #include "nss_mcdb_make.h"
+#include "../uint32.h"
 
 #include <errno.h>
 #include <limits.h>
 #include <string.h>
-#include <stdlib.h>     /* strtol() */
+#include <stdlib.h>     /* malloc() calloc() realloc() free() strtol() */
 #include <netdb.h>
 #include <sys/socket.h> /* AF_INET */
 #include <arpa/inet.h>  /* inet_pton() ntohl() ntohs() htons() */
@@ -102,14 +103,19 @@ nss_mcdb_netdb_make_hostent_datastr(char * restrict buf, const size_t bufsz,
 	if (   __builtin_expect(he_mem_num <= USHRT_MAX, 1)
 	    && __builtin_expect(he_lst_num <= USHRT_MAX, 1)
 	    && __builtin_expect(he_lst[he_lst_num] == NULL,  1)
-	    && __builtin_expect(((he_mem_num+he_lst_num)<<3)+8u+8u+7u
+	    && __builtin_expect((he_mem_num<<1)
+				+((he_mem_num+he_lst_num)<<3)+8u+8u+7u
                                 <= bufsz-dlen, 1)) {
-	    /* verify space in string for (2) 8-aligned char ** array + NULL
+	    /* verify space in string for h_aliases offsets, and verify space
+	     * for (2) 8-aligned char ** array + NULL
 	     * (not strictly necessary, but best to catch excessively long
 	     *  entries at mcdb create time rather than in query at runtime) */
 
 	    /* store string offsets into aligned header, then copy into buf */
 	    /* copy strings into buffer, including string terminating '\0' */
+	    /* append offset of each h_aliases string (relative to h_name) so
+	     * that decode need not scan strings (NSS_HE_MEM is end of addrs) */
+	    size_t offset = he_mem_str_offset;
 	    hdr.u[NSS_H_ADDRTYPE>>2]  = htonl((uint32_t) he->h_addrtype);
 	    hdr.u[NSS_H_LENGTH>>2]    = htonl((uint32_t) he->h_length);
 	    hdr.h[NSS_HE_MEM>>1]      = htons((uint16_t)(dlen - NSS_HE_HDRSZ));
@@ -118,6 +124,11 @@ nss_mcdb_netdb_make_hostent_datastr(char * restrict buf, const size_t bufsz,
 	    hdr.h[NSS_HE_MEM_NUM>>1]  = htons((uint16_t) he_mem_num);
 	    hdr.h[NSS_HE_LST_NUM>>1]  = htons((uint16_t) he_lst_num);
 	    hdr.h[(NSS_HE_HDRSZ>>1)-1]= 0;/*(clear last 2 bytes (consistency))*/
+	    for (size_t i = 0; i < he_mem_num; ++i, dlen += 2) {
+		const uint16_t o = htons((uint16_t) offset);
+		memcpy(buf+dlen, &o, 2);
+		offset += 1 + strlen(he->h_aliases[i]);
+	    }
 	    memcpy(buf,              hdr.u,      NSS_HE_HDRSZ);
 	    memcpy(buf+NSS_HE_HDRSZ, he->h_name, he_name_len);
 	    return dlen;
@@ -301,6 +312,368 @@ nss_mcdb_netdb_make_servent_datastr(char * restrict buf, const size_t bufsz,
 
 
 
+/*
+ * gethostbyname4_r() support
+ * (keep hash map of addresses of all families per host name and alias,
+ *  (similar to grouplist hash map in nss_mcdb_acct_make.c)
+ *  written as 'a' records in nss_mcdb_netdb_make_hosts_flush())
+ */
+
+struct nss_mcdb_netdb_make_hostaddr {
+  struct nss_mcdb_netdb_make_hostaddr * restrict next;
+  char * restrict addrs;   /* NSS_HA_ENTSZ per addr (see nss_mcdb_netdb.h) */
+  uint32_t naddrs;
+  uint32_t addrs_sz;
+  uint32_t line;           /* most recent line (skip name repeated on line) */
+  uint32_t hash;
+  uint32_t namelen;
+  uint32_t canonlen;
+  char name[];             /* name '\0' h_name '\0' */
+};
+
+enum { nss_mcdb_netdb_make_hostaddr_hashmap_init = 256 };/*must be power of 2*/
+
+static struct nss_mcdb_netdb_make_hostaddr ** restrict
+  nss_mcdb_netdb_make_hostaddr_hashmap = NULL;
+
+static size_t nss_mcdb_netdb_make_hostaddr_hashmap_sz = 0;
+static size_t nss_mcdb_netdb_make_hostaddr_count = 0;
+static uint32_t nss_mcdb_netdb_make_hostaddr_line = 0;
+
+__attribute_noinline__
+static bool
+nss_mcdb_netdb_make_hostaddr_free(const bool rc)
+{
+    struct nss_mcdb_netdb_make_hostaddr * restrict ha;
+    struct nss_mcdb_netdb_make_hostaddr * restrict next;
+
+    for (size_t i = 0; i < nss_mcdb_netdb_make_hostaddr_hashmap_sz; ++i) {
+        for (ha = nss_mcdb_netdb_make_hostaddr_hashmap[i]; ha; ha = next) {
+            next = ha->next;
+            free(ha->addrs);
+            free(ha);
+        }
+    }
+    free(nss_mcdb_netdb_make_hostaddr_hashmap);
+    nss_mcdb_netdb_make_hostaddr_hashmap = NULL;
+    nss_mcdb_netdb_make_hostaddr_hashmap_sz = 0;
+    nss_mcdb_netdb_make_hostaddr_count = 0;
+    nss_mcdb_netdb_make_hostaddr_line = 0;
+    return rc;
+}
+
+/* double size of hash map, moving entries into new buckets */
+__attribute_noinline__
+static bool
+nss_mcdb_netdb_make_hostaddr_hashmap_grow(void)
+{
+    struct nss_mcdb_netdb_make_hostaddr * restrict ha;
+    struct nss_mcdb_netdb_make_hostaddr * restrict next;
+    const size_t osz = nss_mcdb_netdb_make_hostaddr_hashmap_sz;
+    const size_t nsz = (osz != 0)
+      ? osz << 1
+      : nss_mcdb_netdb_make_hostaddr_hashmap_init;
+    struct nss_mcdb_netdb_make_hostaddr ** const restrict hashmap =
+      (struct nss_mcdb_netdb_make_hostaddr **)
+      calloc(nsz, sizeof(struct nss_mcdb_netdb_make_hostaddr *));
+    if (__builtin_expect( hashmap == NULL, 0))
+        return false;
+
+    for (size_t i = 0; i < osz; ++i) {
+        for (ha = nss_mcdb_netdb_make_hostaddr_hashmap[i]; ha; ha = next) {
+            next = ha->next;
+            ha->next = hashmap[ha->hash & (nsz-1)];
+            hashmap[ha->hash & (nsz-1)] = ha;
+        }
+    }
+
+    free(nss_mcdb_netdb_make_hostaddr_hashmap);
+    nss_mcdb_netdb_make_hostaddr_hashmap = hashmap;
+    nss_mcdb_netdb_make_hostaddr_hashmap_sz = nsz;
+    return true;
+}
+
+/* append addr of (single addr) hostent to list of name (h_name or alias) */
+static bool
+nss_mcdb_netdb_make_hostaddr_add(const char * const restrict name,
+                                 const struct hostent * const restrict he)
+{
+    struct nss_mcdb_netdb_make_hostaddr *ha;
+    struct nss_mcdb_netdb_make_hostaddr ** restrict hashmap_bucket;
+    const size_t namelen = strlen(name);
+    const uint32_t hash = uint32_hash_djb(UINT32_HASH_DJB_INIT, name, namelen);
+    char * restrict e;
+
+    /* (grow hash map when entries outnumber buckets) */
+    if (__builtin_expect( nss_mcdb_netdb_make_hostaddr_count
+                          >= nss_mcdb_netdb_make_hostaddr_hashmap_sz, 0)) {
+        if (!nss_mcdb_netdb_make_hostaddr_hashmap_grow())
+            return false;
+    }
+
+    hashmap_bucket =
+      &nss_mcdb_netdb_make_hostaddr_hashmap[
+        hash & (nss_mcdb_netdb_make_hostaddr_hashmap_sz-1)];
+    for (ha = *hashmap_bucket; ha; ha = ha->next) {
+        if (ha->hash == hash
+            && ha->name[0] == name[0]
+            && memcmp(ha->name, name, namelen+1) == 0)
+            break;
+    }
+
+    if (ha == NULL) {
+        const size_t canonlen = strlen(he->h_name) + 1;
+        ha = (struct nss_mcdb_netdb_make_hostaddr *)
+          malloc(sizeof(struct nss_mcdb_netdb_make_hostaddr)
+                 + namelen + 1 + canonlen);
+        if (__builtin_expect( ha == NULL, 0))
+            return false;
+        ha->addrs = (char *)malloc(NSS_HA_ENTSZ * 2);
+        if (__builtin_expect( ha->addrs == NULL, 0)) {
+            free(ha);
+            return false;
+        }
+        memcpy(ha->name, name, namelen+1);
+        memcpy(ha->name+namelen+1, he->h_name, canonlen);
+        ha->naddrs   = 0;
+        ha->addrs_sz = 2;   /* initial addrs allocation above */
+        ha->line     = 0;
+        ha->hash     = hash;
+        ha->namelen  = (uint32_t)namelen;
+        ha->canonlen = (uint32_t)canonlen;
+        ha->next     = *hashmap_bucket;
+        *hashmap_bucket = ha;
+        ++nss_mcdb_netdb_make_hostaddr_count;
+    }
+    else if (ha->line == nss_mcdb_netdb_make_hostaddr_line)
+        return true;  /* name repeated as alias on same line */
+    else if (ha->naddrs == ha->addrs_sz) {
+        char * const restrict addrs =
+          (char *)realloc(ha->addrs, NSS_HA_ENTSZ * (size_t)ha->addrs_sz * 2);
+        if (__builtin_expect( addrs == NULL, 0))
+            return false;
+        ha->addrs = addrs;
+        ha->addrs_sz <<= 1;
+    }
+
+    ha->line = nss_mcdb_netdb_make_hostaddr_line;
+    e = ha->addrs + NSS_HA_ENTSZ * (size_t)ha->naddrs++;
+    uint32_strpack_bigendian_macro(e+NSS_HA_TYPE, (uint32_t)he->h_addrtype);
+    memset(e+NSS_HA_ADDR, 0, NSS_HA_ENTSZ-NSS_HA_ADDR);
+    memcpy(e+NSS_HA_ADDR, he->h_addr_list[0], (size_t)he->h_length);
+    return true;
+}
+
+static bool
+nss_mcdb_netdb_make_hostaddr_write(struct nss_mcdb_make_winfo *
+                                     const restrict w,
+                                   const struct nss_mcdb_netdb_make_hostaddr *
+                                     const restrict ha)
+{
+    struct mcdb_make * const restrict m = w->wbuf.m;
+    char hdr[NSS_HA_HDRSZ];
+    const size_t alen = NSS_HA_ENTSZ * (size_t)ha->naddrs;
+
+    uint32_strpack_bigendian_macro(hdr+NSS_HA_NUM, ha->naddrs);
+    if (mcdb_make_addbegin_h(m, ha->namelen+1,
+                             NSS_HA_HDRSZ + alen + ha->canonlen) != 0)
+        return false;
+    mcdb_make_addbuf_key_h(m, &w->tagc, 1);
+    mcdb_make_addbuf_key_h(m, ha->name, ha->namelen);
+    mcdb_make_addbuf_data_h(m, hdr, NSS_HA_HDRSZ);
+    mcdb_make_addbuf_data_h(m, ha->addrs, alen);
+    mcdb_make_addbuf_data_h(m, ha->name+ha->namelen+1, ha->canonlen);
+    mcdb_make_addend_h(m);
+    return true;
+}
+
+bool
+nss_mcdb_netdb_make_hosts_flush(struct nss_mcdb_make_winfo * const restrict w)
+{
+    struct nss_mcdb_netdb_make_hostaddr * restrict ha;
+
+    w->tagc = 'a';
+
+    for (size_t i = 0; i < nss_mcdb_netdb_make_hostaddr_hashmap_sz; ++i) {
+        for (ha = nss_mcdb_netdb_make_hostaddr_hashmap[i]; ha; ha = ha->next) {
+            if (__builtin_expect(!nss_mcdb_netdb_make_hostaddr_write(w,ha), 0))
+                return nss_mcdb_netdb_make_hostaddr_free(false);
+        }
+    }
+
+    return nss_mcdb_netdb_make_hostaddr_free(true);
+}
+
+/*
+ * end gethostbyname4_r() support
+ */
+
+
+/*
+ * nss_mcdb_getnetbyaddr_lpm_r() support
+ * (collect AF_INET networks; written as 'l' record of ranges in flush)
+ * (see NSS_NL_* in nss_mcdb_netdb.h)
+ */
+
+static uint32_t * restrict nss_mcdb_netdb_make_netlpm_nets = NULL;
+static size_t nss_mcdb_netdb_make_netlpm_num = 0;
+static size_t nss_mcdb_netdb_make_netlpm_sz  = 0;
+
+__attribute_noinline__
+static bool
+nss_mcdb_netdb_make_netlpm_free(const bool rc)
+{
+    free(nss_mcdb_netdb_make_netlpm_nets);
+    nss_mcdb_netdb_make_netlpm_nets = NULL;
+    nss_mcdb_netdb_make_netlpm_num = 0;
+    nss_mcdb_netdb_make_netlpm_sz  = 0;
+    return rc;
+}
+
+static bool
+nss_mcdb_netdb_make_netlpm_add(const uint32_t net)
+{
+    if (net == NSS_NL_NONE)  /*(255.255.255.255 not indexed; NSS_NL_NONE)*/
+        return true;
+    if (nss_mcdb_netdb_make_netlpm_num == nss_mcdb_netdb_make_netlpm_sz) {
+        const size_t sz = (nss_mcdb_netdb_make_netlpm_sz != 0)
+          ? nss_mcdb_netdb_make_netlpm_sz << 1
+          : 64;
+        uint32_t * const restrict nets = (uint32_t *)
+          realloc(nss_mcdb_netdb_make_netlpm_nets, sz * sizeof(uint32_t));
+        if (__builtin_expect( nets == NULL, 0))
+            return false;
+        nss_mcdb_netdb_make_netlpm_nets = nets;
+        nss_mcdb_netdb_make_netlpm_sz   = sz;
+    }
+    nss_mcdb_netdb_make_netlpm_nets[nss_mcdb_netdb_make_netlpm_num++] = net;
+    return true;
+}
+
+static int
+nss_mcdb_netdb_make_netlpm_cmp(const void * const a, const void * const b)
+{
+    const uint32_t x = *(const uint32_t *)a;
+    const uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* append range beginning at addr, unless continuation of previous range */
+static void
+nss_mcdb_netdb_make_netlpm_range(uint32_t * const restrict begin,
+                                 uint32_t * const restrict nets,
+                                 size_t * const restrict num,
+                                 const uint64_t addr, const uint32_t net)
+{
+    if (*num != 0 && nets[*num-1] == net)
+        return;
+    begin[*num] = (uint32_t)addr;
+    nets[*num]  = net;
+    ++*num;
+}
+
+bool
+nss_mcdb_netdb_make_networks_flush(struct nss_mcdb_make_winfo *
+                                     const restrict w)
+{
+    struct mcdb_make * const restrict m = w->wbuf.m;
+    uint32_t * const restrict nets = nss_mcdb_netdb_make_netlpm_nets;
+    size_t n = nss_mcdb_netdb_make_netlpm_num;
+    uint32_t * restrict rbegin;
+    uint32_t * restrict rnets;
+    size_t num = 0;
+    uint32_t hdr[NSS_NL_HDRSZ>>2];
+    uint32_t idx[NSS_NL_IDXSZ];
+    uint64_t end[5];       /* stack of nested prefixes: /0 /8 /16 /24 /32 */
+    uint32_t top[5];
+    size_t depth = 0;
+    uint64_t cur = 0;
+
+    if (n == 0)
+        return true;   /* (no networks; no 'l' record) */
+
+    /* sort and make nets unique (prefix length implied by net, so sorted by
+     * begin addr of prefix, and no two prefixes with same begin addr) */
+    if (n > 1) {
+        size_t i, j;
+        qsort(nets, n, sizeof(uint32_t), nss_mcdb_netdb_make_netlpm_cmp);
+        for (i = 1, j = 1; i < n; ++i) {
+            if (nets[i] != nets[j-1])
+                nets[j++] = nets[i];
+        }
+        n = j;
+    }
+
+    /* (each prefix adds at most 2 ranges, plus initial range) */
+    rbegin = (uint32_t *)malloc((2 * n + 1) * 2 * sizeof(uint32_t));
+    if (__builtin_expect( rbegin == NULL, 0))
+        return nss_mcdb_netdb_make_netlpm_free(false);
+    rnets = rbegin + 2 * n + 1;
+
+    /* flatten nested prefixes into disjoint ranges covering all addrs */
+    for (size_t i = 0; i <= n; ++i) {
+        const uint64_t begin = (i < n) ? nets[i] : UINT64_C(0x100000000);
+        while (depth != 0 && end[depth-1] < begin) {
+            --depth;
+            if (cur <= end[depth]) {
+                nss_mcdb_netdb_make_netlpm_range(rbegin, rnets, &num, cur,
+                                                 top[depth]);
+                cur = end[depth] + 1;
+            }
+        }
+        if (cur < begin) {
+            nss_mcdb_netdb_make_netlpm_range(rbegin, rnets, &num, cur,
+                                             depth != 0
+                                               ? top[depth-1]
+                                               : NSS_NL_NONE);
+            cur = begin;
+        }
+        if (i < n) {
+            const uint32_t net = nets[i];
+            const unsigned int zbits = /*(trailing zero octets, in bits)*/
+                (net == 0)               ? 32
+              : (net & 0x00FFFFFFu) == 0 ? 24
+              : (net & 0x0000FFFFu) == 0 ? 16
+              : (net & 0x000000FFu) == 0 ?  8
+              :                            0;
+            end[depth] = (uint64_t)net + (UINT64_C(1) << zbits) - 1;
+            top[depth] = net;
+            ++depth;
+        }
+    }
+
+    /* index by first octet: range containing octet.0.0.0 */
+    for (size_t b = 0, i = 0; b < NSS_NL_IDXSZ-1; ++b) {
+        while (i+1 < num && rbegin[i+1] <= (uint32_t)(b << 24))
+            ++i;
+        idx[b] = (uint32_t)i;
+    }
+    idx[NSS_NL_IDXSZ-1] = (uint32_t)(num - 1);
+
+    hdr[NSS_NL_NUM>>2] = (uint32_t)num;
+    hdr[NSS_NL_BOM>>2] = NSS_NL_BOM_MARK;
+    w->tagc = 'l';
+    if (mcdb_make_addbegin_h(m, 1, NSS_NL_HDRSZ + sizeof(idx)
+                                   + num * 2 * sizeof(uint32_t)) != 0) {
+        free(rbegin);
+        return nss_mcdb_netdb_make_netlpm_free(false);
+    }
+    mcdb_make_addbuf_key_h(m, &w->tagc, 1);
+    mcdb_make_addbuf_data_h(m, (char *)hdr, NSS_NL_HDRSZ);
+    mcdb_make_addbuf_data_h(m, (char *)idx, sizeof(idx));
+    mcdb_make_addbuf_data_h(m, (char *)rbegin, num * sizeof(uint32_t));
+    mcdb_make_addbuf_data_h(m, (char *)rnets,  num * sizeof(uint32_t));
+    mcdb_make_addend_h(m);
+
+    free(rbegin);
+    return nss_mcdb_netdb_make_netlpm_free(true);
+}
+
+/*
+ * end nss_mcdb_getnetbyaddr_lpm_r() support
+ */
+
+
 bool
 nss_mcdb_netdb_make_hostent_encode(
   struct nss_mcdb_make_winfo * const restrict w,
@@ -338,6 +711,20 @@ nss_mcdb_netdb_make_hostent_encode(
     if (__builtin_expect( !nss_mcdb_make_mcdbctl_write(w), 0))
         return false;
 
+    /* aggregate addr by name and alias for 'a' records written in flush */
+    if (__builtin_expect( (size_t)(unsigned int)he->h_length
+                          > NSS_HA_ENTSZ-NSS_HA_ADDR, 0)) {
+        errno = EAFNOSUPPORT;
+        return nss_mcdb_netdb_make_hostaddr_free(false);
+    }
+    ++nss_mcdb_netdb_make_hostaddr_line;
+    if (__builtin_expect( !nss_mcdb_netdb_make_hostaddr_add(he->h_name,he),0))
+        return nss_mcdb_netdb_make_hostaddr_free(false);
+    for (i = 0; he->h_aliases[i] != NULL; ++i) {
+        if (!nss_mcdb_netdb_make_hostaddr_add(he->h_aliases[i], he))
+            return nss_mcdb_netdb_make_hostaddr_free(false);
+    }
+
     return true;
 }
 
@@ -389,6 +776,11 @@ nss_mcdb_netdb_make_netent_encode(
     if (__builtin_expect( !nss_mcdb_make_mcdbctl_write(w), 0))
         return false;
 
+    /* collect network for 'l' record written in flush */
+    if (ne->n_addrtype == AF_INET
+        && __builtin_expect( !nss_mcdb_netdb_make_netlpm_add(ntohl(n[0])), 0))
+        return nss_mcdb_netdb_make_netlpm_free(false);
+
     return true;
 }
 
@@ -76,12 +76,22 @@ nss_mcdb_netdb_make_hostent_encode(
   const void * const)
   __attribute_nonnull__;
 
+bool
+nss_mcdb_netdb_make_hosts_flush(
+  struct nss_mcdb_make_winfo * const restrict)
+  __attribute_nonnull__;
+
 bool
 nss_mcdb_netdb_make_netent_encode(
   struct nss_mcdb_make_winfo * const restrict,
   const void * const)
   __attribute_nonnull__;
 
+bool
+nss_mcdb_netdb_make_networks_flush(
+  struct nss_mcdb_make_winfo * const restrict)
+  __attribute_nonnull__;
+
 bool
 nss_mcdb_netdb_make_protoent_encode(
   struct nss_mcdb_make_winfo * const restrict,
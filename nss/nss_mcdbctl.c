@@ -46,7 +46,9 @@
 #include "../nointr.h"
 #include "../plasma/plasma_stdtypes.h"
 
+#include <sys/mman.h>  /* mmap() munmap() */
 #include <sys/stat.h>  /* stat(), fchmod(), umask() */
+#include <fcntl.h>     /* open() */
 #include <limits.h>
 #include <assert.h>
 #include <errno.h>
@@ -54,36 +56,145 @@
 #include <stdio.h>     /* rename() */
 #include <string.h>    /* memcpy() strlen() */
 #include <unistd.h>    /* sysconf() unlink() */
+#ifdef _THREAD_SAFE
+#include <pthread.h>   /* pthread_create() pthread_join() */
+#endif
 
 /* Note: blank line is required to denote end of mcdb input 
  * Ensure blank line is written after w.wbuf is flushed. */
 
-int main(void)
+struct fdb_st {
+  const char * const restrict file;
+  const char * const restrict mcdbfile;
+  size_t datasz;
+  bool (*parse)(struct nss_mcdb_make_winfo * restrict,
+                char * restrict);
+  bool (*encode)(struct nss_mcdb_make_winfo * restrict,
+                 const void *);
+  bool (*flush)(struct nss_mcdb_make_winfo * restrict);
+};
+
+/* each database is made in its own thread, with its own struct mcdb_make,
+ * struct nss_mcdb_make_winfo, and buffers
+ * (temporary mcdb is created (mcdb_makefn_start()) in main thread, since
+ *  mcdb_makefn_start() sets process umask; each thread renames its mcdb.
+ *  group is only db which keeps state (grouplist) outside of winfo) */
+struct nss_mcdbctl_db {
+  const struct fdb_st * restrict fdb;
+  struct mcdb_make m;
+  bool rc;
+};
+
+static void *
+nss_mcdbctl_make_thread(void * const arg)
+  __attribute_nonnull__;
+static void *
+nss_mcdbctl_make_thread(void * const arg)
 {
     /* WBUFSZ must be >= ((largest record possible * 2) + 26) */
     enum { WBUFSZ = 524288  /* 512 KB */ };
     enum { DBUFSZ =   4096  /*   4 KB */ };
 
-    struct nss_mcdb_make_winfo w = { .wbuf   = { NULL,malloc(WBUFSZ),0,WBUFSZ },
+    struct nss_mcdbctl_db * const restrict db = (struct nss_mcdbctl_db *)arg;
+    struct nss_mcdb_make_winfo w = { .wbuf   = { &db->m,malloc(WBUFSZ),
+                                                 0,WBUFSZ },
                                      .data   = malloc(DBUFSZ),
-                                     .datasz = DBUFSZ };
-    struct nss_mcdb_make_wbuf * const wbuf = &w.wbuf;
+                                     .datasz = db->fdb->datasz,
+                                     .encode = db->fdb->encode,
+                                     .flush  = db->fdb->flush };
+
+    /* (mcdb line must fit in WBUFSZ, including key, value, mcdb line tokens) */
+    assert(DBUFSZ*2 <= WBUFSZ);
+    assert(w.datasz <= DBUFSZ);
+
+    db->rc = w.wbuf.buf != NULL && w.data != NULL
+          && nss_mcdb_make_dbfile(&w, db->fdb->file, db->fdb->parse)
+          && mcdb_makefn_finish(&db->m, true) == 0;
+    mcdb_makefn_cleanup(&db->m);
+
+    free(w.data);
+    free(w.wbuf.buf);
+    return NULL;
+}
+
+/* print lookup statistics shared by processes using libnss_mcdb
+ * (see struct nss_mcdb_stats in nss_mcdb.h)
+ * (create stats file if it does not exist, enabling collection by processes
+ *  which open databases afterwards; remove file to disable) */
+static int
+nss_mcdbctl_stats(void)
+{
+    /* (names in enum nss_dbtype order) */
+    static const char * const dbnames[NSS_DBTYPE_SENTINEL] = {
+      "aliases", "ethers", "group", "hosts", "netgroup", "networks", "passwd",
+      "protocols", "publickey", "rpc", "services", "shadow"
+    };
+    const struct nss_mcdb_stats *stats;
+    struct stat st;
+    int fd = open(NSS_MCDB_STATSPATH, O_RDONLY | O_NONBLOCK | O_CLOEXEC, 0);
+    if (fd == -1 && errno == ENOENT) {
+        const struct nss_mcdb_stats hdr = { .magic   = NSS_MCDB_STATS_MAGIC,
+                                            .version = NSS_MCDB_STATS_VERSION,
+                                            .ndb     = NSS_DBTYPE_SENTINEL,
+                                            .nlat    = NSS_MCDB_STATS_NLAT };
+        fd = open(NSS_MCDB_STATSPATH, O_RDWR|O_CREAT|O_EXCL|O_CLOEXEC, 0644);
+        if (fd != -1
+            && nointr_write(fd, (const char *)&hdr, sizeof(hdr))
+               != (ssize_t)sizeof(hdr)) {
+            (void)unlink(NSS_MCDB_STATSPATH);
+            (void)nointr_close(fd);
+            fd = -1;
+        }
+    }
+    if (fd == -1 || fstat(fd, &st) != 0
+        || st.st_size != (off_t)sizeof(struct nss_mcdb_stats)) {
+        perror("nss_mcdbctl: stats: " NSS_MCDB_STATSPATH);
+        if (fd != -1)
+            (void)nointr_close(fd);
+        return 1;
+    }
+    stats = mmap(NULL, sizeof(struct nss_mcdb_stats), PROT_READ,
+                 MAP_SHARED, fd, 0);
+    (void)nointr_close(fd);
+    if (stats == MAP_FAILED
+        || stats->magic   != NSS_MCDB_STATS_MAGIC
+        || stats->version != NSS_MCDB_STATS_VERSION
+        || stats->ndb     != NSS_DBTYPE_SENTINEL
+        || stats->nlat    != NSS_MCDB_STATS_NLAT) {
+        fputs("nss_mcdbctl: stats: invalid " NSS_MCDB_STATSPATH "\n", stderr);
+        return 1;
+    }
 
+    for (int i = 0; i < NSS_DBTYPE_SENTINEL; ++i) {
+        const struct nss_mcdb_stats_db * const sdb = &stats->db[i];
+        int j;
+        if (sdb->calls == 0 && sdb->opens == 0 && sdb->reopens == 0)
+            continue;
+        printf("%-10s calls %llu hits %llu notfound %llu tryagain %llu"
+               " opens %llu reopens %llu\n", dbnames[i],
+               (unsigned long long)sdb->calls,
+               (unsigned long long)sdb->hits,
+               (unsigned long long)sdb->notfound,
+               (unsigned long long)sdb->tryagain,
+               (unsigned long long)sdb->opens,
+               (unsigned long long)sdb->reopens);
+        printf("%-10s lat_ns", dbnames[i]);
+        for (j = 0; j < NSS_MCDB_STATS_NLAT-1; ++j)
+            printf(" <%lu %llu", 256uL << j, (unsigned long long)sdb->lat[j]);
+        printf(" >=%lu %llu\n", 256uL << (j-1),
+               (unsigned long long)sdb->lat[j]);
+    }
+
+    munmap((void *)(uintptr_t)stats, sizeof(struct nss_mcdb_stats));
+    return fflush(stdout) == 0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
     const long sc_getpw_r_size_max = sysconf(_SC_GETPW_R_SIZE_MAX);
     const long sc_getgr_r_size_max = sysconf(_SC_GETGR_R_SIZE_MAX);
     const long sc_host_name_max    = sysconf(_SC_HOST_NAME_MAX);
 
-    struct fdb_st {
-      const char * const restrict file;
-      const char * const restrict mcdbfile;
-      size_t datasz;
-      bool (*parse)(struct nss_mcdb_make_winfo * restrict,
-                    char * restrict);
-      bool (*encode)(struct nss_mcdb_make_winfo * restrict,
-                     const void *);
-      bool (*flush)(struct nss_mcdb_make_winfo * restrict);
-    };
-
     /* database parse routines and max buffer size required for entry from db
      * (HDRSZ + 1 KB buffer for db that do not specify max buf size) */
     const struct fdb_st fdb[] = {
@@ -124,13 +235,13 @@ int main(void)
           NSS_HE_HDRSZ+1024,
           nss_mcdb_netdb_make_hosts_parse,
           nss_mcdb_netdb_make_hostent_encode,
-          NULL },
+          nss_mcdb_netdb_make_hosts_flush },
         { "/etc/networks",
           "/etc/mcdb/networks.mcdb",
           NSS_NE_HDRSZ+1024,
           nss_mcdb_netdb_make_networks_parse,
           nss_mcdb_netdb_make_netent_encode,
-          NULL },
+          nss_mcdb_netdb_make_networks_flush },
         { "/etc/protocols",
           "/etc/mcdb/protocols.mcdb",
           NSS_PE_HDRSZ+1024,
@@ -151,17 +262,24 @@ int main(void)
           NULL }
     };
 
-    struct mcdb_make m;
+    enum { NFDB = sizeof(fdb)/sizeof(struct fdb_st) };
+    struct nss_mcdbctl_db db[NFDB];
+  #ifdef _THREAD_SAFE
+    pthread_t tid[NFDB];
+    int nthr = 0;
+  #endif
     struct stat st;
     time_t mtime;
     const time_t mtime_nsswitch =
       (stat("/etc/nsswitch.conf", &st) == 0) ? st.st_mtime : 0;
-    bool rc = false;
+    bool rc = true;
+    int i, n = 0;
 
-    if (wbuf->buf == NULL || w.data == NULL) {
-        free(w.data);
-        free(wbuf->buf);
-        return -1;
+    if (argc == 2 && 0 == strcmp(argv[1], "stats"))
+        return nss_mcdbctl_stats();
+    if (argc > 1) {
+        fputs("usage: nss_mcdbctl [stats]\n", stderr);
+        return 1;
     }
 
     /* Arbitrarily limit mcdb line to 32K
@@ -170,31 +288,15 @@ int main(void)
     if (   sc_getpw_r_size_max <= 0 || SHRT_MAX < sc_getpw_r_size_max
         || sc_getgr_r_size_max <= 0 || SHRT_MAX < sc_getgr_r_size_max
         || sc_host_name_max    <= 0 || SHRT_MAX < sc_host_name_max   ) {
-        free(w.data);
-        free(wbuf->buf);
         return -1;  /* should not happen */
     }
 
-    /* (mcdb line must fit in WBUFSZ, including key, value, mcdb line tokens) */
-    assert(DBUFSZ*2 <= WBUFSZ);
-
-    /* initialize struct mcdb_make for writing .mcdb  */
-    memset((wbuf->m = &m), '\0', sizeof(struct mcdb_make));
-    m.fn_malloc = malloc;
-    m.fn_free   = free;
-
-    /* parse databases */
+    /* select databases to make and create temporary mcdb for each */
     /* (parse /etc/shadow (fdb[0]) only if root, else begin with fdb[1]) */
-    for (int i = (0==geteuid() ? 0 : 1);
-             i < (int)(sizeof(fdb)/sizeof(struct fdb_st)); ++i) {
-        w.datasz = fdb[i].datasz;
-        w.encode = fdb[i].encode;
-        w.flush  = fdb[i].flush;
-        assert(w.datasz <= DBUFSZ);
+    for (i = (0==geteuid() ? 0 : 1); i < (int)NFDB; ++i) {
 
         /* preserve permission modes if previous mcdb exists; else read-only
          * (since mcdb is *constant* -- not modified -- after creation) */
-        rc = false;
         if (stat(fdb[i].file, &st) != 0) {
             if (errno == ENOENT)
                 continue; /* skip dbs that do not exist; leave existing mcdb */
@@ -210,22 +312,40 @@ int main(void)
             if (errno != ENOENT)
                 break;
         }
-        if (mtime < st.st_mtime && mtime_nsswitch < st.st_mtime) {
-            rc = true;
+        if (mtime < st.st_mtime && mtime_nsswitch < st.st_mtime)
             continue;  /* dbfile up-to-date (redo if time matches) */
-        }
-        if (0 != mcdb_makefn_start(wbuf->m, fdb[i].mcdbfile, malloc, free))
-            break;
-        wbuf->m->st_mode = st.st_mode;
-        rc =   nss_mcdb_make_dbfile(&w, fdb[i].file, fdb[i].parse)
-            && mcdb_makefn_finish(wbuf->m, true) == 0;
-        mcdb_makefn_cleanup(wbuf->m);
-        if (!rc)
+
+        /* initialize struct mcdb_make for writing .mcdb  */
+        memset(&db[n].m, '\0', sizeof(struct mcdb_make));
+        if (0 != mcdb_makefn_start(&db[n].m, fdb[i].mcdbfile, malloc, free))
             break;
+        db[n].m.st_mode = st.st_mode;
+        db[n].fdb = fdb+i;
+        ++n;
     }
+    if (i < (int)NFDB)
+        rc = false; /* databases selected before error are still made */
 
-    free(w.data);
-    free(wbuf->buf);
+    /* make databases concurrently (make last db in main thread) */
+  #ifdef _THREAD_SAFE
+    for (i = 0; i < n-1; ++i) {
+        if (0==pthread_create(&tid[nthr],NULL,nss_mcdbctl_make_thread,db+i))
+            ++nthr;
+        else
+            nss_mcdbctl_make_thread(db+i);
+    }
+  #else
+    for (i = 0; i < n-1; ++i)
+        nss_mcdbctl_make_thread(db+i);
+  #endif
+    if (n != 0)
+        nss_mcdbctl_make_thread(db+n-1);
+  #ifdef _THREAD_SAFE
+    for (i = 0; i < nthr; ++i)
+        pthread_join(tid[i], NULL);
+  #endif
+    for (i = 0; i < n; ++i)
+        rc &= db[i].rc;
 
     return !rc;
 }
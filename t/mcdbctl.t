@@ -208,6 +208,21 @@ echo '--- mcdbmake handles absurd klen'
 echo '+4294967210' | mcdbmake test.mcdb - 2>/dev/null
 rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
 
+echo '--- mcdbmake handles leading zeros and misplaced separators'
+printf '+3,5:one->Hello\n+00000003,000000007:two->Goodbye\n+3,5:six->Hello\n\n' \
+  > test.in
+mcdbmake test.mcdb test.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "$(mcdbget test.mcdb two)$(mcdbget test.mcdb six)" = "GoodbyeHello" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+for i in '+3,4:one->Hello' '+3,5:one-<Hello' '+3,5one->Hello' '+,5:one->Hello'
+do
+  printf '+3,5:one->Hello\n%s\n+3,5:six->Hello\n\n' "$i" > test.in
+  mcdbmake test.mcdb test.in 2>/dev/null
+  rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+done
+rm -f test.in
+
 echo '--- mcdbget handles empty file'
 touch empty.mcdb
 mcdbget empty.mcdb foo 2>/dev/null
@@ -222,6 +237,36 @@ rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
 cmp ../random.in random.dump >/dev/null
 rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
 
+echo '--- mcdbctl dump -j 3 | -F raw dumps in segments; same records'
+mcdbctl dump -j 3 random.mcdb | cmp ../random.in - >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+awk 'BEGIN {
+  for (i = 0; i < 20000; ++i) {
+    k = "key" i
+    d = (i % 5) ? ((i % 3) ? "same data" : "data " i) : sprintf("%05000d", i)
+    printf "+%d,%d:%s->%s\n", length(k), length(d), k, d
+  }
+  print ""
+}' > seg.in
+mcdbctl make seg.mcdb seg.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl dump -j 3 seg.mcdb | cmp seg.in - >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl dump -F raw seg.mcdb > seg.raw
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl make -V share seg.mcdb seg.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl dump -j 3 -F raw seg.mcdb | cmp seg.raw - >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf '+3,5:one->Hello\n+0,0:->\n\n' | mcdbctl make seg.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf '\0\0\0\003\0\0\0\005oneHello\0\0\0\0\0\0\0\0' > seg.raw
+mcdbctl dump -F raw seg.mcdb | cmp seg.raw - >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl dump -j 0 seg.mcdb 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+rm -f seg.in seg.mcdb seg.raw
+
 echo '--- mcdbtest handles random.mcdb'
 mcdbtest random.mcdb
 rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
@@ -230,6 +275,819 @@ echo '--- mcdbstats handles random.mcdb'
 mcdbstats random.mcdb >/dev/null
 rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
 
+echo '--- mcdbctl make -H fast handles random.mcdb'
+mcdbctl make -H fast random.mcdb - < ../random.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbdump random.mcdb > random.dump
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp ../random.in random.dump >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbtest random.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbctl make -H fast handles repeated keys and uniq'
+echo '+3,5:one->Hello
++3,7:one->Goodbye
++3,4:two->Rain
+' | mcdbctl make -H fast test.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbget test.mcdb one 1
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl uniq test.mcdb last
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbget test.mcdb one
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbget test.mcdb two
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbctl make -B 10 filter handles random.mcdb'
+mcdbctl make -B 10 random.mcdb - < ../random.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbdump random.mcdb > random.dump
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp ../random.in random.dump >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbtest random.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbget with filter exits 100 on nonexistent data'
+echo '+3,5:one->Hello
++3,7:two->Goodbye
+' | mcdbctl make -B 10 -H fast test.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbget test.mcdb two
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbget test.mcdb three
+rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbctl make -I bucket handles random.mcdb'
+mcdbctl make -I bucket random.mcdb - < ../random.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbdump random.mcdb > random.dump
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp ../random.in random.dump >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbtest random.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbctl make -I bucket handles repeated and long keys'
+longkey=`awk 'BEGIN { while (i++ < 70000) printf "k" }'`
+printf '+3,4:one->Here\n+3,7:one->Goodbye\n+3,4:two->Rain\n+70000,1:%s->x\n\n' \
+  "$longkey" | mcdbctl make -I bucket -H fast test.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbtest test.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbget test.mcdb one 1
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbget test.mcdb "$longkey" >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbget test.mcdb "k$longkey"
+rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+mcdbctl uniq test.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbget test.mcdb one
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbctl make -I packed handles random.mcdb'
+mcdbctl make -I packed random.mcdb - < ../random.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbdump random.mcdb > random.dump
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp ../random.in random.dump >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbtest random.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbctl make -I mphf handles random.mcdb'
+mcdbctl make -I mphf random.mcdb - < ../random.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbdump random.mcdb > random.dump
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp ../random.in random.dump >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbtest random.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbctl make -I mphf handles repeated keys'
+echo '+3,4:one->Here
++3,7:one->Goodbye
++3,4:two->Rain
+' | mcdbctl make -I mphf -B 10 test.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbtest test.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbget test.mcdb one 1
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbget test.mcdb two
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbget test.mcdb three
+rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbctl make -E native handles random.mcdb'
+for i in classic bucket packed mphf; do
+  mcdbctl make -E native -I $i random.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbdump random.mcdb > random.dump
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  cmp ../random.in random.dump >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbtest random.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+done
+
+echo '--- mcdbctl make -j 4 output identical to serial make'
+for i in classic bucket packed mphf; do
+  mcdbctl make -B 10 -I $i random.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  cp random.mcdb random.serial
+  mcdbctl make -j 4 -B 10 -I $i random.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  cmp random.serial random.mcdb >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  rm -f random.serial
+done
+
+echo '--- mcdbctl make -j 3 parses input file in parallel; same records'
+awk 'BEGIN {
+  for (i = 0; i < 100000; ++i) {
+    k = "key" (i % 70000)
+    d = (i % 7) ? "data " i : "\n+3,1:key->x\n" i
+    printf "+%d,%d:%s->%s\n", length(k), length(d), k, d
+  }
+  print ""
+}' > par.in
+for o in "-U all" "-U last" "-C slot"; do
+  mcdbctl make $o par.mcdb par.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbdump par.mcdb > par.serial
+  mcdbctl make -j 3 $o par.mcdb par.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbdump par.mcdb > par.dump
+  cmp par.serial par.dump >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+done
+cmp par.in par.dump >/dev/null
+rc=$?; [ $rc -ne 0 ] || echo 1>&2 "FAIL $rc"
+awk 'NR == 60000 { print "+3,5:key->data" } { print }' par.in > par.bad
+mcdbctl make -j 3 par.mcdb par.bad 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+awk 'NR == 60000 && /^\+/ { print "" } { print }' par.in > par.bad
+mcdbctl make par.mcdb par.bad
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbdump par.mcdb > par.serial
+mcdbctl make -j 3 par.mcdb par.bad
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbdump par.mcdb > par.dump
+cmp par.serial par.dump >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+rm -f par.in par.bad par.mcdb par.serial par.dump
+
+echo '--- mcdbctl make -F tsv|ndjson|fixed ingests lines; same as cdbmake input'
+printf '+3,5:one->Hello\n+3,9:two->a\tGoodbye\n+5,3:three->a\tb\n+4,0:four->\n\n' \
+  > fmt.in
+mcdbctl make fmt.mcdb fmt.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbdump fmt.mcdb > fmt.serial
+printf 'Hello\tone\na\ttwo\tGoodbye\r\n\na\tthree\tb\n\tfour' > fmt.txt
+mcdbctl make -F tsv -K 2 fmt.mcdb fmt.txt
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbdump fmt.mcdb | cmp fmt.serial - >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+tr '\t' , < fmt.txt | mcdbctl make -F tsv -K 2 -d , fmt.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "$(mcdbget fmt.mcdb two)" = "a,Goodbye" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf '{"id":"one","v":1}\n{ "v":{"id":"x"}, "id" : "t\\u00e9\\"o" }\n{"id":3}\n' \
+  > fmt.txt
+mcdbctl make -F ndjson -K id fmt.mcdb - < fmt.txt
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "$(mcdbget fmt.mcdb one)$(mcdbget fmt.mcdb 3)" = '{"id":"one","v":1}{"id":3}' ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbget fmt.mcdb "$(printf 't\303\251"o')" >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf 'AB  123\nCDE 4\nFGHI56\nX\n' > fmt.txt
+mcdbctl make -F fixed -K 0,4 fmt.mcdb fmt.txt
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "$(mcdbget fmt.mcdb CDE)$(mcdbget fmt.mcdb FGHI)$(mcdbget fmt.mcdb X)" = "456" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+for i in 'tsv -K 3' 'ndjson -K v' 'fixed -K 1,2'; do
+  mcdbctl make -F $i fmt.mcdb fmt.txt 2>/dev/null
+  rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+done
+mcdbctl make -F ndjson fmt.mcdb fmt.txt 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+awk 'BEGIN {
+  for (i = 0; i < 100000; ++i)
+    printf "{\"n\":%d,\"id\":\"key%d\",\"d\":\"data %d\"}\n", i, i % 70000, i
+}' > fmt.txt
+mcdbctl make -F ndjson -K id fmt.mcdb - < fmt.txt
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbdump fmt.mcdb > fmt.serial
+mcdbctl make -j 3 -F ndjson -K id fmt.mcdb fmt.txt
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbdump fmt.mcdb | cmp fmt.serial - >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+rm -f fmt.in fmt.txt fmt.mcdb fmt.serial
+
+echo '--- mcdbctl make inflates gzip input file or stdin; same records'
+if command -v gzip >/dev/null \
+   && printf '\n' | gzip -c | mcdbctl make gz.mcdb - 2>/dev/null; then
+  awk 'BEGIN {
+    for (i = 0; i < 100000; ++i)
+      printf "+%d,%d:key%d->data %d\n", length("key" i), length("data " i), i, i
+    print ""
+  }' > gz.in
+  mcdbctl make gz.mcdb gz.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbdump gz.mcdb > gz.serial
+  head -c 1000000 gz.in | gzip -c > gz.in.gz
+  tail -c +1000001 gz.in | gzip -c >> gz.in.gz
+  mcdbctl make gz.mcdb gz.in.gz
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbdump gz.mcdb | cmp gz.serial - >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl make gz.mcdb - < gz.in.gz
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbdump gz.mcdb | cmp gz.serial - >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  head -c 100000 gz.in.gz > gz.bad
+  mcdbctl make gz.mcdb gz.bad 2>/dev/null
+  rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+  rm -f gz.in gz.in.gz gz.bad gz.serial
+fi
+printf '\050\265\057\375zstd' | mcdbctl make gz.mcdb - 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+rm -f gz.mcdb
+
+echo '--- mcdbctl make -S spills hash list; output identical'
+for i in classic mphf; do
+  mcdbctl make -B 10 -I $i random.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  cp random.mcdb random.serial
+  mcdbctl make -S . -B 10 -I $i random.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  cmp random.serial random.mcdb >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  rm -f random.serial
+done
+mcdbctl make -S ./nonexistent random.mcdb - < ../random.in 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbctl make -O write|direct output identical to mmap output'
+# (input larger than initial mmap window, so that write buffer is used)
+for i in 1 2 3 4 5 6 7 8 9 10 11 12; do sed '$d' ../random.in; done >random.x
+echo >>random.x
+for i in classic packed mphf; do
+  mcdbctl make -O mmap -I $i random.mcdb random.x
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  cp random.mcdb random.serial
+  for o in write direct; do
+    mcdbctl make -O $o -I $i random.mcdb random.x
+    rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+    cmp random.serial random.mcdb >/dev/null
+    rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  done
+  rm -f random.serial
+done
+rm -f random.x
+
+echo '--- mcdbctl make -U first|last drops records with duplicated keys'
+printf '+3,1:abc->1\n+3,1:def->2\n+3,1:abc->3\n+1,1:z->4\n+3,1:abc->5\n\n' \
+  > dup.in
+printf '+3,1:abc->1\n+3,1:def->2\n+1,1:z->4\n\n' > dup.first
+printf '+3,1:abc->5\n+3,1:def->2\n+1,1:z->4\n\n' > dup.last
+for i in classic bucket packed mphf; do
+  for u in first last; do
+    mcdbctl make -I $i -U $u random.mcdb dup.in
+    rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+    mcdbdump random.mcdb > random.dump
+    rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+    cmp dup.$u random.dump >/dev/null
+    rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+    mcdbctl make -I $i -U $u -C slot random.mcdb dup.in
+    rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+    [ "$(mcdbctl get random.mcdb abc all)" = "$(sed -n 1p dup.$u | cut -d'>' -f2)" ]
+    rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  done
+done
+mcdbctl make -U first random.mcdb - < ../random.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbdump random.mcdb > random.dump
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp ../random.in random.dump >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+
+echo '--- mcdbctl make -U reject rejects duplicated key'
+mcdbctl make -U reject random.mcdb dup.in 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+mcdbctl make -U reject random.mcdb - < ../random.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+rm -f dup.in dup.first dup.last
+
+echo '--- mcdbctl make -V share shares identical data among records'
+v=0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef
+printf '+2,64:k1->%s\n+2,64:k2->%s\n+2,3:k3->abc\n+2,64:k4->%s\n\n' \
+  $v $v $v > share.in
+for i in classic bucket packed mphf; do
+  mcdbctl make -I $i random.mcdb share.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  cp random.mcdb random.serial
+  mcdbctl make -V share -I $i random.mcdb share.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  [ $(wc -c < random.mcdb) -lt $(wc -c < random.serial) ]
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbdump random.mcdb > random.dump
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  cmp share.in random.dump >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  [ "$(mcdbctl get random.mcdb k4)" = "$v" ]
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl make -V share -I $i -C slot -U last random.mcdb share.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  [ "$(mcdbctl get random.mcdb k2)$(mcdbctl get random.mcdb k3)" = "${v}abc" ]
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  rm -f random.serial
+done
+mcdbctl make -V share random.mcdb share.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf '+2,1:k1->-\n+2,2:k5->+x\n\n' > share.in
+mcdbctl make share.mcdb share.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl update random.new random.mcdb share.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "$(mcdbctl get random.new k2)$(mcdbctl get random.new k4)" = "$v$v" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl get random.new k1 >/dev/null
+rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+rm -f share.in share.mcdb random.new
+
+echo '--- mcdbctl make -Z compresses data with -D preset dictionary'
+v='{"name":"user","shell":"/bin/sh","home":"/home/user","groups":["wheel"]}'
+printf "$v" > zdict.in
+: > zdata.in
+for i in 1 2 3 4 5 6 7 8; do
+  printf '+2,%d:k%d->%s\n' ${#v} $i "$v" >> zdata.in
+done
+printf '+2,3:k9->abc\n+2,%d:k1->%s\n\n' ${#v} "$v" >> zdata.in
+if mcdbctl make -Z 1 random.mcdb zdata.in 2>/dev/null; then
+  mcdbctl make random.mcdb zdata.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  cp random.mcdb random.serial
+  for o in "" "-C slot" "-V share" "-I mphf -O write"; do
+    mcdbctl make -Z 6 -D zdict.in $o random.mcdb zdata.in
+    rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+    [ $(wc -c < random.mcdb) -lt $(wc -c < random.serial) ]
+    rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+    mcdbdump random.mcdb > random.dump
+    rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+    [ -n "$o" ] || cmp zdata.in random.dump >/dev/null
+    rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+    [ "$(mcdbctl get random.mcdb k4)$(mcdbctl get random.mcdb k9)" = "${v}abc" ]
+    rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  done
+  mcdbctl make -Z 6 -D zdict.in random.mcdb zdata.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl uniq random.mcdb last
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  [ "$(mcdbctl get random.mcdb k1)" = "$v" ]
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  printf '+2,1:k2->-\n+3,4:k10->+xyz\n\n' > zdelta.in
+  mcdbctl make zdelta.mcdb zdelta.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl update random.new random.mcdb zdelta.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  [ "$(mcdbctl get random.new k3)$(mcdbctl get random.new k10)" = "${v}xyz" ]
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl get random.new k2 >/dev/null
+  rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+  rm -f random.serial random.new zdelta.in zdelta.mcdb
+fi
+rm -f zdict.in zdata.in
+
+echo '--- mcdb_make_writer_start() parallel writers match serial make'
+testmcdbmake serial.mcdb 10000
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+testmcdbmake writers.mcdb 10000 3
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl dump serial.mcdb > serial.dump
+mcdbctl dump writers.mcdb > writers.dump
+cmp serial.dump writers.dump >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbtest writers.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+echo '--- mcdb_makefn_start_memfd() in-memory make matches file make'
+testmcdbmake - 10000 > memfd.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp serial.mcdb memfd.mcdb >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+testmcdbmake - 10000 3 > memfd.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl dump memfd.mcdb | cmp serial.dump - >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+rm -f serial.mcdb writers.mcdb serial.dump writers.dump memfd.mcdb
+
+echo '--- mcdbctl make -C slot clusters data section; same records'
+mcdbctl make random.mcdb - < ../random.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbdump random.mcdb | LC_ALL=C sort > random.serial
+for i in classic bucket mphf; do
+  mcdbctl make -C slot -I $i random.mcdb - < ../random.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbdump random.mcdb | LC_ALL=C sort | cmp random.serial - >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbtest random.mcdb
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+done
+rm -f random.serial
+printf '+3,2:two->50\n\n' | mcdbctl make weights.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf '+3,1:one->1\n+3,1:two->2\n+5,1:three->3\n\n' \
+  | mcdbctl make -W weights.mcdb test.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "`mcdbdump test.mcdb | head -1`" = "+3,1:two->2" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "`mcdbget test.mcdb three`" = "3" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+rm -f weights.mcdb test.mcdb
+
+echo '--- mcdbctl update applies delta; matches full make'
+printf '+3,1:one->1\n+3,1:two->2\n+5,1:three->3\n+4,1:four->4\n\n' \
+  | mcdbctl make test.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf '+3,3:two->=22\n+5,1:three->-\n+4,3:four->+44\n+4,2:five->+5\n\n' \
+  | mcdbctl make delta.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf '+3,1:one->1\n+4,1:four->4\n+3,2:two->22\n+4,2:four->44\n+4,1:five->5\n\n' \
+  | mcdbctl make full.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl update update.mcdb test.mcdb delta.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cmp full.mcdb update.mcdb >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbget update.mcdb three
+rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+printf '+3,1:one->x\n\n' | mcdbctl make delta.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl update update.mcdb test.mcdb delta.mcdb 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+rm -f test.mcdb delta.mcdb full.mcdb update.mcdb
+
+echo '--- mcdbctl get - looks up batch of keys on stdin; same as get per key'
+printf '+3,1:one->1\n+3,2:one->11\n+3,1:two->2\n+0,1:->e\n+5,0:empty->\n\n' \
+  | mcdbctl make test.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf 'one\ntwo\n\nempty\none' | mcdbctl get test.mcdb - > batch.out
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "`cat batch.out`" = "`printf '1\n2\ne\n\n1'`" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf 'one\nthree\ntwo\n' | mcdbctl get test.mcdb - all > batch.out
+rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+printf '1\n11\n\n\n2\n\n' | cmp -s - batch.out
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf 'three\none\nfour\n' | mcdbctl get test.mcdb - > batch.out
+rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+printf '\n1\n\n' | cmp -s - batch.out
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf 'one\ntwo\n' | mcdbctl get test.mcdb - 1 > batch.out
+rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+printf '11\n\n' | cmp -s - batch.out
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf '\000\000\000\003one\000\000\000\005three\000\000\000\000' \
+  | mcdbctl get -F raw test.mcdb - all | od -An -tx1 | tr -d ' \n' > batch.out
+v=0000000131000000023131ffffffffffffffff0000000165ffffffff
+[ "`cat batch.out`" = "$v" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf '\000\000\000\003on' | mcdbctl get -F raw test.mcdb - 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+mcdbctl get -F raw test.mcdb one 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+awk 'BEGIN { while (i++ < 1000) { k = "k" i; d = "d" i
+  printf "+%d,%d:%s->%s\n", length(k), length(d), k, d
+  if (i % 3 == 0) printf "+%d,%d:%s->%s\n", length(k), length(d)+1, k, d "x"
+  } print "" }' | mcdbctl make test.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+awk 'BEGIN { while (i++ < 600) print "k" (i * 7 % 1300) }' > batch.keys
+mcdbctl get test.mcdb - all < batch.keys > batch.out
+rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+while read k; do mcdbget test.mcdb "$k" all; echo; done < batch.keys \
+  > batch.cmp
+cmp batch.out batch.cmp >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+rm -f test.mcdb batch.out batch.keys batch.cmp
+
+echo '--- mcdbctl get all writes values from map; same as batch get all'
+awk 'BEGIN { while (i++ < 600) { d = "d" i; if (i % 5 == 0) d = "dup"
+  printf "+1,%d:m->%s\n", length(d), d
+  if (i < 4) printf "+1,%d:f->%s\n", length(d), d
+  } print "+1,0:e->"; print "" }' > all.in
+for opt in "" "-V share" "-Z 1"; do
+  mcdbctl make $opt test.mcdb all.in 2>/dev/null || continue
+  for k in m f e; do
+    { mcdbctl get test.mcdb $k all; rc=$?; echo; } > batch.out
+    [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+    echo $k | mcdbctl get test.mcdb - all > batch.cmp
+    cmp batch.out batch.cmp >/dev/null
+    rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  done
+  [ "`mcdbctl get test.mcdb f all`" = "`printf 'd1\nd2\nd3'`" ]
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  [ "`mcdbctl get test.mcdb m all | wc -l`" -eq 600 ]
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl get test.mcdb x all
+  rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+done
+rm -f test.mcdb all.in batch.out batch.cmp
+
+echo '--- mcdbctl get -O aio looks up batch by mcdb_aio; same as mmap batch'
+awk 'BEGIN { while (i++ < 1000) { k = "k" i; d = "d" i
+  if (i % 97 == 0) while (length(d) < 3000) d = d "0123456789"
+  printf "+%d,%d:%s->%s\n", length(k), length(d), k, d
+  if (i % 3 == 0) printf "+%d,%d:%s->%s\n", length(k), length(d)+1, k, d "x"
+  } print "" }' > aio.in
+awk 'BEGIN { while (i++ < 600) print "k" (i * 7 % 1300) }' > batch.keys
+for opt in "-I classic" "-I bucket" "-I packed" "-V share" "-E native"; do
+  mcdbctl make $opt test.mcdb aio.in
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl get test.mcdb - < batch.keys > batch.cmp
+  mcdbctl get -O aio test.mcdb - < batch.keys > batch.out
+  rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+  cmp batch.out batch.cmp >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+done
+printf '\000\000\000\003k97\000\000\000\003k-1\000\000\000\002k3' \
+  > batch.keys
+mcdbctl get -F raw test.mcdb - < batch.keys > batch.cmp
+mcdbctl get -O aio -F raw test.mcdb - < batch.keys > batch.out
+rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+cmp batch.out batch.cmp >/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl get -O aio test.mcdb - all < /dev/null 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+mcdbctl make -I mphf test.mcdb aio.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+echo k1 | mcdbctl get -O aio test.mcdb - 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+rm -f test.mcdb aio.in batch.out batch.keys batch.cmp
+
+echo '--- mcdbctl serve answers memcache and raw requests; hot swaps mcdb'
+if perl -MIO::Socket::INET -e 1 2>/dev/null; then
+  serveq () {
+    perl -MIO::Socket::INET -e '
+      for (1..50) { last if $s = IO::Socket::INET->new("127.0.0.1:$ARGV[0]");
+                    select(undef, undef, undef, 0.1) }
+      $s or exit 1; local $/; $r = <STDIN>; print $s $r; shutdown($s, 1);
+      print <$s>' "$1"
+  }
+  port=`expr 20000 + $$ % 10000`
+  printf '+3,1:one->1\n+3,2:two->22\n\n' | mcdbctl make test.mcdb -
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  printf '+3,1:one->x\n+5,3:three->333\n\n' | mcdbctl make test2.mcdb -
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  mcdbctl serve -b 127.0.0.1 -p $port -j 2 test.mcdb test2.mcdb &
+  pid=$!
+  printf 'get one two three four\r\ngets one\r\nversion\r\n%s\r\nz\r\n' \
+    'set a 0 0 1' | serveq $port | tr -d '\r' > serve.out
+  printf 'VALUE one 0 1\n1\nVALUE two 0 2\n22\nVALUE three 0 3\n333\nEND\n' \
+    > serve.cmp
+  printf 'VALUE one 0 1 0\n1\nEND\nVERSION mcdb\nSERVER_ERROR read-only\n' \
+    >> serve.cmp
+  cmp serve.out serve.cmp >/dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  printf '+3,1:one->9\n\n' | mcdbctl make test.mcdb -
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  sleep 2
+  [ "`printf 'get one\r\n' | serveq $port | tr -d '\r'`" = "`printf \
+     'VALUE one 0 1\n9\nEND'`" ]
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  kill $pid; wait $pid 2>/dev/null
+  port=`expr $port + 1`
+  mcdbctl serve -b 127.0.0.1 -p $port -P raw test.mcdb &
+  pid=$!
+  [ "`printf '\000\000\000\003one\000\000\000\004four' | serveq $port \
+      | od -An -tx1 | tr -d ' \n'`" = "0000000139ffffffff" ]
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  kill $pid; wait $pid 2>/dev/null
+  mcdbctl serve -P raw -u $port test.mcdb 2>/dev/null
+  rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+  rm -f test.mcdb test2.mcdb serve.out serve.cmp
+fi
+
+echo '--- mcdbctl shard splits mcdb into shard set; get routes key to shard'
+awk 'BEGIN { while (i++ < 1000) { k = "k" i; d = "d" i
+  printf "+%d,%d:%s->%s\n", length(k), length(d), k, d
+  if (i % 3 == 0) printf "+%d,%d:%s->%s\n", length(k), length(d)+1, k, d "x"
+  } print "" }' | mcdbctl make -H fast test.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl shard -j 2 set.shard 4 test.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "`sed -n '1p;$p' set.shard`" = "`printf 'mcdb-shard 1 4\nset.shard.3-of-4'`" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+for i in 0 1 2 3; do mcdbctl dump set.shard.$i-of-4; done | sort > shard.out
+mcdbctl dump test.mcdb | sort > shard.cmp
+[ "`uniq shard.out`" = "`uniq shard.cmp`" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "`mcdbctl get set.shard k999 all`" = "`printf 'd999\nd999x'`" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "`mcdbctl get set.shard k999 1`" = "d999x" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl get set.shard k1001
+rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+mcdbctl dump set.shard 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+mcdbctl shard set.shard 0 test.mcdb 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+rm -f test.mcdb set.shard set.shard.*-of-4 shard.out shard.cmp
+
+echo '--- mcdbctl make -T tombstones; get, dump -L layer delta over base'
+printf '+1,1:a->1\n+1,1:b->2\n+1,1:c->3\n+1,2:d->4a\n+1,2:d->4b\n\n' \
+  | mcdbctl make -B 10 test.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf '+1,1:b->-\n+1,2:c->33\n+1,1:d->-\n+1,2:d->44\n+1,1:f->-\n\n' \
+  | mcdbctl make -B 10 -C slot -T - delta.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "`mcdbctl get -L delta.mcdb test.mcdb a`" = "1" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl get -L delta.mcdb test.mcdb b
+rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+[ "`mcdbctl get -L delta.mcdb test.mcdb c all`" = "33" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "`mcdbctl get -L delta.mcdb test.mcdb d all`" = "44" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl get -L delta.mcdb test.mcdb f
+rc=$?; [ $rc -eq 100 ] || echo 1>&2 "FAIL $rc"
+mcdbctl dump -L delta.mcdb test.mcdb | sort > layer.out
+printf '\n+1,1:a->1\n+1,2:c->33\n+1,2:d->44\n' > layer.cmp
+cmp -s layer.out layer.cmp
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl dump -j 2 -L delta.mcdb test.mcdb 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+rm -f test.mcdb delta.mcdb layer.out layer.cmp
+
+echo '--- mcdbctl make -X sorted; dump -P scans key prefix in key order'
+printf '+3,1:abc->1\n+2,1:ab->2\n+4,1:abce->3\n+1,1:b->4\n' > sorted.in
+printf '+3,1:abd->5\n+3,1:abc->6\n\n' >> sorted.in
+mcdbctl make -X sorted -I mphf -B 10 test.mcdb sorted.in
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl dump -P abc test.mcdb > sorted.out
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf '+3,1:abc->1\n+3,1:abc->6\n+4,1:abce->3\n\n' > sorted.cmp
+cmp -s sorted.out sorted.cmp
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl dump -P '' test.mcdb | sed -n '1p;$!h;${x;p}' > sorted.out
+printf '+2,1:ab->2\n+1,1:b->4\n' > sorted.cmp
+cmp -s sorted.out sorted.cmp
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "`mcdbctl dump -P zz test.mcdb`" = "" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl uniq test.mcdb last
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "`mcdbctl dump -P abc test.mcdb | head -1`" = "+3,1:abc->6" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf '+1,1:a->1\n\n' | mcdbctl make test.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl dump -P a test.mcdb 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+rm -f test.mcdb sorted.in sorted.out sorted.cmp
+
+echo '--- mcdbctl dump -R parts together hold each record once, in order'
+awk 'BEGIN { d = sprintf("%0100d", 0);
+  for (i = 0; i < 3000; i++)
+    printf "+%d,%d:k%d->%s\n", length(i)+1, i%97, i, substr(d, 1, i%97);
+  print "" }' | mcdbctl make -B 10 -X sorted test.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl dump test.mcdb | sed '$d' > range.cmp
+: > range.out
+for i in 0 1 2 3 4 5 6; do
+  mcdbctl dump -R $i/7 test.mcdb | sed '$d' >> range.out
+done
+cmp -s range.out range.cmp
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+: > range.out
+for i in 0 1 2; do
+  mcdbctl dump -j 2 -F raw -R $i/3 test.mcdb >> range.out
+done
+mcdbctl dump -F raw test.mcdb | cmp -s - range.out
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl dump -R 7/7 test.mcdb 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+rm -f test.mcdb range.out range.cmp
+
+echo '--- mcdbctl warm records access profile from key log; prefetches pages'
+awk 'BEGIN { while (i++ < 3000) { k = "k" i; d = "d" i "-0123456789abcdef"
+  printf "+%d,%d:%s->%s\n", length(k), length(d), k, d } print "" }' \
+  | mcdbctl make test.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl warm -k /dev/null test.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "`od -An -c -N8 test.mcdb.warm | tr -d ' '`" = "mcdbwarm" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ -z "`od -An -tx1 -j24 test.mcdb.warm | tr -d ' 0\n'`" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf 'k1\nk2999\nnone\n' | mcdbctl warm -k - test.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "`od -An -tx1 -j24 -N1 test.mcdb.warm | tr -d ' '`" = "03" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl warm test.mcdb && mcdbctl warm -j 3 test.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl warm -m -W resident.warm test.mcdb \
+  && mcdbctl warm -W resident.warm test.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+printf '+1,1:a->1\n\n' | mcdbctl make other.mcdb -
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl warm -W test.mcdb.warm other.mcdb 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+mcdbctl warm other.mcdb 2>/dev/null
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+mcdbctl warm -m -k - test.mcdb 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+rm -f test.mcdb test.mcdb.warm resident.warm other.mcdb
+
+echo '--- mcdbctl analyze reports layout; byte counts sum to size'
+awk 'BEGIN { while (i++ < 3000) { k = "k" i; d = "d" i "-0123456789abcdef"
+  printf "+%d,%d:%s->%s\n", length(k), length(d), k, d } print "" }' \
+  > test.in
+for opts in "" "-I bucket" "-I packed -B 10" "-I mphf -X sorted" "-Z 6" \
+            "-Y crc32c"; do
+  mcdbctl make $opts test.mcdb test.in \
+    && mcdbctl analyze test.mcdb > test.out \
+    && mcdbctl stats test.mcdb | sed -n 's/^\(d[0-9]\) */hit \1 /p' > test.d
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+  [ "`grep '^records ' test.out`" = "records 3000" ] \
+    && grep '^hit d[0-9] ' test.out | cmp -s - test.d \
+    && [ "`awk '/^size /{n=$2} /^bytes (header|data|sections|index|dead pad) /\
+           {n-=$NF} END {print n}' test.out`" = "0" ] \
+    && grep -q '^klen 4-7 ' test.out && grep -q '^miss lines avg ' test.out
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc ($opts)"
+done
+[ "`grep '^hit mphf ' test.out`" = "hit mphf 0" ] \
+  && mcdbctl make -I mphf test.mcdb test.in \
+  && mcdbctl analyze test.mcdb | grep -q '^hit mphf 3000$'
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+rm -f test.mcdb test.in test.out test.d
+
+echo '--- mcdbctl verify checks checksums written by make -Y crc32c'
+awk 'BEGIN { while (i++ < 3000) { k = "k" i; d = "d" i "-0123456789abcdef"
+  printf "+%d,%d:%s->%s\n", length(k), length(d), k, d } print "" }' \
+  > test.in
+for opts in "" "-I bucket" "-I mphf -B 10 -X sorted" "-E native -j 4"; do
+  mcdbctl make -Y crc32c $opts test.mcdb test.in \
+    && mcdbctl verify test.mcdb && mcdbctl verify -j 3 test.mcdb \
+    && mcdbctl get test.mcdb k2999 > /dev/null
+  rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc ($opts)"
+done
+mcdbctl uniq test.mcdb && mcdbctl verify test.mcdb
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+cp test.mcdb test2.mcdb && chmod u+w test2.mcdb \
+  && printf 'XXXX' | dd of=test2.mcdb bs=1 seek=5000 conv=notrunc 2>/dev/null
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "`mcdbctl verify -j 2 test2.mcdb 2>/dev/null`" = "bad block 0 offset 4096" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl verify test2.mcdb > /dev/null 2>&1
+rc=$?; [ $rc -eq 111 ] || echo 1>&2 "FAIL $rc"
+cp test.mcdb test2.mcdb && chmod u+w test2.mcdb \
+  && printf 'XXXXXXXX' | dd of=test2.mcdb bs=1 conv=notrunc 2>/dev/null \
+       seek=`wc -c < test.mcdb | awk '{print $1 - 8}'`
+[ "`mcdbctl verify test2.mcdb 2>/dev/null`" = "bad index" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl make test.mcdb test.in && mcdbctl verify test.mcdb 2>test.out
+rc=$?; [ $rc -eq 102 ] || echo 1>&2 "FAIL $rc"
+[ "`cat test.out`" = "mcdbctl: verify: no checksums (make -Y crc32c)" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+mcdbctl verify -j 0 test.mcdb 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+rm -f test.mcdb test2.mcdb test.in test.out
+
+echo '--- mcdbctl make rejects unknown hash'
+echo '' | mcdbctl make -H none test.mcdb - 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+
+
+echo '--- testmcdbbench reports make and query results, one line each'
+testmcdbbench make -m bucket -j 2 test.mcdb 3000 > test.out \
+  && testmcdbbench make -m writers -j 3 test.mcdb 3000 >> test.out \
+  && testmcdbbench query -t 2 -n 1000 -k zipf -c cold -r 1 test.mcdb 3000 \
+     >> test.out \
+  && testmcdbbench query -t 1 -n 1000 -k miss test.mcdb 3000 >> test.out \
+  && testmcdbbench query -t 3 -n 1000 test.mcdb 3000 >> test.out
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+[ "`grep -c '^bench=make mode=.* records=3000 bytes=[0-9]* secs=' test.out`" \
+  = "2" ] \
+  && grep -q '^bench=query mix=zipf cache=cold .*queries=2000 hits=2000 ' \
+     test.out \
+  && grep -q '^bench=query mix=miss .* p50_ns=[0-9]* p99_ns=' test.out \
+  && grep -q '^bench=query mix=uniform .* queries=3000 hits=3000 ' test.out \
+  && mcdbctl get test.mcdb 00002999 > /dev/null \
+  && [ -z "`ls test.mcdb.bench* 2>/dev/null`" ]
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+testmcdbbench query -k other test.mcdb 3000 2>/dev/null
+rc=$?; [ $rc -eq 101 ] || echo 1>&2 "FAIL $rc"
+rm -f test.mcdb test.out
+
+echo '--- first lookup after refresh to mcdb of other hash function finds key'
+testmcdbbench refresh test.mcdb 3000 \
+  | grep -q '^bench=refresh records=3000 swaps=2 lookups=6 hits=6$'
+rc=$?; [ $rc -eq 0 ] || echo 1>&2 "FAIL $rc"
+rm -f test.mcdb
 
 echo '--- testzero works'
 testzero 5 test.mcdb
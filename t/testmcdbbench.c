@@ -0,0 +1,690 @@
+/*
+ * testmcdbbench - benchmark harness for mcdb: lookup throughput and latency,
+ *                 build throughput
+ *
+ * Copyright (c) 2011, Glue Logic LLC. All rights reserved. code()gluelogic.com
+ *
+ *  This file is part of mcdb.
+ *
+ *  mcdb is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 2.1 of the License, or
+ *  (at your option) any later version.
+ *
+ *  mcdb is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with mcdb.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* testmcdbbench make  [-m mode] [-j threads] <fname> <count>
+ * testmcdbbench query [-t threads] [-n queries] [-k uniform|zipf|miss]
+ *                     [-c warm|cold] [-r refresh_ms] <fname> <count>
+ * testmcdbbench suite [-t threads] [-n queries] <fname> <count>
+ * testmcdbbench refresh <fname> <count>
+ *
+ * mcdb holds count records as made by testmcdbmake (8-byte keys "%08u" from
+ * 0 to count-1; data same as key).
+ *
+ * make: build mcdb in builder mode (classic, fast, bucket, packed, native,
+ *   mphf, bloom, sorted, share, write, fill, writers); fast hashes keys with
+ *   uint32_hash_fast() instead of uint32_hash_djb(); fill uses threads to fill
+ *   hash tables; writers adds records from threads writers (as testmcdbmake)
+ * query: threads readers each look up queries keys (per thread) of key mix
+ *   uniform (every key found), zipf (skewed; theta 0.99; hot keys scattered
+ *   across mcdb) or miss (90% of keys not found).  Page cache is warm (mcdb
+ *   prefaulted and read) or cold (mcdb evicted from page cache; requires
+ *   mcdb not be mapped by other processes).  If refresh_ms, mcdb is swapped
+ *   (copy renamed into place, then mcdb_mmap_reopen_threadsafe()) every
+ *   refresh_ms while readers move to new map (mcdb_thread_refresh_self()).
+ *   Latency of each lookup (and read of first byte of data) is measured.
+ * suite: make in each builder mode, then query each key mix, warm and cold,
+ *   with and without refresh, with 1 thread and with threads (default: num
+ *   of online cpus); mcdb in classic mode remains at fname
+ * refresh: make (classic) and register lookups on map, then remake with other
+ *   hash function (fast, then classic) and reopen map; first lookup after each
+ *   swap (mcdb_find() and mcdb_find_batch()) must find keys
+ *
+ * Each result is written as one line of space-separated name=value fields:
+ *   bench=make mode= threads= records= bytes= secs= rps=
+ *   bench=query mix= cache= threads= refresh_ms= queries= hits= swaps=
+ *     secs= qps= p50_ns= p99_ns= p999_ns= max_ns=
+ *   bench=refresh records= swaps= lookups= hits=
+ * (latency percentiles are lower bounds of histogram buckets of 1/16 of
+ *  power of 2) (e.g. "make bench" and compare with results of prior release)
+ */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 600
+#endif
+
+/* large file support needed for open() of mcdb > 2 GB */
+#define PLASMA_FEATURE_ENABLE_LARGEFILE
+#include "plasma/plasma_feature.h"
+
+#include "mcdb.h"
+#include "mcdb_make.h"
+#include "mcdb_error.h"
+#include "uint32.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>     /* open(), posix_fadvise() */
+#include <math.h>      /* pow() */
+#include <stdint.h>
+#include <stdio.h>     /* printf(), snprintf() */
+#include <stdlib.h>    /* malloc(), free(), strtoul() */
+#include <string.h>    /* memset(), strcmp() */
+#include <time.h>      /* clock_gettime(), nanosleep() */
+#include <unistd.h>    /* close(), link(), unlink(), sysconf() */
+#include <pthread.h>   /* pthread_create(), pthread_join() */
+
+#define BENCH_THREADS_MAX 256
+#define BENCH_HIST 976  /* (log2 buckets of 16 sub-buckets; 64-bit ns) */
+
+static volatile unsigned char bench_sink; /* (keeps reads of mcdb live) */
+
+struct bench;
+
+struct bench_reader {
+  struct bench *b;
+  pthread_t tid;
+  char *keys;                 /* n 8-byte keys */
+  unsigned long n;
+  unsigned long hits;
+  uint64_t hist[BENCH_HIST];  /* lookup latency (ns) */
+};
+
+struct bench {
+  struct mcdb_mmap *map;      /* shared map (readers register use) */
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int go;                     /* (under mutex) readers may start */
+  int done;                   /* (under mutex) readers finished */
+  uint32_t refresh_ms;
+  unsigned long swaps;
+  const char *fname;
+  char *alt[2];               /* copies of mcdb renamed over fname in turn */
+  char *tmp;
+};
+
+static uint64_t
+bench_now (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* histogram bucket: values below 16 exact; then 16 sub-buckets per power 2 */
+static uint32_t
+bench_hist_idx (const uint64_t v)
+{
+    uint32_t e;
+    if (v < 16)
+        return (uint32_t)v;
+    e = 63 - (uint32_t)__builtin_clzll(v);
+    return ((e - 3) << 4) | (uint32_t)((v >> (e - 4)) & 15);
+}
+
+static uint64_t
+bench_hist_val (const uint32_t i)
+{
+    return (i < 16) ? i : (uint64_t)(16 | (i & 15)) << ((i >> 4) - 1);
+}
+
+static uint64_t
+bench_hist_pct (const uint64_t * const hist, const uint64_t total,
+                const double p)
+{
+    const uint64_t rank = (uint64_t)(p * (double)total + 0.999999);
+    uint64_t n = 0;
+    uint32_t i;
+    for (i = 0; i < BENCH_HIST; ++i) {
+        if ((n += hist[i]) >= rank && hist[i])
+            return bench_hist_val(i);
+    }
+    return 0;
+}
+
+static void
+bench_key (char * const p, unsigned long u)
+{
+    int i;
+    for (i = 7; i >= 0; --i, u /= 10)
+        p[i] = (char)('0' + u % 10);
+}
+
+/* xorshift64* */
+static uint64_t
+bench_rand (uint64_t * const s)
+{
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * UINT64_C(2685821657736338717);
+}
+
+/* (Gray et al, "Quickly Generating Billion-Record Synthetic Databases") */
+struct bench_zipf {
+  double theta, zetan, alpha, eta, half;
+  unsigned long n;
+};
+
+static void
+bench_zipf_init (struct bench_zipf * const z, const unsigned long n,
+                 const double theta)
+{
+    double zeta2 = 1.0 + pow(0.5, theta);
+    unsigned long i;
+    z->zetan = 0.0;
+    for (i = 1; i <= n; ++i)
+        z->zetan += 1.0 / pow((double)i, theta);
+    z->theta = theta;
+    z->n     = n;
+    z->alpha = 1.0 / (1.0 - theta);
+    z->eta   = (1.0 - pow(2.0 / (double)n, 1.0 - theta))
+             / (1.0 - zeta2 / z->zetan);
+    z->half  = pow(0.5, theta);
+}
+
+static unsigned long
+bench_zipf_rank (const struct bench_zipf * const z, uint64_t * const s)
+{
+    const double u  = (double)(bench_rand(s) >> 11) / 9007199254740992.0;
+    const double uz = u * z->zetan;
+    unsigned long r;
+    if (uz < 1.0)
+        return 0;
+    if (uz < 1.0 + z->half)
+        return 1;
+    r = (unsigned long)((double)z->n * pow(z->eta*u - z->eta + 1.0, z->alpha));
+    return (r < z->n) ? r : z->n - 1;
+}
+
+static void *
+bench_reader (void *arg)
+{
+    struct bench_reader * const r = (struct bench_reader *)arg;
+    struct bench * const b = r->b;
+    struct mcdb m;
+    const char *k = r->keys;
+    uint64_t t, u;
+    unsigned long i;
+    memset(&m, '\0', sizeof(m));
+    m.map = mcdb_mmap_thread_registration(&b->map, MCDB_REGISTER_USE_INCR);
+    pthread_mutex_lock(&b->mutex);
+    while (!b->go)
+        pthread_cond_wait(&b->cond, &b->mutex);
+    pthread_mutex_unlock(&b->mutex);
+    if (m.map == NULL)
+        return NULL;
+    t = bench_now();
+    for (i = 0; i < r->n; ++i, k += 8) {
+        if (mcdb_find(&m, k, 8)) {
+            ++r->hits;
+            if (mcdb_datalen(&m))
+                bench_sink = *(const unsigned char *)mcdb_dataptr(&m);
+        }
+        u = bench_now();
+        ++r->hist[bench_hist_idx(u - t)];
+        t = u;
+    }
+    (void)mcdb_mmap_thread_registration(&m.map, MCDB_REGISTER_USE_DECR);
+    return NULL;
+}
+
+/* swap mcdb every refresh_ms until readers are done */
+static void *
+bench_refresher (void *arg)
+{
+    struct bench * const b = (struct bench *)arg;
+    struct timespec ts;
+    pthread_mutex_lock(&b->mutex);
+    while (!b->done) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += (long)(b->refresh_ms % 1000) * 1000000L;
+        ts.tv_sec  += (time_t)(b->refresh_ms / 1000 + ts.tv_nsec / 1000000000L);
+        ts.tv_nsec %= 1000000000L;
+        if (pthread_cond_timedwait(&b->cond, &b->mutex, &ts) == 0 || b->done)
+            continue;
+        pthread_mutex_unlock(&b->mutex);
+        if (link(b->alt[b->swaps & 1], b->tmp) == 0
+            && rename(b->tmp, b->fname) == 0
+            && mcdb_mmap_reopen_threadsafe(&b->map))
+            ++b->swaps;
+        else
+            perror("swap");
+        pthread_mutex_lock(&b->mutex);
+    }
+    pthread_mutex_unlock(&b->mutex);
+    return NULL;
+}
+
+static int
+bench_copy (const char * const src, const char * const dst)
+{
+    static char buf[1u << 20];
+    ssize_t r = -1;
+    const int ifd = open(src, O_RDONLY, 0);
+    const int ofd = open(dst, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (ifd != -1 && ofd != -1) {
+        while ((r = read(ifd, buf, sizeof(buf))) > 0
+               && write(ofd, buf, (size_t)r) == r)
+            ;
+    }
+    if (ifd != -1) close(ifd);
+    if (ofd != -1 && close(ofd) != 0) r = -1;
+    return (r == 0) ? 0 : -1;
+}
+
+/* evict file from page cache (sync first, since dirty pages are not evicted)*/
+static void
+bench_evict (const char * const fname)
+{
+    const int fd = open(fname, O_RDONLY, 0);
+    if (fd == -1)
+        return;
+    (void)fsync(fd);
+  #ifdef POSIX_FADV_DONTNEED
+    (void)posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  #endif
+    close(fd);
+}
+
+static int
+bench_query (const char * const fname, const unsigned long nrec,
+             const uint32_t nthreads, const unsigned long nq,
+             const char * const mix, const char * const cache,
+             const uint32_t refresh_ms)
+{
+    struct bench b;
+    struct bench_reader *r;
+    struct bench_zipf z;
+    pthread_t rtid;
+    uint64_t seed, t0, t1, total = 0;
+    uint64_t *hist;
+    unsigned long hits = 0, j;
+    uint32_t i, n = 0;
+    const int kmix = (0 == strcmp(mix, "zipf")) ? 1
+                   : (0 == strcmp(mix, "miss")) ? 2
+                   : (0 == strcmp(mix, "uniform")) ? 0 : -1;
+    const int cold = (0 == strcmp(cache, "cold")) ? 1
+                   : (0 == strcmp(cache, "warm")) ? 0 : -1;
+    const size_t flen = strlen(fname);
+    int rc = MCDB_ERROR_MALLOC;
+
+    if (kmix == -1 || cold == -1 || nrec == 0 || (kmix == 2 && nrec > 9999999))
+        return MCDB_ERROR_USAGE;
+    memset(&b, '\0', sizeof(b));
+    memset(&z, '\0', sizeof(z));
+    b.fname = fname;
+    b.refresh_ms = refresh_ms;
+    if ((r = calloc(nthreads, sizeof(*r))) == NULL
+        || (hist = calloc(BENCH_HIST, sizeof(*hist))) == NULL
+        || pthread_mutex_init(&b.mutex, NULL) != 0
+        || pthread_cond_init(&b.cond, NULL) != 0)
+        return MCDB_ERROR_MALLOC;
+    if (refresh_ms) {
+        if ((b.alt[0] = malloc(flen + 8)) == NULL
+            || (b.alt[1] = malloc(flen + 8)) == NULL
+            || (b.tmp = malloc(flen + 8)) == NULL)
+            goto done;
+        snprintf(b.alt[0], flen + 8, "%s.bencha", fname);
+        snprintf(b.alt[1], flen + 8, "%s.benchb", fname);
+        snprintf(b.tmp,    flen + 8, "%s.bencht", fname);
+        if (bench_copy(fname, b.alt[0]) != 0
+            || bench_copy(fname, b.alt[1]) != 0) {
+            rc = MCDB_ERROR_WRITE;
+            goto done;
+        }
+    }
+
+    /* keys (generated before timed run) */
+    if (kmix == 1)
+        bench_zipf_init(&z, nrec, 0.99);
+    for (i = 0; i < nthreads; ++i) {
+        r[i].b = &b;
+        r[i].n = nq;
+        if ((r[i].keys = malloc(nq * 8)) == NULL)
+            goto done;
+        seed = UINT64_C(0x9E3779B97F4A7C15) * (i + 1);
+        for (j = 0; j < nq; ++j) {
+            const unsigned long u = (kmix == 0)
+              ? (unsigned long)(bench_rand(&seed) % nrec)
+              : (kmix == 2)
+              ? (unsigned long)(bench_rand(&seed) % (nrec * 10))
+              : (unsigned long)
+                ((bench_zipf_rank(&z, &seed) * UINT64_C(2654435761)) % nrec);
+            bench_key(r[i].keys + j * 8, u);
+        }
+    }
+
+    /* page cache */
+    if (cold) {
+        bench_evict(fname);
+        if (refresh_ms) {
+            bench_evict(b.alt[0]);
+            bench_evict(b.alt[1]);
+        }
+    }
+    b.map = mcdb_mmap_create(NULL, NULL, fname, malloc, free);
+    if (b.map == NULL) {
+        rc = MCDB_ERROR_READ;
+        goto done;
+    }
+    if (!cold) {
+        mcdb_mmap_prefault(b.map);
+        for (j = 0; j < b.map->size; j += 4096)
+            bench_sink = b.map->ptr[j];
+    }
+
+    for (n = 0; n < nthreads; ++n) {
+        if (pthread_create(&r[n].tid, NULL, bench_reader, r + n) != 0)
+            break;
+    }
+    if (refresh_ms && pthread_create(&rtid, NULL, bench_refresher, &b) != 0)
+        b.refresh_ms = 0;
+    pthread_mutex_lock(&b.mutex);
+    b.go = 1;
+    pthread_cond_broadcast(&b.cond);
+    pthread_mutex_unlock(&b.mutex);
+    t0 = bench_now();
+    for (i = 0; i < n; ++i)
+        pthread_join(r[i].tid, NULL);
+    t1 = bench_now();
+    pthread_mutex_lock(&b.mutex);
+    b.done = 1;
+    pthread_cond_broadcast(&b.cond);
+    pthread_mutex_unlock(&b.mutex);
+    if (b.refresh_ms)
+        pthread_join(rtid, NULL);
+
+    for (i = 0; i < n; ++i) {
+        hits += r[i].hits;
+        for (j = 0; j < BENCH_HIST; ++j)
+            hist[j] += r[i].hist[j];
+    }
+    for (j = 0; j < BENCH_HIST; ++j)
+        total += hist[j];
+    for (j = BENCH_HIST; j && !hist[j-1]; --j)
+        ;
+    printf("bench=query mix=%s cache=%s threads=%u refresh_ms=%u queries=%llu"
+           " hits=%lu swaps=%lu secs=%.6f qps=%.0f p50_ns=%llu p99_ns=%llu"
+           " p999_ns=%llu max_ns=%llu\n",
+           mix, cache, n, refresh_ms, (unsigned long long)total, hits,
+           b.swaps, (double)(t1 - t0) / 1e9,
+           t1 > t0 ? (double)total * 1e9 / (double)(t1 - t0) : 0.0,
+           (unsigned long long)bench_hist_pct(hist, total, 0.50),
+           (unsigned long long)bench_hist_pct(hist, total, 0.99),
+           (unsigned long long)bench_hist_pct(hist, total, 0.999),
+           (unsigned long long)(j ? bench_hist_val((uint32_t)j-1) : 0));
+    fflush(stdout);
+    rc = (n == nthreads) ? EXIT_SUCCESS : MCDB_ERROR_MALLOC;
+
+  done:
+    if (b.map != NULL)
+        mcdb_mmap_destroy(b.map);
+    pthread_cond_destroy(&b.cond);
+    pthread_mutex_destroy(&b.mutex);
+    if (b.alt[0]) unlink(b.alt[0]);
+    if (b.alt[1]) unlink(b.alt[1]);
+    free(b.alt[0]);
+    free(b.alt[1]);
+    free(b.tmp);
+    for (i = 0; i < nthreads; ++i)
+        free(r[i].keys);
+    free(hist);
+    free(r);
+    return rc;
+}
+
+struct bench_writer {
+  struct mcdb_make w;
+  pthread_t tid;
+  unsigned long u;
+  unsigned long e;
+  int fd;
+};
+
+static void *
+bench_writer (void *arg)
+{
+    struct bench_writer * const t = (struct bench_writer *)arg;
+    char buf[8];
+    for (; t->u < t->e; ++t->u) { /* records [u, e) (same as serial order) */
+        bench_key(buf, t->u);
+        if (0 != mcdb_make_add(&t->w,buf,8,buf,8))
+            break;
+    }
+    return NULL;
+}
+
+static int
+bench_make (const char * const fname, const unsigned long e,
+            const char * const mode, const uint32_t nthreads)
+{
+    struct mcdb_make m;
+    struct bench_writer *t = NULL;
+    struct stat st;
+    char buf[8];
+    uint64_t t0, t1;
+    unsigned long u = 0, i;
+    const uint32_t nw = (0 == strcmp(mode, "writers")) ? nthreads : 0;
+    int fd, rc;
+
+    if (e > 100000000u || (nw && (t = calloc(nw, sizeof(*t))) == NULL))
+        return MCDB_ERROR_USAGE;
+    unlink(fname);     /* unlink for repeatable test; ignore error if missing */
+    if ((fd = open(fname, O_RDWR|O_CREAT, 0666)) == -1)
+        return MCDB_ERROR_WRITE;
+    t0 = bench_now();
+    if (mcdb_make_start(&m, fd, malloc, free) != 0) {
+        close(fd);
+        return MCDB_ERROR_WRITE;
+    }
+    if      (0 == strcmp(mode, "fast")) {
+        m.hash_fn   = uint32_hash_fast;
+        m.hash_init = UINT32_HASH_FAST_INIT;
+    }
+    else if (0 == strcmp(mode, "bucket"))  m.layout = MCDB_FMT_LAYOUT_BUCKET;
+    else if (0 == strcmp(mode, "packed"))  m.layout = MCDB_FMT_LAYOUT_PACKED;
+    else if (0 == strcmp(mode, "native"))  m.index_native = 1;
+    else if (0 == strcmp(mode, "mphf"))    m.mphf = 1;
+    else if (0 == strcmp(mode, "bloom"))   m.bloom_bits = 10;
+    else if (0 == strcmp(mode, "sorted"))  m.sorted = 1;
+    else if (0 == strcmp(mode, "share"))   m.valshare = 1;
+    else if (0 == strcmp(mode, "write"))   m.io = MCDB_MAKE_IO_WRITE;
+    else if (0 == strcmp(mode, "fill"))    m.nthreads = nthreads;
+    else if (0 != strcmp(mode, "classic") && !nw) {
+        mcdb_make_destroy(&m);
+        close(fd);
+        return MCDB_ERROR_USAGE;
+    }
+
+    if (nw) {
+        /* each writer appends to private segment in unlinked temp file */
+        for (i = 0; i < nw; ++i) {
+            char fntmp[] = "/tmp/testmcdbbench.XXXXXX";
+            t[i].u = e / nw * i;
+            t[i].e = (i == nw-1) ? e : e / nw * (i+1);
+            if ((t[i].fd = mkstemp(fntmp)) == -1
+                || unlink(fntmp) != 0
+                || mcdb_make_writer_start(&t[i].w, &m, t[i].fd) != 0
+                || pthread_create(&t[i].tid, NULL, bench_writer, t+i) != 0)
+                return MCDB_ERROR_WRITE;
+        }
+        for (i = 0; i < nw; ++i) {
+            pthread_join(t[i].tid, NULL);
+            if (t[i].u == t[i].e)
+                u += t[i].e - (e / nw * i);
+        }
+    }
+    else {
+        for (; u < e; ++u) {
+            bench_key(buf, u);
+            if (0 != mcdb_make_add(&m, buf, 8, buf, 8))
+                break;
+        }
+    }
+    rc = (u == e && mcdb_make_finish(&m) == 0 && fstat(fd, &st) == 0);
+    t1 = bench_now();
+    if (close(fd) != 0)
+        rc = 0;
+    for (i = 0; i < nw; ++i)
+        close(t[i].fd);
+    free(t);
+    if (!rc)
+        return MCDB_ERROR_WRITE;
+    printf("bench=make mode=%s threads=%u records=%lu bytes=%llu secs=%.6f"
+           " rps=%.0f\n", mode, nw ? nw : (m.nthreads ? m.nthreads : 1), e,
+           (unsigned long long)st.st_size, (double)(t1 - t0) / 1e9,
+           t1 > t0 ? (double)e * 1e9 / (double)(t1 - t0) : 0.0);
+    fflush(stdout);
+    return EXIT_SUCCESS;
+}
+
+/* hash function is chosen per mcdb; lookups on registered struct mcdb must
+ * move to new map (mcdb_thread_refresh_self()) before hashing key */
+static int
+bench_refresh (const char * const fname, const unsigned long nrec)
+{
+    struct mcdb_mmap *map;
+    struct mcdb m[3];   /*(m[0] for mcdb_find(); m[1..2] mcdb_find_batch())*/
+    char k[2][8];
+    const char *keys[2] = { k[0], k[1] };
+    size_t klens[2] = { 8, 8 };
+    unsigned long hits = 0, swaps = 0;
+    uint32_t i;
+    int rc = bench_make(fname, nrec, "classic", 1);
+    if (rc != EXIT_SUCCESS)
+        return rc;
+    if ((map = mcdb_mmap_create(NULL, NULL, fname, malloc, free)) == NULL)
+        return MCDB_ERROR_READ;
+    memset(m, '\0', sizeof(m));
+    for (i = 0; i < 3; ++i)
+        m[i].map = mcdb_mmap_thread_registration(&map, MCDB_REGISTER_USE_INCR);
+    bench_key(k[0], 0);
+    bench_key(k[1], nrec - 1);
+    for (i = 0; i < 2 && rc == EXIT_SUCCESS; ++i) {
+        rc = bench_make(fname, nrec, (i == 0) ? "fast" : "classic", 1);
+        if (rc != EXIT_SUCCESS)
+            break;
+        if (!mcdb_mmap_reopen_threadsafe(&map)) {
+            rc = MCDB_ERROR_READ;
+            break;
+        }
+        ++swaps;
+        hits += mcdb_find(m, k[1], 8);
+        hits += mcdb_find_batch(m+1, 2, keys, klens);
+    }
+    for (i = 0; i < 3; ++i)
+        (void)mcdb_mmap_thread_registration(&m[i].map, MCDB_REGISTER_USE_DECR);
+    mcdb_mmap_destroy(map);
+    if (rc != EXIT_SUCCESS)
+        return rc;
+    printf("bench=refresh records=%lu swaps=%lu lookups=%lu hits=%lu\n",
+           nrec, swaps, swaps * 3, hits);
+    fflush(stdout);
+    return EXIT_SUCCESS;
+}
+
+static int
+bench_suite (const char * const fname, const unsigned long nrec,
+             const uint32_t nthreads, const unsigned long nq)
+{
+    static const char * const modes[] = { "bucket", "packed", "native",
+      "mphf", "bloom", "sorted", "share", "write", "fill", "writers",
+      "classic" };
+    static const char * const mixes[] = { "uniform", "zipf", "miss" };
+    uint32_t i, j, c, f;
+    int rc = EXIT_SUCCESS;
+    for (i = 0; i < sizeof(modes)/sizeof(*modes) && rc == EXIT_SUCCESS; ++i)
+        rc = bench_make(fname, nrec, modes[i],
+                        (0 == strcmp(modes[i], "fill")
+                         || 0 == strcmp(modes[i], "writers")) ? nthreads : 1);
+    for (i = 0; i < 2 && rc == EXIT_SUCCESS; ++i) {
+        /* (1 thread, then nthreads (skipped if 1)) */
+        if (i == 1 && nthreads == 1)
+            break;
+        for (j = 0; j < sizeof(mixes)/sizeof(*mixes); ++j) {
+            for (c = 0; c < 2; ++c) {
+                for (f = 0; f < 2 && rc == EXIT_SUCCESS; ++f)
+                    rc = bench_query(fname, nrec, i ? nthreads : 1, nq,
+                                     mixes[j], c ? "cold" : "warm",
+                                     f ? 10 : 0);
+            }
+        }
+    }
+    return rc;
+}
+
+int
+main (int argc, char **argv)
+{
+    const char *mode = "classic";
+    const char *mix = "uniform";
+    const char *cache = "warm";
+    unsigned long nq = 1000000;
+    unsigned long nrec, v;
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t nthreads = (ncpu > 0 && ncpu <= BENCH_THREADS_MAX)
+      ? (uint32_t)ncpu
+      : 1;
+    uint32_t refresh_ms = 0;
+    char *endptr;
+    int i, rc;
+    if (argc < 4)
+        return mcdb_error(MCDB_ERROR_USAGE, "testmcdbbench",
+                          "testmcdbbench make|query|suite|refresh [opts]"
+                          " <fname> <n>");
+    for (i = 2; i + 2 < argc; i += 2) {
+        const char * const arg = argv[i+1];
+        v = strtoul(arg, &endptr, 10);
+        if (0 == strcmp(argv[i], "-m"))
+            mode = arg;
+        else if (0 == strcmp(argv[i], "-k"))
+            mix = arg;
+        else if (0 == strcmp(argv[i], "-c"))
+            cache = arg;
+        else if (*endptr != '\0' || endptr == arg)
+            break;
+        else if (0 == strcmp(argv[i], "-j") || 0 == strcmp(argv[i], "-t")) {
+            if (v == 0 || v > BENCH_THREADS_MAX)
+                break;
+            nthreads = (uint32_t)v;
+        }
+        else if (0 == strcmp(argv[i], "-n") && v != 0)
+            nq = v;
+        else if (0 == strcmp(argv[i], "-r") && v <= 60000)
+            refresh_ms = (uint32_t)v;
+        else
+            break;
+    }
+    nrec = strtoul(argv[argc-1], &endptr, 10);
+    if (i + 2 != argc || *endptr != '\0' || nrec == 0 || nrec > 99999999)
+        rc = MCDB_ERROR_USAGE;
+    else if (0 == strcmp(argv[1], "make"))
+        rc = bench_make(argv[argc-2], nrec, mode, nthreads);
+    else if (0 == strcmp(argv[1], "query"))
+        rc = bench_query(argv[argc-2], nrec, nthreads, nq, mix, cache,
+                         refresh_ms);
+    else if (0 == strcmp(argv[1], "suite"))
+        rc = bench_suite(argv[argc-2], nrec, nthreads, nq);
+    else if (0 == strcmp(argv[1], "refresh"))
+        rc = bench_refresh(argv[argc-2], nrec);
+    else
+        rc = MCDB_ERROR_USAGE;
+    return (rc == EXIT_SUCCESS)
+      ? EXIT_SUCCESS
+      : mcdb_error(rc, "testmcdbbench",
+                   "testmcdbbench make|query|suite|refresh [opts]"
+                   " <fname> <n>");
+}
@@ -22,9 +22,16 @@
 #ifndef _XOPEN_SOURCE
 #define _XOPEN_SOURCE 600
 #endif
+/* _GNU_SOURCE needed for F_ADD_SEALS on Linux */
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
 
 #include "mcdb.h"
 #include "mcdb_make.h"
+#include "mcdb_makefn.h"
 #include "mcdb_error.h"
 
 #include <sys/types.h>
@@ -34,6 +41,33 @@
 #include <stdlib.h>    /* malloc(), free(), strtoul() */
 #include <string.h>    /* memset() */
 #include <unistd.h>    /* close() */
+#include <pthread.h>   /* pthread_create(), pthread_join() */
+
+/* testmcdbmake <fname> <count> [writers]
+ * (writers > 0 generates records in parallel; one writer per thread)
+ * (fname "-" builds in-memory mcdb (mcdb_makefn_start_memfd()), looks up
+ *  each record in mcdb_makefn_mmap() map, and writes mcdb to stdout) */
+
+struct testmcdbmake_writer {
+  struct mcdb_make w;
+  pthread_t tid;
+  unsigned long u;
+  unsigned long e;
+  int fd;
+};
+
+static void *
+testmcdbmake_writer (void *arg)
+{
+    struct testmcdbmake_writer * const t = (struct testmcdbmake_writer *)arg;
+    char buf[16];
+    for (; t->u < t->e; ++t->u) { /* records [u, e) (same as serial order) */
+        snprintf(buf, sizeof(buf), "%08u", (unsigned int)t->u);/*generate rec*/
+        if (0 != mcdb_make_add(&t->w,buf,8,buf,8))             /*store record*/
+            break;
+    }
+    return NULL;
+}
 
 int
 main (int argc, char **argv)
@@ -41,21 +75,80 @@ main (int argc, char **argv)
     char buf[16];
     unsigned long u = 0;
     unsigned long e;
+    unsigned long n = 0;
+    unsigned long i;
     struct mcdb_make m;
+    struct testmcdbmake_writer *t = NULL;
     int fd;
+    bool memfd;
     if (argc < 3) return -1;
+    memfd = (argv[1][0] == '-' && argv[1][1] == '\0');
     e = strtoul(argv[2], NULL, 10);
     if (e > 100000000u) return -1;  /*(only 8 decimal chars below; can change)*/
-    unlink(argv[1]);   /* unlink for repeatable test; ignore error if missing */
-    if ((fd = open(argv[1],O_RDWR|O_CREAT,0666)) != -1
+    if (argc > 3 && ((n = strtoul(argv[3], NULL, 10)) > 256
+                     || (n && (t = calloc(n, sizeof(*t))) == NULL)))
+        return -1;
+    if (memfd)
+        fd = (mcdb_makefn_start_memfd(&m,"testmcdbmake",malloc,free) == 0)
+          ? m.fd
+          : -1;
+    else {
+        unlink(argv[1]); /* unlink for repeatable test; ignore err if missing */
+        fd = open(argv[1],O_RDWR|O_CREAT,0666);
+    }
+    if (fd != -1
         && mcdb_make_start(&m,fd,malloc,free) == 0) {
+        if (n) {
+            /* each writer appends to private segment in unlinked temp file */
+            for (i = 0; i < n; ++i) {
+                char fntmp[] = "/tmp/testmcdbmake.XXXXXX";
+                t[i].u = e / n * i;
+                t[i].e = (i == n-1) ? e : e / n * (i+1);
+                if ((t[i].fd = mkstemp(fntmp)) == -1
+                    || unlink(fntmp) != 0
+                    || mcdb_make_writer_start(&t[i].w, &m, t[i].fd) != 0
+                    || pthread_create(&t[i].tid,NULL,testmcdbmake_writer,t+i))
+                    return mcdb_error(MCDB_ERROR_WRITE, "testmake", "");
+            }
+            for (i = 0; i < n; ++i) {
+                pthread_join(t[i].tid, NULL);
+                if (t[i].u == t[i].e)
+                    u += t[i].e - (e / n * i);
+            }
+        }
+        else
         /* generate and store records (generate 8-byte key and use as value)  */
         do { snprintf(buf, sizeof(buf), "%08lu", u);         /*generate record*/
         } while (0 == mcdb_make_add(&m,buf,8,buf,8) && ++u < e);/*store record*/
     } else e = 1; /* !u */
+    if (memfd && u == e) { /* in-memory mcdb; query map without filesystem */
+        struct mcdb_mmap * const map = (mcdb_make_finish(&m) == 0)
+          ? mcdb_makefn_mmap(&m, NULL)
+          : NULL;
+        struct mcdb mm = { .map = map };
+        if (map == NULL)
+            return mcdb_error(MCDB_ERROR_READ, "testmake", "");
+        for (u = 0; u < e; ++u) {
+            snprintf(buf, sizeof(buf), "%08lu", u);
+            if (!mcdb_find(&mm,buf,8) || mcdb_datalen(&mm) != 8
+                || memcmp(mcdb_dataptr(&mm),buf,8) != 0)
+                break;
+        }
+      #ifdef F_ADD_SEALS
+        if (write(fd, buf, 1) != -1) /*(sealed read-only)*/
+            u = 0;
+      #endif
+        if (u != e || write(STDOUT_FILENO, map->ptr, map->size)
+                      != (ssize_t)map->size)
+            return mcdb_error(MCDB_ERROR_READ, "testmake", "");
+        mcdb_makefn_cleanup(&m);
+        mcdb_mmap_destroy(map);
+        return 0;
+    }
     return (u == e && mcdb_make_finish(&m) == 0 && close(fd) == 0)
       ? 0
       : mcdb_error(MCDB_ERROR_WRITE, "testmake", "");
+    /* (writer temp file fds remain open until exit) */
     /* Note: fdatasync(fd) not called before close() due to type of usage here.
      * See comments in mcdb_make.c:mcdb_mmap_commit() for when to use fsync()
      * or fdatasync(). */
@@ -38,6 +38,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -46,13 +47,20 @@ int main (int argc, char *argv[])
     const char *p;
     const char *end;
     struct mcdb m;
+    struct mcdb mb[64];
+    const char *keys[64];
+    size_t klens[64];
     struct mcdb_mmap map;
     struct stat st;
     int fd;
+    size_t i;
+    size_t n = 0;
     const unsigned int klen = 8;
     /* input stream must have keys of constant len 8 */
+    /* optional third arg is batch size (<= 64) for mcdb_find_batch() */
 
     if (argc < 3) return -1;
+    if (argc > 3 && ((n = (size_t)atoi(argv[3])) == 0 || n > 64)) return -1;
 
     /* open mcdb */
     if ((fd = open(argv[1], O_RDONLY, 0777)) == -1) {perror("open"); return -1;}
@@ -62,6 +70,10 @@ int main (int argc, char *argv[])
     memset(&m, '\0', sizeof(m));
     m.map = &map;
     mcdb_mmap_prefault(m.map);
+    for (i = 0; i < n; ++i) {
+        mb[i] = m;
+        klens[i] = klen;
+    }
 
     /* open input file */
     if ((fd = open(argv[2], O_RDONLY, 0777)) == -1) {perror("open"); return -1;}
@@ -75,7 +87,15 @@ int main (int argc, char *argv[])
 
     /* read each key from input mmap and query mcdb
      * (no error checking since key might not exist) */
-    for (end = p+st.st_size; p < end; p += klen)
+    end = p+st.st_size;
+    if (n) {
+        for (; (size_t)(end - p) >= n*klen; p += n*klen) {
+            for (i = 0; i < n; ++i)
+                keys[i] = p + i*klen;
+            (void) mcdb_find_batch(mb, n, keys, klens);
+        }
+    }
+    for (; p < end; p += klen)
         fd = mcdb_find(&m, p, klen); /*(reuse fd; avoid unused result warning)*/
     return 0;
 }
@@ -40,6 +40,14 @@ uint32_t uint32_hash_djb(uint32_t, const void * restrict, size_t);
 uint32_t uint32_hash_djb(uint32_t, const void * restrict, size_t);
 extern inline
 uint32_t uint32_hash_identity(uint32_t, const void * restrict, size_t);
+extern inline
+uint32_t uint32_hash_fast_tagged(uint32_t, unsigned char,
+                                 const void * restrict, size_t);
+uint32_t uint32_hash_fast_tagged(uint32_t, unsigned char,
+                                 const void * restrict, size_t);
+extern inline
+uint32_t uint32_hash_fast(uint32_t, const void * restrict, size_t);
+uint32_t uint32_hash_fast(uint32_t, const void * restrict, size_t);
 uint32_t uint32_hash_identity(uint32_t, const void * restrict, size_t);
 
 extern inline
@@ -145,3 +153,84 @@ uint32_to_ascii_base10_loop (uint32_t x, char * const restrict buf)
     memcpy(buf, b+i, 12-i);
     return (uint32_t)(12-i);
 }
+
+/* CRC32C (Castagnoli polynomial 0x1EDC6F41; bit-reflected 0x82F63B78)
+ * (hardware instructions process 8 bytes per instruction; table-driven
+ *  fallback processes 4 bits per lookup in 16-entry table (64 bytes), which
+ *  is slower than larger tables, but is small and needs no initialization) */
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+static uint32_t
+uint32_crc32c_sw (uint32_t crc, const unsigned char * restrict p, size_t sz)
+  __attribute_nonnull__  __attribute_pure__;
+static uint32_t
+uint32_crc32c_sw (uint32_t crc, const unsigned char * restrict p, size_t sz)
+{
+    static const uint32_t t[16] = {
+      0x00000000u, 0x105EC76Fu, 0x20BD8EDEu, 0x30E349B1u,
+      0x417B1DBCu, 0x5125DAD3u, 0x61C69362u, 0x7198540Du,
+      0x82F63B78u, 0x92A8FC17u, 0xA24BB5A6u, 0xB21572C9u,
+      0xC38D26C4u, 0xD3D3E1ABu, 0xE330A81Au, 0xF36E6F75u
+    };
+  #if defined(__ARM_FEATURE_CRC32)
+    for (; sz && ((uintptr_t)p & 7); --sz)
+        crc = __crc32cb(crc, *p++);
+    for (; sz >= 8; sz -= 8, p += 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        crc = __crc32cd(crc, w);
+    }
+    for (; sz; --sz)
+        crc = __crc32cb(crc, *p++);
+    (void)t;
+  #else
+    for (; sz; --sz) {
+        crc ^= *p++;
+        crc = (crc >> 4) ^ t[crc & 15];
+        crc = (crc >> 4) ^ t[crc & 15];
+    }
+  #endif
+    return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__) \
+ && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define UINT32_CRC32C_SSE42
+__attribute__((__target__("sse4.2")))
+static uint32_t
+uint32_crc32c_sse42 (uint32_t crc, const unsigned char * restrict p, size_t sz)
+  __attribute_nonnull__  __attribute_pure__;
+__attribute__((__target__("sse4.2")))
+static uint32_t
+uint32_crc32c_sse42 (uint32_t crc, const unsigned char * restrict p, size_t sz)
+{
+    uint64_t c;
+    for (; sz && ((uintptr_t)p & 7); --sz)
+        crc = __builtin_ia32_crc32qi(crc, *p++);
+    for (c = crc; sz >= 8; sz -= 8, p += 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        c = __builtin_ia32_crc32di(c, w);
+    }
+    for (crc = (uint32_t)c; sz; --sz)
+        crc = __builtin_ia32_crc32qi(crc, *p++);
+    return crc;
+}
+#endif
+
+uint32_t
+uint32_crc32c(const uint32_t crc, const void * const restrict buf,
+              const size_t sz)
+{
+    const unsigned char * const restrict p = (const unsigned char *)buf;
+  #if defined(UINT32_CRC32C_SSE42)
+   #ifndef __SSE4_2__
+    if (__builtin_cpu_supports("sse4.2"))
+   #endif
+        return ~uint32_crc32c_sse42(~crc, p, sz);
+  #endif
+    return ~uint32_crc32c_sw(~crc, p, sz);
+}
@@ -28,6 +28,8 @@
 #include "plasma/plasma_stdtypes.h"
 PLASMA_ATTR_Pragma_once
 
+#include <string.h>  /* memcpy() */
+
 #ifndef UINT32_C99INLINE
 #define UINT32_C99INLINE C99INLINE
 #endif
@@ -116,6 +118,81 @@ uint32_hash_identity(uint32_t h       __attribute_unused__,
 #endif
 
 
+/* fast hash: 64-bit multiply and rotate over 8-byte words (xxHash64-class)
+ * (words are read big-endian so hash values are identical on all hosts)
+ * The first byte is mixed separately from the words which follow, so that a
+ * tag char passed apart from a key hashes the same as a key prefixed by tag:
+ *   uint32_hash_fast(h,"tkey",4) == uint32_hash_fast_tagged(h,'t',"key",3)
+ * (hash is not incremental; full key must be passed in single call) */
+
+#define UINT32_HASH_FAST_INIT 0u
+#define UINT32_HASH_FAST_P1 UINT64_C(0x9E3779B185EBCA87)
+#define UINT32_HASH_FAST_P2 UINT64_C(0xC2B2AE3D27D4EB4F)
+#define UINT32_HASH_FAST_P3 UINT64_C(0x165667B19E3779F9)
+
+#define uint32_hash_fast_round(x,w) \
+  ((x) ^= (w) * UINT32_HASH_FAST_P2, \
+   (x)  = (((x) << 31) | ((x) >> 33)) * UINT32_HASH_FAST_P1)
+
+__attribute_pure__
+UINT32_C99INLINE
+uint32_t
+uint32_hash_fast_tagged(uint32_t, unsigned char, const void * restrict, size_t)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
+PLASMA_ATTR_Pragma_no_side_effect(uint32_hash_fast_tagged)
+#ifdef UINT32_C99INLINE_FUNCS
+UINT32_C99INLINE
+uint32_t
+uint32_hash_fast_tagged(const uint32_t h, const unsigned char c,
+                        const void * const restrict vbuf, size_t sz)
+{
+    const unsigned char * restrict buf = (const unsigned char *)vbuf;
+    uint64_t x = ((uint64_t)h ^ UINT32_HASH_FAST_P3)
+               + (uint64_t)(sz + 1) * UINT32_HASH_FAST_P1;
+    uint64_t w = c;
+    uint32_hash_fast_round(x, w);
+    for (; __builtin_expect( (sz >= 8), 1); sz -= 8, buf += 8) {
+        memcpy(&w, buf, 8);
+        w = plasma_endian_be64ptoh(&w);
+        uint32_hash_fast_round(x, w);
+    }
+    if (sz) {
+        for (w = 0; sz; --sz)
+            w = (w << 8) | *buf++;
+        uint32_hash_fast_round(x, w);
+    }
+    x ^= x >> 33;
+    x *= UINT32_HASH_FAST_P2;
+    x ^= x >> 29;
+    x *= UINT32_HASH_FAST_P3;
+    x ^= x >> 32;
+    return (uint32_t)x;
+}
+#endif
+
+__attribute_pure__
+UINT32_C99INLINE
+uint32_t
+uint32_hash_fast(uint32_t, const void * restrict, size_t)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
+PLASMA_ATTR_Pragma_no_side_effect(uint32_hash_fast)
+#ifdef UINT32_C99INLINE_FUNCS
+UINT32_C99INLINE
+uint32_t
+uint32_hash_fast(const uint32_t h, const void * const restrict vbuf,
+                 const size_t sz)
+{
+    /*(empty key hashes same as key "\0"; collision is harmless)*/
+    const unsigned char * const restrict buf = (const unsigned char *)vbuf;
+    return (__builtin_expect( (sz != 0), 1))
+      ? uint32_hash_fast_tagged(h, buf[0], buf+1, sz-1)
+      : uint32_hash_fast_tagged(h, 0, buf, 0);
+}
+#endif
+
+
 /* 
  * branchless implementations for comparing two ints and selecting int results
  *
@@ -335,6 +412,16 @@ uint32_from_ascii4hex(const char * const restrict buf)
 PLASMA_ATTR_Pragma_no_side_effect(uint32_from_ascii4hex)
 
 
+/* CRC32C (Castagnoli polynomial, as in iSCSI (RFC 3720)) of buf, continuing
+ * from crc of preceding bytes (crc 0 for first buf), i.e.
+ *   uint32_crc32c(uint32_crc32c(0,a,alen),b,blen) is CRC32C of a followed by b
+ * (SSE4.2 or ARMv8 CRC32 instructions if available; else table-driven) */
+uint32_t  __attribute_pure__
+uint32_crc32c(uint32_t crc, const void * restrict buf, size_t sz)
+  __attribute_nonnull__  __attribute_warn_unused_result__
+  __attribute_nothrow__;
+PLASMA_ATTR_Pragma_no_side_effect(uint32_crc32c)
+
 /*
  * convert 32-bit unsigned/signed integer to ASCII string of base-10 digits
  * (and unsigned/signed char/short types which promote to int in registers)